@@ -28,4 +28,37 @@
 #define GZOCHI_COMMON_PROTOCOL_SESSION_DISCONNECTED 0x30
 #define GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE 0x31
 
+/* The payload of a session message batch is a sequence of session messages,
+   each one prefixed by its two-byte big-endian length. */
+
+#define GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH 0x32
+
+/* The payload of a compressed message is the opcode of the message it wraps
+   (a session message or a session message batch), followed by the two-byte
+   big-endian length of that message's uncompressed payload, followed by the
+   zlib-compressed payload itself. */
+
+#define GZOCHI_COMMON_PROTOCOL_COMPRESSED_MESSAGE 0x33
+
+/* Protocol extensions are negotiated by a client sending an options request
+   before its login request, with a one-byte payload holding the bitwise OR of
+   the options it supports. A server that understands the request replies with
+   an options response holding the subset of those options it has enabled for
+   the connection; a server that doesn't sends no reply, and neither side uses
+   any of the extensions. */
+
+#define GZOCHI_COMMON_PROTOCOL_OPTIONS_REQUEST 0x40
+#define GZOCHI_COMMON_PROTOCOL_OPTIONS_RESPONSE 0x41
+
+#define GZOCHI_COMMON_PROTOCOL_OPTION_BATCH 0x01
+#define GZOCHI_COMMON_PROTOCOL_OPTION_COMPRESSION 0x02
+
+/* Payloads shorter than this many bytes are never compressed. */
+
+#define GZOCHI_COMMON_PROTOCOL_COMPRESSION_THRESHOLD 256
+
+/* The maximum length of a message payload. */
+
+#define GZOCHI_COMMON_PROTOCOL_MAX_PAYLOAD_LENGTH 65535
+
 #endif /* GZOCHI_COMMON_PROTOCOL_H */
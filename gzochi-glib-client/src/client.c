@@ -56,6 +56,13 @@ typedef struct _GzochiSource
 static gboolean prepare (GSource *source, gint *timeout)
 {
   GzochiSource *gzochi_source = (GzochiSource *) source;
+
+  /* Poll for writability only while there are buffered messages to write. */
+
+  gzochi_source->poll_fd->events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+  if (gzochi_client_protocol_should_write (gzochi_source->session))
+    gzochi_source->poll_fd->events |= G_IO_OUT;
+
   return gzochi_client_common_session_is_dispatchable 
     (gzochi_source->session);
 }
@@ -65,6 +72,10 @@ static gboolean check (GSource *source)
   GzochiSource *gzochi_source = (GzochiSource *) source;
   GPollFD *poll_fd = gzochi_source->poll_fd;
 
+  if (poll_fd->revents & G_IO_OUT
+      && gzochi_client_protocol_flush (gzochi_source->session) < 0)
+    gzochi_source->session->connected = FALSE;
+
   if (poll_fd->revents & G_IO_IN)
     {
       if (gzochi_client_protocol_read (gzochi_source->session) < 0)
@@ -74,7 +85,8 @@ static gboolean check (GSource *source)
     }
   if (poll_fd->revents & G_IO_HUP || poll_fd->revents & G_IO_ERR)
     return TRUE;
-  return FALSE;
+  return gzochi_client_common_session_is_dispatchable 
+    (gzochi_source->session);
 }
 
 static gboolean dispatch (GSource *source, GSourceFunc cb, gpointer user_data)
@@ -86,6 +98,8 @@ static gboolean dispatch (GSource *source, GSourceFunc cb, gpointer user_data)
 static void finalize (GSource *source)
 {
   GzochiSource *gzochi_source = (GzochiSource *) source;
+
+  gzochi_source->session->source = NULL;
   free (gzochi_source->poll_fd);
 }
 
@@ -106,10 +120,44 @@ GzochiSource *gzochi_source_new (gzochi_glib_client_session *session)
 
   fcntl (session->socket, F_SETFL, O_NONBLOCK);
 
+  /* Once the session is attached to a source, sends no longer wait for the
+     socket to become writable; any bytes it doesn't accept are written by the
+     source when it does. */
+
+  session->nonblocking = TRUE;
+  session->source = (GSource *) source;
+
   source->session = session;
   return source;
 }
 
+/* Wakes up the main context to which the session's source is attached, if 
+   any, so that it begins polling for writability. */
+
+static void
+wake_source (gzochi_glib_client_session *session)
+{
+  GMainContext *context = NULL;
+
+  if (session->source != NULL)
+    context = g_source_get_context (session->source);
+  if (context != NULL)
+    g_main_context_wakeup (context);
+}
+
+/* Disconnects the session if the specified result of a send indicates an 
+   error; otherwise, if it left bytes in the outbound buffer, arranges for them
+   to be written. */
+
+static void
+handle_send_result (gzochi_glib_client_session *session, int result)
+{
+  if (result < 0)
+    gzochi_client_common_session_disconnect (session);
+  else if (result > 0 && gzochi_client_protocol_should_write (session))
+    wake_source (session);
+}
+
 static int 
 read_and_dispatch (gzochi_glib_client_session *session, int connecting)
 {
@@ -166,6 +214,11 @@ gzochi_glib_client_session *gzochi_glib_client_connect
   session->connected = TRUE;
   session->socket = sock;
 
+  /* Ask for the protocol extensions up front, without waiting for a reply; a
+     server that doesn't support them will ignore the request. */
+  
+  gzochi_client_protocol_send_options_request
+    (session, GZOCHI_CLIENT_PROTOCOL_SUPPORTED_OPTIONS);
   gzochi_client_protocol_send_login_request 
     (session, endpoint, credentials, credentials_length);
 
@@ -175,7 +228,7 @@ gzochi_glib_client_session *gzochi_glib_client_connect
     return session;
   else
     {
-      free (session);
+      gzochi_client_common_session_free (session);
       return NULL;
     }
 }
@@ -188,8 +241,18 @@ void gzochi_glib_client_disconnect (gzochi_glib_client_session *session)
 void gzochi_glib_client_send 
 (gzochi_glib_client_session *session, unsigned char *msg, short len)
 {
-  if (gzochi_client_protocol_send_session_message (session, msg, len) < 0)
-    gzochi_client_common_session_disconnect (session);
+  handle_send_result 
+    (session, gzochi_client_protocol_send_session_message (session, msg, len));
+}
+
+void gzochi_glib_client_begin_batch (gzochi_glib_client_session *session)
+{
+  gzochi_client_protocol_begin_batch (session);
+}
+
+void gzochi_glib_client_flush (gzochi_glib_client_session *session)
+{
+  handle_send_result (session, gzochi_client_protocol_end_batch (session));
 }
 
 char *gzochi_glib_client_session_endpoint (gzochi_glib_client_session *session)
@@ -49,4 +49,7 @@ void gzochi_glib_client_session_set_received_message_callback
 void gzochi_glib_client_send 
 (gzochi_glib_client_session *, unsigned char *, short);
 
+void gzochi_glib_client_begin_batch (gzochi_glib_client_session *);
+void gzochi_glib_client_flush (gzochi_glib_client_session *);
+
 #endif /* LIBGZOCHI_GLIB_H */
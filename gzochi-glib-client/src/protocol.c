@@ -15,6 +15,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <glib.h>
 #include <gzochi-common.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -22,7 +24,9 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "protocol.h"
 #include "session.h"
@@ -35,47 +39,258 @@
 #define SEND_FLAGS MSG_NOSIGNAL
 #endif
 
+/* Appends the specified bytes to the session's outbound buffer, growing it as
+   necessary. The caller must hold the session's outbound mutex. */
+
+static void
+append_outbound (gzochi_client_common_session *session, 
+		 const unsigned char *data, int len)
+{
+  if (session->outbound_length + len > session->outbound_capacity)
+    {
+      int capacity = MAX (session->outbound_capacity * 2,
+			  session->outbound_length + len);
+
+      session->outbound = realloc (session->outbound, capacity);
+      session->outbound_capacity = capacity;
+    }
+
+  memcpy (session->outbound + session->outbound_length, data, len);
+  session->outbound_length += len;
+}
+
+/* Writes the specified buffers to the socket with a single system call. 
+   Returns the number of bytes written, which is 0 if the socket is not ready 
+   for writing, or -1 on error. */
+
 static int 
-send_fully (int sock, unsigned char *data, int len)
+send_vector (int sock, struct iovec *iov, int iovcnt)
+{
+  struct msghdr msg;
+  int bytes_sent = 0;
+
+  memset (&msg, 0, sizeof (struct msghdr));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+
+  do
+    bytes_sent = sendmsg (sock, &msg, SEND_FLAGS);
+  while (bytes_sent < 0 && errno == EINTR);
+
+  if (bytes_sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 0;
+  else return bytes_sent;
+}
+
+static int 
+wait_writable (int sock)
 {
-  int total_sent = 0;
   fd_set wfds;
 
-  while (total_sent < len)
+  FD_ZERO (&wfds);
+  FD_SET (sock, &wfds);
+
+  return select (sock + 1, NULL, &wfds, NULL, NULL) < 0 ? -1 : 0;
+}
+
+/* Writes the contents of the session's outbound buffer to its socket. If the
+   session is non-blocking, only as many bytes as the socket will accept 
+   without blocking are written; otherwise, this function waits until the
+   buffer has been written in full. The caller must hold the session's 
+   outbound mutex.
+
+   Returns the number of bytes left in the buffer, or -1 on error. */
+
+static int 
+flush_outbound (gzochi_client_common_session *session)
+{
+  int offset = 0, ret = 0;
+
+  while (offset < session->outbound_length)
     {
+      struct iovec iov;
       int bytes_sent = 0;
 
-      FD_ZERO (&wfds);
-      FD_SET (sock, &wfds);
-      
-      if (select (sock + 1, NULL, &wfds, &wfds, NULL) < 0)
-	return -1;
+      iov.iov_base = session->outbound + offset;
+      iov.iov_len = session->outbound_length - offset;
+
+      bytes_sent = send_vector (session->socket, &iov, 1);
 
-      bytes_sent = send
-	(sock, (char *) data + total_sent, len - total_sent, SEND_FLAGS);
-      
       if (bytes_sent < 0)
-	return -1;
+	{
+	  ret = -1;
+	  break;
+	}
+      else if (bytes_sent == 0)
+	{
+	  if (session->nonblocking)
+	    break;
+	  else if (wait_writable (session->socket) < 0)
+	    {
+	      ret = -1;
+	      break;
+	    }
+	}
 
-      total_sent += bytes_sent;
+      offset += bytes_sent;
     }
 
-  return total_sent;
+  if (offset > 0)
+    {
+      memmove (session->outbound, session->outbound + offset,
+	       session->outbound_length - offset);
+      session->outbound_length -= offset;
+    }
+
+  return ret < 0 ? ret : session->outbound_length;
 }
 
+/* Frames the specified message and sends it, or adds it to the session's
+   outbound buffer if a batch is open or if earlier messages are still waiting
+   to be written. When nothing is waiting, the length prefix, opcode, and 
+   payload are written with a single `sendmsg' and only the portion that the
+   socket doesn't accept is buffered. The caller must hold the session's 
+   outbound mutex.
+
+   Returns the number of bytes left in the outbound buffer, or -1 on error. */
+
 static int 
-send_protocol_message (int sock, unsigned char opcode, unsigned char *message, 
-		       short len)
+send_frame (gzochi_client_common_session *session, unsigned char opcode,
+	    unsigned char *message, unsigned short len)
 {
-  unsigned char len_bytes[2] = { 0, 0 };
-  gzochi_common_io_write_short (len, len_bytes, 0);
-  if (send_fully (sock, len_bytes, 2) < 0)
-    return -1;
-  if (send_fully (sock, &opcode, 1) < 0)
-    return -1;
-  if (len > 0)
-    return send_fully (sock, message, len);
-  else return 0;
+  unsigned char header[3];
+  int ret = 0;
+
+  gzochi_common_io_write_short (len, header, 0);
+  header[2] = opcode;
+
+  if (session->batching || session->outbound_length > 0)
+    {
+      append_outbound (session, header, 3);
+      if (len > 0)
+	append_outbound (session, message, len);
+
+      ret = session->batching 
+	? session->outbound_length : flush_outbound (session);
+    }
+  else
+    {
+      struct iovec iov[2];
+      int bytes_sent = 0;
+
+      iov[0].iov_base = header;
+      iov[0].iov_len = 3;
+      iov[1].iov_base = message;
+      iov[1].iov_len = len;
+
+      bytes_sent = send_vector (session->socket, iov, len > 0 ? 2 : 1);
+
+      if (bytes_sent < 0)
+	ret = -1;
+      else
+	{
+	  if (bytes_sent < 3)
+	    {
+	      append_outbound (session, header + bytes_sent, 3 - bytes_sent);
+	      bytes_sent = 0;
+	    }
+	  else bytes_sent -= 3;
+
+	  if (bytes_sent < len)
+	    append_outbound (session, message + bytes_sent, len - bytes_sent);
+
+	  ret = session->outbound_length > 0 && ! session->nonblocking
+	    ? flush_outbound (session) : session->outbound_length;
+	}
+    }
+
+  return ret;
+}
+
+/* Sends the specified session message or session message batch, wrapped in a
+   compressed message if compression has been negotiated and the payload is 
+   long enough - and compresses well enough - to be worth it. The caller must
+   hold the session's outbound mutex.
+
+   Returns the number of bytes left in the outbound buffer, or -1 on error. */
+
+static int
+send_compressible_frame (gzochi_client_common_session *session,
+			 unsigned char opcode, unsigned char *message,
+			 unsigned short len)
+{
+  if (session->options & GZOCHI_COMMON_PROTOCOL_OPTION_COMPRESSION
+      && len >= GZOCHI_COMMON_PROTOCOL_COMPRESSION_THRESHOLD)
+    {
+      uLongf compressed_len = compressBound (len);
+      unsigned char *buffer = 
+	malloc (sizeof (unsigned char) * (compressed_len + 3));
+      int ret = 0;
+
+      if (compress2 (buffer + 3, &compressed_len, message, len, Z_BEST_SPEED)
+	  == Z_OK && compressed_len + 3 < len)
+	{
+	  buffer[0] = opcode;
+	  gzochi_common_io_write_short (len, buffer, 1);
+
+	  ret = send_frame (session, GZOCHI_COMMON_PROTOCOL_COMPRESSED_MESSAGE,
+			    buffer, compressed_len + 3);
+	  free (buffer);
+	  return ret;
+	}
+      else free (buffer);
+    }
+
+  return send_frame (session, opcode, message, len);
+}
+
+/* Frames the session messages gathered in the session's open batch, if any, 
+   and sends them; a single gathered message is sent as an ordinary session 
+   message. The caller must hold the session's outbound mutex.
+
+   Returns the number of bytes left in the outbound buffer, or -1 on error. */
+
+static int
+send_batch (gzochi_client_common_session *session)
+{
+  GByteArray *batch = session->batch;
+  int ret = session->outbound_length;
+
+  if (session->batch_count == 1)
+    ret = send_compressible_frame
+      (session, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE, batch->data + 2,
+       batch->len - 2);
+  else if (session->batch_count > 1)
+    ret = send_compressible_frame
+      (session, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH, batch->data,
+       batch->len);
+
+  g_byte_array_set_size (batch, 0);
+  session->batch_count = 0;
+
+  return ret;
+}
+
+/* Sends the specified message after any session messages gathered in the 
+   session's open batch, so that the two are never reordered.
+
+   Returns the number of bytes left in the outbound buffer, or -1 on error. */
+
+static int 
+send_protocol_message (gzochi_client_common_session *session, 
+		       unsigned char opcode, unsigned char *message, short len)
+{
+  int ret = 0;
+
+  g_mutex_lock (&session->outbound_mutex);
+
+  if (send_batch (session) >= 0)
+    ret = send_frame (session, opcode, message, len);
+  else ret = -1;
+  
+  g_mutex_unlock (&session->outbound_mutex);
+
+  return ret;
 }
 
 int 
@@ -92,7 +307,7 @@ gzochi_client_protocol_send_login_request
   memcpy (buffer + endpoint_len, credentials, len);
 
   ret = send_protocol_message 
-    (session->socket, GZOCHI_COMMON_PROTOCOL_LOGIN_REQUEST, buffer, buffer_len);
+    (session, GZOCHI_COMMON_PROTOCOL_LOGIN_REQUEST, buffer, buffer_len);
   free (buffer);
   return ret;
 }
@@ -101,21 +316,105 @@ int
 gzochi_client_protocol_send_disconnect (gzochi_client_common_session *session)
 {
   return send_protocol_message 
-    (session->socket, GZOCHI_COMMON_PROTOCOL_LOGOUT_REQUEST, NULL, 0);
+    (session, GZOCHI_COMMON_PROTOCOL_LOGOUT_REQUEST, NULL, 0);
+}
+
+int
+gzochi_client_protocol_send_options_request
+(gzochi_client_common_session *session, unsigned char options)
+{
+  return send_protocol_message
+    (session, GZOCHI_COMMON_PROTOCOL_OPTIONS_REQUEST, &options, 1);
 }
 
 int 
 gzochi_client_protocol_send_session_message 
 (gzochi_client_common_session *session, unsigned char *msg, short len)
 {
-  return send_protocol_message
-    (session->socket, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE, 
-     (unsigned char *) msg, len);
+  unsigned short msg_len = len;
+  GByteArray *batch = session->batch;
+  int ret = 0;
+
+  g_mutex_lock (&session->outbound_mutex);
+
+  if (session->batching 
+      && session->options & GZOCHI_COMMON_PROTOCOL_OPTION_BATCH
+      && msg_len + 2 <= GZOCHI_COMMON_PROTOCOL_MAX_PAYLOAD_LENGTH)
+    {
+      unsigned char len_bytes[2];
+
+      /* Make room in the batch frame, if necessary. */
+
+      if (batch->len + msg_len + 2 > GZOCHI_COMMON_PROTOCOL_MAX_PAYLOAD_LENGTH)
+	ret = send_batch (session);
+
+      gzochi_common_io_write_short (msg_len, len_bytes, 0);
+      g_byte_array_append (batch, len_bytes, 2);
+      g_byte_array_append (batch, msg, msg_len);
+      session->batch_count++;
+
+      if (ret >= 0)
+	ret = session->outbound_length + batch->len;
+    }
+  else if ((ret = send_batch (session)) >= 0)
+    ret = send_compressible_frame
+      (session, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE, msg, msg_len);
+
+  g_mutex_unlock (&session->outbound_mutex);
+
+  return ret;
+}
+
+void 
+gzochi_client_protocol_begin_batch (gzochi_client_common_session *session)
+{
+  g_mutex_lock (&session->outbound_mutex);
+  session->batching = TRUE;
+  g_mutex_unlock (&session->outbound_mutex);
+}
+
+int 
+gzochi_client_protocol_end_batch (gzochi_client_common_session *session)
+{
+  int ret = 0;
+
+  g_mutex_lock (&session->outbound_mutex);
+  session->batching = FALSE;
+  if ((ret = send_batch (session)) >= 0)
+    ret = flush_outbound (session);
+  g_mutex_unlock (&session->outbound_mutex);
+
+  return ret;
+}
+
+int 
+gzochi_client_protocol_flush (gzochi_client_common_session *session)
+{
+  int ret = 0;
+
+  g_mutex_lock (&session->outbound_mutex);
+  ret = session->batching 
+    ? session->outbound_length : flush_outbound (session);
+  g_mutex_unlock (&session->outbound_mutex);
+
+  return ret;
+}
+
+int 
+gzochi_client_protocol_should_write (gzochi_client_common_session *session)
+{
+  int ret = FALSE;
+
+  g_mutex_lock (&session->outbound_mutex);
+  ret = ! session->batching && session->outbound_length > 0;
+  g_mutex_unlock (&session->outbound_mutex);
+
+  return ret;
 }
 
 static void 
 dispatch_session_message (gzochi_client_common_session *session, 
-			  unsigned char *message, short len)
+			  unsigned char *message, unsigned short len)
 {
   if (session->received_message_callback != NULL)
     session->received_message_callback 
@@ -135,14 +434,87 @@ dispatch_session_disconnected (gzochi_client_common_session *session)
     }
 }
 
+/* Dispatches each of the session messages in the specified session message 
+   batch payload in turn. */
+
+static void
+dispatch_session_message_batch (gzochi_client_common_session *session,
+				unsigned char *payload, unsigned short len)
+{
+  unsigned short offset = 0;
+
+  while (len - offset >= 2)
+    {
+      unsigned short message_len = 
+	gzochi_common_io_read_short (payload, offset);
+
+      offset += 2;
+      if (message_len > len - offset)
+	break;
+
+      dispatch_session_message (session, payload + offset, message_len);
+      offset += message_len;
+    }
+}
+
+/* Decompresses the specified compressed message payload and dispatches the 
+   session message or session message batch within it. */
+
+static void
+dispatch_compressed_message (gzochi_client_common_session *session,
+			     unsigned char *payload, unsigned short len)
+{
+  unsigned char *buffer = NULL;
+  uLongf expected_len = 0, actual_len = 0;
+
+  if (len < 3)
+    return;
+
+  expected_len = (unsigned short) gzochi_common_io_read_short (payload, 1);
+  actual_len = expected_len;
+  buffer = malloc (sizeof (unsigned char) * MAX (expected_len, 1));
+
+  if (uncompress (buffer, &actual_len, payload + 3, len - 3) == Z_OK
+      && actual_len == expected_len)
+    {
+      if (payload[0] == GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE)
+	dispatch_session_message (session, buffer, actual_len);
+      else if (payload[0] == GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH)
+	dispatch_session_message_batch (session, buffer, actual_len);
+    }
+
+  free (buffer);
+}
+
+/* Records the protocol extensions the server has enabled for the 
+   connection. */
+
+static void
+dispatch_options_response (gzochi_client_common_session *session,
+			   unsigned char *payload, unsigned short len)
+{
+  if (len < 1)
+    return;
+  
+  g_mutex_lock (&session->outbound_mutex);
+  session->options = payload[0] & GZOCHI_CLIENT_PROTOCOL_SUPPORTED_OPTIONS;
+  g_mutex_unlock (&session->outbound_mutex);
+}
+
 static void 
 dispatch (gzochi_client_common_session *session, int opcode, 
-	  unsigned char *payload, short len)
+	  unsigned char *payload, unsigned short len)
 {
   switch (opcode)
     {
     case GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE:
       dispatch_session_message (session, payload, len); break;
+    case GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH:
+      dispatch_session_message_batch (session, payload, len); break;
+    case GZOCHI_COMMON_PROTOCOL_COMPRESSED_MESSAGE:
+      dispatch_compressed_message (session, payload, len); break;
+    case GZOCHI_COMMON_PROTOCOL_OPTIONS_RESPONSE:
+      dispatch_options_response (session, payload, len); break;
     case GZOCHI_COMMON_PROTOCOL_SESSION_DISCONNECTED:
       dispatch_session_disconnected (session); break;
  
@@ -160,8 +532,8 @@ attempt_dispatch (gzochi_client_common_session *session, int limit)
 
   while (limit == 0 || remaining > 0)
     {
-      short message_len = 0;
-      char opcode = 0x00;
+      unsigned short message_len = 0;
+      unsigned char opcode = 0x00;
 
       if (! session->connected)
 	{
@@ -178,9 +550,15 @@ attempt_dispatch (gzochi_client_common_session *session, int limit)
 
       opcode = session->buffer[offset + 2];
       dispatch (session, opcode, session->buffer + offset + 3, message_len);
-      dispatched++;
-      
       offset += 3 + message_len;
+
+      /* The options response is part of the connection handshake, and isn't
+	 of interest to callers waiting for a message. */
+      
+      if (opcode == GZOCHI_COMMON_PROTOCOL_OPTIONS_RESPONSE)
+	continue;
+
+      dispatched++;
       
       if (limit != 0)
 	remaining--;
@@ -18,14 +18,55 @@
 #ifndef LIBGZOCHI_GLIB_PROTOCOL_H
 #define LIBGZOCHI_GLIB_PROTOCOL_H
 
+#include <gzochi-common.h>
+
 #include "session.h"
 
+/* The protocol extensions this client is able to use. */
+
+#define GZOCHI_CLIENT_PROTOCOL_SUPPORTED_OPTIONS	\
+  (GZOCHI_COMMON_PROTOCOL_OPTION_BATCH		\
+   | GZOCHI_COMMON_PROTOCOL_OPTION_COMPRESSION)
+
+/* The following functions frame a protocol message and send it to the server,
+   or add it to the session's outbound buffer if a batch is open, if earlier 
+   messages are still waiting to be written, or if the session is 
+   non-blocking and its socket is not ready for writing. They return the number
+   of bytes left in the outbound buffer, or -1 if the socket could not be 
+   written. */
+
 int gzochi_client_protocol_send_login_request 
 (gzochi_client_common_session *, char *, unsigned char *, int);
 int gzochi_client_protocol_send_disconnect (gzochi_client_common_session *);
+int gzochi_client_protocol_send_options_request
+(gzochi_client_common_session *, unsigned char);
 int gzochi_client_protocol_send_session_message 
 (gzochi_client_common_session *, unsigned char *, short);
 
+/* Opens a batch, holding subsequently sent messages in the session's outbound
+   buffer until the batch is ended. If the server has agreed to the batch 
+   option, session messages sent during the batch are framed together as a 
+   single session message batch. */
+
+void gzochi_client_protocol_begin_batch (gzochi_client_common_session *);
+
+/* Ends the current batch, if any, and flushes the session's outbound buffer.
+   Returns the number of bytes left in the buffer, or -1 on error. */
+
+int gzochi_client_protocol_end_batch (gzochi_client_common_session *);
+
+/* Writes as much of the session's outbound buffer as possible (all of it, 
+   unless the session is non-blocking) unless a batch is open. Returns the 
+   number of bytes left in the buffer, or -1 on error. */
+
+int gzochi_client_protocol_flush (gzochi_client_common_session *);
+
+/* Returns `TRUE' if the session's outbound buffer holds bytes that should be
+   written as soon as the socket is ready; that is, if it is not empty and no
+   batch is open. */
+
+int gzochi_client_protocol_should_write (gzochi_client_common_session *);
+
 int gzochi_client_protocol_dispatch_all (gzochi_client_common_session *);
 int gzochi_client_protocol_dispatch (gzochi_client_common_session *);
 int gzochi_client_protocol_read (gzochi_client_common_session *);
@@ -63,6 +63,9 @@ gzochi_client_common_session_new (void)
   gzochi_client_common_session *session = 
     calloc (1, sizeof (gzochi_client_common_session));
 
+  g_mutex_init (&session->outbound_mutex);
+  session->batch = g_byte_array_new ();
+
   return session;
 }
 
@@ -84,6 +87,9 @@ gzochi_client_common_session_is_dispatchable
 void 
 gzochi_client_common_session_free (gzochi_client_common_session *session)
 {
+  g_mutex_clear (&session->outbound_mutex);
+  free (session->outbound);
+  g_byte_array_unref (session->batch);
   free (session);
 }
 
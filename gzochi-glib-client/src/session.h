@@ -18,6 +18,8 @@
 #ifndef LIBGZOCHI_GLIB_SESSION_H
 #define LIBGZOCHI_GLIB_SESSION_H
 
+#include <glib.h>
+
 #define GZOCHI_CLIENT_MAX_BUFFER_SIZE 65538
 
 struct _gzochi_client_common_session
@@ -32,6 +34,32 @@ struct _gzochi_client_common_session
   int socket;
   unsigned char buffer[GZOCHI_CLIENT_MAX_BUFFER_SIZE];
   int buffer_length;
+
+  /* Framed messages waiting to be written to the socket. The outbound buffer 
+     may be written to from a different thread than the one running the main
+     loop, so access to it is guarded by a mutex. */
+
+  GMutex outbound_mutex;
+  unsigned char *outbound;
+  int outbound_length;
+  int outbound_capacity;
+
+  int batching; /* Whether sent messages are held until the batch ends. */
+
+  /* While a batch is open on a connection that has negotiated batching, sent
+     session messages are gathered here as the length-prefixed entries of a
+     single session message batch, which is framed when the batch ends. */
+
+  GByteArray *batch;
+  int batch_count; /* The number of messages gathered. */
+
+  /* The protocol extensions negotiated with the server; a bitwise OR of 
+     `GZOCHI_COMMON_PROTOCOL_OPTION_' flags. */
+
+  int options;
+
+  int nonblocking; /* Whether writes may leave bytes in the buffer. */
+  GSource *source; /* The event source for the session, if any. */
   
   void (*disconnected_callback) (struct _gzochi_client_common_session *, 
 				 void *);
@@ -0,0 +1,461 @@
+/* test-protocol.c: Test routines for protocol.c in libgzochi-glib-client.
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <gzochi-common.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "protocol.h"
+#include "session.h"
+
+struct test_protocol_fixture
+{
+  gzochi_client_common_session *session;
+  int peer; /* The server's end of the session's socket pair. */
+};
+
+static void
+test_protocol_fixture_setup (struct test_protocol_fixture *fixture,
+			     gconstpointer user_data)
+{
+  int fds[2];
+
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+  fixture->session = gzochi_client_common_session_new ();
+  fixture->session->connected = TRUE;
+  fixture->session->socket = fds[0];
+  fixture->peer = fds[1];
+}
+
+static void
+test_protocol_fixture_teardown (struct test_protocol_fixture *fixture,
+				gconstpointer user_data)
+{
+  close (fixture->session->socket);
+  close (fixture->peer);
+  gzochi_client_common_session_free (fixture->session);
+}
+
+/* Appends a message to the specified byte array the way that the protocol
+   has always framed it, as a length prefix, an opcode, and a payload, written
+   one after the other. */
+
+static void
+append_frame (GByteArray *expected, unsigned char opcode,
+	      const unsigned char *payload, short len)
+{
+  unsigned char len_bytes[2] = { 0, 0 };
+
+  gzochi_common_io_write_short (len, len_bytes, 0);
+  g_byte_array_append (expected, len_bytes, 2);
+  g_byte_array_append (expected, &opcode, 1);
+  g_byte_array_append (expected, payload, len);
+}
+
+/* Reads exactly the number of bytes in the specified expected byte array from
+   the peer socket, and asserts that they match. */
+
+static void
+assert_received (int peer, GByteArray *expected)
+{
+  unsigned char *actual = g_malloc (expected->len);
+  int offset = 0;
+
+  while (offset < expected->len)
+    {
+      int n = recv (peer, actual + offset, expected->len - offset, 0);
+      g_assert_cmpint (n, >, 0);
+      offset += n;
+    }
+
+  g_assert (memcmp (actual, expected->data, expected->len) == 0);
+  g_free (actual);
+}
+
+static void
+assert_nothing_received (int peer)
+{
+  unsigned char buf[1];
+
+  g_assert_cmpint (recv (peer, buf, 1, MSG_DONTWAIT), ==, -1);
+  g_assert (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void
+test_protocol_send_login_request (struct test_protocol_fixture *fixture,
+				  gconstpointer user_data)
+{
+  GByteArray *expected = g_byte_array_new ();
+
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_LOGIN_REQUEST,
+		(unsigned char *) "test\0creds", 10);
+
+  g_assert_cmpint
+    (gzochi_client_protocol_send_login_request
+     (fixture->session, "test", (unsigned char *) "creds", 5), ==, 0);
+
+  assert_received (fixture->peer, expected);
+  g_byte_array_unref (expected);
+}
+
+static void
+test_protocol_send_disconnect (struct test_protocol_fixture *fixture,
+			       gconstpointer user_data)
+{
+  GByteArray *expected = g_byte_array_new ();
+
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_LOGOUT_REQUEST, NULL, 0);
+
+  g_assert_cmpint
+    (gzochi_client_protocol_send_disconnect (fixture->session), ==, 0);
+
+  assert_received (fixture->peer, expected);
+  g_byte_array_unref (expected);
+}
+
+static void
+test_protocol_send_session_message (struct test_protocol_fixture *fixture,
+				    gconstpointer user_data)
+{
+  GByteArray *expected = g_byte_array_new ();
+
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE,
+		(unsigned char *) "hello", 5);
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE,
+		(unsigned char *) "", 0);
+
+  g_assert_cmpint
+    (gzochi_client_protocol_send_session_message
+     (fixture->session, (unsigned char *) "hello", 5), ==, 0);
+  g_assert_cmpint
+    (gzochi_client_protocol_send_session_message
+     (fixture->session, (unsigned char *) "", 0), ==, 0);
+
+  assert_received (fixture->peer, expected);
+  g_byte_array_unref (expected);
+}
+
+static void
+test_protocol_batch (struct test_protocol_fixture *fixture,
+		     gconstpointer user_data)
+{
+  GByteArray *expected = g_byte_array_new ();
+
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE,
+		(unsigned char *) "foo", 3);
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE,
+		(unsigned char *) "bar", 3);
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_LOGOUT_REQUEST, NULL, 0);
+
+  gzochi_client_protocol_begin_batch (fixture->session);
+
+  g_assert_cmpint
+    (gzochi_client_protocol_send_session_message
+     (fixture->session, (unsigned char *) "foo", 3), ==, 6);
+  g_assert_cmpint
+    (gzochi_client_protocol_send_session_message
+     (fixture->session, (unsigned char *) "bar", 3), ==, 12);
+  g_assert_cmpint
+    (gzochi_client_protocol_send_disconnect (fixture->session), ==, 15);
+
+  /* Nothing is written until the batch ends, not even by a flush. */
+
+  g_assert (! gzochi_client_protocol_should_write (fixture->session));
+  g_assert_cmpint (gzochi_client_protocol_flush (fixture->session), ==, 15);
+  assert_nothing_received (fixture->peer);
+
+  g_assert_cmpint (gzochi_client_protocol_end_batch (fixture->session), ==, 0);
+
+  assert_received (fixture->peer, expected);
+  g_byte_array_unref (expected);
+}
+
+static void
+test_protocol_nonblocking (struct test_protocol_fixture *fixture,
+			   gconstpointer user_data)
+{
+  GByteArray *expected = g_byte_array_new ();
+  GByteArray *actual = g_byte_array_new ();
+  unsigned char payload[4096], buf[4096];
+  int i = 0, pending = 0;
+
+  fcntl (fixture->session->socket, F_SETFL, O_NONBLOCK);
+  fixture->session->nonblocking = TRUE;
+
+  /* Send more than the socket pair can buffer without the peer reading. */
+
+  for (; i < 1024; i++)
+    {
+      memset (payload, i % 256, 4096);
+      append_frame
+	(expected, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE, payload, 4096);
+
+      pending = gzochi_client_protocol_send_session_message
+	(fixture->session, payload, 4096);
+      g_assert_cmpint (pending, >=, 0);
+    }
+
+  g_assert_cmpint (pending, >, 0);
+  g_assert (gzochi_client_protocol_should_write (fixture->session));
+
+  /* Drain the peer end, flushing the rest of the buffer as room frees up. */
+
+  while (actual->len < expected->len)
+    {
+      int n = recv (fixture->peer, buf, 4096, MSG_DONTWAIT);
+
+      if (n > 0)
+	g_byte_array_append (actual, buf, n);
+      else g_assert (errno == EAGAIN || errno == EWOULDBLOCK);
+
+      g_assert_cmpint (gzochi_client_protocol_flush (fixture->session), >=, 0);
+    }
+
+  g_assert (! gzochi_client_protocol_should_write (fixture->session));
+  g_assert_cmpint (actual->len, ==, expected->len);
+  g_assert (memcmp (actual->data, expected->data, expected->len) == 0);
+
+  g_byte_array_unref (expected);
+  g_byte_array_unref (actual);
+}
+
+static void
+test_protocol_send_options_request (struct test_protocol_fixture *fixture,
+				    gconstpointer user_data)
+{
+  GByteArray *expected = g_byte_array_new ();
+
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_OPTIONS_REQUEST,
+		(unsigned char *) "\x03", 1);
+
+  g_assert_cmpint
+    (gzochi_client_protocol_send_options_request (fixture->session, 0x03),
+     ==, 0);
+
+  assert_received (fixture->peer, expected);
+  g_byte_array_unref (expected);
+}
+
+static void
+test_protocol_batch_negotiated (struct test_protocol_fixture *fixture,
+				gconstpointer user_data)
+{
+  GByteArray *expected = g_byte_array_new ();
+
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH,
+		(unsigned char *) "\x00\x03" "foo" "\x00\x03" "bar", 10);
+  append_frame (expected, GZOCHI_COMMON_PROTOCOL_LOGOUT_REQUEST, NULL, 0);
+
+  fixture->session->options = GZOCHI_COMMON_PROTOCOL_OPTION_BATCH;
+  gzochi_client_protocol_begin_batch (fixture->session);
+
+  g_assert_cmpint
+    (gzochi_client_protocol_send_session_message
+     (fixture->session, (unsigned char *) "foo", 3), ==, 5);
+  g_assert_cmpint
+    (gzochi_client_protocol_send_session_message
+     (fixture->session, (unsigned char *) "bar", 3), ==, 10);
+
+  /* The batch is framed before any other kind of message is sent. */
+  
+  g_assert_cmpint
+    (gzochi_client_protocol_send_disconnect (fixture->session), ==, 16);
+  assert_nothing_received (fixture->peer);
+
+  g_assert_cmpint (gzochi_client_protocol_end_batch (fixture->session), ==, 0);
+
+  assert_received (fixture->peer, expected);
+  g_byte_array_unref (expected);
+}
+
+static void
+test_protocol_send_compressed (struct test_protocol_fixture *fixture,
+			       gconstpointer user_data)
+{
+  unsigned char payload[1024], uncompressed[1024], header[3], *frame = NULL;
+  uLongf uncompressed_len = 1024;
+  unsigned short frame_len = 0;
+
+  fixture->session->options = GZOCHI_COMMON_PROTOCOL_OPTION_COMPRESSION;
+  memset (payload, 'a', 1024);
+
+  g_assert_cmpint
+    (gzochi_client_protocol_send_session_message
+     (fixture->session, payload, 1024), ==, 0);
+
+  g_assert_cmpint (recv (fixture->peer, header, 3, MSG_WAITALL), ==, 3);
+  g_assert_cmpint (header[2], ==, GZOCHI_COMMON_PROTOCOL_COMPRESSED_MESSAGE);
+
+  frame_len = gzochi_common_io_read_short (header, 0);
+  g_assert_cmpint (frame_len, <, 1024);
+
+  frame = g_malloc (frame_len);
+  g_assert_cmpint
+    (recv (fixture->peer, frame, frame_len, MSG_WAITALL), ==, frame_len);
+
+  g_assert_cmpint (frame[0], ==, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE);
+  g_assert_cmpint (gzochi_common_io_read_short (frame, 1), ==, 1024);
+  g_assert_cmpint
+    (uncompress (uncompressed, &uncompressed_len, frame + 3, frame_len - 3),
+     ==, Z_OK);
+  g_assert_cmpint (uncompressed_len, ==, 1024);
+  g_assert (memcmp (uncompressed, payload, 1024) == 0);
+
+  g_free (frame);
+}
+
+/* A received message callback that appends each message, followed by a 
+   separator, to the `GByteArray' passed as user data. */
+
+static void
+collect_message (gzochi_client_common_session *session, unsigned char *msg,
+		 unsigned short len, void *user_data)
+{
+  GByteArray *messages = user_data;
+
+  g_byte_array_append (messages, msg, len);
+  g_byte_array_append (messages, (unsigned char *) "|", 1);
+}
+
+/* Copies the specified bytes into the session's receive buffer. */
+
+static void
+receive (gzochi_client_common_session *session, const unsigned char *data,
+	 int len)
+{
+  memcpy (session->buffer + session->buffer_length, data, len);
+  session->buffer_length += len;
+}
+
+static void
+test_protocol_dispatch_options_response (struct test_protocol_fixture *fixture,
+					 gconstpointer user_data)
+{
+  receive (fixture->session, (unsigned char *) "\x00\x01\x41\xff", 4);
+
+  /* The options response isn't counted as a dispatched message, and options 
+     the client doesn't support are ignored. */
+  
+  g_assert_cmpint (gzochi_client_protocol_dispatch_all (fixture->session),
+		   ==, 0);
+  g_assert_cmpint (fixture->session->options, ==, 0x03);
+  g_assert_cmpint (fixture->session->buffer_length, ==, 0);
+}
+
+static void
+test_protocol_dispatch_batch (struct test_protocol_fixture *fixture,
+			      gconstpointer user_data)
+{
+  GByteArray *messages = g_byte_array_new ();
+
+  gzochi_client_common_session_set_received_message_callback
+    (fixture->session, collect_message, messages);
+
+  receive (fixture->session, (unsigned char *)
+	   "\x00\x0a\x32\x00\x03" "foo" "\x00\x03" "bar", 13);
+  receive (fixture->session, (unsigned char *) "\x00\x03\x31" "baz", 6);
+
+  g_assert_cmpint (gzochi_client_protocol_dispatch_all (fixture->session),
+		   ==, 2);
+  g_assert_cmpint (messages->len, ==, 12);
+  g_assert (memcmp (messages->data, "foo|bar|baz|", 12) == 0);
+
+  g_byte_array_unref (messages);
+}
+
+static void
+test_protocol_dispatch_compressed (struct test_protocol_fixture *fixture,
+				   gconstpointer user_data)
+{
+  GByteArray *messages = g_byte_array_new ();
+  unsigned char payload[1024], frame[1024];
+  uLongf compressed_len = 1018;
+
+  gzochi_client_common_session_set_received_message_callback
+    (fixture->session, collect_message, messages);
+
+  memset (payload, 'a', 1024);
+  g_assert_cmpint
+    (compress (frame + 6, &compressed_len, payload, 1024), ==, Z_OK);
+
+  gzochi_common_io_write_short (compressed_len + 3, frame, 0);
+  frame[2] = GZOCHI_COMMON_PROTOCOL_COMPRESSED_MESSAGE;
+  frame[3] = GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE;
+  gzochi_common_io_write_short (1024, frame, 4);
+
+  receive (fixture->session, frame, compressed_len + 6);
+
+  g_assert_cmpint (gzochi_client_protocol_dispatch_all (fixture->session),
+		   ==, 1);
+  g_assert_cmpint (messages->len, ==, 1025);
+  g_assert (memcmp (messages->data, payload, 1024) == 0);
+
+  g_byte_array_unref (messages);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/protocol/send/login-request", struct test_protocol_fixture,
+	      NULL, test_protocol_fixture_setup,
+	      test_protocol_send_login_request, test_protocol_fixture_teardown);
+  g_test_add ("/protocol/send/disconnect", struct test_protocol_fixture, NULL,
+	      test_protocol_fixture_setup, test_protocol_send_disconnect,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/send/session-message", struct test_protocol_fixture,
+	      NULL, test_protocol_fixture_setup,
+	      test_protocol_send_session_message,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/batch", struct test_protocol_fixture, NULL,
+	      test_protocol_fixture_setup, test_protocol_batch,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/nonblocking", struct test_protocol_fixture, NULL,
+	      test_protocol_fixture_setup, test_protocol_nonblocking,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/send/options-request", struct test_protocol_fixture,
+	      NULL, test_protocol_fixture_setup,
+	      test_protocol_send_options_request,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/batch/negotiated", struct test_protocol_fixture, NULL,
+	      test_protocol_fixture_setup, test_protocol_batch_negotiated,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/send/compressed", struct test_protocol_fixture, NULL,
+	      test_protocol_fixture_setup, test_protocol_send_compressed,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/dispatch/options-response",
+	      struct test_protocol_fixture, NULL, test_protocol_fixture_setup,
+	      test_protocol_dispatch_options_response,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/dispatch/batch", struct test_protocol_fixture, NULL,
+	      test_protocol_fixture_setup, test_protocol_dispatch_batch,
+	      test_protocol_fixture_teardown);
+  g_test_add ("/protocol/dispatch/compressed", struct test_protocol_fixture,
+	      NULL, test_protocol_fixture_setup,
+	      test_protocol_dispatch_compressed,
+	      test_protocol_fixture_teardown);
+
+  return g_test_run ();
+}
@@ -22,6 +22,7 @@
 	  gzochi:disconnect
 	  gzochi:pump-events
 	  gzochi:send
+	  gzochi:send-all
 
 	  gzochi:set-received-message-callback!
 	  gzochi:set-disconnected-callback!)
@@ -30,6 +31,7 @@
 	  (gzochi client protocol)
 	  (gzochi main-loop)
 	  (ice-9 threads)
+	  (prefix (system foreign) ffi:)
 	  (rnrs))
 
 ;; This is a reference implementation of a client for the gzochi game
@@ -93,7 +95,8 @@
 	    (mutable disconnect-acknowledged)
 	    buffer
 	    (mutable buffer-offset)
-	    send-mutex)
+	    send-mutex
+	    (mutable options))
 
     (protocol (lambda (n)
 		(lambda (socket)
@@ -105,9 +108,83 @@
 			      #:check check
 			      #:dispatch dispatch-all)))
 		    (p #f #f #t #f (make-bytevector max-buffer-size) 0
-		       (make-mutex)))))))
+		       (make-mutex) 0))))))
   
   (define (read-short bv off) (bytevector-u16-ref bv off (endianness big)))
+  (define (write-short! bv off n)
+    (bytevector-u16-set! bv off n (endianness big)))
+
+  (define max-payload-size 65535)
+
+;; Compression is provided by the system's zlib, via the FFI. If zlib can't be
+;; loaded, the client doesn't offer compression to the server.
+
+  (define zlib
+    (catch #t (lambda () (dynamic-link "libz")) (lambda (key . args) #f)))
+
+  (define (zlib-procedure name return-type arg-types)
+    (and zlib 
+	 (ffi:pointer->procedure 
+	  return-type (dynamic-func name zlib) arg-types)))
+
+  (define zlib-compress-bound 
+    (zlib-procedure "compressBound" ffi:unsigned-long (list ffi:unsigned-long)))
+  (define zlib-compress2
+    (zlib-procedure "compress2" ffi:int 
+		    (list '* '* '* ffi:unsigned-long ffi:int)))
+  (define zlib-uncompress
+    (zlib-procedure "uncompress" ffi:int (list '* '* '* ffi:unsigned-long)))
+
+  (define (make-length-cell n)
+    (let ((cell (make-bytevector (ffi:sizeof ffi:unsigned-long))))
+      (bytevector-uint-set! 
+       cell 0 n (native-endianness) (ffi:sizeof ffi:unsigned-long))
+      cell))
+
+  (define (length-cell-ref cell)
+    (bytevector-uint-ref 
+     cell 0 (native-endianness) (ffi:sizeof ffi:unsigned-long)))
+
+  (define (subbytevector bv len)
+    (let ((sub (make-bytevector len)))
+      (bytevector-copy! bv 0 sub 0 len)
+      sub))
+
+  ;; Returns the zlib-compressed form of the specified bytevector, or #f if it
+  ;; could not be compressed.
+
+  (define (deflate bv)
+    (let* ((len (bytevector-length bv))
+	   (dest (make-bytevector (zlib-compress-bound len)))
+	   (dest-len (make-length-cell (bytevector-length dest))))
+      (and (zero? (zlib-compress2 
+		   (ffi:bytevector->pointer dest) 
+		   (ffi:bytevector->pointer dest-len) 
+		   (ffi:bytevector->pointer bv) len 1))
+	   (subbytevector dest (length-cell-ref dest-len)))))
+
+  ;; Returns the decompressed form of the specified zlib-compressed bytevector,
+  ;; which must decompress to exactly the specified number of bytes; or #f if 
+  ;; it does not.
+  
+  (define (inflate bv expected-len)
+    (let* ((dest (make-bytevector (max expected-len 1)))
+	   (dest-len (make-length-cell expected-len)))
+      (and (zero? (zlib-uncompress 
+		   (ffi:bytevector->pointer dest) 
+		   (ffi:bytevector->pointer dest-len) 
+		   (ffi:bytevector->pointer bv) (bytevector-length bv)))
+	   (eqv? (length-cell-ref dest-len) expected-len)
+	   (subbytevector dest expected-len))))
+
+  (define supported-options
+    (if zlib
+	(bitwise-ior gzochi:protocol/option-batch 
+		     gzochi:protocol/option-compression)
+	gzochi:protocol/option-batch))
+
+  (define (option-enabled? client option)
+    (not (zero? (bitwise-and (gzochi:client-options client) option))))
 
   (define (protocol-read client)
     (let* ((buffer (gzochi:client-buffer client))
@@ -144,6 +221,43 @@
     (let ((received-message (gzochi:client-received-message client)))
       (and received-message (received-message message))))
 
+  ;; Calls the specified procedure on each of the length-prefixed messages in 
+  ;; the specified session message batch payload, in order.
+
+  (define (for-each-batch-entry proc batch)
+    (let ((len (bytevector-length batch)))
+      (let loop ((offset 0))
+	(if (<= (+ offset 2) len)
+	    (let ((message-len (read-short batch offset)))
+	      (if (<= (+ offset 2 message-len) len)
+		  (let ((message (make-bytevector message-len)))
+		    (bytevector-copy! batch (+ offset 2) message 0 message-len)
+		    (proc message)
+		    (loop (+ offset 2 message-len)))))))))
+
+  (define (dispatch-session-message-batch client batch)
+    (for-each-batch-entry 
+     (lambda (message) (dispatch-session-message client message)) batch))
+
+  (define (dispatch-compressed-message client message)
+    (let ((len (bytevector-length message)))
+      (and zlib (>= len 3)
+	   (let ((compressed (make-bytevector (- len 3))))
+	     (bytevector-copy! message 3 compressed 0 (- len 3))
+	     (let ((payload (inflate compressed (read-short message 1)))
+		   (opcode (bytevector-u8-ref message 0)))
+	       (cond ((not payload))
+		     ((eqv? opcode gzochi:protocol/session-message)
+		      (dispatch-session-message client payload))
+		     ((eqv? opcode gzochi:protocol/session-message-batch)
+		      (dispatch-session-message-batch client payload))))))))
+
+  (define (dispatch-options-response client message)
+    (if (> (bytevector-length message) 0)
+	(gzochi:client-options-set! 
+	 client (bitwise-and (bytevector-u8-ref message 0) 
+			     supported-options))))
+
   (define (dispatch-disconnect client)
     (gzochi:client-connected-set! client #f)
     (if (not (gzochi:client-disconnect-acknowledged client))
@@ -157,6 +271,12 @@
       (cond ((eqv? opcode gzochi:protocol/login-success))
 	    ((eqv? opcode gzochi:protocol/session-message)
 	     (dispatch-session-message client message))
+	    ((eqv? opcode gzochi:protocol/session-message-batch)
+	     (dispatch-session-message-batch client message))
+	    ((eqv? opcode gzochi:protocol/compressed-message)
+	     (dispatch-compressed-message client message))
+	    ((eqv? opcode gzochi:protocol/options-response)
+	     (dispatch-options-response client message))
 	    ((or (eqv? opcode gzochi:protocol/login-failure)
 		 (eqv? opcode gzochi:protocol/session-disconnected))
 	     (dispatch-disconnect client))))
@@ -185,7 +305,15 @@
 			      (bytevector-copy! 
 			       buffer (+ offset 3) message 0 len)
 			      (dispatch-inner op message)
-			      (loop all? (+ offset 3 len) (+ dispatched 1)))
+
+			      ;; The options response is part of the 
+			      ;; connection handshake, and isn't of interest to
+			      ;; callers waiting for a message.
+
+			      (if (eqv? op gzochi:protocol/options-response)
+				  (loop #t (+ offset 3 len) dispatched)
+				  (loop all? (+ offset 3 len) 
+					(+ dispatched 1))))
 			    (loop #f offset dispatched)))))))))
 
   (define (dispatch client) (attempt-dispatch client))
@@ -223,8 +351,74 @@
     (send-protocol-message 
      client gzochi:protocol/logout-request (make-bytevector 0)))
 
+  (define (send-options-request client)
+    (send-protocol-message 
+     client gzochi:protocol/options-request 
+     (u8-list->bytevector (list supported-options))))
+
+  ;; Sends the specified session message or session message batch, wrapped in
+  ;; a compressed message if compression has been negotiated and the payload is
+  ;; long enough - and compresses well enough - to be worth it.
+  
+  (define (send-compressible-message client opcode payload)
+    (let* ((len (bytevector-length payload))
+	   (compressed 
+	    (and (option-enabled? client gzochi:protocol/option-compression)
+		 (>= len gzochi:protocol/compression-threshold)
+		 (deflate payload))))
+      (if (and compressed (< (+ (bytevector-length compressed) 3) len))
+	  (let ((message (make-bytevector (+ (bytevector-length compressed) 3))))
+	    (bytevector-u8-set! message 0 opcode)
+	    (write-short! message 1 len)
+	    (bytevector-copy! 
+	     compressed 0 message 3 (bytevector-length compressed))
+	    (send-protocol-message 
+	     client gzochi:protocol/compressed-message message))
+	  (send-protocol-message client opcode payload))))
+
   (define (send-session-message client message)
-    (send-protocol-message client gzochi:protocol/session-message message))
+    (send-compressible-message 
+     client gzochi:protocol/session-message message))
+
+  ;; Sends the specified list of messages as session message batches, each one
+  ;; holding as many of the messages as will fit in a single frame. A batch
+  ;; that would hold a single message is sent as an ordinary session message.
+
+  (define (send-session-message-batches client messages)
+    (define (send-batch entries)
+      (cond ((null? entries))
+	    ((null? (cdr entries)) (send-session-message client (car entries)))
+	    (else
+	     (let* ((entries (reverse entries))
+		    (len (fold-left 
+			  (lambda (len message) 
+			    (+ len (bytevector-length message) 2))
+			  0 entries))
+		    (batch (make-bytevector len)))
+	       (fold-left (lambda (offset message)
+			    (let ((message-len (bytevector-length message)))
+			      (write-short! batch offset message-len)
+			      (bytevector-copy! 
+			       message 0 batch (+ offset 2) message-len)
+			      (+ offset message-len 2)))
+			  0 entries)
+	       (send-compressible-message 
+		client gzochi:protocol/session-message-batch batch)))))
+
+    (let loop ((messages messages) (entries '()) (len 0))
+      (if (null? messages)
+	  (send-batch entries)
+	  (let ((entry-len (+ (bytevector-length (car messages)) 2)))
+	    (if (> (+ len entry-len) max-payload-size)
+		(begin
+		  (send-batch entries)
+		  (if (> entry-len max-payload-size)
+		      (begin
+			(send-session-message client (car messages))
+			(loop (cdr messages) '() 0))
+		      (loop (cdr messages) (list (car messages)) entry-len)))
+		(loop (cdr messages) (cons (car messages) entries)
+		      (+ len entry-len)))))))
 
   (define (check-argument predicate argument optional?)
     (or (and optional? (not argument))
@@ -256,6 +450,11 @@
       (connect sock addr)
 
       (let ((client (gzochi:make-client sock)))
+
+	;; Ask for the protocol extensions up front, without waiting for a 
+	;; reply; a server that doesn't support them will ignore the request.
+
+	(send-options-request client)
 	(send-login-request client endpoint credentials)	
 
 	(let loop ()
@@ -315,6 +514,25 @@
     (with-mutex (gzochi:client-send-mutex client)
       (send-session-message client msg) #t))
 
+;; Sends the specified list of messages to the server to which the specified
+;; client is connected, in order.
+;;
+;; Each message must be a bytevector of at most 65535 bytes. If the server
+;; supports it, the messages are sent together in as few protocol frames as 
+;; possible, and may be delivered to the server application in a single 
+;; transaction.
+
+  (define (gzochi:send-all client msgs)
+    (check-argument gzochi:client? client #f)
+    (check-argument 
+     (lambda (msgs) (and (list? msgs) (for-all bytevector? msgs))) msgs #f)
+
+    (with-mutex (gzochi:client-send-mutex client)
+      (if (option-enabled? client gzochi:protocol/option-batch)
+	  (send-session-message-batches client msgs)
+	  (for-each (lambda (msg) (send-session-message client msg)) msgs))
+      #t))
+
   (define (dispatchable? client)
     (let ((offset (gzochi:client-buffer-offset client)))
       (cond ((and (not (gzochi:client-connected client))
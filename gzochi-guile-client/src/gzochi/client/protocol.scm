@@ -25,7 +25,16 @@
 	  gzochi:protocol/logout-success
 
 	  gzochi:protocol/session-disconnected
-	  gzochi:protocol/session-message)
+	  gzochi:protocol/session-message
+	  gzochi:protocol/session-message-batch
+	  gzochi:protocol/compressed-message
+
+	  gzochi:protocol/options-request
+	  gzochi:protocol/options-response
+
+	  gzochi:protocol/option-batch
+	  gzochi:protocol/option-compression
+	  gzochi:protocol/compression-threshold)
   (import (rnrs base))
 
   (define gzochi:protocol/login-request #x10)
@@ -37,4 +46,13 @@
 
   (define gzochi:protocol/session-disconnected #x30)
   (define gzochi:protocol/session-message #x31)
+  (define gzochi:protocol/session-message-batch #x32)
+  (define gzochi:protocol/compressed-message #x33)
+
+  (define gzochi:protocol/options-request #x40)
+  (define gzochi:protocol/options-response #x41)
+
+  (define gzochi:protocol/option-batch #x01)
+  (define gzochi:protocol/option-compression #x02)
+  (define gzochi:protocol/compression-threshold 256)
 )
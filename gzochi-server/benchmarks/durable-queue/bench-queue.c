@@ -0,0 +1,547 @@
+/* bench-queue.c: Offer / pop throughput benchmark for gzochid durable queues
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "data.h"
+#include "io.h"
+#include "queue.h"
+#include "util.h"
+
+/* This benchmark measures the cost of offering elements to and popping
+   elements from a durable queue, with each operation performed in its own
+   "transaction," the way durable task chains and application code use queues.
+   It compares the segmented queue in queue.c against a reimplementation of the
+   original one-link-object-per-element layout.
+
+   The data services are replaced with a minimal in-memory implementation that
+   serializes every new or modified object at the end of each transaction and
+   counts the number of records and bytes written and the number of oids
+   allocated, so that the storage traffic generated by each layout can be
+   compared independent of any particular storage engine. */
+
+#define DEFAULT_NUM_ELEMENTS 100000
+
+/* Storage statistics. */
+
+struct _bench_stats
+{
+  guint64 oids_allocated;
+  guint64 records_written;
+  guint64 records_removed;
+  guint64 bytes_written;
+  guint64 bytes_read;
+};
+
+typedef struct _bench_stats bench_stats;
+
+static bench_stats stats;
+
+/* The simulated object store: `guint64' oid to `GByteArray'. */
+
+static GHashTable *store;
+
+/* The transaction-local reference cache: `guint64' oid to reference. */
+
+static GHashTable *references;
+
+/* Maps each cached object to its reference, to support
+   `gzochid_data_mark'. */
+
+static GHashTable *objects_to_references;
+
+static guint64 next_oid = 1;
+
+/* Minimal data service implementation. */
+
+static gzochid_data_managed_reference *
+cache_reference (gzochid_application_context *context,
+		 gzochid_io_serialization *serialization, guint64 oid,
+		 gpointer obj, enum gzochid_data_managed_reference_state state)
+{
+  gzochid_data_managed_reference *reference =
+    calloc (1, sizeof (gzochid_data_managed_reference));
+
+  reference->context = context;
+  reference->serialization = serialization;
+  reference->oid = oid;
+  reference->obj = obj;
+  reference->state = state;
+
+  g_hash_table_insert
+    (references, g_memdup (&oid, sizeof (guint64)), reference);
+  if (obj != NULL)
+    g_hash_table_insert (objects_to_references, obj, reference);
+
+  return reference;
+}
+
+gzochid_data_managed_reference *
+gzochid_data_create_reference_to_oid
+(gzochid_application_context *context, gzochid_io_serialization *serialization,
+ guint64 oid)
+{
+  gzochid_data_managed_reference *reference =
+    g_hash_table_lookup (references, &oid);
+
+  if (reference == NULL)
+    reference = cache_reference
+      (context, serialization, oid, NULL,
+       GZOCHID_MANAGED_REFERENCE_STATE_EMPTY);
+
+  return reference;
+}
+
+gzochid_data_managed_reference *
+gzochid_data_create_reference
+(gzochid_application_context *context, gzochid_io_serialization *serialization,
+ gpointer data, GError **err)
+{
+  stats.oids_allocated++;
+
+  return cache_reference
+    (context, serialization, next_oid++, data,
+     GZOCHID_MANAGED_REFERENCE_STATE_NEW);
+}
+
+void *
+gzochid_data_dereference
+(gzochid_data_managed_reference *reference, GError **error)
+{
+  GByteArray *in = NULL, *data = NULL;
+
+  if (reference->obj != NULL)
+    return reference->obj;
+
+  data = g_hash_table_lookup (store, &reference->oid);
+  g_assert (data != NULL);
+
+  in = g_byte_array_sized_new (data->len);
+  g_byte_array_append (in, data->data, data->len);
+
+  stats.bytes_read += data->len;
+
+  reference->obj = reference->serialization->deserializer
+    (reference->context, in, NULL);
+  reference->state = GZOCHID_MANAGED_REFERENCE_STATE_NOT_MODIFIED;
+  g_hash_table_insert (objects_to_references, reference->obj, reference);
+
+  g_byte_array_unref (in);
+
+  return reference->obj;
+}
+
+void *
+gzochid_data_dereference_for_update
+(gzochid_data_managed_reference *reference, GError **error)
+{
+  return gzochid_data_dereference (reference, error);
+}
+
+void
+gzochid_data_mark
+(gzochid_application_context *context, gzochid_io_serialization *serialization,
+ gpointer data, GError **error)
+{
+  gzochid_data_managed_reference *reference =
+    g_hash_table_lookup (objects_to_references, data);
+
+  g_assert (reference != NULL);
+
+  if (reference->state != GZOCHID_MANAGED_REFERENCE_STATE_NEW)
+    reference->state = GZOCHID_MANAGED_REFERENCE_STATE_MODIFIED;
+}
+
+void
+gzochid_data_remove_object (gzochid_data_managed_reference *reference,
+			    GError **err)
+{
+  reference->state = GZOCHID_MANAGED_REFERENCE_STATE_REMOVED_FETCHED;
+}
+
+/* Writes all new and modified objects in the reference cache to the store,
+   removes removed objects, and empties the cache. */
+
+static void
+commit ()
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, references);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      gzochid_data_managed_reference *reference = value;
+
+      switch (reference->state)
+	{
+	case GZOCHID_MANAGED_REFERENCE_STATE_NEW:
+	case GZOCHID_MANAGED_REFERENCE_STATE_MODIFIED:
+	  {
+	    GByteArray *out = g_byte_array_new ();
+
+	    reference->serialization->serializer
+	      (reference->context, reference->obj, out, NULL);
+
+	    stats.records_written++;
+	    stats.bytes_written += out->len;
+
+	    g_hash_table_insert
+	      (store, g_memdup (&reference->oid, sizeof (guint64)), out);
+	    break;
+	  }
+	case GZOCHID_MANAGED_REFERENCE_STATE_REMOVED_FETCHED:
+	  stats.records_removed++;
+	  g_hash_table_remove (store, &reference->oid);
+	  break;
+	default: break;
+	}
+
+      if (reference->obj != NULL)
+	reference->serialization->finalizer
+	  (reference->context, reference->obj);
+      free (reference);
+    }
+
+  g_hash_table_remove_all (references);
+  g_hash_table_remove_all (objects_to_references);
+}
+
+/* Element serialization: A fixed-size payload, standing in for a durable task
+   handle. */
+
+#define PAYLOAD_SIZE 32
+
+static void
+serialize_payload (gzochid_application_context *app_context, gpointer data,
+		   GByteArray *out, GError **err)
+{
+  g_byte_array_append (out, data, PAYLOAD_SIZE);
+}
+
+static gpointer
+deserialize_payload (gzochid_application_context *app_context, GByteArray *in,
+		     GError **err)
+{
+  return g_memdup (in->data, PAYLOAD_SIZE);
+}
+
+static void
+finalize_payload (gzochid_application_context *app_context, gpointer data)
+{
+  g_free (data);
+}
+
+static gzochid_io_serialization payload_serialization =
+  { serialize_payload, deserialize_payload, finalize_payload };
+
+/* A reimplementation of the original linked queue layout, in which every
+   element is a separate managed link object and the queue header holds the
+   oids of the head and tail links. */
+
+struct _linked_element
+{
+  guint64 oid;
+  gzochid_data_managed_reference *next;
+};
+
+typedef struct _linked_element linked_element;
+
+struct _linked_queue
+{
+  gzochid_data_managed_reference *head;
+  gzochid_data_managed_reference *tail;
+};
+
+typedef struct _linked_queue linked_queue;
+
+static gzochid_io_serialization linked_element_serialization;
+
+static void
+serialize_linked_element (gzochid_application_context *app_context,
+			  gpointer data, GByteArray *out, GError **err)
+{
+  linked_element *elt = data;
+
+  gzochid_util_serialize_oid (elt->oid, out);
+  gzochid_util_serialize_boolean (elt->next != NULL, out);
+  if (elt->next != NULL)
+    gzochid_util_serialize_oid (elt->next->oid, out);
+}
+
+static gpointer
+deserialize_linked_element (gzochid_application_context *app_context,
+			    GByteArray *in, GError **err)
+{
+  linked_element *elt = calloc (1, sizeof (linked_element));
+
+  elt->oid = gzochid_util_deserialize_oid (in);
+  if (gzochid_util_deserialize_boolean (in))
+    elt->next = gzochid_data_create_reference_to_oid
+      (app_context, &linked_element_serialization,
+       gzochid_util_deserialize_oid (in));
+
+  return elt;
+}
+
+static void
+finalize_linked (gzochid_application_context *app_context, gpointer data)
+{
+  free (data);
+}
+
+static gzochid_io_serialization linked_element_serialization =
+  { serialize_linked_element, deserialize_linked_element, finalize_linked };
+
+static void
+serialize_linked_queue (gzochid_application_context *app_context,
+			gpointer data, GByteArray *out, GError **err)
+{
+  linked_queue *queue = data;
+
+  gzochid_util_serialize_boolean (queue->head != NULL, out);
+  if (queue->head != NULL)
+    {
+      gzochid_util_serialize_oid (queue->head->oid, out);
+      gzochid_util_serialize_oid (queue->tail->oid, out);
+    }
+}
+
+static gpointer
+deserialize_linked_queue (gzochid_application_context *app_context,
+			  GByteArray *in, GError **err)
+{
+  linked_queue *queue = calloc (1, sizeof (linked_queue));
+
+  if (gzochid_util_deserialize_boolean (in))
+    {
+      queue->head = gzochid_data_create_reference_to_oid
+	(app_context, &linked_element_serialization,
+	 gzochid_util_deserialize_oid (in));
+      queue->tail = gzochid_data_create_reference_to_oid
+	(app_context, &linked_element_serialization,
+	 gzochid_util_deserialize_oid (in));
+    }
+
+  return queue;
+}
+
+static gzochid_io_serialization linked_queue_serialization =
+  { serialize_linked_queue, deserialize_linked_queue, finalize_linked };
+
+static void
+linked_queue_offer (linked_queue *queue, gpointer data)
+{
+  linked_element *elt = calloc (1, sizeof (linked_element));
+  gzochid_data_managed_reference *elt_ref = gzochid_data_create_reference
+    (NULL, &linked_element_serialization, elt, NULL);
+  gzochid_data_managed_reference *data_ref = gzochid_data_create_reference
+    (NULL, &payload_serialization, data, NULL);
+
+  elt->oid = data_ref->oid;
+
+  if (queue->head == NULL)
+    queue->head = elt_ref;
+  else
+    {
+      linked_element *tail_elt = gzochid_data_dereference (queue->tail, NULL);
+
+      tail_elt->next = elt_ref;
+      gzochid_data_mark (NULL, &linked_element_serialization, tail_elt, NULL);
+    }
+
+  queue->tail = elt_ref;
+  gzochid_data_mark (NULL, &linked_queue_serialization, queue, NULL);
+}
+
+static gpointer
+linked_queue_pop (linked_queue *queue)
+{
+  gzochid_data_managed_reference *head_ref = queue->head;
+  linked_element *elt = NULL;
+  gpointer data = NULL;
+
+  if (head_ref == NULL)
+    return NULL;
+
+  elt = gzochid_data_dereference_for_update (head_ref, NULL);
+  data = gzochid_data_dereference
+    (gzochid_data_create_reference_to_oid
+     (NULL, &payload_serialization, elt->oid), NULL);
+
+  queue->head = elt->next;
+  if (queue->head == NULL)
+    queue->tail = NULL;
+
+  gzochid_data_remove_object (head_ref, NULL);
+  gzochid_data_mark (NULL, &linked_queue_serialization, queue, NULL);
+
+  return data;
+}
+
+/* Benchmark drivers. */
+
+enum queue_layout
+  {
+    LAYOUT_LINKED,
+    LAYOUT_SEGMENTED
+  };
+
+/* Dereferences the queue header stored at the specified oid. */
+
+static gpointer
+get_queue (enum queue_layout layout, guint64 queue_oid)
+{
+  return gzochid_data_dereference
+    (gzochid_data_create_reference_to_oid
+     (NULL, layout == LAYOUT_LINKED
+      ? &linked_queue_serialization : &gzochid_durable_queue_serialization,
+      queue_oid), NULL);
+}
+
+static void
+offer (enum queue_layout layout, guint64 queue_oid)
+{
+  gpointer data = g_malloc0 (PAYLOAD_SIZE);
+
+  if (layout == LAYOUT_LINKED)
+    linked_queue_offer (get_queue (layout, queue_oid), data);
+  else gzochid_durable_queue_offer
+	 (get_queue (layout, queue_oid), &payload_serialization, data, NULL);
+
+  commit ();
+}
+
+static void
+pop (enum queue_layout layout, guint64 queue_oid)
+{
+  gpointer data = NULL;
+
+  if (layout == LAYOUT_LINKED)
+    data = linked_queue_pop (get_queue (layout, queue_oid));
+  else data = gzochid_durable_queue_pop
+	 (get_queue (layout, queue_oid), &payload_serialization, NULL);
+
+  g_assert (data != NULL);
+
+  /* Like durable task chains, remove each popped element from the store. */
+
+  gzochid_data_remove_object
+    (g_hash_table_lookup (objects_to_references, data), NULL);
+  commit ();
+}
+
+/* Creates and stores an empty queue of the specified layout, returning its
+   oid. */
+
+static guint64
+create_queue (enum queue_layout layout)
+{
+  gzochid_data_managed_reference *reference = layout == LAYOUT_LINKED
+    ? gzochid_data_create_reference
+    (NULL, &linked_queue_serialization, calloc (1, sizeof (linked_queue)),
+     NULL)
+    : gzochid_data_create_reference
+    (NULL, &gzochid_durable_queue_serialization,
+     gzochid_durable_queue_new (NULL), NULL);
+  guint64 oid = reference->oid;
+
+  commit ();
+  return oid;
+}
+
+static void
+print_result (const char *layout_name, const char *phase, int n,
+	      gint64 elapsed_us, bench_stats *before)
+{
+  printf ("%-10s %-12s %12.0f ops/sec %10.2f records/op %10.2f bytes/op "
+	  "%8.2f oids/op\n", layout_name, phase,
+	  n / (elapsed_us / (double) G_USEC_PER_SEC),
+	  (stats.records_written + stats.records_removed
+	   - before->records_written - before->records_removed) / (double) n,
+	  (stats.bytes_written - before->bytes_written) / (double) n,
+	  (stats.oids_allocated - before->oids_allocated) / (double) n);
+}
+
+static void
+run (enum queue_layout layout, int n)
+{
+  const char *name = layout == LAYOUT_LINKED ? "linked" : "segmented";
+  guint64 queue_oid = create_queue (layout);
+  bench_stats before = stats;
+  gint64 start = g_get_monotonic_time ();
+  int i = 0;
+
+  /* Fill, then drain. */
+
+  for (i = 0; i < n; i++)
+    offer (layout, queue_oid);
+  print_result (name, "offer", n, g_get_monotonic_time () - start, &before);
+
+  before = stats;
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n; i++)
+    pop (layout, queue_oid);
+  print_result (name, "pop", n, g_get_monotonic_time () - start, &before);
+
+  /* Steady state: Alternate offers and pops on a short queue, as a durable
+     task chain does. */
+
+  before = stats;
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n; i++)
+    {
+      offer (layout, queue_oid);
+      pop (layout, queue_oid);
+    }
+  print_result
+    (name, "offer+pop", n, g_get_monotonic_time () - start, &before);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi (argv[1]) : DEFAULT_NUM_ELEMENTS;
+
+  if (n <= 0)
+    {
+      fprintf (stderr, "Usage: %s [NUM_ELEMENTS]\n", argv[0]);
+      return 1;
+    }
+
+  store = g_hash_table_new_full
+    (g_int64_hash, g_int64_equal, g_free, (GDestroyNotify) g_byte_array_unref);
+  references = g_hash_table_new_full
+    (g_int64_hash, g_int64_equal, g_free, NULL);
+  objects_to_references = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  printf ("%d elements, one transaction per operation\n", n);
+
+  run (LAYOUT_LINKED, n);
+  run (LAYOUT_SEGMENTED, n);
+
+  g_hash_table_destroy (store);
+  g_hash_table_destroy (references);
+  g_hash_table_destroy (objects_to_references);
+
+  return 0;
+}
@@ -0,0 +1,1041 @@
+/* bench-load.c: Load generator for the gzochi game protocol
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <glib.h>
+#include <gzochi-common.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* This program opens a large number of client sessions against a running
+   gzochid server from a single thread, multiplexing their sockets with epoll,
+   and drives them through one of the following scenarios:
+
+   login    Each session repeatedly connects, logs in, and logs out.
+   echo     Each session logs in once and then sends messages at a fixed rate,
+            which the server application echoes back to the sender.
+   channel  Each session logs in once, joins one of several channels, and
+            then sends messages at a fixed rate, which the server application
+            broadcasts to every member of the sender's channel.
+
+   Every session message carries the time at which it was sent, so the round
+   trip time (echo) or the delivery latency (channel) of each message can be
+   computed on receipt. The results are written to standard output as a JSON
+   object; progress is reported on standard error. */
+
+#define DEFAULT_HOST "localhost"
+#define DEFAULT_PORT "8001"
+#define DEFAULT_ENDPOINT "load-generator"
+#define DEFAULT_NUM_SESSIONS 1000
+#define DEFAULT_RAMP_RATE 1000
+#define DEFAULT_MESSAGE_RATE 1.0
+#define DEFAULT_MESSAGE_SIZE 32
+#define DEFAULT_GROUP_SIZE 100
+#define DEFAULT_DURATION 30
+
+/* The smallest message payload: A one-byte message type followed by an
+   eight-byte timestamp. */
+
+#define MIN_MESSAGE_SIZE 9
+
+/* The largest message payload that fits in a game protocol frame. */
+
+#define MAX_MESSAGE_SIZE 65532
+
+/* Sends to a session are skipped (and counted as deferred) while more than
+   this many bytes are waiting to be written to its socket. */
+
+#define MAX_OUTBOUND_BYTES 65536
+
+/* How long to wait for responses to messages in flight once the test has
+   stopped sending. */
+
+#define DRAIN_US (2 * G_USEC_PER_SEC)
+
+#define MAX_EVENTS 1024
+#define READ_BUFFER_SIZE 65536
+
+/* The number of histogram buckets needed to record latencies up to 2^32
+   microseconds; see `histogram_index' below. */
+
+#define HISTOGRAM_BUCKETS (64 * 26 + 64)
+
+enum scenario
+  {
+    SCENARIO_LOGIN,
+    SCENARIO_ECHO,
+    SCENARIO_CHANNEL
+  };
+
+enum phase
+  {
+    PHASE_RAMP, /* Sessions are being opened and logged in. */
+    PHASE_STEADY, /* The scenario is running. */
+    PHASE_DRAIN, /* Waiting for responses to messages in flight. */
+    PHASE_DONE
+  };
+
+enum session_state
+  {
+    SESSION_IDLE, /* No socket is open. */
+    SESSION_CONNECTING, /* The connection is in progress. */
+    SESSION_LOGGING_IN, /* The login request has been sent. */
+    SESSION_READY, /* The session is logged in. */
+    SESSION_LOGGING_OUT, /* The logout request has been sent. */
+    SESSION_CLOSED /* The session is finished and will not be reopened. */
+  };
+
+/* A log-linear histogram of latencies in microseconds. Values below 128 are
+   recorded exactly; larger values are recorded with a relative error of less
+   than 1/64. */
+
+struct histogram
+{
+  guint64 counts[HISTOGRAM_BUCKETS];
+  guint64 count;
+  guint64 sum;
+  guint64 min;
+  guint64 max;
+};
+
+struct session
+{
+  int index; /* The index of the session, which determines its name. */
+  int fd; /* The session socket, or -1. */
+  enum session_state state;
+  gint64 start_time; /* When the current connection attempt started. */
+  gboolean want_write; /* Whether `EPOLLOUT' is registered for the socket. */
+  GByteArray *inbound; /* Bytes read but not yet parsed into frames. */
+  GByteArray *outbound; /* Bytes waiting to be written. */
+};
+
+/* The options for a run of the load generator. */
+
+struct options
+{
+  const char *host;
+  const char *port;
+  const char *endpoint;
+  enum scenario scenario;
+  int num_sessions;
+  int ramp_rate; /* New connections per second. */
+  double message_rate; /* Messages per second, per session. */
+  int message_size; /* The size of each message payload, in bytes. */
+  int group_size; /* The number of sessions per channel. */
+  int duration; /* The length of the steady phase, in seconds. */
+};
+
+struct generator
+{
+  struct options *options;
+  struct addrinfo *address; /* The resolved server address. */
+  int epoll_fd;
+
+  struct session *sessions;
+  int *idle; /* A stack of the indexes of idle sessions. */
+  int num_idle;
+
+  enum phase phase;
+  gint64 start_time; /* When the generator started. */
+  gint64 steady_time; /* When the steady phase started. */
+  gint64 drain_time; /* When the drain phase started. */
+  gint64 last_progress_time; /* When progress was last reported. */
+
+  guint64 connections_opened; /* Connection attempts started. */
+  guint64 messages_attempted; /* Sends scheduled during the steady phase. */
+  int send_cursor; /* The next session to consider for a send. */
+  int num_pending; /* Sessions connecting or logging in. */
+  int num_ready; /* Sessions logged in. */
+
+  guint64 connect_failures;
+  guint64 logins;
+  guint64 login_failures;
+  guint64 logouts;
+  guint64 disconnects; /* Disconnections initiated by the server. */
+  guint64 errors; /* Connections lost unexpectedly. */
+  guint64 messages_sent;
+  guint64 messages_received;
+  guint64 sends_deferred;
+
+  struct histogram login_latency; /* From connect to login success. */
+  struct histogram message_latency; /* From send to receipt. */
+
+  unsigned char *frame; /* A scratch buffer for outgoing frames. */
+};
+
+static int
+histogram_index (guint64 value)
+{
+  int shift = 0;
+
+  if (value < 128)
+    return value;
+  if (value > G_MAXUINT32)
+    value = G_MAXUINT32;
+
+  /* Shift the value so that it falls between 64 and 127. */
+
+  shift = g_bit_storage (value) - 7;
+  return 64 * shift + (value >> shift);
+}
+
+/* Returns the smallest value recorded in the specified bucket. */
+
+static guint64
+histogram_value (int index)
+{
+  int shift = 0;
+
+  if (index < 128)
+    return index;
+
+  shift = index / 64 - 1;
+  return ((guint64) index - 64 * shift) << shift;
+}
+
+static void
+histogram_record (struct histogram *histogram, guint64 value)
+{
+  histogram->counts[histogram_index (value)]++;
+
+  if (histogram->count == 0 || value < histogram->min)
+    histogram->min = value;
+  if (value > histogram->max)
+    histogram->max = value;
+
+  histogram->count++;
+  histogram->sum += value;
+}
+
+/* Returns the value below which the specified fraction of the recorded values
+   fall. */
+
+static guint64
+histogram_percentile (struct histogram *histogram, double fraction)
+{
+  guint64 rank = (guint64) (fraction * histogram->count + 0.5);
+  guint64 seen = 0;
+  int i = 0;
+
+  if (histogram->count == 0)
+    return 0;
+  if (rank < 1)
+    rank = 1;
+
+  for (; i < HISTOGRAM_BUCKETS; i++)
+    {
+      seen += histogram->counts[i];
+      if (seen >= rank)
+	return MIN (MAX (histogram_value (i), histogram->min), histogram->max);
+    }
+
+  return histogram->max;
+}
+
+static void
+print_histogram (const char *name, struct histogram *histogram,
+		 gboolean last)
+{
+  printf ("  \"%s\": {\n", name);
+  printf ("    \"count\": %" G_GUINT64_FORMAT ",\n", histogram->count);
+  printf ("    \"min\": %" G_GUINT64_FORMAT ",\n", histogram->min);
+  printf ("    \"mean\": %.1f,\n", histogram->count == 0 ? 0.0 :
+	  histogram->sum / (double) histogram->count);
+  printf ("    \"p50\": %" G_GUINT64_FORMAT ",\n",
+	  histogram_percentile (histogram, 0.5));
+  printf ("    \"p90\": %" G_GUINT64_FORMAT ",\n",
+	  histogram_percentile (histogram, 0.9));
+  printf ("    \"p99\": %" G_GUINT64_FORMAT ",\n",
+	  histogram_percentile (histogram, 0.99));
+  printf ("    \"p999\": %" G_GUINT64_FORMAT ",\n",
+	  histogram_percentile (histogram, 0.999));
+  printf ("    \"max\": %" G_GUINT64_FORMAT "\n", histogram->max);
+  printf ("  }%s\n", last ? "" : ",");
+}
+
+static void
+set_events (struct generator *generator, struct session *session,
+	    gboolean want_write)
+{
+  struct epoll_event event;
+
+  event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+  event.data.ptr = session;
+
+  if (epoll_ctl (generator->epoll_fd, EPOLL_CTL_MOD, session->fd, &event) < 0)
+    g_error ("epoll_ctl: %s", strerror (errno));
+
+  session->want_write = want_write;
+}
+
+/* Closes the specified session's socket. In the login scenario, the session
+   is returned to the idle stack to be reopened; otherwise it is finished. */
+
+static void
+session_close (struct generator *generator, struct session *session)
+{
+  if (session->state == SESSION_CONNECTING
+      || session->state == SESSION_LOGGING_IN)
+    generator->num_pending--;
+  else if (session->state == SESSION_READY)
+    generator->num_ready--;
+
+  close (session->fd);
+
+  session->fd = -1;
+  session->want_write = FALSE;
+  g_byte_array_set_size (session->inbound, 0);
+  g_byte_array_set_size (session->outbound, 0);
+
+  if (generator->options->scenario == SCENARIO_LOGIN)
+    {
+      session->state = SESSION_IDLE;
+      generator->idle[generator->num_idle++] = session->index;
+    }
+  else session->state = SESSION_CLOSED;
+}
+
+/* Writes as much of the specified session's outbound buffer as the socket
+   will accept. Returns `FALSE' if the session was closed. */
+
+static gboolean
+session_flush (struct generator *generator, struct session *session)
+{
+  while (session->outbound->len > 0)
+    {
+      ssize_t n = write
+	(session->fd, session->outbound->data, session->outbound->len);
+
+      if (n < 0)
+	{
+	  if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    break;
+	  else if (errno == EINTR)
+	    continue;
+
+	  generator->errors++;
+	  session_close (generator, session);
+	  return FALSE;
+	}
+
+      g_byte_array_remove_range (session->outbound, 0, n);
+    }
+
+  if (session->outbound->len > 0 && !session->want_write)
+    set_events (generator, session, TRUE);
+  else if (session->outbound->len == 0 && session->want_write)
+    set_events (generator, session, FALSE);
+
+  return TRUE;
+}
+
+/* Frames the specified payload with the specified opcode and queues it for
+   writing to the specified session. Returns `FALSE' if the session was
+   closed. */
+
+static gboolean
+session_send (struct generator *generator, struct session *session,
+	      int opcode, const unsigned char *payload, size_t len)
+{
+  gzochi_common_io_write_short (len, generator->frame, 0);
+  generator->frame[2] = opcode;
+  memcpy (generator->frame + 3, payload, len);
+
+  g_byte_array_append (session->outbound, generator->frame, len + 3);
+
+  /* If other bytes were already waiting, the socket is not writable; the
+     frame will be written once `EPOLLOUT' fires. */
+
+  if (session->outbound->len == len + 3)
+    return session_flush (generator, session);
+  else return TRUE;
+}
+
+/* Starts a non-blocking connection attempt for the specified session. */
+
+static void
+session_open (struct generator *generator, struct session *session,
+	      gint64 now)
+{
+  struct addrinfo *address = generator->address;
+  struct epoll_event event;
+  int one = 1;
+  int fd = socket
+    (address->ai_family, address->ai_socktype | SOCK_NONBLOCK,
+     address->ai_protocol);
+
+  generator->connections_opened++;
+
+  if (fd < 0)
+    {
+      /* Usually `EMFILE'; see the README regarding `ulimit -n'. */
+
+      generator->connect_failures++;
+      session->state = generator->options->scenario == SCENARIO_LOGIN
+	? SESSION_IDLE : SESSION_CLOSED;
+      if (session->state == SESSION_IDLE)
+	generator->idle[generator->num_idle++] = session->index;
+      return;
+    }
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (int));
+
+  session->fd = fd;
+  session->start_time = now;
+  session->state = SESSION_CONNECTING;
+  generator->num_pending++;
+
+  if (connect (fd, address->ai_addr, address->ai_addrlen) < 0
+      && errno != EINPROGRESS)
+    {
+      generator->connect_failures++;
+      session_close (generator, session);
+      return;
+    }
+
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = session;
+  session->want_write = TRUE;
+
+  if (epoll_ctl (generator->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    g_error ("epoll_ctl: %s", strerror (errno));
+}
+
+/* Sends a login request once the specified session's connection has been
+   established. */
+
+static void
+session_connected (struct generator *generator, struct session *session)
+{
+  struct options *options = generator->options;
+  size_t endpoint_len = strlen (options->endpoint) + 1;
+  char credentials[32];
+  unsigned char *payload = NULL;
+  size_t credentials_len = 0;
+  socklen_t len = sizeof (int);
+  int err = 0;
+
+  if (getsockopt (session->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0
+      || err != 0)
+    {
+      generator->connect_failures++;
+      session_close (generator, session);
+      return;
+    }
+
+  /* The login payload is the endpoint name, NUL-terminated, followed by the
+     credentials, which gzochid's default authentication plugin uses as the
+     session's name. */
+
+  credentials_len = snprintf (credentials, 32, "load-%d", session->index);
+  payload = malloc (sizeof (unsigned char) * (endpoint_len + credentials_len));
+  memcpy (payload, options->endpoint, endpoint_len);
+  memcpy (payload + endpoint_len, credentials, credentials_len);
+
+  session->state = SESSION_LOGGING_IN;
+  session_send
+    (generator, session, GZOCHI_COMMON_PROTOCOL_LOGIN_REQUEST, payload,
+     endpoint_len + credentials_len);
+
+  free (payload);
+}
+
+static void
+session_logged_in (struct generator *generator, struct session *session,
+		   gint64 now)
+{
+  unsigned char request = 0;
+  char join[32];
+
+  generator->logins++;
+  generator->num_pending--;
+  generator->num_ready++;
+  session->state = SESSION_READY;
+
+  histogram_record (&generator->login_latency, now - session->start_time);
+
+  switch (generator->options->scenario)
+    {
+    case SCENARIO_LOGIN:
+
+      session->state = SESSION_LOGGING_OUT;
+      generator->num_ready--;
+      session_send
+	(generator, session, GZOCHI_COMMON_PROTOCOL_LOGOUT_REQUEST, &request,
+	 0);
+      break;
+
+    case SCENARIO_CHANNEL:
+
+      /* Ask the server application to add the session to its channel. */
+
+      snprintf (join, 32, "Jload-%d",
+		session->index / generator->options->group_size);
+      session_send
+	(generator, session, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE,
+	 (unsigned char *) join, strlen (join));
+      break;
+
+    default: break;
+    }
+}
+
+static void
+session_message (struct generator *generator, unsigned char *payload,
+		 size_t len, gint64 now)
+{
+  gint64 sent = 0;
+
+  if (len < MIN_MESSAGE_SIZE)
+    return;
+
+  sent = gzochi_common_io_read_long (payload, 1);
+
+  generator->messages_received++;
+  histogram_record (&generator->message_latency, now - sent);
+}
+
+/* Processes a single frame received by the specified session. Returns `FALSE'
+   if the session was closed. */
+
+static gboolean
+session_dispatch (struct generator *generator, struct session *session,
+		  int opcode, unsigned char *payload, size_t len, gint64 now)
+{
+  switch (opcode)
+    {
+    case GZOCHI_COMMON_PROTOCOL_LOGIN_SUCCESS:
+      session_logged_in (generator, session, now);
+      return session->fd >= 0;
+
+    case GZOCHI_COMMON_PROTOCOL_LOGIN_FAILURE:
+      generator->login_failures++;
+      session_close (generator, session);
+      return FALSE;
+
+    case GZOCHI_COMMON_PROTOCOL_LOGOUT_SUCCESS:
+      generator->logouts++;
+      session_close (generator, session);
+      return FALSE;
+
+    case GZOCHI_COMMON_PROTOCOL_SESSION_DISCONNECTED:
+      generator->disconnects++;
+      session_close (generator, session);
+      return FALSE;
+
+    case GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE:
+      session_message (generator, payload, len, now);
+      return TRUE;
+
+    default:
+      g_warning ("Unexpected opcode %d received from server.", opcode);
+      return TRUE;
+    }
+}
+
+/* Reads everything available from the specified session's socket and
+   dispatches the complete frames. */
+
+static void
+session_readable (struct generator *generator, struct session *session,
+		  unsigned char *buf, gint64 now)
+{
+  gboolean eof = FALSE;
+  guint offset = 0;
+
+  while (TRUE)
+    {
+      ssize_t n = read (session->fd, buf, READ_BUFFER_SIZE);
+
+      if (n > 0)
+	g_byte_array_append (session->inbound, buf, n);
+      else if (n < 0 && errno == EINTR)
+	continue;
+      else
+	{
+	  eof = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+	  break;
+	}
+    }
+
+  while (session->inbound->len - offset >= 3)
+    {
+      unsigned char *frame = session->inbound->data + offset;
+      size_t len = (unsigned short) gzochi_common_io_read_short (frame, 0);
+
+      if (session->inbound->len - offset < len + 3)
+	break;
+
+      offset += len + 3;
+
+      if (!session_dispatch (generator, session, frame[2], frame + 3, len, now))
+	return;
+    }
+
+  g_byte_array_remove_range (session->inbound, 0, offset);
+
+  if (eof)
+    {
+      /* The server closed the connection without a disconnect or logout
+	 message. */
+
+      generator->errors++;
+      session_close (generator, session);
+    }
+}
+
+static void
+handle_event (struct generator *generator, struct epoll_event *event,
+	      unsigned char *buf, gint64 now)
+{
+  struct session *session = event->data.ptr;
+
+  if (session->state == SESSION_CONNECTING)
+    {
+      if (event->events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+	session_connected (generator, session);
+      return;
+    }
+
+  if (event->events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+    {
+      session_readable (generator, session, buf, now);
+      if (session->fd < 0)
+	return;
+    }
+
+  if (event->events & EPOLLOUT)
+    session_flush (generator, session);
+}
+
+/* Starts as many connection attempts as the ramp rate allows. */
+
+static void
+open_sessions (struct generator *generator, gint64 now)
+{
+  struct options *options = generator->options;
+  guint64 allowed = (now - generator->start_time) * options->ramp_rate
+    / G_USEC_PER_SEC + 1;
+
+  while (generator->num_idle > 0 && generator->connections_opened < allowed)
+    {
+      int index = generator->idle[--generator->num_idle];
+      session_open (generator, &generator->sessions[index], now);
+    }
+}
+
+/* Sends as many messages as the aggregate message rate allows, spreading them
+   round-robin across the logged-in sessions. */
+
+static void
+send_messages (struct generator *generator, gint64 now)
+{
+  struct options *options = generator->options;
+  guint64 target = (now - generator->steady_time) / (double) G_USEC_PER_SEC
+    * options->message_rate * options->num_sessions;
+  unsigned char *payload = generator->frame + 3 + MAX_MESSAGE_SIZE;
+
+  payload[0] = options->scenario == SCENARIO_CHANNEL ? 'C' : 'E';
+  memset (payload + MIN_MESSAGE_SIZE, 'x',
+	  options->message_size - MIN_MESSAGE_SIZE);
+
+  while (generator->messages_attempted < target && generator->num_ready > 0)
+    {
+      struct session *session = NULL;
+
+      do
+	{
+	  session = &generator->sessions[generator->send_cursor];
+	  generator->send_cursor =
+	    (generator->send_cursor + 1) % options->num_sessions;
+	}
+      while (session->state != SESSION_READY);
+
+      generator->messages_attempted++;
+
+      if (session->outbound->len > MAX_OUTBOUND_BYTES)
+	{
+	  generator->sends_deferred++;
+	  continue;
+	}
+
+      gzochi_common_io_write_long (g_get_monotonic_time (), payload, 1);
+      if (session_send (generator, session,
+			GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE, payload,
+			options->message_size))
+	generator->messages_sent++;
+    }
+}
+
+static void
+report_progress (struct generator *generator, gint64 now)
+{
+  if (now - generator->last_progress_time < G_USEC_PER_SEC)
+    return;
+
+  fprintf (stderr, "%6.1fs: %d ready, %d pending, %" G_GUINT64_FORMAT
+	   " logins, %" G_GUINT64_FORMAT " sent, %" G_GUINT64_FORMAT
+	   " received\n", (now - generator->start_time)
+	   / (double) G_USEC_PER_SEC, generator->num_ready,
+	   generator->num_pending, generator->logins, generator->messages_sent,
+	   generator->messages_received);
+
+  generator->last_progress_time = now;
+}
+
+/* Advances the generator from one phase to the next as the scenario
+   requires. */
+
+static void
+update_phase (struct generator *generator, gint64 now)
+{
+  struct options *options = generator->options;
+
+  switch (generator->phase)
+    {
+    case PHASE_RAMP:
+      if (generator->num_idle == 0 && generator->num_pending == 0)
+	{
+	  generator->phase = PHASE_STEADY;
+	  generator->steady_time = now;
+	}
+      break;
+
+    case PHASE_STEADY:
+      if (now - generator->steady_time
+	  >= (gint64) options->duration * G_USEC_PER_SEC)
+	{
+	  generator->phase = PHASE_DRAIN;
+	  generator->drain_time = now;
+	}
+      break;
+
+    case PHASE_DRAIN:
+      if (now - generator->drain_time >= DRAIN_US
+	  || (options->scenario == SCENARIO_LOGIN
+	      && generator->num_pending == 0))
+	generator->phase = PHASE_DONE;
+      break;
+
+    default: break;
+    }
+}
+
+static void
+run (struct generator *generator)
+{
+  struct epoll_event events[MAX_EVENTS];
+  unsigned char *buf = malloc (sizeof (unsigned char) * READ_BUFFER_SIZE);
+
+  generator->start_time = g_get_monotonic_time ();
+  generator->last_progress_time = generator->start_time;
+
+  /* The login scenario has no ramp phase; connections are opened at the ramp
+     rate for the duration of the test. */
+
+  if (generator->options->scenario == SCENARIO_LOGIN)
+    {
+      generator->phase = PHASE_STEADY;
+      generator->steady_time = generator->start_time;
+    }
+  else generator->phase = PHASE_RAMP;
+
+  while (generator->phase != PHASE_DONE)
+    {
+      gint64 now = g_get_monotonic_time ();
+      int i = 0, n = 0;
+
+      if (generator->phase == PHASE_RAMP
+	  || (generator->phase == PHASE_STEADY
+	      && generator->options->scenario == SCENARIO_LOGIN))
+	open_sessions (generator, now);
+      else if (generator->phase == PHASE_STEADY)
+	send_messages (generator, now);
+
+      n = epoll_wait (generator->epoll_fd, events, MAX_EVENTS, 1);
+      if (n < 0 && errno != EINTR)
+	g_error ("epoll_wait: %s", strerror (errno));
+
+      now = g_get_monotonic_time ();
+      for (i = 0; i < n; i++)
+	handle_event (generator, &events[i], buf, now);
+
+      update_phase (generator, now);
+      report_progress (generator, now);
+    }
+
+  free (buf);
+}
+
+static void
+print_report (struct generator *generator)
+{
+  struct options *options = generator->options;
+  const char *scenarios[] = { "login", "echo", "channel" };
+  double ramp_s = (generator->steady_time - generator->start_time)
+    / (double) G_USEC_PER_SEC;
+  double steady_s = (generator->drain_time - generator->steady_time)
+    / (double) G_USEC_PER_SEC;
+  double login_s = options->scenario == SCENARIO_LOGIN ? steady_s : ramp_s;
+
+  printf ("{\n");
+  printf ("  \"scenario\": \"%s\",\n", scenarios[options->scenario]);
+  printf ("  \"sessions\": %d,\n", options->num_sessions);
+  printf ("  \"message_rate\": %.3f,\n", options->message_rate);
+  printf ("  \"message_size\": %d,\n", options->message_size);
+  if (options->scenario == SCENARIO_CHANNEL)
+    printf ("  \"group_size\": %d,\n", options->group_size);
+  printf ("  \"ramp_s\": %.3f,\n", ramp_s);
+  printf ("  \"duration_s\": %.3f,\n", steady_s);
+  printf ("  \"connections\": %" G_GUINT64_FORMAT ",\n",
+	  generator->connections_opened);
+  printf ("  \"connect_failures\": %" G_GUINT64_FORMAT ",\n",
+	  generator->connect_failures);
+  printf ("  \"logins\": %" G_GUINT64_FORMAT ",\n", generator->logins);
+  printf ("  \"login_failures\": %" G_GUINT64_FORMAT ",\n",
+	  generator->login_failures);
+  printf ("  \"logins_per_s\": %.1f,\n",
+	  login_s > 0 ? generator->logins / login_s : 0.0);
+  printf ("  \"logouts\": %" G_GUINT64_FORMAT ",\n", generator->logouts);
+  printf ("  \"disconnects\": %" G_GUINT64_FORMAT ",\n",
+	  generator->disconnects);
+  printf ("  \"errors\": %" G_GUINT64_FORMAT ",\n", generator->errors);
+  printf ("  \"messages_sent\": %" G_GUINT64_FORMAT ",\n",
+	  generator->messages_sent);
+  printf ("  \"messages_received\": %" G_GUINT64_FORMAT ",\n",
+	  generator->messages_received);
+  printf ("  \"sends_deferred\": %" G_GUINT64_FORMAT ",\n",
+	  generator->sends_deferred);
+  printf ("  \"sent_per_s\": %.1f,\n",
+	  steady_s > 0 ? generator->messages_sent / steady_s : 0.0);
+  printf ("  \"received_per_s\": %.1f,\n",
+	  steady_s > 0 ? generator->messages_received / steady_s : 0.0);
+
+  print_histogram ("login_latency_us", &generator->login_latency, FALSE);
+  print_histogram ("message_latency_us", &generator->message_latency, TRUE);
+  printf ("}\n");
+}
+
+/* Raises the limit on open file descriptors as far as the hard limit allows,
+   since each session needs a socket. */
+
+static void
+raise_fd_limit (int num_sessions)
+{
+  struct rlimit limit;
+
+  if (getrlimit (RLIMIT_NOFILE, &limit) < 0)
+    return;
+
+  limit.rlim_cur = limit.rlim_max;
+  if (setrlimit (RLIMIT_NOFILE, &limit) < 0
+      && getrlimit (RLIMIT_NOFILE, &limit) < 0)
+    return;
+
+  if (limit.rlim_cur != RLIM_INFINITY
+      && limit.rlim_cur < (rlim_t) num_sessions + 16)
+    g_warning ("The open file limit (%lu) is too low for %d sessions.",
+	       (unsigned long) limit.rlim_cur, num_sessions);
+}
+
+static void
+print_help (const char *program_name)
+{
+  fprintf (stderr, "\
+Usage: %s [OPTION]...\n\
+\n\
+  -s, --scenario      login, echo, or channel (default: echo)\n\
+  -H, --host          the server host name (default: %s)\n\
+  -p, --port          the server port (default: %s)\n\
+  -e, --endpoint      the application endpoint (default: %s)\n\
+  -n, --sessions      the number of concurrent sessions (default: %d)\n\
+  -r, --ramp          new connections per second (default: %d)\n\
+  -m, --rate          messages per second, per session (default: %.1f)\n\
+  -b, --size          the message payload size in bytes (default: %d)\n\
+  -g, --group-size    the number of sessions per channel (default: %d)\n\
+  -d, --duration      the length of the test in seconds (default: %d)\n\
+  -h, --help          display this help and exit\n", program_name,
+	   DEFAULT_HOST, DEFAULT_PORT, DEFAULT_ENDPOINT, DEFAULT_NUM_SESSIONS,
+	   DEFAULT_RAMP_RATE, DEFAULT_MESSAGE_RATE, DEFAULT_MESSAGE_SIZE,
+	   DEFAULT_GROUP_SIZE, DEFAULT_DURATION);
+}
+
+static const struct option longopts[] =
+  {
+    { "scenario", required_argument, NULL, 's' },
+    { "host", required_argument, NULL, 'H' },
+    { "port", required_argument, NULL, 'p' },
+    { "endpoint", required_argument, NULL, 'e' },
+    { "sessions", required_argument, NULL, 'n' },
+    { "ramp", required_argument, NULL, 'r' },
+    { "rate", required_argument, NULL, 'm' },
+    { "size", required_argument, NULL, 'b' },
+    { "group-size", required_argument, NULL, 'g' },
+    { "duration", required_argument, NULL, 'd' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+static void
+parse_options (struct options *options, int argc, char *argv[])
+{
+  const char *program_name = argv[0];
+  int optc = 0;
+
+  options->host = DEFAULT_HOST;
+  options->port = DEFAULT_PORT;
+  options->endpoint = DEFAULT_ENDPOINT;
+  options->scenario = SCENARIO_ECHO;
+  options->num_sessions = DEFAULT_NUM_SESSIONS;
+  options->ramp_rate = DEFAULT_RAMP_RATE;
+  options->message_rate = DEFAULT_MESSAGE_RATE;
+  options->message_size = DEFAULT_MESSAGE_SIZE;
+  options->group_size = DEFAULT_GROUP_SIZE;
+  options->duration = DEFAULT_DURATION;
+
+  while ((optc = getopt_long
+	  (argc, argv, "s:H:p:e:n:r:m:b:g:d:h", longopts, NULL)) != -1)
+    switch (optc)
+      {
+      case 's':
+	if (strcmp (optarg, "login") == 0)
+	  options->scenario = SCENARIO_LOGIN;
+	else if (strcmp (optarg, "echo") == 0)
+	  options->scenario = SCENARIO_ECHO;
+	else if (strcmp (optarg, "channel") == 0)
+	  options->scenario = SCENARIO_CHANNEL;
+	else
+	  {
+	    print_help (program_name);
+	    exit (EXIT_FAILURE);
+	  }
+	break;
+      case 'H': options->host = optarg; break;
+      case 'p': options->port = optarg; break;
+      case 'e': options->endpoint = optarg; break;
+      case 'n': options->num_sessions = atoi (optarg); break;
+      case 'r': options->ramp_rate = atoi (optarg); break;
+      case 'm': options->message_rate = atof (optarg); break;
+      case 'b': options->message_size = atoi (optarg); break;
+      case 'g': options->group_size = atoi (optarg); break;
+      case 'd': options->duration = atoi (optarg); break;
+
+      case 'h':
+	print_help (program_name);
+	exit (EXIT_SUCCESS);
+	break;
+
+      default:
+	print_help (program_name);
+	exit (EXIT_FAILURE);
+      }
+
+  if (optind != argc || options->num_sessions <= 0 || options->ramp_rate <= 0
+      || options->message_rate < 0 || options->group_size <= 0
+      || options->duration <= 0 || options->message_size < MIN_MESSAGE_SIZE
+      || options->message_size > MAX_MESSAGE_SIZE)
+    {
+      print_help (program_name);
+      exit (EXIT_FAILURE);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct generator generator;
+  struct options options;
+  struct addrinfo hints;
+  int i = 0, err = 0;
+
+  parse_options (&options, argc, argv);
+  raise_fd_limit (options.num_sessions);
+
+  memset (&generator, 0, sizeof (struct generator));
+  memset (&hints, 0, sizeof (struct addrinfo));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  err = getaddrinfo (options.host, options.port, &hints, &generator.address);
+  if (err != 0)
+    g_error ("Failed to resolve %s:%s: %s", options.host, options.port,
+	     gai_strerror (err));
+
+  generator.options = &options;
+  generator.epoll_fd = epoll_create1 (0);
+  if (generator.epoll_fd < 0)
+    g_error ("epoll_create1: %s", strerror (errno));
+
+  generator.sessions = calloc (options.num_sessions, sizeof (struct session));
+  generator.idle = malloc (sizeof (int) * options.num_sessions);
+
+  /* The frame buffer has room for one maximum-size frame, followed by the
+     payload buffer used by `send_messages'. */
+
+  generator.frame = malloc
+    (sizeof (unsigned char) * (3 + MAX_MESSAGE_SIZE) * 2);
+
+  for (i = 0; i < options.num_sessions; i++)
+    {
+      struct session *session = &generator.sessions[i];
+
+      session->index = i;
+      session->fd = -1;
+      session->state = SESSION_IDLE;
+      session->inbound = g_byte_array_new ();
+      session->outbound = g_byte_array_new ();
+
+      /* Push the sessions in reverse so that they are opened in order. */
+
+      generator.idle[options.num_sessions - i - 1] = i;
+    }
+
+  generator.num_idle = options.num_sessions;
+
+  run (&generator);
+  print_report (&generator);
+
+  for (i = 0; i < options.num_sessions; i++)
+    {
+      struct session *session = &generator.sessions[i];
+
+      if (session->fd >= 0)
+	close (session->fd);
+
+      g_byte_array_unref (session->inbound);
+      g_byte_array_unref (session->outbound);
+    }
+
+  close (generator.epoll_fd);
+  freeaddrinfo (generator.address);
+  free (generator.frame);
+  free (generator.idle);
+  free (generator.sessions);
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+;; load-generator/server.scm --- Load generator benchmark, server side
+;; Copyright (C) 2017 Julian Graham
+;;
+;; gzochi is free software: you can redistribute it and/or modify it
+;; under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+;; 
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#!r6rs
+
+(library (server)
+  (export disconnected initialized logged-in received-message)
+  (import (gzochi) (rnrs))
+
+  ;; Collocates the client session with the channel it has joined, if any, so
+  ;; that the channel doesn't have to be looked up on every message.
+
+  (gzochi:define-managed-record-type load-client
+    (fields session (mutable channel)))
+
+  ;; Channels are created on demand as clients join them.
+
+  (define (initialized properties) (if #f #f))
+
+  (define (get-or-create-channel name)
+    (guard (condition ((gzochi:name-not-bound-condition? condition)
+		       (gzochi:create-channel name)))
+      (gzochi:get-channel name)))
+
+  ;; The first byte of each message from the load generator says what to do
+  ;; with it: "E" messages are echoed back to the sender; "J" messages carry
+  ;; the name of a channel for the sender to join; and "C" messages are
+  ;; broadcast to the members of the sender's channel.
+
+  (define (received-message msg client)
+    (let ((session (load-client-session client))
+	  (channel (load-client-channel client)))
+      (case (integer->char (bytevector-u8-ref msg 0))
+	((#\E) (gzochi:send-message session msg))
+	((#\J)
+	 (let ((new-channel 
+		(get-or-create-channel (substring (utf8->string msg) 1))))
+	   (if channel (gzochi:leave-channel channel session))
+	   (gzochi:join-channel new-channel session)
+	   (load-client-channel-set! client new-channel)))
+	((#\C) (if channel (gzochi:send-channel-message channel msg)))
+	(else (raise (make-assertion-violation))))))
+
+  ;; Remove the session from its channel, if it joined one.
+
+  (define (disconnected client)
+    (let ((channel (load-client-channel client)))
+      (if channel
+	  (gzochi:leave-channel channel (load-client-session client)))))
+
+  (define (logged-in client-session)
+    (let ((client (make-load-client client-session #f)))
+      (gzochi:make-client-session-listener
+       (g:@ received-message client) (g:@ disconnected client))))
+)
@@ -0,0 +1,155 @@
+/* bench-lock.c: Throughput benchmark for the gzochi-metad lock table
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lock.h"
+
+/* This benchmark measures the cost of the point lock operations performed by
+   the meta server's data server - checking, setting, upgrading, and releasing
+   locks - against a lock table that holds a large number of locks, spread
+   across a handful of application server nodes. It also measures the cost of
+   range lock requests that must be checked against the held write locks. */
+
+#define DEFAULT_NUM_LOCKS 1000000
+
+#define NUM_NODES 8
+
+static void
+print_result (const char *phase, int n, gint64 elapsed_us)
+{
+  printf ("%-12s %12d ops %12.0f ops/sec\n", phase, n,
+	  n / (elapsed_us / (double) G_USEC_PER_SEC));
+}
+
+/* Returns an array of `n' distinct keys, in ascending order. */
+
+static GPtrArray *
+create_keys (int n)
+{
+  GPtrArray *keys = g_ptr_array_new_full
+    (n, (GDestroyNotify) g_bytes_unref);
+  int i = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      gchar *key = g_strdup_printf ("key-%010d", i);
+      g_ptr_array_add (keys, g_bytes_new_take (key, strlen (key) + 1));
+    }
+
+  return keys;
+}
+
+/* Acquires a read lock on every key, on behalf of the node given by the key's
+   index modulo the number of nodes. */
+
+static void
+acquire_all (gzochid_lock_table *lock_table, GPtrArray *keys)
+{
+  int i = 0;
+
+  for (i = 0; i < keys->len; i++)
+    if (!gzochid_lock_check_and_set
+	(lock_table, i % NUM_NODES, g_ptr_array_index (keys, i), FALSE, NULL))
+      g_error ("Failed to acquire lock %d.", i);
+}
+
+static void
+run (int n)
+{
+  GPtrArray *keys = create_keys (n);
+  gzochid_lock_table *lock_table = gzochid_lock_table_new (NULL);
+  gint64 start = g_get_monotonic_time ();
+  int i = 0, num_ranges = n / 100;
+
+  acquire_all (lock_table, keys);
+  print_result ("acquire", n, g_get_monotonic_time () - start);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n; i++)
+    gzochid_lock_check
+      (lock_table, i % NUM_NODES, g_ptr_array_index (keys, i), FALSE);
+  print_result ("check", n, g_get_monotonic_time () - start);
+
+  /* Requests for write locks by other nodes are denied. */
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n; i++)
+    gzochid_lock_check_and_set
+      (lock_table, (i + 1) % NUM_NODES, g_ptr_array_index (keys, i), TRUE,
+       NULL);
+  print_result ("deny", n, g_get_monotonic_time () - start);
+
+  /* Upgrade every read lock to a write lock. */
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n; i++)
+    gzochid_lock_check_and_set
+      (lock_table, i % NUM_NODES, g_ptr_array_index (keys, i), TRUE, NULL);
+  print_result ("upgrade", n, g_get_monotonic_time () - start);
+
+  /* Range lock requests from a node holding no locks conflict with the write
+     locks, and are denied. */
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < num_ranges; i++)
+    gzochid_lock_range_check_and_set
+      (lock_table, NUM_NODES, g_ptr_array_index (keys, i * 100),
+       g_ptr_array_index (keys, i * 100 + 1), NULL);
+  print_result ("range-deny", num_ranges, g_get_monotonic_time () - start);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n; i++)
+    gzochid_lock_release
+      (lock_table, i % NUM_NODES, g_ptr_array_index (keys, i));
+  print_result ("release", n, g_get_monotonic_time () - start);
+
+  /* Reacquire the locks, then release them a node at a time, as the data
+     server does when a node disconnects. */
+
+  acquire_all (lock_table, keys);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < NUM_NODES; i++)
+    gzochid_lock_release_all (lock_table, i);
+  print_result ("release-all", n, g_get_monotonic_time () - start);
+
+  gzochid_lock_table_free (lock_table);
+  g_ptr_array_unref (keys);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi (argv[1]) : DEFAULT_NUM_LOCKS;
+
+  if (n < 100)
+    {
+      fprintf (stderr, "Usage: %s [NUM_LOCKS]\n", argv[0]);
+      return 1;
+    }
+
+  printf ("%d held locks across %d nodes\n", n, NUM_NODES);
+
+  run (n);
+
+  return 0;
+}
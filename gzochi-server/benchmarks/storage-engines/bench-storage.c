@@ -0,0 +1,320 @@
+/* bench-storage.c: Transaction throughput benchmark for gzochid storage engines
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gmodule.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "gzochid-storage.h"
+#include "storage-mem.h"
+
+/* This benchmark measures the transaction throughput of the available storage
+   engines - the built-in `mem' engine, and the `bdb' and `lmdb' modules, if
+   they were built - under workloads that resemble those of game application
+   tasks: several threads executing short transactions that read and update
+   managed objects, a small set of which (e.g., channels, or a game's global
+   state) are accessed much more frequently than the rest.
+
+   In the "read-heavy" workload, each transaction reads several objects and
+   one in ten transactions also updates one of them. In the "write-heavy"
+   workload, each transaction reads and updates two objects. Transactions that
+   fail due to a conflict with another transaction (a deadlock, a lock timeout,
+   or a failed validation) are rolled back and retried, and the number of
+   retries is reported along with the throughput. */
+
+#define Q(x) #x
+#define QUOTE(x) Q(x)
+
+#define DEFAULT_NUM_TRANSACTIONS 100000
+
+#define NUM_KEYS 100000
+#define NUM_HOT_KEYS 64
+#define NUM_THREADS 8
+#define VALUE_SIZE 128
+
+#define LOAD_BATCH_SIZE 1000
+#define READS_PER_TRANSACTION 8
+#define TRANSACTION_TIMEOUT_MS 100
+
+/* The state of a benchmark run against a single engine. */
+
+struct _bench_context
+{
+  gzochid_storage_engine_interface *iface;
+  gzochid_storage_context *context;
+  gzochid_storage_store *store;
+
+  gboolean write_heavy; /* Whether the write-heavy workload is being run. */
+  int transactions_per_thread;
+  gint retries; /* The number of transaction retries, updated atomically. */
+};
+
+typedef struct _bench_context bench_context;
+
+static void
+print_result (const char *phase, int n, gint64 elapsed_us, int retries)
+{
+  printf ("%-12s %12d tx %12.0f tx/sec %10d retries\n", phase, n,
+	  n / (elapsed_us / (double) G_USEC_PER_SEC), retries);
+}
+
+static void
+format_key (char *key, int i)
+{
+  snprintf (key, 16, "key-%010d", i);
+}
+
+/* Picks a key index at random, choosing one of the hot keys one time in
+   ten. */
+
+static int
+random_key (GRand *rand)
+{
+  if (g_rand_int_range (rand, 0, 10) == 0)
+    return g_rand_int_range (rand, 0, NUM_HOT_KEYS);
+  else return g_rand_int_range (rand, 0, NUM_KEYS);
+}
+
+static gzochid_storage_transaction *
+begin (bench_context *bench)
+{
+  struct timeval timeout = { 0, TRANSACTION_TIMEOUT_MS * 1000 };
+
+  return bench->iface->transaction_begin_timed (bench->context, timeout);
+}
+
+/* Prepares and commits the specified transaction if it has not been marked for
+   rollback, and rolls it back otherwise. Returns `TRUE' if the transaction was
+   committed. */
+
+static gboolean
+finish (bench_context *bench, gzochid_storage_transaction *tx)
+{
+  if (!tx->rollback)
+    bench->iface->transaction_prepare (tx);
+
+  if (tx->rollback)
+    {
+      bench->iface->transaction_rollback (tx);
+      return FALSE;
+    }
+  else
+    {
+      bench->iface->transaction_commit (tx);
+      return TRUE;
+    }
+}
+
+static void
+load (bench_context *bench)
+{
+  char key[16], value[VALUE_SIZE];
+  int i = 0;
+
+  memset (value, 'x', VALUE_SIZE);
+
+  while (i < NUM_KEYS)
+    {
+      gzochid_storage_transaction *tx =
+	bench->iface->transaction_begin (bench->context);
+      int j = i;
+
+      for (; j < NUM_KEYS && j < i + LOAD_BATCH_SIZE; j++)
+	{
+	  format_key (key, j);
+	  bench->iface->transaction_put
+	    (tx, bench->store, key, strlen (key) + 1, value, VALUE_SIZE);
+	}
+
+      if (!finish (bench, tx))
+	g_error ("Failed to load keys %d through %d.", i, j);
+
+      i = j;
+    }
+}
+
+/* Executes a single transaction of the current workload. Returns `TRUE' if the
+   transaction committed. */
+
+static gboolean
+execute (bench_context *bench, GRand *rand, gboolean update)
+{
+  gzochid_storage_transaction *tx = begin (bench);
+  int num_reads = bench->write_heavy ? 2 : READS_PER_TRANSACTION;
+  char key[16];
+  int i = 0;
+
+  for (; i < num_reads && !tx->rollback; i++)
+    {
+      gboolean write = bench->write_heavy || (update && i == 0);
+      size_t value_len = 0;
+      char *value = NULL;
+
+      format_key (key, random_key (rand));
+      value = write
+	? bench->iface->transaction_get_for_update
+	(tx, bench->store, key, strlen (key) + 1, &value_len)
+	: bench->iface->transaction_get
+	(tx, bench->store, key, strlen (key) + 1, &value_len);
+
+      if (value == NULL)
+	continue;
+
+      if (write)
+	{
+	  value[0]++;
+	  bench->iface->transaction_put
+	    (tx, bench->store, key, strlen (key) + 1, value, value_len);
+	}
+
+      free (value);
+    }
+
+  return finish (bench, tx);
+}
+
+static gpointer
+run_thread (gpointer data)
+{
+  bench_context *bench = data;
+  GRand *rand = g_rand_new ();
+  int i = 0;
+
+  for (; i < bench->transactions_per_thread; i++)
+    {
+      gboolean update = !bench->write_heavy && i % 10 == 0;
+
+      while (!execute (bench, rand, update))
+	g_atomic_int_inc (&bench->retries);
+    }
+
+  g_rand_free (rand);
+  return NULL;
+}
+
+static void
+run_workload (bench_context *bench, const char *phase, gboolean write_heavy,
+	      int n)
+{
+  GThread *threads[NUM_THREADS];
+  gint64 start = 0;
+  int i = 0;
+
+  bench->write_heavy = write_heavy;
+  bench->transactions_per_thread = n / NUM_THREADS;
+  bench->retries = 0;
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < NUM_THREADS; i++)
+    threads[i] = g_thread_new (phase, run_thread, bench);
+  for (i = 0; i < NUM_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  print_result (phase, bench->transactions_per_thread * NUM_THREADS,
+		g_get_monotonic_time () - start, bench->retries);
+}
+
+static void
+run (gzochid_storage_engine_interface *iface, int n)
+{
+  bench_context bench;
+  gchar *dir = g_dir_make_tmp (NULL, NULL);
+  gint64 start = 0;
+
+  memset (&bench, 0, sizeof (bench_context));
+
+  bench.iface = iface;
+  bench.context = iface->initialize (dir);
+
+  if (bench.context == NULL)
+    g_error ("Failed to initialize %s storage context.", iface->name);
+
+  bench.store = iface->open (bench.context, "bench", GZOCHID_STORAGE_CREATE);
+
+  printf ("%s\n", iface->name);
+
+  start = g_get_monotonic_time ();
+  load (&bench);
+  print_result ("load", NUM_KEYS / LOAD_BATCH_SIZE,
+		g_get_monotonic_time () - start, 0);
+
+  run_workload (&bench, "read-heavy", FALSE, n);
+  run_workload (&bench, "write-heavy", TRUE, n);
+
+  iface->close_store (bench.store);
+  iface->destroy_store (bench.context, "bench");
+  iface->close_context (bench.context);
+  iface->destroy_context (dir);
+
+  if (g_file_test (dir, G_FILE_TEST_EXISTS))
+    g_rmdir (dir);
+
+  g_free (dir);
+}
+
+#if defined (BDB_MODULE_LOCATION) || defined (LMDB_MODULE_LOCATION)
+
+static gzochid_storage_engine_interface *
+load_engine (const char *location)
+{
+  gzochid_storage_engine engine;
+  gint (*initializer) (gzochid_storage_engine *);
+  GModule *module = g_module_open (location, G_MODULE_BIND_LOCAL);
+
+  if (module == NULL
+      || !g_module_symbol (module, "gzochid_storage_init_engine",
+			   (gpointer *) &initializer))
+    g_error ("Failed to load storage engine at %s.", location);
+
+  initializer (&engine);
+  return engine.interface;
+}
+
+#endif
+
+int
+main (int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi (argv[1]) : DEFAULT_NUM_TRANSACTIONS;
+
+  if (n < NUM_THREADS)
+    {
+      fprintf (stderr, "Usage: %s [NUM_TRANSACTIONS]\n", argv[0]);
+      return 1;
+    }
+
+  printf ("%d keys (%d hot), %d threads\n", NUM_KEYS, NUM_HOT_KEYS,
+	  NUM_THREADS);
+
+  run (&gzochid_storage_engine_interface_mem, n);
+
+#ifdef BDB_MODULE_LOCATION
+  run (load_engine (QUOTE (BDB_MODULE_LOCATION)), n);
+#endif /* BDB_MODULE_LOCATION */
+
+#ifdef LMDB_MODULE_LOCATION
+  run (load_engine (QUOTE (LMDB_MODULE_LOCATION)), n);
+#endif /* LMDB_MODULE_LOCATION */
+
+  return 0;
+}
@@ -26,8 +26,17 @@ local pf_credentials = ProtoField.new("Credentials", "gzochi-meta.credentials",
 local pf_message = ProtoField.new("Message", "gzochi-meta.message",
 				  ftypes.BYTES)
 local pf_type = ProtoField.new("Type", "gzochi-meta.type", ftypes.STRING)
-
-game_proto.fields = { pf_app, pf_credentials, pf_message, pf_type }
+local pf_inner_type = ProtoField.new("Compressed type",
+				     "gzochi-meta.inner_type", ftypes.UINT8,
+				     nil, base.HEX)
+local pf_uncompressed_len = ProtoField.new("Uncompressed length",
+					   "gzochi-meta.uncompressed_len",
+					   ftypes.UINT16)
+local pf_options = ProtoField.new("Options", "gzochi-meta.options",
+				  ftypes.UINT8, nil, base.HEX)
+
+game_proto.fields = { pf_app, pf_credentials, pf_message, pf_type,
+		      pf_inner_type, pf_uncompressed_len, pf_options }
 
 -- Decodes the two-byte message length prefix from the start of the PDU
 
@@ -71,6 +80,52 @@ function dissect_session_message(tvb, pinfo, tree)
    tree:add(pf_message, tvb:range(3))
 end
 
+-- Adds each of the length-prefixed messages in a session message batch payload
+-- starting at the specified offset
+
+function dissect_batch_entries(tvb, offset, tree)
+   while offset + 2 <= tvb:len() do
+      local len = tvb:range(offset, 2):uint()
+
+      if len > 0 then
+	 tree:add(pf_message, tvb:range(offset + 2, len))
+      end
+      offset = offset + len + 2
+   end
+end
+
+function dissect_session_message_batch(tvb, pinfo, tree)
+   tree:add(pf_type, "SESSION_MESSAGE_BATCH")
+   dissect_batch_entries(tvb, 3, tree)
+end
+
+function dissect_compressed_message(tvb, pinfo, tree)
+   local inner_type = tvb:range(3, 1):uint()
+   local uncompressed = tvb:range(6):uncompress("Uncompressed payload")
+
+   tree:add(pf_type, "COMPRESSED_MESSAGE")
+   tree:add(pf_inner_type, tvb:range(3, 1))
+   tree:add(pf_uncompressed_len, tvb:range(4, 2))
+
+   if uncompressed ~= nil then
+      if inner_type == 0x32 then
+	 dissect_batch_entries(uncompressed, 0, tree)
+      else
+	 tree:add(pf_message, uncompressed:range(0))
+      end
+   end
+end
+
+function dissect_options_request(tvb, pinfo, tree)
+   tree:add(pf_type, "OPTIONS_REQUEST")
+   tree:add(pf_options, tvb:range(3, 1))
+end
+
+function dissect_options_response(tvb, pinfo, tree)
+   tree:add(pf_type, "OPTIONS_RESPONSE")
+   tree:add(pf_options, tvb:range(3, 1))
+end
+
 -- Dissector function opcode table
 
 msg_type_dissectors = {
@@ -80,7 +135,11 @@ msg_type_dissectors = {
    [0x20] = dissect_logout_request,
    [0x21] = dissect_logout_success,
    [0x30] = dissect_session_disconnected,
-   [0x31] = dissect_session_message
+   [0x31] = dissect_session_message,
+   [0x32] = dissect_session_message_batch,
+   [0x33] = dissect_compressed_message,
+   [0x40] = dissect_options_request,
+   [0x41] = dissect_options_response
 }
 
 -- Dissector router function
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 
 #include "../app.h"
+#include "../backup.h"
 #include "../game.h"
 #include "../guile.h"
 #include "../gzochid-auth.h"
@@ -119,6 +120,41 @@ SCM_DEFINE (primitive_with_application, "primitive-with-application",
   return SCM_UNSPECIFIED;
 }
 
+SCM_DEFINE (primitive_backup_application, "primitive-backup-application", 
+	    2, 0, 0, (SCM context, SCM directory), 
+	    "Writes a snapshot of the specified application's data to the "
+	    "specified directory, returning an association list of store names "
+	    "to record counts, or an error message string on failure.")
+{
+  SCM ret = SCM_BOOL_F;
+  char *name = scm_to_locale_string 
+    (scm_call_1 (scm_application_context_name, context));
+  char *dir = scm_to_locale_string (directory);
+  gzochid_application_context *app_context = 
+    gzochid_game_server_lookup_application (game_server, name);
+  gzochid_backup_stats stats;
+  GError *err = NULL;
+
+  free (name);
+
+  if (gzochid_backup_application (app_context, dir, &stats, &err))
+    ret = scm_list_3
+      (scm_cons (scm_from_locale_symbol ("meta"),
+		 scm_from_ulong (stats.num_meta_records)),
+       scm_cons (scm_from_locale_symbol ("oids"),
+		 scm_from_ulong (stats.num_oids_records)),
+       scm_cons (scm_from_locale_symbol ("names"),
+		 scm_from_ulong (stats.num_names_records)));
+  else
+    {
+      ret = scm_from_locale_string (err->message);
+      g_error_free (err);
+    }
+
+  free (dir);
+  return ret;
+}
+
 void 
 gzochid_api_admin_init (GzochidGameServer *server)
 {
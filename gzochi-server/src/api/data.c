@@ -93,6 +93,30 @@ SCM_DEFINE (primitive_dereference, "primitive-dereference", 1, 0, 0, (SCM ref),
   return ret;
 }
 
+SCM_DEFINE (primitive_prefetch, "primitive-prefetch", 1, 0, 0, (SCM oids),
+	    "Begin retrieving the managed records with the specified oids.")
+{
+  gzochid_application_context *context = 
+    gzochid_api_ensure_current_application_context ();
+  GArray *oid_array = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  while (!scm_is_null (oids))
+    {
+      guint64 oid = scm_to_uint64 (SCM_CAR (oids));
+
+      g_array_append_val (oid_array, oid);
+      oids = SCM_CDR (oids);
+    }
+
+  gzochid_data_prefetch
+    (context, (guint64 *) oid_array->data, oid_array->len, NULL);  
+  g_array_unref (oid_array);
+
+  gzochid_api_check_transaction ();
+
+  return SCM_UNSPECIFIED;
+}
+
 static char *prefix_name (char *name)
 {
   int name_len = strlen (name);
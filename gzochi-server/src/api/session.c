@@ -27,8 +27,9 @@
 #include "session.h"
 #include "util.h"
 
-SCM_DEFINE (primitive_send_message, "primitive-send-message", 2, 0, 0,
-	    (SCM session, SCM msg), "Send a message to a client session.")
+SCM_DEFINE (primitive_send_message, "primitive-send-message", 2, 1, 0,
+	    (SCM session, SCM msg, SCM droppable),
+	    "Send a message to a client session.")
 {
   GError *err = NULL;
   gzochid_application_context *context =
@@ -45,8 +46,13 @@ SCM_DEFINE (primitive_send_message, "primitive-send-message", 2, 0, 0,
   gzochid_data_dereference (reference, &err);
 
   if (err == NULL)
-    gzochid_client_session_send_message 
-      (context, (gzochid_client_session *) reference->obj, payload, len);
+    {
+      if (!SCM_UNBNDP (droppable) && scm_is_true (droppable))
+	gzochid_client_session_send_droppable_message
+	  (context, (gzochid_client_session *) reference->obj, payload, len);
+      else gzochid_client_session_send_message 
+	     (context, (gzochid_client_session *) reference->obj, payload, len);
+    }
   else gzochid_api_check_not_found (err);
 
   gzochid_api_check_transaction ();
@@ -54,6 +60,33 @@ SCM_DEFINE (primitive_send_message, "primitive-send-message", 2, 0, 0,
   return SCM_UNSPECIFIED;
 }
 
+SCM_DEFINE (primitive_client_session_congested_p,
+	    "primitive-client-session-congested?", 1, 0, 0, (SCM session),
+	    "Returns whether a client session's send queue is congested.")
+{
+  GError *err = NULL;
+  gzochid_application_context *context =
+    gzochid_api_ensure_current_application_context ();
+  gzochid_data_managed_reference *reference = NULL;
+  guint64 c_oid = gzochid_scheme_client_session_oid (session);
+  SCM ret = SCM_BOOL_F;
+  
+  reference = gzochid_data_create_reference_to_oid
+    (context, &gzochid_client_session_serialization, c_oid);
+
+  gzochid_data_dereference (reference, &err);
+
+  if (err == NULL)
+    ret = scm_from_bool
+      (gzochid_client_session_congested
+       (context, (gzochid_client_session *) reference->obj));
+  else gzochid_api_check_not_found (err);
+
+  gzochid_api_check_transaction ();
+
+  return ret;
+}
+
 SCM_DEFINE (primitive_disconnect, "primitive-disconnect", 1, 0, 0,
 	    (SCM session), "Disconnect a client session.")
 {
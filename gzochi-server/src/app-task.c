@@ -100,7 +100,23 @@ execution_new (gzochid_application_task *task,
   else execution->timeout = NULL;
 
   execution->attempts = 0;
-  execution->max_attempts = GZOCHID_APPLICATION_MAX_ATTEMPTS_DEFAULT;
+
+  if (task->context != NULL && task->context->retry_policy.max_attempts > 0)
+    {
+      execution->max_attempts = task->context->retry_policy.max_attempts;
+      execution->initial_backoff_ms =
+	task->context->retry_policy.initial_backoff_ms;
+      execution->max_backoff_ms = task->context->retry_policy.max_backoff_ms;
+    }
+  else
+    {
+      execution->max_attempts = GZOCHID_APPLICATION_MAX_ATTEMPTS_DEFAULT;
+      execution->initial_backoff_ms = 0;
+      execution->max_backoff_ms = 0;
+    }
+
+  execution->has_affinity = FALSE;
+  execution->affinity_key = 0;
   execution->result = GZOCHID_TRANSACTION_PENDING;
 
   return execution;
@@ -138,6 +154,14 @@ gzochid_transactional_application_task_execution_free
   free (execution);
 }
 
+void
+gzochid_transactional_application_task_execution_set_affinity
+(gzochid_transactional_application_task_execution *execution, guint64 key)
+{
+  execution->has_affinity = TRUE;
+  execution->affinity_key = key;
+}
+
 static void 
 transactional_task_worker (gpointer data)
 {
@@ -278,6 +302,24 @@ gzochid_application_transaction_execute_timed
   return gzochid_transaction_execute_timed (event_func_wrapper, args, timeout);
 }
 
+/* Computes the delay before the next retry of the specified execution and 
+   reports it to the specified application's stats via a `TRANSACTION_RETRY'
+   event. Returns the delay, in microseconds. */
+
+static guint64
+prepare_retry (gzochid_application_context *app_context,
+	       gzochid_transactional_application_task_execution *execution)
+{
+  guint64 delay_us = gzochid_application_retry_delay (execution);
+
+  gzochid_event_dispatch
+    (app_context->event_source,
+     g_object_new (GZOCHID_TYPE_TRANSACTION_EVENT,
+		   "type", TRANSACTION_RETRY, "duration-us", delay_us, NULL));
+
+  return delay_us;
+}
+
 void 
 gzochid_application_reexecuting_transactional_task_worker 
 (gzochid_application_context *app_context, gzochid_auth_identity *identity, 
@@ -285,9 +327,19 @@ gzochid_application_reexecuting_transactional_task_worker
 {
   gzochid_transactional_application_task_execution *execution = data;
 
-  do gzochid_application_transactional_task_worker 
-       (app_context, identity, execution);
-  while (gzochid_application_should_retry (execution));
+  gzochid_application_transactional_task_worker 
+    (app_context, identity, execution);
+  
+  while (gzochid_application_should_retry (execution))
+    {
+      guint64 delay_us = prepare_retry (app_context, execution);
+
+      if (delay_us > 0)
+	g_usleep (delay_us);
+      
+      gzochid_application_transactional_task_worker 
+	(app_context, identity, execution);
+    }
 
   if (execution->result != GZOCHID_TRANSACTION_SUCCESS
       && execution->catch_task != NULL)
@@ -321,8 +373,11 @@ gzochid_application_resubmitting_transactional_task_worker
  gpointer data)
 {
   gboolean resubmitting_execution = FALSE;
+  guint64 delay_us = 0;
   gzochid_application_task *application_task = NULL;
   gzochid_transactional_application_task_execution *execution = data;
+  gboolean has_affinity = execution->has_affinity;
+  guint64 affinity_key = execution->affinity_key;
 
   gzochid_application_transactional_task_worker 
     (app_context, identity, execution);
@@ -330,6 +385,7 @@ gzochid_application_resubmitting_transactional_task_worker
   if (gzochid_application_should_retry (execution))
     {
       resubmitting_execution = TRUE;
+      delay_us = prepare_retry (app_context, execution);
       execution->result = GZOCHID_TRANSACTION_PENDING;
       
       application_task = gzochid_application_task_new
@@ -345,6 +401,8 @@ gzochid_application_resubmitting_transactional_task_worker
 	(execution->catch_task, NULL, execution->cleanup_task);
 
       catch_execution->max_attempts = 1;
+      catch_execution->has_affinity = has_affinity;
+      catch_execution->affinity_key = affinity_key;
       
       application_task = gzochid_application_task_new
 	(app_context, identity,
@@ -367,8 +425,25 @@ gzochid_application_resubmitting_transactional_task_worker
       task.worker = gzochid_application_task_thread_worker;
       task.data = application_task;
       gettimeofday (&task.target_execution_time, NULL);
+
+      if (delay_us > 0)
+	{
+	  struct timeval delay;
+
+	  delay.tv_sec = delay_us / G_USEC_PER_SEC;
+	  delay.tv_usec = delay_us % G_USEC_PER_SEC;
+	  
+	  timeradd (&task.target_execution_time, &delay,
+		    &task.target_execution_time);
+	}
+
+      /* The follow-up task takes the place of this one at the front of the 
+	 execution's lane, if it has one. */
       
-      gzochid_schedule_submit_task (app_context->task_queue, &task);
+      if (has_affinity)
+	gzochid_schedule_submit_task_with_affinity_first
+	  (app_context->task_queue, affinity_key, &task);
+      else gzochid_schedule_submit_task (app_context->task_queue, &task);
     }
 }
 
@@ -394,3 +469,31 @@ gzochid_application_should_retry
   return execution->result == GZOCHID_TRANSACTION_SHOULD_RETRY
     && execution->attempts < execution->max_attempts;
 }
+
+guint64
+gzochid_application_retry_delay
+(gzochid_transactional_application_task_execution *execution)
+{
+  guint64 bound_us = 0, max_us = 0;
+  unsigned int i = 1;
+  
+  if (execution->initial_backoff_ms == 0)
+    return 0;
+
+  bound_us = (guint64) execution->initial_backoff_ms * 1000;
+  max_us = (guint64) MAX (execution->max_backoff_ms,
+			  execution->initial_backoff_ms) * 1000;
+
+  /* Double the bound once for every failed attempt after the first, stopping
+     short of the maximum. */
+  
+  for (; i < execution->attempts && bound_us < max_us; i++)
+    bound_us *= 2;
+
+  bound_us = MIN (bound_us, max_us);
+
+  /* "Equal jitter": Wait for at least half of the bound, plus a random amount
+     up to the other half. */
+  
+  return bound_us / 2 + (guint64) (g_random_double () * (bound_us / 2 + 1));
+}
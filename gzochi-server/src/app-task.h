@@ -32,6 +32,11 @@ struct _gzochid_task_transaction_context
   gzochid_application_context *context;
   gzochid_auth_identity *identity;
   GList *scheduled_tasks;
+
+  /* Periodic task executions to be added to the application's tick buckets on
+     commit. */
+
+  GList *scheduled_periodic_tasks;
 };
 
 typedef struct _gzochid_task_transaction_context
@@ -74,6 +79,20 @@ struct _gzochid_transactional_application_task_execution
   struct timeval *timeout;
   unsigned int attempts;
   unsigned int max_attempts;
+
+  /* Retry backoff parameters, initialized - like `max_attempts' - from the 
+     retry policy of the main task's application. */
+
+  unsigned long initial_backoff_ms;
+  unsigned long max_backoff_ms;
+
+  /* Whether the execution runs in the execution lane identified by 
+     `affinity_key' in its application's task queue. See
+     `gzochid_transactional_application_task_execution_set_affinity'. */
+
+  gboolean has_affinity;
+  guint64 affinity_key;
+
   gzochid_transaction_result result;
 };
 
@@ -126,6 +145,16 @@ gzochid_transactional_application_task_timed_execution_new
 void gzochid_transactional_application_task_execution_free
 (gzochid_transactional_application_task_execution *);
 
+/* Binds the specified transactional application task execution to the 
+   execution lane with the specified affinity key in its application's task 
+   queue. The execution must be first submitted to that lane; the resubmitting
+   worker below then submits the execution's retries and its catch and cleanup
+   tasks to the front of the lane, so that the lane's other tasks can't overtake
+   them. */
+
+void gzochid_transactional_application_task_execution_set_affinity
+(gzochid_transactional_application_task_execution *, guint64);
+
 void gzochid_application_transactional_task_worker 
 (gzochid_application_context *, gzochid_auth_identity *, gpointer);
 
@@ -133,7 +162,12 @@ void gzochid_application_transactional_task_worker
    transactional application task wrapped by the specified 
    `gzochid_transactional_application_task_execution', synchronously retrying on
    transaction failure up to the task retry maximum; and runs the wrapped
-   catch and cleanup handler tasks as appropriate. */
+   catch and cleanup handler tasks as appropriate. 
+
+   The retry backoff delay is slept on the calling thread, so this worker should
+   only be used when the caller must wait for the execution's completion - e.g.,
+   to free resources the execution depends on. Otherwise, prefer the 
+   resubmitting worker below. */
 
 void gzochid_application_reexecuting_transactional_task_worker 
 (gzochid_application_context *, gzochid_auth_identity *, gpointer);
@@ -142,7 +176,9 @@ void gzochid_application_reexecuting_transactional_task_worker
    the transactional application task wrapped by the specified
    `gzochid_transactional_application_task_execution', resubmitting the task on
    transaction failure up to the task retry maximum; and submits the wrapped
-   catch and cleanup handler tasks as appropriate. */
+   catch and cleanup handler tasks as appropriate. Retries are submitted with
+   the retry backoff delay as their target execution time, so no thread is held
+   while they wait. */
 
 void gzochid_application_resubmitting_transactional_task_worker 
 (gzochid_application_context *, gzochid_auth_identity *, gpointer);
@@ -152,4 +188,14 @@ void gzochid_application_task_thread_worker (gpointer, gpointer);
 gboolean gzochid_application_should_retry 
 (gzochid_transactional_application_task_execution *);
 
+/* Returns the delay, in microseconds, that should elapse before the next 
+   attempt of the specified transactional application task execution, based on
+   the number of attempts made so far. The delay is drawn at random from the 
+   upper half of an interval whose bound grows exponentially with the number of
+   failed attempts, up to the execution's maximum backoff. Returns 0 if backoff
+   is disabled for the execution. */
+
+guint64 gzochid_application_retry_delay
+(gzochid_transactional_application_task_execution *);
+
 #endif /* GZOCHID_APP_TASK_H */
@@ -58,6 +58,10 @@ gzochid_application_context_new (void)
     (g_int64_hash, g_int64_equal, free, (GDestroyNotify) g_sequence_free);
 
   g_mutex_init (&context->channel_mapping_lock);
+
+  context->periodic_task_buckets = g_hash_table_new_full
+    (g_bytes_hash, g_bytes_equal, (GDestroyNotify) g_bytes_unref, NULL);
+  g_mutex_init (&context->periodic_task_buckets_lock);
   
   context->event_source = gzochid_event_source_new ();
   context->stats = calloc (1, sizeof (gzochid_application_stats));
@@ -79,6 +83,9 @@ gzochid_application_context_free (gzochid_application_context *app_context)
 
   g_mutex_clear (&app_context->channel_mapping_lock);
 
+  g_hash_table_destroy (app_context->periodic_task_buckets);
+  g_mutex_clear (&app_context->periodic_task_buckets_lock);
+
   g_source_destroy ((GSource *) app_context->event_source);
   g_source_unref ((GSource *) app_context->event_source);
 
@@ -255,6 +262,8 @@ initialize_data (gzochid_application_context *app_context, const char *work_dir,
       
       gzochid_dataclient_storage_context_set_dataclient
 	(storage_context, dataclient);
+      gzochid_dataclient_storage_context_set_max_cache_bytes
+	(storage_context, gzochid_dataclient_get_max_cache_bytes (dataclient));
       
       g_object_unref (dataclient);
       g_object_unref (metaclient);
@@ -430,13 +439,15 @@ gzochid_application_context_init
  GzochidMetaClientContainer *metaclient_container,
  GzochidAuthPluginRegistry *auth_plugin_registry,
  gzochid_storage_engine_interface *iface, const char *work_dir,
- gzochid_task_queue *task_queue, struct timeval tx_timeout)
+ gzochid_task_queue *task_queue, struct timeval tx_timeout,
+ gzochid_application_retry_policy retry_policy)
 {
   context->authenticator = gzochid_auth_function_pass_thru;
   context->descriptor = g_object_ref (descriptor);
   context->storage_engine_interface = iface;
   context->task_queue = task_queue;
   context->tx_timeout = tx_timeout;
+  context->retry_policy = retry_policy;
   
   initialize_auth (context, auth_plugin_registry);
   initialize_data (context, work_dir, metaclient_container);
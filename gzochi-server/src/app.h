@@ -31,6 +31,31 @@
 #include "stats.h"
 #include "tx.h"
 
+/* Governs how transactional application tasks are retried after their 
+   transactions fail in a retryable way (e.g., as the result of a lock conflict
+   or a deadlock). Retries are delayed by an exponentially increasing amount of
+   time, with a random component, to keep tasks contending for the same data
+   from re-colliding on every attempt. */
+
+struct _gzochid_application_retry_policy
+{
+  /* The maximum number of times a task will be attempted, including its first
+     attempt. */
+
+  unsigned int max_attempts; 
+
+  /* The upper bound on the delay (in milliseconds) before the first retry. The
+     bound doubles for each subsequent retry. A value of zero disables backoff,
+     in which case retries are attempted immediately. */
+
+  unsigned long initial_backoff_ms;
+
+  unsigned long max_backoff_ms; /* The cap on any single retry delay. */
+};
+
+typedef struct _gzochid_application_retry_policy
+gzochid_application_retry_policy;
+
 struct _gzochid_application_context
 {
   /* The directory containing the application descriptor. Used to resolve
@@ -61,6 +86,16 @@ struct _gzochid_application_context
 
   gzochid_task_queue *task_queue;
   struct timeval tx_timeout;
+
+  /* The default retry policy for the application's transactional tasks. */
+
+  gzochid_application_retry_policy retry_policy; 
+
+  /* Tick buckets of pending periodic durable task executions, keyed on period
+     and dispatch time. See `durable-task.c'. */
+
+  GHashTable *periodic_task_buckets;
+  GMutex periodic_task_buckets_lock; /* Protects the tick buckets. */
   
   GHashTable *oids_to_clients;
   GHashTable *clients_to_oids;
@@ -90,7 +125,8 @@ void gzochid_application_context_init (gzochid_application_context *,
 				       GzochidAuthPluginRegistry *,
 				       gzochid_storage_engine_interface *,
 				       const char *, gzochid_task_queue *,
-				       struct timeval);
+				       struct timeval,
+				       gzochid_application_retry_policy);
 
 void gzochid_application_context_free (gzochid_application_context *);
 
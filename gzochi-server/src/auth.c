@@ -365,9 +365,14 @@ gzochid_auth_identity_cache_new ()
   gzochid_auth_identity_cache *cache;
 
   cache = malloc (sizeof (gzochid_auth_identity_cache));
-  cache->cache = gzochid_lru_cache_new_full
+
+  /* Take the caller's reference inside the cache, so that the identity can't
+     be evicted and freed by a concurrent lookup before it's returned. */
+  
+  cache->cache = gzochid_lru_cache_new_with_ref
     (g_str_hash, g_str_equal, identity_new_func,
      GZOCHID_AUTH_IDENTITY_CACHE_DEFAULT_MAX_SIZE, (GDestroyNotify) free,
+     (gzochid_lru_cache_ref_func) gzochid_auth_identity_ref,
      (GDestroyNotify) gzochid_auth_identity_unref);
   
   return cache;
@@ -383,8 +388,7 @@ gzochid_auth_identity_cache_destroy (gzochid_auth_identity_cache *cache)
 gzochid_auth_identity *
 gzochid_auth_identity_from_name (gzochid_auth_identity_cache *cache, char *name)
 {
-  return gzochid_auth_identity_ref
-    (gzochid_lru_cache_lookup (cache->cache, name));
+  return gzochid_lru_cache_lookup (cache->cache, name);
 }
 
 gzochid_auth_identity *
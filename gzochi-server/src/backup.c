@@ -0,0 +1,223 @@
+/* backup.c: Online backups of gzochi application data
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "backup.h"
+#include "dumpfile.h"
+#include "gzochid-storage.h"
+#include "storage.h"
+#include "storage-dataclient.h"
+
+/* The number of records to read from one store before moving on to the next.
+   Interleaving the stores' cursors this way allows the three dump writers'
+   threads to compress and write their files in parallel. */
+
+#define BACKUP_CHUNK_SIZE 1024
+
+/* The state of the backup of a single store. */
+
+struct store_backup
+{
+  gzochid_storage_cursor *cursor; /* The cursor over the store's records. */
+  FILE *to; /* The output stream. */
+  gzochid_dump_writer *writer; /* The dump writer for the output stream. */
+  unsigned long num_records; /* The number of records written so far. */
+  gboolean done; /* Whether the cursor has been exhausted. */
+};
+
+GQuark
+gzochid_backup_error_quark (void)
+{
+  return g_quark_from_static_string ("gzochid-backup-error-quark");
+}
+
+/* Writes up to `BACKUP_CHUNK_SIZE' records from the specified store backup's
+   cursor, marking the backup done when the cursor is exhausted. */
+
+static void
+store_backup_step (struct store_backup *backup,
+		   gzochid_storage_engine_interface *iface)
+{
+  size_t key_len = 0, value_len = 0;
+  char *key = NULL, *value = NULL;
+  int i = 0;
+
+  for (; i < BACKUP_CHUNK_SIZE; i++)
+    {
+      key = iface->cursor_next (backup->cursor, &key_len, &value, &value_len);
+
+      if (key == NULL)
+	{
+	  backup->done = TRUE;
+	  break;
+	}
+
+      gzochid_dump_writer_put (backup->writer, key, key_len, value, value_len);
+      backup->num_records++;
+
+      free (value);
+      free (key);
+    }
+}
+
+gboolean
+gzochid_backup_application (gzochid_application_context *app_context,
+			    const char *dir, gzochid_backup_stats *stats,
+			    GError **err)
+{
+  gzochid_storage_engine_interface *iface =
+    app_context->storage_engine_interface;
+  gzochid_storage_store *stores[3];
+  char *files[] = { "meta.dump", "oids.dump", "names.dump" };
+  struct store_backup backups[3];
+  gzochid_storage_transaction *tx = NULL;
+  gboolean done = FALSE, success = TRUE;
+  GError *local_err = NULL;
+  int i = 0;
+
+  if (iface == &gzochid_storage_engine_interface_dataclient)
+    {
+      g_set_error
+	(err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_UNSUPPORTED,
+	 "The data for application %s is not stored locally.",
+	 app_context->descriptor->name);
+      return FALSE;
+    }
+
+  /* A locking read of every record in the application's stores would stall
+     its transactions - or time them out - for the duration of the backup. */
+  
+  if (!gzochid_storage_context_snapshot_reads
+      (iface, app_context->storage_context))
+    {
+      g_set_error
+	(err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_NO_SNAPSHOT,
+	 "The storage engine for application %s does not provide snapshot "
+	 "reads; a backup would block the application's transactions.",
+	 app_context->descriptor->name);
+      return FALSE;
+    }
+  
+  if (g_mkdir_with_parents (dir, 493) != 0)
+    {
+      g_set_error
+	(err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_IO,
+	 "Unable to create backup directory %s: %s", dir, strerror (errno));
+      return FALSE;
+    }
+
+  stores[0] = app_context->meta;
+  stores[1] = app_context->oids;
+  stores[2] = app_context->names;
+
+  for (; i < 3; i++)
+    {
+      char *filename = g_strconcat (dir, "/", files[i], NULL);
+      FILE *to = fopen (filename, "w");
+
+      if (to == NULL)
+	{
+	  g_set_error
+	    (err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_IO,
+	     "Failed to open file %s for writing: %s", filename,
+	     strerror (errno));
+	  g_free (filename);
+
+	  for (i--; i >= 0; i--)
+	    fclose (backups[i].to);
+	  return FALSE;
+	}
+
+      backups[i].to = to;
+      g_free (filename);
+    }
+
+  /* All three stores are read within the same transaction, so the backup is
+     consistent across stores as well as within them. */
+
+  tx = gzochid_storage_transaction_begin_read_only
+    (iface, app_context->storage_context);
+
+  for (i = 0; i < 3; i++)
+    {
+      backups[i].cursor = iface->transaction_cursor_open (tx, stores[i]);
+      backups[i].writer = gzochid_dump_writer_new (backups[i].to, TRUE);
+      backups[i].num_records = 0;
+      backups[i].done = FALSE;
+    }
+
+  while (!done && !tx->rollback)
+    {
+      done = TRUE;
+
+      for (i = 0; i < 3; i++)
+	if (!backups[i].done)
+	  {
+	    store_backup_step (&backups[i], iface);
+	    done = done && backups[i].done;
+	  }
+    }
+
+  if (tx->rollback)
+    {
+      g_set_error
+	(&local_err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_TRANSACTION,
+	 "Failed to read the stores for application %s.",
+	 app_context->descriptor->name);
+      success = FALSE;
+    }
+
+  for (i = 0; i < 3; i++)
+    {
+      iface->cursor_close (backups[i].cursor);
+
+      if (!gzochid_dump_writer_close (backups[i].writer,
+				      success ? &local_err : NULL))
+	success = FALSE;
+      if (fclose (backups[i].to) != 0 && success)
+	{
+	  g_set_error
+	    (&local_err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_IO,
+	     "Failed to write %s/%s: %s", dir, files[i], strerror (errno));
+	  success = FALSE;
+	}
+    }
+
+  iface->transaction_rollback (tx);
+
+  if (!success)
+    {
+      g_propagate_error (err, local_err);
+      return FALSE;
+    }
+
+  if (stats != NULL)
+    {
+      stats->num_meta_records = backups[0].num_records;
+      stats->num_oids_records = backups[1].num_records;
+      stats->num_names_records = backups[2].num_records;
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,80 @@
+/* backup.h: Prototypes and declarations for backup.c
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GZOCHID_BACKUP_H
+#define GZOCHID_BACKUP_H
+
+#include <glib.h>
+
+#include "app.h"
+
+#define GZOCHID_BACKUP_ERROR gzochid_backup_error_quark ()
+
+GQuark gzochid_backup_error_quark (void);
+
+enum GzochidBackupError
+  {
+    /* The application's stores are not local to this server, as is the case
+       when the server is running in distributed mode. */
+
+    GZOCHID_BACKUP_ERROR_UNSUPPORTED,
+
+    /* The application's storage engine does not service read-only 
+       transactions from a snapshot, so the backup would hold read locks on 
+       every record and stall the application's transactions. */
+
+    GZOCHID_BACKUP_ERROR_NO_SNAPSHOT,
+
+    /* The snapshot transaction could not read all of the stores' records. */
+
+    GZOCHID_BACKUP_ERROR_TRANSACTION,
+    GZOCHID_BACKUP_ERROR_IO /* A backup file could not be written. */
+  };
+
+/* The number of records written to each of the dump files in a backup. */
+
+struct _gzochid_backup_stats
+{
+  unsigned long num_meta_records;
+  unsigned long num_oids_records;
+  unsigned long num_names_records;
+};
+
+typedef struct _gzochid_backup_stats gzochid_backup_stats;
+
+/* Writes a consistent, point-in-time copy of the `meta', `oids', and `names'
+   stores of the specified running application to the files `meta.dump',
+   `oids.dump', and `names.dump' in the specified directory, which is created
+   if it does not exist. The files are written in the compressed binary dump
+   format, and can be restored via `gzochi-load -i'.
+
+   The stores are read in a single read-only transaction, which must be 
+   serviced from a snapshot (see `context_snapshot_reads' in 
+   `gzochid-storage.h') so that the application's transactions are not blocked
+   by the backup. The backup is refused if the storage engine can't provide 
+   one - as is the case for the `mem' engine, and for the `bdb' engine unless
+   `storage.bdb.snapshot.enabled' is set.
+
+   Returns `TRUE' and fills in the specified `gzochid_backup_stats' structure
+   (which may be `NULL') on success; otherwise returns `FALSE' and sets the
+   error return. */
+
+gboolean gzochid_backup_application (gzochid_application_context *,
+				     const char *, gzochid_backup_stats *,
+				     GError **);
+
+#endif /* GZOCHID_BACKUP_H */
@@ -313,6 +313,224 @@ gzochid_data_protocol_response_read (GBytes *data)
     }
 }
 
+/* Serializes the specified (possibly `NULL') byte buffer to the specified byte
+   array, writing a two-byte zero prefix if the buffer is `NULL'. */
+
+static void
+write_optional_bytes (GBytes *data, GByteArray *arr)
+{
+  if (data != NULL)
+    write_bytes (data, arr);
+
+  /* Write two-byte prefix indicating an empty buffer. */
+
+  else g_byte_array_append
+	 (arr, (unsigned char *) &(unsigned char[]) { 0, 0 }, 2);
+}
+
+/* Deserializes a length-prefixed byte buffer from the specified buffer into
+   the specified `GBytes' pointer, which is set to `NULL' if the buffer is 
+   empty. Returns the number of bytes consumed, or 0 if the buffer was 
+   malformed. */
+
+static size_t
+read_optional_bytes (const unsigned char *bytes, size_t len, GBytes **ret)
+{
+  GBytes *data = gzochid_protocol_read_bytes (bytes, len);
+  size_t size = 0;
+  
+  if (data == NULL)
+    return 0;
+
+  size = g_bytes_get_size (data);
+
+  if (size == 0)
+    {
+      /* If the buffer was empty, free the wrapper. */
+	  
+      g_bytes_unref (data);
+      *ret = NULL;
+    }
+  else *ret = data;
+
+  return size + 2;
+}
+
+gzochid_data_grant *
+gzochid_data_grant_new (const char *app, const char *store, gboolean for_write,
+			GBytes *key, GBytes *data)
+{
+  gzochid_data_grant *grant = g_slice_alloc (sizeof (gzochid_data_grant));
+
+  grant->app = strdup (app);
+  grant->store = strdup (store);
+  grant->for_write = for_write;
+  grant->key = key == NULL ? NULL : g_bytes_ref (key);
+  grant->data = data == NULL ? NULL : g_bytes_ref (data);
+
+  return grant;
+}
+
+void
+gzochid_data_grant_free (gzochid_data_grant *grant)
+{
+  free (grant->app);
+  free (grant->store);
+
+  if (grant->key != NULL)
+    g_bytes_unref (grant->key);
+  if (grant->data != NULL)
+    g_bytes_unref (grant->data);
+
+  g_slice_free (gzochid_data_grant, grant);
+}
+
+void
+gzochid_data_protocol_grant_write (gzochid_data_grant *grant, GByteArray *arr)
+{
+  unsigned char for_write = grant->for_write ? 1 : 0;
+  
+  g_byte_array_append
+    (arr, (unsigned char *) grant->app, strlen (grant->app) + 1);
+  g_byte_array_append
+    (arr, (unsigned char *) grant->store, strlen (grant->store) + 1);
+  g_byte_array_append (arr, &for_write, 1);
+
+  write_optional_bytes (grant->key, arr);
+  write_optional_bytes (grant->data, arr);
+}
+
+gzochid_data_grant *
+gzochid_data_protocol_grant_read (GBytes *data)
+{
+  size_t len = 0, offset = 0, str_len = 0, bytes_len = 0;
+  const unsigned char *bytes = g_bytes_get_data (data, &len);
+  const char *app = gzochid_protocol_read_str (bytes, len, &str_len);
+  const char *store = NULL;
+  gboolean for_write = FALSE;
+  GBytes *key = NULL, *value = NULL;
+  gzochid_data_grant *grant = NULL;
+  
+  if (app == NULL || str_len == 0)
+    return NULL;
+  
+  len -= str_len;
+  offset += str_len;
+
+  store = gzochid_protocol_read_str (bytes + offset, len, &str_len);
+
+  if (store == NULL || str_len == 0)
+    return NULL;
+
+  len -= str_len;
+  offset += str_len;
+  
+  if (len-- <= 0)
+    return NULL;
+
+  for_write = bytes[offset++] != 0;
+
+  bytes_len = read_optional_bytes (bytes + offset, len, &key);
+  
+  if (bytes_len == 0)
+    return NULL;
+
+  len -= bytes_len;
+  offset += bytes_len;
+
+  if (read_optional_bytes (bytes + offset, len, &value) == 0)
+    {
+      if (key != NULL)
+	g_bytes_unref (key);
+      return NULL;
+    }
+
+  grant = gzochid_data_grant_new (app, store, for_write, key, value);
+
+  /* Unref the buffers to give exclusive ownership to the grant object. */
+  
+  if (key != NULL)
+    g_bytes_unref (key);
+  if (value != NULL)
+    g_bytes_unref (value);
+  
+  return grant;
+}
+
+gzochid_data_revocation *
+gzochid_data_revocation_new (const char *app, const char *store, GBytes *key)
+{
+  gzochid_data_revocation *revocation =
+    g_slice_alloc (sizeof (gzochid_data_revocation));
+
+  revocation->app = strdup (app);
+  revocation->store = strdup (store);
+  revocation->key = key == NULL ? NULL : g_bytes_ref (key);
+
+  return revocation;
+}
+
+void
+gzochid_data_revocation_free (gzochid_data_revocation *revocation)
+{
+  free (revocation->app);
+  free (revocation->store);
+
+  if (revocation->key != NULL)
+    g_bytes_unref (revocation->key);
+
+  g_slice_free (gzochid_data_revocation, revocation);
+}
+
+void
+gzochid_data_protocol_revocation_write (gzochid_data_revocation *revocation,
+					GByteArray *arr)
+{
+  g_byte_array_append
+    (arr, (unsigned char *) revocation->app, strlen (revocation->app) + 1);
+  g_byte_array_append
+    (arr, (unsigned char *) revocation->store, strlen (revocation->store) + 1);
+
+  write_optional_bytes (revocation->key, arr);
+}
+
+gzochid_data_revocation *
+gzochid_data_protocol_revocation_read (GBytes *data)
+{
+  size_t len = 0, offset = 0, str_len = 0;
+  const unsigned char *bytes = g_bytes_get_data (data, &len);
+  const char *app = gzochid_protocol_read_str (bytes, len, &str_len);
+  const char *store = NULL;
+  GBytes *key = NULL;
+  gzochid_data_revocation *revocation = NULL;
+  
+  if (app == NULL || str_len == 0)
+    return NULL;
+  
+  len -= str_len;
+  offset += str_len;
+
+  store = gzochid_protocol_read_str (bytes + offset, len, &str_len);
+
+  if (store == NULL || str_len == 0)
+    return NULL;
+
+  len -= str_len;
+  offset += str_len;
+
+  if (read_optional_bytes (bytes + offset, len, &key) == 0)
+    return NULL;
+
+  revocation = gzochid_data_revocation_new (app, store, key);
+
+  /* Unref the buffer to give exclusive ownership to the revocation object. */
+  
+  if (key != NULL)
+    g_bytes_unref (key);
+
+  return revocation;
+}
+
 gzochid_data_changeset *
 gzochid_data_changeset_new_with_free_func (const char *app, GArray *changes,
 					   GDestroyNotify free_func)
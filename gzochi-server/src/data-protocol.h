@@ -58,6 +58,47 @@ struct _gzochid_data_response
 
 typedef struct _gzochid_data_response gzochid_data_response;
 
+/* A lock granted by the data server to a node whose earlier request for that
+   lock was denied and queued. */
+
+struct _gzochid_data_grant
+{
+  char *app; /* The requesting application name. */
+  char *store; /* The target store name. */
+  gboolean for_write; /* Whether a point lock was granted for write. */
+
+  /* The requested key, for a point lock; or the lower bound of the requested 
+     key range, for a range lock, which is `NULL' if the requested range begins
+     at the start of the keyspace. */
+
+  GBytes *key; 
+
+  /* For a point lock, the value stored at the key; for a range lock, the upper
+     bound of the granted range. In either case, may be `NULL' to indicate the 
+     absence of data. */
+
+  GBytes *data; 
+};
+
+typedef struct _gzochid_data_grant gzochid_data_grant;
+
+/* A request from the data server that a node release a lock because another
+   node has requested a conflicting lock. */
+
+struct _gzochid_data_revocation
+{
+  char *app; /* The application name. */
+  char *store; /* The target store name. */
+
+  /* The locked key, for a point lock; or the lower bound of the locked key 
+     range, for a range lock, which is `NULL' if the range begins at the start
+     of the keyspace. */
+
+  GBytes *key; 
+};
+
+typedef struct _gzochid_data_revocation gzochid_data_revocation;
+
 /* A change to the key-value binding to be made as part of a changeset. */
 
 struct _gzochid_data_change
@@ -162,6 +203,86 @@ void gzochid_data_protocol_response_write
 
 gzochid_data_response *gzochid_data_protocol_response_read (GBytes *);
 
+/*
+  Construct and return a new lock grant with the specified application and 
+  store names, write flag, key bytes, and data bytes; either of these last two
+  arguments may be `NULL'.
+
+  The pointer returned by this function should be freed with 
+  `gzochid_data_grant_free'.
+*/
+
+gzochid_data_grant *gzochid_data_grant_new
+(const char *, const char *, gboolean, GBytes *, GBytes *);
+
+/* Free the specified lock grant. */
+
+void gzochid_data_grant_free (gzochid_data_grant *);
+
+/* 
+  Serialize the specified lock grant to the specified byte array. Format:
+
+  `NULL'-terminated string: Name of the requesting game application
+  `NULL'-terminated string: Name of the target store
+  1 byte: 0x01 if a point lock was granted for write, else 0x00
+  2 bytes: The big-endian encoding of the length of the key
+    Two zeros indicates the beginning of the keyspace, else the key bytes 
+    follow
+  2 bytes: The big-endian encoding of the length of the data
+    Two zeros indicates the absence of data, else the data follows
+*/
+
+void gzochid_data_protocol_grant_write (gzochid_data_grant *, GByteArray *);
+
+/*
+  Deserialize and return a lock grant from the specified byte buffer, or return
+  `NULL' if the buffer does not contain a correctly-serialized grant. 
+
+  The pointer returned by this function should be freed with 
+  `gzochid_data_grant_free'.
+*/
+
+gzochid_data_grant *gzochid_data_protocol_grant_read (GBytes *);
+
+/*
+  Construct and return a new lock revocation with the specified application and
+  store names and key bytes; this last argument may be `NULL'.
+
+  The pointer returned by this function should be freed with 
+  `gzochid_data_revocation_free'.
+*/
+
+gzochid_data_revocation *gzochid_data_revocation_new
+(const char *, const char *, GBytes *);
+
+/* Free the specified lock revocation. */
+
+void gzochid_data_revocation_free (gzochid_data_revocation *);
+
+/* 
+  Serialize the specified lock revocation to the specified byte array. Format:
+
+  `NULL'-terminated string: Name of the game application
+  `NULL'-terminated string: Name of the target store
+  2 bytes: The big-endian encoding of the length of the key
+    Two zeros indicates the beginning of the keyspace, else the key bytes 
+    follow
+*/
+
+void gzochid_data_protocol_revocation_write
+(gzochid_data_revocation *, GByteArray *);
+
+/*
+  Deserialize and return a lock revocation from the specified byte buffer, or
+  return `NULL' if the buffer does not contain a correctly-serialized 
+  revocation. 
+
+  The pointer returned by this function should be freed with 
+  `gzochid_data_revocation_free'.
+*/
+
+gzochid_data_revocation *gzochid_data_protocol_revocation_read (GBytes *);
+
 /* Create and return a new changeset with the specified gzochi game application
    name and change array. */
 
@@ -757,7 +757,9 @@ char *
 gzochid_data_next_binding_oid (gzochid_application_context *context, char *key,
 			       guint64 *oid, GError **err)
 {
-  char *next_key = NULL;
+  char *next_key = NULL, *oid_bytes = NULL, *seek_key = NULL;
+  size_t key_len = strlen (key) + 1, oid_bytes_len = 0;
+  gzochid_storage_cursor *cursor = NULL;
   GError *local_err = NULL;
   gzochid_data_transaction_context *tx_context = 
     join_transaction (context, &local_err);
@@ -768,25 +770,40 @@ gzochid_data_next_binding_oid (gzochid_application_context *context, char *key,
       return NULL;
     }
 
-  next_key = context->storage_engine_interface->transaction_next_key 
-    (tx_context->transaction, tx_context->context->names, key, 
-     strlen (key) + 1, NULL);
+  /* Read the next binding and its value in a single cursor operation, by
+     seeking to the current binding with a NUL byte appended. */
+  
+  seek_key = calloc (key_len + 1, sizeof (char));
+  memcpy (seek_key, key, key_len);
+
+  cursor = context->storage_engine_interface->transaction_cursor_open
+    (tx_context->transaction, context->names);
+  context->storage_engine_interface->cursor_seek
+    (cursor, seek_key, key_len + 1);
+  next_key = context->storage_engine_interface->cursor_next
+    (cursor, NULL, &oid_bytes, &oid_bytes_len);
+  context->storage_engine_interface->cursor_close (cursor);
+
+  free (seek_key);
+  
   if (tx_context->transaction->rollback)
-    gzochid_transaction_mark_for_rollback 
-      (&data_participant, tx_context->transaction->should_retry);
+    {
+      gzochid_transaction_mark_for_rollback 
+	(&data_participant, tx_context->transaction->should_retry);
 
-  if (next_key != NULL)
+      free (next_key);
+      free (oid_bytes);
+      return NULL;
+    }
+  else if (next_key != NULL)
     {
-      GError *local_err = NULL;
-      guint64 local_oid = get_binding (tx_context, next_key, &local_err);
+      guint64 encoded_oid = 0;
 
-      if (local_err != NULL)
-	{
-	  g_propagate_error (err, local_err);
-	  return NULL;
-	}
+      assert (oid_bytes_len == sizeof (guint64));
+      memcpy (&encoded_oid, oid_bytes, sizeof (guint64));
+      free (oid_bytes);
 
-      *oid = local_oid;
+      *oid = gzochid_util_decode_oid (encoded_oid);
       return next_key;
     }
   else return NULL;
@@ -938,6 +955,47 @@ gzochid_data_dereference_for_update (gzochid_data_managed_reference *reference,
   return reference->obj;
 }
 
+void
+gzochid_data_prefetch (gzochid_application_context *context, guint64 *oids,
+		       size_t num_oids, GError **err)
+{
+  int i = 0;
+  GError *local_err = NULL;
+  gzochid_data_transaction_context *tx_context = 
+    join_transaction (context, &local_err);
+
+  if (local_err != NULL)
+    {
+      g_propagate_error (err, local_err);
+      return;
+    }
+
+  /* Storage engines for which retrieval is cheap needn't support prefetching.
+   */
+  
+  if (context->storage_engine_interface->transaction_prefetch == NULL)
+    return;
+  
+  for (; i < num_oids; i++)
+    {
+      gzochid_data_managed_reference *reference = g_hash_table_lookup 
+	(tx_context->oids_to_references, &oids[i]);
+
+      /* Skip references that have already been dereferenced or created in
+	 this transaction. */
+      
+      if (reference == NULL
+	  || reference->state == GZOCHID_MANAGED_REFERENCE_STATE_EMPTY)
+	{
+	  guint64 encoded_oid = gzochid_util_encode_oid (oids[i]);
+
+	  context->storage_engine_interface->transaction_prefetch
+	    (tx_context->transaction, context->oids, (char *) &encoded_oid,
+	     sizeof (guint64));
+	}
+    }
+}
+
 void 
 gzochid_data_remove_object (gzochid_data_managed_reference *reference, 
 			    GError **err)
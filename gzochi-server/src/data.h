@@ -154,6 +154,23 @@ void *gzochid_data_dereference (gzochid_data_managed_reference *, GError **);
 void *gzochid_data_dereference_for_update (gzochid_data_managed_reference *,
 					   GError **);
 
+/*
+  Hints that the objects with the specified object ids (an array of the 
+  specified length) are likely to be dereferenced in the current transaction, 
+  joining the transaction if necessary. The storage engine may begin retrieving
+  them concurrently, returning before any of them have been retrieved, so that
+  subsequent calls to `gzochid_data_dereference' for their references don't 
+  each have to wait out a full round trip to the data store. Object ids whose
+  references have already been dereferenced within the current transaction are
+  ignored.
+
+  The error return argument will be set if the transaction could not be 
+  joined.
+*/
+
+void gzochid_data_prefetch
+(gzochid_application_context *, guint64 *, size_t, GError **);
+
 void gzochid_data_remove_object (gzochid_data_managed_reference *, GError **);
 void gzochid_data_mark 
 (gzochid_application_context *, gzochid_io_serialization *, void *, GError **);
@@ -136,6 +136,71 @@ dispatch_next_key_response (GzochidDataClient *client,
   return ret;
 }
 
+/* Processes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_VALUE_GRANT' or 
+   `GZOZCHID_DATA_PROTOCOL_NEXT_KEY_GRANT' opcode. Returns `TRUE' if the message
+   was successfully decoded, `FALSE' otherwise. */
+
+static gboolean
+dispatch_grant (GzochidDataClient *client, int opcode,
+		const unsigned char *data, unsigned short len)
+{
+  GBytes *grant_bytes = g_bytes_new_with_free_func (data, len, NULL, NULL);
+  gzochid_data_grant *grant = gzochid_data_protocol_grant_read (grant_bytes);
+  gboolean ret = TRUE;
+
+  if (grant == NULL)
+    ret = FALSE;
+  else
+    {
+      /* Invoke the callbacks of the queued request. */
+
+      if (opcode == GZOCHID_DATA_PROTOCOL_VALUE_GRANT)
+	gzochid_dataclient_received_value_grant (client, grant);
+      else gzochid_dataclient_received_next_key_grant (client, grant);
+
+      gzochid_data_grant_free (grant);
+    }
+
+  g_bytes_unref (grant_bytes);
+
+  return ret;
+}
+
+/* Processes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_REVOKE_KEY' or 
+   `GZOZCHID_DATA_PROTOCOL_REVOKE_KEY_RANGE' opcode. Returns `TRUE' if the 
+   message was successfully decoded, `FALSE' otherwise. */
+
+static gboolean
+dispatch_revocation (GzochidDataClient *client, int opcode,
+		     const unsigned char *data, unsigned short len)
+{
+  GBytes *revocation_bytes = g_bytes_new_with_free_func
+    (data, len, NULL, NULL);
+  gzochid_data_revocation *revocation =
+    gzochid_data_protocol_revocation_read (revocation_bytes);
+  gboolean ret = TRUE;
+
+  if (revocation == NULL)
+    ret = FALSE;
+  else
+    {
+      /* Expedite the release of the revoked lock. */
+
+      if (opcode == GZOCHID_DATA_PROTOCOL_REVOKE_KEY)
+	gzochid_dataclient_received_key_revocation (client, revocation);
+      else gzochid_dataclient_received_key_range_revocation
+	     (client, revocation);
+
+      gzochid_data_revocation_free (revocation);
+    }
+
+  g_bytes_unref (revocation_bytes);
+
+  return ret;
+}
+
 /* Attempt to dispatch a fully-buffered message from the server based on the 
    message opcode. */
 
@@ -159,6 +224,14 @@ dispatch_message (GzochidDataClient *client, unsigned char *message,
     case GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE:
       dispatch_next_key_response (client, payload, len);
       break;
+    case GZOCHID_DATA_PROTOCOL_VALUE_GRANT:
+    case GZOCHID_DATA_PROTOCOL_NEXT_KEY_GRANT:
+      dispatch_grant (client, opcode, payload, len);
+      break;
+    case GZOCHID_DATA_PROTOCOL_REVOKE_KEY:
+    case GZOCHID_DATA_PROTOCOL_REVOKE_KEY_RANGE:
+      dispatch_revocation (client, opcode, payload, len);
+      break;
       
     default:
       g_warning ("Unexpected opcode %d received from server", opcode);
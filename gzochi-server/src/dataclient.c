@@ -75,6 +75,20 @@ struct _dataclient_callback_registration
   gzochid_dataclient_release_callback release_callback; 
 
   gpointer release_data; /* Closure data for the release callback. */
+
+  /* Identifies the requested lock, for matching grants and revocations pushed
+     by the meta server to this registration. See `lock_key_new'. */
+
+  GBytes *lock_key;
+
+  /* The callback queue that owns this registration. */
+  
+  struct _dataclient_callback_queue *queue;
+
+  /* The source that will invoke the release callback once the lock has been
+     obtained, or `NULL' until then. */
+
+  GSource *release_source;
 };
 
 typedef struct _dataclient_callback_registration
@@ -95,6 +109,16 @@ struct _dataclient_callback_queue
   /* List of `dataclient_callback_registration' objects. */
 
   GList *callback_registrations; 
+
+  /* Map of lock keys to `GQueue's of callback registrations whose requests 
+     were queued by the meta server, and which are awaiting a grant. */
+
+  GHashTable *pending_grants;
+
+  /* Map of lock keys to `GList's of callback registrations for locks currently
+     held, which may be released early if the meta server revokes them. */
+
+  GHashTable *held_locks;
 };
 
 typedef struct _dataclient_callback_queue dataclient_callback_queue;
@@ -112,10 +136,21 @@ struct _GzochidDataClient
 
   unsigned int lock_release_ms;
 
+  /* The number of milliseconds before the release of a successfully-acquired 
+     point lock that is held only for read will be requested. Set via 
+     `lock.read.release.msec'; defaults to the value of `lock.release.msec'. */
+
+  unsigned int read_lock_release_ms;
+
   /* The number of milliseconds before the release of a successfully-acquired 
      range lock will be requested. Set via `rangelock.release.msec'. */  
   
   unsigned int range_lock_release_ms;
+
+  /* The number of bytes that released values may occupy in the local cache of
+     the client's storage engine. Set via `cache.max.mb'. */
+
+  size_t max_cache_bytes;
   
   GzochidConfiguration *configuration; /* The global configuration object. */
 
@@ -190,8 +225,13 @@ gzochid_data_client_constructed (GObject *gobject)
   
   client->lock_release_ms = gzochid_config_to_int
     (g_hash_table_lookup (metaserver_config, "lock.release.msec"), 1000);
+  client->read_lock_release_ms = gzochid_config_to_int
+    (g_hash_table_lookup (metaserver_config, "lock.read.release.msec"),
+     client->lock_release_ms);
   client->range_lock_release_ms = gzochid_config_to_int
     (g_hash_table_lookup (metaserver_config, "rangelock.release.msec"), 500);
+  client->max_cache_bytes = (size_t) gzochid_config_to_long
+    (g_hash_table_lookup (metaserver_config, "cache.max.mb"), 64) * 1024 * 1024;
 
   g_hash_table_destroy (metaserver_config);
 }
@@ -245,14 +285,55 @@ gzochid_data_client_class_init (GzochidDataClientClass *klass)
     (object_class, N_PROPERTIES, obj_properties);
 }
 
-/* Create and return a new callback registration object with the specified
-   expected opcode and success, failure, and release callbacks (with associated
-   user data pointers. This object should freed via `free' when no longer 
-   needed. */
+/* Returns a new `GBytes' identifying the lock requested by a value or key 
+   range request with the specified response opcode, intention, store, and key
+   (which may be `NULL' in the case of a key range request), for use in
+   matching the grants and revocations pushed by the meta server to the 
+   callback registrations for the request. The returned bytes should be freed
+   via `g_bytes_unref' when no longer needed. */
+
+static GBytes *
+lock_key_new (unsigned char opcode, gboolean for_write, const char *store,
+	      GBytes *key)
+{
+  GByteArray *lock_key = g_byte_array_new ();
+  unsigned char header[3] = { opcode, for_write ? 1 : 0, key != NULL ? 1 : 0 };
+
+  g_byte_array_append (lock_key, header, 3);
+  g_byte_array_append
+    (lock_key, (const unsigned char *) store, strlen (store) + 1);
+
+  if (key != NULL)
+    {
+      size_t key_len = 0;
+      const unsigned char *key_bytes = g_bytes_get_data (key, &key_len);
+
+      g_byte_array_append (lock_key, key_bytes, key_len);
+    }
+  
+  return g_byte_array_free_to_bytes (lock_key);
+}
+
+/* Returns `TRUE' if the lock identified by the specified lock key (as returned
+   by `lock_key_new') is a write lock, `FALSE' otherwise. */
+
+static gboolean
+lock_key_for_write (GBytes *lock_key)
+{
+  const unsigned char *lock_key_bytes = g_bytes_get_data (lock_key, NULL);
+  return lock_key_bytes[1] == 1;
+}
+
+/* Create and return a new callback registration object for the specified 
+   callback queue with the specified expected opcode, lock key (ownership of 
+   which is transferred to the registration) and success, failure, and release
+   callbacks (with associated user data pointers. This object should freed via
+   `free_callback' when no longer needed. */
 
 static dataclient_callback_registration *
 create_callback
-(unsigned char expected_opcode,
+(dataclient_callback_queue *queue, unsigned char expected_opcode,
+ GBytes *lock_key,
  gzochid_dataclient_success_callback success_callback, gpointer success_data,
  gzochid_dataclient_failure_callback failure_callback, gpointer failure_data,
  gzochid_dataclient_release_callback release_callback, gpointer release_data)
@@ -275,17 +356,55 @@ create_callback
   
   registration->release_callback = release_callback;
   registration->release_data = release_data;
+
+  registration->lock_key = lock_key;
+  registration->queue = queue;
+  registration->release_source = NULL;
   
   return registration;
 }
 
-/* Frees the callback queue structure, including all pending callbacks. */
+/* Frees the specified callback registration. */
+
+static void
+free_callback (gpointer data)
+{
+  dataclient_callback_registration *registration = data;
+
+  g_bytes_unref (registration->lock_key);
+  free (registration);
+}
+
+/* A `GDestroyNotify' for the queues of registrations awaiting grants. */
+
+static void
+free_pending_grants (gpointer data)
+{
+  g_queue_free_full (data, free_callback);
+}
+
+/* A `GHFunc' that frees the lists of registrations for held locks. (The lists
+   are not freed by the held lock table itself, since they are replaced in 
+   place as registrations are added and removed.) */
+
+static void
+free_held_locks (gpointer key, gpointer value, gpointer user_data)
+{
+  g_list_free (value);
+}
+
+/* Frees the callback queue structure, including all pending callbacks. The
+   registrations for held locks are owned by their release sources, and are
+   not freed here. */
 
 static void
 free_callback_queue (dataclient_callback_queue *queue)
 {
   g_mutex_clear (&queue->mutex);
-  g_list_free_full (queue->callback_registrations, free);
+  g_list_free_full (queue->callback_registrations, free_callback);
+  g_hash_table_destroy (queue->pending_grants);
+  g_hash_table_foreach (queue->held_locks, free_held_locks, NULL);
+  g_hash_table_destroy (queue->held_locks);
   free (queue);
 }
 
@@ -317,6 +436,12 @@ acquire_callback_queue (GzochidDataClient *client, char *app)
       queue->oids_callback = NULL;
       queue->oids_callback_data = NULL;
       queue->callback_registrations = NULL;
+      queue->pending_grants = g_hash_table_new_full
+	(g_bytes_hash, g_bytes_equal, (GDestroyNotify) g_bytes_unref,
+	 free_pending_grants);
+      queue->held_locks = g_hash_table_new_full
+	(g_bytes_hash, g_bytes_equal, (GDestroyNotify) g_bytes_unref,
+	 NULL);
 
       g_hash_table_insert
 	(client->application_callback_queues, strdup (app), queue);
@@ -424,6 +549,12 @@ gzochid_dataclient_received_oids (GzochidDataClient *client,
   release_callback_queue (queue);
 }
 
+size_t
+gzochid_dataclient_get_max_cache_bytes (GzochidDataClient *client)
+{
+  return client->max_cache_bytes;
+}
+
 void
 gzochid_dataclient_reserve_oids (GzochidDataClient *client, char *app,
 				 gzochid_dataclient_oids_callback callback,
@@ -447,14 +578,142 @@ gzochid_dataclient_reserve_oids (GzochidDataClient *client, char *app,
   release_callback_queue (queue);
 }
 
+/* Removes the specified callback registration from its queue's table of held
+   locks. The queue's mutex must be held by the caller. */
+
+static void
+remove_held_lock (dataclient_callback_queue *queue,
+		  dataclient_callback_registration *registration)
+{
+  GList *registrations = g_hash_table_lookup
+    (queue->held_locks, registration->lock_key);
+
+  registrations = g_list_remove (registrations, registration);
+
+  if (registrations == NULL)
+    g_hash_table_remove (queue->held_locks, registration->lock_key);
+  else g_hash_table_insert
+	 (queue->held_locks, g_bytes_ref (registration->lock_key),
+	  registrations);
+}
+
 static gboolean
 invoke_release_callback (gpointer user_data)
 {
   dataclient_callback_registration *registration = user_data;
+
+  /* Once the registration has been removed from the held lock table, it can no
+     longer be targeted by a revocation. */
+  
+  g_mutex_lock (&registration->queue->mutex);
+  remove_held_lock (registration->queue, registration);
+  g_mutex_unlock (&registration->queue->mutex);
+  
   registration->release_callback (registration->release_data);  
   return FALSE;
 }
 
+/* Invokes the success callback of the specified registration with the 
+   specified data, and schedules the release of the lock it represents after
+   the lock or range lock lease interval, as appropriate to the specified
+   opcode. The queue's mutex must be held by the caller. */
+
+static void
+lock_acquired (GzochidDataClient *client, dataclient_callback_queue *queue,
+	       dataclient_callback_registration *callbacks, unsigned char opcode,
+	       const char *app, const char *store, GBytes *data)
+{
+  GSource *release_callback = NULL;
+  GList *registrations = NULL;
+      
+  callbacks->success_callback (data, callbacks->success_data);
+  assert (callbacks->timeout == G_MAXINT64);
+
+  if (opcode == GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE)
+    {
+      /* Read locks are shared, and are revoked by the meta server as soon as 
+	 another node asks to write the key, so they can safely be leased for
+	 longer than write locks. */
+      
+      unsigned int release_ms = lock_key_for_write (callbacks->lock_key)
+	? client->lock_release_ms : client->read_lock_release_ms;
+      
+      gzochid_trace
+	("Obtained lock for %s/%s; will expire in %dms.", app, store,
+	 release_ms);
+      release_callback = g_timeout_source_new (release_ms);
+    }
+  else if (opcode == GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE)
+    {
+      gzochid_trace
+	("Obtained range lock on keys in %s/%s; will expired in %dms.", app,
+	 store, client->range_lock_release_ms);
+      release_callback = g_timeout_source_new (client->range_lock_release_ms);
+    }
+
+  if (release_callback != NULL)
+    {
+      /* Track the lock so that its release can be expedited if the meta server
+	 revokes it before the lease expires. */
+      
+      callbacks->release_source = release_callback;
+      registrations = g_hash_table_lookup
+	(queue->held_locks, callbacks->lock_key);
+      g_hash_table_insert
+	(queue->held_locks, g_bytes_ref (callbacks->lock_key),
+	 g_list_prepend (registrations, callbacks));
+      
+      g_source_set_callback
+	(release_callback, invoke_release_callback, callbacks, free_callback);
+      g_source_attach (release_callback, client->main_context);
+      g_source_unref (release_callback);
+    }
+  else free_callback (callbacks);
+}
+
+/* Adds the specified callback registration to the queue of registrations 
+   awaiting a lock grant from the meta server. The queue's mutex must be held by
+   the caller. */
+
+static void
+add_pending_grant (dataclient_callback_queue *queue,
+		   dataclient_callback_registration *registration)
+{
+  GQueue *registrations = g_hash_table_lookup
+    (queue->pending_grants, registration->lock_key);
+
+  if (registrations == NULL)
+    {
+      registrations = g_queue_new ();
+      g_hash_table_insert
+	(queue->pending_grants, g_bytes_ref (registration->lock_key),
+	 registrations);
+    }
+
+  g_queue_push_tail (registrations, registration);
+}
+
+/* Removes and returns the oldest callback registration awaiting a grant of the
+   lock with the specified lock key, or `NULL' if there is no such 
+   registration. The queue's mutex must be held by the caller. */
+
+static dataclient_callback_registration *
+remove_pending_grant (dataclient_callback_queue *queue, GBytes *lock_key)
+{
+  dataclient_callback_registration *registration = NULL;
+  GQueue *registrations = g_hash_table_lookup (queue->pending_grants, lock_key);
+
+  if (registrations != NULL)
+    {
+      registration = g_queue_pop_head (registrations);
+
+      if (g_queue_is_empty (registrations))
+	g_hash_table_remove (queue->pending_grants, lock_key);
+    }
+
+  return registration;
+}
+
 /* Convenience function to handle the processing of a message received in
    response to a value or sequential key request, and representing a successful
    or unsuccessful fulfillment of the request. Some error checking is performed
@@ -480,44 +739,23 @@ process_queued_callback (GzochidDataClient *client,
       g_warning
 	("Received response %d for %s/%s; expected response %d.", opcode,
 	 response->app, response->store, callbacks->expected_opcode);
-      free (callbacks);
+      free_callback (callbacks);
     }
   else if (response->success)
-    {
-      GSource *release_callback = NULL;
-      
-      callbacks->success_callback (response->data, callbacks->success_data);
-      assert (callbacks->timeout == G_MAXINT64);
-
-      if (opcode == GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE)
-	{
-	  gzochid_trace
-	    ("Obtained lock for %s/%s; will expire in %dms.",
-	     response->app, response->store, client->lock_release_ms);
-	  release_callback = g_timeout_source_new (client->lock_release_ms);
-	}
-      else if (opcode == GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE)
-	{
-	  gzochid_trace
-	    ("Obtained range lock on keys in %s/%s; will expired in %dms.",
-	     response->app, response->store, client->range_lock_release_ms);
-	  release_callback = g_timeout_source_new
-	    (client->range_lock_release_ms);
-	}
-
-      if (release_callback != NULL)
-	{
-	  g_source_set_callback
-	    (release_callback, invoke_release_callback, callbacks, free);
-	  g_source_attach (release_callback, client->main_context);
-	}
-    }
+    lock_acquired (client, queue, callbacks, opcode, response->app,
+		   response->store, response->data);
   else
     {
       g_debug
 	("Lock request against %s/%s failed.", response->app, response->store);
       callbacks->failure_callback (response->timeout, callbacks->failure_data);
-      free (callbacks);
+
+      /* A zero timeout means that the meta server has queued the request and
+	 will push a grant once the conflicting locks have been released. */
+      
+      if (response->timeout.tv_sec == 0 && response->timeout.tv_usec == 0)
+	add_pending_grant (queue, callbacks);
+      else free_callback (callbacks);
     }
 }
 
@@ -586,7 +824,9 @@ gzochid_dataclient_request_value
   
   queue->callback_registrations = g_list_append
     (queue->callback_registrations,
-     create_callback (GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE,
+     create_callback (queue, GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE,
+		      lock_key_new (GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE,
+				    for_write, store, key),
 		      success_callback, success_data,
 		      failure_callback, failure_data,
 		      release_callback, release_data));
@@ -611,6 +851,122 @@ gzochid_dataclient_received_next_key (GzochidDataClient *client,
   release_callback_queue (queue);
 }
 
+/* Convenience function to handle the processing of a lock grant pushed by the
+   meta server in response to a value or sequential key request that was 
+   earlier denied and queued. If no registration is awaiting the grant (which
+   should not happen) the lock is released immediately. */
+
+static void
+process_grant (GzochidDataClient *client, unsigned char opcode,
+	       gzochid_data_grant *grant)
+{
+  dataclient_callback_queue *queue = acquire_callback_queue
+    (client, grant->app);
+  GBytes *lock_key = lock_key_new
+    (opcode, opcode == GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE
+     ? grant->for_write : FALSE, grant->store, grant->key);
+  dataclient_callback_registration *callbacks = remove_pending_grant
+    (queue, lock_key);
+
+  if (callbacks != NULL)
+    lock_acquired (client, queue, callbacks, opcode, grant->app, grant->store,
+		   grant->data);
+
+  release_callback_queue (queue);
+
+  if (callbacks == NULL)
+    {
+      g_warning
+	("Received lock grant for %s/%s but no requests pending; releasing.",
+	 grant->app, grant->store);
+
+      if (opcode == GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE)
+	gzochid_dataclient_release_key
+	  (client, grant->app, grant->store, grant->key);
+      else gzochid_dataclient_release_key_range
+	     (client, grant->app, grant->store, grant->key, grant->data);
+    }
+
+  g_bytes_unref (lock_key);
+}
+
+void
+gzochid_dataclient_received_value_grant (GzochidDataClient *client,
+					 gzochid_data_grant *grant)
+{
+  process_grant (client, GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE, grant);
+}
+
+void
+gzochid_dataclient_received_next_key_grant (GzochidDataClient *client,
+					    gzochid_data_grant *grant)
+{
+  process_grant (client, GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE, grant);
+}
+
+/* Expedites the release of the locks represented by callback registrations 
+   with the specified lock key, by making their release sources ready to 
+   dispatch immediately. The queue's mutex must be held by the caller. */
+
+static void
+expedite_release (dataclient_callback_queue *queue, GBytes *lock_key)
+{
+  GList *registrations = g_hash_table_lookup (queue->held_locks, lock_key);
+
+  for (; registrations != NULL; registrations = registrations->next)
+    {
+      dataclient_callback_registration *callbacks = registrations->data;
+      g_source_set_ready_time (callbacks->release_source, 0);
+    }
+}
+
+void
+gzochid_dataclient_received_key_revocation
+(GzochidDataClient *client, gzochid_data_revocation *revocation)
+{
+  dataclient_callback_queue *queue = acquire_callback_queue
+    (client, revocation->app);
+  GBytes *read_key = lock_key_new
+    (GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE, FALSE, revocation->store,
+     revocation->key);
+  GBytes *write_key = lock_key_new
+    (GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE, TRUE, revocation->store,
+     revocation->key);
+
+  gzochid_trace ("Lock on key in %s/%s revoked.", revocation->app,
+		 revocation->store);
+  
+  /* A point lock may have been obtained via a read request, a write request, 
+     or both. */
+  
+  expedite_release (queue, read_key);
+  expedite_release (queue, write_key);
+  
+  release_callback_queue (queue);
+
+  g_bytes_unref (read_key);
+  g_bytes_unref (write_key);
+}
+
+void
+gzochid_dataclient_received_key_range_revocation
+(GzochidDataClient *client, gzochid_data_revocation *revocation)
+{
+  dataclient_callback_queue *queue = acquire_callback_queue
+    (client, revocation->app);
+  GBytes *lock_key = lock_key_new
+    (GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE, FALSE, revocation->store,
+     revocation->key);
+
+  gzochid_trace ("Range lock on keys in %s/%s revoked.", revocation->app,
+		 revocation->store);
+
+  expedite_release (queue, lock_key);
+  release_callback_queue (queue);
+
+  g_bytes_unref (lock_key);
+}
+
 /* Convenience function to append a length-prefixed array of bytes to the
    specified `GByteArray', or a pair of `NULL' bytes if the specified byte
    buffer is `NULL'. */
@@ -675,7 +1031,9 @@ gzochid_dataclient_request_next_key
 
   queue->callback_registrations = g_list_append
     (queue->callback_registrations,
-     create_callback (GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE,
+     create_callback (queue, GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE,
+		      lock_key_new (GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE,
+				    FALSE, store, key),
 		      success_callback, success_data,
 		      failure_callback, failure_data,
 		      release_callback, release_data));
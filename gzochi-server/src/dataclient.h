@@ -78,6 +78,12 @@ typedef void (*gzochid_dataclient_release_callback) (gpointer);
 typedef void (*gzochid_dataclient_oids_callback)
 (gzochid_data_oids_block, gpointer);
 
+/* Returns the number of bytes that the values of released keys may occupy in 
+   the local cache of a storage engine backed by the specified data client, as
+   configured via `cache.max.mb' in the "metaserver" configuration group. */
+
+size_t gzochid_dataclient_get_max_cache_bytes (GzochidDataClient *);
+
 /* Request a block of oids for objects belonging to the specified gzochi game 
    application, with the response delivered via the specified callback, which 
    will be invoked with the specified user data pointer. */
@@ -93,8 +99,12 @@ void gzochid_dataclient_reserve_oids
   
   The release callback will be called (with its associated user data pointer) 
   `lock.release.msecs' milliseconds after the successful acquisition of a lock 
-  on this value. (Upgrading a read lock to a write lock does not extend the 
-  lease time.)
+  on this value, or sooner if the meta server revokes the lock. (Upgrading a 
+  read lock to a write lock does not extend the lease time.)
+
+  If the failure callback is invoked with a zero wait time, the meta server has
+  queued the request, and the success callback will be invoked once the lock 
+  has been granted.
 */
 
 void gzochid_dataclient_request_value
@@ -112,7 +122,8 @@ void gzochid_dataclient_request_value
   
   The release callback will be called (with its associated user data pointer) 
   `rangelock.release.msecs' milliseconds after the successful acquisition of a 
-  range lock on these bounds.
+  range lock on these bounds, or sooner if the meta server revokes the lock. A
+  zero wait time passed to the failure callback has the same meaning as above.
 
   The key argument may be `NULL' to indicate that the first key in the store
   should be returned.
@@ -163,4 +174,28 @@ void gzochid_dataclient_received_value
 void gzochid_dataclient_received_next_key
 (GzochidDataClient *, gzochid_data_response *);
 
+/* Notify the client that the meta server has granted a point lock requested by
+   an earlier value request that it had denied and queued. */
+
+void gzochid_dataclient_received_value_grant
+(GzochidDataClient *, gzochid_data_grant *);
+
+/* Notify the client that the meta server has granted a range lock requested by
+   an earlier key range request that it had denied and queued. */
+
+void gzochid_dataclient_received_next_key_grant
+(GzochidDataClient *, gzochid_data_grant *);
+
+/* Notify the client that the meta server has revoked a point lock held by the 
+   client, which should be released as soon as possible. */
+
+void gzochid_dataclient_received_key_revocation
+(GzochidDataClient *, gzochid_data_revocation *);
+
+/* Notify the client that the meta server has revoked a range lock held by the
+   client, which should be released as soon as possible. */
+
+void gzochid_dataclient_received_key_range_revocation
+(GzochidDataClient *, gzochid_data_revocation *);
+
 #endif /* GZOCHID_DATACLIENT_H */
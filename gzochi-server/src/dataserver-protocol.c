@@ -51,6 +51,8 @@ gzochi_metad_dataserver_client_new (GzochiMetadDataServer *dataserver,
   client->dataserver = g_object_ref (dataserver);
   client->sock = sock;
   client->node_id = node_id;
+
+  gzochi_metad_dataserver_server_connected (dataserver, node_id, sock);
   
   return client;
 }
@@ -86,384 +88,445 @@ can_dispatch (const GByteArray *buffer, gpointer user_data)
   else return FALSE;
 }
 
-/* Processes the message payload following the 
-   `GZOZCHID_DATA_PROTOCOL_REQUEST_OIDS' opcode. Returns `TRUE' if the message 
-   was successfully decoded, `FALSE' otherwise. 
+/* A decoded data protocol request. Requests are decoded on the socket thread
+   that received them and then submitted to the data server for execution on a
+   request worker thread, which writes any response back to the requesting
+   client's socket. 
 
-   If the message was successfully decoded, the bytes encoding a 
-   `gzochid_data_reserve_oids_response' structure will be written to the client
-   socket's send buffer. 
-*/
+   All requests from a given node are executed in the order in which they were
+   received - the data server's workers are partitioned by node id - which 
+   preserves the ordering the data protocol relies on (e.g., that a changeset 
+   is processed before a subsequent release of the keys it modifies) while 
+   allowing slow requests (such as changeset commits) from one node to proceed
+   without blocking the requests of other nodes. */
 
-static gboolean 
-dispatch_request_oids (gzochi_metad_dataserver_client *client,
-		       unsigned char *data, unsigned short len)
+struct _dataserver_request
 {
-  size_t str_len = 0;
-  const char *app = gzochid_protocol_read_str (data, len, &str_len);
-  gzochid_data_reserve_oids_response *response = NULL;
-  GByteArray *bytes = NULL;
+  int opcode; /* The request opcode. */
+  guint node_id; /* The requesting node id. */
+  gzochid_client_socket *sock; /* The client socket, for responses. */
 
-  if (app == NULL || str_len <= 1)
-    {
-      g_warning
-	("Received malformed 'REQUEST_OIDS' message from node %d.",
-	 client->node_id);
-      return FALSE;
-    }
+  char *app; /* The target application name, if applicable. */
+  char *store; /* The target store name, if applicable. */
+  gboolean for_write; /* Whether a value was requested for update. */
+  GBytes *key; /* The target key, or first key of a range, if applicable. */
+  GBytes *to_key; /* The last key of a range, if applicable. */
+
+  gzochid_data_changeset *changeset; /* The submitted changeset, if any. */
+};
+
+typedef struct _dataserver_request dataserver_request;
+
+/* Creates and returns a new request with the specified opcode on behalf of the
+   specified client. The memory associated with the returned request should be
+   freed via `dataserver_request_free'. */
+
+static dataserver_request *
+dataserver_request_new (gzochi_metad_dataserver_client *client, int opcode)
+{
+  dataserver_request *request = calloc (1, sizeof (dataserver_request));
+
+  request->opcode = opcode;
+  request->node_id = client->node_id;
+  request->sock = gzochid_client_socket_ref (client->sock);
+
+  return request;
+}
+
+static void
+dataserver_request_free (dataserver_request *request)
+{
+  gzochid_client_socket_unref (request->sock);
+
+  free (request->app);
+  free (request->store);
+
+  if (request->key != NULL)
+    g_bytes_unref (request->key);
+  if (request->to_key != NULL)
+    g_bytes_unref (request->to_key);
+  if (request->changeset != NULL)
+    gzochid_data_changeset_free (request->changeset);
   
-  bytes = g_byte_array_new ();
-  response = gzochi_metad_dataserver_reserve_oids
-    (client->dataserver, client->node_id, app);
+  free (request);
+}
 
-  gzochid_data_protocol_reserve_oids_response_write (response, bytes);
+/* Frames the specified response payload with the specified opcode and writes
+   it to the specified client socket's send buffer. */
 
+static void
+write_response (gzochid_client_socket *sock, int opcode, GByteArray *bytes)
+{
   /* Pad with two `NULL' bytes to leave space for the actual length to be 
      encoded. */
 
   g_byte_array_prepend
-    (bytes, (unsigned char *) &(unsigned char[])
-     { 0, 0, GZOCHID_DATA_PROTOCOL_OIDS_RESPONSE }, 3);
+    (bytes, (unsigned char *) &(unsigned char[]) { 0, 0, opcode }, 3);
   gzochi_common_io_write_short (bytes->len - 3, bytes->data, 0);
-  gzochid_client_socket_write (client->sock, bytes->data, bytes->len);
-  
-  gzochid_data_reserve_oids_response_free (response);
-  g_byte_array_unref (bytes);
-
-  return TRUE;
+  gzochid_client_socket_write (sock, bytes->data, bytes->len);
 }
 
-/* Processes the message payload following the 
-   `GZOZCHID_DATA_PROTOCOL_REQUEST_VALUE' opcode. Returns `TRUE' if the 
-   message was successfully decoded, `FALSE' otherwise. 
-
-   If the message was successfully decoded, the bytes encoding a 
-   `gzochid_data_object_response' structure will be written to the client
-   socket's send buffer. 
-*/
+/* Decodes the application and store names at the beginning of the specified
+   message payload into the specified request, returning the number of bytes 
+   consumed, or 0 if the payload was malformed. */
 
-static gboolean
-dispatch_request_value (gzochi_metad_dataserver_client *client,
-			unsigned char *data, unsigned short len)
+static size_t
+decode_app_and_store (dataserver_request *request, unsigned char *data,
+		      unsigned short len)
 {
-  size_t str_len = 0, offset = 0;
-  const char *app = gzochid_protocol_read_str (data, len, &str_len),
+  size_t app_len = 0, store_len = 0;
+  const char *app = gzochid_protocol_read_str (data, len, &app_len), 
     *store = NULL;
-  gboolean for_write = FALSE;
-  GByteArray *bytes = NULL;
-  GBytes *key = NULL;
-  GError *err = NULL;
 
-  gzochid_data_response *response = NULL;
+  if (app == NULL || app_len <= 1)
+    return 0;
   
+  store = gzochid_protocol_read_str (data + app_len, len - app_len, &store_len);
+
+  if (store == NULL || store_len <= 1)
+    return 0;
+
+  request->app = strdup (app);
+  request->store = strdup (store);
+
+  return app_len + store_len;
+}
+
+/* Decodes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_REQUEST_OIDS' opcode. Returns a new request, or 
+   `NULL' if the message was malformed. */
+
+static dataserver_request *
+decode_request_oids (gzochi_metad_dataserver_client *client,
+		     unsigned char *data, unsigned short len)
+{
+  size_t str_len = 0;
+  const char *app = gzochid_protocol_read_str (data, len, &str_len);
+  dataserver_request *request = NULL;
+
   if (app == NULL || str_len <= 1)
+    {
+      g_warning
+	("Received malformed 'REQUEST_OIDS' message from node %d.",
+	 client->node_id);
+      return NULL;
+    }
+
+  request = dataserver_request_new
+    (client, GZOCHID_DATA_PROTOCOL_REQUEST_OIDS);
+  request->app = strdup (app);
+
+  return request;
+}
+
+/* Decodes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_REQUEST_VALUE' opcode. Returns a new request, or 
+   `NULL' if the message was malformed. */
+
+static dataserver_request *
+decode_request_value (gzochi_metad_dataserver_client *client,
+		      unsigned char *data, unsigned short len)
+{
+  dataserver_request *request = dataserver_request_new
+    (client, GZOCHID_DATA_PROTOCOL_REQUEST_VALUE);
+  size_t offset = decode_app_and_store (request, data, len);
+
+  if (offset > 0 && offset < len)
+    {
+      request->for_write = data[offset] == 1;
+      offset++;
+
+      request->key = gzochid_protocol_read_bytes (data + offset, len - offset);
+    }
+
+  if (request->key == NULL)
     {
       g_warning
 	("Received malformed 'REQUEST_VALUE' message from node %d.",
 	 client->node_id);
-      return FALSE;
+      dataserver_request_free (request);
+      return NULL;
     }
   
-  len -= str_len;
-  offset += str_len;
+  return request;
+}
 
-  store = gzochid_protocol_read_str (data + offset, len, &str_len);
+/* Decodes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_REQUEST_NEXT_KEY' opcode. Returns a new request, or 
+   `NULL' if the message was malformed. */
+
+static dataserver_request *
+decode_request_next_key (gzochi_metad_dataserver_client *client,
+			 unsigned char *data, unsigned short len)
+{
+  dataserver_request *request = dataserver_request_new
+    (client, GZOCHID_DATA_PROTOCOL_REQUEST_NEXT_KEY);
+  size_t offset = decode_app_and_store (request, data, len);
 
-  if (store == NULL || str_len <= 1)
+  if (offset > 0)
+    request->key = gzochid_protocol_read_bytes (data + offset, len - offset);
+
+  if (request->key == NULL)
     {
       g_warning
-	("Received malformed 'REQUEST_VALUE' message from node %d.",
+	("Received malformed 'REQUEST_NEXT_KEY' message from node %d.",
 	 client->node_id);
-      return FALSE;
+      dataserver_request_free (request);
+      return NULL;
     }
 
-  len -= str_len;
-  offset += str_len;
-  
-  if (len <= 0)
-    return FALSE;
+  return request;
+}
 
-  for_write = data[offset] == 1;
+/* Decodes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_SUBMIT_CHANGESET' opcode. Returns a new request, or
+   `NULL' if the message was malformed. */
 
-  len--;
-  offset++;
-  
-  key = gzochid_protocol_read_bytes (data + offset, len);
+static dataserver_request *
+decode_submit_changeset (gzochi_metad_dataserver_client *client,
+			 unsigned char *data, unsigned short len)
+{
+  GBytes *bytes = g_bytes_new (data, len);
+  gzochid_data_changeset *changeset =
+    gzochid_data_protocol_changeset_read (bytes);
+  dataserver_request *request = NULL;
 
-  if (key == NULL)
+  g_bytes_unref (bytes);
+  
+  if (changeset == NULL)
     {
       g_warning
-	("Received malformed 'REQUEST_VALUE' message from node %d.",
+	("Received malformed 'SUBMIT_CHANGESET' message from node %d.",
 	 client->node_id);
-      return FALSE;
+      return NULL;
     }
 
-  response = gzochi_metad_dataserver_request_value
-    (client->dataserver, client->node_id, app, store, key, for_write, &err);
+  request = dataserver_request_new
+    (client, GZOCHID_DATA_PROTOCOL_SUBMIT_CHANGESET);
+  request->changeset = changeset;
 
-  if (response == NULL)
+  return request;
+}
+
+/* Decodes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_RELEASE_KEY' opcode. Returns a new request, or 
+   `NULL' if the message was malformed. */
+
+static dataserver_request *
+decode_release_key (gzochi_metad_dataserver_client *client,
+		    unsigned char *data, unsigned short len)
+{
+  dataserver_request *request = dataserver_request_new
+    (client, GZOCHID_DATA_PROTOCOL_RELEASE_KEY);
+  size_t offset = decode_app_and_store (request, data, len);
+
+  if (offset > 0)
+    request->key = gzochid_protocol_read_bytes (data + offset, len - offset);
+
+  if (request->key == NULL)
     {
-      assert (err != NULL);
+      dataserver_request_free (request);
+      return NULL;
+    }
 
-      g_warning
-	("Failed to request value for application '%s': %s", app, err->message);
+  return request;
+}
 
-      g_error_free (err);
-      g_bytes_unref (key);
-      return FALSE;
+/* Decodes the message payload following the 
+   `GZOZCHID_DATA_PROTOCOL_RELEASE_KEY_RANGE' opcode. Returns a new request, or
+   `NULL' if the message was malformed. */
+
+static dataserver_request *
+decode_release_key_range (gzochi_metad_dataserver_client *client,
+			  unsigned char *data, unsigned short len)
+{
+  dataserver_request *request = dataserver_request_new
+    (client, GZOCHID_DATA_PROTOCOL_RELEASE_KEY_RANGE);
+  size_t offset = decode_app_and_store (request, data, len);
+
+  if (offset > 0)
+    request->key = gzochid_protocol_read_bytes (data + offset, len - offset);
+
+  if (request->key != NULL)
+    {
+      offset += 2 + g_bytes_get_size (request->key);  
+      request->to_key = gzochid_protocol_read_bytes
+	(data + offset, len - offset);
     }
   
-  bytes = g_byte_array_new ();  
-  gzochid_data_protocol_response_write (response, bytes);
+  if (request->to_key == NULL)
+    {
+      dataserver_request_free (request);
+      return NULL;
+    }
 
-  /* Pad with two `NULL' bytes to leave space for the actual length to be 
-     encoded. */
+  return request;
+}
 
-  g_byte_array_prepend
-    (bytes, (unsigned char *) &(unsigned char[])
-     { 0, 0, GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE }, 3);
-  gzochi_common_io_write_short (bytes->len - 3, bytes->data, 0);
-  gzochid_client_socket_write (client->sock, bytes->data, bytes->len);
+/* Executes a `GZOZCHID_DATA_PROTOCOL_REQUEST_OIDS' request. The bytes encoding
+   a `gzochid_data_reserve_oids_response' structure will be written to the 
+   client socket's send buffer. */
 
-  gzochid_data_response_free (response);
-  g_byte_array_unref (bytes);
+static void
+execute_request_oids (GzochiMetadDataServer *dataserver,
+		      dataserver_request *request)
+{
+  GByteArray *bytes = g_byte_array_new ();
+  gzochid_data_reserve_oids_response *response =
+    gzochi_metad_dataserver_reserve_oids
+    (dataserver, request->node_id, request->app);
+
+  gzochid_data_protocol_reserve_oids_response_write (response, bytes);
+  write_response (request->sock, GZOCHID_DATA_PROTOCOL_OIDS_RESPONSE, bytes);
   
-  g_bytes_unref (key);
-  return TRUE;
+  gzochid_data_reserve_oids_response_free (response);
+  g_byte_array_unref (bytes);
 }
 
-/* Processes the message payload following the 
-   `GZOZCHID_DATA_PROTOCOL_REQUEST_NEXT_KEY' opcode. Returns `TRUE' if the 
-   message was successfully decoded, `FALSE' otherwise. */
+/* Executes a `GZOZCHID_DATA_PROTOCOL_REQUEST_VALUE' request. On success, the
+   bytes encoding a `gzochid_data_object_response' structure will be written to
+   the client socket's send buffer. */
 
-static gboolean
-dispatch_request_next_key (gzochi_metad_dataserver_client *client,
-			   unsigned char *data, unsigned short len)
+static void
+execute_request_value (GzochiMetadDataServer *dataserver,
+		       dataserver_request *request)
 {
-  size_t str_len = 0, offset = 0;
-  const char *app = gzochid_protocol_read_str (data, len, &str_len),
-    *store = NULL;
   GByteArray *bytes = NULL;
-  GBytes *key = NULL; 
   GError *err = NULL;
-  
-  gzochid_data_response *response = NULL;
+  gzochid_data_response *response = gzochi_metad_dataserver_request_value
+    (dataserver, request->node_id, request->app, request->store, request->key,
+     request->for_write, &err);
 
-  if (app == NULL || str_len <= 1)
+  if (response == NULL)
     {
-      g_warning
-	("Received malformed 'REQUEST_NEXT_KEY' message from node %d.",
-	 client->node_id);
-      return FALSE;
-    }
-
-  len -= str_len;
-  offset += str_len;
-
-  store = gzochid_protocol_read_str (data + offset, len, &str_len);
+      assert (err != NULL);
 
-  if (store == NULL || str_len <= 1)
-    {
       g_warning
-	("Received malformed 'REQUEST_NEXT_KEY' message from node %d.",
-	 client->node_id);
-      return FALSE;
+	("Failed to request value for application '%s': %s", request->app,
+	 err->message);
+
+      g_error_free (err);
+      return;
     }
+  
+  bytes = g_byte_array_new ();  
+  gzochid_data_protocol_response_write (response, bytes);
+  write_response (request->sock, GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE, bytes);
 
-  len -= str_len;
-  offset += str_len;
+  gzochid_data_response_free (response);
+  g_byte_array_unref (bytes);
+}
 
-  key = gzochid_protocol_read_bytes (data + offset, len);
+/* Executes a `GZOZCHID_DATA_PROTOCOL_REQUEST_NEXT_KEY' request. On success, 
+   the bytes encoding a `gzochid_data_object_response' structure will be 
+   written to the client socket's send buffer. */
 
-  if (key == NULL)
-    {
-      g_warning
-	("Received malformed 'REQUEST_NEXT_KEY' message from node %d.",
-	 client->node_id);
-      return FALSE;
-    }
+static void
+execute_request_next_key (GzochiMetadDataServer *dataserver,
+			  dataserver_request *request)
+{
+  GByteArray *bytes = NULL;
+  GError *err = NULL;
+  gzochid_data_response *response = NULL;
 
   /* The data protocol specifies that an empty key in a "next key" request
      indicates a request to lock the entire keyspace; but the data server uses
      `NULL' to represent this condition. */
   
   response = gzochi_metad_dataserver_request_next_key
-    (client->dataserver, client->node_id, app, store,
-     g_bytes_get_size (key) == 0 ? NULL : key, &err);
+    (dataserver, request->node_id, request->app, request->store,
+     g_bytes_get_size (request->key) == 0 ? NULL : request->key, &err);
 
   if (response == NULL)
     {
       assert (err != NULL);
 
       g_warning
-	("Failed to request key range for application '%s': %s", app,
+	("Failed to request key range for application '%s': %s", request->app,
 	 err->message);
 
       g_error_free (err);
-      g_bytes_unref (key);
-      return FALSE;
+      return;
     }
 
   bytes = g_byte_array_new ();
   gzochid_data_protocol_response_write (response, bytes);
-
-  /* Pad with two `NULL' bytes to leave space for the actual length to be 
-     encoded. */
-
-  g_byte_array_prepend
-    (bytes, (unsigned char *) &(unsigned char[])
-     { 0, 0, GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE }, 3);
-  gzochi_common_io_write_short (bytes->len - 3, bytes->data, 0);
-  gzochid_client_socket_write (client->sock, bytes->data, bytes->len);
+  write_response
+    (request->sock, GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE, bytes);
 
   gzochid_data_response_free (response);
   g_byte_array_unref (bytes);
-  g_bytes_unref (key);
-  
-  return TRUE;
 }
 
-/* Processes the message payload following the 
-   `GZOZCHID_DATA_PROTOCOL_PROCESS_CHANGESET' opcode. Returns `TRUE' if the 
-   message was successfully decoded and the changeset ingested, `FALSE' 
-   otherwise. */
+/* Executes a `GZOZCHID_DATA_PROTOCOL_SUBMIT_CHANGESET' request. */
 
-static gboolean
-dispatch_submit_changeset (gzochi_metad_dataserver_client *client,
-			   unsigned char *data, unsigned short len)
+static void
+execute_submit_changeset (GzochiMetadDataServer *dataserver,
+			  dataserver_request *request)
 {
   GError *local_err = NULL;
-  GBytes *bytes = g_bytes_new (data, len);
-  gzochid_data_changeset *changeset =
-    gzochid_data_protocol_changeset_read (bytes);
-
-  if (changeset == NULL)
-    {
-      g_warning
-	("Received malformed 'SUBMIT_CHANGESET' message from node %d.",
-	 client->node_id);
-      g_bytes_unref (bytes);
-      return FALSE;
-    }
   
   gzochi_metad_dataserver_process_changeset
-    (client->dataserver, client->node_id, changeset, &local_err);
+    (dataserver, request->node_id, request->changeset, &local_err);
 
   if (local_err != NULL)
     {
-      g_warning ("Failed to process changeset from %d/%s: %s", client->node_id,
-		 changeset->app, local_err->message);
-
-      gzochid_data_changeset_free (changeset);
+      g_warning ("Failed to process changeset from %d/%s: %s",
+		 request->node_id, request->changeset->app, local_err->message);
       g_error_free (local_err);
-      g_bytes_unref (bytes);
-      return FALSE;
     }
-  
-  gzochid_data_changeset_free (changeset);
-  g_bytes_unref (bytes);
-  return TRUE;
 }
 
-/* Processes the message payload following the 
-   `GZOZCHID_DATA_PROTOCOL_RELEASE_KEY' opcode. Returns `TRUE' if the 
-   message was successfully decoded, `FALSE' otherwise. */
+/* Executes a `GZOZCHID_DATA_PROTOCOL_RELEASE_KEY_RANGE' request. */
 
-static gboolean
-dispatch_release_key (gzochi_metad_dataserver_client *client,
-		      unsigned char *data, unsigned short len)
+static void
+execute_release_key_range (GzochiMetadDataServer *dataserver,
+			   dataserver_request *request)
 {
-  size_t str_len = 0, offset = 0;
-  const char *app = gzochid_protocol_read_str (data, len, &str_len),
-    *store = NULL;
-  GBytes *key = NULL;
-
-  if (app == NULL || str_len <= 1)
-    return FALSE;
-
-  len -= str_len;
-  offset += str_len;
-
-  store = gzochid_protocol_read_str (data + offset, len, &str_len);
-
-  if (store == NULL || str_len <= 1)
-    return FALSE;
-
-  len -= str_len;
-  offset += str_len;
-
-  key = gzochid_protocol_read_bytes (data + offset, len);
-
-  if (key == NULL)
-    return FALSE;
-  
-  gzochi_metad_dataserver_release_key
-    (client->dataserver, client->node_id, app, store, key);
-  g_bytes_unref (key);
+  /* The data protocol specifies that an empty "from" or "to" key in a key range
+     release indicates the beginning or end, respectively of the keyspace; but
+     the data server uses `NULL' to represent these boundaries. */
 
-  return TRUE;
+  gzochi_metad_dataserver_release_range
+    (dataserver, request->node_id, request->app, request->store,
+     g_bytes_get_size (request->key) == 0 ? NULL : request->key,
+     g_bytes_get_size (request->to_key) == 0 ? NULL : request->to_key);
 }
 
-/* Processes the message payload following the 
-   `GZOZCHID_DATA_PROTOCOL_RELEASE_KEY_RANGE' opcode. Returns `TRUE' if the 
-   message was successfully decoded, `FALSE' otherwise. */
+/* A `gzochi_metad_dataserver_request_worker' implementation that executes the
+   specified `dataserver_request' and frees it. */
 
-static gboolean
-dispatch_release_key_range (gzochi_metad_dataserver_client *client,
-			    unsigned char *data, unsigned short len)
+static void
+execute_request (GzochiMetadDataServer *dataserver, gpointer data)
 {
-  size_t str_len = 0, offset = 0;
-  const char *app = gzochid_protocol_read_str (data, len, &str_len),
-    *store = NULL;
-  GBytes *from_key = NULL, *to_key = NULL;
-
-  if (app == NULL || str_len <= 1)
-    return FALSE;
-
-  len -= str_len;
-  offset += str_len;
-
-  store = gzochid_protocol_read_str (data + offset, len, &str_len);
-
-  if (store == NULL || str_len <= 1)
-    return FALSE;
+  dataserver_request *request = data;
 
-  len -= str_len;
-  offset += str_len;
-
-  from_key = gzochid_protocol_read_bytes (data + offset, len);
-
-  if (from_key == NULL)
-    return FALSE;
-
-  len -= 2 + g_bytes_get_size (from_key);
-  offset += 2 + g_bytes_get_size (from_key);
-  
-  to_key = gzochid_protocol_read_bytes (data + offset, len);
-
-  if (to_key == NULL)
+  switch (request->opcode)
     {
-      g_bytes_unref (from_key);
-      return FALSE;
+    case GZOCHID_DATA_PROTOCOL_REQUEST_OIDS:
+      execute_request_oids (dataserver, request); break;
+    case GZOCHID_DATA_PROTOCOL_REQUEST_VALUE:
+      execute_request_value (dataserver, request); break;
+    case GZOCHID_DATA_PROTOCOL_REQUEST_NEXT_KEY:
+      execute_request_next_key (dataserver, request); break;
+    case GZOCHID_DATA_PROTOCOL_SUBMIT_CHANGESET:
+      execute_submit_changeset (dataserver, request); break;
+    case GZOCHID_DATA_PROTOCOL_RELEASE_KEY:
+      gzochi_metad_dataserver_release_key
+	(dataserver, request->node_id, request->app, request->store,
+	 request->key);
+      break;
+    case GZOCHID_DATA_PROTOCOL_RELEASE_KEY_RANGE:
+      execute_release_key_range (dataserver, request); break;
+      
+    default: assert (1 == 0);
     }
-  
-  /* The data protocol specifies that an empty "from" or "to" key in a key range
-     release indicates the beginning or end, respectively of the keyspace; but
-     the data server uses `NULL' to represent these boundaries. */
-
-  gzochi_metad_dataserver_release_range
-    (client->dataserver, client->node_id, app, store,
-     g_bytes_get_size (from_key) == 0 ? NULL : from_key,
-     g_bytes_get_size (to_key) == 0 ? NULL : to_key);
 
-  g_bytes_unref (from_key);
-  g_bytes_unref (to_key);
-  
-  return TRUE;
+  dataserver_request_free (request);
 }
 
-/* Attempt to dispatch a fully-buffered message from the specified client based
-   on its opcode. */
+/* Attempt to decode a fully-buffered message from the specified client based
+   on its opcode, and submit it to the data server for execution. */
 
 static void 
 dispatch_message (gzochi_metad_dataserver_client *client,
@@ -471,29 +534,32 @@ dispatch_message (gzochi_metad_dataserver_client *client,
 {
   int opcode = message[0];
   unsigned char *payload = message + 1;
+  dataserver_request *request = NULL;
   
   len--;
   
   switch (opcode)
     {
     case GZOCHID_DATA_PROTOCOL_REQUEST_OIDS:
-      dispatch_request_oids (client, payload, len); break;
+      request = decode_request_oids (client, payload, len); break;
     case GZOCHID_DATA_PROTOCOL_REQUEST_VALUE:
-      dispatch_request_value (client, payload, len); break;
+      request = decode_request_value (client, payload, len); break;
     case GZOCHID_DATA_PROTOCOL_REQUEST_NEXT_KEY:
-      dispatch_request_next_key (client, payload, len); break;
+      request = decode_request_next_key (client, payload, len); break;
     case GZOCHID_DATA_PROTOCOL_SUBMIT_CHANGESET:
-      dispatch_submit_changeset (client, payload, len); break;
+      request = decode_submit_changeset (client, payload, len); break;
     case GZOCHID_DATA_PROTOCOL_RELEASE_KEY:
-      dispatch_release_key (client, payload, len); break;
+      request = decode_release_key (client, payload, len); break;
     case GZOCHID_DATA_PROTOCOL_RELEASE_KEY_RANGE:
-      dispatch_release_key_range (client, payload, len); break;
+      request = decode_release_key_range (client, payload, len); break;
       
     default:
       g_warning ("Unexpected opcode %d received from client", opcode);
     }
-  
-  return;
+
+  if (request != NULL)
+    gzochi_metad_dataserver_submit_request
+      (client->dataserver, client->node_id, execute_request, request);
 }
 
 /* Attempts to dispatch all messages in the specified buffer. Returns the 
@@ -527,13 +593,30 @@ client_dispatch (const GByteArray *buffer, gpointer user_data)
   return total;
 }
 
-/* The client error handler. Releases all locks held on behalf of the client. */
+/* A `gzochi_metad_dataserver_request_worker' implementation that unregisters
+   the connection to the node whose id is encoded in the specified pointer and
+   releases all locks held on its behalf. */
+
+static void
+release_all (GzochiMetadDataServer *dataserver, gpointer data)
+{
+  guint node_id = GPOINTER_TO_UINT (data);
+  
+  gzochi_metad_dataserver_server_disconnected (dataserver, node_id);
+  gzochi_metad_dataserver_release_all (dataserver, node_id);
+}
+
+/* The client error handler. Releases all locks held on behalf of the client, 
+   once any requests already received from the client have been executed. */
 
 static void
 client_error (gpointer user_data)
 {
   gzochi_metad_dataserver_client *client = user_data;
-  gzochi_metad_dataserver_release_all (client->dataserver, client->node_id);
+
+  gzochi_metad_dataserver_submit_request
+    (client->dataserver, client->node_id, release_all,
+     GUINT_TO_POINTER (client->node_id));
 }
 
 /* Client finalization callback. */
@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <glib.h>
 #include <glib-object.h>
+#include <gzochi-common.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +30,7 @@
 #include "httpd.h"
 #include "lock.h"
 #include "log.h"
+#include "meta-protocol.h"
 #include "oids-storage.h"
 #include "oids.h"
 #include "resolver.h"
@@ -48,12 +50,22 @@
 
 #define LOCK_ACCESS(for_write) (for_write ? "r/w" : "read")
 
+/* The default number of request worker threads. */
+
+#define DEFAULT_REQUEST_THREADS 4
+
 /* A store with an associated lock table. */
 
 struct _gzochi_metad_dataserver_lockable_store
 {
   gzochid_storage_store *store; /* The persistent store. */
   gzochid_lock_table *locks; /* The lock table. */
+
+  /* The queue of `gzochi_metad_dataserver_waiter' structures for the lock 
+     requests that were denied, in the order in which they were denied. */
+
+  GQueue *waiters; 
+  GMutex mutex; /* Protects the lock table and the waiter queue. */
 };
 
 typedef struct _gzochi_metad_dataserver_lockable_store
@@ -78,11 +90,63 @@ struct _gzochi_metad_dataserver_application_store
   /* The oid allocation strategy. */
   
   gzochid_oid_allocation_strategy *oid_strategy; 
+
+  /* Serializes changeset commits and oid block reservations against the 
+     application's storage. */
+
+  GMutex mutex; 
 };
 
 typedef struct _gzochi_metad_dataserver_application_store
 gzochi_metad_dataserver_application_store;
 
+/* A lock request that was denied because of a conflicting lock held by another
+   node, and which will be granted to the requesting node - and the grant pushed
+   to it - once the conflicting locks have been released. */
+
+struct _gzochi_metad_dataserver_waiter
+{
+  guint node_id; /* The requesting node id. */
+  char *app; /* The name of the target application. */
+  char *store_name; /* The name of the target store. */
+
+  /* The target application store. */
+
+  gzochi_metad_dataserver_application_store *app_store; 
+
+  /* The target lockable store. */
+  
+  gzochi_metad_dataserver_lockable_store *store;   
+  gboolean range; /* Whether a range lock was requested. */
+  gboolean for_write; /* Whether a point lock was requested for write. */
+
+  /* The requested key, or the lower bound of the requested range, which may be
+     `NULL' to indicate the start of the keyspace. */
+
+  GBytes *key; 
+
+  /* The upper bound of the range, as of the most recent attempt to grant it;
+     `NULL' for point locks and for ranges that extend to the end of the 
+     keyspace. */
+  
+  GBytes *to_key; 
+};
+
+typedef struct _gzochi_metad_dataserver_waiter gzochi_metad_dataserver_waiter;
+
+/* A message to be sent to a connected node from one of the request worker 
+   threads. */
+
+struct _gzochi_metad_dataserver_notification
+{
+  guint node_id; /* The target node id. */
+  int opcode; /* The message opcode. */
+  GByteArray *payload; /* The message payload. */
+};
+
+typedef struct _gzochi_metad_dataserver_notification
+gzochi_metad_dataserver_notification;
+
 /* Boilerplate setup for the data server object. */
 
 /* The data server object. */
@@ -113,8 +177,32 @@ struct _GzochiMetadDataServer
   /* Mapping application name to `gzochi_metad_dataserver_application_store'. */
 
   GHashTable *application_stores; 
+  GMutex application_stores_mutex; /* Protects the application store map. */
+
+  /* The request worker pools, each consisting of a single thread, or `NULL' if
+     the data server has not been started. */
+
+  GThreadPool **request_workers; 
+  guint num_request_workers; /* The number of request worker pools. */
+
+  /* Mapping of node id to `gzochid_client_socket' for connected nodes; used to
+     push lock revocations and grants. */
+
+  GHashTable *node_sockets; 
+  GMutex node_sockets_mutex; /* Protects the node socket map. */
+};
+
+/* A request submitted for execution on a request worker thread. */
+
+struct _gzochi_metad_dataserver_request
+{
+  gzochi_metad_dataserver_request_worker worker; /* The execution function. */
+  gpointer data; /* The request data. */
 };
 
+typedef struct _gzochi_metad_dataserver_request
+gzochi_metad_dataserver_request;
+
 #define STORAGE_INTERFACE(server) server->storage_engine->interface
 
 G_DEFINE_TYPE (GzochiMetadDataServer, gzochi_metad_data_server, G_TYPE_OBJECT);
@@ -164,6 +252,47 @@ gzochi_metad_data_server_set_property (GObject *object, guint property_id,
     }
 }
 
+/* Creates and returns a new waiter for the specified lock request, and, for
+   range lock requests, the upper bound of the range as of the request. The 
+   memory associated with the returned waiter should be freed via 
+   `waiter_free'. */
+
+static gzochi_metad_dataserver_waiter *
+waiter_new (guint node_id, const char *app, const char *store_name,
+	    gzochi_metad_dataserver_application_store *app_store,
+	    gzochi_metad_dataserver_lockable_store *store, gboolean range,
+	    gboolean for_write, GBytes *key, GBytes *to_key)
+{
+  gzochi_metad_dataserver_waiter *waiter =
+    malloc (sizeof (gzochi_metad_dataserver_waiter));
+
+  waiter->node_id = node_id;
+  waiter->app = strdup (app);
+  waiter->store_name = strdup (store_name);
+  waiter->app_store = app_store;
+  waiter->store = store;
+  waiter->range = range;
+  waiter->for_write = for_write;
+  waiter->key = key == NULL ? NULL : g_bytes_ref (key);
+  waiter->to_key = to_key == NULL ? NULL : g_bytes_ref (to_key);
+
+  return waiter;
+}
+
+static void
+waiter_free (gzochi_metad_dataserver_waiter *waiter)
+{
+  free (waiter->app);
+  free (waiter->store_name);
+
+  if (waiter->key != NULL)
+    g_bytes_unref (waiter->key);
+  if (waiter->to_key != NULL)
+    g_bytes_unref (waiter->to_key);
+  
+  free (waiter);
+}
+
 /* A `GHRFunc' implementation that cleans up 
    `gzochi_metad_dataserver_application_store' instances managed by the data 
    server as part of the data server shutdown process. */
@@ -176,10 +305,14 @@ close_application_store (gpointer key, gpointer value, gpointer user_data)
   
   STORAGE_INTERFACE (server)->close_store (store->oids->store);
   gzochid_lock_table_free (store->oids->locks);
+  g_queue_free_full (store->oids->waiters, (GDestroyNotify) waiter_free);
+  g_mutex_clear (&store->oids->mutex);
   free (store->oids);
   
   STORAGE_INTERFACE (server)->close_store (store->names->store);
   gzochid_lock_table_free (store->names->locks);
+  g_queue_free_full (store->names->waiters, (GDestroyNotify) waiter_free);
+  g_mutex_clear (&store->names->mutex);
   free (store->names);
 
   STORAGE_INTERFACE (server)->close_store (store->meta);
@@ -187,6 +320,7 @@ close_application_store (gpointer key, gpointer value, gpointer user_data)
   STORAGE_INTERFACE (server)->close_context (store->storage_context);
 
   gzochid_oid_allocation_strategy_free (store->oid_strategy);
+  g_mutex_clear (&store->mutex);
   
   return TRUE;
 }
@@ -195,12 +329,20 @@ static void
 gzochi_metad_data_server_finalize (GObject *gobject)
 {
   GzochiMetadDataServer *server = GZOCHI_METAD_DATA_SERVER (gobject);
+
+  /* Drain any pending requests before tearing down the application stores. */
+  
+  gzochi_metad_dataserver_stop (server);
   
   g_hash_table_destroy (server->data_configuration);
 
   g_hash_table_foreach_remove
     (server->application_stores, close_application_store, server);
   g_hash_table_destroy (server->application_stores);
+  g_mutex_clear (&server->application_stores_mutex);
+
+  g_hash_table_destroy (server->node_sockets);
+  g_mutex_clear (&server->node_sockets_mutex);
 
   if (server->storage_engine != NULL)
     {
@@ -261,6 +403,24 @@ gzochi_metad_data_server_init (GzochiMetadDataServer *self)
 {
   self->application_stores = g_hash_table_new_full
     (g_str_hash, g_str_equal, (GDestroyNotify) free, (GDestroyNotify) free);
+  g_mutex_init (&self->application_stores_mutex);
+
+  self->node_sockets = g_hash_table_new_full
+    (g_direct_hash, g_direct_equal, NULL,
+     (GDestroyNotify) gzochid_client_socket_unref);
+  g_mutex_init (&self->node_sockets_mutex);
+}
+
+/* The `GFunc' for the request worker pools. Executes the specified 
+   `gzochi_metad_dataserver_request' and frees it. */
+
+static void
+execute_request (gpointer data, gpointer user_data)
+{
+  gzochi_metad_dataserver_request *request = data;
+
+  request->worker (user_data, request->data);
+  free (request);
 }
 
 void
@@ -281,7 +441,8 @@ gzochi_metad_dataserver_start (GzochiMetadDataServer *self)
         }
 
       self->storage_engine = gzochid_storage_load_engine 
-        (dir, g_hash_table_lookup (self->data_configuration, "storage.engine"));
+        (dir, g_hash_table_lookup (self->data_configuration, "storage.engine"),
+	 self->data_configuration);
     }
   else g_message 
          ("No durable storage engine configured; memory engine will be used.");
@@ -295,6 +456,234 @@ FOR PRODUCTION USE.");
       self->storage_engine = calloc (1, sizeof (gzochid_storage_engine));
       self->storage_engine->interface = &gzochid_storage_engine_interface_mem;
     }
+
+  if (self->request_workers == NULL)
+    {
+      guint i = 0;
+      int num_request_workers = gzochid_config_to_int
+	(g_hash_table_lookup (self->data_configuration, "request.threads"),
+	 DEFAULT_REQUEST_THREADS);
+
+      if (num_request_workers < 1)
+	{
+	  g_warning
+	    ("Invalid request thread count %d; using %d.", num_request_workers,
+	     DEFAULT_REQUEST_THREADS);
+	  num_request_workers = DEFAULT_REQUEST_THREADS;
+	}
+
+      /* Each worker "pool" has exactly one thread, which guarantees that 
+	 requests submitted to it are executed in order. */
+      
+      self->num_request_workers = num_request_workers;
+      self->request_workers = malloc
+	(sizeof (GThreadPool *) * self->num_request_workers);
+
+      for (; i < self->num_request_workers; i++)
+	self->request_workers[i] = g_thread_pool_new
+	  (execute_request, self, 1, TRUE, NULL);
+    }
+}
+
+void
+gzochi_metad_dataserver_stop (GzochiMetadDataServer *self)
+{
+  if (self->request_workers != NULL)
+    {
+      guint i = 0;
+
+      /* Wait for each worker to finish its queued requests. */
+      
+      for (; i < self->num_request_workers; i++)
+	g_thread_pool_free (self->request_workers[i], FALSE, TRUE);
+
+      free (self->request_workers);
+
+      self->request_workers = NULL;
+      self->num_request_workers = 0;
+    }
+}
+
+void
+gzochi_metad_dataserver_submit_request
+(GzochiMetadDataServer *server, guint64 partition,
+ gzochi_metad_dataserver_request_worker worker, gpointer data)
+{
+  if (server->request_workers == NULL)
+    worker (server, data);
+  else
+    {
+      gzochi_metad_dataserver_request *request =
+	malloc (sizeof (gzochi_metad_dataserver_request));
+
+      request->worker = worker;
+      request->data = data;
+      
+      g_thread_pool_push
+	(server->request_workers[partition % server->num_request_workers],
+	 request, NULL);
+    }
+}
+
+void
+gzochi_metad_dataserver_server_connected (GzochiMetadDataServer *server,
+					  guint node_id,
+					  gzochid_client_socket *sock)
+{
+  g_mutex_lock (&server->node_sockets_mutex);
+  g_hash_table_insert
+    (server->node_sockets, GUINT_TO_POINTER (node_id),
+     gzochid_client_socket_ref (sock));
+  g_mutex_unlock (&server->node_sockets_mutex);
+}
+
+void
+gzochi_metad_dataserver_server_disconnected (GzochiMetadDataServer *server,
+					     guint node_id)
+{
+  g_mutex_lock (&server->node_sockets_mutex);
+  g_hash_table_remove (server->node_sockets, GUINT_TO_POINTER (node_id));
+  g_mutex_unlock (&server->node_sockets_mutex);
+}
+
+/* Frames the specified message payload with the specified opcode and writes it
+   to the send buffer of the socket for the specified node. Returns `TRUE' if
+   the node is connected, `FALSE' otherwise. */
+
+static gboolean
+write_to_node (GzochiMetadDataServer *server, guint node_id, int opcode,
+	       GByteArray *payload)
+{
+  gzochid_client_socket *sock = NULL;
+
+  g_mutex_lock (&server->node_sockets_mutex);
+  sock = g_hash_table_lookup (server->node_sockets, GUINT_TO_POINTER (node_id));
+  if (sock != NULL)
+    gzochid_client_socket_ref (sock);
+  g_mutex_unlock (&server->node_sockets_mutex);
+
+  if (sock == NULL)
+    return FALSE;
+  else
+    {
+      GByteArray *message = g_byte_array_sized_new (payload->len + 3);
+
+      /* Pad with two `NULL' bytes to leave space for the actual length to be 
+	 encoded. */
+
+      g_byte_array_append
+	(message, (unsigned char *) &(unsigned char[]) { 0, 0, opcode }, 3);
+      g_byte_array_append (message, payload->data, payload->len);
+      gzochi_common_io_write_short (payload->len, message->data, 0);
+      gzochid_client_socket_write (sock, message->data, message->len);
+
+      g_byte_array_unref (message);
+      gzochid_client_socket_unref (sock);
+
+      return TRUE;
+    }
+}
+
+/* A `gzochi_metad_dataserver_request_worker' implementation that sends the 
+   specified `gzochi_metad_dataserver_notification' to its target node and
+   frees it. */
+
+static void
+send_notification (GzochiMetadDataServer *server, gpointer data)
+{
+  gzochi_metad_dataserver_notification *notification = data;
+
+  write_to_node
+    (server, notification->node_id, notification->opcode,
+     notification->payload);
+
+  g_byte_array_unref (notification->payload);
+  free (notification);
+}
+
+/* Encapsulates contextual data used while collecting the revocations to send
+   to the holders of locks that conflict with a denied lock request. */
+
+struct _revocation_context
+{
+  const char *app; /* The name of the target application. */
+  const char *store_name; /* The name of the target store. */
+
+  /* The list of `gzochi_metad_dataserver_notification' structures. */
+  
+  GList *notifications; 
+};
+
+typedef struct _revocation_context revocation_context;
+
+/* A `gzochid_lock_conflict_func' implementation that adds a revocation for the
+   specified lock to the notification list in the specified 
+   `revocation_context', unless an identical one is already present. */
+
+static void
+collect_revocation (guint node_id, gboolean range, GBytes *from, GBytes *to,
+		    gpointer user_data)
+{
+  revocation_context *context = user_data;
+  int opcode = range
+    ? GZOCHID_DATA_PROTOCOL_REVOKE_KEY_RANGE
+    : GZOCHID_DATA_PROTOCOL_REVOKE_KEY;
+  GByteArray *payload = g_byte_array_new ();
+  gzochid_data_revocation *revocation = gzochid_data_revocation_new
+    (context->app, context->store_name, from);
+  GList *notification_ptr = context->notifications;
+
+  gzochid_data_protocol_revocation_write (revocation, payload);
+  gzochid_data_revocation_free (revocation);
+
+  for (; notification_ptr != NULL; notification_ptr = notification_ptr->next)
+    {
+      gzochi_metad_dataserver_notification *notification =
+	notification_ptr->data;
+
+      if (notification->node_id == node_id && notification->opcode == opcode
+	  && notification->payload->len == payload->len
+	  && memcmp (notification->payload->data, payload->data,
+		     payload->len) == 0)
+	{
+	  g_byte_array_unref (payload);
+	  return;
+	}
+    }
+
+  {
+    gzochi_metad_dataserver_notification *notification =
+      malloc (sizeof (gzochi_metad_dataserver_notification));
+
+    notification->node_id = node_id;
+    notification->opcode = opcode;
+    notification->payload = payload;
+
+    context->notifications = g_list_prepend
+      (context->notifications, notification);
+  }
+}
+
+/* Submits each revocation in the specified list to the request worker that
+   handles requests for the node holding the revoked lock, and frees the list.
+   Doing so guarantees that the revocation is written to the node's socket
+   after the response that granted the lock. */
+
+static void
+submit_revocations (GzochiMetadDataServer *server, GList *notifications)
+{
+  GList *notification_ptr = notifications;
+
+  for (; notification_ptr != NULL; notification_ptr = notification_ptr->next)
+    {
+      gzochi_metad_dataserver_notification *notification =
+	notification_ptr->data;
+
+      gzochi_metad_dataserver_submit_request
+	(server, notification->node_id, send_notification, notification);
+    }
+
+  g_list_free (notifications);
 }
 
 /* Switch on the specified store name to return either the oids store or the
@@ -330,17 +719,19 @@ get_lockable_store (gzochi_metad_dataserver_application_store *store,
 */
 
 static gzochi_metad_dataserver_application_store *
-ensure_open_application_store (const GzochiMetadDataServer *server,
-			       const char *app)
+ensure_open_application_store (GzochiMetadDataServer *server, const char *app)
 {
-  if (g_hash_table_contains (server->application_stores, app))
-    return g_hash_table_lookup (server->application_stores, app);
-  else
+  gzochi_metad_dataserver_application_store *store = NULL;
+
+  g_mutex_lock (&server->application_stores_mutex);
+  store = g_hash_table_lookup (server->application_stores, app);
+
+  if (store == NULL)
     {
-      gzochi_metad_dataserver_application_store *store =
-	malloc (sizeof (gzochi_metad_dataserver_application_store));
       gzochid_storage_engine_interface *iface = STORAGE_INTERFACE (server);
 
+      store = malloc (sizeof (gzochi_metad_dataserver_application_store));
+
       g_message ("Initializing application storage for '%s'.", app);
       
       store->storage_context = iface->initialize ((char *) app);
@@ -349,21 +740,393 @@ ensure_open_application_store (const GzochiMetadDataServer *server,
       store->oids->store = iface->open
 	(store->storage_context, "oids", GZOCHID_STORAGE_CREATE);
       store->oids->locks = gzochid_lock_table_new ("oids"); 
+      store->oids->waiters = g_queue_new ();
+      g_mutex_init (&store->oids->mutex);
 
       store->names = malloc (sizeof (gzochi_metad_dataserver_lockable_store));
       store->names->store = iface->open
 	(store->storage_context, "names", GZOCHID_STORAGE_CREATE);
       store->names->locks = gzochid_lock_table_new ("names"); 
+      store->names->waiters = g_queue_new ();
+      g_mutex_init (&store->names->mutex);
 
       store->meta = iface->open
 	(store->storage_context, "meta", GZOCHID_STORAGE_CREATE);
 
       store->oid_strategy = gzochid_storage_oid_strategy_new
 	(iface, store->storage_context, store->meta);
+      g_mutex_init (&store->mutex);
       
       g_hash_table_insert (server->application_stores, strdup (app), store);
-      return store;
     }
+
+  g_mutex_unlock (&server->application_stores_mutex);
+  
+  return store;
+}
+
+/* Reads the value stored at the specified key in the specified lockable store,
+   returning it as a `GBytes' (which should be released via `g_bytes_unref')
+   or `NULL' if there is no value for the key. */
+
+static GBytes *
+read_value (GzochiMetadDataServer *server,
+	    gzochi_metad_dataserver_application_store *app_store,
+	    gzochi_metad_dataserver_lockable_store *store, GBytes *key)
+{
+  size_t data_len = 0;
+  gzochid_storage_transaction *transaction =
+    gzochid_storage_transaction_begin_read_only
+    (STORAGE_INTERFACE (server), app_store->storage_context);
+  char *data = STORAGE_INTERFACE (server)->transaction_get
+    (transaction, store->store, (char *) g_bytes_get_data (key, NULL),
+     g_bytes_get_size (key), &data_len);
+
+  STORAGE_INTERFACE (server)->transaction_rollback (transaction);
+
+  return data == NULL ? NULL : g_bytes_new_with_free_func
+    (data, data_len, (GDestroyNotify) free, data);
+}
+
+/* Reads the key that immediately follows the specified key (or the first key,
+   if the specified key is `NULL') in the specified lockable store, returning 
+   it as a `GBytes' (which should be released via `g_bytes_unref') or `NULL' if
+   there is no such key. */
+
+static GBytes *
+read_next_key (GzochiMetadDataServer *server,
+	       gzochi_metad_dataserver_application_store *app_store,
+	       gzochi_metad_dataserver_lockable_store *store, GBytes *key)
+{
+  size_t data_len = 0;
+  char *data = NULL;
+  gzochid_storage_transaction *transaction =
+    gzochid_storage_transaction_begin_read_only
+    (STORAGE_INTERFACE (server), app_store->storage_context);
+
+  if (key == NULL)
+    data = STORAGE_INTERFACE (server)->transaction_first_key
+      (transaction, store->store, &data_len);
+  else data = STORAGE_INTERFACE (server)->transaction_next_key
+	 (transaction, store->store, (char *) g_bytes_get_data (key, NULL),
+	  g_bytes_get_size (key), &data_len);
+  
+  assert (!transaction->rollback);
+
+  STORAGE_INTERFACE (server)->transaction_rollback (transaction);
+
+  return data == NULL ? NULL : g_bytes_new_with_free_func
+    (data, data_len, (GDestroyNotify) free, data);
+}
+
+/* The upper bound of a range beginning at a particular key, read ahead of an
+   attempt to grant the range locks requested by a lockable store's waiters, so
+   that the storage I/O isn't performed while holding the store's mutex. */
+
+struct _gzochi_metad_dataserver_range_bound
+{
+  GBytes *key; /* The lower bound of the range; may be `NULL'. */
+  GBytes *to_key; /* The key that follows `key'; may be `NULL'. */
+};
+
+typedef struct _gzochi_metad_dataserver_range_bound
+gzochi_metad_dataserver_range_bound;
+
+/* Frees the specified range bound. */
+
+static void
+range_bound_free (gzochi_metad_dataserver_range_bound *bound)
+{
+  if (bound->key != NULL)
+    g_bytes_unref (bound->key);
+  if (bound->to_key != NULL)
+    g_bytes_unref (bound->to_key);
+
+  free (bound);
+}
+
+/* Returns the bound in the specified list of range bounds whose lower bound is
+   the specified key, or `NULL' if there is no such bound. */
+
+static gzochi_metad_dataserver_range_bound *
+find_range_bound (GList *bounds, GBytes *key)
+{
+  GList *bound_ptr = bounds;
+
+  for (; bound_ptr != NULL; bound_ptr = bound_ptr->next)
+    {
+      gzochi_metad_dataserver_range_bound *bound = bound_ptr->data;
+
+      if (gzochid_util_bytes_compare_null_first (bound->key, key) == 0)
+	return bound;
+    }
+
+  return NULL;
+}
+
+/* 
+   Reads the current upper bound of each distinct range requested by the 
+   waiters queued on the specified lockable store, returning a list of 
+   `gzochi_metad_dataserver_range_bound' structures to be passed to 
+   `grant_waiting_requests' and then freed via `free_range_bounds'. The store's
+   mutex is only held while the waiter queue is scanned, not during the reads.
+   The caller must not hold the store's mutex.
+
+   (The upper bounds may change between the reads and the grant, but no more so
+   than they may between the read of a new range lock request's upper bound and
+   the attempt to grant it, which is also made without holding the mutex.)
+*/
+
+static GList *
+read_range_bounds (GzochiMetadDataServer *server,
+		   gzochi_metad_dataserver_application_store *app_store,
+		   gzochi_metad_dataserver_lockable_store *store)
+{
+  GList *bounds = NULL, *bound_ptr = NULL, *waiter_link = NULL;
+
+  g_mutex_lock (&store->mutex);
+
+  for (waiter_link = store->waiters->head; waiter_link != NULL;
+       waiter_link = waiter_link->next)
+    {
+      gzochi_metad_dataserver_waiter *waiter = waiter_link->data;
+
+      if (waiter->range && find_range_bound (bounds, waiter->key) == NULL)
+	{
+	  gzochi_metad_dataserver_range_bound *bound =
+	    malloc (sizeof (gzochi_metad_dataserver_range_bound));
+
+	  bound->key = waiter->key == NULL ? NULL : g_bytes_ref (waiter->key);
+	  bound->to_key = NULL;
+	  bounds = g_list_prepend (bounds, bound);
+	}
+    }
+
+  g_mutex_unlock (&store->mutex);
+
+  for (bound_ptr = bounds; bound_ptr != NULL; bound_ptr = bound_ptr->next)
+    {
+      gzochi_metad_dataserver_range_bound *bound = bound_ptr->data;
+
+      bound->to_key = read_next_key (server, app_store, store, bound->key);
+    }
+
+  return bounds;
+}
+
+/* Frees the specified list of range bounds. */
+
+static void
+free_range_bounds (GList *bounds)
+{
+  g_list_free_full (bounds, (GDestroyNotify) range_bound_free);
+}
+
+static GList *grant_waiting_requests
+(gzochi_metad_dataserver_lockable_store *, GList *);
+static void submit_grants (GzochiMetadDataServer *, GList *);
+
+/* 
+   A `gzochi_metad_dataserver_request_worker' implementation that pushes a 
+   grant for the lock requested by the specified 
+   `gzochi_metad_dataserver_waiter' to the requesting node, and frees the 
+   waiter.
+
+   If the node has disconnected since the lock was granted, the lock is 
+   released instead, since the node's other locks may already have been
+   released.
+*/
+
+static void
+push_grant (GzochiMetadDataServer *server, gpointer data)
+{
+  gzochi_metad_dataserver_waiter *waiter = data;
+  GByteArray *payload = g_byte_array_new ();
+  GBytes *value = waiter->range
+    ? (waiter->to_key == NULL ? NULL : g_bytes_ref (waiter->to_key))
+    : read_value (server, waiter->app_store, waiter->store, waiter->key);
+  gzochid_data_grant *grant = gzochid_data_grant_new
+    (waiter->app, waiter->store_name, waiter->for_write, waiter->key, value);
+
+  gzochid_data_protocol_grant_write (grant, payload);
+
+  if (!write_to_node
+      (server, waiter->node_id,
+       waiter->range
+       ? GZOCHID_DATA_PROTOCOL_NEXT_KEY_GRANT
+       : GZOCHID_DATA_PROTOCOL_VALUE_GRANT, payload))
+    {
+      GList *bounds = NULL, *grants = NULL;
+      
+      g_debug ("Node %d disconnected before lock grant; releasing.",
+	       waiter->node_id);
+
+      bounds = read_range_bounds (server, waiter->app_store, waiter->store);
+      g_mutex_lock (&waiter->store->mutex);
+
+      if (waiter->range)
+	gzochid_lock_release_range
+	  (waiter->store->locks, waiter->node_id, waiter->key, waiter->to_key);
+      else gzochid_lock_release
+	     (waiter->store->locks, waiter->node_id, waiter->key);
+
+      grants = grant_waiting_requests (waiter->store, bounds);
+      g_mutex_unlock (&waiter->store->mutex);
+
+      free_range_bounds (bounds);
+      submit_grants (server, grants);
+    }
+  
+  if (value != NULL)
+    g_bytes_unref (value);
+  
+  gzochid_data_grant_free (grant);
+  g_byte_array_unref (payload);
+  waiter_free (waiter);
+}
+
+/* 
+   Returns `TRUE' if a node other than the specified node is waiting for a write
+   lock on the specified key, queued on the specified lockable store ahead of 
+   the specified waiter link (or anywhere in the queue, if the link is 
+   `NULL'), `FALSE' otherwise. The caller must hold the store's mutex.
+
+   Read locks are shared and may be leased for a long time, so requests for new
+   read locks that arrive while a writer is waiting are queued behind it rather
+   than granted; otherwise a steady stream of readers could starve the writer 
+   indefinitely.
+*/
+
+static gboolean
+has_queued_writer (gzochi_metad_dataserver_lockable_store *store,
+		   GList *waiter_link, guint node_id, GBytes *key)
+{
+  GList *link = store->waiters->head;
+
+  for (; link != NULL && link != waiter_link; link = link->next)
+    {
+      gzochi_metad_dataserver_waiter *waiter = link->data;
+
+      if (!waiter->range && waiter->for_write && waiter->node_id != node_id
+	  && g_bytes_equal (waiter->key, key))
+	return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* 
+   Attempts to obtain the locks requested by the waiters queued on the 
+   specified lockable store, in the order in which they were queued. The 
+   waiters whose locks are obtained are removed from the queue and returned as
+   a list, which should be passed to `submit_grants' once the lockable store's
+   mutex (which the caller must hold) has been released.
+
+   The upper bounds of requested ranges are taken from the specified list of
+   range bounds, as returned by `read_range_bounds'; a range whose lower bound
+   isn't in the list (because it was requested after the list was read) keeps
+   the upper bound read when it was requested.
+*/
+
+static GList *
+grant_waiting_requests (gzochi_metad_dataserver_lockable_store *store,
+			GList *bounds)
+{
+  GList *grants = NULL;
+  GList *waiter_link = store->waiters->head;
+
+  while (waiter_link != NULL)
+    {
+      GList *next_link = waiter_link->next;
+      gzochi_metad_dataserver_waiter *waiter = waiter_link->data;
+      gboolean granted = FALSE;
+      
+      if (waiter->range)
+	{
+	  /* The range's upper bound may have changed since the request was 
+	     denied. */
+
+	  gzochi_metad_dataserver_range_bound *bound =
+	    find_range_bound (bounds, waiter->key);
+
+	  if (bound != NULL)
+	    {
+	      if (waiter->to_key != NULL)
+		g_bytes_unref (waiter->to_key);
+	      waiter->to_key = bound->to_key == NULL
+		? NULL : g_bytes_ref (bound->to_key);
+	    }
+	  
+	  granted = gzochid_lock_range_check_and_set
+	    (store->locks, waiter->node_id, waiter->key, waiter->to_key, NULL);
+	}
+      else if (waiter->for_write
+	       || !has_queued_writer
+	       (store, waiter_link, waiter->node_id, waiter->key))
+	granted = gzochid_lock_check_and_set
+	  (store->locks, waiter->node_id, waiter->key, waiter->for_write, NULL);
+
+      if (granted)
+	{
+	  g_queue_delete_link (store->waiters, waiter_link);
+	  grants = g_list_prepend (grants, waiter);
+	}
+
+      waiter_link = next_link;
+    }
+
+  return g_list_reverse (grants);
+}
+
+/* Submits the grant for each waiter in the specified list to the request 
+   worker that handles requests for the waiter's node, and frees the list. 
+   Doing so guarantees that each grant is written to the node's socket after
+   the response that denied the lock. */
+
+static void
+submit_grants (GzochiMetadDataServer *server, GList *grants)
+{
+  GList *grant_ptr = grants;
+
+  for (; grant_ptr != NULL; grant_ptr = grant_ptr->next)
+    {
+      gzochi_metad_dataserver_waiter *waiter = grant_ptr->data;
+
+      gzochi_metad_dataserver_submit_request
+	(server, waiter->node_id, push_grant, waiter);
+    }
+
+  g_list_free (grants);
+}
+
+/* 
+   Returns the waiter queued on the specified lockable store by the specified
+   node for the same lock - a point lock (or a range lock, if `range' is 
+   `TRUE') on the specified key - or `NULL' if the node has no such waiter. The
+   caller must hold the store's mutex.
+
+   A node that repeats a denied request (e.g., on retry) must not be queued a
+   second time for the same lock, since each waiter results in a separate grant
+   being pushed to the node, and the lock's holders being asked to release it 
+   again.
+*/
+
+static gzochi_metad_dataserver_waiter *
+find_waiter (gzochi_metad_dataserver_lockable_store *store, guint node_id,
+	     gboolean range, GBytes *key)
+{
+  GList *link = store->waiters->head;
+
+  for (; link != NULL; link = link->next)
+    {
+      gzochi_metad_dataserver_waiter *waiter = link->data;
+
+      if (waiter->node_id == node_id && waiter->range == range
+	  && gzochid_util_bytes_compare_null_first (waiter->key, key) == 0)
+	return waiter;
+    }
+
+  return NULL;
 }
 
 gzochid_data_reserve_oids_response *
@@ -374,11 +1137,16 @@ gzochi_metad_dataserver_reserve_oids (GzochiMetadDataServer *server,
   gzochid_data_reserve_oids_response *response = NULL;
   gzochi_metad_dataserver_application_store *app_store =
     ensure_open_application_store (server, app);
+  gboolean reserved = FALSE;
 
   gzochid_trace ("Node %d requested oid block for %s.", node_id, app);
+
+  g_mutex_lock (&app_store->mutex);
+  reserved = gzochid_oids_reserve_block
+    (app_store->oid_strategy, &oids_block, NULL);
+  g_mutex_unlock (&app_store->mutex);
   
-  assert (gzochid_oids_reserve_block
-	  (app_store->oid_strategy, &oids_block, NULL));
+  assert (reserved);
 
   gzochid_trace ("Reserved block { %" G_GUINT64_FORMAT ", %d } for node %d/%s.",
 		 oids_block.block_start, oids_block.block_size, node_id, app);
@@ -402,7 +1170,9 @@ gzochi_metad_dataserver_request_value (GzochiMetadDataServer *server,
     (app_store, store_name, &local_err);
   
   struct timeval most_recent_lock;
-
+  gboolean granted = FALSE;
+  revocation_context revocations = { app, store_name, NULL };
+  
   if (store == NULL)
     {
       g_propagate_error (err, local_err);
@@ -415,30 +1185,58 @@ gzochi_metad_dataserver_request_value (GzochiMetadDataServer *server,
        ("Node %d requested %s lock on key %s/%s/%s.", node_id,
 	LOCK_ACCESS (for_write), app, store_name, buf));
   
-  if (gzochid_lock_check_and_set
-      (store->locks, node_id, key, for_write, &most_recent_lock))
-    {
-      size_t data_len = 0;
-      gzochid_storage_transaction *transaction = STORAGE_INTERFACE (server)
-	->transaction_begin (app_store->storage_context);
-      char *data = STORAGE_INTERFACE (server)->transaction_get
-	(transaction, store->store, (char *) g_bytes_get_data (key, NULL),
-	 g_bytes_get_size (key), &data_len);
+  g_mutex_lock (&store->mutex);
 
-      if (data != NULL)
+  if (for_write || gzochid_lock_check (store->locks, node_id, key, FALSE)
+      || !has_queued_writer (store, NULL, node_id, key))
+    granted = gzochid_lock_check_and_set
+      (store->locks, node_id, key, for_write, &most_recent_lock);
+
+  if (!granted)
+    {
+      gzochi_metad_dataserver_waiter *waiter =
+	find_waiter (store, node_id, FALSE, key);
+
+      /* Queue the request to be granted once the conflicting locks have been
+	 released, and ask their holders to release them. (A read request 
+	 queued behind a waiting writer may not conflict with any held lock, in
+	 which case there's nothing to revoke.) If the node is already waiting
+	 for the lock, its holders have already been asked to release it; a 
+	 repeated request only upgrades the queued request's access, if 
+	 necessary. */
+
+      if (waiter == NULL)
+	{
+	  g_queue_push_tail
+	    (store->waiters, waiter_new
+	     (node_id, app, store_name, app_store, store, FALSE, for_write, key,
+	      NULL));
+	  gzochid_lock_foreach_conflict
+	    (store->locks, node_id, key, for_write, collect_revocation,
+	     &revocations);
+	}
+      else if (for_write && !waiter->for_write)
 	{
-	  GBytes *data_bytes = g_bytes_new_with_free_func
-	    (data, data_len, (GDestroyNotify) free, data);
-	  response = gzochid_data_response_new
-	    (app, store_name, TRUE, data_bytes);
+	  waiter->for_write = TRUE;
+	  gzochid_lock_foreach_conflict
+	    (store->locks, node_id, key, for_write, collect_revocation,
+	     &revocations);
+	}
+    }
+  
+  g_mutex_unlock (&store->mutex);
+  
+  if (granted)
+    {
+      GBytes *data = read_value (server, app_store, store, key);
 
-	  /* Turn ownership of the data over to the response object. */
+      response = gzochid_data_response_new (app, store_name, TRUE, data);
 
-	  g_bytes_unref (data_bytes);
-	}
-      else response = gzochid_data_response_new (app, store_name, TRUE, NULL);
+      if (data != NULL)
 
-      STORAGE_INTERFACE (server)->transaction_rollback (transaction);
+	/* Turn ownership of the data over to the response object. */
+
+	g_bytes_unref (data);
 
       if (gzochid_log_level_visible (G_LOG_DOMAIN, GZOCHID_LOG_LEVEL_TRACE))
 	GZOCHID_WITH_FORMATTED_BYTES
@@ -455,8 +1253,16 @@ gzochi_metad_dataserver_request_value (GzochiMetadDataServer *server,
 	  (key, buf, 33, g_debug ("Denied %s lock on key %s/%s/%s to node %d.",
 				  LOCK_ACCESS (for_write), app, store_name, buf,
 				  node_id));
+
+      submit_revocations (server, revocations.notifications);
+
+      /* A zero timeout indicates to the requesting node that the request has
+	 been queued, and that it should wait for a grant rather than retry. */
+
+      response = gzochid_data_response_new (app, store_name, FALSE, NULL);
+      response->timeout = (struct timeval) { 0, 0 };
       
-      return gzochid_data_response_new (app, store_name, FALSE, NULL);
+      return response;
     }
 }
 
@@ -476,10 +1282,8 @@ gzochi_metad_dataserver_request_next_key (GzochiMetadDataServer *server,
     (app_store, store_name, &local_err);
 
   struct timeval most_recent_lock;
-
-  size_t data_len = 0;
-  gzochid_storage_transaction *transaction = NULL;
-  char *data = NULL;
+  gboolean granted = FALSE;
+  revocation_context revocations = { app, store_name, NULL };
 
   if (store == NULL)
     {
@@ -487,39 +1291,42 @@ gzochi_metad_dataserver_request_next_key (GzochiMetadDataServer *server,
       return NULL;
     }
   
-  transaction = STORAGE_INTERFACE (server)->transaction_begin
-    (app_store->storage_context);
-  
   if (key == NULL)
-    {
-      gzochid_trace ("Node %d requested range lock on %s/%s keyspace.", node_id,
-		     app, store_name);
-      data = STORAGE_INTERFACE (server)->transaction_first_key
-	(transaction, store->store, &data_len);
-    }
-  else
-    {
-      if (gzochid_log_level_visible (G_LOG_DOMAIN, GZOCHID_LOG_LEVEL_TRACE))
-	GZOCHID_WITH_FORMATTED_BYTES
-	  (key, buf, 33, gzochid_trace
-	   ("Node %d requested range lock from key %s/%s/%s.", node_id, app,
-	    store_name, buf));
-	   
-      data = STORAGE_INTERFACE (server)->transaction_next_key
-	(transaction, store->store, (char *) g_bytes_get_data (key, NULL),
-	 g_bytes_get_size (key), &data_len);
-    }
-  
-  assert (!transaction->rollback);
+    gzochid_trace ("Node %d requested range lock on %s/%s keyspace.", node_id,
+		   app, store_name);
+  else if (gzochid_log_level_visible (G_LOG_DOMAIN, GZOCHID_LOG_LEVEL_TRACE))
+    GZOCHID_WITH_FORMATTED_BYTES
+      (key, buf, 33, gzochid_trace
+       ("Node %d requested range lock from key %s/%s/%s.", node_id, app,
+	store_name, buf));
+
+  to_key = read_next_key (server, app_store, store, key);
   
-  if (data != NULL)
-    to_key = g_bytes_new_with_free_func
-      (data, data_len, (GDestroyNotify) free, data);
+  g_mutex_lock (&store->mutex);
+  granted = gzochid_lock_range_check_and_set
+    (store->locks, node_id, key, to_key, &most_recent_lock);
 
-  STORAGE_INTERFACE (server)->transaction_rollback (transaction);
+  if (!granted)
+    {
+      /* As above, queue the request and ask the holders of the conflicting 
+	 locks to release them, unless the node is already waiting for the 
+	 same range. */
 
-  if (!gzochid_lock_range_check_and_set
-      (store->locks, node_id, key, to_key, &most_recent_lock))
+      if (find_waiter (store, node_id, TRUE, key) == NULL)
+	{
+	  g_queue_push_tail
+	    (store->waiters, waiter_new
+	     (node_id, app, store_name, app_store, store, TRUE, TRUE, key,
+	      to_key));
+	  gzochid_lock_range_foreach_conflict
+	    (store->locks, node_id, key, to_key, collect_revocation,
+	     &revocations);
+	}
+    }
+
+  g_mutex_unlock (&store->mutex);
+  
+  if (!granted)
     {
       if (key == NULL)
 	g_debug ("Denied range lock on %s/%s keyspace to node %d.", app,
@@ -529,8 +1336,11 @@ gzochi_metad_dataserver_request_next_key (GzochiMetadDataServer *server,
 	  (key, buf, 33, g_debug
 	   ("Denied range lock starting at %s/%s/%s to node %d.", app,
 	    store_name, buf, node_id));
+
+      submit_revocations (server, revocations.notifications);
       
       response = gzochid_data_response_new (app, store_name, FALSE, NULL);
+      response->timeout = (struct timeval) { 0, 0 };
     }
   else
     {
@@ -563,11 +1373,19 @@ gzochi_metad_dataserver_process_changeset (GzochiMetadDataServer *server,
   gboolean needs_rollback = FALSE;
   gzochi_metad_dataserver_application_store *app_store =
     ensure_open_application_store (server, changeset->app);
-  gzochid_storage_transaction *transaction =
-    STORAGE_INTERFACE (server)->transaction_begin (app_store->storage_context);
+  gzochid_storage_transaction *transaction = NULL;
 
   gzochid_trace ("Processing %d changes from %d/%s.", changeset->changes->len,
 		 node_id, changeset->app);
+
+  /* Changesets for the same application are committed one at a time, as they 
+     would be if they had all arrived on a single thread; concurrent write 
+     transactions may otherwise fail with storage-level (e.g., page lock) 
+     conflicts that the submitting node has no way to retry. */
+  
+  g_mutex_lock (&app_store->mutex);
+  transaction = STORAGE_INTERFACE (server)->transaction_begin
+    (app_store->storage_context);
   
   for (; i < changeset->changes->len; i++)
     {
@@ -576,6 +1394,7 @@ gzochi_metad_dataserver_process_changeset (GzochiMetadDataServer *server,
       GError *local_err = NULL;
       gzochi_metad_dataserver_lockable_store *store = get_lockable_store
 	(app_store, change.store, &local_err);
+      gboolean has_lock = FALSE;
 
       if (store == NULL)
 	{
@@ -584,7 +1403,11 @@ gzochi_metad_dataserver_process_changeset (GzochiMetadDataServer *server,
 	  break;
 	}
 
-      if (!gzochid_lock_check (store->locks, node_id, change.key, TRUE))
+      g_mutex_lock (&store->mutex);
+      has_lock = gzochid_lock_check (store->locks, node_id, change.key, TRUE);
+      g_mutex_unlock (&store->mutex);
+      
+      if (!has_lock)
 	{
 	  g_set_error
 	    (err, GZOCHI_METAD_DATASERVER_ERROR,
@@ -649,6 +1472,8 @@ gzochi_metad_dataserver_process_changeset (GzochiMetadDataServer *server,
 	  STORAGE_INTERFACE (server)->transaction_commit (transaction);
 	}
     }
+
+  g_mutex_unlock (&app_store->mutex);
 }
 
 void
@@ -662,7 +1487,8 @@ gzochi_metad_dataserver_release_key (GzochiMetadDataServer *server,
   GError *local_err = NULL;
   gzochi_metad_dataserver_lockable_store *store = get_lockable_store
     (app_store, store_name, &local_err);
-
+  GList *bounds = NULL, *grants = NULL;
+  
   if (local_err != NULL)
     {
       g_warning
@@ -677,7 +1503,14 @@ gzochi_metad_dataserver_release_key (GzochiMetadDataServer *server,
       (key, buf, 33, gzochid_trace ("Node id %d releasing key %s/%s/%s.",
 				    node_id, app, store_name, buf));
   
+  bounds = read_range_bounds (server, app_store, store);
+  g_mutex_lock (&store->mutex);
   gzochid_lock_release (store->locks, node_id, key);
+  grants = grant_waiting_requests (store, bounds);
+  g_mutex_unlock (&store->mutex);
+
+  free_range_bounds (bounds);
+  submit_grants (server, grants);
 }
 
 void
@@ -692,7 +1525,8 @@ gzochi_metad_dataserver_release_range (GzochiMetadDataServer *server,
   GError *local_err = NULL;
   gzochi_metad_dataserver_lockable_store *store = get_lockable_store
     (app_store, store_name, &local_err);
-
+  GList *bounds = NULL, *grants = NULL;
+  
   if (local_err != NULL)
     {
       g_warning
@@ -711,7 +1545,54 @@ gzochi_metad_dataserver_release_range (GzochiMetadDataServer *server,
        ("Node id %d releasing range lock from %s/%s/%s.", node_id, app,
 	store_name, buf));
   
+  bounds = read_range_bounds (server, app_store, store);
+  g_mutex_lock (&store->mutex);
   gzochid_lock_release_range (store->locks, node_id, first_key, last_key);
+  grants = grant_waiting_requests (store, bounds);
+  g_mutex_unlock (&store->mutex);
+
+  free_range_bounds (bounds);
+  submit_grants (server, grants);
+}
+
+/* Releases all locks held by the specified node id in the specified lockable
+   store, discards the node's queued lock requests, and grants any waiting 
+   requests from other nodes that no longer conflict. */
+
+static void
+release_all_in_store (GzochiMetadDataServer *server,
+		      gzochi_metad_dataserver_application_store *app_store,
+		      gzochi_metad_dataserver_lockable_store *store,
+		      guint node_id)
+{
+  GList *bounds = read_range_bounds (server, app_store, store);
+  GList *grants = NULL;
+  GList *waiter_link = NULL;
+  
+  g_mutex_lock (&store->mutex);
+
+  waiter_link = store->waiters->head;
+
+  while (waiter_link != NULL)
+    {
+      GList *next_link = waiter_link->next;
+      gzochi_metad_dataserver_waiter *waiter = waiter_link->data;
+
+      if (waiter->node_id == node_id)
+	{
+	  g_queue_delete_link (store->waiters, waiter_link);
+	  waiter_free (waiter);
+	}
+
+      waiter_link = next_link;
+    }
+  
+  gzochid_lock_release_all (store->locks, node_id);
+  grants = grant_waiting_requests (store, bounds);
+  g_mutex_unlock (&store->mutex);
+
+  free_range_bounds (bounds);
+  submit_grants (server, grants);
 }
 
 void
@@ -721,15 +1602,18 @@ gzochi_metad_dataserver_release_all (GzochiMetadDataServer *server,
   GHashTableIter iter;
   gpointer value = NULL;
 
+  g_mutex_lock (&server->application_stores_mutex);
   g_hash_table_iter_init (&iter, server->application_stores);
 
   while (g_hash_table_iter_next (&iter, NULL, &value))
     {
       gzochi_metad_dataserver_application_store *store = value;
 
-      gzochid_lock_release_all (store->oids->locks, node_id);
-      gzochid_lock_release_all (store->names->locks, node_id);
+      release_all_in_store (server, store, store->oids, node_id);
+      release_all_in_store (server, store, store->names, node_id);
     }
+
+  g_mutex_unlock (&server->application_stores_mutex);
 }
 
 GQuark
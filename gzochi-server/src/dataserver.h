@@ -23,6 +23,7 @@
 
 #include "data-protocol.h"
 #include "oids.h"
+#include "socket.h"
 
 /* The core data server type definitions. */
 
@@ -79,6 +80,41 @@ void gzochi_metad_dataserver_start (GzochiMetadDataServer *);
 
 void gzochi_metad_dataserver_stop (GzochiMetadDataServer *);
 
+/* A request execution function, invoked on a data server request worker thread
+   with the data server and the request data. */
+
+typedef void (*gzochi_metad_dataserver_request_worker)
+(GzochiMetadDataServer *, gpointer);
+
+/* 
+   Submits the specified request execution function and data to the specified
+   data server for execution on one of its request worker threads, and returns
+   immediately. 
+
+   Requests are assigned to workers by the specified partition key. Requests 
+   with the same partition key are executed serially, in submission order;
+   requests with different partition keys may be executed concurrently. If the
+   data server has not been started (or has been stopped) the request is 
+   executed synchronously in the calling thread.
+*/
+
+void gzochi_metad_dataserver_submit_request
+(GzochiMetadDataServer *, guint64, gzochi_metad_dataserver_request_worker,
+ gpointer);
+
+/* Registers the specified client socket as the connection to the node with 
+   the specified id, so that the data server can push lock revocations and 
+   grants to it. */
+
+void gzochi_metad_dataserver_server_connected
+(GzochiMetadDataServer *, guint, gzochid_client_socket *);
+
+/* Unregisters the connection to the node with the specified id. Lock grants
+   made to the node after it has disconnected are released immediately. */
+
+void gzochi_metad_dataserver_server_disconnected
+(GzochiMetadDataServer *, guint);
+
 /* Requests from the specified data server on behalf of the specified node id a
    block of unallocated object ids for the specified application, and returns a
    `gzochid_data_reserve_oids_response' (which should be freed via 
@@ -88,12 +124,19 @@ void gzochi_metad_dataserver_stop (GzochiMetadDataServer *);
 gzochid_data_reserve_oids_response *gzochi_metad_dataserver_reserve_oids
 (GzochiMetadDataServer *, guint, const char *);
 
-/* Requests from the specified data server on behalf of the specified node id
+/* 
+   Requests from the specified data server on behalf of the specified node id
    the value with the specified key in one of the specified application's 
    persistent stores (optionally locking it for write) and returns a 
    `gzochid_data_response' (which should be freed via 
    `gzochid_data_response_free' when no longer necessary) describing the
-   outcome of the request. */
+   outcome of the request. 
+
+   If the lock cannot be obtained because of conflicting locks held by other
+   nodes, the request is queued and the holders of those locks are asked to 
+   release them; once they have, the lock is granted to the requesting node and
+   a `GZOCHID_DATA_PROTOCOL_VALUE_GRANT' message is pushed to it.
+*/
 
 gzochid_data_response *gzochi_metad_dataserver_request_value
 (GzochiMetadDataServer *, guint, const char *, const char *, GBytes *, gboolean,
@@ -103,7 +146,9 @@ gzochid_data_response *gzochi_metad_dataserver_request_value
    the key that immediately follows the specified key in one of the specified 
    application's persistent stores and returns a `gzochid_data_response' 
    (which should be freed via `gzochid_data_response_free' when no longer 
-   necessary) describing the outcome of the request. */
+   necessary) describing the outcome of the request. Denied requests are queued
+   as described above, and granted via `GZOCHID_DATA_PROTOCOL_NEXT_KEY_GRANT'
+   messages. */
 
 gzochid_data_response *gzochi_metad_dataserver_request_next_key
 (GzochiMetadDataServer *, guint, const char *, const char *, GBytes *,
@@ -29,6 +29,9 @@
 
 #include "descriptor.h"
 
+#define DEFAULT_MAX_BATCH_MESSAGES 32
+#define DEFAULT_MAX_BATCH_BYTES 16384
+
 struct _descriptor_builder_context
 {
   GList *hierarchy;
@@ -66,6 +69,33 @@ to_module_name (const gchar *module_name_str)
   return module_name;
 }
 
+/* Parses the specified attribute value as a positive integer, setting an error
+   and returning zero if the value is not a positive integer. Returns the 
+   specified default value if the attribute value is `NULL'. */
+
+static unsigned int
+parse_positive_int_attribute (const gchar *attribute_name,
+			      const gchar *attribute_value, unsigned int def,
+			      GError **error)
+{
+  gchar *end = NULL;
+  guint64 value = 0;
+  
+  if (attribute_value == NULL)
+    return def;
+
+  value = g_ascii_strtoull (attribute_value, &end, 10);
+
+  if (*end != 0 || value == 0 || value > G_MAXUINT)
+    {
+      *error = g_error_new
+	(G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+	 "Attribute '%s' must be a positive integer.", attribute_name);
+      return 0;
+    }
+  else return value;
+}
+
 static void 
 descriptor_start_element (GMarkupParseContext *context,
 			  const gchar *element_name,
@@ -133,6 +163,26 @@ descriptor_start_element (GMarkupParseContext *context,
 	  else descriptor->auth_type = strdup (type);
 	}
     }
+  else if (strcmp (element_name, "message-batching") == 0)
+    {
+      if (parent == NULL || strcmp (parent, "game") != 0)
+	*error = g_error_new 
+	  (G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT, 
+	   "Invalid position for 'message-batching' element.");
+      else
+	{
+	  descriptor->max_batch_messages = parse_positive_int_attribute
+	    ("max-messages", find_attribute_value
+	     ("max-messages", attribute_names, attribute_values),
+	     DEFAULT_MAX_BATCH_MESSAGES, error);
+
+	  if (*error == NULL)
+	    descriptor->max_batch_bytes = parse_positive_int_attribute
+	      ("max-bytes", find_attribute_value
+	       ("max-bytes", attribute_names, attribute_values),
+	       DEFAULT_MAX_BATCH_BYTES, error);
+	}
+    }
   else if (strcmp (element_name, "initialized") == 0
 	   || strcmp (element_name, "logged-in") == 0
 	   || strcmp (element_name, "ready") == 0)
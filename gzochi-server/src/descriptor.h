@@ -49,6 +49,14 @@ struct _GzochidApplicationDescriptor
   char *auth_type;
   GHashTable *auth_properties;
 
+  /* The bounds on the number of messages and the number of payload bytes that
+     may be delivered to a session's `received-message' handler in a single 
+     transaction when messages from that session arrive in bursts. A
+     `max_batch_messages' value of zero (the default) disables batching. */
+  
+  unsigned int max_batch_messages;
+  unsigned int max_batch_bytes;
+
   GHashTable *properties;
 };
 
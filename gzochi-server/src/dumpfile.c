@@ -0,0 +1,488 @@
+/* dumpfile.c: Binary dump file reader and writer for the gzochid tools
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "dumpfile.h"
+
+#define MAGIC "\211GZDUMP\n"
+#define MAGIC_LEN 8
+#define HEADER_LEN 12
+#define BLOCK_HEADER_LEN 16
+
+#define FORMAT_VERSION 1
+
+#define COMPRESSION_NONE 0
+#define COMPRESSION_ZLIB 1
+
+/* The size past which a block is written out. Blocks may be larger, if they
+   contain a record larger than this. */
+
+#define BLOCK_SIZE (256 * 1024)
+
+/* The maximum number of full blocks that may be queued for writing; once this
+   many are pending, `gzochid_dump_writer_put' blocks until the writer thread
+   catches up. */
+
+#define MAX_PENDING_BLOCKS 16
+
+/* The largest block a reader will accept, as a guard against corrupt block
+   headers. */
+
+#define MAX_BLOCK_SIZE (1024 * 1024 * 1024)
+
+GQuark
+gzochid_dump_error_quark (void)
+{
+  return g_quark_from_static_string ("gzochid-dump-error-quark");
+}
+
+gboolean
+gzochid_dump_file_is_binary (FILE *from)
+{
+  int c = getc (from);
+
+  if (c == EOF)
+    return FALSE;
+
+  ungetc (c, from);
+  return c == (unsigned char) MAGIC[0];
+}
+
+/* A block of records awaiting compression and writing. */
+
+struct _dump_block
+{
+  GByteArray *data; /* The encoded records. */
+  guint32 num_records; /* The number of records in `data'. */
+};
+
+typedef struct _dump_block dump_block;
+
+struct _gzochid_dump_writer
+{
+  FILE *to; /* The output stream. */
+  gboolean compress; /* Whether blocks are compressed. */
+
+  dump_block *block; /* The block being filled. */
+
+  GThread *thread; /* The thread that writes blocks to the stream. */
+  GMutex mutex; /* Protects `pending' and `closing'. */
+  GCond cond; /* Signaled when `pending' or `closing' changes. */
+  GQueue *pending; /* The queue of full blocks. */
+  gboolean closing; /* Whether there are no more blocks to come. */
+
+  /* The `errno' of the first failed write, or 0; set by the writer thread,
+     and read once it has exited. */
+
+  int error;
+};
+
+static dump_block *
+dump_block_new (void)
+{
+  dump_block *block = malloc (sizeof (dump_block));
+
+  block->data = g_byte_array_sized_new (BLOCK_SIZE + BLOCK_SIZE / 8);
+  block->num_records = 0;
+
+  return block;
+}
+
+static void
+dump_block_free (dump_block *block)
+{
+  g_byte_array_unref (block->data);
+  free (block);
+}
+
+static void
+append_uint32 (GByteArray *arr, guint32 n)
+{
+  guint32 be = GUINT32_TO_BE (n);
+  g_byte_array_append (arr, (guint8 *) &be, sizeof (guint32));
+}
+
+static guint32
+read_uint32 (const unsigned char *bytes)
+{
+  guint32 be = 0;
+
+  memcpy (&be, bytes, sizeof (guint32));
+  return GUINT32_FROM_BE (be);
+}
+
+static void
+write_bytes (gzochid_dump_writer *writer, const void *data, size_t len)
+{
+  if (writer->error == 0 && len > 0 && fwrite (data, 1, len, writer->to) < len)
+    writer->error = errno != 0 ? errno : EIO;
+}
+
+/* Compresses (if appropriate), checksums, and writes the specified block. A
+   block whose compressed form would be no smaller than its record data is
+   written uncompressed. */
+
+static void
+write_block (gzochid_dump_writer *writer, dump_block *block)
+{
+  GByteArray *header = g_byte_array_sized_new (BLOCK_HEADER_LEN);
+  unsigned char *stored = block->data->data;
+  uLongf stored_len = block->data->len;
+  unsigned char *compressed = NULL;
+
+  if (writer->compress)
+    {
+      uLongf compressed_len = compressBound (block->data->len);
+
+      compressed = malloc (compressed_len);
+
+      if (compress2 (compressed, &compressed_len, block->data->data,
+		     block->data->len, Z_BEST_SPEED) == Z_OK
+	  && compressed_len < block->data->len)
+	{
+	  stored = compressed;
+	  stored_len = compressed_len;
+	}
+    }
+
+  append_uint32 (header, block->data->len);
+  append_uint32 (header, stored_len);
+  append_uint32 (header, block->num_records);
+  append_uint32
+    (header, crc32 (crc32 (0L, Z_NULL, 0), block->data->data,
+		    block->data->len));
+
+  write_bytes (writer, header->data, header->len);
+  write_bytes (writer, stored, stored_len);
+
+  g_byte_array_unref (header);
+  free (compressed);
+}
+
+static gpointer
+writer_thread (gpointer data)
+{
+  gzochid_dump_writer *writer = data;
+
+  g_mutex_lock (&writer->mutex);
+
+  while (TRUE)
+    {
+      dump_block *block = NULL;
+
+      while (g_queue_is_empty (writer->pending) && !writer->closing)
+	g_cond_wait (&writer->cond, &writer->mutex);
+
+      if (g_queue_is_empty (writer->pending))
+	break;
+
+      block = g_queue_pop_head (writer->pending);
+      g_cond_broadcast (&writer->cond);
+      g_mutex_unlock (&writer->mutex);
+
+      write_block (writer, block);
+      dump_block_free (block);
+
+      g_mutex_lock (&writer->mutex);
+    }
+
+  g_mutex_unlock (&writer->mutex);
+
+  return NULL;
+}
+
+gzochid_dump_writer *
+gzochid_dump_writer_new (FILE *to, gboolean compress)
+{
+  gzochid_dump_writer *writer = malloc (sizeof (gzochid_dump_writer));
+  unsigned char header[HEADER_LEN - MAGIC_LEN] =
+    { FORMAT_VERSION, compress ? COMPRESSION_ZLIB : COMPRESSION_NONE, 0, 0 };
+
+  writer->to = to;
+  writer->compress = compress;
+  writer->block = dump_block_new ();
+  writer->pending = g_queue_new ();
+  writer->closing = FALSE;
+  writer->error = 0;
+
+  g_mutex_init (&writer->mutex);
+  g_cond_init (&writer->cond);
+
+  write_bytes (writer, MAGIC, MAGIC_LEN);
+  write_bytes (writer, header, HEADER_LEN - MAGIC_LEN);
+
+  writer->thread = g_thread_new ("dump-writer", writer_thread, writer);
+
+  return writer;
+}
+
+/* Hands the current block off to the writer thread, waiting for space in the
+   queue if necessary, and starts a new one. */
+
+static void
+enqueue_block (gzochid_dump_writer *writer)
+{
+  g_mutex_lock (&writer->mutex);
+
+  while (g_queue_get_length (writer->pending) >= MAX_PENDING_BLOCKS)
+    g_cond_wait (&writer->cond, &writer->mutex);
+
+  g_queue_push_tail (writer->pending, writer->block);
+  g_cond_broadcast (&writer->cond);
+  g_mutex_unlock (&writer->mutex);
+
+  writer->block = dump_block_new ();
+}
+
+void
+gzochid_dump_writer_put (gzochid_dump_writer *writer, const char *key,
+			 size_t key_len, const char *value, size_t value_len)
+{
+  GByteArray *data = writer->block->data;
+
+  append_uint32 (data, key_len);
+  append_uint32 (data, value_len);
+  g_byte_array_append (data, (const guint8 *) key, key_len);
+  g_byte_array_append (data, (const guint8 *) value, value_len);
+
+  writer->block->num_records++;
+
+  if (data->len >= BLOCK_SIZE)
+    enqueue_block (writer);
+}
+
+gboolean
+gzochid_dump_writer_close (gzochid_dump_writer *writer, GError **err)
+{
+  unsigned char terminator[BLOCK_HEADER_LEN];
+  gboolean ret = TRUE;
+
+  if (writer->block->num_records > 0)
+    enqueue_block (writer);
+
+  g_mutex_lock (&writer->mutex);
+  writer->closing = TRUE;
+  g_cond_broadcast (&writer->cond);
+  g_mutex_unlock (&writer->mutex);
+
+  g_thread_join (writer->thread);
+
+  memset (terminator, 0, BLOCK_HEADER_LEN);
+  write_bytes (writer, terminator, BLOCK_HEADER_LEN);
+
+  if (writer->error == 0 && fflush (writer->to) != 0)
+    writer->error = errno;
+
+  if (writer->error != 0)
+    {
+      g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_IO,
+		   "Failed to write dump: %s", strerror (writer->error));
+      ret = FALSE;
+    }
+
+  dump_block_free (writer->block);
+  g_queue_free (writer->pending);
+  g_mutex_clear (&writer->mutex);
+  g_cond_clear (&writer->cond);
+  free (writer);
+
+  return ret;
+}
+
+struct _gzochid_dump_reader
+{
+  FILE *from; /* The input stream. */
+
+  unsigned char *block; /* The record data of the current block. */
+  size_t block_len; /* The length of the current block's record data. */
+  size_t offset; /* The offset of the next record in the current block. */
+  guint32 remaining; /* The number of unread records in the current block. */
+
+  gboolean done; /* Whether the final block has been read. */
+};
+
+static gboolean
+read_bytes (FILE *from, void *data, size_t len, GError **err)
+{
+  if (fread (data, 1, len, from) == len)
+    return TRUE;
+
+  if (ferror (from))
+    g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_IO,
+		 "Failed to read dump: %s", strerror (errno));
+  else g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT,
+		    "Unexpected end of dump.");
+  return FALSE;
+}
+
+gzochid_dump_reader *
+gzochid_dump_reader_new (FILE *from, GError **err)
+{
+  unsigned char header[HEADER_LEN];
+  gzochid_dump_reader *reader = NULL;
+
+  if (!read_bytes (from, header, HEADER_LEN, err))
+    return NULL;
+
+  if (memcmp (header, MAGIC, MAGIC_LEN) != 0)
+    {
+      g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT,
+		   "Not a binary dump file.");
+      return NULL;
+    }
+  else if (header[MAGIC_LEN] != FORMAT_VERSION)
+    {
+      g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT,
+		   "Unsupported dump format version %d.", header[MAGIC_LEN]);
+      return NULL;
+    }
+
+  reader = calloc (1, sizeof (gzochid_dump_reader));
+  reader->from = from;
+
+  return reader;
+}
+
+/* Reads, decompresses (if necessary), and verifies the next block. Returns
+   `FALSE' and sets the error return on failure. */
+
+static gboolean
+read_block (gzochid_dump_reader *reader, GError **err)
+{
+  unsigned char header[BLOCK_HEADER_LEN];
+  guint32 block_len = 0, stored_len = 0, num_records = 0, checksum = 0;
+
+  if (!read_bytes (reader->from, header, BLOCK_HEADER_LEN, err))
+    return FALSE;
+
+  block_len = read_uint32 (header);
+  stored_len = read_uint32 (header + 4);
+  num_records = read_uint32 (header + 8);
+  checksum = read_uint32 (header + 12);
+
+  if (num_records == 0)
+    {
+      reader->done = TRUE;
+      return TRUE;
+    }
+  else if (block_len > MAX_BLOCK_SIZE || stored_len > block_len)
+    {
+      g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT,
+		   "Invalid block header.");
+      return FALSE;
+    }
+
+  free (reader->block);
+  reader->block = malloc (MAX (block_len, 1));
+  reader->block_len = block_len;
+  reader->offset = 0;
+  reader->remaining = num_records;
+
+  if (stored_len == block_len)
+    {
+      if (!read_bytes (reader->from, reader->block, block_len, err))
+	return FALSE;
+    }
+  else
+    {
+      unsigned char *stored = malloc (stored_len);
+      uLongf len = block_len;
+      int ret = Z_OK;
+
+      if (!read_bytes (reader->from, stored, stored_len, err))
+	{
+	  free (stored);
+	  return FALSE;
+	}
+
+      ret = uncompress (reader->block, &len, stored, stored_len);
+      free (stored);
+
+      if (ret != Z_OK || len != block_len)
+	{
+	  g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT,
+		       "Failed to decompress block.");
+	  return FALSE;
+	}
+    }
+
+  if (crc32 (crc32 (0L, Z_NULL, 0), reader->block, block_len) != checksum)
+    {
+      g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_CHECKSUM,
+		   "Block checksum mismatch.");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+gboolean
+gzochid_dump_reader_next (gzochid_dump_reader *reader, char **key,
+			  size_t *key_len, char **value, size_t *value_len,
+			  GError **err)
+{
+  guint32 klen = 0, vlen = 0;
+
+  while (reader->remaining == 0)
+    if (reader->done || !read_block (reader, err) || reader->done)
+      return FALSE;
+
+  if (reader->block_len - reader->offset < 8)
+    {
+      g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT,
+		   "Truncated record.");
+      return FALSE;
+    }
+
+  klen = read_uint32 (reader->block + reader->offset);
+  vlen = read_uint32 (reader->block + reader->offset + 4);
+  reader->offset += 8;
+
+  if (reader->block_len - reader->offset < (size_t) klen + vlen)
+    {
+      g_set_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT,
+		   "Truncated record.");
+      return FALSE;
+    }
+
+  *key = malloc (MAX (klen, 1));
+  memcpy (*key, reader->block + reader->offset, klen);
+  *key_len = klen;
+  reader->offset += klen;
+
+  *value = malloc (MAX (vlen, 1));
+  memcpy (*value, reader->block + reader->offset, vlen);
+  *value_len = vlen;
+  reader->offset += vlen;
+
+  reader->remaining--;
+  return TRUE;
+}
+
+void
+gzochid_dump_reader_free (gzochid_dump_reader *reader)
+{
+  free (reader->block);
+  free (reader);
+}
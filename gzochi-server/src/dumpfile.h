@@ -0,0 +1,105 @@
+/* dumpfile.h: Prototypes and declarations for dumpfile.c
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GZOCHID_DUMPFILE_H
+#define GZOCHID_DUMPFILE_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* The binary dump format used by gzochi-dump and gzochi-load is a compact
+   alternative to the Berkeley DB-style text format. A binary dump file begins
+   with a 12-byte header - the magic sequence "\211GZDUMP\n", a format version
+   byte, a compression byte, and two reserved bytes - followed by a sequence of
+   blocks. Each block consists of four big-endian 32-bit integers - the length
+   of the block's record data, the number of bytes of record data stored in the
+   file (which is less than the former if the record data is compressed), the
+   number of records in the block, and the CRC-32 checksum of the record data -
+   followed by the (possibly zlib-compressed) record data. Each record is the
+   key length and value length, as big-endian 32-bit integers, followed by the
+   key and value bytes. The last block is an empty block whose header is all
+   zeroes. */
+
+#define GZOCHID_DUMP_ERROR gzochid_dump_error_quark ()
+
+GQuark gzochid_dump_error_quark (void);
+
+enum GzochidDumpError
+  {
+    GZOCHID_DUMP_ERROR_IO, /* A read or write failed. */
+
+    /* The file is not a binary dump file, or is truncated or corrupt. */
+
+    GZOCHID_DUMP_ERROR_FORMAT,
+    GZOCHID_DUMP_ERROR_CHECKSUM /* A block's checksum did not match. */
+  };
+
+/* Returns `TRUE' if the specified stream - which must not have been read
+   from - is positioned at the start of a binary dump file, `FALSE'
+   otherwise. */
+
+gboolean gzochid_dump_file_is_binary (FILE *);
+
+/* A writer of binary dump files. Records are accumulated into blocks, which
+   are compressed, checksummed, and written by a dedicated thread, so that a
+   writer can be filled as quickly as records can be read from the database. */
+
+typedef struct _gzochid_dump_writer gzochid_dump_writer;
+
+/* Create a new dump writer that writes to the specified stream, compressing
+   blocks if the specified flag is `TRUE'. The header is written
+   immediately. */
+
+gzochid_dump_writer *gzochid_dump_writer_new (FILE *, gboolean);
+
+/* Appends the specified key and value to the specified dump writer. */
+
+void gzochid_dump_writer_put (gzochid_dump_writer *, const char *, size_t,
+			      const char *, size_t);
+
+/* Writes the remaining records and the final block to the stream and frees
+   the specified dump writer; the stream is flushed, but not closed. Returns
+   `TRUE' on success, or `FALSE' and sets the error return if any of the
+   writer's output could not be written. */
+
+gboolean gzochid_dump_writer_close (gzochid_dump_writer *, GError **);
+
+/* A reader of binary dump files. */
+
+typedef struct _gzochid_dump_reader gzochid_dump_reader;
+
+/* Create a new dump reader that reads from the specified stream, which must be
+   positioned at the start of a binary dump file. Returns `NULL' and sets the
+   error return if the header cannot be read or is invalid. */
+
+gzochid_dump_reader *gzochid_dump_reader_new (FILE *, GError **);
+
+/* Reads the next record from the specified dump reader, setting the key and
+   value arguments to copies of the record's key and value - which should be
+   freed via `free' when no longer needed - and the key and value length
+   arguments to their lengths. Returns `FALSE' at the end of the dump, or if
+   the next record cannot be read, in which case the error return is set. */
+
+gboolean gzochid_dump_reader_next (gzochid_dump_reader *, char **, size_t *,
+				   char **, size_t *, GError **);
+
+/* Frees the specified dump reader. The underlying stream is not closed. */
+
+void gzochid_dump_reader_free (gzochid_dump_reader *);
+
+#endif /* GZOCHID_DUMPFILE_H */
@@ -32,6 +32,18 @@
 
 #define PENDING_TASK_PREFIX "s.pendingTask."
 
+/* The granularity, in milliseconds, of the tick buckets into which executions
+   of periodic tasks are coalesced. A periodic task execution is dispatched at 
+   the first bucket boundary at or after its target execution time. */
+
+#define PERIODIC_TASK_TICK_MS 10
+
+/* The maximum number of executions from a tick bucket that are run together,
+   in sequence, as a single task queue entry. A bucket with more executions 
+   than this is split into chunks that the task pool can run in parallel. */
+
+#define PERIODIC_TASK_CHUNK_SIZE 32
+
 GHashTable *serialization_registry = NULL;
 
 struct _gzochid_durable_application_task
@@ -59,8 +71,95 @@ struct _gzochid_durable_application_task_handle
   gboolean repeats;
   struct timeval period;
   struct timeval target_execution_time;
+
+  /* A reference to the `periodic_task_schedule' that tracks the target time of
+     the next execution of this task, or `NULL' if the task is not periodic (or
+     was persisted before schedule records were introduced, in which case 
+     `target_execution_time' holds the target time of the next execution). */
+
+  gzochid_data_managed_reference *schedule_reference;
+};
+
+/* The mutable scheduling state of a periodic task. This is stored separately
+   from the task handle so that each execution of the task rewrites only this
+   small record instead of the entire handle. Because the record is updated in
+   the same transaction as the execution itself, each period's execution is 
+   committed exactly once, across restarts. */
+
+struct _periodic_task_schedule
+{
+  struct timeval target_execution_time;
 };
 
+typedef struct _periodic_task_schedule periodic_task_schedule;
+
+static void
+serialize_periodic_task_schedule (gzochid_application_context *context,
+				  gpointer data, GByteArray *out, GError **err)
+{
+  periodic_task_schedule *schedule = data;
+  gzochid_util_serialize_timeval (schedule->target_execution_time, out);
+}
+
+static gpointer
+deserialize_periodic_task_schedule (gzochid_application_context *context,
+				    GByteArray *in, GError **err)
+{
+  periodic_task_schedule *schedule = malloc (sizeof (periodic_task_schedule));
+
+  schedule->target_execution_time = gzochid_util_deserialize_timeval (in);
+  return schedule;
+}
+
+static void
+finalize_periodic_task_schedule (gzochid_application_context *context,
+				 gpointer data)
+{
+  free (data);
+}
+
+static gzochid_io_serialization periodic_task_schedule_serialization =
+  {
+    serialize_periodic_task_schedule,
+    deserialize_periodic_task_schedule,
+    finalize_periodic_task_schedule
+  };
+
+/* A pending periodic task execution, as recorded in the task transaction 
+   context prior to commit. */
+
+struct _periodic_task_submission
+{
+  gzochid_task *task; /* The task to execute. */
+  struct timeval period; /* The period of the task. */
+};
+
+typedef struct _periodic_task_submission periodic_task_submission;
+
+/* A tick bucket: The set of periodic task executions with the same period that
+   are due at the same tick. Until it's due, each bucket occupies a single slot
+   in the application's task queue, no matter how many executions it holds. */
+
+struct _periodic_task_bucket
+{
+  gzochid_application_context *app_context;
+  GBytes *key; /* The bucket's key in the application's bucket table. */
+  GArray *tasks; /* The `gzochid_task' executions to dispatch. */
+};
+
+typedef struct _periodic_task_bucket periodic_task_bucket;
+
+/* A run of consecutive executions from a dispatched tick bucket. */
+
+struct _periodic_task_chunk
+{
+  GArray *tasks; /* The bucket's executions; shared by all of its chunks. */
+  guint start; /* The index of the first execution in the chunk. */
+  guint end; /* The index just past the last execution in the chunk. */
+};
+
+typedef struct _periodic_task_chunk periodic_task_chunk;
+
 static int 
 task_prepare (gpointer data)
 {
@@ -101,12 +200,151 @@ static void
 cleanup_transaction (gzochid_task_transaction_context *tx_context,
 		     gboolean unref_app_tasks)
 {
+  GList *submission_ptr = tx_context->scheduled_periodic_tasks;
+
+  while (submission_ptr != NULL)
+    {
+      periodic_task_submission *submission = submission_ptr->data;
+
+      if (unref_app_tasks)
+	task_free_wrapper (submission->task);
+      else gzochid_task_free (submission->task);
+
+      free (submission);
+      submission_ptr = submission_ptr->next;
+    }
+
+  g_list_free (tx_context->scheduled_periodic_tasks);
   g_list_free_full
     (tx_context->scheduled_tasks,
      unref_app_tasks ? task_free_wrapper : (GDestroyNotify) gzochid_task_free);
   free (tx_context);
 }
 
+/* The task worker for a chunk of a tick bucket. Runs each of the chunk's 
+   executions in turn. (An execution that must be retried is resubmitted on its
+   own by its worker.) */
+
+static void
+periodic_task_chunk_worker (gpointer data, gpointer user_data)
+{
+  periodic_task_chunk *chunk = data;
+  guint i = chunk->start;
+
+  for (; i < chunk->end; i++)
+    {
+      gzochid_task *task = &g_array_index (chunk->tasks, gzochid_task, i);
+      task->worker (task->data, user_data);
+    }
+
+  g_array_unref (chunk->tasks);
+  free (chunk);
+}
+
+/* The task worker for a tick bucket. Removes the bucket from the application's
+   bucket table - so that subsequent executions with the same key start a new 
+   bucket - and then splits the bucket's executions into chunks of at most
+   `PERIODIC_TASK_CHUNK_SIZE'. Every chunk but the first is submitted to the 
+   task queue, so that large buckets are spread across the task pool; the first
+   is run on the current thread. */
+
+static void
+periodic_task_bucket_worker (gpointer data, gpointer user_data)
+{
+  periodic_task_bucket *bucket = data;
+  gzochid_application_context *app_context = bucket->app_context;
+  periodic_task_chunk *first_chunk = malloc (sizeof (periodic_task_chunk));
+  guint start = PERIODIC_TASK_CHUNK_SIZE;
+  
+  g_mutex_lock (&app_context->periodic_task_buckets_lock);
+  g_hash_table_remove (app_context->periodic_task_buckets, bucket->key);
+  g_mutex_unlock (&app_context->periodic_task_buckets_lock);
+
+  g_bytes_unref (bucket->key);
+
+  for (; start < bucket->tasks->len; start += PERIODIC_TASK_CHUNK_SIZE)
+    {
+      gzochid_task chunk_task;
+      periodic_task_chunk *chunk = malloc (sizeof (periodic_task_chunk));
+
+      chunk->tasks = g_array_ref (bucket->tasks);
+      chunk->start = start;
+      chunk->end = MIN (start + PERIODIC_TASK_CHUNK_SIZE, bucket->tasks->len);
+
+      chunk_task.worker = periodic_task_chunk_worker;
+      chunk_task.data = chunk;
+      gettimeofday (&chunk_task.target_execution_time, NULL);
+
+      gzochid_schedule_submit_task (app_context->task_queue, &chunk_task);
+    }
+
+  /* The first chunk takes over the bucket's reference to the executions. */
+  
+  first_chunk->tasks = bucket->tasks;
+  first_chunk->start = 0;
+  first_chunk->end = MIN (PERIODIC_TASK_CHUNK_SIZE, bucket->tasks->len);
+  
+  free (bucket);
+  
+  periodic_task_chunk_worker (first_chunk, user_data);
+}
+
+/* Adds the specified periodic task execution to the tick bucket for its period
+   and target execution time, creating the bucket - and submitting it to the
+   task queue - if necessary. */
+
+static void
+commit_scheduled_periodic_task (gpointer data, gpointer user_data)
+{
+  periodic_task_submission *submission = data;
+  gzochid_task_transaction_context *tx_context = user_data;
+  gzochid_application_context *app_context = tx_context->context;
+  struct timeval *target = &submission->task->target_execution_time;
+  guint64 tick_ms = ((guint64) target->tv_sec * 1000 + target->tv_usec / 1000
+		     + PERIODIC_TASK_TICK_MS - 1)
+    / PERIODIC_TASK_TICK_MS * PERIODIC_TASK_TICK_MS;
+  guint64 key_data[2];
+  GBytes *key = NULL;
+  periodic_task_bucket *bucket = NULL;
+
+  key_data[0] = (guint64) submission->period.tv_sec * G_USEC_PER_SEC
+    + submission->period.tv_usec;
+  key_data[1] = tick_ms;
+  key = g_bytes_new (key_data, sizeof (key_data));
+
+  g_mutex_lock (&app_context->periodic_task_buckets_lock);
+
+  bucket = g_hash_table_lookup (app_context->periodic_task_buckets, key);
+
+  if (bucket == NULL)
+    {
+      gzochid_task bucket_task;
+
+      bucket = malloc (sizeof (periodic_task_bucket));
+      bucket->app_context = app_context;
+      bucket->key = g_bytes_ref (key);
+      bucket->tasks = g_array_new (FALSE, FALSE, sizeof (gzochid_task));
+
+      g_hash_table_insert
+	(app_context->periodic_task_buckets, g_bytes_ref (key), bucket);
+
+      bucket_task.worker = periodic_task_bucket_worker;
+      bucket_task.data = bucket;
+      bucket_task.target_execution_time.tv_sec = tick_ms / 1000;
+      bucket_task.target_execution_time.tv_usec = (tick_ms % 1000) * 1000;
+
+      /* The bucket is submitted while the lock is held, so that it can't be
+	 dispatched before the execution below is added to it. */
+      
+      gzochid_schedule_submit_task (app_context->task_queue, &bucket_task);
+    }
+  
+  g_array_append_val (bucket->tasks, *submission->task);
+  g_mutex_unlock (&app_context->periodic_task_buckets_lock);
+
+  g_bytes_unref (key);
+}
+
 static void 
 commit_scheduled_task (gpointer task, gpointer user_data)
 {
@@ -122,6 +360,9 @@ task_commit (gpointer data)
   gzochid_task_transaction_context *tx_context = data;
 
   g_list_foreach (tx_context->scheduled_tasks, commit_scheduled_task, data);
+  g_list_foreach
+    (tx_context->scheduled_periodic_tasks, commit_scheduled_periodic_task,
+     data);
 
   cleanup_transaction (tx_context, FALSE);
 }
@@ -212,6 +453,7 @@ create_durable_task_handle
   durable_task_handle->repeats = FALSE;
   durable_task_handle->period = immediate;
   durable_task_handle->target_execution_time = target_execution_time;
+  durable_task_handle->schedule_reference = NULL;
 
   return durable_task_handle;
 }
@@ -271,6 +513,15 @@ deserialize_durable_task_handle
     handle->period = gzochid_util_deserialize_timeval (in);
 
   handle->target_execution_time = gzochid_util_deserialize_timeval (in);
+
+  /* Task handles persisted before the introduction of periodic task schedule
+     records end here. */
+  
+  if (in->len > 0 && gzochid_util_deserialize_boolean (in))
+    handle->schedule_reference = gzochid_data_create_reference_to_oid
+      (context, &periodic_task_schedule_serialization,
+       gzochid_util_deserialize_oid (in));
+  else handle->schedule_reference = NULL;
   
   free (serialization_name);
   return handle;
@@ -300,6 +551,10 @@ serialize_durable_task_handle
     gzochid_util_serialize_timeval (handle->period, out);
 
   gzochid_util_serialize_timeval (handle->target_execution_time, out);
+
+  gzochid_util_serialize_boolean (handle->schedule_reference != NULL, out);
+  if (handle->schedule_reference != NULL)
+    gzochid_util_serialize_oid (handle->schedule_reference->oid, out);
 }
 
 static void
@@ -350,6 +605,8 @@ remove_durable_task (gzochid_application_context *context, guint64 oid,
   if (task_handle->binding != NULL)
     gzochid_data_remove_binding
       (reference->context, task_handle->binding, &local_err);
+  if (local_err == NULL && task_handle->schedule_reference != NULL)
+    gzochid_data_remove_object (task_handle->schedule_reference, &local_err);
   
   if (local_err == NULL)
     {
@@ -472,12 +729,77 @@ gzochid_create_durable_application_task_handle
     }
   
   if (period != NULL)
-    return create_durable_periodic_task_handle
-      (task_data_reference, serialization, task->identity, target, *period);
+    {
+      gzochid_durable_application_task_handle *handle = NULL;
+      periodic_task_schedule *schedule =
+	malloc (sizeof (periodic_task_schedule));
+      gzochid_data_managed_reference *schedule_reference = NULL;
+
+      schedule->target_execution_time = target;
+      schedule_reference = gzochid_data_create_reference
+	(task->context, &periodic_task_schedule_serialization, schedule,
+	 &local_err);
+
+      if (local_err != NULL)
+	{
+	  free (schedule);
+	  g_propagate_error (err, local_err);
+	  return NULL;
+	}
+      
+      handle = create_durable_periodic_task_handle
+	(task_data_reference, serialization, task->identity, target, *period);
+      handle->schedule_reference = schedule_reference;
+
+      return handle;
+    }
+  
   return create_durable_task_handle
     (task_data_reference, serialization, task->identity, target);
 }
  
+/* Advances the target execution time of the specified periodic task handle by
+   one period. Only the handle's schedule record is modified; the handle itself
+   is marked for update only when it was persisted before schedule records were
+   introduced, in which case a schedule record is attached to it. */
+
+static void
+advance_periodic_task_schedule (gzochid_application_context *context,
+				gzochid_durable_application_task_handle *handle,
+				GError **err)
+{
+  GError *local_err = NULL;
+  periodic_task_schedule *schedule = NULL;
+
+  if (handle->schedule_reference == NULL)
+    {
+      schedule = malloc (sizeof (periodic_task_schedule));
+      schedule->target_execution_time = handle->target_execution_time;
+      
+      handle->schedule_reference = gzochid_data_create_reference
+	(context, &periodic_task_schedule_serialization, schedule, &local_err);
+
+      if (local_err == NULL)
+	gzochid_data_mark
+	  (context, &gzochid_durable_application_task_handle_serialization,
+	   handle, &local_err);
+      else free (schedule);
+    }
+  else schedule = gzochid_data_dereference_for_update
+	 (handle->schedule_reference, &local_err);
+
+  if (local_err == NULL)
+    {
+      timeradd (&handle->period, &schedule->target_execution_time,
+		&schedule->target_execution_time);
+      gzochid_data_mark
+	(context, &periodic_task_schedule_serialization, schedule, &local_err);
+    }
+
+  if (local_err != NULL)
+    g_propagate_error (err, local_err);
+}
+
 static void 
 durable_task_application_worker (gzochid_application_context *context, 
 				 gzochid_auth_identity *identity, gpointer data)
@@ -536,16 +858,7 @@ durable_task_application_worker (gzochid_application_context *context,
     }
   else
     {
-      struct timeval now;
-
-      gettimeofday (&now, NULL);
-      timeradd (&handle->period, 
-		&handle->target_execution_time, 
-		&handle->target_execution_time);
-
-      gzochid_data_mark 
-	(context, &gzochid_durable_application_task_handle_serialization, 
-	 handle, &err);
+      advance_periodic_task_schedule (context, handle, &err);
 
       if (err == NULL)
 	gzochid_schedule_durable_task_handle (context, handle, NULL);
@@ -653,6 +966,8 @@ void gzochid_schedule_durable_task_handle
   
   gzochid_durable_application_task *durable_task = NULL;  
   gzochid_task_transaction_context *tx_context = NULL;
+  gzochid_task *task = NULL;
+  struct timeval target_execution_time = task_handle->target_execution_time;
 
   /* The task handle pointer should already be cached in the current transaction
      since it must have been created and persisted via 
@@ -661,29 +976,46 @@ void gzochid_schedule_durable_task_handle
   
   assert (durable_task_handle_reference != NULL);
 
-  durable_task = gzochid_durable_application_task_new
-    (durable_task_handle_reference->oid);
+  if (task_handle->schedule_reference != NULL)
+    {
+      periodic_task_schedule *schedule = gzochid_data_dereference
+	(task_handle->schedule_reference, &local_err);
 
-  /* The memory allocated for this oid is freed by the cleanup task. */
-  
-  oid = g_memdup (&durable_task_handle_reference->oid, sizeof (guint64));
+      if (local_err != NULL)
+	{
+	  g_propagate_error (err, local_err);
+	  return;
+	}
 
-  task_handle->binding = create_pending_task_binding
-    (durable_task_handle_reference->oid);
-  
-  gzochid_data_set_binding_to_oid 
-    (app_context, task_handle->binding, durable_task_handle_reference->oid,
-     &local_err);
+      target_execution_time = schedule->target_execution_time;
+    }
 
-  if (local_err != NULL)
+  /* The pending task binding only needs to be written the first time the task
+     is scheduled; rescheduling a periodic task or resubmitting a task on 
+     container restart leaves it in place. */
+  
+  if (task_handle->binding == NULL)
     {
-      g_free (oid);
-      gzochid_durable_application_task_free (durable_task);      
+      task_handle->binding = create_pending_task_binding
+	(durable_task_handle_reference->oid);
+  
+      gzochid_data_set_binding_to_oid 
+	(app_context, task_handle->binding, durable_task_handle_reference->oid,
+	 &local_err);
 
-      g_propagate_error (err, local_err);
-      
-      return;
+      if (local_err != NULL)
+	{
+	  g_propagate_error (err, local_err);
+	  return;
+	}
     }
+
+  durable_task = gzochid_durable_application_task_new
+    (durable_task_handle_reference->oid);
+
+  /* The memory allocated for this oid is freed by the cleanup task. */
+  
+  oid = g_memdup (&durable_task_handle_reference->oid, sizeof (guint64));
   
   tx_context = join_transaction (app_context);
   
@@ -708,10 +1040,23 @@ void gzochid_schedule_durable_task_handle
     (app_context, task_handle->identity,
      gzochid_application_resubmitting_transactional_task_worker, execution);
 
-  tx_context->scheduled_tasks = g_list_append 
-    (tx_context->scheduled_tasks,
-     gzochid_task_new (gzochid_application_task_thread_worker,
-		       application_task, task_handle->target_execution_time));
+  task = gzochid_task_new
+    (gzochid_application_task_thread_worker, application_task,
+     target_execution_time);
+
+  if (task_handle->repeats)
+    {
+      periodic_task_submission *submission =
+	malloc (sizeof (periodic_task_submission));
+
+      submission->task = task;
+      submission->period = task_handle->period;
+      
+      tx_context->scheduled_periodic_tasks = g_list_append
+	(tx_context->scheduled_periodic_tasks, submission);
+    }
+  else tx_context->scheduled_tasks = g_list_append 
+	 (tx_context->scheduled_tasks, task);
 }
 
 /*
@@ -300,6 +300,85 @@ gzochid_transaction_event_init (GzochidTransactionEvent *self)
 {
 }
 
+/* The login event object. */
+
+struct _GzochidLoginEvent
+{
+  GzochidEvent parent_instance; /* The parent event instance. */
+  
+  guint64 duration_us; /* The authentication latency, in microseconds. */
+};
+
+/* Boilerplate setup for the login event sub-type. */
+
+G_DEFINE_TYPE (GzochidLoginEvent, gzochid_login_event, GZOCHID_TYPE_EVENT);
+
+enum gzochid_login_event_properties
+  {
+    PROP_LOGIN_EVENT_DURATION_US = 1,
+    N_LOGIN_EVENT_PROPERTIES
+  };
+
+static GParamSpec *
+login_event_properties[N_LOGIN_EVENT_PROPERTIES] = { NULL };
+
+static void
+gzochid_login_event_get_property (GObject *object, guint property_id,
+				  GValue *value, GParamSpec *pspec)
+{
+  GzochidLoginEvent *login_event = GZOCHID_LOGIN_EVENT (object);
+
+  switch (property_id)
+    {
+    case PROP_LOGIN_EVENT_DURATION_US:
+      g_value_set_uint64 (value, login_event->duration_us);
+      break;
+      
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+gzochid_login_event_set_property (GObject *object, guint property_id,
+				  const GValue *value, GParamSpec *pspec)
+{
+  GzochidLoginEvent *login_event = GZOCHID_LOGIN_EVENT (object);
+
+  switch (property_id)
+    {
+    case PROP_LOGIN_EVENT_DURATION_US:
+      login_event->duration_us = g_value_get_uint64 (value);
+      break;
+      
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+gzochid_login_event_class_init (GzochidLoginEventClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = gzochid_login_event_get_property;
+  object_class->set_property = gzochid_login_event_set_property;
+
+  login_event_properties[PROP_LOGIN_EVENT_DURATION_US] =
+    g_param_spec_uint64 ("duration-us", "duration", "", 0, G_MAXUINT64, 0,
+			 G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  g_object_class_install_properties
+    (object_class, N_LOGIN_EVENT_PROPERTIES, login_event_properties);
+}
+
+static void
+gzochid_login_event_init (GzochidLoginEvent *self)
+{
+}
+
 /* The event loop object struct. */
 
 struct _GzochidEventLoop
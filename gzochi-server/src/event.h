@@ -28,6 +28,11 @@ enum _gzochid_event_type
   {
     MESSAGE_RECEIVED, /* A message has been received from a client session. */
     MESSAGE_SENT, /* A message has been sent to a client session. */
+
+    /* A message to a client session has been discarded because the session's
+       send queue overflowed. */
+
+    MESSAGE_DROPPED,
     
     TRANSACTION_START /* An application transaction has been started. */
   };
@@ -49,11 +54,35 @@ typedef enum _gzochid_data_event_type gzochid_data_event_type;
 enum _gzochid_transaction_event_type
   {
     TRANSACTION_COMMIT, /* A transaction has been committed. */
-    TRANSACTION_ROLLBACK /* A transaction has been rolled back. */
+    TRANSACTION_ROLLBACK, /* A transaction has been rolled back. */
+
+    /* A failed transaction is going to be retried. The event's duration gives
+       the delay before the retry. */
+    
+    TRANSACTION_RETRY
   };
 
 typedef enum _gzochid_transaction_event_type gzochid_transaction_event_type;
 
+/* Enumeration of login-related event types. */
+
+enum _gzochid_login_event_type
+  {
+    /* A client has authenticated. The event's duration gives the time between
+       the receipt of the login request and the completion of 
+       authentication. */
+    
+    LOGIN_SUCCEEDED, 
+
+    LOGIN_FAILED, /* A client has failed to authenticate. */
+
+    /* A login request was refused because too many were already pending. */
+
+    LOGIN_REJECTED 
+  };
+
+typedef enum _gzochid_login_event_type gzochid_login_event_type;
+
 /* GObject type definition for base event type. */
 
 #define GZOCHID_TYPE_EVENT gzochid_event_get_type ()
@@ -149,6 +178,32 @@ GZOCHID_TRANSACTION_EVENT (gconstpointer ptr) {
 
 /* End boilerplate. */
 
+/* GObject type definition for login event sub-type. */
+
+#define GZOCHID_TYPE_LOGIN_EVENT gzochid_login_event_get_type ()
+
+/* The following boilerplate can be consolidated once GLib 2.44 makes it into
+   Debian stable and `G_DECLARE_FINAL_TYPE' can be used. */
+
+GType gzochid_login_event_get_type (void);
+
+typedef struct _GzochidLoginEvent GzochidLoginEvent;
+
+struct _GzochidLoginEventClass
+{
+  GzochidEventClass parent_class;
+};
+
+typedef struct _GzochidLoginEventClass GzochidLoginEventClass;
+
+static inline GzochidLoginEvent *
+GZOCHID_LOGIN_EVENT (gconstpointer ptr) {
+  return G_TYPE_CHECK_INSTANCE_CAST
+    (ptr, gzochid_login_event_get_type (), GzochidLoginEvent);
+}
+
+/* End boilerplate. */
+
 /* The gzochid event loop object is a lightweight wrapper around GLib's 
    `GMainLoop' and `GMainContext', to make it easy to share and inject those
    objects using gzochid's dependency injector. */
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <zlib.h>
 
 #include "app.h"
 #include "app-task.h"
@@ -37,6 +38,7 @@
 #include "sessionclient.h"
 #include "socket.h"
 #include "task.h"
+#include "threads.h"
 
 /* The `gzochid_game_protocol_closure' struct definition. */
 
@@ -45,12 +47,46 @@ struct _gzochid_game_protocol_closure
   GzochidGameServer *game_server; /* Reference to the game server. */
   gzochid_task_queue *task_queue; /* The game server's task queue. */
   struct timeval tx_timeout; /* The default task execution timeout. */
+
+  /* Flow control settings for client send queues. */
+  
+  gzochid_game_client_flow_control flow_control; 
+
+  /* The pool on which clients are authenticated, or `NULL' to authenticate 
+     them on the socket server's thread. */
+  
+  GThreadPool *auth_pool; 
+  
+  gzochid_game_client_login_control login_control; /* Login settings. */
+
+  /* The number of login requests awaiting authentication. Modified 
+     atomically. */
+  
+  volatile gint pending_logins; 
+
+  /* Protects the login rate limiter's tokens. */
+
+  GMutex login_rate_mutex; 
+
+  /* The number of authentications that may be started without waiting; may be
+     negative, in which case the authentications already waiting have used up
+     tokens that have not yet been refilled. */
+  
+  double login_tokens;
+  gint64 login_refill_us; /* When the login tokens were last refilled. */
+
+  /* The transactional workers that deliver received messages to the target
+     application, singly and in batches. */
+
+  gzochid_application_worker message_worker;
+  gzochid_application_worker message_batch_worker;
 };
 
 gzochid_game_protocol_closure *
-gzochid_game_protocol_create_closure (GzochidGameServer *game_server,
-				      gzochid_task_queue *task_queue,
-				      struct timeval tx_timeout)
+gzochid_game_protocol_create_closure
+(GzochidGameServer *game_server, gzochid_task_queue *task_queue,
+ struct timeval tx_timeout, gzochid_game_client_flow_control flow_control,
+ GThreadPool *auth_pool, gzochid_game_client_login_control login_control)
 {
   gzochid_game_protocol_closure *closure =
     malloc (sizeof (gzochid_game_protocol_closure));
@@ -58,10 +94,35 @@ gzochid_game_protocol_create_closure (GzochidGameServer *game_server,
   closure->game_server = g_object_ref (game_server);
   closure->task_queue = task_queue;
   closure->tx_timeout = tx_timeout;
+  closure->flow_control = flow_control;
+  closure->auth_pool = auth_pool;
+  closure->login_control = login_control;
+  closure->pending_logins = 0;
+
+  g_mutex_init (&closure->login_rate_mutex);
+  closure->login_tokens = MAX (login_control.burst, 1);
+  closure->login_refill_us = g_get_monotonic_time ();
+
+  closure->message_worker = gzochid_scheme_application_received_message_worker;
+  closure->message_batch_worker =
+    gzochid_scheme_application_received_messages_worker;
   
   return closure;
 }
 
+void
+gzochid_game_protocol_closure_free (gzochid_game_protocol_closure *closure)
+{
+  g_object_unref (closure->game_server);
+  g_mutex_clear (&closure->login_rate_mutex);
+  free (closure);
+}
+
+/* The protocol extensions that the server is willing to negotiate. */
+
+#define SUPPORTED_OPTIONS (GZOCHI_COMMON_PROTOCOL_OPTION_BATCH \
+			   | GZOCHI_COMMON_PROTOCOL_OPTION_COMPRESSION)
+
 /* The client struct for the game client protocol. */
 
 struct _gzochid_game_client
@@ -81,8 +142,41 @@ struct _gzochid_game_client
   gboolean disconnected; 
 
   gzochid_client_socket *sock; /* The client socket, for writes. */
+
+  /* The protocol extensions negotiated for the connection; a bitwise OR of 
+     `GZOCHI_COMMON_PROTOCOL_OPTION_' flags. */
+
+  unsigned char options;
+
+  /* Outbound session messages are gathered here - as the length-prefixed 
+     entries of a session message batch - until the client socket's thread 
+     gets around to flushing them. Only used if batching has been 
+     negotiated. */
+  
+  GByteArray *outbound_batch;
+  unsigned int outbound_batch_count; /* The number of messages gathered. */
+  gboolean flush_scheduled; /* Whether a flush has been scheduled. */
+
+  /* The most recent droppable message sent while the client was congested, if
+     the overflow policy is to coalesce them; `NULL' otherwise. */
+
+  GBytes *coalesced_message;
+
+  /* Whether the client's connection is being shut down because its send queue
+     overflowed. */
+
+  gboolean overflowed;
+
+  gboolean login_pending; /* Whether a login request is being authenticated. */
+
+  /* Protects the outbound batch, and orders writes to the client socket. */
+  
+  GMutex outbound_mutex; 
 };
 
+static void client_drained (gpointer);
+static void send_coalesced_message (gzochid_game_client *);
+
 static gzochid_client_socket *
 server_accept (GIOChannel *channel, const char *desc, gpointer data)
 {
@@ -96,6 +190,20 @@ server_accept (GIOChannel *channel, const char *desc, gpointer data)
   
   client->closure = closure;
   client->sock = sock;
+  client->outbound_batch = g_byte_array_new ();
+
+  g_mutex_init (&client->outbound_mutex);
+
+  if (closure->flow_control.high_watermark > 0)
+    gzochid_client_socket_set_watermarks
+      (sock, closure->flow_control.low_watermark,
+       closure->flow_control.high_watermark, client_drained, client);
+
+  /* Don't let clients that never log in hold on to their connections. */
+  
+  if (closure->login_control.login_timeout_ms > 0)
+    gzochid_client_socket_set_idle_timeout
+      (sock, closure->login_control.login_timeout_ms);
   
   return sock;
 }
@@ -151,13 +259,35 @@ login_catch_worker (gzochid_application_context *context,
 
 /* A `gzochid_application_worker' implementation intended for use as the 
    "cleanup" task worker for the transactional stage of the login process (see
-   below); frees the heap-allocated session oid. */
+   below); frees the heap-allocated session oid. 
+
+   The cleanup task runs once the login transaction has either succeeded or 
+   finally failed, including any retries, so it is also the place to inform 
+   the meta server (if connected) of the new session: If the client is *still*
+   present in the client-to-session oid mapping table, it's safe to assume they
+   completed the login process. */
 
 static void
 login_cleanup_worker (gzochid_application_context *context,
 		      gzochid_auth_identity *identity, gpointer data)
 {
-  g_free (data);
+  guint64 *session_oid = data;
+  
+  if (g_hash_table_contains (context->oids_to_clients, session_oid)
+      && context->metaclient != NULL)
+    {
+      GzochidSessionClient *sessionclient = NULL;
+
+      g_object_get
+	(context->metaclient, "session-client", &sessionclient, NULL);
+
+      gzochid_sessionclient_session_connected
+	(sessionclient, context->descriptor->name, *session_oid);
+      
+      g_object_unref (sessionclient);
+    }
+  
+  g_free (session_oid);
 }
 
 /* The application task worker for the login event.  */
@@ -171,7 +301,6 @@ logged_in_task (gzochid_application_context *context,
   gzochid_client_session *session = gzochid_client_session_new (identity);
   
   guint64 *session_oid = malloc (sizeof (guint64));
-  guint64 local_session_oid = 0;
   
   gzochid_application_task *login_task = NULL;
   gzochid_application_task *login_catch_task = NULL;
@@ -196,11 +325,6 @@ logged_in_task (gzochid_application_context *context,
       return;
     }
 
-  /* Useful to have a stack-local version of this id, in case it gets freed by
-     one of the cleanup handler for some task. */
-  
-  else local_session_oid = *session_oid;
-  
   login_task = gzochid_application_task_new
     (context, identity, gzochid_scheme_application_logged_in_worker,
      session_oid);
@@ -227,34 +351,19 @@ logged_in_task (gzochid_application_context *context,
 		       g_memdup (session_oid, sizeof (guint64)));
   g_mutex_unlock (&context->client_mapping_lock);
 
+  /* The first attempt runs synchronously, but a retry is resubmitted to the
+     task queue with its backoff delay, rather than sleeping through the delay
+     on this thread and stalling the logins and messages queued behind it. */
+  
   application_task = gzochid_application_task_new
     (context, gzochid_game_client_get_identity (client), 
-     gzochid_application_reexecuting_transactional_task_worker, execution);
+     gzochid_application_resubmitting_transactional_task_worker, execution);
      
   task.worker = gzochid_application_task_thread_worker;
   task.data = application_task;
   gettimeofday (&task.target_execution_time, NULL);
 
   gzochid_schedule_run_task (client->closure->task_queue, &task);
-
-  /* If after executing the login task the client is *still* present in the
-     client-to-session oid mapping table, safe to assume they've completed the
-     login process; if we're connected to a metaserver, inform it that there's
-     a new session on this application server node. */
-  
-  if (g_hash_table_contains (context->oids_to_clients, &local_session_oid)
-      && context->metaclient != NULL)
-    {
-      GzochidSessionClient *sessionclient = NULL;
-
-      g_object_get
-	(context->metaclient, "session-client", &sessionclient, NULL);
-
-      gzochid_sessionclient_session_connected
-	(sessionclient, context->descriptor->name, local_session_oid);
-      
-      g_object_unref (sessionclient);
-    }
 }
 
 /* Schedules the transactional stage of the login process. */
@@ -274,11 +383,359 @@ logged_in (gzochid_application_context *context, gzochid_game_client *client)
   gzochid_task_free (task);
 }
 
+/* Writes a frame with the specified opcode and payload to the specified 
+   client's socket. If compression has been negotiated and the payload is long
+   enough - and compresses well enough - to be worth it, the frame is wrapped 
+   in a compressed message. */
+
+static void
+write_frame (gzochid_game_client *client, unsigned char opcode,
+	     const unsigned char *payload, unsigned short len)
+{
+  unsigned char *buf = NULL;
+
+  if (client->options & GZOCHI_COMMON_PROTOCOL_OPTION_COMPRESSION
+      && len >= GZOCHI_COMMON_PROTOCOL_COMPRESSION_THRESHOLD)
+    {
+      uLongf compressed_len = compressBound (len);
+
+      buf = malloc (sizeof (unsigned char) * (compressed_len + 6));
+
+      if (compress2 (buf + 6, &compressed_len, payload, len, Z_BEST_SPEED)
+	  == Z_OK && compressed_len + 3 < len)
+	{
+	  gzochi_common_io_write_short (compressed_len + 3, buf, 0);
+	  buf[2] = GZOCHI_COMMON_PROTOCOL_COMPRESSED_MESSAGE;
+	  buf[3] = opcode;
+	  gzochi_common_io_write_short (len, buf, 4);
+
+	  gzochid_client_socket_write (client->sock, buf, compressed_len + 6);
+	  free (buf);
+	  return;
+	}
+      else free (buf);
+    }
+
+  buf = malloc (sizeof (unsigned char) * (len + 3));
+
+  gzochi_common_io_write_short (len, buf, 0);
+  buf[2] = opcode;
+  if (len > 0)
+    memcpy (buf + 3, payload, len);
+
+  gzochid_client_socket_write (client->sock, buf, len + 3);
+  free (buf);
+}
+
+/* Writes the specified client's pending outbound session messages, if any, to
+   its socket. A single pending message is written as an ordinary session 
+   message. The caller must hold the client's outbound mutex. */
+
+static void
+flush_outbound_batch (gzochid_game_client *client)
+{
+  GByteArray *batch = client->outbound_batch;
+  
+  if (client->outbound_batch_count == 1)
+    write_frame (client, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE,
+		 batch->data + 2, batch->len - 2);
+  else if (client->outbound_batch_count > 1)
+    write_frame (client, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH,
+		 batch->data, batch->len);
+
+  g_byte_array_set_size (batch, 0);
+  client->outbound_batch_count = 0;
+}
+
+/* A `GSourceFunc' that flushes the outbound batch of the specified client. */
+
+static gboolean
+flush_outbound_batch_callback (gpointer data)
+{
+  gzochid_game_client *client = data;
+
+  g_mutex_lock (&client->outbound_mutex);
+  flush_outbound_batch (client);
+  client->flush_scheduled = FALSE;
+
+  /* A droppable message may have been coalesced because the batch alone was
+     over the high watermark. If flushing the batch didn't congest the socket,
+     there'll be no drain notification to send it, so send it now. */
+
+  if (!gzochid_client_socket_is_congested (client->sock))
+    send_coalesced_message (client);
+  
+  g_mutex_unlock (&client->outbound_mutex);
+
+  return FALSE;
+}
+
+/* The `GDestroyNotify' for the flush source; releases the reference to the 
+   client socket taken when the flush was scheduled, which keeps the client 
+   alive until the flush has run. */
+
+static void
+release_client_socket (gpointer data)
+{
+  gzochid_game_client *client = data;
+  gzochid_client_socket_unref (client->sock);
+}
+
+/* Schedules a flush of the specified client's outbound batch on its socket's
+   thread. Every message sent to the client until then is coalesced into the
+   same batch frame. The caller must hold the client's outbound mutex. */
+
+static void
+schedule_outbound_flush (gzochid_game_client *client)
+{
+  GSource *source = g_idle_source_new ();
+
+  /* Run at the same priority as the socket's reads and writes, so that the 
+     flush isn't starved by a busy socket server. */
+  
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_callback
+    (source, flush_outbound_batch_callback, client, release_client_socket);
+
+  gzochid_client_socket_ref (client->sock);
+  g_source_attach
+    (source, gzochid_client_socket_get_main_context (client->sock));
+  g_source_unref (source);
+
+  client->flush_scheduled = TRUE;
+}
+
+/* Writes a frame with the specified opcode and payload to the specified 
+   client's socket after flushing any pending outbound session messages, so 
+   that control messages are never reordered with respect to them. */
+
+static void
+write_frame_in_order (gzochid_game_client *client, unsigned char opcode,
+		      const unsigned char *payload, unsigned short len)
+{
+  g_mutex_lock (&client->outbound_mutex);
+  flush_outbound_batch (client);
+  write_frame (client, opcode, payload, len);
+  g_mutex_unlock (&client->outbound_mutex);
+}
+
+/* Records the protocol extensions requested by the client, limited to those
+   supported by the server, and replies with the extensions the connection
+   will use. */
+
+static void
+dispatch_options_request (gzochid_game_client *client, unsigned char *payload,
+			  short len)
+{
+  unsigned char options = 0;
+  
+  if (len < 1)
+    {
+      g_warning
+	("Received malformed options request from client at %s",
+	 gzochid_client_socket_get_connection_description (client->sock));
+      return;
+    }
+  else if (client->identity != NULL)
+    {
+      g_warning
+	("Client with identity %s attempted to negotiate options after login",
+	 gzochid_auth_identity_name (client->identity));
+      return;
+    }
+
+  options = payload[0] & SUPPORTED_OPTIONS;
+  
+  g_mutex_lock (&client->outbound_mutex);
+  client->options = options;
+  g_mutex_unlock (&client->outbound_mutex);
+
+  write_frame_in_order
+    (client, GZOCHI_COMMON_PROTOCOL_OPTIONS_RESPONSE, &options, 1);
+}
+
+/* A login request awaiting authentication. */
+
+struct login_request
+{
+  gzochid_game_client *client; /* The client; its socket is ref'd. */
+  char *endpoint; /* The name of the target application. */
+  unsigned char *cred; /* The client's credentials. */
+  short cred_len; /* The length of the credentials. */
+  gint64 start_us; /* The monotonic time at which the request was received. */
+
+  /* The results of authentication. */
+
+  gzochid_auth_identity *identity; 
+  GError *error;
+};
+
+/* Frees the specified login request, releasing its client socket ref. */
+
+static void
+free_login_request (gpointer data)
+{
+  struct login_request *request = data;
+
+  gzochid_client_socket_unref (request->client->sock);
+  free (request->endpoint);
+  g_free (request->cred);
+  free (request);
+}
+
+/* Blocks until the login rate limit allows another authentication to start. 
+   Each caller reserves a token up front - driving the token count negative if
+   necessary - and then sleeps until that token would have been refilled, so 
+   that waiting authentications start in order at the configured rate. */
+
+static void
+wait_for_login_token (gzochid_game_protocol_closure *closure)
+{
+  gzochid_game_client_login_control *login_control = &closure->login_control;
+  gint64 now = 0, wait_us = 0;
+  
+  if (login_control->rate == 0)
+    return;
+
+  g_mutex_lock (&closure->login_rate_mutex);
+
+  now = g_get_monotonic_time ();
+  closure->login_tokens = MIN
+    (MAX (login_control->burst, 1), closure->login_tokens
+     + (now - closure->login_refill_us) * login_control->rate / 1000000.0);
+  closure->login_refill_us = now;
+  closure->login_tokens -= 1;
+
+  if (closure->login_tokens < 0)
+    wait_us = -closure->login_tokens * 1000000 / login_control->rate;
+  
+  g_mutex_unlock (&closure->login_rate_mutex);
+
+  if (wait_us > 0)
+    g_usleep (wait_us);
+}
+
+/* Passes the credentials from the specified login request to the 
+   authenticator of the target application, storing the result in the 
+   request. */
+
+static void
+authenticate (struct login_request *request)
+{
+  gzochid_application_context *app_context = request->client->app_context;
+
+  assert (app_context->authenticator != NULL);
+  request->identity = app_context->authenticator
+    (request->cred, request->cred_len, app_context->auth_data,
+     &request->error);
+
+  g_atomic_int_add (&request->client->closure->pending_logins, -1);
+}
+
+/* Dispatches a login event of the specified type to the event source of the
+   specified client's application. */
+
+static void
+dispatch_login_event (gzochid_game_client *client,
+		      gzochid_login_event_type type, guint64 duration_us)
+{
+  gzochid_event_dispatch
+    (client->app_context->event_source,
+     g_object_new (GZOCHID_TYPE_LOGIN_EVENT, "type", type, "duration-us",
+		   duration_us, NULL));
+}
+
+/* A `GSourceFunc' that acts on the outcome of the specified authenticated 
+   login request on the client socket's thread - the thread on which the rest
+   of the client's state is managed. */
+
+static gboolean
+complete_login (gpointer data)
+{
+  struct login_request *request = data;
+  gzochid_game_client *client = request->client;
+  gzochid_game_client_login_control *login_control =
+    &client->closure->login_control;
+
+  client->login_pending = FALSE;
+  
+  if (client->disconnected)
+    {
+      /* The client went away while it was being authenticated. */
+      
+      if (request->identity != NULL)
+	gzochid_auth_identity_unref (request->identity);
+      g_clear_error (&request->error);
+    }
+  else if (request->identity == NULL)
+    {
+      if (request->error != NULL)
+	g_critical 
+	  ("Error from authenticator for endpoint '%s': %s", request->endpoint,
+	   request->error->message);
+      else g_warning 
+	     ("Client at %s failed to authenticate to endpoint %s", 
+	      gzochid_client_socket_get_connection_description (client->sock),
+	      request->endpoint);
+
+      g_clear_error (&request->error);
+
+      /* Give the client the rest of its login timeout to try again. */
+      
+      gzochid_client_socket_set_idle_timeout
+	(client->sock, login_control->login_timeout_ms);
+      dispatch_login_event (client, LOGIN_FAILED, 0);
+    }
+  else 
+    {
+      client->identity = request->identity;
+      
+      g_message
+	("Client at %s authenticated to endpoint %s as %s",
+	 gzochid_client_socket_get_connection_description (client->sock),
+	 request->endpoint, gzochid_auth_identity_name (client->identity));
+
+      gzochid_client_socket_set_idle_timeout
+	(client->sock, login_control->idle_timeout_ms);
+      dispatch_login_event
+	(client, LOGIN_SUCCEEDED, g_get_monotonic_time () - request->start_us);
+      
+      logged_in (client->app_context, client);
+    }
+
+  return FALSE;
+}
+
+/* A `gzochid_thread_worker' that authenticates the specified login request on
+   a thread of the authentication pool, and then hands the request back to the
+   client socket's thread for completion. */
+
+static void
+authenticate_worker (gpointer data, gpointer user_data)
+{
+  struct login_request *request = data;
+  GSource *source = g_idle_source_new ();
+
+  /* The rate limiter may sleep, so it's only consulted here, where doing so 
+     holds up the authentication pool rather than the socket server. */
+  
+  wait_for_login_token (request->client->closure);
+  authenticate (request);
+
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_callback (source, complete_login, request, free_login_request);
+  g_source_attach
+    (source, gzochid_client_socket_get_main_context (request->client->sock));
+  g_source_unref (source);
+}
+
 static void 
 dispatch_login_request (gzochid_game_client *client, char *endpoint,
 			unsigned char *cred, short cred_len)
 {
-  GError *error = NULL;
+  gzochid_game_protocol_closure *closure = client->closure;
+  struct login_request *request = NULL;
+  gint pending = 0;
 
   if (client->identity != NULL)
     {
@@ -287,6 +744,13 @@ dispatch_login_request (gzochid_game_client *client, char *endpoint,
 	 gzochid_auth_identity_name (client->identity));
       return;
     }
+  else if (client->login_pending)
+    {
+      g_warning
+	("Client at %s sent a login request while another was pending",
+	 gzochid_client_socket_get_connection_description (client->sock));
+      return;
+    }
 
   client->app_context = gzochid_game_server_lookup_application
     (client->closure->game_server, endpoint);
@@ -302,31 +766,51 @@ dispatch_login_request (gzochid_game_client *client, char *endpoint,
       return;
     }
 
-  assert (client->app_context->authenticator != NULL);
-  client->identity = client->app_context->authenticator 
-    (cred, cred_len, client->app_context->auth_data, &error);
- 
-  if (client->identity == NULL)
+  /* Refuse the login outright if too many are already waiting; the client can
+     try again once the storm has passed. */
+  
+  pending = g_atomic_int_add (&closure->pending_logins, 1);
+  if (closure->login_control.max_pending > 0
+      && (unsigned int) pending >= closure->login_control.max_pending)
     {
-      if (error != NULL)
-	g_critical 
-	  ("Error from authenticator for endpoint '%s': %s", endpoint,
-	   error->message);
-      else g_warning 
-	     ("Client at %s failed to authenticate to endpoint %s", 
-	      gzochid_client_socket_get_connection_description (client->sock),
-	      endpoint);
+      g_atomic_int_add (&closure->pending_logins, -1);
+      
+      g_message
+	("Refusing login request from client at %s; %d logins pending.",
+	 gzochid_client_socket_get_connection_description (client->sock),
+	 pending);
 
-      g_clear_error (&error);
+      dispatch_login_event (client, LOGIN_REJECTED, 0);
+      gzochid_game_client_login_failure (client);
+      return;
     }
-  else 
+
+  request = malloc (sizeof (struct login_request));
+  
+  request->client = client;
+  request->endpoint = strdup (endpoint);
+  request->cred = g_memdup (cred, cred_len);
+  request->cred_len = cred_len;
+  request->start_us = g_get_monotonic_time ();
+  request->identity = NULL;
+  request->error = NULL;
+
+  /* The client has done its part; don't time it out while it waits for 
+     authentication. The socket ref keeps the client alive until the request
+     has been completed. */
+  
+  client->login_pending = TRUE;
+  gzochid_client_socket_set_idle_timeout (client->sock, 0);
+  gzochid_client_socket_ref (client->sock);
+  
+  if (closure->auth_pool == NULL)
     {
-      g_message
-	("Client at %s authenticated to endpoint %s as %s",
-	 gzochid_client_socket_get_connection_description (client->sock),
-	 endpoint, gzochid_auth_identity_name (client->identity));
-      logged_in (client->app_context, client);
+      authenticate (request);
+      complete_login (request);
+      free_login_request (request);
     }
+  else gzochid_thread_pool_push
+	 (closure->auth_pool, authenticate_worker, request, NULL);
 }
 
 /* Schedules the transactional stage of the disconnect process. */
@@ -404,8 +888,12 @@ disconnected (gzochid_application_context *context, gzochid_game_client *client)
 	  g_hash_table_remove (context->oids_to_clients, session_oid);
 	  g_hash_table_remove (context->clients_to_oids, client);
 	}
+
+      /* Submit the disconnect task in the session's execution lane, so that it
+	 runs after any messages from the session that are still pending. */
       
-      gzochid_schedule_submit_task (client->closure->task_queue, &task);
+      gzochid_schedule_submit_task_with_affinity
+	(client->closure->task_queue, *session_oid_copy, &task);
 
       g_mutex_unlock (&context->client_mapping_lock);
     }
@@ -439,11 +927,147 @@ cleanup_received_message_arguments (gzochid_application_context *context,
   free (args);
 }
 
-/* Schedules the transactional stage of the "received message" process. */
+/* Creates an execution of the transactional stage of the "received message" 
+   process, using the specified worker to deliver the message payload in the 
+   specified worker data (which will be disposed of by the specified cleanup 
+   worker). If the specified catch worker is non-`NULL', it is run if the
+   delivery transaction finally fails. */
+
+static gzochid_transactional_application_task_execution *
+create_received_message_execution (gzochid_application_context *context,
+				   gzochid_auth_identity *identity,
+				   gzochid_application_worker worker,
+				   gzochid_application_worker catch_worker,
+				   gzochid_application_worker cleanup_worker,
+				   gpointer data, struct timeval tx_timeout)
+{
+  gzochid_application_task *transactional_task = gzochid_application_task_new
+    (context, identity, worker, data);
+  gzochid_application_task *catch_task = catch_worker == NULL ? NULL
+    : gzochid_application_task_new (context, identity, catch_worker, data);
+  gzochid_application_task *cleanup_task = gzochid_application_task_new
+    (context, identity, cleanup_worker, data);
+  gzochid_transactional_application_task_execution *execution =
+    gzochid_transactional_application_task_timed_execution_new
+    (transactional_task, catch_task, cleanup_task, tx_timeout);
 
-static void 
-received_message (gzochid_application_context *context,
-		  gzochid_game_client *client, unsigned char *msg, short len)
+  /* Not necessary to hold a ref to these, as we've transferred them to the
+     execution. */
+  
+  gzochid_application_task_unref (transactional_task);
+  if (catch_task != NULL)
+    gzochid_application_task_unref (catch_task);
+  gzochid_application_task_unref (cleanup_task);
+
+  return execution;
+}
+
+/* Creates a task that runs the transactional stage of the "received message"
+   process (as per `create_received_message_execution') in the execution lane
+   of the session with the specified oid. The transaction is resubmitted to the
+   front of the lane if it needs to be retried, so that the session's next 
+   message can't overtake it, and so that no thread is held while the retry 
+   waits out its backoff delay. */
+
+static gzochid_task *
+create_received_message_task (gzochid_application_context *context,
+			      gzochid_auth_identity *identity,
+			      gzochid_application_worker worker,
+			      gzochid_application_worker catch_worker,
+			      gzochid_application_worker cleanup_worker,
+			      gpointer data, struct timeval tx_timeout,
+			      guint64 session_oid)
+{
+  gzochid_transactional_application_task_execution *execution =
+    create_received_message_execution
+    (context, identity, worker, catch_worker, cleanup_worker, data,
+     tx_timeout);
+
+  gzochid_transactional_application_task_execution_set_affinity
+    (execution, session_oid);
+  
+  return gzochid_task_immediate_new
+    (gzochid_application_task_thread_worker, gzochid_application_task_new
+     (context, identity,
+      gzochid_application_resubmitting_transactional_task_worker, execution));
+}
+
+/* Catch handler for the received message batch event. Flags the batch as 
+   failed, so that its messages are redelivered individually, no matter why its
+   final attempt was rolled back - a handler error, or a conflict or timeout 
+   that outlasted the batch's retries. */
+
+static void
+catch_received_message_batch (gzochid_application_context *context,
+			      gzochid_auth_identity *identity, gpointer data)
+{
+  void **args = data;
+  gboolean *failed = args[2];
+
+  *failed = TRUE;
+}
+
+/* Cleanup handler for the received message batch event. If the batch's final
+   attempt was rolled back, all of its messages were rolled back along with it;
+   they are redelivered here, each in its own transaction, so that a failing 
+   message costs only itself. The redeliveries are submitted to the front of 
+   the session's execution lane (this handler is run from it) to preserve 
+   message order. */
+
+static void
+cleanup_received_message_batch_arguments (gzochid_application_context *context,
+					  gzochid_auth_identity *identity,
+					  gpointer data)
+{
+  void **args = data;
+  GPtrArray *messages = args[1];
+  gboolean *failed = args[2];
+  gzochid_game_protocol_closure *closure = args[3];
+  
+  if (*failed)
+    {
+      guint i = messages->len;
+      guint64 session_oid = *(guint64 *) args[0];
+
+      g_debug
+	("Redelivering %u batched messages for session '%" G_GUINT64_FORMAT
+	 "' individually.", messages->len, session_oid);
+
+      /* Each redelivery goes to the front of the lane, so they're submitted in
+	 reverse order. */
+      
+      while (i > 0)
+	{
+	  void **message_args = malloc (sizeof (void *) * 2);
+	  gzochid_task *task = NULL;
+	  
+	  message_args[0] = args[0];
+	  message_args[1] = g_bytes_ref (g_ptr_array_index (messages, --i));
+
+	  task = create_received_message_task
+	    (context, identity, closure->message_worker, NULL,
+	     cleanup_received_message_arguments, message_args,
+	     closure->tx_timeout, session_oid);
+	  
+	  gzochid_schedule_submit_task_with_affinity_first
+	    (context->task_queue, session_oid, task);
+	  gzochid_task_free (task);
+	}
+    }
+  
+  /* As above, the session oid (arg 0) can't be freed here. */
+  
+  g_ptr_array_unref (messages);
+  free (failed);
+  free (args);
+}
+
+/* Returns the oid of the session mapped to the specified client, or `NULL' if
+   the client has no session. */
+
+static guint64 *
+lookup_session_oid (gzochid_application_context *context,
+		    gzochid_game_client *client)
 {
   guint64 *session_oid = NULL;
 
@@ -451,49 +1075,79 @@ received_message (gzochid_application_context *context,
   session_oid = g_hash_table_lookup (context->clients_to_oids, client);
   g_mutex_unlock (&context->client_mapping_lock);
 
+  return session_oid;
+}
+
+/* Submits the transactional stage of the "received message" process for the
+   specified client to its session's execution lane (keyed by session oid), so
+   that messages from the same session are processed one at a time, in the 
+   order in which they were received, and do not contend with each other for 
+   the session's data. The first element of the specified worker data array is
+   set to the session oid before the task is submitted. The catch worker may be
+   `NULL'. */
+
+static void 
+submit_received_message (gzochid_application_context *context,
+			 gzochid_game_client *client,
+			 gzochid_application_worker worker,
+			 gzochid_application_worker catch_worker,
+			 gzochid_application_worker cleanup_worker,
+			 void **data)
+{
+  gzochid_auth_identity *identity = gzochid_game_client_get_identity (client);
+  guint64 *session_oid = lookup_session_oid (context, client);
+
+  data[0] = session_oid;
+  
   if (session_oid == NULL)
-    return;
+    cleanup_worker (context, identity, data);
   else 
     {
-      void **data = malloc (sizeof (void *) * 2);
+      gzochid_task *task = create_received_message_task
+	(context, identity, worker, catch_worker, cleanup_worker, data,
+	 client->closure->tx_timeout, *session_oid);
       
-      gzochid_application_task *transactional_task = NULL;
-      gzochid_application_task *cleanup_task = NULL;
-      gzochid_application_task *application_task = NULL;
-      gzochid_transactional_application_task_execution *execution = NULL;
-      gzochid_task task;
+      gzochid_schedule_submit_task_with_affinity
+	(client->closure->task_queue, *session_oid, task);
+      gzochid_task_free (task);
+    }
+}
 
-      data[0] = session_oid;
-      data[1] = g_bytes_new (msg, len);
-      
-      transactional_task = gzochid_application_task_new
-	(context, gzochid_game_client_get_identity (client),
-	 gzochid_scheme_application_received_message_worker, data);
+/* Schedules the delivery of a single received message. */
 
-      cleanup_task = gzochid_application_task_new
-	(context, gzochid_game_client_get_identity (client),
-	 cleanup_received_message_arguments, data);
-      
-      execution = gzochid_transactional_application_task_timed_execution_new
-	(transactional_task, NULL, cleanup_task,
-	 client->closure->tx_timeout);
+static void 
+received_message (gzochid_application_context *context,
+		  gzochid_game_client *client, unsigned char *msg, short len)
+{
+  void **data = malloc (sizeof (void *) * 2);
 
-      /* Not necessary to hold a ref to these, as we've transferred them to the
-	 execution. */
+  data[1] = g_bytes_new (msg, len);
   
-      gzochid_application_task_unref (transactional_task);
-      gzochid_application_task_unref (cleanup_task);
-      
-      application_task = gzochid_application_task_new
-	(context, gzochid_game_client_get_identity (client),
-	 gzochid_application_resubmitting_transactional_task_worker, execution);
-      
-      task.worker = gzochid_application_task_thread_worker;
-      task.data = application_task;
-      gettimeofday (&task.target_execution_time, NULL);
+  submit_received_message
+    (context, client, client->closure->message_worker, NULL,
+     cleanup_received_message_arguments, data);
+}
 
-      gzochid_schedule_submit_task (client->closure->task_queue, &task);
-    }
+/* Schedules the delivery of the specified `GPtrArray' of `GBytes' messages in
+   a single transaction. Takes ownership of the array. */
+
+static void 
+received_message_batch (gzochid_application_context *context,
+			gzochid_game_client *client, GPtrArray *messages)
+{
+  void **data = malloc (sizeof (void *) * 4);
+  gboolean *failed = malloc (sizeof (gboolean));
+
+  *failed = FALSE;
+  
+  data[1] = messages;
+  data[2] = failed;
+  data[3] = client->closure;
+
+  submit_received_message
+    (context, client, client->closure->message_batch_worker,
+     catch_received_message_batch, cleanup_received_message_batch_arguments,
+     data);
 }
 
 static void 
@@ -543,6 +1197,8 @@ dispatch_message (gzochid_game_client *client, unsigned char *message,
       dispatch_logout_request (client); break;
     case GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE:
       dispatch_session_message (client, (unsigned char *) payload, len); break;
+    case GZOCHI_COMMON_PROTOCOL_OPTIONS_REQUEST:
+      dispatch_options_request (client, payload, len); break;
 
     default:
       g_warning ("Unexpected opcode %d received from client", opcode);
@@ -554,6 +1210,180 @@ dispatch_message (gzochid_game_client *client, unsigned char *message,
   return;
 }
 
+/* Returns `TRUE' if session messages from the specified client should be
+   batched; that is, if the client has authenticated to an application that has
+   enabled message batching in its descriptor. */
+
+static gboolean
+should_batch_messages (gzochid_game_client *client)
+{
+  return client->identity != NULL
+    && client->app_context->descriptor->max_batch_messages > 1;
+}
+
+/* Session messages gathered for delivery in a single transaction. */
+
+struct message_batch
+{
+  GPtrArray *messages; /* The `GBytes' messages, or `NULL' if none. */
+  unsigned int bytes; /* The total length of the messages. */
+};
+
+/* Schedules the delivery of the messages in the specified batch, if any, and
+   resets it. A batch that holds a single message is delivered as an ordinary
+   message. */
+
+static void
+flush_message_batch (gzochid_game_client *client, struct message_batch *batch)
+{
+  if (batch->messages == NULL)
+    return;
+  else if (batch->messages->len == 1)
+    {
+      gsize len = 0;
+      gconstpointer msg = g_bytes_get_data
+	(g_ptr_array_index (batch->messages, 0), &len);
+      
+      received_message (client->app_context, client, (unsigned char *) msg,
+			len);
+      g_ptr_array_unref (batch->messages);
+    }
+  else received_message_batch (client->app_context, client, batch->messages);
+
+  batch->messages = NULL;
+  batch->bytes = 0;
+}
+
+/* Handles a single session message from the specified client. If message 
+   batching is enabled for the client's application, the message is added to 
+   the specified batch - which is flushed once it reaches the limits specified
+   by the application descriptor; otherwise, the pending batch is flushed and 
+   the message is dispatched on its own. */
+
+static void
+receive_session_message (gzochid_game_client *client,
+			 struct message_batch *batch, unsigned char *msg,
+			 unsigned short len)
+{
+  if (should_batch_messages (client))
+    {
+      GzochidApplicationDescriptor *descriptor =
+	client->app_context->descriptor;
+      
+      gzochid_event_dispatch
+	(client->app_context->event_source,
+	 g_object_new (GZOCHID_TYPE_EVENT, "type", MESSAGE_RECEIVED, NULL));
+
+      if (batch->messages == NULL)
+	batch->messages = g_ptr_array_new_with_free_func
+	  ((GDestroyNotify) g_bytes_unref);
+
+      g_ptr_array_add (batch->messages, g_bytes_new (msg, len));
+      batch->bytes += len;
+
+      if (batch->messages->len >= descriptor->max_batch_messages
+	  || batch->bytes >= descriptor->max_batch_bytes)
+	flush_message_batch (client, batch);
+    }
+  else
+    {
+      /* Deliver any pending batch first, to preserve message order. */
+
+      flush_message_batch (client, batch);
+      dispatch_session_message (client, msg, len);
+    }
+}
+
+/* Handles each of the session messages in the specified session message batch
+   payload in turn. */
+
+static void
+receive_session_message_batch (gzochid_game_client *client,
+			       struct message_batch *batch,
+			       unsigned char *payload, unsigned short len)
+{
+  unsigned short offset = 0;
+
+  if (! (client->options & GZOCHI_COMMON_PROTOCOL_OPTION_BATCH))
+    {
+      g_warning
+	("Received session message batch from client at %s without "
+	 "negotiating batching", 
+	 gzochid_client_socket_get_connection_description (client->sock));
+      return;
+    }
+  
+  while (len - offset >= 2)
+    {
+      unsigned short msg_len = gzochi_common_io_read_short (payload, offset);
+
+      offset += 2;
+      if (msg_len > len - offset)
+	break;
+
+      receive_session_message (client, batch, payload + offset, msg_len);
+      offset += msg_len;
+    }
+
+  if (offset != len)
+    g_warning
+      ("Received malformed session message batch from client at %s",
+       gzochid_client_socket_get_connection_description (client->sock));
+}
+
+/* Decompresses the specified compressed message payload and handles the 
+   session message or session message batch within it. */
+
+static void
+receive_compressed_message (gzochid_game_client *client,
+			    struct message_batch *batch,
+			    unsigned char *payload, unsigned short len)
+{
+  unsigned char opcode = 0;
+  unsigned char *buf = NULL;
+  uLongf expected_len = 0, actual_len = 0;
+
+  if (! (client->options & GZOCHI_COMMON_PROTOCOL_OPTION_COMPRESSION))
+    {
+      g_warning
+	("Received compressed message from client at %s without negotiating "
+	 "compression",
+	 gzochid_client_socket_get_connection_description (client->sock));
+      return;
+    }
+
+  opcode = len >= 3 ? payload[0] : 0;
+  if (opcode != GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE
+      && opcode != GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH)
+    {
+      g_warning
+	("Received malformed compressed message from client at %s",
+	 gzochid_client_socket_get_connection_description (client->sock));
+      return;
+    }
+  
+  expected_len = (unsigned short) gzochi_common_io_read_short (payload, 1);
+  actual_len = expected_len;
+  buf = malloc (sizeof (unsigned char) * MAX (expected_len, 1));
+
+  if (uncompress (buf, &actual_len, payload + 3, len - 3) != Z_OK
+      || actual_len != expected_len)
+    g_warning
+      ("Failed to decompress message from client at %s",
+       gzochid_client_socket_get_connection_description (client->sock));
+  else if (opcode == GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE)
+    receive_session_message (client, batch, buf, actual_len);
+  else receive_session_message_batch (client, batch, buf, actual_len);
+
+  free (buf);
+}
+
+/* Dispatches the complete messages in the specified buffer. If message 
+   batching is enabled for the client's application, consecutive session 
+   messages - including those unpacked from session message batches and 
+   compressed messages - are gathered, up to the limits specified by the 
+   application descriptor, and delivered together in a single transaction. */
+
 static unsigned int
 client_dispatch (const GByteArray *buffer, gpointer user_data)
 {
@@ -562,8 +1392,11 @@ client_dispatch (const GByteArray *buffer, gpointer user_data)
   int offset = 0, total = 0;
   int remaining = buffer->len;
 
+  struct message_batch batch = { NULL, 0 };
+  
   while (remaining >= 3)
     {
+      unsigned char *message = NULL;
       unsigned short len = gzochi_common_io_read_short
 	((unsigned char *) buffer->data, offset);
       
@@ -571,14 +1404,35 @@ client_dispatch (const GByteArray *buffer, gpointer user_data)
 	break;
       
       offset += 2;
+      message = (unsigned char *) buffer->data + offset;
 
-      dispatch_message (client, (unsigned char *) buffer->data + offset, len);
+      switch (message[0])
+	{
+	case GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE:
+	  receive_session_message (client, &batch, message + 1, len - 1);
+	  break;
+	case GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE_BATCH:
+	  receive_session_message_batch (client, &batch, message + 1, len - 1);
+	  break;
+	case GZOCHI_COMMON_PROTOCOL_COMPRESSED_MESSAGE:
+	  receive_compressed_message (client, &batch, message + 1, len - 1);
+	  break;
+
+	default:
+
+	  /* Deliver any pending batch first, to preserve message order. */
+	  
+	  flush_message_batch (client, &batch);
+	  dispatch_message (client, message, len);
+	}
       
       offset += len;
       remaining -= len + 2;
       total += len + 2;
     }
 
+  flush_message_batch (client, &batch);
+  
   return total;
 }
 
@@ -589,6 +1443,12 @@ client_free (gpointer data)
 
   if (client->identity != NULL)
     gzochid_auth_identity_unref (client->identity);
+
+  g_byte_array_unref (client->outbound_batch);
+  if (client->coalesced_message != NULL)
+    g_bytes_unref (client->coalesced_message);
+  g_mutex_clear (&client->outbound_mutex);
+  
   free (client);
 }
 
@@ -617,37 +1477,200 @@ gzochid_game_client_get_identity (gzochid_game_client *client)
 void 
 gzochid_game_client_disconnect (gzochid_game_client *client)
 {
-  unsigned char buf[3] = 
-    { 0x0, 0x0, GZOCHI_COMMON_PROTOCOL_SESSION_DISCONNECTED };
-  gzochid_client_socket_write (client->sock, buf, 3);
+  write_frame_in_order
+    (client, GZOCHI_COMMON_PROTOCOL_SESSION_DISCONNECTED, NULL, 0);
 }
 
 void 
 gzochid_game_client_login_success (gzochid_game_client *client)
 {
-  unsigned char buf[3] = { 0x0, 0x0, GZOCHI_COMMON_PROTOCOL_LOGIN_SUCCESS };
-  gzochid_client_socket_write (client->sock, buf, 3);
+  write_frame_in_order (client, GZOCHI_COMMON_PROTOCOL_LOGIN_SUCCESS, NULL, 0);
 }
 
 void 
 gzochid_game_client_login_failure (gzochid_game_client *client)
 {
-  unsigned char buf[3] = { 0x0, 0x0, GZOCHI_COMMON_PROTOCOL_LOGIN_FAILURE };
-  gzochid_client_socket_write (client->sock, buf, 3);
+  write_frame_in_order (client, GZOCHI_COMMON_PROTOCOL_LOGIN_FAILURE, NULL, 0);
+}
+
+/* Writes the specified session message to the specified client's socket, or
+   adds it to the client's outbound batch if batching has been negotiated. The
+   caller must hold the client's outbound mutex. */
+
+static void
+enqueue_message (gzochid_game_client *client, const unsigned char *msg,
+		 unsigned short len)
+{
+  if (! (client->options & GZOCHI_COMMON_PROTOCOL_OPTION_BATCH))
+    write_frame (client, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE, msg, len);
+  else
+    {
+      GByteArray *batch = client->outbound_batch;
+      
+      /* Make room in the batch frame, if necessary. A message too long to fit
+	 in a batch frame at all is written on its own. */
+
+      if (batch->len + len + 2 > GZOCHI_COMMON_PROTOCOL_MAX_PAYLOAD_LENGTH)
+	flush_outbound_batch (client);
+
+      if (len + 2 > GZOCHI_COMMON_PROTOCOL_MAX_PAYLOAD_LENGTH)
+	write_frame (client, GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE, msg, len);
+      else
+	{
+	  unsigned char len_bytes[2];
+
+	  gzochi_common_io_write_short (len, len_bytes, 0);
+	  g_byte_array_append (batch, len_bytes, 2);
+	  g_byte_array_append (batch, msg, len);
+	  client->outbound_batch_count++;
+
+	  if (!client->flush_scheduled)
+	    schedule_outbound_flush (client);
+	}
+    }
+}
+
+/* Sends the specified client's coalesced droppable message, if there is one.
+   The caller must hold the client's outbound mutex. */
+
+static void
+send_coalesced_message (gzochid_game_client *client)
+{
+  if (client->coalesced_message != NULL)
+    {
+      GBytes *message = client->coalesced_message;
+      gsize len = 0;
+      const unsigned char *msg = g_bytes_get_data (message, &len);
+
+      client->coalesced_message = NULL;
+      if (!client->overflowed)
+	enqueue_message (client, msg, len);
+      g_bytes_unref (message);
+    }
+}
+
+/* Shuts down the connection of the specified client, whose send queue has 
+   overflowed. The client's protocol `error' callback will run the usual 
+   disconnect process once the socket server notices the shutdown. The caller
+   must hold the client's outbound mutex. */
+
+static void
+overflow (gzochid_game_client *client, size_t queue_len)
+{
+  g_message
+    ("Disconnecting client at %s; send queue length %" G_GSIZE_FORMAT 
+     " exceeds limit.",
+     gzochid_client_socket_get_connection_description (client->sock),
+     queue_len);
+  
+  client->overflowed = TRUE;
+  gzochid_client_socket_shutdown (client->sock);
+}
+
+/* The `gzochid_client_socket_drained_callback' for game client sockets. Sends
+   the coalesced droppable message, if there is one. */
+
+static void
+client_drained (gpointer data)
+{
+  gzochid_game_client *client = data;
+
+  g_mutex_lock (&client->outbound_mutex);
+  send_coalesced_message (client);
+  g_mutex_unlock (&client->outbound_mutex);
+}
+
+/* Returns the number of bytes waiting to be sent to the specified client: the
+   length of its socket's send queue, plus the messages gathered in its 
+   outbound batch. The caller must hold the client's outbound mutex. */
+
+static size_t
+send_queue_length (gzochid_game_client *client)
+{
+  return gzochid_client_socket_get_send_queue_length (client->sock)
+    + client->outbound_batch->len;
+}
+
+/* Sends the specified message to the specified client, applying the game 
+   protocol's overflow policy if the client is congested - i.e., if its socket
+   is congested, or if the messages gathered in its outbound batch would put 
+   the socket's send queue over the high watermark once flushed. */
+
+static void
+send_message (gzochid_game_client *client, const unsigned char *msg,
+	      unsigned short len, gboolean droppable)
+{
+  gzochid_game_client_flow_control *flow_control =
+    &client->closure->flow_control;
+  gboolean dropped = FALSE;
+  size_t queue_len = 0;
+  
+  g_mutex_lock (&client->outbound_mutex);
+
+  queue_len = send_queue_length (client);
+  
+  if (client->overflowed)
+    dropped = TRUE;
+  else if (flow_control->high_watermark > 0
+	   && (gzochid_client_socket_is_congested (client->sock)
+	       || queue_len > flow_control->high_watermark))
+    {
+      if (flow_control->overflow_policy
+	  == GZOCHID_GAME_CLIENT_OVERFLOW_DISCONNECT
+	  || (flow_control->max_send_queue_length > 0
+	      && queue_len > flow_control->max_send_queue_length))
+	{
+	  overflow (client, queue_len);
+	  dropped = TRUE;
+	}
+      else if (!droppable)
+	enqueue_message (client, msg, len);
+      else if (flow_control->overflow_policy
+	       == GZOCHID_GAME_CLIENT_OVERFLOW_COALESCE)
+	{
+	  if (client->coalesced_message != NULL)
+	    {
+	      g_bytes_unref (client->coalesced_message);
+	      dropped = TRUE;
+	    }
+	  client->coalesced_message = g_bytes_new (msg, len);
+	}
+      else dropped = TRUE;
+    }
+  else enqueue_message (client, msg, len);
+  
+  g_mutex_unlock (&client->outbound_mutex);
+
+  if (dropped && client->app_context != NULL)
+    gzochid_event_dispatch
+      (client->app_context->event_source,
+       g_object_new (GZOCHID_TYPE_EVENT, "type", MESSAGE_DROPPED, NULL));
 }
 
 void 
 gzochid_game_client_send
 (gzochid_game_client *client, const unsigned char *msg, unsigned short len)
 {
-  unsigned char *buf = malloc (sizeof (unsigned char) * (len + 3));
+  send_message (client, msg, len, FALSE);
+}
 
-  gzochi_common_io_write_short (len, buf, 0);
-  buf[2] = GZOCHI_COMMON_PROTOCOL_SESSION_MESSAGE;
-  memcpy (buf + 3, msg, len);
+void 
+gzochid_game_client_send_droppable
+(gzochid_game_client *client, const unsigned char *msg, unsigned short len)
+{
+  send_message (client, msg, len, TRUE);
+}
 
-  gzochid_client_socket_write (client->sock, buf, len + 3);
-  free (buf);
+size_t
+gzochid_game_client_get_send_queue_length (gzochid_game_client *client)
+{
+  return gzochid_client_socket_get_send_queue_length (client->sock);
+}
+
+gboolean
+gzochid_game_client_is_congested (gzochid_game_client *client)
+{
+  return gzochid_client_socket_is_congested (client->sock);
 }
 
 gboolean
@@ -655,3 +1678,34 @@ _gzochid_game_client_disconnected (gzochid_game_client *client)
 {
   return client->disconnected;
 }
+
+gboolean
+_gzochid_game_client_login_pending (gzochid_game_client *client)
+{
+  return client->login_pending;
+}
+
+unsigned int
+_gzochid_game_protocol_pending_logins (gzochid_game_protocol_closure *closure)
+{
+  return g_atomic_int_get (&closure->pending_logins);
+}
+
+void
+_gzochid_game_protocol_set_message_workers
+(gzochid_game_protocol_closure *closure,
+ gzochid_application_worker message_worker,
+ gzochid_application_worker message_batch_worker)
+{
+  closure->message_worker = message_worker;
+  closure->message_batch_worker = message_batch_worker;
+}
+
+void
+_gzochid_game_client_set_identity (gzochid_game_client *client,
+				   gzochid_application_context *app_context,
+				   gzochid_auth_identity *identity)
+{
+  client->app_context = app_context;
+  client->identity = identity;
+}
@@ -18,8 +18,11 @@
 #ifndef GZOCHID_GAME_PROTOCOL_H
 #define GZOCHID_GAME_PROTOCOL_H
 
+#include <stddef.h>
 #include <sys/time.h>
 
+#include "app.h"
+#include "app-task.h"
 #include "game.h"
 #include "gzochid-auth.h"
 #include "protocol.h"
@@ -42,12 +45,103 @@ extern gzochid_client_protocol gzochid_game_client_protocol;
 
 typedef struct _gzochid_game_protocol_closure gzochid_game_protocol_closure;
 
+/* The policies that may be applied to a client whose send queue has exceeded
+   its high watermark. */
+
+enum _gzochid_game_client_overflow_policy
+  {
+    /* Discard droppable messages until the send queue has drained. */
+    
+    GZOCHID_GAME_CLIENT_OVERFLOW_DROP,
+
+    /* Hold on to the most recent droppable message - discarding any older 
+       ones - and send it once the send queue has drained. */
+    
+    GZOCHID_GAME_CLIENT_OVERFLOW_COALESCE,
+
+    GZOCHID_GAME_CLIENT_OVERFLOW_DISCONNECT /* Disconnect the client. */
+  };
+
+typedef enum _gzochid_game_client_overflow_policy
+gzochid_game_client_overflow_policy;
+
+/* Flow control settings for the send queues of game clients. */
+
+struct _gzochid_game_client_flow_control
+{
+  /* The send queue length, in bytes, above which a client is considered 
+     congested; `0' disables flow control. */
+
+  size_t high_watermark;
+
+  /* The send queue length to which a congested client's send queue must drain
+     before it is considered uncongested. */
+
+  size_t low_watermark;
+
+  /* The send queue length above which a congested client is disconnected, 
+     regardless of the overflow policy; `0' for no limit. */
+
+  size_t max_send_queue_length;
+
+  /* The policy to apply to messages sent to a congested client. */
+
+  gzochid_game_client_overflow_policy overflow_policy;
+};
+
+typedef struct _gzochid_game_client_flow_control
+gzochid_game_client_flow_control;
+
+/* Settings that govern the handling of client login requests. */
+
+struct _gzochid_game_client_login_control
+{
+  /* The maximum number of login requests that may be awaiting authentication
+     at once; `0' for no limit. Login requests beyond this limit are refused 
+     with a login failure. */
+
+  unsigned int max_pending;
+
+  /* The sustained number of authentications started per second, or `0' if 
+     the login rate is not limited. Login requests in excess of the rate wait
+     in the pending queue. */
+  
+  unsigned int rate;
+  unsigned int burst; /* The maximum burst of authentications. */
+
+  /* The number of milliseconds a newly-connected client has to send a 
+     successful login request before it is disconnected; `0' for no limit. */
+
+  guint login_timeout_ms;
+
+  /* The number of milliseconds an authenticated client may go without sending
+     anything before it is disconnected; `0' for no limit. */
+  
+  guint idle_timeout_ms;
+};
+
+typedef struct _gzochid_game_client_login_control
+gzochid_game_client_login_control;
+
 /* Construct and return a new `gzochid_game_protocol_closure' around the 
-   specified `GzochidGameServer', `gzochid_task_queue', and task execution 
-   timeout value. */   
+   specified `GzochidGameServer', `gzochid_task_queue', task execution 
+   timeout value, client flow control settings, authentication thread pool, 
+   and login control settings. 
+
+   Authentication - which may block on the authentication plugin - is performed
+   on the threads of the specified pool, so that it doesn't hold up the socket
+   server. If the pool is `NULL', clients are authenticated on the socket 
+   server's thread, and the login rate limit is not enforced, since waiting 
+   for it would stall every other client of the socket server. */   
 
 gzochid_game_protocol_closure *gzochid_game_protocol_create_closure
-(GzochidGameServer *, gzochid_task_queue *, struct timeval);
+(GzochidGameServer *, gzochid_task_queue *, struct timeval,
+ gzochid_game_client_flow_control, GThreadPool *,
+ gzochid_game_client_login_control);
+
+/* Frees the specified `gzochid_game_protocol_closure'. */
+
+void gzochid_game_protocol_closure_free (gzochid_game_protocol_closure *);
 
 /* A struct representing a connected gzochi game application client. 
    `gzochid_game_client' instances are created and managed by the protocol. */
@@ -77,15 +171,63 @@ void gzochid_game_client_login_failure (gzochid_game_client *);
    65532 bytes) to the specified client. Note that this function returns once 
    the bytes have been copied to the client's send buffer; the entire payload
    may not be flushed until the associated socket is ready to write all of
-   it. */
+   it. If the client has negotiated batching, messages sent to it from any 
+   thread are coalesced into a single batch frame until the socket's thread
+   next gets around to flushing them. */
 
 void gzochid_game_client_send
 (gzochid_game_client *, const unsigned char *, unsigned short);
 
+/* Like `gzochid_game_client_send', but marks the message as droppable: If the
+   client's send queue has exceeded its high watermark, the message may be 
+   discarded or superseded by a later droppable message, according to the 
+   game protocol's overflow policy. Use this for messages - like periodic 
+   state updates - that a client can do without. */
+
+void gzochid_game_client_send_droppable
+(gzochid_game_client *, const unsigned char *, unsigned short);
+
+/* Returns the number of bytes written to the specified client that have not
+   yet been written to its socket. */
+
+size_t gzochid_game_client_get_send_queue_length (gzochid_game_client *);
+
+/* Returns `TRUE' if the specified client's send queue has exceeded its high
+   watermark and has not yet drained to its low watermark, `FALSE' 
+   otherwise. */
+
+gboolean gzochid_game_client_is_congested (gzochid_game_client *);
+
 /* Private client socket API, visible for testing only. */
 
 gboolean _gzochid_game_client_disconnected (gzochid_game_client *);
 
+/* Returns `TRUE' if the specified client's login request is awaiting
+   authentication or its completion on the client socket's thread. */
+
+gboolean _gzochid_game_client_login_pending (gzochid_game_client *);
+
+/* Returns the number of login requests handled by the specified closure that 
+   are awaiting authentication. */
+
+unsigned int _gzochid_game_protocol_pending_logins
+(gzochid_game_protocol_closure *);
+
+/* Replaces the transactional workers that the specified closure uses to 
+   deliver received messages, singly and in batches, to the target 
+   application. The batch worker must follow the contract of 
+   `gzochid_scheme_application_received_messages_worker'. */
+
+void _gzochid_game_protocol_set_message_workers
+(gzochid_game_protocol_closure *, gzochid_application_worker,
+ gzochid_application_worker);
+
+/* Binds the specified client to the specified application context and 
+   identity, as if it had logged in. */
+
+void _gzochid_game_client_set_identity
+(gzochid_game_client *, gzochid_application_context *, gzochid_auth_identity *);
+
 gzochid_client_socket *_gzochid_game_client_get_socket (gzochid_game_client *);
 
 #endif /* GZOCHID_GAME_PROTOCOL_H */
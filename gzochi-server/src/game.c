@@ -23,6 +23,7 @@
 #include <libguile.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -50,6 +51,20 @@
 
 #define DEFAULT_TX_TIMEOUT_MS 100
 
+#define DEFAULT_TX_RETRY_MAX_ATTEMPTS 3
+#define DEFAULT_TX_RETRY_BACKOFF_INITIAL_MS 5
+#define DEFAULT_TX_RETRY_BACKOFF_MAX_MS 250
+
+#define DEFAULT_CLIENT_SEND_QUEUE_HIGH_WATERMARK 1048576
+#define DEFAULT_CLIENT_SEND_QUEUE_LOW_WATERMARK 262144
+#define DEFAULT_CLIENT_SEND_QUEUE_MAX_LENGTH 16777216
+
+#define DEFAULT_AUTH_THREAD_POOL_MAX_THREADS 4
+#define DEFAULT_ACCEPT_BURST 64
+#define DEFAULT_LOGIN_BURST 64
+#define DEFAULT_LOGIN_MAX_PENDING 1024
+#define DEFAULT_CLIENT_LOGIN_TIMEOUT_MS 30000
+
 #define SERVER_FS_APPS_DEFAULT "/var/gzochid/deploy"
 #define SERVER_FS_DATA_DEFAULT "/var/gzochid/data"
 
@@ -66,6 +81,7 @@ struct _GzochidGameServer
   GObject parent_instance; /* The parent struct, for casting. */
   
   GThreadPool *pool; /* Thread pool for task queue. */
+  GThreadPool *auth_pool; /* Thread pool for client authentication. */
 
   /* Non-durable queue of tasks pending execution on behalf of running 
      applications. */
@@ -81,6 +97,24 @@ struct _GzochidGameServer
   
   struct timeval tx_timeout; /* The default timeout for transactional tasks. */
 
+  /* The default retry policy for transactional tasks. */
+
+  gzochid_application_retry_policy retry_policy; 
+
+  /* Flow control settings for the send queues of connected clients. */
+
+  gzochid_game_client_flow_control client_flow_control;
+
+  /* The maximum number of connections accepted per second, and the maximum
+     burst of connections; a rate of `0' means no limit. */
+  
+  unsigned int accept_rate;
+  unsigned int accept_burst;
+
+  /* Settings for the handling of client logins. */
+  
+  gzochid_game_client_login_control client_login_control;
+
   /* Map of application name to `gzochid_application_context'. */
 
   GHashTable *applications; 
@@ -121,6 +155,25 @@ enum gzochid_game_server_properties
 
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL };
 
+/* Parses the specified overflow policy name, returning the default policy - 
+   dropping droppable messages - if the name is `NULL' or unrecognized. */
+
+static gzochid_game_client_overflow_policy
+parse_overflow_policy (const char *name)
+{
+  if (name == NULL || strcmp (name, "drop") == 0)
+    return GZOCHID_GAME_CLIENT_OVERFLOW_DROP;
+  else if (strcmp (name, "coalesce") == 0)
+    return GZOCHID_GAME_CLIENT_OVERFLOW_COALESCE;
+  else if (strcmp (name, "disconnect") == 0)
+    return GZOCHID_GAME_CLIENT_OVERFLOW_DISCONNECT;
+  else
+    {
+      g_warning ("Unknown client send queue overflow policy '%s'.", name);
+      return GZOCHID_GAME_CLIENT_OVERFLOW_DROP;
+    }
+}
+
 static void
 game_server_constructed (GObject *obj)
 {
@@ -130,11 +183,16 @@ game_server_constructed (GObject *obj)
     (self->configuration, "game");
   int max_threads = gzochid_config_to_int 
     (g_hash_table_lookup (config, "thread_pool.max_threads"), 4);
+  int auth_max_threads = gzochid_config_to_int
+    (g_hash_table_lookup (config, "auth.thread_pool.max_threads"),
+     DEFAULT_AUTH_THREAD_POOL_MAX_THREADS);
   long tx_timeout_ms = gzochid_config_to_long 
     (g_hash_table_lookup (config, "tx.timeout"), DEFAULT_TX_TIMEOUT_MS);
        
   self->pool = gzochid_thread_pool_new (self, max_threads, TRUE, NULL);
   self->task_queue = gzochid_schedule_task_queue_new (self->pool);
+  self->auth_pool = gzochid_thread_pool_new
+    (self, auth_max_threads, FALSE, NULL);
 
   self->port = gzochid_config_to_int
     (g_hash_table_lookup (config, "server.port"), 8001);
@@ -150,6 +208,48 @@ game_server_constructed (GObject *obj)
   self->tx_timeout.tv_sec = tx_timeout_ms / 1000;
   self->tx_timeout.tv_usec = (tx_timeout_ms % 1000) * 1000;
 
+  self->retry_policy.max_attempts = gzochid_config_to_int
+    (g_hash_table_lookup (config, "tx.retry.max_attempts"),
+     DEFAULT_TX_RETRY_MAX_ATTEMPTS);
+  self->retry_policy.initial_backoff_ms = gzochid_config_to_long
+    (g_hash_table_lookup (config, "tx.retry.backoff.initial.msec"),
+     DEFAULT_TX_RETRY_BACKOFF_INITIAL_MS);
+  self->retry_policy.max_backoff_ms = gzochid_config_to_long
+    (g_hash_table_lookup (config, "tx.retry.backoff.max.msec"),
+     DEFAULT_TX_RETRY_BACKOFF_MAX_MS);
+
+  self->client_flow_control.high_watermark = gzochid_config_to_long
+    (g_hash_table_lookup (config, "client.send_queue.high_watermark"),
+     DEFAULT_CLIENT_SEND_QUEUE_HIGH_WATERMARK);
+  self->client_flow_control.low_watermark = MIN
+    (self->client_flow_control.high_watermark, gzochid_config_to_long
+     (g_hash_table_lookup (config, "client.send_queue.low_watermark"),
+      DEFAULT_CLIENT_SEND_QUEUE_LOW_WATERMARK));
+  self->client_flow_control.max_send_queue_length = gzochid_config_to_long
+    (g_hash_table_lookup (config, "client.send_queue.max_length"),
+     DEFAULT_CLIENT_SEND_QUEUE_MAX_LENGTH);
+  self->client_flow_control.overflow_policy = parse_overflow_policy
+    (g_hash_table_lookup (config, "client.send_queue.overflow_policy"));
+
+  self->accept_rate = gzochid_config_to_int
+    (g_hash_table_lookup (config, "server.accept.rate"), 0);
+  self->accept_burst = gzochid_config_to_int
+    (g_hash_table_lookup (config, "server.accept.burst"),
+     DEFAULT_ACCEPT_BURST);
+
+  self->client_login_control.max_pending = gzochid_config_to_int
+    (g_hash_table_lookup (config, "login.max_pending"),
+     DEFAULT_LOGIN_MAX_PENDING);
+  self->client_login_control.rate = gzochid_config_to_int
+    (g_hash_table_lookup (config, "login.rate"), 0);
+  self->client_login_control.burst = gzochid_config_to_int
+    (g_hash_table_lookup (config, "login.burst"), DEFAULT_LOGIN_BURST);
+  self->client_login_control.login_timeout_ms = gzochid_config_to_int
+    (g_hash_table_lookup (config, "client.login_timeout.msec"),
+     DEFAULT_CLIENT_LOGIN_TIMEOUT_MS);
+  self->client_login_control.idle_timeout_ms = gzochid_config_to_int
+    (g_hash_table_lookup (config, "client.idle_timeout.msec"), 0);
+  
   g_hash_table_destroy (config);
 }
 
@@ -297,7 +397,7 @@ initialize_storage (GzochidGameServer *server)
 	}
 
       server->storage_engine = gzochid_storage_load_engine 
-	(dir, g_hash_table_lookup (config, "storage.engine"));
+	(dir, g_hash_table_lookup (config, "storage.engine"), config);
     }
   else g_message 
 	 ("No durable storage engine configured; memory engine will be used.");
@@ -349,7 +449,8 @@ initialize_application (GzochidGameServer *server, const char *dir,
   gzochid_application_context_init
     (application_context, descriptor, server->metaclient_container,
      server->auth_plugin_registry, server->storage_engine->interface,
-     server->work_dir, server->task_queue, server->tx_timeout);
+     server->work_dir, server->task_queue, server->tx_timeout,
+     server->retry_policy);
 
   g_hash_table_insert
     (server->applications, descriptor->name, application_context);
@@ -501,8 +602,12 @@ gzochid_game_server_start (GzochidGameServer *server, GError **err)
   server->server_socket = gzochid_server_socket_new
     ("Game server", gzochid_game_server_protocol,
      gzochid_game_protocol_create_closure
-     (server, server->task_queue, server->tx_timeout));
+     (server, server->task_queue, server->tx_timeout,
+      server->client_flow_control, server->auth_pool,
+      server->client_login_control));
 
+  gzochid_server_socket_set_accept_rate
+    (server->server_socket, server->accept_rate, server->accept_burst);
   gzochid_server_socket_listen
     (server->socket_server, server->server_socket, server->port);
 }
@@ -519,3 +624,11 @@ gzochid_game_server_get_applications (GzochidGameServer *server)
 {
   return g_hash_table_get_values (server->applications);
 }
+
+void
+_gzochid_game_server_register_application
+(GzochidGameServer *server, gzochid_application_context *context)
+{
+  g_hash_table_insert
+    (server->applications, context->descriptor->name, context);
+}
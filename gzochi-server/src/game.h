@@ -69,4 +69,13 @@ gzochid_application_context *gzochid_game_server_lookup_application
 (GzochidGameServer *, const char *);
 GList *gzochid_game_server_get_applications (GzochidGameServer *);
 
+/* Private game server API, visible for testing only. */
+
+/* Makes the specified application context available to clients of the 
+   specified game server, under the name given by the context's descriptor. 
+   The context is not owned by the server. */
+
+void _gzochid_game_server_register_application
+(GzochidGameServer *, gzochid_application_context *);
+
 #endif /* GZOCHID_GAME_H */
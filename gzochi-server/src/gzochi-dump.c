@@ -27,11 +27,32 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "dumpfile.h"
 #include "gzochid-storage.h"
+#include "storage.h"
 #include "toollib.h"
 
 #define _(String) gettext (String)
 
+/* The number of records to read from one store before moving on to the next,
+   when dumping all stores. */
+
+#define DUMP_CHUNK_SIZE 1024
+
+/* The state of the dump of a single store. */
+
+struct store_dump
+{
+  gzochid_storage_store *store;
+  gzochid_storage_cursor *cursor; /* The cursor over the store's records. */
+  FILE *to; /* The output stream. */
+
+  /* The binary dump writer, or `NULL' if the text format is being used. */
+
+  gzochid_dump_writer *writer;
+  gboolean done; /* Whether the cursor has been exhausted. */
+};
+
 static void 
 dump_header (FILE *to)
 {
@@ -59,53 +80,83 @@ dump_key_value (char *k, size_t k_len, char *v, size_t v_len, FILE *to)
 }
 
 static void
-dump_store (gzochid_storage_engine_interface *iface, 
-	    gzochid_storage_transaction *tx, gzochid_storage_store *store, 
-	    FILE *to) 
+store_dump_open (struct store_dump *dump,
+		 gzochid_storage_engine_interface *iface,
+		 gzochid_storage_context *context, gzochid_storage_transaction *tx,
+		 char *data_dir, char *db, FILE *to, gboolean binary,
+		 gboolean compress)
 {
-  size_t key_len = 0;
-  char *key = NULL;
-  
-  dump_header (to);
-  key = iface->transaction_first_key (tx, store, &key_len);
-  
-  while (key != NULL)
+  char *db_path = g_strconcat (data_dir, "/", db, NULL);
+
+  dump->store = gzochid_tool_open_store (iface, context, db_path);
+  dump->cursor = iface->transaction_cursor_open (tx, dump->store);
+  dump->to = to;
+  dump->done = FALSE;
+
+  if (binary)
+    dump->writer = gzochid_dump_writer_new (to, compress);
+  else
     {
-      char *old_key = key;
-      size_t old_key_len = key_len;
+      dump->writer = NULL;
+      dump_header (to);
+    }
 
-      size_t value_len = 0;
-      char *value = iface->transaction_get 
-	(tx, store, key, key_len, &value_len);
+  g_free (db_path);
+}
 
-      dump_key_value (key, key_len, value, value_len, to);
-      key = iface->transaction_next_key (tx, store, key, old_key_len, &key_len);
+/* Writes up to the specified number of records from the specified store dump's
+   cursor, marking the dump done when the cursor is exhausted. */
+
+static void
+store_dump_step (struct store_dump *dump,
+		 gzochid_storage_engine_interface *iface, int max_records)
+{
+  size_t key_len = 0, value_len = 0;
+  char *key = NULL, *value = NULL;
+  int i = 0;
+
+  for (; i < max_records; i++)
+    {
+      key = iface->cursor_next (dump->cursor, &key_len, &value, &value_len);
+
+      if (key == NULL)
+	{
+	  dump->done = TRUE;
+	  break;
+	}
+
+      if (dump->writer != NULL)
+	gzochid_dump_writer_put (dump->writer, key, key_len, value, value_len);
+      else dump_key_value (key, key_len, value, value_len, dump->to);
 
       free (value);
-      free (old_key);
+      free (key);
     }
-  
-  fprintf (to, "DATA=END\n");
 }
 
 static void
-dump_single_inner 
-(gzochid_storage_engine_interface *iface, gzochid_storage_context *context, 
- gzochid_storage_transaction *tx, char *data_dir, char *db, FILE *to)
+store_dump_close (struct store_dump *dump,
+		  gzochid_storage_engine_interface *iface)
 {
-  char *db_path = g_strconcat (data_dir, "/", db, NULL);
-  gzochid_storage_store *store = 
-    gzochid_tool_open_store (iface, context, db_path);
+  iface->cursor_close (dump->cursor);
+  iface->close_store (dump->store);
 
-  dump_store (iface, tx, store, to);
+  if (dump->writer != NULL)
+    {
+      GError *err = NULL;
 
-  iface->close_store (store);
-  g_free (db_path);
+      if (!gzochid_dump_writer_close (dump->writer, &err))
+	{
+	  g_critical ("%s", err->message);
+	  exit (EXIT_FAILURE);
+	}
+    }
+  else fprintf (dump->to, "DATA=END\n");
 }
 
 static void
 dump_single (gzochid_storage_engine_interface *iface, char *data_dir, char *db,
-	     FILE *to)
+	     FILE *to, gboolean binary, gboolean compress)
 {
   gzochid_storage_context *context = iface->initialize (data_dir);
 
@@ -116,8 +167,23 @@ dump_single (gzochid_storage_engine_interface *iface, char *data_dir, char *db,
     }
   else 
     {
-      gzochid_storage_transaction *tx = iface->transaction_begin (context);
-      dump_single_inner (iface, context, tx, data_dir, db, to);
+      struct store_dump dump;
+      gzochid_storage_transaction *tx =
+	gzochid_storage_transaction_begin_read_only (iface, context);
+
+      store_dump_open
+	(&dump, iface, context, tx, data_dir, db, to, binary, compress);
+      while (!dump.done)
+	store_dump_step (&dump, iface, DUMP_CHUNK_SIZE);
+
+      if (tx->rollback)
+	{
+	  g_critical ("Failed to read %s in %s", db, data_dir);
+	  exit (EXIT_FAILURE);
+	}
+
+      store_dump_close (&dump, iface);
+
       iface->transaction_rollback (tx);
       iface->close_context (context);
     }
@@ -141,9 +207,16 @@ open_dump_output_file (char *output_dir, char *file)
   return output_file;
 }
 
+/* Dumps the `meta', `oids', and `names' stores from a single transaction. The
+   stores' cursors are advanced in turn, a chunk of records at a time, so that
+   when the binary format is in use, the three dump writers' threads compress
+   and write their files in parallel. (The cursors themselves must be advanced
+   on a single thread, since storage engine transactions may not be used by
+   more than one thread at a time.) */
+
 static void
 dump_all (gzochid_storage_engine_interface *iface, char *data_dir, 
-	  char *output_dir)
+	  char *output_dir, gboolean binary, gboolean compress)
 {
   gzochid_storage_context *context = iface->initialize (data_dir);
 
@@ -154,19 +227,47 @@ dump_all (gzochid_storage_engine_interface *iface, char *data_dir,
     }
   else
     {
-      FILE *meta_dump = open_dump_output_file (output_dir, "meta.dump");
-      FILE *oids_dump = open_dump_output_file (output_dir, "oids.dump");
-      FILE *names_dump = open_dump_output_file (output_dir, "names.dump");
+      char *dbs[] = { "meta", "oids", "names" };
+      struct store_dump dumps[3];
+      gboolean done = FALSE;
+      int i = 0;
 
-      gzochid_storage_transaction *tx = iface->transaction_begin (context);
+      gzochid_storage_transaction *tx =
+	gzochid_storage_transaction_begin_read_only (iface, context);
 
-      dump_single_inner (iface, context, tx, data_dir, "meta", meta_dump);
-      dump_single_inner (iface, context, tx, data_dir, "oids", oids_dump);
-      dump_single_inner (iface, context, tx, data_dir, "names", names_dump);
+      for (; i < 3; i++)
+	{
+	  char *filename = g_strconcat (dbs[i], ".dump", NULL);
 
-      fclose (meta_dump);
-      fclose (oids_dump);
-      fclose (names_dump);
+	  store_dump_open
+	    (&dumps[i], iface, context, tx, data_dir, dbs[i],
+	     open_dump_output_file (output_dir, filename), binary, compress);
+	  g_free (filename);
+	}
+
+      while (!done)
+	{
+	  done = TRUE;
+
+	  for (i = 0; i < 3; i++)
+	    if (!dumps[i].done)
+	      {
+		store_dump_step (&dumps[i], iface, DUMP_CHUNK_SIZE);
+		done = done && dumps[i].done;
+	      }
+	}
+
+      if (tx->rollback)
+	{
+	  g_critical ("Failed to read stores in %s", data_dir);
+	  exit (EXIT_FAILURE);
+	}
+
+      for (i = 0; i < 3; i++)
+	{
+	  store_dump_close (&dumps[i], iface);
+	  fclose (dumps[i].to);
+	}
 
       iface->transaction_rollback (tx);
       iface->close_context (context);
@@ -175,9 +276,11 @@ dump_all (gzochid_storage_engine_interface *iface, char *data_dir,
 
 static const struct option longopts[] =
   {
+    { "binary", no_argument, NULL, 'b' },
     { "config", required_argument, NULL, 'c' },
     { "engine", required_argument, NULL, 'e' },
     { "output", required_argument, NULL, 'o' },
+    { "compress", no_argument, NULL, 'z' },
     { "help", no_argument, NULL, 'h' },
     { "version", no_argument, NULL, 'v' },
     { NULL, 0, NULL, 0 }
@@ -201,16 +304,19 @@ static void
 print_help (const char *program_name)
 {
   fprintf (stderr, _("\
-Usage: %s [-c <CONF>] [-e <ENGINE>] [-o <DIR>] <APP_NAME or DATA_DIR>[:<DB>]\n\
+Usage: %s [-b [-z]] [-c <CONF>] [-e <ENGINE>] [-o <DIR>]\n\
+         <APP_NAME or DATA_DIR>[:<DB>]\n\
        %s [-h | -v]\n"), program_name, program_name);
   
   fputs ("", stderr);
   fputs (_("\
+  -b, --binary        write the binary dump format instead of the text format\n\
   -c, --config        full path to gzochid.conf\n\
   -e, --engine        the name of the storage engine in use, as per\n\
                       gzochid.conf (e.g., bdb)\n\
   -o, --output        the output directory, if dumping all databases; or\n\
                       the output file, if dumping a single database\n\
+  -z, --compress      compress the binary dump format\n\
   -h, --help          display this help and exit\n\
   -v, --version       display version information and exit\n"), stderr);
 
@@ -237,13 +343,17 @@ main (int argc, char *argv[])
   char *gzochid_conf_path = NULL;
   char *storage_engine_name = NULL;
   char *output = NULL;
+  gboolean binary = FALSE, compress = FALSE;
   int optc = 0;
   
   setlocale (LC_ALL, "");
   
-  while ((optc = getopt_long (argc, argv, "+c:e:o:hv", longopts, NULL)) != -1)
+  while ((optc = getopt_long (argc, argv, "+bc:e:o:zhv", longopts, NULL)) != -1)
     switch (optc)
       {
+      case 'b':
+	binary = TRUE;
+	break;
       case 'c':
 	gzochid_conf_path = strdup (optarg);
 	break;
@@ -253,6 +363,10 @@ main (int argc, char *argv[])
       case 'o':
 	output = strdup (optarg);
 	break;
+      case 'z':
+	binary = TRUE;
+	compress = TRUE;
+	break;
 
       case 'v':
 	print_version ();
@@ -290,7 +404,7 @@ main (int argc, char *argv[])
 	{
 	  if (output == NULL)
 	    output = g_get_current_dir ();
-	  dump_all (engine->interface, data_dir, output);
+	  dump_all (engine->interface, data_dir, output, binary, compress);
 	  free (output);
 	}
       else 
@@ -311,7 +425,8 @@ main (int argc, char *argv[])
 	      free (output);
 	    }
 
-	  dump_single (engine->interface, data_dir, db, output_file);
+	  dump_single
+	    (engine->interface, data_dir, db, output_file, binary, compress);
 	}
 
       g_strfreev (targets);
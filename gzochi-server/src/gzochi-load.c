@@ -26,16 +26,32 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "dumpfile.h"
 #include "gzochid-storage.h"
+#include "storage.h"
 #include "toollib.h"
 
 #define _(String) gettext (String)
 
+/* The default number of records to store per transaction. */
+
+#define DEFAULT_BATCH_SIZE 10000
+
+/* The size of the buffer for input streams. */
+
+#define INPUT_BUFFER_SIZE (1024 * 1024)
+
+/* The state of the load of a single store. */
+
 struct load_context
 {
   gzochid_storage_engine *engine;
   gzochid_storage_context *storage_context;
   gzochid_storage_store *store;
+
+  FILE *from; /* The stream from which the dump is read. */
+  size_t batch_size; /* The number of records to store per transaction. */
+  unsigned long num_records; /* The number of records loaded so far. */
 };
 
 struct datum
@@ -44,22 +60,34 @@ struct datum
   size_t data_len;
 };
 
+static gzochid_storage_context *
+initialize_storage (gzochid_storage_engine *engine, char *data_dir)
+{
+  gzochid_storage_context *storage_context = 
+    engine->interface->initialize (data_dir);
+
+  if (storage_context == NULL)
+    {
+      g_critical ("Failed to initialize store in %s", data_dir);
+      exit (EXIT_FAILURE);
+    }
+
+  return storage_context;
+}
+
 static struct load_context *
-setup_load_context (gzochid_storage_engine *engine, char *data_dir, char *db, 
-		    gboolean force)
+setup_load_context (gzochid_storage_engine *engine, 
+		    gzochid_storage_context *storage_context, char *data_dir,
+		    char *db, gboolean force, FILE *from, size_t batch_size)
 {
   unsigned int flags = GZOCHID_STORAGE_CREATE | GZOCHID_STORAGE_EXCL;
   struct load_context *context = calloc (1, sizeof (struct load_context));
   char *path = g_strconcat (data_dir, "/", db, NULL);
  
   context->engine = engine;
-  context->storage_context = engine->interface->initialize (data_dir);
-
-  if (context->storage_context == NULL)
-    {
-      g_critical ("Failed to initialize store in %s", data_dir);
-      exit (EXIT_FAILURE);
-    }
+  context->storage_context = storage_context;
+  context->from = from;
+  context->batch_size = batch_size;
 
   if (force)
     flags ^= GZOCHID_STORAGE_EXCL;
@@ -74,6 +102,8 @@ setup_load_context (gzochid_storage_engine *engine, char *data_dir, char *db,
     }
 
   free (path);
+
+  setvbuf (from, NULL, _IOFBF, INPUT_BUFFER_SIZE);
   
   return context;
 }
@@ -83,18 +113,39 @@ load_data_header (char *line, size_t line_len, int line_num)
 {
 }
 
+/* Returns the value of the specified hexadecimal digit, or -1 if the character
+   is not a hexadecimal digit. (This is considerably faster than `sscanf'.) */
+
+static inline int
+hex_value (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  else if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  else if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  else return -1;
+}
+
 static char *
 pack_line (char *line, size_t len, int line_num)
 {
   size_t i = 0;
-  char *packed_line = calloc (len / 2, sizeof (char));
+  char *packed_line = malloc (sizeof (char) * len / 2);
 
   for (; i < len; i += 2)
-    if (sscanf (line + i, "%2hhx", &packed_line[i / 2]) != 1)
-      {
-	g_critical ("Malformed line at row %d.", line_num);
-	exit (EXIT_FAILURE);
-      }
+    {
+      int hi = hex_value (line[i]), lo = hex_value (line[i + 1]);
+
+      if (hi < 0 || lo < 0)
+	{
+	  g_critical ("Malformed line at row %d.", line_num);
+	  exit (EXIT_FAILURE);
+	}
+
+      packed_line[i / 2] = (hi << 4) | lo;
+    }
 
   return packed_line;
 }
@@ -104,13 +155,13 @@ read_line (char *line, size_t line_len, int line_num)
 {
   struct datum data;
 
-  line_len -= 2;
-  
-  if (line_len <= 0 || line_len % 2 != 0)
+  if (line_len < 4 || line_len % 2 != 0)
     {
       g_critical ("Malformed line at row %d.", line_num);
       exit (EXIT_FAILURE);
     }
+
+  line_len -= 2;
   
   data.data = pack_line (line + 1, line_len, line_num);
   data.data_len = line_len / 2;
@@ -122,32 +173,79 @@ static void
 cleanup_load_context (struct load_context *context)
 {
   context->engine->interface->close_store (context->store);
-  context->engine->interface->close_context (context->storage_context);
-  
   free (context);
 }
 
+/* Stores the specified batch of key-value pairs in a single transaction, and
+   frees the pairs' keys and values. */
+
 static void
-load_data (gzochid_storage_engine *engine, char *data_dir, char *db, 
-	   gboolean force)
+load_batch (struct load_context *context, gzochid_storage_pair *pairs,
+	    size_t num_pairs)
 {
-  int line_num = 1;
-  struct datum line = { NULL, 0 }, key, value;
-  gboolean reading_key = TRUE;
-  struct load_context *context = 
-    setup_load_context (engine, data_dir, db, force);
+  gzochid_storage_engine_interface *iface = context->engine->interface;
+  gzochid_storage_transaction *tx = 
+    iface->transaction_begin (context->storage_context);
+  size_t i = 0;
+
+  gzochid_storage_transaction_put_bulk
+    (iface, tx, context->store, pairs, num_pairs);
 
-  while ((line.data_len = getline (&line.data, &line.data_len, stdin)) != -1 
-	 && strcmp (line.data, "HEADER=END\n") != 0)
+  if (!tx->rollback)
+    iface->transaction_prepare (tx);
+  
+  if (tx->rollback)
     {
-      load_data_header (line.data, line.data_len, line_num++);
-      
-      free (line.data);
-      line.data = NULL;
-      line.data_len = 0;
+      g_critical ("Failed to store batch of %zu records.", num_pairs);
+      iface->transaction_rollback (tx);
+      exit (EXIT_FAILURE);
+    }
+  else iface->transaction_commit (tx);
+  
+  for (; i < num_pairs; i++)
+    {
+      free (pairs[i].key);
+      free (pairs[i].value);
     }
+}
+
+/* Adds the specified key and value to the specified batch, storing the batch
+   if it is full. */
+
+static void
+add_to_batch (struct load_context *context, gzochid_storage_pair *pairs,
+	      size_t *num_pairs, char *key, size_t key_len, char *value,
+	      size_t value_len)
+{
+  pairs[*num_pairs].key = key;
+  pairs[*num_pairs].key_len = key_len;
+  pairs[*num_pairs].value = value;
+  pairs[*num_pairs].value_len = value_len;
+
+  context->num_records++;
+
+  if (++(*num_pairs) == context->batch_size)
+    {
+      load_batch (context, pairs, *num_pairs);
+      *num_pairs = 0;
+    }
+}
+
+static void
+load_text_data (struct load_context *context, gzochid_storage_pair *pairs)
+{
+  int line_num = 1;
+  char *line = NULL;
+  size_t line_cap = 0, num_pairs = 0;
+  ssize_t line_len = 0;
+  struct datum key = { NULL, 0 }, value;
+  gboolean reading_key = TRUE;
+
+  while ((line_len = getline (&line, &line_cap, context->from)) != -1 
+	 && strcmp (line, "HEADER=END\n") != 0)
+    load_data_header (line, line_len, line_num++);
 
-  if (line.data_len == -1)
+  if (line_len == -1)
     {
       g_critical ("While reading header data: %s", strerror (errno));
       exit (EXIT_FAILURE);
@@ -155,47 +253,182 @@ load_data (gzochid_storage_engine *engine, char *data_dir, char *db,
 
   line_num++;
 
-  while ((line.data_len = getline (&line.data, &line.data_len, stdin)) != -1 
-	 && strcmp (line.data, "DATA=END\n") != 0)
+  /* The line buffer is reused from line to line, and the data are committed in
+     batches, rather than a transaction per record. */
+  
+  while ((line_len = getline (&line, &line_cap, context->from)) != -1 
+	 && strcmp (line, "DATA=END\n") != 0)
     {
       if (reading_key)
 	{
-	  key = read_line (line.data, line.data_len, line_num++);
+	  key = read_line (line, line_len, line_num++);
 	  reading_key = FALSE;
 	}
       else 
 	{
-	  gzochid_storage_transaction *tx = context->engine->interface
-	    ->transaction_begin (context->storage_context);
+	  value = read_line (line, line_len, line_num++);
+	  add_to_batch (context, pairs, &num_pairs, key.data, key.data_len,
+			value.data, value.data_len);
+	  reading_key = TRUE;
+	}
+    }
 
-	  value = read_line (line.data, line.data_len, line_num++);
-	  
-	  context->engine->interface->transaction_put 
-	    (tx, context->store, key.data, key.data_len, value.data, 
-	     value.data_len);
+  if (num_pairs > 0)
+    load_batch (context, pairs, num_pairs);
+  if (!reading_key)
+    free (key.data);
 
-	  context->engine->interface->transaction_prepare (tx);
-	  context->engine->interface->transaction_commit (tx);
-	  
-	  free (key.data);
-	  free (value.data);
+  free (line);
+}
 
-	  reading_key = TRUE;
-	}
+static void
+load_binary_data (struct load_context *context, gzochid_storage_pair *pairs)
+{
+  size_t key_len = 0, value_len = 0, num_pairs = 0;
+  char *key = NULL, *value = NULL;
+  GError *err = NULL;
+  gzochid_dump_reader *reader = gzochid_dump_reader_new (context->from, &err);
 
-      free (line.data);
-      line.data = NULL;
-      line.data_len = 0;
+  if (reader == NULL)
+    {
+      g_critical ("While reading header data: %s", err->message);
+      exit (EXIT_FAILURE);
+    }
+
+  while (gzochid_dump_reader_next
+	 (reader, &key, &key_len, &value, &value_len, &err))
+    add_to_batch
+      (context, pairs, &num_pairs, key, key_len, value, value_len);
+
+  if (err != NULL)
+    {
+      g_critical ("After record %lu: %s", context->num_records, err->message);
+      exit (EXIT_FAILURE);
     }
 
+  if (num_pairs > 0)
+    load_batch (context, pairs, num_pairs);
+
+  gzochid_dump_reader_free (reader);
+}
+
+/* Loads the dump data from the specified load context's input stream, which
+   may be in either the text or the binary dump format. This function is a
+   `GThreadFunc', so that several stores may be loaded in parallel. */
+
+static gpointer
+load_data (gpointer data)
+{
+  struct load_context *context = data;
+  gzochid_storage_pair *pairs = malloc
+    (sizeof (gzochid_storage_pair) * context->batch_size);
+
+  if (gzochid_dump_file_is_binary (context->from))
+    load_binary_data (context, pairs);
+  else load_text_data (context, pairs);
+
+  free (pairs);
+  return NULL;
+}
+
+static void
+report_rate (unsigned long num_records, gint64 start)
+{
+  gint64 elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  fprintf (stderr, _("Loaded %lu records in %.2f seconds (%.0f rows/sec).\n"),
+	   num_records, elapsed / (double) G_USEC_PER_SEC,
+	   num_records / (elapsed / (double) G_USEC_PER_SEC));
+}
+
+static void
+load_single (gzochid_storage_engine *engine, char *data_dir, char *db,
+	     gboolean force, FILE *from, size_t batch_size)
+{
+  gzochid_storage_context *storage_context = 
+    initialize_storage (engine, data_dir);
+  struct load_context *context = setup_load_context
+    (engine, storage_context, data_dir, db, force, from, batch_size);
+  gint64 start = g_get_monotonic_time ();
+  unsigned long num_records = 0;
+
+  load_data (context);
+  num_records = context->num_records;
+
   cleanup_load_context (context);
+  engine->interface->close_context (storage_context);
+
+  report_rate (num_records, start);
+}
+
+static FILE *
+open_dump_input_file (char *input_dir, char *file)
+{
+  FILE *input_file = NULL;
+  char *filename = g_strconcat (input_dir, "/", file, NULL);
+  
+  input_file = fopen (filename, "r");
+  if (input_file == NULL)
+    {
+      g_critical 
+	("Failed to open file %s for reading: %s", filename, strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  
+  g_free (filename);
+  return input_file;
+}
+
+/* Loads the `meta', `oids', and `names' stores from the corresponding dump
+   files in the specified input directory, each in its own thread. */
+
+static void
+load_all (gzochid_storage_engine *engine, char *data_dir, char *input_dir,
+	  gboolean force, size_t batch_size)
+{
+  char *dbs[] = { "meta", "oids", "names" };
+  struct load_context *contexts[3];
+  GThread *threads[3];
+  gzochid_storage_context *storage_context = 
+    initialize_storage (engine, data_dir);
+  gint64 start = g_get_monotonic_time ();
+  unsigned long num_records = 0;
+  int i = 0;
+
+  for (; i < 3; i++)
+    {
+      char *filename = g_strconcat (dbs[i], ".dump", NULL);
+
+      contexts[i] = setup_load_context
+	(engine, storage_context, data_dir, dbs[i], force,
+	 open_dump_input_file (input_dir, filename), batch_size);
+      g_free (filename);
+    }
+
+  for (i = 0; i < 3; i++)
+    threads[i] = g_thread_new (dbs[i], load_data, contexts[i]);
+
+  for (i = 0; i < 3; i++)
+    {
+      g_thread_join (threads[i]);
+      num_records += contexts[i]->num_records;
+
+      fclose (contexts[i]->from);
+      cleanup_load_context (contexts[i]);
+    }
+
+  engine->interface->close_context (storage_context);
+
+  report_rate (num_records, start);
 }
 
 static const struct option longopts[] =
   {
+    { "batch-size", required_argument, NULL, 'b' },
     { "config", required_argument, NULL, 'c' },
     { "engine", required_argument, NULL, 'e' },
     { "force", no_argument, NULL, 'f' },
+    { "input", required_argument, NULL, 'i' },
     { "help", no_argument, NULL, 'h' },
     { "version", no_argument, NULL, 'v' },
     { NULL, 0, NULL, 0 }
@@ -219,15 +452,20 @@ static void
 print_help (const char *program_name)
 {
   fprintf (stderr, _("\
-Usage: %s [-c <CONF>] [-e <ENGINE>] [-f] <APP_NAME or DATA_DIR>:<DB>\n\
+Usage: %s [-b <SIZE>] [-c <CONF>] [-e <ENGINE>] [-f] [-i <INPUT>]\n\
+         <APP_NAME or DATA_DIR>[:<DB>]\n\
        %s [-h | -v]\n"), program_name, program_name);
 
   fputs ("", stderr);
   fputs (_("\
+  -b, --batch-size    the number of records to store per transaction\n\
+                      (default: 10000)\n\
   -c, --config        full path to gzochid.conf\n\
   -e, --engine        the name of the storage engine in use, as per\n\
                       gzochid.conf (e.g., bdb)\n\
   -f, --force         force an import, even when the target already exists\n\
+  -i, --input         the input directory, if loading all databases; or\n\
+                      the input file, if loading a single database\n\
   -h, --help          display this help and exit\n\
   -v, --version       display version information and exit\n"), stderr);
 
@@ -253,14 +491,26 @@ main (int argc, char *argv[])
   const char *program_name = argv[0];
   char *gzochid_conf_path = NULL;
   char *storage_engine_name = NULL;
+  char *input = NULL;
   gboolean force = FALSE;
+  long batch_size = DEFAULT_BATCH_SIZE;
+  char *end = NULL;
   int optc = 0;
   
   setlocale (LC_ALL, "");
   
-  while ((optc = getopt_long (argc, argv, "+c:e:fhv", longopts, NULL)) != -1)
+  while ((optc = getopt_long (argc, argv, "+b:c:e:fi:hv", longopts, NULL))
+	 != -1)
     switch (optc)
       {
+      case 'b':
+	batch_size = strtol (optarg, &end, 10);
+	if (end == optarg || *end != '\0' || batch_size <= 0)
+	  {
+	    print_help (program_name);
+	    exit (EXIT_FAILURE);
+	  }
+	break;
       case 'c':
 	gzochid_conf_path = strdup (optarg);
 	break;
@@ -270,6 +520,9 @@ main (int argc, char *argv[])
       case 'f':
 	force = TRUE;
 	break;
+      case 'i':
+	input = strdup (optarg);
+	break;
 	
       case 'v':
 	print_version ();
@@ -305,10 +558,28 @@ main (int argc, char *argv[])
 
       if (db == NULL)
 	{
-	  print_help (program_name);
-	  exit (EXIT_FAILURE);
+	  if (input == NULL)
+	    input = g_get_current_dir ();
+	  load_all (engine, data_dir, input, force, batch_size);
+	}
+      else if (input == NULL)
+	load_single (engine, data_dir, db, force, stdin, batch_size);
+      else
+	{
+	  FILE *input_file = fopen (input, "r");
+
+	  if (input_file == NULL)
+	    {
+	      g_critical ("Failed to open file %s for reading: %s", input,
+			  strerror (errno));
+	      exit (EXIT_FAILURE);
+	    }
+
+	  load_single (engine, data_dir, db, force, input_file, batch_size);
+	  fclose (input_file);
 	}
-      else load_data (engine, data_dir, db, force);
+
+      free (input);
       g_strfreev (targets);
     }
 
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #include "app.h"
 #include "config.h"
@@ -37,6 +38,7 @@
 #include "reloc.h"
 #include "scheme.h"
 #include "scheme-task.h"
+#include "storage.h"
 #include "toollib.h"
 #include "tx.h"
 #include "util.h"
@@ -55,12 +57,60 @@
 #define SERVER_FS_APPS_DEFAULT "/var/gzochid/deploy"
 #define SERVER_FS_DATA_DEFAULT "/var/gzochid/data"
 
+/* The number of object bindings read per transaction while migrating. */
+
+#define BINDINGS_BATCH_SIZE 256
+
+/* The default number of worker threads that visit objects. */
+
+#define DEFAULT_NUM_THREADS 4
+
+/* The number of times an object's migration transaction is attempted before
+   the migration fails, when the transaction fails in a retryable way (e.g., on
+   lock contention with another worker). */
+
+#define MAX_ATTEMPTS 5
+
+/* The number of oids covered by a single page of an oid set. */
+
+#define OID_SET_PAGE_SIZE 65536
+
+/* The interval, in seconds, between progress reports. */
+
+#define PROGRESS_INTERVAL 10
+
+/* The progress journal begins with this magic sequence, followed by the length
+   of the name of the target application as a big-endian 32-bit integer, and
+   the name itself. It is followed by a sequence of records, each of which
+   begins with a tag byte:
+
+   'O' records an object whose migration was committed, and consists of the
+   object's oid and the number of oids it references, as big-endian 64-bit and
+   32-bit integers, followed by the referenced oids.
+
+   'B' records that all objects reachable from the bindings up to and including
+   a particular binding have been migrated, and consists of the length of the
+   binding's key, as a big-endian 32-bit integer, followed by the key. */
+
+#define JOURNAL_MAGIC "GZMIGRATE\n"
+#define JOURNAL_MAGIC_LEN 10
+
+/* When a migration is journaled, the transaction that migrates an object also
+   binds a name with this prefix followed by the object's oid, so that an object
+   whose migration committed before it could be recorded in the journal isn't
+   transformed a second time when the migration is resumed. These bindings are
+   removed once the migration is complete. */
+
+#define MIGRATED_PREFIX "s.migrated."
+
 static SCM 
 scm_gzochi_visit_object = SCM_BOOL_F;
 static SCM 
 scm_push_type_registry_x = SCM_BOOL_F;
 static SCM 
 scm_pop_type_registry_x = SCM_BOOL_F;
+static SCM
+scm_skip_object = SCM_BOOL_F;
 
 /* TODO: Remove temporary, fake definition of `GZOCHID_TYPE_ROOT_CONTEXT' as
    soon as the root context is decoupled from the game server. */
@@ -71,22 +121,51 @@ gzochid_root_context_get_type ()
   return g_object_get_type ();
 }
 
+/* A set of oids, stored as a bitmap divided into fixed-size pages, which are
+   allocated as they are needed. Oids are allocated densely, so the set uses
+   about one bit per object in the store. */
+
+struct oid_set
+{
+  GHashTable *pages; /* Map of `guint64' page number to page bits. */
+};
+
 struct migration 
 {
   gzochid_application_context *context;
   struct migration_descriptor *descriptor;
   gboolean dry_run;
-  gboolean explicit_rollback;
   gboolean quiet;
 
-  GQueue *pending_oids;
-  char *visited_oids_path;
-  gzochid_storage_store *visited_oids;
+  int num_threads; /* The number of worker threads. */
+  GThread **threads; /* The worker threads. */
+
+  /* The following fields are protected by `mutex'. */
+
+  GMutex mutex;
+
+  /* Signaled when oids are added to `pending_oids', when the last busy worker
+     becomes idle, and when the migration is finished. */
+
+  GCond cond;
+  
+  /* The stack of oids waiting to be visited, as `guint64' values. Oids are
+     added to the set of visited oids as they are pushed, so an oid is never
+     pushed more than once, and the stack can't grow larger than the number of
+     objects in the store. */
+
+  GArray *pending_oids;
+  struct oid_set *visited_oids;
+  int num_busy; /* The number of workers currently visiting an object. */
+  gboolean finished; /* Whether there are no more bindings to migrate. */
+
+  /* The progress journal, or `NULL' if progress is not being recorded. */
+  
+  FILE *journal; 
 
   SCM callback;
   SCM input_registry;
   SCM output_registry;
-  gboolean pushed_registry;
 
   struct timeval start_time;
   struct timeval end_time;
@@ -95,6 +174,20 @@ struct migration
   guint64 num_removed;
 };
 
+/* The per-thread state of a migration worker. */
+
+struct migration_worker
+{
+  struct migration *migration;
+
+  guint64 oid; /* The oid of the object being visited. */
+  GArray *child_oids; /* The oids referenced by the object being visited. */
+  gboolean explicit_rollback;
+  gboolean pushed_registry;
+  gboolean transformed; /* Whether the object being visited was replaced. */
+  gboolean removed; /* Whether the object being visited was removed. */
+};
+
 struct migration_descriptor
 {
   char *target;
@@ -306,23 +399,36 @@ parse_descriptor (FILE *descriptor)
   return md;
 }
 
+/* Records the list of oids referenced by the object being visited. They are
+   not pushed onto the migration's stack of pending oids until the object's
+   migration transaction has completed. */
+
 static SCM
-enqueue_oids (SCM migration_ptr, SCM oids)
+enqueue_oids (SCM worker_ptr, SCM oids)
 {
-  struct migration *m = scm_to_pointer (migration_ptr);
+  struct migration_worker *worker = scm_to_pointer (worker_ptr);
 
   while (oids != SCM_EOL)
     {
-      guint64 *oid_ptr = malloc (sizeof (guint64));
+      guint64 oid = scm_to_uint64 (SCM_CAR (oids));
 
-      *oid_ptr = scm_to_uint64 (SCM_CAR (oids));
-      g_queue_push_tail (m->pending_oids, oid_ptr);
+      g_array_append_val (worker->child_oids, oid);
       oids = SCM_CDR (oids);
     }
 
   return SCM_UNSPECIFIED;
 }
 
+/* A visitor that leaves the object it visits unchanged; used to find the oids
+   referenced by an object that was migrated by an earlier, interrupted run of
+   the migration. */
+
+static SCM
+skip_object (SCM obj)
+{
+  return SCM_UNSPECIFIED;
+}
+
 static void
 initialize_scheme_bindings ()
 {
@@ -340,6 +446,7 @@ initialize_scheme_bindings ()
     scm_variable_ref (scm_c_module_lookup (gpd, "gzochi:pop-type-registry!"));
   scm_gzochi_visit_object = 
     scm_variable_ref (scm_c_module_lookup (gpdm, "gzochi:visit-object"));
+  scm_skip_object = scm_c_make_gsubr ("skip-object", 1, 0, 0, skip_object);
 
   scm_variable_set_x 
     (scm_c_module_lookup (gpdm, "enqueue-oids!"), scm_enqueue_oids);
@@ -347,44 +454,72 @@ initialize_scheme_bindings ()
   scm_gc_protect_object (scm_push_type_registry_x);
   scm_gc_protect_object (scm_pop_type_registry_x);
   scm_gc_protect_object (scm_gzochi_visit_object);
+  scm_gc_protect_object (scm_skip_object);
   scm_gc_protect_object (scm_enqueue_oids);
 }
 
-static gzochid_storage_store *
-create_store (gzochid_storage_engine_interface *iface, 
-	      gzochid_storage_context *context, char *path)
+static struct oid_set *
+oid_set_new (void)
 {
-  gzochid_storage_store *store = iface->open 
-    (context, path, GZOCHID_STORAGE_CREATE | GZOCHID_STORAGE_EXCL);
+  struct oid_set *set = malloc (sizeof (struct oid_set));
 
-  if (store == NULL)
-    {
-      g_critical ("Failed to open store in %s", path);
-      exit (EXIT_FAILURE);
-    }
-  else return store;
+  set->pages = g_hash_table_new_full (g_int64_hash, g_int64_equal, free, free);
+  return set;
 }
 
-static gzochid_storage_store *
-create_oid_scratch_storage (gzochid_storage_engine_interface *iface, 
-			    char *scratch_dir)
+static void
+oid_set_free (struct oid_set *set)
 {
-  gchar *filename = g_strconcat (scratch_dir, "/oids", NULL);
-  gzochid_storage_context *context = iface->initialize (scratch_dir);
-  gzochid_storage_store *store = create_store (iface, context, filename);
+  g_hash_table_destroy (set->pages);
+  free (set);
+}
 
-  g_free (filename);
-  return store;
+/* Returns `TRUE' if the specified oid is in the specified set. */
+
+static gboolean
+oid_set_contains (struct oid_set *set, guint64 oid)
+{
+  guint64 page_num = oid / OID_SET_PAGE_SIZE;
+  guint64 bit = oid % OID_SET_PAGE_SIZE;
+  unsigned char *page = g_hash_table_lookup (set->pages, &page_num);
+
+  return page != NULL && (page[bit / 8] & (1 << (bit % 8))) != 0;
 }
 
-static void
-cleanup_oids_scratch_storage (gzochid_storage_engine_interface *iface, 
-			      gzochid_storage_store *s, char *scratch_dir)
+/* Adds the specified oid to the specified set. Returns `TRUE' if the oid was
+   added, `FALSE' if it was already in the set. */
+
+static gboolean
+oid_set_add (struct oid_set *set, guint64 oid)
 {
-  gzochid_storage_context *context = s->context;
+  guint64 page_num = oid / OID_SET_PAGE_SIZE;
+  guint64 bit = oid % OID_SET_PAGE_SIZE;
+  unsigned char *page = g_hash_table_lookup (set->pages, &page_num);
+
+  if (page == NULL)
+    {
+      guint64 *key = malloc (sizeof (guint64));
+
+      *key = page_num;
+      page = calloc (OID_SET_PAGE_SIZE / 8, sizeof (unsigned char));
+      g_hash_table_insert (set->pages, key, page);
+    }
+  else if ((page[bit / 8] & (1 << (bit % 8))) != 0)
+    return FALSE;
+
+  page[bit / 8] |= 1 << (bit % 8);
+  return TRUE;
+}
+
+/* Pushes the specified oid onto the stack of pending oids for the specified
+   migration, unless it has already been visited or is already pending. The
+   migration's mutex must be held. */
 
-  iface->close_store (s);
-  iface->destroy_store (context, scratch_dir);
+static void
+push_oid (struct migration *m, guint64 oid)
+{
+  if (oid_set_add (m->visited_oids, oid))
+    g_array_append_val (m->pending_oids, oid);
 }
 
 static SCM 
@@ -415,18 +550,9 @@ append_load_paths (GList *load_paths)
 static struct migration *
 create_migration (gzochid_application_context *context, 
 		  struct migration_descriptor *md, gboolean dry_run, 
-		  gboolean quiet)
+		  gboolean quiet, int num_threads)
 { 
-  struct migration *m = malloc (sizeof (struct migration));
-  char *scratch_dir_template = strdup ("gzochid-migrate-XXXXXXX");
-  char *scratch_dir = g_dir_make_tmp (scratch_dir_template, NULL);
-  
-  if (scratch_dir == NULL)
-    {
-      g_critical ("Unable to create scratch storage: %s", strerror (errno));
-      exit (EXIT_FAILURE);
-      return NULL; /* Never reached. */
-    }
+  struct migration *m = calloc (1, sizeof (struct migration));
 
   assert (md->callback_name != NULL && strlen (md->callback_name) > 0);
   assert (md->callback_module != NULL && strlen (md->callback_module) > 0);
@@ -437,13 +563,15 @@ create_migration (gzochid_application_context *context,
   m->context = context;
   m->descriptor = md;
   m->dry_run = dry_run;
-  m->explicit_rollback = FALSE;
   m->quiet = quiet;
-  m->pending_oids = g_queue_new ();
+  m->num_threads = num_threads;
+  m->threads = calloc (num_threads, sizeof (GThread *));
+
+  g_mutex_init (&m->mutex);
+  g_cond_init (&m->cond);
   
-  m->visited_oids = create_oid_scratch_storage 
-    (context->storage_engine_interface, scratch_dir);
-  m->visited_oids_path = scratch_dir;
+  m->pending_oids = g_array_new (FALSE, FALSE, sizeof (guint64));
+  m->visited_oids = oid_set_new ();
 
   m->callback = resolve_or_die (md->callback_module, md->callback_name);
 
@@ -463,8 +591,6 @@ create_migration (gzochid_application_context *context,
     }
   else m->output_registry = SCM_BOOL_F;
 
-  m->pushed_registry = FALSE;
-
   scm_gc_protect_object (m->input_registry);
   scm_gc_protect_object (m->output_registry);
   scm_gc_protect_object (m->callback);
@@ -485,15 +611,18 @@ cleanup_application_context (gzochid_application_context *context)
 static void
 cleanup_migration (struct migration *m)
 {
-  cleanup_oids_scratch_storage 
-    (m->context->storage_engine_interface, m->visited_oids,
-     m->visited_oids_path);
   cleanup_application_context (m->context);
 
-  free (m->visited_oids_path);
-
-  g_queue_free (m->pending_oids);
+  if (m->journal != NULL)
+    fclose (m->journal);
+  
+  g_array_free (m->pending_oids, TRUE);
+  oid_set_free (m->visited_oids);
+  free (m->threads);
 
+  g_mutex_clear (&m->mutex);
+  g_cond_clear (&m->cond);
+  
   if (m->input_registry != SCM_BOOL_F)
     scm_gc_unprotect_object (m->input_registry);
   if (m->output_registry != SCM_BOOL_F)
@@ -618,9 +747,11 @@ create_application_context (char *path, char *app)
 }
 
 static SCM
-invoke_callback (struct migration *m, gzochid_data_managed_reference *obj_ref)
+invoke_callback (struct migration_worker *worker,
+		 gzochid_data_managed_reference *obj_ref, SCM callback)
 {
-  SCM migration_ptr = scm_from_pointer (m, NULL);
+  struct migration *m = worker->migration;
+  SCM worker_ptr = scm_from_pointer (worker, NULL);
   SCM exception_var = scm_make_variable (SCM_UNSPECIFIED);
   SCM obj = gzochid_scm_location_resolve (m->context, obj_ref->obj);
   SCM ret = SCM_BOOL_F;
@@ -628,13 +759,13 @@ invoke_callback (struct migration *m, gzochid_data_managed_reference *obj_ref)
   gpointer args[4];
 
   args[0] = scm_gzochi_visit_object;
-  args[1] = scm_list_3 (migration_ptr, obj, m->callback);
+  args[1] = scm_list_3 (worker_ptr, obj, callback);
   args[2] = exception_var;
   args[3] = &ret;
 
   gzochid_scheme_application_worker (m->context, NULL, args);
 
-  scm_remember_upto_here_1 (migration_ptr);
+  scm_remember_upto_here_1 (worker_ptr);
   scm_remember_upto_here_1 (exception_var);
   scm_remember_upto_here_1 (obj);
 
@@ -658,51 +789,106 @@ rollback (gpointer user_data) { }
 static gzochid_transaction_participant 
 migration_participant = { "migration", prepare, commit, rollback };
 
+/* Returns a newly-allocated string holding the name of the binding that marks
+   the object with the specified oid as migrated. */
+
+static char *
+migrated_binding (guint64 oid)
+{
+  GString *binding = g_string_new (MIGRATED_PREFIX);
+
+  g_string_append_printf (binding, "%" G_GUINT64_FORMAT, oid);
+  return g_string_free (binding, FALSE);
+}
+
+/* Pushes the specified type registry for the specified worker, popping the
+   one it pushed previously, if any. */
+
+static void
+switch_type_registry (struct migration_worker *worker, SCM registry)
+{
+  if (worker->pushed_registry)
+    {
+      scm_call_0 (scm_pop_type_registry_x);
+      worker->pushed_registry = FALSE;
+    }
+  if (registry != SCM_BOOL_F)
+    {
+      scm_call_1 (scm_push_type_registry_x, registry);
+      worker->pushed_registry = TRUE;
+    }
+}
 
 static void
 migrate_object_tx (gpointer data)
 {
-  gpointer *args = data;
-  struct migration *m = args[0];
-  guint64 *oid = args[1];
+  struct migration_worker *worker = data;
+  struct migration *m = worker->migration;
 
   GError *err = NULL;
   gzochid_data_managed_reference *obj_ref = NULL;
+  char *binding = NULL;
+  gboolean migrated = FALSE;
+  
+  /* The transaction may be a retry of an earlier attempt. */
 
-  m->explicit_rollback = FALSE;
-  if (m->pushed_registry)
-    {
-      scm_call_0 (scm_pop_type_registry_x);
-      m->pushed_registry = FALSE;
-    }
-  if (m->input_registry != SCM_BOOL_F)
+  g_array_set_size (worker->child_oids, 0);
+  worker->transformed = FALSE;
+  worker->removed = FALSE;
+  worker->explicit_rollback = FALSE;
+
+  if (m->journal != NULL)
     {
-      scm_call_1 (scm_push_type_registry_x, m->input_registry);
-      m->pushed_registry = TRUE;
+      binding = migrated_binding (worker->oid);
+      migrated = gzochid_data_binding_exists (m->context, binding, &err);
+
+      if (err != NULL)
+	{
+	  /* The transaction has been marked for rollback. */
+	  
+	  g_error_free (err);
+	  g_free (binding);
+	  return;
+	}
     }
+  
+  /* An object that's already been migrated is in the output format, and is
+     only visited to find the oids it references. */
+  
+  switch_type_registry
+    (worker, migrated ? m->output_registry : m->input_registry);
 
   obj_ref = gzochid_data_create_reference_to_oid 
-    (m->context, &gzochid_scm_location_aware_serialization, *oid);
+    (m->context, &gzochid_scm_location_aware_serialization, worker->oid);
   gzochid_data_dereference (obj_ref, &err);
 
-  m->num_visited++;
-
   if (err != NULL)
     {
       if (g_error_matches 
 	  (err, GZOCHID_DATA_ERROR, GZOCHID_DATA_ERROR_NOT_FOUND))
-	g_warning ("No data found for oid %" G_GUINT64_FORMAT ".", *oid);
+	{
+	  /* An object removed by its migration won't be found again. */
+	  
+	  if (!migrated)
+	    g_warning ("No data found for oid %" G_GUINT64_FORMAT ".",
+		       worker->oid);
+	}
       else 
 	{
 	  g_critical 
 	    ("Failed to deserialize data for oid %" G_GUINT64_FORMAT ": %s",
-	     *oid, err->message);
+	     worker->oid, err->message);
 	  exit (EXIT_FAILURE);
 	}
+
+      g_error_free (err);
+      err = NULL;
     }
+  else if (migrated)
+    invoke_callback (worker, obj_ref, scm_skip_object);
   else
     {
-      SCM ret = invoke_callback (m, obj_ref);
+      SCM ret = invoke_callback (worker, obj_ref, m->callback);
 
       if (ret == SCM_BOOL_F)
 	{
@@ -710,11 +896,12 @@ migrate_object_tx (gpointer data)
 	  if (err != NULL)
 	    {
 	      g_critical
-		("Failed to remove data for oid %" G_GUINT64_FORMAT, *oid);
+		("Failed to remove data for oid %" G_GUINT64_FORMAT,
+		 worker->oid);
 	      exit (EXIT_FAILURE);
 	    }
 	  
-	  m->num_removed++;
+	  worker->removed = TRUE;
 	}
       else if (ret != SCM_UNSPECIFIED)
 	{
@@ -726,58 +913,184 @@ migrate_object_tx (gpointer data)
 	  obj_ref->obj = gzochid_scm_location_get (m->context, ret);
 	  obj_ref->state = GZOCHID_MANAGED_REFERENCE_STATE_MODIFIED;
 
-	  m->num_transformed++;
+	  worker->transformed = TRUE;
+	}
+
+      /* Mark the object as migrated in the same transaction that migrates
+	 it. */
+      
+      if (binding != NULL)
+	{
+	  gzochid_data_set_binding_to_oid
+	    (m->context, binding, worker->oid, &err);
+	  if (err != NULL)
+	    g_error_free (err);
 	}
     }
 
-  if (m->pushed_registry)
+  g_free (binding);
+  switch_type_registry (worker, m->output_registry);
+
+  if (m->dry_run && !worker->explicit_rollback)
     {
-      scm_call_0 (scm_pop_type_registry_x);
-      m->pushed_registry = FALSE;
+      gzochid_transaction_join (&migration_participant, NULL);
+      gzochid_transaction_mark_for_rollback (&migration_participant, TRUE);
+      worker->explicit_rollback = TRUE;
     }
-  if (m->output_registry != SCM_BOOL_F)
+}
+
+/* Writes the specified bytes to the specified migration's journal, exiting on
+   failure. */
+
+static void
+journal_write (struct migration *m, const void *data, size_t len)
+{
+  if (fwrite (data, 1, len, m->journal) != len)
     {
-      scm_call_1 (scm_push_type_registry_x, m->output_registry);
-      m->pushed_registry = TRUE;
+      g_critical ("Failed to write to migration journal: %s",
+		  strerror (errno));
+      exit (EXIT_FAILURE);
     }
+}
+
+/* Flushes the specified migration's journal, so that its contents survive the
+   termination of the process. */
 
-  if (m->dry_run && !m->explicit_rollback)
+static void
+journal_flush (struct migration *m)
+{
+  if (fflush (m->journal) != 0)
     {
-      gzochid_transaction_join (&migration_participant, NULL);
-      gzochid_transaction_mark_for_rollback (&migration_participant, TRUE);
-      m->explicit_rollback = TRUE;
+      g_critical ("Failed to write to migration journal: %s",
+		  strerror (errno));
+      exit (EXIT_FAILURE);
     }
 }
 
-static void 
-migrate_object (struct migration *m, guint64 oid)
+/* Records in the specified migration's journal that the specified worker's
+   current object has been migrated. The migration's mutex must be held. */
+
+static void
+journal_object (struct migration *m, struct migration_worker *worker)
 {
-  gpointer args[2];
+  guint64 oid = GUINT64_TO_BE (worker->oid);
+  guint32 num_child_oids = GUINT32_TO_BE (worker->child_oids->len);
+  int i = 0;
 
-  args[0] = m;
-  args[1] = &oid;
+  journal_write (m, "O", 1);
+  journal_write (m, &oid, sizeof (guint64));
+  journal_write (m, &num_child_oids, sizeof (guint32));
 
-  gzochid_storage_transaction *tx = m->context->storage_engine_interface
-    ->transaction_begin (m->context->storage_context);
-  guint64 encoded_oid = gzochid_util_encode_oid (oid);
-  char *val = m->context->storage_engine_interface->transaction_get
-    (tx, m->visited_oids, (char *) &encoded_oid, sizeof (guint64), NULL);
-      
-  if (val == NULL)
+  for (; i < worker->child_oids->len; i++)
+    {
+      guint64 child_oid = GUINT64_TO_BE
+	(g_array_index (worker->child_oids, guint64, i));
+
+      journal_write (m, &child_oid, sizeof (guint64));
+    }
+
+  journal_flush (m);
+}
+
+/* Visits the specified worker's current object in a new transaction, retrying
+   the transaction if it fails in a retryable way. Returns `TRUE' if the
+   object's migration was committed, `FALSE' if it was rolled back because the
+   migration is a dry run. */
+
+static gboolean
+migrate_object (struct migration_worker *worker)
+{
+  gzochid_transaction_result result = GZOCHID_TRANSACTION_PENDING;
+  int attempts = 0;
+
+  while (attempts++ < MAX_ATTEMPTS)
+    {
+      result = gzochid_transaction_execute (migrate_object_tx, worker);
+
+      if (result == GZOCHID_TRANSACTION_SUCCESS)
+	return TRUE;
+      else if (worker->explicit_rollback)
+	return FALSE;
+      else if (result != GZOCHID_TRANSACTION_SHOULD_RETRY)
+	break;
+    }
+
+  g_critical ("Migration transaction failed for oid %" G_GUINT64_FORMAT ".",
+	      worker->oid);
+  exit (EXIT_FAILURE);
+  return FALSE; /* Never reached. */
+}
+
+static void *
+run_worker_guile (void *data)
+{
+  struct migration_worker *worker = data;
+  struct migration *m = worker->migration;
+
+  g_mutex_lock (&m->mutex);
+
+  while (TRUE)
     {
-      m->context->storage_engine_interface->transaction_put
-	(tx, m->visited_oids, (char *) &encoded_oid, sizeof (guint64), "", 1);
-      if (gzochid_transaction_execute (migrate_object_tx, args) 
-	  != GZOCHID_TRANSACTION_SUCCESS && !m->explicit_rollback)
+      int i = 0;
+
+      while (m->pending_oids->len == 0 && !m->finished)
+	g_cond_wait (&m->cond, &m->mutex);
+
+      if (m->pending_oids->len == 0)
+	break;
+
+      /* Oids are taken from the top of the stack, so that the objects
+	 reachable from a binding are visited depth-first, and the number of
+	 pending oids stays small. */
+      
+      worker->oid = g_array_index
+	(m->pending_oids, guint64, m->pending_oids->len - 1);
+      g_array_set_size (m->pending_oids, m->pending_oids->len - 1);
+      m->num_busy++;
+      
+      g_mutex_unlock (&m->mutex);
+
+      if (migrate_object (worker) && m->journal != NULL)
 	{
-	  g_critical ("Migration transaction failed.");
-	  exit (EXIT_FAILURE);
+	  g_mutex_lock (&m->mutex);
+	  journal_object (m, worker);
 	}
+      else g_mutex_lock (&m->mutex);
+
+      m->num_visited++;
+      if (worker->transformed)
+	m->num_transformed++;
+      if (worker->removed)
+	m->num_removed++;
+      
+      for (; i < worker->child_oids->len; i++)
+	push_oid (m, g_array_index (worker->child_oids, guint64, i));
+
+      m->num_busy--;
+      g_cond_broadcast (&m->cond);
     }
-  else free (val);
 
-  m->context->storage_engine_interface->transaction_prepare (tx);
-  m->context->storage_engine_interface->transaction_commit (tx);
+  g_mutex_unlock (&m->mutex);
+
+  if (worker->pushed_registry)
+    scm_call_0 (scm_pop_type_registry_x);
+
+  return NULL;
+}
+
+/* The entry point for migration worker threads. */
+
+static gpointer
+run_worker (gpointer data)
+{
+  struct migration_worker *worker = data;
+
+  scm_with_guile (run_worker_guile, worker);
+
+  g_array_free (worker->child_oids, TRUE);
+  free (worker);
+
+  return NULL;
 }
 
 struct datum
@@ -786,78 +1099,467 @@ struct datum
   size_t data_len;
 };
 
-static struct datum
-next_key (struct migration *m, struct datum last_key)
+/*
+  Reads, via a cursor in a single transaction, up to `BINDINGS_BATCH_SIZE' 
+  object bindings (i.e., those with the "o." prefix) from the names store, 
+  starting immediately after the specified key (or from the first binding, if
+  the key is empty), and appends the bound oids to the specified array. The
+  key is updated to the last binding read.
+
+  Returns `FALSE' if there are no more bindings.
+*/
+
+static gboolean
+next_bindings (struct migration *m, struct datum *last_key, GArray *oids)
 {
-  struct datum key = { NULL, 0 };
-  gzochid_storage_transaction *tx = m->context->storage_engine_interface
-    ->transaction_begin (m->context->storage_context);
-  
-  if (last_key.data == NULL)
-    key.data = m->context->storage_engine_interface
-      ->transaction_next_key (tx, m->context->names, "o.", 2, &key.data_len);
-  else key.data = m->context->storage_engine_interface
-	 ->transaction_next_key (tx, m->context->names, last_key.data,
-				 last_key.data_len, &key.data_len);
-
-  m->context->storage_engine_interface->transaction_rollback (tx);
+  gzochid_storage_engine_interface *iface =
+    m->context->storage_engine_interface;
+  gzochid_storage_transaction *tx = gzochid_storage_transaction_begin_read_only
+    (iface, m->context->storage_context);
+  gzochid_storage_cursor *cursor =
+    iface->transaction_cursor_open (tx, m->context->names);
+  int n = 0;
   
-  if (key.data != NULL && strncmp ("o.", key.data, 2) != 0)
+  if (last_key->data == NULL)
+    iface->cursor_seek (cursor, "o.", 2);
+  else
+    {
+      /* Seek to the last key with a NUL byte appended, which is the smallest
+	 key that follows it. */
+
+      char *seek_key = calloc (last_key->data_len + 1, sizeof (char));
+
+      memcpy (seek_key, last_key->data, last_key->data_len);
+      iface->cursor_seek (cursor, seek_key, last_key->data_len + 1);
+      free (seek_key);
+    }
+
+  while (n < BINDINGS_BATCH_SIZE)
+    {
+      size_t key_len = 0, oid_len = 0;
+      char *oid_bytes = NULL;
+      char *key = iface->cursor_next (cursor, &key_len, &oid_bytes, &oid_len);
+      guint64 encoded_oid = 0, oid = 0;
+      
+      if (key == NULL)
+	break;
+      else if (key_len < 2 || strncmp ("o.", key, 2) != 0)
+	{
+	  free (key);
+	  free (oid_bytes);
+	  break;
+	}
+
+      assert (oid_len == sizeof (guint64));
+      memcpy (&encoded_oid, oid_bytes, sizeof (guint64));
+      free (oid_bytes);
+
+      oid = gzochid_util_decode_oid (encoded_oid);
+      g_array_append_val (oids, oid);
+
+      free (last_key->data);
+      last_key->data = key;
+      last_key->data_len = key_len;
+
+      n++;
+    }
+
+  iface->cursor_close (cursor);
+  iface->transaction_rollback (tx);
+
+  return n > 0;
+}
+
+/* Records in the specified migration's journal that all objects reachable
+   from the bindings up to and including the specified key have been
+   migrated. */
+
+static void
+journal_bindings (struct migration *m, struct datum *last_key)
+{
+  guint32 key_len = GUINT32_TO_BE (last_key->data_len);
+
+  journal_write (m, "B", 1);
+  journal_write (m, &key_len, sizeof (guint32));
+  journal_write (m, last_key->data, last_key->data_len);
+  journal_flush (m);
+}
+
+/* Reads the specified number of bytes from the specified journal file.
+   Returns `FALSE' if the file ends first. */
+
+static gboolean
+journal_read (FILE *journal, void *data, size_t len)
+{
+  return fread (data, 1, len, journal) == len;
+}
+
+/* Reads a single record from the specified journal file, replaying it against
+   the specified migration. Oids of migrated objects are added to the 
+   specified set of completed oids, and oids referenced by migrated objects are
+   pushed onto the migration's stack of pending oids. Returns `FALSE' if the
+   file ends before a complete record can be read. */
+
+static gboolean
+replay_journal_record (struct migration *m, FILE *journal,
+		       struct oid_set *completed, struct datum *last_key)
+{
+  char tag = 0;
+  guint32 len = 0;
+
+  if (!journal_read (journal, &tag, 1))
+    return FALSE;
+
+  if (tag == 'O')
+    {
+      guint64 oid = 0;
+      GArray *child_oids = NULL;
+      gboolean complete = FALSE;
+      int i = 0;
+      
+      if (!journal_read (journal, &oid, sizeof (guint64))
+	  || !journal_read (journal, &len, sizeof (guint32)))
+	return FALSE;
+
+      len = GUINT32_FROM_BE (len);
+      child_oids = g_array_sized_new (FALSE, FALSE, sizeof (guint64), len);
+      g_array_set_size (child_oids, len);
+      complete = journal_read
+	(journal, child_oids->data, len * sizeof (guint64));
+
+      if (complete)
+	{
+	  oid_set_add (completed, GUINT64_FROM_BE (oid));
+	  oid_set_add (m->visited_oids, GUINT64_FROM_BE (oid));
+
+	  for (; i < len; i++)
+	    push_oid (m, GUINT64_FROM_BE
+		      (g_array_index (child_oids, guint64, i)));
+	}
+
+      g_array_free (child_oids, TRUE);
+      return complete;
+    }
+  else if (tag == 'B')
+    {
+      char *key = NULL;
+
+      if (!journal_read (journal, &len, sizeof (guint32)))
+	return FALSE;
+
+      len = GUINT32_FROM_BE (len);
+      key = malloc (len);
+
+      if (!journal_read (journal, key, len))
+	{
+	  free (key);
+	  return FALSE;
+	}
+
+      free (last_key->data);
+      last_key->data = key;
+      last_key->data_len = len;
+
+      return TRUE;
+    }
+  else
     {
-      free (key.data);
-      memset (&key, 0, sizeof (struct datum));
+      g_critical ("Invalid record in migration journal.");
+      exit (EXIT_FAILURE);
+      return FALSE; /* Never reached. */
     }
+}
+
+/* Opens the journal at the specified path for the specified migration. If the
+   journal already exists, its records are replayed, so that objects that were
+   migrated by an earlier, interrupted run of the migration aren't visited 
+   again, and the specified key is set to the last binding whose reachable 
+   objects were all migrated. Any incomplete record at the end of the journal
+   is discarded. */
+
+static void
+open_journal (struct migration *m, const char *path, struct datum *last_key)
+{
+  const char *target = m->descriptor->target;
+  guint32 target_len = strlen (target);
+  FILE *journal = fopen (path, "r+");
+
+  if (journal != NULL)
+    {
+      char magic[JOURNAL_MAGIC_LEN];
+      guint32 len = 0;
+      char *journal_target = NULL;
+      struct oid_set *completed = oid_set_new ();
+      long offset = 0;
+      int i = 0;
+      
+      if (!journal_read (journal, magic, JOURNAL_MAGIC_LEN)
+	  || memcmp (magic, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0
+	  || !journal_read (journal, &len, sizeof (guint32))
+	  || GUINT32_FROM_BE (len) != target_len)
+	{
+	  g_critical ("%s is not a migration journal for %s.", path, target);
+	  exit (EXIT_FAILURE);
+	}
+
+      journal_target = malloc (target_len);
+      if (!journal_read (journal, journal_target, target_len)
+	  || memcmp (journal_target, target, target_len) != 0)
+	{
+	  g_critical ("%s is not a migration journal for %s.", path, target);
+	  exit (EXIT_FAILURE);
+	}
+
+      free (journal_target);
+      
+      offset = ftell (journal);
+      while (replay_journal_record (m, journal, completed, last_key))
+	offset = ftell (journal);
+
+      /* The oids referenced by migrated objects were pushed as the journal was
+	 replayed; remove the ones that were subsequently migrated themselves.
+	 */
+      
+      while (i < m->pending_oids->len)
+	if (oid_set_contains
+	    (completed, g_array_index (m->pending_oids, guint64, i)))
+	  g_array_remove_index_fast (m->pending_oids, i);
+	else i++;
+
+      oid_set_free (completed);
+
+      if (fseek (journal, offset, SEEK_SET) != 0
+	  || ftruncate (fileno (journal), offset) != 0)
+	{
+	  g_critical ("Failed to truncate migration journal %s: %s", path,
+		      strerror (errno));
+	  exit (EXIT_FAILURE);
+	}
+
+      m->journal = journal;
+
+      if (!m->quiet)
+	fprintf (stderr, "Resuming migration with %u objects pending.\n",
+		 m->pending_oids->len);
+    }
+  else if (errno == ENOENT)
+    {
+      guint32 len = GUINT32_TO_BE (target_len);
+
+      m->journal = fopen (path, "w");
+
+      if (m->journal == NULL)
+	{
+	  g_critical ("Failed to create migration journal %s: %s", path,
+		      strerror (errno));
+	  exit (EXIT_FAILURE);
+	}
+      
+      journal_write (m, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN);
+      journal_write (m, &len, sizeof (guint32));
+      journal_write (m, target, target_len);
+      journal_flush (m);
+    }
+  else
+    {
+      g_critical ("Failed to open migration journal %s: %s", path,
+		  strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+}
+
+/* Returns the average number of objects visited per second since the start of
+   the specified migration, as of the specified time. */
+
+static double
+objects_per_second (struct migration *m, struct timeval *now)
+{
+  struct timeval elapsed;
+  double seconds = 0;
+
+  timersub (now, &m->start_time, &elapsed);
+  seconds = elapsed.tv_sec + elapsed.tv_usec / 1000000.0;
+
+  return seconds > 0 ? m->num_visited / seconds : 0;
+}
+
+/* Waits until the specified migration has no pending oids and no busy
+   workers, reporting progress periodically. The migration's mutex must be
+   held. */
+
+static void
+wait_for_workers (struct migration *m)
+{
+  while (m->pending_oids->len > 0 || m->num_busy > 0)
+    {
+      gint64 end_time = g_get_monotonic_time ()
+	+ PROGRESS_INTERVAL * G_TIME_SPAN_SECOND;
+      
+      if (!g_cond_wait_until (&m->cond, &m->mutex, end_time) && !m->quiet)
+	{
+	  struct timeval now;
+
+	  gettimeofday (&now, NULL);
+	  fprintf (stderr, "Objects visited: %" G_GUINT64_FORMAT
+		   " (%.0f objects/sec)\n", m->num_visited,
+		   objects_per_second (m, &now));
+	}
+    }
+}
+
+/* The state of a sweep of the bindings that mark objects as migrated. */
+
+struct migrated_binding_sweep
+{
+  struct migration *migration;
+  gboolean finished; /* Whether there are no more bindings to remove. */
+};
+
+/* Removes up to `BINDINGS_BATCH_SIZE' of the bindings that mark objects as
+   migrated. Each batch starts from the beginning of the prefix, since the
+   bindings removed by earlier batches are gone. */
+
+static void
+remove_migrated_bindings_tx (gpointer data)
+{
+  struct migrated_binding_sweep *sweep = data;
+  struct migration *m = sweep->migration;
+  size_t prefix_len = strlen (MIGRATED_PREFIX);
+  char *key = strdup (MIGRATED_PREFIX);
+  int n = 0;
+
+  sweep->finished = FALSE;
   
-  return key;
+  while (n < BINDINGS_BATCH_SIZE)
+    {
+      GError *err = NULL;
+      guint64 oid = 0;
+      char *next_key = gzochid_data_next_binding_oid
+	(m->context, key, &oid, &err);
+
+      free (key);
+      key = next_key;
+      
+      if (err != NULL)
+	{
+	  g_error_free (err);
+	  break;
+	}
+      else if (key == NULL || strncmp (MIGRATED_PREFIX, key, prefix_len) != 0)
+	{
+	  sweep->finished = TRUE;
+	  break;
+	}
+
+      gzochid_data_remove_binding (m->context, key, &err);
+      if (err != NULL)
+	{
+	  g_error_free (err);
+	  break;
+	}
+
+      n++;
+    }
+
+  free (key);
 }
 
+/* Removes the bindings that mark objects as migrated, once the migration is
+   complete. */
+
 static void
-run_migration (struct migration *m)
+remove_migrated_bindings (struct migration *m)
 {
-  struct datum key = { NULL, 0 }, last_key = { NULL, 0 };
+  struct migrated_binding_sweep sweep = { m, FALSE };
+  int attempts = 0;
 
-  while (TRUE)
+  while (!sweep.finished)
     {
-      guint64 *oid = NULL;
+      gzochid_transaction_result result = gzochid_transaction_execute
+	(remove_migrated_bindings_tx, &sweep);
 
-      if (! g_queue_is_empty (m->pending_oids))
-	oid = g_queue_pop_head (m->pending_oids);
-      else
+      if (result == GZOCHID_TRANSACTION_SUCCESS)
+	attempts = 0;
+      else if (result != GZOCHID_TRANSACTION_SHOULD_RETRY
+	       || ++attempts == MAX_ATTEMPTS)
 	{
-	  last_key = key;
-	  key = next_key (m, last_key);
-	  
-	  free (last_key.data);
+	  g_critical ("Failed to remove migration progress bindings.");
+	  exit (EXIT_FAILURE);
+	}
+      else sweep.finished = FALSE;
+    }
+}
 
-	  if (key.data == NULL)
-	    break;
-	  else
-	    {
-	      gzochid_storage_transaction *tx =
-		m->context->storage_engine_interface->transaction_begin
-		(m->context->storage_context);
+/* Migrates the objects reachable from the bindings in the names store, one
+   batch of bindings at a time. The objects reachable from each batch are 
+   visited by the migration's worker threads in parallel; once they've all been
+   visited, the batch's last binding is recorded in the journal, and the next
+   batch is read. */
 
-	      size_t oid_len = 0;
-	      char *oid_bytes = NULL;
-	      guint64 encoded_oid = 0;
-	      
-	      oid_bytes = m->context->storage_engine_interface->transaction_get 
-		(tx, m->context->names, key.data, key.data_len, &oid_len);
+static void
+run_migration (struct migration *m, const char *journal_path)
+{
+  struct datum last_key = { NULL, 0 };
+  GArray *bound_oids = g_array_new (FALSE, FALSE, sizeof (guint64));
+  int i = 0;
 
-	      assert (oid_len == sizeof (guint64));
+  if (journal_path != NULL)
+    open_journal (m, journal_path, &last_key);
 
-	      memcpy (&encoded_oid, oid_bytes, sizeof (guint64));
+  for (; i < m->num_threads; i++)
+    {
+      struct migration_worker *worker =
+	calloc (1, sizeof (struct migration_worker));
 
-	      oid = malloc (sizeof (guint64));
-	      *oid = gzochid_util_decode_oid (encoded_oid);
-	      
-	      m->context->storage_engine_interface->transaction_rollback (tx);
-	    }
+      worker->migration = m;
+      worker->child_oids = g_array_new (FALSE, FALSE, sizeof (guint64));
+      m->threads[i] = g_thread_new ("migration-worker", run_worker, worker);
+    }
+
+  g_mutex_lock (&m->mutex);
+
+  /* Finish any work left over from an interrupted run before moving on. */
+
+  wait_for_workers (m);
+  
+  while (TRUE)
+    {
+      g_array_set_size (bound_oids, 0);
+      g_mutex_unlock (&m->mutex);
+
+      if (!next_bindings (m, &last_key, bound_oids))
+	{
+	  g_mutex_lock (&m->mutex);
+	  break;
 	}
       
-      migrate_object (m, *oid);
-      free (oid);
+      g_mutex_lock (&m->mutex);
+
+      /* Push the bound oids in reverse order, so that they are popped in key
+	 order. */
+      
+      for (i = bound_oids->len - 1; i >= 0; i--)
+	push_oid (m, g_array_index (bound_oids, guint64, i));
+
+      g_cond_broadcast (&m->cond);
+      wait_for_workers (m);
+
+      if (m->journal != NULL)
+	journal_bindings (m, &last_key);
     }
+
+  m->finished = TRUE;
+  g_cond_broadcast (&m->cond);
+  g_mutex_unlock (&m->mutex);
+
+  for (i = 0; i < m->num_threads; i++)
+    g_thread_join (m->threads[i]);
+
+  if (m->journal != NULL)
+    remove_migrated_bindings (m);
+
+  free (last_key.data);
+  g_array_free (bound_oids, TRUE);
 }
 
 static void
@@ -873,6 +1575,8 @@ report_stats (struct migration *m)
   fprintf (stderr, "Objects transformed: %" G_GUINT64_FORMAT "\n",
 	   m->num_transformed);
   fprintf (stderr, "Objects removed: %" G_GUINT64_FORMAT "\n", m->num_removed);
+  fprintf (stderr, "Objects per second: %.0f\n",
+	   objects_per_second (m, &m->end_time));
 }
 
 static struct migration_descriptor *
@@ -895,18 +1599,18 @@ create_migration_descriptor (const char *path)
 }
 
 static void
-migrate 
-(char *gzochid_conf_path, const char *path, gboolean dry_run, gboolean quiet)
+migrate (char *gzochid_conf_path, const char *path, gboolean dry_run,
+	 gboolean quiet, int num_threads, const char *journal_path)
 {
   struct migration *m = NULL;
   struct migration_descriptor *md = create_migration_descriptor (path);
 
   m = create_migration 
     (create_application_context (gzochid_conf_path, md->target), md, dry_run, 
-     quiet);
+     quiet, num_threads);
 
   gettimeofday (&m->start_time,  NULL);
-  run_migration (m);
+  run_migration (m, journal_path);
   gettimeofday (&m->end_time,  NULL);
   
   if (!m->quiet)
@@ -931,7 +1635,9 @@ static const struct option longopts[] =
     { "help", no_argument, NULL, 'h' },
     { "version", no_argument, NULL, 'v' },
     { "dry-run", no_argument, NULL, 'n' },
+    { "journal", required_argument, NULL, 'j' },
     { "quiet", no_argument, NULL, 'q' },
+    { "threads", required_argument, NULL, 't' },
     { NULL, 0, NULL, 0 }
   };
 
@@ -953,14 +1659,18 @@ static void
 print_help (const char *program_name)
 {
   fprintf (stderr, _("\
-Usage: %s [-c <CONF>] [-n] [-q] <MIGRATION_DESCRIPTOR>\n\
+Usage: %s [-c <CONF>] [-n | -j <JOURNAL>] [-q] [-t <THREADS>] \
+<MIGRATION_DESCRIPTOR>\n\
        %s [-h | -v]\n"), program_name, program_name);
   
   fputs ("", stderr);
   fputs (_("\
   -c, --config        full path to gzochid.conf\n\
   -n, --dry-run       run the migration without committing changes\n\
+  -j, --journal       record progress in the specified file, resuming the\n\
+                      migration it records if it exists\n\
   -q, --quiet         run without logging messages or stats\n\
+  -t, --threads       the number of objects to visit in parallel (default 4)\n\
   -h, --help          display this help and exit\n\
   -v, --version       display version information and exit\n"), stderr);
 
@@ -985,13 +1695,14 @@ inner_main (void *data, int argc, char *argv[])
 {
   int optc = 0;
   const char *program_name = argv[0];
-  char *gzochid_conf_path = NULL;
+  char *gzochid_conf_path = NULL, *journal_path = NULL;
   gboolean dry_run = FALSE;
   gboolean quiet = FALSE;
+  int num_threads = DEFAULT_NUM_THREADS;
   
   setlocale (LC_ALL, "");
   
-  while ((optc = getopt_long (argc, argv, "+c:nqhv", longopts, NULL)) != -1)
+  while ((optc = getopt_long (argc, argv, "+c:nj:qt:hv", longopts, NULL)) != -1)
     switch (optc)
       {
       case 'c':
@@ -1000,12 +1711,23 @@ inner_main (void *data, int argc, char *argv[])
       case 'n': 
 	dry_run = TRUE;
 	break;
+      case 'j':
+	journal_path = strdup (optarg);
+	break;
       case 'q':
 	quiet = TRUE;
 	g_log_set_handler 
 	  (NULL, G_LOG_LEVEL_MASK | G_LOG_FLAG_FATAL | G_LOG_FLAG_RECURSION, 
 	   null_log_handler, NULL);
 	break;
+      case 't':
+	num_threads = atoi (optarg);
+	if (num_threads < 1)
+	  {
+	    fprintf (stderr, "Invalid number of threads: %s\n", optarg);
+	    exit (EXIT_FAILURE);
+	  }
+	break;
 
       case 'v':
 	print_version ();
@@ -1017,7 +1739,7 @@ inner_main (void *data, int argc, char *argv[])
 	break;
       }
 
-  if (optind != argc - 1)
+  if (optind != argc - 1 || (dry_run && journal_path != NULL))
     {
       print_help (program_name);
       exit (EXIT_FAILURE);
@@ -1025,7 +1747,8 @@ inner_main (void *data, int argc, char *argv[])
   else 
     {
       initialize_scheme_bindings ();
-      migrate (gzochid_conf_path, argv[optind], dry_run, quiet);
+      migrate (gzochid_conf_path, argv[optind], dry_run, quiet, num_threads,
+	       journal_path);
     }
 }
 
@@ -54,6 +54,37 @@ struct _gzochid_storage_transaction
 
 typedef struct _gzochid_storage_transaction gzochid_storage_transaction;
 
+/* A cursor over the keys in a store, in order, within the scope of a 
+   transaction. The cursor must be closed before the transaction is committed or
+   rolled back. */
+
+struct _gzochid_storage_cursor
+{
+  gzochid_storage_transaction *transaction;
+  gzochid_storage_store *store;
+  gpointer cursor; /* Engine-specific cursor state. */
+};
+
+typedef struct _gzochid_storage_cursor gzochid_storage_cursor;
+
+/* A key-value pair, as passed to the bulk storage functions. */
+
+struct _gzochid_storage_pair
+{
+  char *key;
+  size_t key_len;
+  char *value;
+  size_t value_len;
+};
+
+typedef struct _gzochid_storage_pair gzochid_storage_pair;
+
+/* A function that receives the name and formatted value of a storage engine
+   statistic, along with a user data pointer. */
+
+typedef void (*gzochid_storage_stat_func) (const char *, const char *,
+					   gpointer);
+
 /* The interface provided by storage engine modules. */
 
 struct _gzochid_storage_engine_interface
@@ -99,8 +130,90 @@ struct _gzochid_storage_engine_interface
   char *(*transaction_first_key)
     (gzochid_storage_transaction *, gzochid_storage_store *, size_t *);
   char *(*transaction_next_key)
-    (gzochid_storage_transaction *, gzochid_storage_store *, char *, size_t, 
+    (gzochid_storage_transaction *, gzochid_storage_store *, char *, size_t,
      size_t *);
+
+  /* Open a cursor on the specified store within the specified transaction,
+     positioned before the first key. */
+
+  gzochid_storage_cursor *(*transaction_cursor_open)
+    (gzochid_storage_transaction *, gzochid_storage_store *);
+
+  /* Position the specified cursor before the first key greater than or equal
+     to the specified key. (To position a cursor after a key, seek to that key
+     with a NUL byte appended.) */
+
+  void (*cursor_seek) (gzochid_storage_cursor *, char *, size_t);
+
+  /* Advance the specified cursor and return its key, setting the key length
+     and the value and value length arguments (which may be `NULL') to the
+     associated value. The key and value should be freed via `free' when no
+     longer needed. Returns `NULL' when there are no more keys, or if the
+     enclosing transaction fails (in which case the transaction will be marked
+     for rollback). Engines may retrieve and buffer several key-value pairs at
+     a time. */
+
+  char *(*cursor_next)
+    (gzochid_storage_cursor *, size_t *, char **, size_t *);
+
+  /* Close the specified cursor, releasing its resources. */
+
+  void (*cursor_close) (gzochid_storage_cursor *);
+
+  /* Hint that the specified key in the specified store is likely to be read in
+     the specified transaction in the near future. Engines for which fetching a
+     value is expensive (e.g., because it involves a network round trip) may
+     begin retrieving it and return immediately, without waiting for the
+     retrieval to complete. This function is optional and may be `NULL'. */
+
+  void (*transaction_prefetch)
+    (gzochid_storage_transaction *, gzochid_storage_store *, char *, size_t);
+
+  /* Begin a transaction that will only read from the database. Engines may 
+     give such a transaction a consistent snapshot of the database instead of
+     taking read locks, so that it neither blocks nor is blocked by writers.
+     This function is optional and may be `NULL', in which case read-only
+     transactions are begun via `transaction_begin'. */
+
+  gzochid_storage_transaction *(*transaction_begin_read_only)
+    (gzochid_storage_context *);
+
+  /* Configure the engine from the specified table of settings, which is 
+     typically the section of the server configuration file that names the
+     engine. This function is called once, when the engine is loaded, before
+     any storage contexts are initialized. It is optional and may be `NULL'. */
+
+  void (*configure) (GHashTable *);
+
+  /* Report statistics for the specified storage context by invoking the 
+     specified function once for each statistic, with its name, its formatted
+     value, and the specified user data pointer. This function is optional and
+     may be `NULL'. */
+
+  void (*context_stats)
+    (gzochid_storage_context *, gzochid_storage_stat_func, gpointer);
+
+  /* Store the specified array of key-value pairs in the specified store within
+     the specified transaction, as if by calling `transaction_put' for each
+     pair. This function is intended for populating a store in bulk (e.g., from
+     a dump file) and should not be mixed with other operations on the same
+     keys within a transaction; engines are not required to make the stored
+     pairs visible to subsequent reads in the transaction. The pairs will
+     usually be in ascending key order, and engines may optimize for this case
+     (e.g., by appending to the store without searching it), but must accept
+     pairs in any order. This function is optional and may be `NULL'. */
+
+  void (*transaction_put_bulk)
+    (gzochid_storage_transaction *, gzochid_storage_store *,
+     gzochid_storage_pair *, size_t);
+
+  /* Returns `TRUE' if the transactions begun in the specified storage context
+     via `transaction_begin_read_only' read from a snapshot of the database, 
+     such that they neither block nor are blocked by writers; `FALSE' if they
+     take read locks like other transactions. This function is optional and 
+     may be `NULL', which is equivalent to returning `FALSE'. */
+
+  gboolean (*context_snapshot_reads) (gzochid_storage_context *);
 };
 
 typedef struct _gzochid_storage_engine_interface 
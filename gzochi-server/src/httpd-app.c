@@ -24,13 +24,17 @@
 #include <string.h>
 
 #include "app.h"
+#include "backup.h"
 #include "config.h"
 #include "event.h"
 #include "event-app.h"
 #include "game.h"
+#include "game-protocol.h"
 #include "httpd.h"
 #include "httpd-app.h"
 #include "resolver.h"
+#include "storage.h"
+#include "threads.h"
 #include "util.h"
 
 #define HEADER "  <head><title>gzochid v" VERSION "</title></head>"
@@ -42,6 +46,12 @@
 #define OID_SUFFIX_LEN 29
 #define OID_LINE_LEN 80
 
+/* The default and maximum number of keys listed per page when listing the
+   contents of a store. */
+
+#define LIST_KEYS_DEFAULT_LIMIT 100
+#define LIST_KEYS_MAX_LIMIT 1000
+
 /* Holds information about the current meta server connection. */
 
 struct _gzochid_metaserver_info
@@ -220,8 +230,9 @@ next_line (struct data_state *state)
    specified maximum character count. */
 
 static ssize_t 
-write_data_line (struct data_state *state, char *buf, size_t max)
+write_data_line (gpointer data, char *buf, size_t max)
 {
+  struct data_state *state = data;
   int n = 0;
 
   /* If there is no current line, render one to the state buffer. */
@@ -397,6 +408,64 @@ bind_app (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
   return app_context;
 }
 
+/* A `gzochid_storage_stat_func' that appends a table row for a storage engine
+   statistic to the specified `GString'. */
+
+static void
+append_storage_stat (const char *name, const char *value, gpointer user_data)
+{
+  GString *response_str = user_data;
+
+  g_string_append (response_str, "      <tr>\n");
+  g_string_append_printf (response_str, "        <td>%s</td>\n", name);
+  g_string_append_printf (response_str, "        <td>%s</td>\n", value);
+  g_string_append (response_str, "      </tr>\n");
+}
+
+/* Appends a table of the send queue lengths of the specified application's
+   connected clients to the specified `GString'. */
+
+static void
+append_client_send_queues (GString *response_str,
+			   gzochid_application_context *app_context)
+{
+  GHashTableIter iter;
+  gpointer key = NULL, value = NULL;
+
+  g_string_append (response_str, "    <h2>Client send queues</h2>\n");
+  g_string_append (response_str, "    <table>\n");
+  g_string_append (response_str, "      <tr>\n");
+  g_string_append (response_str, "        <th>Session</th>\n");
+  g_string_append (response_str, "        <th>Queued bytes</th>\n");
+  g_string_append (response_str, "        <th>Congested</th>\n");
+  g_string_append (response_str, "      </tr>\n");
+
+  g_mutex_lock (&app_context->client_mapping_lock);
+  g_hash_table_iter_init (&iter, app_context->oids_to_clients);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      guint64 *session_oid = key;
+      gzochid_game_client *client = value;
+
+      g_string_append (response_str, "      <tr>\n");
+      g_string_append_printf
+	(response_str, "        <td>%" G_GUINT64_FORMAT "</td>\n",
+	 *session_oid);
+      g_string_append_printf
+	(response_str, "        <td>%" G_GSIZE_FORMAT "</td>\n",
+	 gzochid_game_client_get_send_queue_length (client));
+      g_string_append_printf
+	(response_str, "        <td>%s</td>\n",
+	 gzochid_game_client_is_congested (client) ? "yes" : "no");
+      g_string_append (response_str, "      </tr>\n");
+    }
+
+  g_mutex_unlock (&app_context->client_mapping_lock);
+
+  g_string_append (response_str, "    </table>\n");
+}
+
 static void 
 app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
 	  gpointer request_context, gpointer user_data)
@@ -424,6 +493,10 @@ app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
       g_string_append_printf 
 	(response_str, "    <a href=\"/app/%s/oids/\">oids</a><br />\n", 
 	 app_context->descriptor->name);
+      g_string_append_printf 
+	(response_str, "    <form method=\"post\" action=\"/app/%s/backup\">"
+	 "<input type=\"submit\" value=\"backup\" /></form>\n",
+	 app_context->descriptor->name);
     }
   
   g_string_append (response_str, "    <h2>Application statistics</h2>\n");
@@ -450,6 +523,46 @@ app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
   g_string_append_printf (response_str, "        <td>%u</td>\n", 
 			  app_context->stats->num_messages_sent);
   g_string_append (response_str, "      </tr>\n");
+  g_string_append (response_str, "      <tr>\n");
+  g_string_append (response_str, "        <td>Messages dropped</td>\n");
+  g_string_append_printf (response_str, "        <td>%u</td>\n", 
+			  app_context->stats->num_messages_dropped);
+  g_string_append (response_str, "      </tr>\n");
+
+  g_string_append (response_str, "      <tr>\n");
+  g_string_append (response_str, "        <td>Logins</td>\n");
+  g_string_append_printf (response_str, "        <td>%u</td>\n",
+			  app_context->stats->num_logins);
+  g_string_append (response_str, "      </tr>\n");
+  g_string_append (response_str, "      <tr>\n");
+  g_string_append (response_str, "        <td>Login failures</td>\n");
+  g_string_append_printf (response_str, "        <td>%u</td>\n",
+			  app_context->stats->num_login_failures);
+  g_string_append (response_str, "      </tr>\n");
+  g_string_append (response_str, "      <tr>\n");
+  g_string_append (response_str, "        <td>Logins rejected</td>\n");
+  g_string_append_printf (response_str, "        <td>%u</td>\n",
+			  app_context->stats->num_logins_rejected);
+  g_string_append (response_str, "      </tr>\n");
+
+  if (app_context->stats->num_logins > 0)
+    {
+      g_string_append (response_str, "      <tr>\n");
+      g_string_append
+	(response_str, "        <td>Maximum login latency</td>\n");
+      g_string_append_printf
+	(response_str, "        <td>%lu</td>\n",
+	 app_context->stats->max_login_latency);
+      g_string_append (response_str, "      </tr>\n");
+
+      g_string_append (response_str, "      <tr>\n");
+      g_string_append
+	(response_str, "        <td>Average login latency</td>\n");
+      g_string_append_printf
+	(response_str, "        <td>%.2f</td>\n",
+	 app_context->stats->average_login_latency);
+      g_string_append (response_str, "      </tr>\n");
+    }
 
   g_string_append (response_str, "      <tr>\n");
   g_string_append (response_str, "        <td>Transactions started</td>\n");
@@ -467,6 +580,30 @@ app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
   g_string_append_printf (response_str, "        <td>%u</td>\n", 
 			  app_context->stats->num_transactions_rolled_back);
   g_string_append (response_str, "      </tr>\n");
+  g_string_append (response_str, "      <tr>\n");
+  g_string_append (response_str, "        <td>Transactions retried</td>\n");
+  g_string_append_printf (response_str, "        <td>%u</td>\n", 
+			  app_context->stats->num_transactions_retried);
+  g_string_append (response_str, "      </tr>\n");
+
+  if (app_context->stats->num_transactions_retried > 0)
+    {
+      g_string_append (response_str, "      <tr>\n");
+      g_string_append
+	(response_str, "        <td>Total retry backoff delay</td>\n");
+      g_string_append_printf 
+	(response_str, "        <td>%.3f</td>\n", 
+	 app_context->stats->total_retry_delay_us / 1000.0);
+      g_string_append (response_str, "      </tr>\n");
+
+      g_string_append (response_str, "      <tr>\n");
+      g_string_append
+	(response_str, "        <td>Maximum retry backoff delay</td>\n");
+      g_string_append_printf 
+	(response_str, "        <td>%.3f</td>\n", 
+	 app_context->stats->max_retry_delay_us / 1000.0);
+      g_string_append (response_str, "      </tr>\n");
+    }
 
   if (app_context->stats->num_transactions_committed > 0)
     {
@@ -474,7 +611,7 @@ app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
       g_string_append
 	(response_str, "        <td>Maximum transaction duration</td>\n");
       g_string_append_printf 
-	(response_str, "        <td>%ld</td>\n", 
+	(response_str, "        <td>%lu</td>\n", 
 	 app_context->stats->max_transaction_duration);
       g_string_append (response_str, "      </tr>\n");
 
@@ -482,7 +619,7 @@ app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
       g_string_append
 	(response_str, "        <td>Minimum transaction duration</td>\n");
       g_string_append_printf 
-	(response_str, "        <td>%ld</td>\n", 
+	(response_str, "        <td>%lu</td>\n", 
 	 app_context->stats->min_transaction_duration);
       g_string_append (response_str, "      </tr>\n");
 
@@ -496,6 +633,19 @@ app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
     }
 
   g_string_append (response_str, "    </table>\n");
+
+  append_client_send_queues (response_str, app_context);
+  
+  if (app_context->storage_engine_interface->context_stats != NULL)
+    {
+      g_string_append
+	(response_str, "    <h2>Storage engine statistics</h2>\n");
+      g_string_append (response_str, "    <table>\n");
+      app_context->storage_engine_interface->context_stats
+	(app_context->storage_context, append_storage_stat, response_str);
+      g_string_append (response_str, "    </table>\n");
+    }
+  
   append_footer (response_str);
 
   gzochid_http_write_response
@@ -504,62 +654,404 @@ app_info (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
   g_string_free (response_str, TRUE);
 }
 
+/* A key read from a store, along with its value, if it was requested. */
+
+struct store_entry
+{
+  GBytes *key; /* The key. */
+  GBytes *value; /* The value, or `NULL' if values were not read. */
+};
+
 static void
-list_oids (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
-	   gpointer request_context, gpointer user_data)
+free_store_entry (gpointer data)
 {
-  gzochid_application_context *app_context = request_context;
-  GString *response_str = g_string_new (NULL);
+  struct store_entry *entry = data;
+
+  g_bytes_unref (entry->key);
+  if (entry->value != NULL)
+    g_bytes_unref (entry->value);
+
+  free (entry);
+}
+
+/*
+  Returns a list of up to the specified number of entries from the specified 
+  store, as `struct store_entry' pointers, starting immediately after the 
+  specified key, or from the first key in the store if the specified key is 
+  `NULL'. Values are only read if requested. 
+
+  The entries are read via a cursor in a single, short-lived, read-only 
+  transaction, so that the store is not held up while the entries are 
+  rendered. The cursor seeks directly to the starting key, so the cost of 
+  reading a page doesn't depend on how far into the store it is.
+
+  If the transaction is rolled back before the page has been read, `NULL' is 
+  returned and the specified `failed' flag is set to `TRUE', so that a partial
+  page isn't mistaken for the end of the store.
+
+  The returned list should be freed via `g_list_free_full' with 
+  `free_store_entry' when no longer needed.
+*/
+
+static GList *
+next_entries (gzochid_application_context *app_context,
+	      gzochid_storage_store *store, GBytes *after, int limit,
+	      gboolean with_values, gboolean *failed)
+{
+  GList *entries = NULL;
+  gzochid_storage_engine_interface *iface =
+    app_context->storage_engine_interface;
+  gzochid_storage_transaction *tx = gzochid_storage_transaction_begin_read_only
+    (iface, app_context->storage_context);
+  gzochid_storage_cursor *cursor = iface->transaction_cursor_open (tx, store);
+
+  char *k = NULL, *v = NULL;
+  size_t klen = 0, vlen = 0;
+  int n = 0;
   
-  size_t klen = 0;
-  gzochid_storage_transaction *tx = app_context->storage_engine_interface
-    ->transaction_begin (app_context->storage_context);
-  char *k = app_context->storage_engine_interface
-    ->transaction_first_key (tx, app_context->oids, &klen);
+  if (after != NULL)
+    {
+      size_t after_len = 0;
+      const char *after_data = g_bytes_get_data (after, &after_len);
 
-  app_context->storage_engine_interface->transaction_rollback (tx);
+      /* Seek to the key with a NUL byte appended, which is the smallest key
+	 that follows it. */
+      
+      char *seek_key = calloc (after_len + 1, sizeof (char));
+      
+      memcpy (seek_key, after_data, after_len);
+      iface->cursor_seek (cursor, seek_key, after_len + 1);
+      free (seek_key);
+    }
+
+  while (n < limit
+	 && (k = iface->cursor_next
+	     (cursor, &klen, with_values ? &v : NULL,
+	      with_values ? &vlen : NULL)) != NULL)
+    {
+      struct store_entry *entry = malloc (sizeof (struct store_entry));
+
+      entry->key = g_bytes_new_take (k, klen);
+      entry->value = with_values ? g_bytes_new_take (v, vlen) : NULL;
+      
+      entries = g_list_prepend (entries, entry);
+      n++;
+    }
+
+  *failed = tx->rollback;
+  
+  iface->cursor_close (cursor);
+  iface->transaction_rollback (tx);
+
+  if (*failed)
+    {
+      g_list_free_full (entries, free_store_entry);
+      return NULL;
+    }
+  else return g_list_reverse (entries);
+}
+
+/* Appends the specified bytes to the specified buffer as a JSON string. Bytes
+   that aren't part of a valid UTF-8 string are escaped as if they were 
+   Latin-1 characters. */
+
+static void
+append_json_string (GString *str, const char *s, size_t len)
+{
+  gboolean valid = g_utf8_validate (s, len, NULL);
+  size_t i = 0;
+
+  g_string_append_c (str, '"');
+
+  for (; i < len; i++)
+    {
+      unsigned char c = s[i];
+
+      if (c == '"' || c == '\\')
+	{
+	  g_string_append_c (str, '\\');
+	  g_string_append_c (str, c);
+	}
+      else if (c < 0x20 || (c >= 0x80 && !valid))
+	g_string_append_printf (str, "\\u%04x", c);
+      else g_string_append_c (str, c);
+    }
+
+  g_string_append_c (str, '"');
+}
+
+/* Appends the oid encoded in the specified store key to the specified buffer
+   as a JSON string, in hexadecimal. */
+
+static void
+append_json_oid (GString *str, GBytes *key)
+{
+  size_t klen = 0;
+  const char *k = g_bytes_get_data (key, &klen);
+  guint64 encoded_oid = 0;
 
   assert (klen == sizeof (guint64));  
+  memcpy (&encoded_oid, k, sizeof (guint64));
 
-  append_header (response_str);
-  g_string_append_printf 
-    (response_str, "    <h1>%s</h1><br />\n", app_context->descriptor->name);
-  g_string_append (response_str, "    <ul>\n");
+  g_string_append_printf
+    (str, "\"%" G_GINT64_MODIFIER "x\"", gzochid_util_decode_oid (encoded_oid));
+}
+
+/* Appends the name in the specified names store key - minus its terminating
+   NUL byte - to the specified buffer as a JSON string. */
+
+static void
+append_json_name (GString *str, GBytes *key)
+{
+  size_t klen = 0;
+  const char *k = g_bytes_get_data (key, &klen);
+
+  append_json_string (str, k, klen > 0 && k[klen - 1] == 0 ? klen - 1 : klen);
+}
+
+/* Renders an entry from the oids store as a JSON value. The object data is not
+   read; it can be fetched lazily, one object at a time, via the oid. */
+
+static void
+render_oid_entry (GString *str, struct store_entry *entry)
+{
+  append_json_oid (str, entry->key);
+}
+
+/* Renders an entry from the names store as a JSON object giving the name and
+   the oid to which it's bound. */
+
+static void
+render_name_entry (GString *str, struct store_entry *entry)
+{
+  g_string_append (str, "{\"name\":");
+  append_json_name (str, entry->key);
+  g_string_append (str, ",\"oid\":");
+  append_json_oid (str, entry->value);
+  g_string_append_c (str, '}');
+}
+
+/* The progress of a key listing through its JSON rendering. */
+
+enum key_listing_position
+  {
+    KEY_LISTING_START, /* Nothing has been rendered. */
+    KEY_LISTING_ENTRIES, /* The entries are being rendered. */
+    KEY_LISTING_END, /* The entries have all been rendered. */
+    KEY_LISTING_DONE /* The listing has been completely rendered. */
+  };
+
+/* The state of a page of entries from a store being streamed to an HTTP client
+   as a JSON object of the form:
+
+   { "<name>": [<entry>, ...], "next": <cursor> }
+
+   ...where the cursor is the key of the last entry on the page - to be passed
+   as the `after' argument of the request for the next page - or `null' if 
+   there are no further pages. */
+
+struct key_listing
+{
+  const char *name; /* The name of the array of entries. */
+
+  /* Renders an entry as a JSON value. */
+
+  void (*render_entry) (GString *, struct store_entry *); 
+
+  /* Renders the key of an entry as a JSON value for use as a cursor. */
+
+  void (*render_cursor) (GString *, GBytes *);
   
-  while (k != NULL)
+  GList *entries; /* The entries on the page. */
+  GList *next_entry; /* The next entry to render. */
+  gboolean more; /* Whether there are entries beyond the page. */
+
+  enum key_listing_position position; /* The rendering progress. */
+
+  GString *chunk; /* The most recently rendered part of the listing. */
+  size_t chunk_offset; /* The number of bytes of the chunk already written. */
+};
+
+static void
+free_key_listing (gpointer data)
+{
+  struct key_listing *listing = data;
+
+  g_list_free_full (listing->entries, free_store_entry);
+  g_string_free (listing->chunk, TRUE);
+  free (listing);
+}
+
+/* Renders the next part of the specified listing - its header, a single entry,
+   or its trailer - to the listing's chunk buffer. */
+
+static void
+render_next_chunk (struct key_listing *listing)
+{
+  g_string_truncate (listing->chunk, 0);
+  listing->chunk_offset = 0;
+
+  if (listing->position == KEY_LISTING_START)
     {
-      guint64 encoded_oid = 0;
-      char *next_k = NULL;
+      g_string_append_printf (listing->chunk, "{\"%s\":[", listing->name);
+      listing->position = KEY_LISTING_ENTRIES;
+    }
+  else if (listing->position == KEY_LISTING_ENTRIES)
+    {
+      if (listing->next_entry != listing->entries)
+	g_string_append_c (listing->chunk, ',');
+      
+      listing->render_entry (listing->chunk, listing->next_entry->data);
+      listing->next_entry = listing->next_entry->next;
+    }
+  else if (listing->position == KEY_LISTING_END)
+    {
+      g_string_append (listing->chunk, "],\"next\":");
 
-      memcpy (&encoded_oid, k, sizeof (guint64));
-            
-      g_string_append (response_str, "      <li><a href=\"");
-      g_string_append_printf
-	(response_str, "%" G_GUINT64_FORMAT,
-	 gzochid_util_decode_oid (encoded_oid));
-      g_string_append (response_str, "\">");
-      g_string_append_printf
-	(response_str, "%" G_GUINT64_FORMAT,
-	 gzochid_util_decode_oid (encoded_oid));
-      g_string_append (response_str, "</a></li>\n");
-
-      tx = app_context->storage_engine_interface
-	->transaction_begin (app_context->storage_context);      
-      next_k = app_context->storage_engine_interface->transaction_next_key
-	(tx, app_context->oids, k, klen, &klen);
-      app_context->storage_engine_interface->transaction_rollback (tx);
+      if (listing->more)
+	listing->render_cursor
+	  (listing->chunk,
+	   ((struct store_entry *) g_list_last (listing->entries)->data)->key);
+      else g_string_append (listing->chunk, "null");
+
+      g_string_append (listing->chunk, "}\n");
+      listing->position = KEY_LISTING_DONE;
+    }
+
+  if (listing->position == KEY_LISTING_ENTRIES && listing->next_entry == NULL)
+    listing->position = KEY_LISTING_END;
+}
+
+/* A `gzochid_http_response_producer' that writes as much of the specified 
+   listing as will fit in the specified buffer, rendering it one chunk at a
+   time as it goes. */
+
+static ssize_t
+write_key_listing (gpointer data, char *buf, size_t max)
+{
+  struct key_listing *listing = data;
+  size_t written = 0;
+
+  while (written < max)
+    {
+      size_t n = 0;
       
-      free (k);
-      k = next_k;
+      if (listing->chunk_offset == listing->chunk->len)
+	{
+	  if (listing->position == KEY_LISTING_DONE)
+	    break;
+	  else render_next_chunk (listing);
+	}
+
+      n = MIN (max - written, listing->chunk->len - listing->chunk_offset);
+      memcpy (buf + written, listing->chunk->str + listing->chunk_offset, n);
+
+      listing->chunk_offset += n;
+      written += n;
     }
+
+  return written > 0 ? (ssize_t) written : -1;
+}
+
+/* Returns the page size requested via the `limit' argument of the request 
+   being handled via the specified sink, within the bounds of the maximum page
+   size. */
+
+static int
+parse_limit (gzochid_http_response_sink *sink)
+{
+  const char *limit_str = gzochid_http_get_argument (sink, "limit");
+  long limit = limit_str != NULL ? strtol (limit_str, NULL, 10) : 0;
+
+  if (limit <= 0)
+    return LIST_KEYS_DEFAULT_LIMIT;
+  else return MIN (limit, LIST_KEYS_MAX_LIMIT);
+}
+
+/* Reads the page of entries following the specified key (which may be `NULL')
+   from the specified store, and streams it to the specified sink as a JSON 
+   listing with the specified name, rendered via the specified functions. */
+
+static void
+write_key_listing_response (gzochid_http_response_sink *sink,
+			    gzochid_application_context *app_context,
+			    gzochid_storage_store *store, GBytes *after,
+			    gboolean with_values, const char *name,
+			    void (*render_entry)
+			    (GString *, struct store_entry *),
+			    void (*render_cursor) (GString *, GBytes *))
+{
+  struct key_listing *listing = NULL;
+  gboolean failed = FALSE;
+  int limit = parse_limit (sink);
+
+  /* Read one entry past the end of the page to find out whether there's 
+     another page after it. */
   
-  g_string_append (response_str, "    </ul>\n");
-  append_footer (response_str);
+  GList *entries = next_entries
+    (app_context, store, after, limit + 1, with_values, &failed);
 
-  gzochid_http_write_response
-    (sink, 200, response_str->str, response_str->len);
+  if (failed)
+    {
+      gzochid_http_write_response
+	(sink, 503, "<html><body>Service unavailable.</body></html>", 46);
+      return;
+    }
+  
+  listing = calloc (1, sizeof (struct key_listing));
+  listing->entries = entries;
+  
+  if ((int) g_list_length (listing->entries) > limit)
+    {
+      GList *last = g_list_last (listing->entries);
 
-  g_string_free (response_str, TRUE);
+      free_store_entry (last->data);
+      listing->entries = g_list_delete_link (listing->entries, last);
+      listing->more = TRUE;
+    }
+
+  listing->name = name;
+  listing->render_entry = render_entry;
+  listing->render_cursor = render_cursor;
+  listing->next_entry = listing->entries;
+  listing->position = KEY_LISTING_START;
+  listing->chunk = g_string_new (NULL);
+  
+  gzochid_http_write_response_stream
+    (sink, 200, "application/json", write_key_listing, listing,
+     free_key_listing);
+}
+
+static void
+list_oids (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
+	   gpointer request_context, gpointer user_data)
+{
+  gzochid_application_context *app_context = request_context;
+  const char *after_str = gzochid_http_get_argument (sink, "after");
+  GBytes *after = NULL;
+
+  if (after_str != NULL)
+    {
+      char *end = NULL;
+      guint64 oid = g_ascii_strtoull (after_str, &end, 16);
+      guint64 encoded_oid = gzochid_util_encode_oid (oid);
+      
+      if (*after_str == 0 || *end != 0)
+	{
+	  gzochid_http_write_response
+	    (sink, 400, "<html><body>Bad request.</body></html>", 38);
+	  return;
+	}
+      
+      after = g_bytes_new (&encoded_oid, sizeof (guint64));
+    }
+
+  write_key_listing_response
+    (sink, app_context, app_context->oids, after, FALSE, "oids",
+     render_oid_entry, append_json_oid);
+
+  if (after != NULL)
+    g_bytes_unref (after);
 }
 
 static void
@@ -569,8 +1061,8 @@ render_oid (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
   size_t data_length = 0;
   char *oid_str = g_match_info_fetch (match_info, 1);
   gzochid_application_context *app_context = request_context;
-  gzochid_storage_transaction *tx = app_context->storage_engine_interface
-    ->transaction_begin (app_context->storage_context);
+  gzochid_storage_transaction *tx = gzochid_storage_transaction_begin_read_only
+    (app_context->storage_engine_interface, app_context->storage_context);
   guint64 oid = gzochid_util_encode_oid (g_ascii_strtoull (oid_str, NULL, 16)); 
   char *data = app_context->storage_engine_interface->transaction_get
     (tx, app_context->oids, (char *) &oid, sizeof (guint64), &data_length);
@@ -583,20 +1075,15 @@ render_oid (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
     not_found404_default (sink);
   else
     {
-      char buf[256];
-      ssize_t len = 0;
-      GString *response = g_string_new (NULL);
       struct data_state *state = calloc (1, sizeof (struct data_state));
 
       state->data = data;
       state->data_length = data_length;
 
-      while ((len = write_data_line (state, buf, 256)) >= 0)
-	g_string_append_len (response, buf, len);
-
-      free_data_state (state);
-      gzochid_http_write_response (sink, 200, response->str, response->len);
-      g_string_free (response, TRUE);
+      /* The hex dump is rendered a line at a time as the client reads it. */
+      
+      gzochid_http_write_response_stream
+	(sink, 200, "text/html", write_data_line, state, free_data_state);
     }
 }
 
@@ -604,49 +1091,160 @@ static void
 list_names (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
 	    gpointer request_context, gpointer user_data)
 {
-  GString *response_str = g_string_new (NULL);
-  
-  size_t klen = 0;
   gzochid_application_context *app_context = request_context;
-  gzochid_storage_transaction *tx = app_context->storage_engine_interface
-    ->transaction_begin (app_context->storage_context);
-  char *k = app_context->storage_engine_interface
-    ->transaction_first_key (tx, app_context->names, &klen);
+  const char *after_str = gzochid_http_get_argument (sink, "after");
+  GBytes *after = NULL;
 
-  app_context->storage_engine_interface->transaction_rollback (tx);
+  /* Keys in the names store include the name's terminating NUL byte. */
+  
+  if (after_str != NULL)
+    after = g_bytes_new (after_str, strlen (after_str) + 1);
+
+  write_key_listing_response
+    (sink, app_context, app_context->names, after, TRUE, "names",
+     render_name_entry, append_json_name);
+
+  if (after != NULL)
+    g_bytes_unref (after);
+}
+
+/* The state of the console's backup service. */
+
+struct backup_service
+{
+  char *dir; /* The directory under which backups are written. */
+
+  /* Runs backups one at a time, off the HTTP server's thread. */
+
+  GThreadPool *pool; 
 
+  GHashTable *pending; /* The names of the applications being backed up. */
+  GMutex mutex; /* Protects the set of pending backups. */
+};
+
+/* A backup of an application, waiting to be run by the backup service. */
+
+struct backup_request
+{
+  struct backup_service *service; /* The backup service. */
+  gzochid_application_context *app_context; /* The application to back up. */
+  char *dir; /* The directory to back up to. */
+};
+
+/* A `gzochid_thread_worker' that runs the specified backup request on a thread
+   of the backup service's pool, and logs the outcome. */
+
+static void
+backup_worker (gpointer data, gpointer user_data)
+{
+  struct backup_request *request = data;
+  struct backup_service *service = request->service;
+  const char *name = request->app_context->descriptor->name;
+  gzochid_backup_stats stats;
+  GError *err = NULL;
+
+  if (gzochid_backup_application (request->app_context, request->dir, &stats,
+				  &err))
+    g_message
+      ("Backed up application %s to %s: %lu meta, %lu oids, and %lu names "
+       "records.", name, request->dir, stats.num_meta_records,
+       stats.num_oids_records, stats.num_names_records);
+  else
+    {
+      g_warning ("Backup of application %s failed: %s", name, err->message);
+      g_error_free (err);
+    }
+
+  g_mutex_lock (&service->mutex);
+  g_hash_table_remove (service->pending, name);
+  g_mutex_unlock (&service->mutex);
+
+  g_free (request->dir);
+  free (request);
+}
+
+/* Starts writing a snapshot of the bound application's stores to a new, 
+   timestamped directory under the directory of the backup service given by 
+   the user data, and renders a page saying so. A backup reads every record in
+   the application's stores, so it must be requested via POST, and it is run
+   in the background; its outcome is written to the server log. */
+
+static void
+backup_app (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
+	    gpointer request_context, gpointer user_data)
+{
+  GString *response_str = g_string_new (NULL);
+  gzochid_application_context *app_context = request_context;
+  struct backup_service *service = user_data;
+  const char *name = app_context->descriptor->name;
+  int code = 202;
+  
   append_header (response_str);
-  g_string_append_printf 
-    (response_str, "    <h1>%s</h1><br />\n", app_context->descriptor->name);
-  g_string_append (response_str, "    <ul>\n");
+  g_string_append_printf (response_str, "    <h1>%s</h1>\n", name);
 
-  while (k != NULL)
+  g_mutex_lock (&service->mutex);
+
+  if (strcmp (gzochid_http_get_method (sink), "POST") != 0)
     {
-      char *next_k = NULL;
+      code = 405;
+      g_string_append
+	(response_str, "    <p>Backups must be requested via POST.</p>\n");
+    }
+  else if (g_hash_table_contains (service->pending, name))
+    {
+      code = 409;
+      g_string_append
+	(response_str, "    <p>A backup is already in progress.</p>\n");
+    }
+  else
+    {
+      struct backup_request *request = malloc (sizeof (struct backup_request));
+      GDateTime *now = g_date_time_new_now_local ();
+      gchar *timestamp = g_date_time_format (now, "%Y%m%d-%H%M%S");
 
-      g_string_append (response_str, "      <li>");
-      g_string_append_len (response_str, k, klen);
-      g_string_append (response_str, "</li>\n");
+      request->service = service;
+      request->app_context = app_context;
+      request->dir = g_strconcat
+	(service->dir, "/", name, "/", timestamp, NULL);
 
-      tx = app_context->storage_engine_interface
-	->transaction_begin (app_context->storage_context);      
-      next_k = app_context->storage_engine_interface->transaction_next_key
-	(tx, app_context->names, k, klen, &klen);
-      app_context->storage_engine_interface->transaction_rollback (tx);
-      
-      free (k);
-      k = next_k;
+      g_message ("Backing up application %s to %s.", name, request->dir);
+      g_string_append_printf
+	(response_str, "    <p>Backing up to %s. The outcome will be written "
+	 "to the server log.</p>\n", request->dir);
+
+      g_hash_table_add (service->pending, (gpointer) name);
+      gzochid_thread_pool_push (service->pool, backup_worker, request, NULL);
+
+      g_free (timestamp);
+      g_date_time_unref (now);
     }
 
-  g_string_append (response_str, "    </ul>\n");
+  g_mutex_unlock (&service->mutex);
+
   append_footer (response_str);
 
   gzochid_http_write_response
-    (sink, 200, response_str->str, response_str->len);
+    (sink, code, response_str->str, response_str->len);
 
   g_string_free (response_str, TRUE);
 }
 
+/* Constructs and returns a new backup service that writes backups under the
+   specified directory. */
+
+static struct backup_service *
+backup_service_new (const char *dir)
+{
+  struct backup_service *service = malloc (sizeof (struct backup_service));
+
+  service->dir = strdup (dir);
+  service->pool = gzochid_thread_pool_new (NULL, 1, FALSE, NULL);
+  service->pending = g_hash_table_new (g_str_hash, g_str_equal);
+  g_mutex_init (&service->mutex);
+
+  return service;
+}
+
 /* A no-op continuation used to root a `gzochid_httpd_partial' and just pass 
    through the request context. */
 
@@ -745,6 +1343,13 @@ attach_data_client_handler (GzochidResolutionContext *res_context,
   g_object_unref (configuration);
 }
 
+void
+_gzochid_httpd_app_append_key_listings (gzochid_httpd_partial *app_root)
+{
+  gzochid_httpd_append_terminal (app_root, "/oids/", list_oids, NULL);
+  gzochid_httpd_append_terminal (app_root, "/names/", list_names, NULL);
+}
+
 void
 gzochid_httpd_app_register_handlers (GzochidHttpServer *http_server,
 				     GzochidGameServer *game_server,
@@ -754,8 +1359,19 @@ gzochid_httpd_app_register_handlers (GzochidHttpServer *http_server,
   gzochid_httpd_partial *oids_root = NULL;
 
   gzochid_server_state *state = gzochid_server_state_new ();
-
+  GzochidConfiguration *configuration = gzochid_resolver_require_full
+    (res_context, GZOCHID_TYPE_CONFIGURATION, NULL);
+  GHashTable *config = gzochid_configuration_extract_group
+    (configuration, "admin");
+  char *backup_dir = NULL;
+  
   attach_data_client_handler (res_context, state);
+
+  if (g_hash_table_contains (config, "backup.dir"))
+    backup_dir = strdup (g_hash_table_lookup (config, "backup.dir"));
+
+  g_hash_table_destroy (config);
+  g_object_unref (configuration);
   
   gzochid_httpd_add_terminal (http_server, "/", hello_world, state);
   gzochid_httpd_add_terminal (http_server, "/app/", list_apps, game_server);
@@ -770,13 +1386,19 @@ gzochid_httpd_app_register_handlers (GzochidHttpServer *http_server,
   
   if (!state->has_metaclient)
     {
-      gzochid_httpd_append_terminal (apps_root, "/oids/", list_oids, NULL);
+      _gzochid_httpd_app_append_key_listings (apps_root);
       oids_root = gzochid_httpd_append_continuation
 	(apps_root, "/oids/", null_continuation, NULL);
   
       gzochid_httpd_append_terminal
 	(oids_root, "([a-f0-9]+)", render_oid, NULL);
 
-      gzochid_httpd_append_terminal (apps_root, "/names/", list_names, NULL);
+      if (backup_dir != NULL)
+	gzochid_httpd_append_terminal
+	  (apps_root, "/backup", backup_app, backup_service_new (backup_dir));
+      else g_message
+	     ("No backup.dir configured; application backups are disabled.");
     }
+
+  free (backup_dir);
 }
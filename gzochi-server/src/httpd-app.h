@@ -42,4 +42,12 @@
 void gzochid_httpd_app_register_handlers
 (GzochidHttpServer *, GzochidGameServer *, GzochidResolutionContext *);
 
+/* Private HTTP handler API, visible for testing only. */
+
+/* Appends the handlers for the paged JSON listings of an application's object
+   ids and name bindings - "/oids/" and "/names/" - to the specified partial,
+   which must resolve to the application's `gzochid_application_context'. */
+
+void _gzochid_httpd_app_append_key_listings (gzochid_httpd_partial *);
+
 #endif /* GZOCHID_HTTPD_APP_H */
@@ -145,6 +145,8 @@ struct _gzochid_http_response_sink
   /* The GNU microhttpd connecction object. */
   
   struct MHD_Connection *connection; 
+
+  const char *method; /* The request method; "GET" or "POST". */
 };
 
 /* A little bit of legal compiler trickery to make it possible to declare
@@ -484,6 +486,83 @@ gzochid_http_write_response
   sink->response_written = TRUE;
 }
 
+/* Binds a response producer to its user data, for use as the closure of a 
+   callback-driven GNU microhttpd response. */
+
+struct response_stream
+{
+  gzochid_http_response_producer producer; /* The producer function. */
+  gpointer user_data; /* The producer's user data. */
+  GDestroyNotify destroy_notify; /* Destructor for the user data, or `NULL'. */
+};
+
+/* The `MHD_ContentReaderCallback' for streamed responses. */
+
+static ssize_t
+read_response_stream (void *cls, uint64_t pos, char *buf, size_t max)
+{
+  struct response_stream *stream = cls;
+  ssize_t n = stream->producer (stream->user_data, buf, max);
+
+  return n < 0 ? MHD_CONTENT_READER_END_OF_STREAM : n;
+}
+
+/* The `MHD_ContentReaderFreeCallback' for streamed responses. */
+
+static void
+free_response_stream (void *cls)
+{
+  struct response_stream *stream = cls;
+
+  if (stream->destroy_notify != NULL)
+    stream->destroy_notify (stream->user_data);
+
+  free (stream);
+}
+
+void
+gzochid_http_write_response_stream
+(gzochid_http_response_sink *sink, int code, const char *content_type,
+ gzochid_http_response_producer producer, gpointer user_data,
+ GDestroyNotify destroy_notify)
+{
+  struct MHD_Response *response = NULL;
+  struct response_stream *stream = malloc (sizeof (struct response_stream));
+
+  stream->producer = producer;
+  stream->user_data = user_data;
+  stream->destroy_notify = destroy_notify;
+  
+  response = MHD_create_response_from_callback
+    (MHD_SIZE_UNKNOWN, 4096, read_response_stream, stream,
+     free_response_stream);
+
+  if (content_type != NULL)
+    MHD_add_response_header
+      (response, MHD_HTTP_HEADER_CONTENT_TYPE, content_type);
+  
+  sink->queue_code = MHD_queue_response (sink->connection, code, response);
+  MHD_destroy_response (response);
+  sink->response_written = TRUE;
+}
+
+const char *
+gzochid_http_get_argument (gzochid_http_response_sink *sink, const char *name)
+{
+  return MHD_lookup_connection_value
+    (sink->connection, MHD_GET_ARGUMENT_KIND, name);
+}
+
+const char *
+gzochid_http_get_method (gzochid_http_response_sink *sink)
+{
+  return sink->method;
+}
+
+/* Marks a connection whose POST request body is being received. */
+
+static int post_in_progress;
+
 /* The `MHD_AccessHandlerCallback' for GNU microhttpd. */
 
 static int 
@@ -499,11 +578,30 @@ dispatch (void *cls, struct MHD_Connection *connection,
   gpointer request_context = NULL;
   path_match *match = NULL;
   
-  if (strcmp (method, "GET") != 0)
+  if (strcmp (method, "POST") == 0)
+    {
+      /* None of the handlers read the request body, but it has to be consumed
+	 before a response can be queued. Handle the request once the body has
+	 been received in its entirety - signaled by a final call with no 
+	 upload data. */
+      
+      if (*con_cls == NULL)
+	{
+	  *con_cls = &post_in_progress;
+	  return MHD_YES;
+	}
+      else if (*upload_data_size > 0)
+	{
+	  *upload_data_size = 0;
+	  return MHD_YES;
+	}
+    }
+  else if (strcmp (method, "GET") != 0)
     return 0;
 
   sink.response_written = FALSE;
   sink.connection = connection;
+  sink.method = method;
 
   /* Traverse the hierarchy by finding, at each level, the child with the 
      pattern that produces the longest match against the current suffix of the
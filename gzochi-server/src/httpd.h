@@ -21,6 +21,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <sys/socket.h>
+#include <sys/types.h>
 
 /* The core embedded HTTP server type definitions. */
 
@@ -148,6 +149,41 @@ gzochid_httpd_partial *gzochid_httpd_append_continuation
 void gzochid_http_write_response
 (gzochid_http_response_sink *, int, char *, size_t);
 
+/* The function pointer typedef for the producer of a streamed response body.
+   The function is called with the user data pointer passed to
+   `gzochid_http_write_response_stream' and should write up to the specified 
+   number of bytes of the body to the specified buffer, returning the number of
+   bytes written, or `-1' once the body is complete. It may be called from a 
+   different thread than the handler that started the response, after the 
+   handler has returned. */
+
+typedef ssize_t (*gzochid_http_response_producer) (gpointer, char *, size_t);
+
+/* Like `gzochid_http_write_response', but streams the response body from the
+   specified producer as the client is able to receive it, rather than copying
+   it from a buffer. The content type of the response is set to the specified
+   string, if it is non-`NULL'. The specified `GDestroyNotify' (which may be 
+   `NULL') is called on the producer's user data once the response is 
+   complete. */
+
+void gzochid_http_write_response_stream
+(gzochid_http_response_sink *, int, const char *, 
+ gzochid_http_response_producer, gpointer, GDestroyNotify);
+
+/* Returns the value of the query string argument with the specified name in
+   the request being handled via the specified sink, or `NULL' if the request
+   has no such argument. The returned string is owned by the HTTP server and
+   should not be modified or freed by the caller. */
+
+const char *gzochid_http_get_argument
+(gzochid_http_response_sink *, const char *);
+
+/* Returns the method - "GET" or "POST" - of the request being handled via the
+   specified sink. (The server doesn't accept requests with other methods.) The
+   bodies of "POST" requests are discarded. */
+
+const char *gzochid_http_get_method (gzochid_http_response_sink *);
+
 /*
   Returns a string giving the base URL of the HTTP server.
 
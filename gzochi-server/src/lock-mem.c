@@ -35,6 +35,21 @@
    table is kept entirely in process memory.
 */
 
+/*
+   Point locks are indexed by key in a hash table, so that checking, setting,
+   and releasing a point lock takes constant time regardless of the number of
+   locks held. The locks on a key and the locks held by a node are linked
+   together intrusively, via pointers embedded in the lock structures, so that
+   a lock can be unlinked from either list without a search or an allocation.
+
+   Range locks are indexed by an interval tree. Since a range lock conflicts
+   only with point locks held for write, write locks are additionally indexed in
+   a key-ordered sequence, which is consulted when range locks are requested.
+*/
+
+typedef struct _gzochid_locks gzochid_locks;
+typedef struct _gzochid_node_locks gzochid_node_locks;
+
 /* The lock structure for ann individual key. */
 
 struct _gzochid_lock
@@ -50,9 +65,24 @@ struct _gzochid_lock
 
   struct timeval timestamp; 
 
-  /* A pointer to this lock in the timestamp-ordered lock sequence. */
+  gzochid_locks *locks; /* The list of locks on the same key. */
+
+  /* The previous and next locks on the same key. */
+
+  struct _gzochid_lock *prev_on_key;
+  struct _gzochid_lock *next_on_key;
+
+  gzochid_node_locks *node_locks; /* The locks held by the same node. */
+
+  /* The previous and next point locks held by the same node. */
+
+  struct _gzochid_lock *prev_on_node;
+  struct _gzochid_lock *next_on_node;
+
+  /* A pointer to this lock in the key-ordered write lock sequence, or `NULL'
+     if the lock is not held for write. */
 
-  GSequenceIter *timestamp_iter; 
+  GSequenceIter *write_iter;
 };
 
 typedef struct _gzochid_lock gzochid_lock;
@@ -75,16 +105,19 @@ struct _gzochid_range_lock
 
 typedef struct _gzochid_range_lock gzochid_range_lock;
 
-/* A wrapper around a list of compatible (i.e., read) single-key locks, with the
-   timestamp of the most recent lock provided as a convenience. */
+/* The head of the list of compatible (i.e., read) single-key locks on a key,
+   most recent first. */
 
 struct _gzochid_locks
 {
-  GList *locks; /* The list of `gzochid_lock' structures. */
-  struct timeval most_recent_timestamp; /* The most recent lock timestamp. */
-};
+  /* The locked key, which is also the key of this structure in the point lock
+     table. */
 
-typedef struct _gzochid_locks gzochid_locks;
+  GBytes *key;
+
+  gzochid_lock *locks; /* The first `gzochid_lock' in the list. */
+  guint num_locks; /* The number of locks in the list. */
+};
 
 /* Represents the complete set of individual and range locks held by a 
    particular locker. In addition to convenience, this structure is the single 
@@ -93,23 +126,26 @@ typedef struct _gzochid_locks gzochid_locks;
    
 struct _gzochid_node_locks
 {
-  GList *locks; /* The list of read-write locks held by the node. */
+  /* The first of the read-write locks held by the node. */
+
+  gzochid_lock *locks;
+
   GList *range_locks; /* The list of range locks held by the node. */
 };
 
-typedef struct _gzochid_node_locks gzochid_node_locks;
-
 /* The private lock table structure. */
 
 struct _gzochid_lock_table
 {
-  /* A sequence of read-write locks, ordered by key, ascending. */
+  /* A mapping of `GBytes' keys to `gzochid_locks' lists of read-write
+     locks. */
 
-  GSequence *locks; 
+  GHashTable *locks;
 
-  /* A sequence of read-write locks, ordered by timestamp, ascending. */
+  /* A sequence of the read-write locks held for write, ordered by key,
+     ascending. */
 
-  GSequence *locks_by_timestamp; 
+  GSequence *write_locks;
   
   gzochid_itree *range_locks; /* The interval tree of range locks. */
 
@@ -128,13 +164,16 @@ struct _gzochid_lock_table
 static gzochid_node_locks *
 ensure_node_registration (gzochid_lock_table *lock_table, guint node_id)
 {
-  if (g_hash_table_contains (lock_table->nodes_to_locks, &node_id))
-    return g_hash_table_lookup (lock_table->nodes_to_locks, &node_id);
+  gzochid_node_locks *node_locks = g_hash_table_lookup
+    (lock_table->nodes_to_locks, &node_id);
+
+  if (node_locks != NULL)
+    return node_locks;
   else
     {
       guint *node_id_ptr = malloc (sizeof (guint));
-      gzochid_node_locks *node_locks = calloc (1, sizeof (gzochid_node_locks));
 
+      node_locks = calloc (1, sizeof (gzochid_node_locks));
       *node_id_ptr = node_id;
       
       g_hash_table_insert (lock_table->nodes_to_locks, node_id_ptr, node_locks);
@@ -159,11 +198,11 @@ lock_failure (struct timeval lock_timestamp, struct timeval *ret_timestamp)
   return FALSE;
 }
 
-/* A `GCompareFunc' implementation for `gzochid_lock' structures, in terms of
-   `GBytes' structures. */
+/* A `GCompareDataFunc' implementation for `gzochid_lock' structures, in terms
+   of their `GBytes' keys. (The data argument is ignored.) */
 
 static gint
-compare_locks (gconstpointer a, gconstpointer b)
+compare_locks_data (gconstpointer a, gconstpointer b, gpointer user_data)
 {
   const gzochid_lock *lock_a = a;
   const gzochid_lock *lock_b = b;
@@ -171,21 +210,6 @@ compare_locks (gconstpointer a, gconstpointer b)
   return g_bytes_compare (lock_a->key, lock_b->key);
 }
 
-/* A `GCompareFunc' implementation for `gzochid_locks' structures, in terms of
-   their first `gzochid_lock' element. */
-
-static gint
-compare_lock_lists (gconstpointer a, gconstpointer b)
-{
-  const gzochid_locks *locks_a = a;
-  const gzochid_locks *locks_b = b;
-
-  assert (locks_a->locks != NULL);
-  assert (locks_b->locks != NULL);
-
-  return compare_locks (locks_a->locks->data, locks_b->locks->data);
-}
-
 /* 
    Create and return a pointer to a new `gzochid_lock' structure to lock the
    specified key on behalf of the specified node, for read or write.
@@ -197,14 +221,13 @@ compare_lock_lists (gconstpointer a, gconstpointer b)
 static gzochid_lock *
 lock_new (GBytes *key, guint node_id, gboolean for_write)
 {
-  gzochid_lock *lock = malloc (sizeof (gzochid_lock));
+  gzochid_lock *lock = calloc (1, sizeof (gzochid_lock));
 
   lock->key = g_bytes_ref (key);
   lock->node_id = node_id;
   lock->for_write = for_write;
 
   gettimeofday (&lock->timestamp, NULL);
-  lock->timestamp_iter = NULL;
 
   return lock;
 }
@@ -255,6 +278,26 @@ range_lock_free (gzochid_range_lock *range_lock)
 }
 
 /* 
+   Create and return a pointer to a new, empty `gzochid_locks' structure for
+   the specified key.
+
+   The memory allocated for this structure should be freed via a call to
+   `locks_free' when no longer in use.
+*/
+
+static gzochid_locks *
+locks_new (GBytes *key)
+{
+  gzochid_locks *locks = malloc (sizeof (gzochid_locks));
+
+  locks->key = g_bytes_ref (key);
+  locks->locks = NULL;
+  locks->num_locks = 0;
+
+  return locks;
+}
+
+/*
    Free the memory associated with the specified `gzochid_locks' structure.
 
    Note that this function does not free the constituent `gzochid_lock' objects,
@@ -267,8 +310,7 @@ locks_free (gpointer data)
 {
   gzochid_locks *locks = data;
 
-  g_list_free (locks->locks);
-
+  g_bytes_unref (locks->key);
   free (locks);
 }
 
@@ -278,7 +320,16 @@ locks_free (gpointer data)
 static void
 node_locks_free (gzochid_node_locks *node_locks)
 {
-  g_list_free_full (node_locks->locks, (GDestroyNotify) lock_free);
+  gzochid_lock *lock = node_locks->locks;
+
+  while (lock != NULL)
+    {
+      gzochid_lock *next = lock->next_on_node;
+
+      lock_free (lock);
+      lock = next;
+    }
+
   g_list_free_full (node_locks->range_locks, (GDestroyNotify) range_lock_free);
   
   free (node_locks);
@@ -296,8 +347,9 @@ gzochid_lock_table_new (const char *scope)
 {
   gzochid_lock_table *lock_table = malloc (sizeof (gzochid_lock_table));
 
-  lock_table->locks = g_sequence_new (locks_free);
-  lock_table->locks_by_timestamp = g_sequence_new (NULL);
+  lock_table->locks = g_hash_table_new_full
+    (g_bytes_hash, g_bytes_equal, NULL, locks_free);
+  lock_table->write_locks = g_sequence_new (NULL);
 
   lock_table->range_locks =
     gzochid_itree_new
@@ -322,8 +374,8 @@ gzochid_lock_table_free (gzochid_lock_table *lock_table)
      `gzochid_node_locks' below takes care of freeing the individual point 
      locks. */
 
-  g_sequence_free (lock_table->locks); 
-  g_sequence_free (lock_table->locks_by_timestamp);
+  g_hash_table_destroy (lock_table->locks);
+  g_sequence_free (lock_table->write_locks);
 
   /* The loop over `gzochid_node_locks' below takes care of freeing the
      individual range locks. */
@@ -337,32 +389,62 @@ gzochid_lock_table_free (gzochid_lock_table *lock_table)
   free (lock_table);
 }
 
-/*
-  A `GCompareFunc' to be used to find a point lock already held by a node id. 
+/* Returns the point lock in the specified lock list held by the specified node
+   id, or `NULL' if the node holds no lock on the list's key. The length of the
+   list is bounded by the number of nodes. */
   
-   Despite the prototype, when used with `g_list_find_custom', this function 
-   will always be called with a `guint' pointer (to the target node id) as its 
-   second argument. 
-*/
+static gzochid_lock *
+find_lock_with_node_id (gzochid_locks *locks, guint node_id)
+{
+  gzochid_lock *lock = locks->locks;
 
-static gint
-find_lock_with_node_id (gconstpointer a, gconstpointer b)
+  for (; lock != NULL; lock = lock->next_on_key)
+    if (lock->node_id == node_id)
+      return lock;
+
+  return NULL;
+}
+
+/* Adds the specified point lock to the specified lock table's key-ordered
+   sequence of write locks. */
+
+static void
+index_write_lock (gzochid_lock_table *lock_table, gzochid_lock *lock)
 {
-  const gzochid_lock *lock = a;
-  const guint *node_id_ptr = b;
+  assert (lock->write_iter == NULL);
 
-  guint node_id = *node_id_ptr;
-  
-  return lock->node_id < node_id ? -1 : lock->node_id > node_id ? 1 : 0;
+  lock->write_iter = g_sequence_insert_sorted
+    (lock_table->write_locks, lock, compare_locks_data, NULL);
 }
 
-/* Adapts `compare_lock_lists' to a `GCompareDataFunc' for use by 
-   `g_sequence_lookup' in `find_locks_by_key'. */
+/* Creates a new point lock on the key of the specified lock list on behalf of
+   the specified node, and links it into the lock list, the node's lock list,
+   and - if it is a write lock - the write lock sequence of the specified lock
+   table. */
 
-static gint
-compare_lock_lists_data (gconstpointer a, gconstpointer b, gpointer user_data)
+static void
+add_lock (gzochid_lock_table *lock_table, gzochid_locks *locks, guint node_id,
+	  gboolean for_write)
 {
-  return compare_lock_lists (a, b);
+  gzochid_node_locks *node_locks =
+    ensure_node_registration (lock_table, node_id);
+  gzochid_lock *lock = lock_new (locks->key, node_id, for_write);
+
+  lock->locks = locks;
+  lock->next_on_key = locks->locks;
+  if (locks->locks != NULL)
+    locks->locks->prev_on_key = lock;
+  locks->locks = lock;
+  locks->num_locks++;
+
+  lock->node_locks = node_locks;
+  lock->next_on_node = node_locks->locks;
+  if (node_locks->locks != NULL)
+    node_locks->locks->prev_on_node = lock;
+  node_locks->locks = lock;
+
+  if (for_write)
+    index_write_lock (lock_table, lock);
 }
 
 /* Encapsulates contextual data used during the interval tree search for the 
@@ -425,14 +507,14 @@ most_recent_covering_range_lock (gzochid_lock_table *lock_table,
   return search_context.range_lock;
 }
 
-/* A `GCompareDataFunc' for comparing `gzochid_lock' structures by their lock
-   timestamps. (The data argument is ignored.) */
+/* A `GCompareDataFunc' for comparing `gzochid_range_lock' structures by their
+   lock timestamps. (The data argument is ignored.) */
 
 static gint
 compare_timestamp_data (gconstpointer a, gconstpointer b, gpointer data)
 {
-  const gzochid_lock *lock_a = a;
-  const gzochid_lock *lock_b = b;
+  const gzochid_range_lock *lock_a = a;
+  const gzochid_range_lock *lock_b = b;
 
   if (timercmp (&lock_a->timestamp, &lock_b->timestamp, <))
     return -1;
@@ -441,55 +523,21 @@ compare_timestamp_data (gconstpointer a, gconstpointer b, gpointer data)
   else return 0;
 }
 
-/* Returns a `GSequenceIter' pointing to the location of the lock for the
-   specified key in the specified lock table's point lock sequence, or `NULL' if
-   no such lock exists. */
-
-static GSequenceIter *
-find_locks_by_key (gzochid_lock_table *lock_table, GBytes *key)
-{
-  gzochid_lock lock;  
-  gzochid_locks locks;
-  GSequenceIter *iter = NULL;
-
-  /* Create a fake lock list for comparison with the lock lists in the lock 
-     sequence. (The comparison ultimately takes place by key.) */
-  
-  lock.key = key;
-  locks.locks = g_list_prepend (NULL, &lock);
-  
-  iter = g_sequence_lookup
-    (lock_table->locks, &locks, compare_lock_lists_data, NULL);
-
-  g_list_free (locks.locks);
-
-  return iter;
-}
-
 gboolean
 gzochid_lock_check (gzochid_lock_table *lock_table, guint node_id, GBytes *key,
 		    gboolean for_write)
 {
-  GSequenceIter *iter = find_locks_by_key (lock_table, key);
+  gzochid_locks *locks = g_hash_table_lookup (lock_table->locks, key);
   
-  if (iter != NULL)
+  if (locks != NULL)
     {
-      gzochid_locks *locks = g_sequence_get (iter);
-      GList *existing_lock_ptr = NULL;
-
-      assert (locks->locks != NULL);      
-
       /* Find an existing lock for the specified key held by the specified 
 	 node. */
       
-      existing_lock_ptr = g_list_find_custom
-	(locks->locks, &node_id, find_lock_with_node_id);
+      gzochid_lock *lock = find_lock_with_node_id (locks, node_id);
 
-      if (existing_lock_ptr != NULL)
-	{
-	  gzochid_lock *lock = existing_lock_ptr->data;
-	  return lock->for_write || !for_write;
-	}
+      if (lock != NULL)
+	return lock->for_write || !for_write;
     }
 
   return FALSE;
@@ -500,25 +548,19 @@ gzochid_lock_check_and_set (gzochid_lock_table *lock_table, guint node_id,
 			    GBytes *key, gboolean for_write,
 			    struct timeval *ret_timestamp)
 {
-  GSequenceIter *iter = find_locks_by_key (lock_table, key);
+  gzochid_locks *locks = g_hash_table_lookup (lock_table->locks, key);
   
-  if (iter != NULL)
+  if (locks != NULL)
     {
-      gzochid_locks *locks = g_sequence_get (iter);
-      GList *existing_lock_ptr = NULL;
+      /* Find an existing lock for the specified key held by the specified
+	 node. */
 
-      assert (locks->locks != NULL);      
+      gzochid_lock *existing_lock = find_lock_with_node_id (locks, node_id);
 
-      /* Find an existing lock for the specified key held by the specified 
-	 node. */
-      
-      existing_lock_ptr = g_list_find_custom
-	(locks->locks, &node_id, find_lock_with_node_id);
+      assert (locks->locks != NULL);      
 
-      if (existing_lock_ptr != NULL)
+      if (existing_lock != NULL)
 	{
-	  gzochid_lock *existing_lock = existing_lock_ptr->data;
-
 	  /* If it's already locked for write, or if we're not currently trying
 	     to lock it for write, then we already have the level of access we
 	     need. */
@@ -533,18 +575,13 @@ gzochid_lock_check_and_set (gzochid_lock_table *lock_table, guint node_id,
 		 currently attempting the lock, and return its timestamp as the
 		 failure timestamp. */
 	      
-	      if (g_list_length (locks->locks) > 1)
+	      if (locks->num_locks > 1)
 		{
-		  GList *locks_ptr = locks->locks;
-		  while (locks_ptr != NULL)
-		    {
-		      gzochid_lock *lock = locks_ptr->data;
+		  gzochid_lock *lock = locks->locks;
 
-		      if (lock->node_id != node_id)
-			return lock_failure (lock->timestamp, ret_timestamp);
-		      
-		      locks_ptr = locks_ptr->next;
-		    }
+		  for (; lock != NULL; lock = lock->next_on_key)
+		    if (lock->node_id != node_id)
+		      return lock_failure (lock->timestamp, ret_timestamp);
 
 		  assert (1 == 0);
 		}
@@ -561,22 +598,19 @@ gzochid_lock_check_and_set (gzochid_lock_table *lock_table, guint node_id,
 		}
 	    }
 
+	  /* If we're upgrading the lock from read to write, count it as "new"
+	     insofar as its timestamp is concerned, and add it to the write
+	     lock sequence. */
+
 	  existing_lock->for_write = TRUE;
 	  gettimeofday (&existing_lock->timestamp, NULL);
-	  locks->most_recent_timestamp = existing_lock->timestamp;
-
-	  /* If we're upgrading the lock from read to write, count it as "new"
-	     insofar as its timestamp is concerned, and update the timestamp
-	     sequence accordingly. */
-	  
-	  g_sequence_sort_changed
-	    (existing_lock->timestamp_iter, compare_timestamp_data, NULL);
+	  index_write_lock (lock_table, existing_lock);
 	      
 	  return TRUE;
 	}
       else
 	{
- 	  gzochid_lock *lock = locks->locks->data;
+	  gzochid_lock *lock = locks->locks;
 
 	  if (for_write || lock->for_write)
 
@@ -587,19 +621,7 @@ gzochid_lock_check_and_set (gzochid_lock_table *lock_table, guint node_id,
 
 	  else 
 	    {
-	      gzochid_node_locks *node_locks =
-		ensure_node_registration (lock_table, node_id);
-	  
-	      gzochid_lock *lock = lock_new (key, node_id, for_write);
-	  
-	      lock->timestamp_iter = g_sequence_insert_sorted
-		(lock_table->locks_by_timestamp, lock, compare_timestamp_data,
-		 NULL);
-	  
-	      locks->locks = g_list_prepend (locks->locks, lock);
-	      locks->most_recent_timestamp = lock->timestamp;
-	  
-	      node_locks->locks = g_list_prepend (node_locks->locks, lock);
+	      add_lock (lock_table, locks, node_id, for_write);
 	      return TRUE;
 	    }
 	}
@@ -620,27 +642,44 @@ gzochid_lock_check_and_set (gzochid_lock_table *lock_table, guint node_id,
   /* At this point, there are no impediments to creating an entirely new, 
      possibly exclusive lock on the target key. */
   
-  { gzochid_node_locks *node_locks =
-      ensure_node_registration (lock_table, node_id);
+  locks = locks_new (key);
+  g_hash_table_insert (lock_table->locks, locks->key, locks);
+  add_lock (lock_table, locks, node_id, for_write);
     
-    gzochid_lock *lock = lock_new (key, node_id, for_write);
-    gzochid_locks *locks = malloc (sizeof (gzochid_locks));
+  return TRUE;
+}
     
-    locks->locks = g_list_prepend (NULL, lock);
-    locks->most_recent_timestamp = lock->timestamp;      
-    g_sequence_insert_sorted
-      (lock_table->locks, locks, compare_lock_lists_data, NULL);
+/* Returns a `GSequenceIter' pointing to the location of the first write lock
+   on a key greater than or equal to the specified key in the specified lock
+   table's write lock sequence, which may be the end iterator. A `NULL' key
+   indicates the beginning of the keyspace. */
 
-    node_locks->locks = g_list_prepend (node_locks->locks, lock);
+static GSequenceIter *
+find_write_locks_from_key (gzochid_lock_table *lock_table, GBytes *key)
+{
+  gzochid_lock lock;
+  GSequenceIter *iter = NULL;
 
-    /* Add the new lock to the proper place in the timestamp sequence. */
+  if (key == NULL)
+    return g_sequence_get_begin_iter (lock_table->write_locks);
     
-    lock->timestamp_iter = g_sequence_insert_sorted
-      (lock_table->locks_by_timestamp, lock, compare_timestamp_data,
-       NULL);
+  /* `g_sequence_search' returns the position after the last element equal to
+     the search key, so step back over an exact match. */
     
-    return TRUE;
-  }
+  lock.key = key;
+  iter = g_sequence_search
+    (lock_table->write_locks, &lock, compare_locks_data, NULL);
+
+  if (!g_sequence_iter_is_begin (iter))
+    {
+      GSequenceIter *prev = g_sequence_iter_prev (iter);
+      gzochid_lock *prev_lock = g_sequence_get (prev);
+
+      if (g_bytes_equal (prev_lock->key, key))
+	return prev;
+    }
+
+  return iter;
 }
 
 /* A `gzochid_itree_search_func' implementation to locate range locks that 
@@ -688,26 +727,23 @@ gzochid_lock_range_check_and_set (gzochid_lock_table *lock_table, guint node_id,
     {
       gzochid_node_locks *node_locks = NULL;
       gzochid_range_lock *range_lock = NULL;
-      GSequenceIter *point_iter = find_locks_by_key (lock_table, from);
+      GSequenceIter *iter = find_write_locks_from_key (lock_table, from);
 
       /* Even if there are no conflicting range locks, there may be point locks
 	 that are locked for write that fall within the covered interval. */
       
-      if (point_iter != NULL)
-	while (!g_sequence_iter_is_end (point_iter))
-	  {
-	    gzochid_locks *locks = g_sequence_get (point_iter);
-	    gzochid_lock *lock = locks->locks->data;
-
-	    /* It's only necessary to check the first locker in the lock list;
-	       if the key is locked for write, there'll only be a single 
-	       locker. */
+      while (!g_sequence_iter_is_end (iter))
+	{
+	  gzochid_lock *lock = g_sequence_get (iter);
+
+	  if (to != NULL && g_bytes_compare (lock->key, to) > 0)
+	    break;
 	    
-	    if (lock->for_write && lock->node_id != node_id) 
-	      return lock_failure (lock->timestamp, ret_timestamp);
+	  if (lock->node_id != node_id) 
+	    return lock_failure (lock->timestamp, ret_timestamp);
 	    
-	    point_iter = g_sequence_iter_next (point_iter);
-	  }
+	  iter = g_sequence_iter_next (iter);
+	}
       
       node_locks = ensure_node_registration (lock_table, node_id);
       range_lock = range_lock_new (from, to, node_id);
@@ -732,38 +768,37 @@ gzochid_lock_range_check_and_set (gzochid_lock_table *lock_table, guint node_id,
 static void
 remove_lock (gzochid_lock_table *lock_table, gzochid_lock *lock)
 {
-  GSequenceIter *iter = find_locks_by_key (lock_table, lock->key);
-  gzochid_node_locks *node_locks = g_hash_table_lookup
-    (lock_table->nodes_to_locks, &lock->node_id);
-
-  gzochid_locks *locks = NULL;
-  GList *lock_link = NULL;
-
-  if (iter == NULL)
-    return;
-
-  locks = g_sequence_get (iter);  
-  lock_link = g_list_find (locks->locks, lock);  
+  gzochid_locks *locks = lock->locks;
+  gzochid_node_locks *node_locks = lock->node_locks;
 
-  /* Remove the lock from the lock list for its key in the sequence. */
+  /* Remove the lock from the lock list for its key. */
 
-  locks->locks = g_list_delete_link (locks->locks, lock_link);
+  if (lock->prev_on_key != NULL)
+    lock->prev_on_key->next_on_key = lock->next_on_key;
+  else locks->locks = lock->next_on_key;
+  if (lock->next_on_key != NULL)
+    lock->next_on_key->prev_on_key = lock->prev_on_key;
+  locks->num_locks--;
 
   if (locks->locks == NULL)
 
     /* If this causes the lock list to go empty, remove the lock list from the
-       sequence. */
+       table. */
     
-    g_sequence_remove (iter);
+    g_hash_table_remove (lock_table->locks, lock->key);
 
-  /* Remove the lock from the timestamp-ordered lock sequence. */
+  /* Remove the lock from the key-ordered write lock sequence. */
 
-  g_sequence_remove (lock->timestamp_iter);
+  if (lock->write_iter != NULL)
+    g_sequence_remove (lock->write_iter);
 
   /* Remove the lock from the node's lock list. */
   
-  lock_link = g_list_find (node_locks->locks, lock);
-  node_locks->locks = g_list_delete_link (node_locks->locks, lock_link);
+  if (lock->prev_on_node != NULL)
+    lock->prev_on_node->next_on_node = lock->next_on_node;
+  else node_locks->locks = lock->next_on_node;
+  if (lock->next_on_node != NULL)
+    lock->next_on_node->prev_on_node = lock->prev_on_node;
   
   if (node_locks->locks == NULL && node_locks->range_locks == NULL)
     {
@@ -781,16 +816,14 @@ void
 gzochid_lock_release (gzochid_lock_table *lock_table, guint node_id,
 		      GBytes *key)
 {
-  GSequenceIter *iter = find_locks_by_key (lock_table, key);  
+  gzochid_locks *locks = g_hash_table_lookup (lock_table->locks, key);
   
-  if (iter != NULL)
+  if (locks != NULL)
     {
-      gzochid_locks *locks = g_sequence_get (iter);
-      GList *lock_ptr = g_list_find_custom
-	(locks->locks, &node_id, find_lock_with_node_id);
+      gzochid_lock *lock = find_lock_with_node_id (locks, node_id);
 
-      if (lock_ptr != NULL)
-	remove_lock (lock_table, lock_ptr->data);
+      if (lock != NULL)
+	remove_lock (lock_table, lock);
       else GZOCHID_WITH_FORMATTED_BYTES
 	     (key, buf, 33, g_warning
 	      ("Attempted to release non-existent lock on %s for node %d.", buf,
@@ -909,18 +942,6 @@ gzochid_lock_release_range (gzochid_lock_table *lock_table, guint node_id,
     }
 }
 
-/* Adapts `remove_lock' as a `GFunc' for use by `g_list_foreach' in 
-   `gzochid_lock_release_all'. */
-
-static void
-release_lock (gpointer data, gpointer user_data)
-{
-  gzochid_lock *lock = data;
-  gzochid_lock_table *lock_table = user_data;
-
-  remove_lock (lock_table, lock);
-}
-
 /* Adapts `remove_range_lock' as a `GFunc' for use by `g_list_foreach' in 
    `gzochid_lock_release_all'. */
 
@@ -939,11 +960,124 @@ gzochid_lock_release_all (gzochid_lock_table *lock_table, guint node_id)
   gzochid_node_locks *node_locks = g_hash_table_lookup
     (lock_table->nodes_to_locks, &node_id);
 
+  gzochid_lock *lock = NULL;
+  
   if (node_locks == NULL)
     return;
 
-  g_list_foreach (node_locks->locks, release_lock, lock_table);
+  lock = node_locks->locks;
+  
+  /* Releasing the node's last lock frees its lock list, so advance to the next
+     lock before releasing the current one. */
+  
+  while (lock != NULL)
+    {
+      gzochid_lock *next = lock->next_on_node;
+
+      remove_lock (lock_table, lock);
+      lock = next;
+    }
 
   if (g_hash_table_contains (lock_table->nodes_to_locks, &node_id))  
     g_list_foreach (node_locks->range_locks, release_range_lock, lock_table);
 }
+
+/* Encapsulates contextual data used during the enumeration of locks that
+   conflict with a lock request. */
+
+struct _conflict_search_context
+{
+  /* The node id to ignore during the enumeration; the requesting node's own 
+     locks never conflict with its requests. */
+
+  guint excluded_node_id; 
+
+  gzochid_lock_conflict_func func; /* The visitor function. */
+  gpointer user_data; /* The visitor function's user data. */
+};
+
+typedef struct _conflict_search_context conflict_search_context;
+
+/* A `gzochid_itree_search_func' implementation that passes every range lock
+   not held by the excluded node id to the visitor function. Use with 
+   `conflict_search_context'. */
+
+static gboolean
+visit_conflicting_range_lock (gpointer from, gpointer to, gpointer data,
+			      gpointer user_data)
+{
+  gzochid_range_lock *range_lock = data;
+  conflict_search_context *search_context = user_data;
+
+  if (range_lock->node_id != search_context->excluded_node_id)
+    search_context->func
+      (range_lock->node_id, TRUE, range_lock->from, range_lock->to,
+       search_context->user_data);
+
+  return FALSE;
+}
+
+void
+gzochid_lock_foreach_conflict (gzochid_lock_table *lock_table, guint node_id,
+			       GBytes *key, gboolean for_write,
+			       gzochid_lock_conflict_func func,
+			       gpointer user_data)
+{
+  gzochid_locks *locks = g_hash_table_lookup (lock_table->locks, key);
+
+  if (locks != NULL)
+    {
+      gzochid_lock *lock = locks->locks;
+
+      /* A read lock only conflicts with a write lock; a write lock conflicts
+	 with any lock held by another node. */
+      
+      for (; lock != NULL; lock = lock->next_on_key)
+	if (lock->node_id != node_id && (for_write || lock->for_write))
+	  func (lock->node_id, FALSE, lock->key, lock->key, user_data);
+    }
+
+  if (for_write)
+    {
+      conflict_search_context search_context;
+
+      search_context.excluded_node_id = node_id;
+      search_context.func = func;
+      search_context.user_data = user_data;
+
+      gzochid_itree_search
+	(lock_table->range_locks, key, visit_conflicting_range_lock,
+	 &search_context);
+    }
+}
+
+void
+gzochid_lock_range_foreach_conflict (gzochid_lock_table *lock_table,
+				     guint node_id, GBytes *from, GBytes *to,
+				     gzochid_lock_conflict_func func,
+				     gpointer user_data)
+{
+  conflict_search_context search_context;
+  GSequenceIter *iter = find_write_locks_from_key (lock_table, from);
+
+  search_context.excluded_node_id = node_id;
+  search_context.func = func;
+  search_context.user_data = user_data;
+
+  gzochid_itree_search_interval
+    (lock_table->range_locks, from, to, visit_conflicting_range_lock,
+     &search_context);
+
+  while (!g_sequence_iter_is_end (iter))
+    {
+      gzochid_lock *lock = g_sequence_get (iter);
+
+      if (to != NULL && g_bytes_compare (lock->key, to) > 0)
+	break;
+
+      if (lock->node_id != node_id)
+	func (lock->node_id, FALSE, lock->key, lock->key, user_data);
+
+      iter = g_sequence_iter_next (iter);
+    }
+}
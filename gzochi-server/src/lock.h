@@ -100,6 +100,42 @@ gboolean gzochid_lock_range_check_and_set
 gboolean gzochid_lock_range_check
 (gzochid_lock_table *, guint, GBytes *, GBytes *);
 
+/* A visitor function for locks that conflict with a lock request. Invoked with
+   the node id of the node holding the conflicting lock, `TRUE' if the lock is
+   a range lock or `FALSE' if it is a point lock, the lower and upper bounds of
+   the lock (which are the same key in the case of a point lock, and either of
+   which may be `NULL' in the case of a range lock), and the user data pointer
+   passed to the enumeration function. */
+
+typedef void (*gzochid_lock_conflict_func)
+(guint, gboolean, GBytes *, GBytes *, gpointer);
+
+/*
+   Invokes the specified visitor function with the specified user data for each
+   lock held by a node other than the specified node that would prevent the
+   specified node from obtaining a read or write lock on the specified key, per
+   the rules given for `gzochid_lock_check_and_set'.
+
+   The visitor function must not modify the lock table.
+*/
+
+void gzochid_lock_foreach_conflict
+(gzochid_lock_table *, guint, GBytes *, gboolean, gzochid_lock_conflict_func,
+ gpointer);
+
+/*
+   Invokes the specified visitor function with the specified user data for each
+   lock held by a node other than the specified node that would prevent the
+   specified node from obtaining a range lock on the specified key interval,
+   per the rules given for `gzochid_lock_range_check_and_set'.
+
+   The visitor function must not modify the lock table.
+*/
+
+void gzochid_lock_range_foreach_conflict
+(gzochid_lock_table *, guint, GBytes *, GBytes *, gzochid_lock_conflict_func,
+ gpointer);
+
 /* Completely releases the specified node's lock on the specified point lock. */
 
 void gzochid_lock_release (gzochid_lock_table *, guint, GBytes *);
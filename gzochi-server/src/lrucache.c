@@ -1,4 +1,4 @@
-/* lrucache.c: Simple GLib-based LRU cache implementation for gzochid
+/* lrucache.c: Concurrent, sharded LRU cache implementation for gzochid
  * Copyright (C) 2015 Julian Graham
  *
  * gzochi is free software: you can redistribute it and/or modify it
@@ -19,175 +19,382 @@
 #include <glib.h>
 #include <stddef.h>
 #include <stdlib.h>
-#include <sys/time.h>
 
 #include "lrucache.h"
 
-/* A wrapper around values stored in the cache to assist with recency 
-   determination and eviction. */
+/* The cache is divided into a power-of-two number of shards, each with its own
+   lock, hash table, and eviction state, so that lookups of keys in different
+   shards do not contend with each other. Small caches use a single shard, so
+   that their eviction behavior is exactly that of a single cache of the
+   requested size. */
 
-struct _gzochid_lru_cache_value
+#define MAX_SHARDS 16
+
+/* The minimum number of elements in each shard of a multi-shard cache. */
+
+#define MIN_SHARD_SIZE 64
+
+/* A wrapper around values stored in the cache to assist with eviction. Entries
+   in a shard are linked into a circular list, over which the shard's "clock
+   hand" sweeps to find eviction candidates. */
+
+struct _gzochid_lru_cache_entry
 {
   gpointer key; /* The key stored in the cache. */
   gpointer value; /* The value stored in the cache. */
 
-  /* The "last access counter, used to sort the LRU index. */
+  /* Set on access; cleared by the clock hand as it passes over the entry. An 
+     entry whose referenced flag is clear when the hand reaches it is 
+     evicted. */
+
+  gboolean referenced; 
+
+  /* `TRUE' while the value generator is being called for this entry. Lookups 
+     of the same key during this time wait for the value rather than generating
+     it again. */
+  
+  gboolean loading; 
+
+  /* The number of lookups waiting for this entry to finish loading. Pinned 
+     entries are not evicted. */
   
-  guint64 access_counter; 
+  guint pin_count; 
+
+  struct _gzochid_lru_cache_entry *prev; /* The previous entry on the clock. */
+  struct _gzochid_lru_cache_entry *next; /* The next entry on the clock. */
 };
 
-typedef struct _gzochid_lru_cache_value gzochid_lru_cache_value;
+typedef struct _gzochid_lru_cache_entry gzochid_lru_cache_entry;
 
-/* The private LRU cache structure. */
+/* A single shard of the cache. */
 
-struct _gzochid_lru_cache
+struct _gzochid_lru_cache_shard
 {
-  GHashTable *cache; /* The table of keys and values currently in the cache. */
+  GMutex mutex; /* Synchronizes access to the shard. */
 
-  /* The values currently in the cache, sorted by last access. */
+  /* Signaled when an entry in this shard finishes loading. */
 
-  GSequence *lru_index; 
+  GCond cond; 
 
-  GMutex mutex; /* Synchronizes membership checks on values in the cache. */  
+  GHashTable *entries; /* The table of keys to entries in this shard. */
 
-  /* The maximum number of elements that may be in the cache without triggering
-     an eviction. */
+  /* The clock hand; the next entry to be considered for eviction, or `NULL' if
+     the shard is empty. */
+
+  gzochid_lru_cache_entry *hand; 
 
+  /* The maximum number of elements that may be in the shard without triggering
+     an eviction. */
+  
   guint max_size; 
+};
+
+typedef struct _gzochid_lru_cache_shard gzochid_lru_cache_shard;
 
-  guint64 next_access_counter; /* The global access counter. */
+/* The private LRU cache structure. */
+
+struct _gzochid_lru_cache
+{
+  GHashFunc hash_func; /* The key hash function, used to select shards. */
+  
+  gzochid_lru_cache_shard *shards; /* The array of shards. */
+  guint num_shards; /* The number of shards; always a power of two. */
   
   GDestroyNotify value_evict_func; /* The value eviction function, if any. */
   gzochid_lru_cache_new_func new_func; /* The value generator function. */
+
+  /* The function used to take a reference to a value on behalf of the caller 
+     of `gzochid_lru_cache_lookup', if any. */
+
+  gzochid_lru_cache_ref_func value_ref_func; 
 };
 
 gzochid_lru_cache *
-gzochid_lru_cache_new_full (GHashFunc hash_func, GEqualFunc key_equal_func,
-			    gzochid_lru_cache_new_func cache_new_func,
-			    guint max_size, GDestroyNotify key_evict_func,
-			    GDestroyNotify value_evict_func)
+gzochid_lru_cache_new_with_ref (GHashFunc hash_func, GEqualFunc key_equal_func,
+				gzochid_lru_cache_new_func cache_new_func,
+				guint max_size, GDestroyNotify key_evict_func,
+				gzochid_lru_cache_ref_func value_ref_func,
+				GDestroyNotify value_evict_func)
 {
   gzochid_lru_cache *cache = malloc (sizeof (gzochid_lru_cache));
-
+  guint i = 0;
+  
   assert (hash_func != NULL);
   assert (key_equal_func != NULL);
   assert (cache_new_func != NULL);
+
+  cache->num_shards = 1;
+  while (cache->num_shards < MAX_SHARDS
+	 && max_size / (cache->num_shards * 2) >= MIN_SHARD_SIZE)
+    cache->num_shards *= 2;
+
+  cache->shards = malloc (sizeof (gzochid_lru_cache_shard) * cache->num_shards);
   
-  cache->cache = g_hash_table_new_full
-    (hash_func, key_equal_func, key_evict_func, NULL);
-  cache->lru_index = g_sequence_new (free);
-  cache->max_size = max_size;
-  cache->next_access_counter = 0;
-  
+  for (i = 0; i < cache->num_shards; i++)
+    {
+      gzochid_lru_cache_shard *shard = &cache->shards[i];
+
+      g_mutex_init (&shard->mutex);
+      g_cond_init (&shard->cond);
+
+      shard->entries = g_hash_table_new_full
+	(hash_func, key_equal_func, key_evict_func, NULL);
+      shard->hand = NULL;
+
+      /* Distribute any remainder across the first few shards, so that the 
+	 shard capacities sum to the requested maximum size. */
+      
+      shard->max_size = max_size / cache->num_shards
+	+ (i < max_size % cache->num_shards ? 1 : 0);
+    }
+
+  cache->hash_func = hash_func;
   cache->new_func = cache_new_func;
+  cache->value_ref_func = value_ref_func;
   cache->value_evict_func = value_evict_func;
-  
-  g_mutex_init (&cache->mutex);
 
   return cache;
 }
 
-/* A `GCompareDataFunc' implementation for sorting the LRU index. */
-
-static gint
-lru_cache_value_compare (gconstpointer a, gconstpointer b, gpointer user_data)
+gzochid_lru_cache *
+gzochid_lru_cache_new_full (GHashFunc hash_func, GEqualFunc key_equal_func,
+			    gzochid_lru_cache_new_func cache_new_func,
+			    guint max_size, GDestroyNotify key_evict_func,
+			    GDestroyNotify value_evict_func)
 {
-  const gzochid_lru_cache_value *value_a = a;
-  const gzochid_lru_cache_value *value_b = b;
-
-  if (value_a->access_counter < value_b->access_counter)
-    return -1;
-  else if (value_a->access_counter > value_b->access_counter)
-    return 1;
-  else return 0;
+  return gzochid_lru_cache_new_with_ref
+    (hash_func, key_equal_func, cache_new_func, max_size, key_evict_func, NULL,
+     value_evict_func);
 }
 
-gpointer
-gzochid_lru_cache_lookup (gzochid_lru_cache *cache, gpointer key)
+/* Returns the shard responsible for the specified key. */
+
+static gzochid_lru_cache_shard *
+find_shard (gzochid_lru_cache *cache, gconstpointer key)
 {
-  gpointer ret = NULL;
+  guint hash = cache->hash_func (key);
   
-  g_mutex_lock (&cache->mutex);
-
-  /* If the value is already in the cache, bump the access counter and return 
-     it. */
+  /* Fold the high bits of the hash into the low bits, since the shard mask 
+     only looks at a few of the latter. */
   
-  if (g_hash_table_contains (cache->cache, key))
-    {
-      gzochid_lru_cache_value *value = g_hash_table_lookup (cache->cache, key);
-      GSequenceIter *iter = g_sequence_lookup
-	(cache->lru_index, value, lru_cache_value_compare, NULL);
+  return &cache->shards[(hash ^ (hash >> 16)) & (cache->num_shards - 1)];
+}
 
-      value->access_counter = cache->next_access_counter++;
-      
-      g_sequence_sort_changed (iter, lru_cache_value_compare, NULL);
+/* Links the specified entry into the specified shard's clock, immediately 
+   "behind" the hand, so that it is the last entry the hand reaches. */
 
-      ret = value->value;
+static void
+link_entry (gzochid_lru_cache_shard *shard, gzochid_lru_cache_entry *entry)
+{
+  if (shard->hand == NULL)
+    {
+      entry->prev = entry;
+      entry->next = entry;
+      shard->hand = entry;
     }
+  else
+    {
+      entry->prev = shard->hand->prev;
+      entry->next = shard->hand;
+      shard->hand->prev->next = entry;
+      shard->hand->prev = entry;
+    }
+}
 
-  /* Otherwise, use the value generator to produce it. */
-  
+/* Unlinks the specified entry from the specified shard's clock, advancing the
+   hand if it points to the entry. */
+
+static void
+unlink_entry (gzochid_lru_cache_shard *shard, gzochid_lru_cache_entry *entry)
+{
+  if (entry->next == entry)
+    shard->hand = NULL;
   else
     {
-      gzochid_lru_cache_value *value =
-	malloc (sizeof (gzochid_lru_cache_value));
-      gpointer key_copy = NULL;
-           
-      value->value = cache->new_func (key, &key_copy);
-      value->key = key_copy != NULL ? key_copy : key;      
-      value->access_counter = cache->next_access_counter++;
-
-      g_sequence_insert_sorted
-	(cache->lru_index, value, lru_cache_value_compare, NULL);
-      g_hash_table_insert (cache->cache, value->key, value);
-
-      ret = value->value;
-
-      /* ...and possibly evict the oldest value from the cache if the cache has
-	 exceeded its maximum size. */
+      if (shard->hand == entry)
+	shard->hand = entry->next;
       
-      if (g_hash_table_size (cache->cache) > cache->max_size)
+      entry->prev->next = entry->next;
+      entry->next->prev = entry->prev;
+    }
+}
+
+/* Sweeps the clock hand of the specified shard until the shard is no larger
+   than its maximum size, evicting unreferenced entries and clearing the 
+   referenced flag on the others. Entries that are loading or pinned are 
+   skipped; if there are not enough evictable entries the shard is left 
+   temporarily oversized, to be trimmed by a later insertion. 
+
+   The shard mutex must be held by the caller. */
+
+static void
+evict (gzochid_lru_cache *cache, gzochid_lru_cache_shard *shard)
+{
+  /* Two full sweeps are enough to clear every referenced flag and then reach
+     every evictable entry. */
+  
+  guint remaining = g_hash_table_size (shard->entries) * 2;
+
+  while (g_hash_table_size (shard->entries) > shard->max_size
+	 && remaining-- > 0)
+    {
+      gzochid_lru_cache_entry *entry = shard->hand;
+
+      if (entry->loading || entry->pin_count > 0)
+	shard->hand = entry->next;
+      else if (entry->referenced)
+	{
+	  entry->referenced = FALSE;
+	  shard->hand = entry->next;
+	}
+      else
 	{
-	  GSequenceIter *first = g_sequence_get_begin_iter (cache->lru_index);
-	  gzochid_lru_cache_value *old_value = g_sequence_get (first);	  
+	  unlink_entry (shard, entry);
 
 	  /* If the value eviction function exists, use it to evict the 
 	     value. */
 	  
 	  if (cache->value_evict_func != NULL)
-	    cache->value_evict_func (old_value->value);
+	    cache->value_evict_func (entry->value);
 
 	  /* GHashTable will handle the key eviction. */
-	  
-	  g_hash_table_remove (cache->cache, old_value->key);
-	  g_sequence_remove (first);
+
+	  g_hash_table_remove (shard->entries, entry->key);
+	  free (entry);
 	}
     }
+}
+
+/* Returns the value of the specified entry, taking a reference to it via the
+   cache's reference function if there is one. The shard mutex must be held by
+   the caller. */
+
+static gpointer
+entry_value (gzochid_lru_cache *cache, gzochid_lru_cache_entry *entry)
+{
+  return cache->value_ref_func != NULL
+    ? cache->value_ref_func (entry->value) : entry->value;
+}
+
+/* Creates a placeholder entry for the specified key in the specified shard, 
+   and calls the cache's value generator to produce its value, with the shard
+   mutex released so that lookups of other keys in the shard may proceed. 
+   Returns the generated value.
+   
+   The shard mutex must be held by the caller. */
+
+static gpointer
+load_entry (gzochid_lru_cache *cache, gzochid_lru_cache_shard *shard,
+	    gpointer key)
+{
+  gzochid_lru_cache_entry *entry = malloc (sizeof (gzochid_lru_cache_entry));
+  gpointer key_copy = NULL;
+  gpointer value = NULL;
+  gpointer ret = NULL;
+
+  entry->key = key;
+  entry->value = NULL;
+  entry->referenced = FALSE;
+  entry->loading = TRUE;
+  entry->pin_count = 0;
+
+  link_entry (shard, entry);
+  g_hash_table_insert (shard->entries, key, entry);
+
+  g_mutex_unlock (&shard->mutex);
+  value = cache->new_func (key, &key_copy);
+  g_mutex_lock (&shard->mutex);
+
+  /* The placeholder was keyed on the caller's key; re-key it if the value
+     generator provided a copy for storage in the cache. */
   
-  g_mutex_unlock (&cache->mutex);
+  if (key_copy != NULL)
+    {
+      g_hash_table_steal (shard->entries, key);
+      entry->key = key_copy;
+      g_hash_table_insert (shard->entries, key_copy, entry);
+    }
+
+  entry->value = value;
+  entry->loading = FALSE;
+  ret = entry_value (cache, entry);
+
+  g_cond_broadcast (&shard->cond);
+
+  /* ...and possibly evict older values from the shard if it has exceeded its
+     maximum size. */
+
+  evict (cache, shard);
+
   return ret;
 }
 
-/* A `Func' implementation to apply the `GDestroyNotify' value eviction function
-   to every value. */
-
-static void
-evict_value (gpointer data, gpointer user_data)
+gpointer
+gzochid_lru_cache_lookup (gzochid_lru_cache *cache, gpointer key)
 {
-  gzochid_lru_cache_value *value = data;
-  ((GDestroyNotify) user_data) (value->value);
+  gzochid_lru_cache_shard *shard = find_shard (cache, key);
+  gzochid_lru_cache_entry *entry = NULL;
+  gpointer ret = NULL;
+  
+  g_mutex_lock (&shard->mutex);
+
+  entry = g_hash_table_lookup (shard->entries, key);
+
+  /* If the value is already in the cache, mark it as referenced and return
+     it... */
+  
+  if (entry != NULL)
+    {
+      /* ...waiting for it to be generated if another thread is already doing 
+	 so. */
+
+      if (entry->loading)
+	{
+	  entry->pin_count++;
+	  while (entry->loading)
+	    g_cond_wait (&shard->cond, &shard->mutex);
+	  entry->pin_count--;
+	}
+
+      entry->referenced = TRUE;
+      ret = entry_value (cache, entry);
+    }
+
+  /* Otherwise, use the value generator to produce it. */
+  
+  else ret = load_entry (cache, shard, key);
+  
+  g_mutex_unlock (&shard->mutex);
+  return ret;
 }
 
 void
 gzochid_lru_cache_destroy (gzochid_lru_cache *cache)
 {
-  g_hash_table_destroy (cache->cache);
+  guint i = 0;
+
+  for (i = 0; i < cache->num_shards; i++)
+    {
+      gzochid_lru_cache_shard *shard = &cache->shards[i];
 
-  if (cache->value_evict_func != NULL)
-    g_sequence_foreach (cache->lru_index, evict_value, cache->value_evict_func);
+      g_hash_table_destroy (shard->entries);
 
-  g_sequence_free (cache->lru_index);
-  g_mutex_clear (&cache->mutex);
+      while (shard->hand != NULL)
+	{
+	  gzochid_lru_cache_entry *entry = shard->hand;
+
+	  unlink_entry (shard, entry);
+	  
+	  if (cache->value_evict_func != NULL)
+	    cache->value_evict_func (entry->value);
+
+	  free (entry);
+	}
+
+      g_mutex_clear (&shard->mutex);
+      g_cond_clear (&shard->cond);
+    }
 
+  free (cache->shards);
   free (cache);
 }
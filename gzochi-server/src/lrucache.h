@@ -29,18 +29,44 @@
 
 typedef gpointer (*gzochid_lru_cache_new_func) (gpointer, gpointer *);
 
+/* Typedef for a function pointer type to represent the caller-supplied 
+   "reference" function that is called on a value before it is returned from
+   `gzochid_lru_cache_lookup', while the value is guaranteed not to be evicted
+   from the cache. Implementations should return the value. */
+
+typedef gpointer (*gzochid_lru_cache_ref_func) (gpointer);
+
 typedef struct _gzochid_lru_cache gzochid_lru_cache;
 
-/* Construct a new LRU cache with the specified hash and equality functions
+/* 
+   Construct a new LRU cache with the specified hash and equality functions
    governing the behavior of the hash table backing the cache, the specified
    `gzochid_lru_cache_new_func' to be used as the value generator, the maximum
    size of the cache, and the optionally NULL `GDestroyNotify' functions to be 
-   called when keys and values are evicted from the cache. */
+   called when keys and values are evicted from the cache. 
+
+   The cache is safe for concurrent use. Large caches are divided into 
+   independently locked shards, each holding a fixed share of the maximum 
+   size; recency is tracked approximately, via the "clock" algorithm.
+*/
 
 gzochid_lru_cache *
 gzochid_lru_cache_new_full (GHashFunc, GEqualFunc, gzochid_lru_cache_new_func,
 			    guint, GDestroyNotify, GDestroyNotify);
 
+/* Like `gzochid_lru_cache_new_full', but with an additional, optionally NULL
+   `gzochid_lru_cache_ref_func' (preceding the value eviction function) to be
+   applied to values returned from `gzochid_lru_cache_lookup'. Use this when 
+   values are reference-counted and may otherwise be evicted - and released - 
+   by a concurrent lookup before the caller has a chance to take its own 
+   reference. */
+
+gzochid_lru_cache *
+gzochid_lru_cache_new_with_ref (GHashFunc, GEqualFunc,
+				gzochid_lru_cache_new_func, guint,
+				GDestroyNotify, gzochid_lru_cache_ref_func,
+				GDestroyNotify);
+
 /* Return the value mapped to the specified key in the specified LRU cache. If
    no value is currently mapped to the key, the cache's associated "value 
    generator" will be called, and the value it returns will be added to the
@@ -48,7 +74,11 @@ gzochid_lru_cache_new_full (GHashFunc, GEqualFunc, gzochid_lru_cache_new_func,
    recently accessed values in the cache.
 
    Accessing a value that is already mapped in the cache (i.e., a "cache hit")
-   causes it to be marked as recently accessed. */
+   causes it to be marked as recently accessed. 
+
+   The value generator is called without any cache locks held, and at most once
+   for concurrent lookups of the same key; lookups that arrive while the value
+   is being generated wait for it and return the same value. */
 
 gpointer
 gzochid_lru_cache_lookup (gzochid_lru_cache *, gpointer);
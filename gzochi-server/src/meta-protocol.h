@@ -222,6 +222,34 @@
 
 #define GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE 0x52
 
+/* Grants a point lock to a node whose earlier request for it was denied, along
+   with the value stored at the key. (A denial carrying a zero timeout indicates
+   that the request was queued by the data server, and that a grant will follow
+   once the conflicting locks have been released.) See
+   `gzochid_data_protocol_grant_write' below for format details. */
+
+#define GZOCHID_DATA_PROTOCOL_VALUE_GRANT 0x53
+
+/* Grants a range lock to a node whose earlier request for it was denied, along
+   with the key that bounds the range. See `gzochid_data_protocol_grant_write'
+   below for format details. */
+
+#define GZOCHID_DATA_PROTOCOL_NEXT_KEY_GRANT 0x54
+
+/* Asks the target server to release its point lock on the specified key as
+   soon as the transactions using it have completed, because another node has
+   requested a conflicting lock. See `gzochid_data_protocol_revocation_write'
+   below for format details. */
+
+#define GZOCHID_DATA_PROTOCOL_REVOKE_KEY 0x55
+
+/* Asks the target server to release its range lock starting at the specified
+   key as soon as the transactions using it have completed, because another
+   node has requested a conflicting lock. See
+   `gzochid_data_protocol_revocation_write' below for format details. */
+
+#define GZOCHID_DATA_PROTOCOL_REVOKE_KEY_RANGE 0x56
+
 /* 
   Directs the target server to disconnect the specified client session.
    
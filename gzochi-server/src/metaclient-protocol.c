@@ -181,6 +181,10 @@ client_dispatch (const GByteArray *buffer, gpointer user_data)
 	case GZOCHID_DATA_PROTOCOL_OIDS_RESPONSE:
 	case GZOCHID_DATA_PROTOCOL_VALUE_RESPONSE:
 	case GZOCHID_DATA_PROTOCOL_NEXT_KEY_RESPONSE:
+	case GZOCHID_DATA_PROTOCOL_VALUE_GRANT:
+	case GZOCHID_DATA_PROTOCOL_NEXT_KEY_GRANT:
+	case GZOCHID_DATA_PROTOCOL_REVOKE_KEY:
+	case GZOCHID_DATA_PROTOCOL_REVOKE_KEY_RANGE:
 	  {
 	    GzochidDataClient *dataclient = NULL;
 	    GByteArray *delegate_buffer = g_byte_array_sized_new (len);
@@ -24,10 +24,27 @@
 #include "queue.h"
 #include "util.h"
 
-/* Architecturally, the queue is a wrapper around a linked list with head and 
-   tail pointers used for remove and append operations, respectively. */
+/* Architecturally, the queue is a singly-linked list of "segments," each of 
+   which holds the oids of up to `QUEUE_SEGMENT_CAPACITY' queued objects. New
+   elements are appended to the tail segment, and elements are removed from the
+   head segment; so most offers and pops modify a single segment, and neither 
+   the queue header nor the list structure needs to be rewritten until a 
+   segment fills up or is drained.
 
-/* A link node in the queue. */
+   Queues persisted by earlier versions of gzochid store one link object per 
+   element. Such queues are still readable: Their remaining "legacy" links are
+   drained before any segment, and all new elements are added to segments. */
+
+/* The maximum number of element oids stored in a single segment. */
+
+#define QUEUE_SEGMENT_CAPACITY 64
+
+/* The leading byte of a serialized segmented queue. (The first byte of a 
+   serialized legacy queue is a boolean, and so is always 0 or 1.) */
+
+#define QUEUE_FORMAT_SEGMENTED 0x2
+
+/* A link node in a legacy queue. */
 
 struct _gzochid_durable_queue_element
 {
@@ -40,6 +57,19 @@ struct _gzochid_durable_queue_element
 
 typedef struct _gzochid_durable_queue_element gzochid_durable_queue_element;
 
+/* A segment of the queue. */
+
+struct _gzochid_durable_queue_segment
+{
+  GArray *oids; /* The `guint64' oids of the objects in this segment. */
+
+  /* A pointer to the next segment, or `NULL' if this is the last segment. */
+
+  gzochid_data_managed_reference *next;
+};
+
+typedef struct _gzochid_durable_queue_segment gzochid_durable_queue_segment;
+
 /* The outer queue structure. */
 
 struct _gzochid_durable_queue
@@ -47,14 +77,20 @@ struct _gzochid_durable_queue
   /* The gzochi application context to which the queue belongs. */
 
   gzochid_application_context *app_context; 
+
+  /* A reference to the first `gzochid_durable_queue_element' in the legacy 
+     part of the queue, or `NULL' if there are no legacy elements. */
+
+  gzochid_data_managed_reference *legacy_head;
   
-  /* The a reference to the first `gzochid_durable_queue_element' in the queue, 
-     or `NULL' if the queue is empty. */
+  /* A reference to the first `gzochid_durable_queue_segment' in the queue, or
+     `NULL' if no segment has been allocated. Only the tail segment may be 
+     empty, and only when it is also the head segment. */
 
   gzochid_data_managed_reference *head; 
 
-  /* The a reference to the last `gzochid_durable_queue_element' in the queue, 
-     or `NULL' if the queue is empty. */
+  /* A reference to the last `gzochid_durable_queue_segment' in the queue, or
+     `NULL' if no segment has been allocated. */
 
   gzochid_data_managed_reference *tail;
 };
@@ -147,16 +183,133 @@ finalize_element (gzochid_application_context *app_context, gpointer data)
 static gzochid_io_serialization gzochid_durable_queue_element_serialization =
   { serialize_element, deserialize_element, finalize_element };
 
+/* Create and return a new, empty `gzochid_durable_queue_segment'. The memory 
+   allocated for this object should be freed via 
+   `gzochid_durable_queue_segment_free' when no longer in use. */
+
+static gzochid_durable_queue_segment *
+gzochid_durable_queue_segment_new ()
+{
+  gzochid_durable_queue_segment *segment =
+    malloc (sizeof (gzochid_durable_queue_segment));
+
+  segment->oids = g_array_sized_new
+    (FALSE, FALSE, sizeof (guint64), QUEUE_SEGMENT_CAPACITY);
+  segment->next = NULL;
+
+  return segment;
+}
+
+/* Frees the memory associated with the specified 
+   `gzochid_durable_queue_segment'. */
+
+static void
+gzochid_durable_queue_segment_free (gzochid_durable_queue_segment *segment)
+{
+  g_array_unref (segment->oids);
+  free (segment);
+}
+
+/* Serializer implementation for `gzochid_durable_queue_segment' objects. Writes
+   the number of oids in the segment and the oids themselves, followed, 
+   optionally, by the oid of the next segment in the queue. */
+
+static void
+serialize_segment (gzochid_application_context *app_context, gpointer data,
+		   GByteArray *out, GError **err)
+{
+  gzochid_durable_queue_segment *segment = data;
+  guint i = 0;
+  
+  gzochid_util_serialize_int (segment->oids->len, out);
+
+  for (; i < segment->oids->len; i++)
+    gzochid_util_serialize_oid
+      (g_array_index (segment->oids, guint64, i), out);
+
+  /* Is there a next segment? */
+  
+  if (segment->next != NULL)
+    {
+      /* If so, write its oid. */
+      
+      gzochid_util_serialize_boolean (TRUE, out);
+      gzochid_util_serialize_oid (segment->next->oid, out);
+    }
+  else gzochid_util_serialize_boolean (FALSE, out);  
+}
+
+/* Forward declaration for the serialization, since the deserializer needs 
+   it. */
+
+static gzochid_io_serialization gzochid_durable_queue_segment_serialization;
+
+/* Deserializer implementation for `gzochid_durable_queue_segment' objects. */
+
+static gpointer
+deserialize_segment (gzochid_application_context *app_context, GByteArray *in,
+		     GError **err)
+{
+  gzochid_durable_queue_segment *segment = gzochid_durable_queue_segment_new ();
+  int i = 0, len = gzochid_util_deserialize_int (in);
+
+  for (; i < len; i++)
+    {
+      guint64 oid = gzochid_util_deserialize_oid (in);
+      g_array_append_val (segment->oids, oid);
+    }
+
+  /* Is there a next segment? */
+  
+  if (gzochid_util_deserialize_boolean (in))
+    {
+      /* If so, deserialize it. */
+
+      guint64 next_oid = gzochid_util_deserialize_oid (in);
+
+      segment->next = gzochid_data_create_reference_to_oid
+	(app_context, &gzochid_durable_queue_segment_serialization, next_oid);
+    }
+  
+  return segment;
+}
+
+/* Finalizer implementation for `gzochid_durable_queue_segment' objects. */
+
+static void
+finalize_segment (gzochid_application_context *app_context, gpointer data)
+{
+  gzochid_durable_queue_segment_free (data);
+}
+
+/* The serializer struct for `gzochid_durable_queue_segment'. */
+
+static gzochid_io_serialization gzochid_durable_queue_segment_serialization =
+  { serialize_segment, deserialize_segment, finalize_segment };
+
 /* Serializer implementation for `gzochid_durable_queue' objects. Writes the
-   oids of the head and tail pointers, if they exist. */
+   format marker, followed by the oid of the legacy head pointer and the oids of
+   the head and tail segment pointers, if they exist. */
 
 static void
 serialize_queue (gzochid_application_context *app_context, gpointer data,
 		 GByteArray *out, GError **err)
 {
   gzochid_durable_queue *queue = data;
+  unsigned char format[1] = { QUEUE_FORMAT_SEGMENTED };
 
-  /* Is the queue non-empty? */
+  g_byte_array_append (out, format, 1);
+  
+  /* Are there legacy elements left in the queue? */
+
+  if (queue->legacy_head != NULL)
+    {
+      gzochid_util_serialize_boolean (TRUE, out);
+      gzochid_util_serialize_oid (queue->legacy_head->oid, out);
+    }
+  else gzochid_util_serialize_boolean (FALSE, out);
+
+  /* Have any segments been allocated? */
   
   if (queue->head != NULL)
     {
@@ -170,7 +323,11 @@ serialize_queue (gzochid_application_context *app_context, gpointer data,
 }
 
 /* Deserializer implementation for `gzochid_durable_queue' objects. Reads the
-   oids of the head and tail pointers, if they exist. */
+   oids of the legacy head pointer and the head and tail segment pointers, if 
+   they exist. Queues persisted in the legacy format, which begins with a 
+   boolean indicating whether the queue is non-empty, followed by the head and
+   tail oids of the element list, are read as queues with a legacy head and no
+   segments. */
 
 static gpointer
 deserialize_queue (gzochid_application_context *app_context, GByteArray *in,
@@ -178,21 +335,37 @@ deserialize_queue (gzochid_application_context *app_context, GByteArray *in,
 {
   gzochid_durable_queue *queue = gzochid_durable_queue_new (app_context);
 
-  /* Is the queue non-empty? */
-
-  if (gzochid_util_deserialize_boolean (in))
+  if (in->data[0] == QUEUE_FORMAT_SEGMENTED)
     {
-      /* If so, read the head and tail oids. */
+      g_byte_array_remove_index (in, 0);
 
-      guint64 oid = gzochid_util_deserialize_oid (in);
+      if (gzochid_util_deserialize_boolean (in))
+	queue->legacy_head = gzochid_data_create_reference_to_oid
+	  (app_context, &gzochid_durable_queue_element_serialization,
+	   gzochid_util_deserialize_oid (in));
+
+      if (gzochid_util_deserialize_boolean (in))
+	{
+	  guint64 oid = gzochid_util_deserialize_oid (in);
       
-      queue->head = gzochid_data_create_reference_to_oid
-	(app_context, &gzochid_durable_queue_element_serialization, oid);
+	  queue->head = gzochid_data_create_reference_to_oid
+	    (app_context, &gzochid_durable_queue_segment_serialization, oid);
+
+	  oid = gzochid_util_deserialize_oid (in);
 
-      oid = gzochid_util_deserialize_oid (in);
+	  queue->tail = gzochid_data_create_reference_to_oid
+	    (app_context, &gzochid_durable_queue_segment_serialization, oid);
+	}
+    }
+  else if (gzochid_util_deserialize_boolean (in))
+    {
+      /* The legacy tail oid isn't needed, since new elements are always
+	 appended to segments. */
 
-      queue->tail = gzochid_data_create_reference_to_oid
-	(app_context, &gzochid_durable_queue_element_serialization, oid);
+      queue->legacy_head = gzochid_data_create_reference_to_oid
+	(app_context, &gzochid_durable_queue_element_serialization,
+	 gzochid_util_deserialize_oid (in));
+      gzochid_util_deserialize_oid (in);
     }
   
   return queue;
@@ -227,28 +400,44 @@ gzochid_durable_queue_free (gzochid_durable_queue *queue)
   free (queue);
 }
 
+/* Creates a new managed segment containing the single specified oid and 
+   returns a reference to it, or returns `NULL' and sets the error return 
+   argument if the segment could not be created. */
+
+static gzochid_data_managed_reference *
+create_segment (gzochid_durable_queue *queue, guint64 oid, GError **err)
+{
+  GError *local_err = NULL;
+  gzochid_durable_queue_segment *segment = gzochid_durable_queue_segment_new ();
+  gzochid_data_managed_reference *segment_ref = gzochid_data_create_reference
+    (queue->app_context, &gzochid_durable_queue_segment_serialization, segment,
+     &local_err);
+
+  if (local_err != NULL)
+    {
+      gzochid_durable_queue_segment_free (segment);
+      g_propagate_error (err, local_err);
+
+      return NULL;
+    }
+
+  g_array_append_val (segment->oids, oid);
+  return segment_ref;
+}
+
 void
 gzochid_durable_queue_offer (gzochid_durable_queue *queue,
 			     gzochid_io_serialization *serialization,
 			     gpointer data, GError **err)
 {
   GError *local_err = NULL;
-  gzochid_durable_queue_element *elt = gzochid_durable_queue_element_new ();
-  gzochid_data_managed_reference *elt_ref = NULL; 
-  gzochid_data_managed_reference *data_ref = NULL; 
+  gzochid_durable_queue_segment *tail_segment = NULL;
+  gzochid_data_managed_reference *segment_ref = NULL;
+  gzochid_data_managed_reference *data_ref = gzochid_data_create_reference
+    (queue->app_context, serialization, data, &local_err);
 
-  elt_ref = gzochid_data_create_reference
-    (queue->app_context, &gzochid_durable_queue_element_serialization, elt,
-     &local_err);
-  
-  if (local_err == NULL)
-    data_ref = gzochid_data_create_reference
-      (queue->app_context, serialization, data, &local_err);
-  else gzochid_durable_queue_element_free (elt);
-
-  /* Creating the reference to the new element wrapper or to the element itself
-     may fail if the transaction isn't healthy. If that happens, propagate the
-     error and bail out. */
+  /* Creating the reference to the new element may fail if the transaction 
+     isn't healthy. If that happens, propagate the error and bail out. */
   
   if (local_err != NULL)
     {
@@ -256,54 +445,124 @@ gzochid_durable_queue_offer (gzochid_durable_queue *queue,
       return;
     }
 
-  elt->oid = data_ref->oid;
-  elt->next = NULL;
-
-  if (queue->head == NULL)
+  if (queue->tail == NULL)
     {
-      /* If the queue is empty, the new link is the head and the tail. */
-      
-      queue->head = elt_ref;
-      queue->tail = elt_ref;
-    }
-  else
-    {
-      gzochid_data_dereference (queue->tail, &local_err);
+      /* If no segment has been allocated, the new segment is the head and the
+	 tail. */
 
-      if (local_err == NULL)
+      segment_ref = create_segment (queue, data_ref->oid, err);
+
+      if (segment_ref != NULL)
 	{
-	  /* Otherwise, make the new link the "next" of the current tail, and
-	     set the tail to be the new link. */
-	  
-	  gzochid_durable_queue_element *tail_elt = queue->tail->obj;
-	  
-	  if (local_err != NULL)
-	    {
-	      g_propagate_error (err, local_err);
-	      return;
-	    }
-	  
-	  tail_elt->next = elt_ref;
-	  queue->tail = elt_ref;
+	  queue->head = segment_ref;
+	  queue->tail = segment_ref;
 
-	  /* Mark the old tail for modification. */
+	  /* Mark the entire queue for modification. */
 	  
 	  gzochid_data_mark
-	    (queue->app_context, &gzochid_durable_queue_element_serialization,
-	     tail_elt, &local_err);
+	    (queue->app_context, &gzochid_durable_queue_serialization, queue,
+	     err);
 	}
+      
+      return;
+    }
 
-      if (local_err != NULL)
-	{
-	  g_propagate_error (err, local_err);
-	  return;
-	}
+  tail_segment = gzochid_data_dereference_for_update (queue->tail, &local_err);
+
+  if (local_err != NULL)
+    {
+      g_propagate_error (err, local_err);
+      return;
     }
 
-  /* Mark the entire queue for modification. */
+  if (tail_segment->oids->len < QUEUE_SEGMENT_CAPACITY)
+    {
+      /* If there's room in the tail segment, add the new oid to it. The queue
+	 itself is unmodified. */
+      
+      g_array_append_val (tail_segment->oids, data_ref->oid);
+      gzochid_data_mark
+	(queue->app_context, &gzochid_durable_queue_segment_serialization,
+	 tail_segment, err);
+      
+      return;
+    }
+
+  /* Otherwise, link a new segment to the tail and make it the new tail. */
   
-  gzochid_data_mark
-    (queue->app_context, &gzochid_durable_queue_serialization, queue, err);
+  segment_ref = create_segment (queue, data_ref->oid, &local_err);
+
+  if (local_err == NULL)
+    {
+      tail_segment->next = segment_ref;
+      queue->tail = segment_ref;
+      
+      gzochid_data_mark
+	(queue->app_context, &gzochid_durable_queue_segment_serialization,
+	 tail_segment, &local_err);
+    }
+
+  if (local_err == NULL)
+
+    /* Mark the entire queue for modification. */
+    
+    gzochid_data_mark
+      (queue->app_context, &gzochid_durable_queue_serialization, queue,
+       &local_err);
+
+  if (local_err != NULL)
+    g_propagate_error (err, local_err);
+}
+
+/* Deserializes and returns the object at the head of the legacy part of the
+   specified queue, optionally removing it from the queue. */
+
+static gpointer
+legacy_peek_or_pop (gzochid_durable_queue *queue,
+		    gzochid_io_serialization *serialization, gboolean pop,
+		    GError **err)
+{
+  GError *local_err = NULL;
+  gpointer data = NULL;
+  gzochid_data_managed_reference *head_ref = queue->legacy_head;
+  gzochid_data_managed_reference *data_ref = NULL;
+  gzochid_durable_queue_element *elt = pop
+    ? gzochid_data_dereference_for_update (head_ref, &local_err)
+    : gzochid_data_dereference (head_ref, &local_err);
+
+  if (local_err != NULL)
+    {
+      g_propagate_error (err, local_err);
+      return NULL;
+    }
+
+  data_ref = gzochid_data_create_reference_to_oid
+    (queue->app_context, serialization, elt->oid);
+  data = gzochid_data_dereference (data_ref, &local_err);
+
+  if (local_err == NULL && pop)
+    {
+      queue->legacy_head = elt->next;
+      
+      /* Remove the old head link from the data store. */
+	      
+      gzochid_data_remove_object (head_ref, &local_err);
+
+      if (local_err == NULL)
+
+	/* Mark the queue for modification. */
+		
+	gzochid_data_mark
+	  (queue->app_context, &gzochid_durable_queue_serialization, queue,
+	   &local_err);
+    }
+
+  if (local_err != NULL)
+    {
+      g_propagate_error (err, local_err);
+      return NULL;
+    }
+  else return data;
 }
 
 gpointer
@@ -311,23 +570,26 @@ gzochid_durable_queue_peek (gzochid_durable_queue *queue,
 			    gzochid_io_serialization *serialization,
 			    GError **err)
 {
-  gzochid_data_managed_reference *head_ref = queue->head;
+  GError *local_err = NULL;
+  gzochid_durable_queue_segment *segment = NULL;
 
-  if (head_ref != NULL)
-    {
-      GError *local_err = NULL;
-      gzochid_durable_queue_element *elt =
-	gzochid_data_dereference (head_ref, &local_err);
+  if (queue->legacy_head != NULL)
+    return legacy_peek_or_pop (queue, serialization, FALSE, err);
+  else if (queue->head == NULL)
+    return NULL;
 
-      if (local_err == NULL)
-	{
-	  gzochid_data_managed_reference *data_ref =
-	    gzochid_data_create_reference_to_oid
-	    (queue->app_context, serialization, elt->oid);
+  segment = gzochid_data_dereference (queue->head, &local_err);
 
-	  return gzochid_data_dereference (data_ref, err);
-	}
-      else g_propagate_error (err, local_err);
+  if (local_err != NULL)
+    g_propagate_error (err, local_err);
+  else if (segment->oids->len > 0)
+    {
+      gzochid_data_managed_reference *data_ref =
+	gzochid_data_create_reference_to_oid
+	(queue->app_context, serialization,
+	 g_array_index (segment->oids, guint64, 0));
+
+      return gzochid_data_dereference (data_ref, err);
     }
 
   return NULL;
@@ -338,52 +600,66 @@ gzochid_durable_queue_pop (gzochid_durable_queue *queue,
 			   gzochid_io_serialization *serialization,
 			   GError **err)
 {
+  GError *local_err = NULL;
+  gpointer data = NULL;
   gzochid_data_managed_reference *head_ref = queue->head;
+  gzochid_data_managed_reference *data_ref = NULL;
+  gzochid_durable_queue_segment *segment = NULL;
+
+  if (queue->legacy_head != NULL)
+    return legacy_peek_or_pop (queue, serialization, TRUE, err);
+  else if (head_ref == NULL)
+    return NULL;
 
-  if (head_ref != NULL)
+  segment = gzochid_data_dereference_for_update (head_ref, &local_err);
+
+  if (local_err != NULL)
     {
-      GError *local_err = NULL;
-      gzochid_durable_queue_element *elt = gzochid_data_dereference_for_update
-	(head_ref, &local_err);
+      g_propagate_error (err, local_err);
+      return NULL;
+    }
+  else if (segment->oids->len == 0)
+    return NULL;
 
-      if (local_err == NULL)
-	{
-	  gpointer data = NULL;
-	  gzochid_data_managed_reference *data_ref = NULL;
-	  
-	  queue->head = elt->next;
+  data_ref = gzochid_data_create_reference_to_oid
+    (queue->app_context, serialization,
+     g_array_index (segment->oids, guint64, 0));
+  data = gzochid_data_dereference (data_ref, &local_err);
 
-	  /* If the head of the queue is now `NULL', that must mean the queue is
-	     empty. Set the tail to `NULL' as well. */
-	  
-	  if (queue->head == NULL)
-	    queue->tail = NULL;
+  if (local_err != NULL)
+    {
+      g_propagate_error (err, local_err);
+      return NULL;
+    }
 
-	  data_ref = gzochid_data_create_reference_to_oid
-	    (queue->app_context, serialization, elt->oid);
-	  data = gzochid_data_dereference (data_ref, &local_err);
+  g_array_remove_index (segment->oids, 0);
 
-	  if (local_err == NULL)
-	    {
-	      /* Remove the old head link from the data store. */
-	      
-	      gzochid_data_remove_object (head_ref, &local_err);
+  if (segment->oids->len == 0 && segment->next != NULL)
+    {
+      /* The head segment has been drained and isn't the tail; remove it and
+	 advance the head of the queue to the next segment. */
 
-	      if (local_err == NULL)
+      queue->head = segment->next;
+      gzochid_data_remove_object (head_ref, &local_err);
 
-		/* Mark the queue for modification. */
-		
-		gzochid_data_mark
-		  (queue->app_context, &gzochid_durable_queue_serialization,
-		   queue, &local_err);
-	      
-	      if (local_err == NULL)
-		return data;
-	    }
-	}
+      if (local_err == NULL)
+	gzochid_data_mark
+	  (queue->app_context, &gzochid_durable_queue_serialization, queue,
+	   &local_err);
+    }
 
+  /* Otherwise only the segment has changed. An empty segment that is also the
+     tail is kept, so that a queue that is repeatedly filled and drained 
+     doesn't have to allocate a new segment for every offer. */
+  
+  else gzochid_data_mark
+	 (queue->app_context, &gzochid_durable_queue_segment_serialization,
+	  segment, &local_err);
+
+  if (local_err != NULL)
+    {
       g_propagate_error (err, local_err);
+      return NULL;
     }
-
-  return NULL;
+  else return data;
 }
@@ -52,8 +52,31 @@ struct _gzochid_task_queue
 
   GQueue *queue; /* The task queue. */
   GThreadPool *pool; /* The pool to which ready tasks are fed. */
+
+  /* Map of `guint64' affinity key to `gzochid_task_lane'. A lane is present in
+     this table only while it has a task executing or pending execution. 
+     Protected by `mutex'. */
+
+  GHashTable *lanes;
+};
+
+/* An execution lane, which serializes the execution of tasks submitted with 
+   the same affinity key. */
+
+struct _gzochid_task_lane
+{
+  gzochid_task_queue *task_queue; /* The task queue that owns the lane. */
+  guint64 key; /* The lane's affinity key. */
+
+  /* The task currently submitted to the task queue on behalf of the lane. */
+  
+  gzochid_task *current; 
+
+  GQueue *pending; /* `gzochid_task' pointers waiting to be released. */
 };
 
+typedef struct _gzochid_task_lane gzochid_task_lane;
+
 /* The pending task structure. Represents the status of a task submitted to a
    task execution queue. 
 
@@ -77,6 +100,22 @@ struct _gzochid_pending_task
 
 typedef struct _gzochid_pending_task gzochid_pending_task;
 
+/* Frees the specified execution lane, along with its current task (if it has
+   not already been run) and any tasks still waiting to be released. The task
+   data is not freed. */
+
+static void
+lane_free (gpointer data)
+{
+  gzochid_task_lane *lane = data;
+
+  if (lane->current != NULL)
+    gzochid_task_free (lane->current);
+  
+  g_queue_free_full (lane->pending, (GDestroyNotify) gzochid_task_free);
+  free (lane);
+}
+
 gzochid_task_queue *
 gzochid_schedule_task_queue_new (GThreadPool *pool)
 {
@@ -85,6 +124,8 @@ gzochid_schedule_task_queue_new (GThreadPool *pool)
   g_cond_init (&task_queue->cond);
   g_mutex_init (&task_queue->mutex);
   task_queue->queue = g_queue_new ();
+  task_queue->lanes = g_hash_table_new_full
+    (g_int64_hash, g_int64_equal, NULL, lane_free);
 
   task_queue->pool = pool;
   task_queue->consumer_thread = NULL;
@@ -108,6 +149,7 @@ gzochid_schedule_task_queue_free (gzochid_task_queue *task_queue)
   g_mutex_clear (&task_queue->mutex);
 
   g_queue_free_full (task_queue->queue, (GDestroyNotify) free_pending_task);
+  g_hash_table_destroy (task_queue->lanes);
 
   free (task_queue);
 }
@@ -299,6 +341,18 @@ gzochid_schedule_submit_task_chain (gzochid_task_queue *task_queue,
   gzochid_schedule_submit_task (task_queue, &task);
 }
 
+/* Adds the specified pending task to the specified task queue and signals the
+   consumer thread. The caller must hold the task queue's mutex. */
+
+static void
+enqueue_pending_task (gzochid_task_queue *task_queue,
+		      gzochid_pending_task *pending_task)
+{
+  g_queue_insert_sorted 
+    (task_queue->queue, pending_task, pending_task_compare, NULL);
+  g_cond_signal (&task_queue->cond);
+}
+
 static gzochid_pending_task *
 submit_task (gzochid_task_queue *task_queue, gzochid_task *task,
 	     gboolean destroy_on_execute)
@@ -307,9 +361,7 @@ submit_task (gzochid_task_queue *task_queue, gzochid_task *task,
     gzochid_pending_task_new (task, destroy_on_execute);
   
   g_mutex_lock (&task_queue->mutex);
-  g_queue_insert_sorted 
-    (task_queue->queue, pending_task, pending_task_compare, NULL);
-  g_cond_signal (&task_queue->cond);
+  enqueue_pending_task (task_queue, pending_task);
   g_mutex_unlock (&task_queue->mutex);
 
   return pending_task;
@@ -322,6 +374,103 @@ gzochid_schedule_submit_task (gzochid_task_queue *task_queue,
   submit_task (task_queue, task, TRUE);
 }
 
+static void lane_worker (gpointer, gpointer);
+
+/* Submits the current task of the specified lane to the lane's task queue. The 
+   caller must hold the task queue's mutex. */
+
+static void
+release_lane_task (gzochid_task_lane *lane)
+{
+  gzochid_task lane_task;
+
+  lane_task.worker = lane_worker;
+  lane_task.data = lane;
+  lane_task.target_execution_time = lane->current->target_execution_time;
+
+  enqueue_pending_task
+    (lane->task_queue, gzochid_pending_task_new (&lane_task, TRUE));
+}
+
+/* The worker for tasks submitted on behalf of an execution lane. Runs the 
+   lane's current task and then either releases the next pending task in the 
+   lane or, if there are none, retires the lane. */
+
+static void 
+lane_worker (gpointer data, gpointer user_data)
+{
+  gzochid_task_lane *lane = data;
+  gzochid_task_queue *task_queue = lane->task_queue;
+
+  lane->current->worker (lane->current->data, user_data);
+  gzochid_task_free (lane->current);
+  lane->current = NULL;
+  
+  g_mutex_lock (&task_queue->mutex);
+
+  /* Removing the lane from the lane table frees it. */
+  
+  if (g_queue_is_empty (lane->pending))
+    g_hash_table_remove (task_queue->lanes, &lane->key);
+  else
+    {
+      lane->current = g_queue_pop_head (lane->pending);
+      release_lane_task (lane);
+    }
+  
+  g_mutex_unlock (&task_queue->mutex);
+}
+
+/* Submits a copy of the specified task to the execution lane with the 
+   specified key, creating the lane if necessary. If the lane already exists,
+   the task is queued behind its pending tasks, or ahead of them if `first' is
+   `TRUE'. */
+
+static void
+submit_task_with_affinity (gzochid_task_queue *task_queue, guint64 key,
+			   gzochid_task *task, gboolean first)
+{
+  gzochid_task_lane *lane = NULL;
+  gzochid_task *task_copy = gzochid_task_new
+    (task->worker, task->data, task->target_execution_time);
+  
+  g_mutex_lock (&task_queue->mutex);
+
+  lane = g_hash_table_lookup (task_queue->lanes, &key);
+
+  if (lane == NULL)
+    {
+      lane = malloc (sizeof (gzochid_task_lane));
+
+      lane->task_queue = task_queue;
+      lane->key = key;
+      lane->current = task_copy;
+      lane->pending = g_queue_new ();
+
+      g_hash_table_insert (task_queue->lanes, &lane->key, lane);
+      release_lane_task (lane);
+    }
+  else if (first)
+    g_queue_push_head (lane->pending, task_copy);
+  else g_queue_push_tail (lane->pending, task_copy);
+
+  g_mutex_unlock (&task_queue->mutex);
+}
+
+void
+gzochid_schedule_submit_task_with_affinity (gzochid_task_queue *task_queue,
+					    guint64 key, gzochid_task *task)
+{
+  submit_task_with_affinity (task_queue, key, task, FALSE);
+}
+
+void
+gzochid_schedule_submit_task_with_affinity_first
+(gzochid_task_queue *task_queue, guint64 key, gzochid_task *task)
+{
+  submit_task_with_affinity (task_queue, key, task, TRUE);
+}
+
 void 
 gzochid_schedule_run_task (gzochid_task_queue *task_queue, gzochid_task *task)
 {
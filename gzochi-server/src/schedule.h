@@ -48,6 +48,26 @@ void gzochid_schedule_task_queue_stop (gzochid_task_queue *);
 
 void gzochid_schedule_submit_task (gzochid_task_queue *, gzochid_task *);
 
+/* Submits the specified task for execution in the specified task queue, in the
+   execution "lane" identified by the specified affinity key, and returns 
+   immediately. Tasks submitted with the same affinity key are executed 
+   serially, in submission order - each task is released to the queue only 
+   once the previous task in its lane has finished executing - while tasks with
+   different affinity keys may execute concurrently. Each task will be executed
+   no earlier than its configured execution time. */
+
+void gzochid_schedule_submit_task_with_affinity
+(gzochid_task_queue *, guint64, gzochid_task *);
+
+/* Like `gzochid_schedule_submit_task_with_affinity', but places the specified
+   task ahead of any tasks already pending in its lane. This is meant to be
+   called by a task executing in the lane, to have a follow-up task - e.g., the
+   delayed retry of a failed transaction - run before the rest of the lane, 
+   without holding a thread while it waits for its execution time. */
+
+void gzochid_schedule_submit_task_with_affinity_first
+(gzochid_task_queue *, guint64, gzochid_task *);
+
 /* Submits the specified list of tasks for execution in the specified task 
    queue and returns immediately. Each task is submitted in the order specified
    in the queue once the previous task has executed; each task will be executed
@@ -344,41 +344,32 @@ gzochid_scheme_application_logged_in_worker
     }
 }
 
-void 
-gzochid_scheme_application_received_message_worker 
-(gzochid_application_context *context, gzochid_auth_identity *identity, 
- gpointer ptr)
+/* Dereferences the session with the specified oid and the `received-message'
+   handler attached to it. Returns a reference to the handler, or `NULL' if 
+   either could not be dereferenced. */
+
+static gzochid_data_managed_reference *
+resolve_received_message_handler (gzochid_application_context *context,
+				  guint64 session_oid)
 {
   GError *err = NULL;
   gzochid_client_session *session = NULL;
   gzochid_data_managed_reference *session_reference = NULL;
   gzochid_data_managed_reference *callback_reference = NULL;
 
-  SCM bv = SCM_BOOL_F;
-  SCM exception_var = scm_make_variable (SCM_UNSPECIFIED);
-
-  void **data = ptr;
-
-  guint64 *session_oid = data[0];
-  gsize message_len;
-  unsigned char *message = (unsigned char *) g_bytes_get_data
-    (data[1], &message_len);
-
   session_reference = gzochid_data_create_reference_to_oid 
-    (context, &gzochid_client_session_serialization, *session_oid);
+    (context, &gzochid_client_session_serialization, session_oid);
 
   gzochid_data_dereference (session_reference, &err);
 
   if (err != NULL)
     {
       g_error_free (err);
-      return;
+      return NULL;
     }
 
   session = session_reference->obj;
 
-  bv = gzochid_scheme_create_bytevector (message, message_len);
-  
   callback_reference =
     gzochid_data_create_reference_to_oid
     (context, &gzochid_scheme_data_serialization,
@@ -389,8 +380,27 @@ gzochid_scheme_application_received_message_worker
   if (err != NULL)
     {
       g_error_free (err);
-      return;
+      return NULL;
     }
+  else return callback_reference;
+}
+
+/* Invokes the specified `received-message' handler with the specified message
+   payload, marking the transaction for rollback if the handler raises an 
+   error. Returns `TRUE' if the handler returned normally, `FALSE' otherwise. */
+
+static gboolean
+deliver_received_message (gzochid_application_context *context,
+			  gzochid_auth_identity *identity,
+			  gzochid_data_managed_reference *callback_reference,
+			  GBytes *message)
+{
+  gsize message_len;
+  unsigned char *message_bytes = (unsigned char *) g_bytes_get_data
+    (message, &message_len);
+
+  SCM bv = gzochid_scheme_create_bytevector (message_bytes, message_len);
+  SCM exception_var = scm_make_variable (SCM_UNSPECIFIED);
       
   gzochid_scheme_invoke_callback
     (context, identity, "gzochi:execute-received-message", gzochi_private_app,
@@ -398,16 +408,69 @@ gzochid_scheme_application_received_message_worker
 
   if (scm_variable_ref (exception_var) != SCM_UNSPECIFIED)
     {
+      /* A rollback triggered elsewhere in the transaction (a lock conflict
+	 or a timeout, for example) is the transaction's fault, not the 
+	 handler's, so the delivery is considered worth retrying. */
+      
+      gboolean retry = TRUE;
+      
       if (! gzochid_scheme_triggered_by_rollback 
 	  (scm_variable_ref (exception_var)))
 	{
+	  retry = gzochid_scheme_is_transaction_retry
+	    (scm_variable_ref (exception_var));
+	  
 	  gzochid_transaction_join (&scheme_participant, NULL);
-	  gzochid_transaction_mark_for_rollback 
-	    (&scheme_participant, 
-	     gzochid_scheme_is_transaction_retry 
-	     (scm_variable_ref (exception_var)));
+	  gzochid_transaction_mark_for_rollback (&scheme_participant, retry);
 	}
+
+      return FALSE;
     }
+  else return TRUE;
+}
+
+void 
+gzochid_scheme_application_received_message_worker 
+(gzochid_application_context *context, gzochid_auth_identity *identity, 
+ gpointer ptr)
+{
+  void **data = ptr;
+  guint64 *session_oid = data[0];
+  gzochid_data_managed_reference *callback_reference =
+    resolve_received_message_handler (context, *session_oid);
+
+  if (callback_reference != NULL)
+    deliver_received_message
+      (context, identity, callback_reference, data[1]);
+}
+
+void 
+gzochid_scheme_application_received_messages_worker 
+(gzochid_application_context *context, gzochid_auth_identity *identity, 
+ gpointer ptr)
+{
+  void **data = ptr;
+  guint64 *session_oid = data[0];
+  GPtrArray *messages = data[1];
+  gboolean *failed = data[2];
+  gzochid_data_managed_reference *callback_reference = NULL;
+  guint i = 0;
+
+  /* The flag may have been set by a previous attempt at the same batch. */
+  
+  *failed = FALSE;
+  callback_reference = resolve_received_message_handler (context, *session_oid);
+  
+  if (callback_reference == NULL)
+    return;
+  
+  for (; i < messages->len; i++)
+    if (!deliver_received_message (context, identity, callback_reference,
+				   g_ptr_array_index (messages, i)))
+      {
+	*failed = TRUE;
+	break;
+      }
 }
 
 void 
@@ -38,6 +38,19 @@ void gzochid_scheme_application_logged_in_worker
 (gzochid_application_context *, gzochid_auth_identity *, gpointer);
 void gzochid_scheme_application_received_message_worker
 (gzochid_application_context *, gzochid_auth_identity *, gpointer);
+
+/* Transactional application worker that delivers a batch of messages received
+   from a single client session to the session's `received-message' handler, in
+   order, within the current transaction. The worker data is an array of 
+   pointers, the first being a pointer to the session oid, the second being a
+   `GPtrArray' of `GBytes' message payloads, and the third being a pointer to a
+   `gboolean'. Delivery stops at the first message whose handler raises an 
+   error, in which case the `gboolean' is set to `TRUE', to let the caller 
+   redeliver the messages one transaction at a time if the batch's final
+   attempt fails. */
+
+void gzochid_scheme_application_received_messages_worker
+(gzochid_application_context *, gzochid_auth_identity *, gpointer);
 void gzochid_scheme_application_disconnected_worker
 (gzochid_application_context *, gzochid_auth_identity *, gpointer);
 
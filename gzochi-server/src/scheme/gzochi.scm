@@ -105,7 +105,7 @@
 	  gzochi:client-session-listener gzochi:make-client-session-listener
 	  gzochi:client-session-listener-received-message
 	  gzochi:client-session-listener-disconnected gzochi:send-message
-	  gzochi:disconnect
+	  gzochi:client-session-congested? gzochi:disconnect
 
           ;; (gzochi task)
 
@@ -21,6 +21,7 @@
 	  gzochi:application-context-name
 
           gzochi:applications
+	  gzochi:backup-application
 	  gzochi:current-application
 	  gzochi:with-application)
   (import (only (guile) thunk?)
@@ -37,12 +38,26 @@
     (sealed #t))
 
   (define primitive-applications #f)
+  (define primitive-backup-application #f)
   (define primitive-current-application #f)
   (define primitive-with-application #f)
 
   (define (gzochi:applications)
     (primitive-applications))
 
+  (define (gzochi:backup-application context directory)
+    (or (gzochi:application-context? context)
+	(assertion-violation
+	 'gzochi:backup-application "Expected application context." context))
+    (or (string? directory)
+	(assertion-violation
+	 'gzochi:backup-application "Expected string." directory))
+
+    (let ((result (primitive-backup-application context directory)))
+      (if (string? result)
+	  (error 'gzochi:backup-application result context directory)
+	  result)))
+
   (define (gzochi:current-application)
     (primitive-current-application))
 
@@ -93,6 +93,7 @@
 
 	  gzochi:create-reference
 	  gzochi:dereference
+	  gzochi:prefetch
 	  gzochi:get-binding
 	  gzochi:set-binding!
 	  gzochi:remove-binding!
@@ -278,7 +279,11 @@
     (let ((obj (vector-ref (gzochi:managed-vector-vector vec) i)))
       (and obj (managed-vector-entry-value (gzochi:dereference obj)))))
 
+  (define (prefetch-managed-vector vec)
+    (gzochi:prefetch (filter values (vector->list vec))))
+
   (define (gzochi:managed-vector->list vec)
+    (prefetch-managed-vector (gzochi:managed-vector-vector vec))
     (map (lambda (obj) 
 	   (and obj (managed-vector-entry-value (gzochi:dereference obj))))
 	 (vector->list (gzochi:managed-vector-vector vec))))
@@ -782,6 +787,7 @@
     (define seeds-length (length seeds))
     (define (terminate? seeds) (and (eqv? (length seeds) 1) (not (car seeds))))
     (define (managed-vector-fold-left mvec size . seeds)
+      (prefetch-managed-vector (gzochi:managed-vector-vector mvec))
       (let loop ((i 0) (seeds seeds))
 	(if (< i size)
 	    (receive seeds 
@@ -815,6 +821,7 @@
     (define seeds-length (length seeds))
     (define (terminate? seeds) (and (eqv? (length seeds) 1) (not (car seeds))))
     (define (managed-vector-fold-right mvec size . seeds)
+      (prefetch-managed-vector (gzochi:managed-vector-vector mvec))
       (let loop ((i (- size 1)) (seeds seeds))
 	(if (>= i 0)
 	    (receive seeds 
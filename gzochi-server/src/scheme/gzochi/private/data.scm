@@ -44,6 +44,7 @@
 
 	  gzochi:create-reference
 	  gzochi:dereference
+	  gzochi:prefetch
 
 	  gzochi:get-binding
 	  gzochi:set-binding!
@@ -722,6 +723,23 @@
     
     (primitive-dereference reference))
 
+  (define (gzochi:prefetch references)
+    (define (reference->oid reference)
+      (cond ((gzochi:managed-reference? reference)
+	     (gzochi:managed-reference-oid reference))
+	    ((and (integer? reference) (exact? reference) 
+		  (not (negative? reference)))
+	     reference)
+	    (else (assertion-violation
+		   'gzochi:prefetch
+		   "Only managed references and oids can be prefetched."
+		   reference))))
+    
+    (or (list? references)
+	(assertion-violation 'gzochi:prefetch "Expecting list." references))
+
+    (primitive-prefetch (map reference->oid references)))
+
   (define (gzochi:get-binding name)
     (or (string? name)
 	(assertion-violation 'gzochi:get-binding "Expecting string." name))
@@ -756,6 +774,7 @@
 
   (define primitive-create-reference #f)
   (define primitive-dereference #f)
+  (define primitive-prefetch #f)
 
   (define primitive-get-binding #f)
   (define primitive-set-binding! #f)
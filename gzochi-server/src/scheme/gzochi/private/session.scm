@@ -29,9 +29,11 @@
 	  gzochi:client-session-listener-disconnected
 
 	  gzochi:send-message
+	  gzochi:client-session-congested?
 	  gzochi:disconnect)
 
-  (import (gzochi io)
+  (import (only (guile) define*)
+	  (gzochi io)
 	  (gzochi private data)
 	  (rnrs base)
 	  (rnrs bytevectors)
@@ -39,6 +41,7 @@
 	  (rnrs exceptions))
 
   (define primitive-send-message #f)
+  (define primitive-client-session-congested? #f)
   (define primitive-disconnect #f)
 
   (gzochi:define-managed-record-type 
@@ -55,7 +58,7 @@
    (fields received-message disconnected)
    (sealed #t))
 
-  (define (gzochi:send-message session msg)
+  (define* (gzochi:send-message session msg #:optional droppable?)
     (or (gzochi:client-session? session)
 	(assertion-violation
 	 'gzochi:send-message "Expected gzochi:client-session." session))
@@ -63,7 +66,15 @@
     (or (bytevector? msg)
 	(assertion-violation 'gzochi:send-message "Expected bytevector." msg))
     
-    (primitive-send-message session msg))
+    (primitive-send-message session msg (and droppable? #t)))
+
+  (define (gzochi:client-session-congested? session)
+    (or (gzochi:client-session? session)
+	(assertion-violation
+	 'gzochi:client-session-congested? "Expected gzochi:client-session."
+	 session))
+
+    (primitive-client-session-congested? session))
 
   (define (gzochi:disconnect session)
     (or (gzochi:client-session? session)
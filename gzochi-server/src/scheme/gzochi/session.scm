@@ -27,6 +27,7 @@
 	  gzochi:client-session-listener-disconnected
 
 	  gzochi:send-message
+	  gzochi:client-session-congested?
 	  gzochi:disconnect)
 
   (import (gzochi private session))
@@ -84,6 +84,10 @@ struct _gzochid_client_session_pending_message_operation
 
   unsigned char *message;
   short len;
+
+  /* Whether the message may be dropped if the client is congested. */
+
+  gboolean droppable; 
 };
 
 typedef struct _gzochid_client_session_pending_message_operation
@@ -156,7 +160,8 @@ create_login_failure_operation (guint64 target_session)
 }
 
 static gzochid_client_session_pending_operation *
-create_message_operation (guint64 target_session, unsigned char *msg, short len)
+create_message_operation (guint64 target_session, unsigned char *msg, short len,
+			  gboolean droppable)
 {
   gzochid_client_session_pending_message_operation *msg_op = 
     malloc (sizeof (gzochid_client_session_pending_message_operation));
@@ -168,6 +173,7 @@ create_message_operation (guint64 target_session, unsigned char *msg, short len)
 
   msg_op->message = msg;
   msg_op->len = len;
+  msg_op->droppable = droppable;
 
   return op;
 }
@@ -283,7 +289,17 @@ session_commit_operation
 	     g_object_new (GZOCHID_TYPE_EVENT, "type", MESSAGE_SENT, NULL));
 
 	  if (client != NULL)
-	    gzochid_game_client_send (client, msg_op->message, msg_op->len);
+	    {
+	      if (msg_op->droppable)
+		gzochid_game_client_send_droppable
+		  (client, msg_op->message, msg_op->len);
+	      else gzochid_game_client_send
+		     (client, msg_op->message, msg_op->len);
+	    }
+
+	  /* The metaserver protocol has no notion of droppable messages, so 
+	     messages to remote sessions are always forwarded. */
+	  
 	  else if (context->metaclient != NULL)
 	    forward_message (context->metaclient, context->descriptor->name,
 			     op->target_session, msg_op->message, msg_op->len);
@@ -663,10 +679,13 @@ gzochid_client_session_send_login_failure (gzochid_application_context *context,
   tx_context->login_failed = TRUE;
 }
 
-void 
-gzochid_client_session_send_message (gzochid_application_context *context, 
-				     gzochid_client_session *session, 
-				     unsigned char *msg, short len)
+/* Adds an operation to send the specified message to the specified session to
+   the current transaction. */
+
+static void
+send_message (gzochid_application_context *context,
+	      gzochid_client_session *session, unsigned char *msg, short len,
+	      gboolean droppable)
 {
   gzochid_client_session_transaction_context *tx_context =
     join_transaction (context);
@@ -680,7 +699,43 @@ gzochid_client_session_send_message (gzochid_application_context *context,
 
   tx_context->operations = g_list_append 
     (tx_context->operations, 
-     create_message_operation (reference->oid, msg, len));
+     create_message_operation (reference->oid, msg, len, droppable));
+}
+
+void 
+gzochid_client_session_send_message (gzochid_application_context *context, 
+				     gzochid_client_session *session, 
+				     unsigned char *msg, short len)
+{
+  send_message (context, session, msg, len, FALSE);
+}
+
+void 
+gzochid_client_session_send_droppable_message
+(gzochid_application_context *context, gzochid_client_session *session,
+ unsigned char *msg, short len)
+{
+  send_message (context, session, msg, len, TRUE);
+}
+
+gboolean
+gzochid_client_session_congested (gzochid_application_context *context,
+				  gzochid_client_session *session)
+{
+  gboolean congested = FALSE;
+  gzochid_game_client *client = NULL;
+  gzochid_data_managed_reference *reference = gzochid_data_create_reference 
+    (context, &gzochid_client_session_serialization, session, NULL);
+
+  assert (reference != NULL);
+  
+  g_mutex_lock (&context->client_mapping_lock);
+  client = g_hash_table_lookup (context->oids_to_clients, &reference->oid);
+  if (client != NULL)
+    congested = gzochid_game_client_is_congested (client);
+  g_mutex_unlock (&context->client_mapping_lock);
+
+  return congested;
 }
 
 struct _gzochid_persistence_task_data
@@ -69,6 +69,22 @@ void gzochid_client_session_send_message
 (gzochid_application_context *, gzochid_client_session *, unsigned char *, 
  short);
 
+/* Like `gzochid_client_session_send_message', but marks the message as 
+   droppable: If the session's client is congested when the transaction 
+   commits, the message may be discarded according to the game server's 
+   overflow policy. */
+
+void gzochid_client_session_send_droppable_message 
+(gzochid_application_context *, gzochid_client_session *, unsigned char *, 
+ short);
+
+/* Returns `TRUE' if the specified session's client is connected to this server
+   and its send queue has exceeded its high watermark, `FALSE' otherwise. This
+   is a non-transactional snapshot of the state of the client's connection. */
+
+gboolean gzochid_client_session_congested
+(gzochid_application_context *, gzochid_client_session *);
+
 gzochid_auth_identity *gzochid_client_session_identity
 (gzochid_client_session *);
 
@@ -69,6 +69,18 @@ struct _gzochid_server_socket
 
   gzochid_server_protocol protocol; /* The server protocol. */
   gpointer protocol_data; /* Callback data for the server protocol. */
+
+  /* The sustained number of connections accepted per second, or `0' if the
+     accept rate is not limited. */
+
+  unsigned int accept_rate; 
+  unsigned int accept_burst; /* The maximum burst of accepted connections. */
+  double accept_tokens; /* The number of connections that may be accepted. */
+  gint64 accept_refill_us; /* When the tokens were last refilled. */
+
+  /* Whether accepting has been paused to respect the accept rate. */
+
+  gboolean accept_paused; 
 };
 
 struct _gzochid_client_socket
@@ -78,6 +90,40 @@ struct _gzochid_client_socket
   GMutex sock_mutex; /* A mutex to synchronize access to the send buffer. */
 
   GByteArray *send_buffer; /* The outgoing data buffer. */
+
+  /* The number of bytes at the head of the send buffer that have already been
+     written to the socket. Compaction is deferred until this offset accounts
+     for at least half of the buffer, so that a slow reader doesn't force the
+     whole buffer to be shifted after every partial write. */
+
+  size_t send_offset;
+
+  /* The send queue length above which the socket is considered congested, or
+     `0' if no limit has been set. */
+
+  size_t high_watermark;
+
+  /* The send queue length at or below which a congested socket is considered
+     to have drained. */
+
+  size_t low_watermark;
+
+  gboolean congested; /* Whether the send queue exceeded the high watermark. */
+  gboolean shut_down; /* Whether the connection has been shut down. */
+
+  /* The callback to invoke when a congested socket drains to its low 
+     watermark, and its closure data. */
+
+  gzochid_client_socket_drained_callback drained_callback;
+  gpointer drained_data;
+
+  /* The number of milliseconds after the last read from the socket after 
+     which the connection is shut down, or `0' for no timeout. */
+
+  guint idle_timeout_ms;
+  gint64 last_read_us; /* The monotonic time of the last read. */
+  GSource *idle_source; /* The source that checks for idleness. */
+
   GByteArray *recv_buffer; /* The incoming data buffer. */
   
   GIOChannel *channel; /* The client socket IO channel. */
@@ -101,15 +147,40 @@ gzochid_server_socket_new (char *name, gzochid_server_protocol protocol,
   server_socket->name = strdup (name);
   server_socket->protocol = protocol;
   server_socket->protocol_data = protocol_data;
+  server_socket->accept_rate = 0;
 
   return server_socket;
 }
 
+/* Returns the number of bytes in the specified client socket's send buffer that
+   have not yet been written to the socket. The caller must hold the socket 
+   mutex. */
+
+static size_t
+send_queue_length (gzochid_client_socket *sock)
+{
+  return sock->send_buffer->len - sock->send_offset;
+}
+
+/* Discards the already-written prefix of the specified client socket's send 
+   buffer. The caller must hold the socket mutex. */
+
+static void
+compact_send_buffer (gzochid_client_socket *sock)
+{
+  if (sock->send_offset == sock->send_buffer->len)
+    g_byte_array_set_size (sock->send_buffer, 0);
+  else g_byte_array_remove_range (sock->send_buffer, 0, sock->send_offset);
+
+  sock->send_offset = 0;
+}
+
 static gboolean
 dispatch_client_write (GIOChannel *channel, GIOCondition cond, gpointer data)
 {
   GIOStatus status;
   gzochid_client_socket *sock = data;
+  gboolean drained = FALSE;
 
   /* It's possible that a dangling write may be dispatched to a destroyed 
      source, which may already have been finalized. So check the destroyed
@@ -126,11 +197,11 @@ dispatch_client_write (GIOChannel *channel, GIOCondition cond, gpointer data)
       GError *error = NULL;
       
       status = g_io_channel_write_chars 
-	(sock->channel, (const gchar *) sock->send_buffer->data,
-	 sock->send_buffer->len, &written, &error);
+	(sock->channel,
+	 (const gchar *) sock->send_buffer->data + sock->send_offset,
+	 send_queue_length (sock), &written, &error);
 
-      if (written > 0)
-	g_byte_array_remove_range (sock->send_buffer, 0, written);
+      sock->send_offset += written;
 
       if (error != NULL)
 	{
@@ -139,9 +210,18 @@ dispatch_client_write (GIOChannel *channel, GIOCondition cond, gpointer data)
 	  return FALSE;
 	}
     }
-  while (status == G_IO_STATUS_NORMAL && sock->send_buffer->len > 0);
+  while (status == G_IO_STATUS_NORMAL && send_queue_length (sock) > 0);
+
+  if (sock->send_offset > 0 && sock->send_offset >= sock->send_buffer->len / 2)
+    compact_send_buffer (sock);
+
+  if (sock->congested && send_queue_length (sock) <= sock->low_watermark)
+    {
+      sock->congested = FALSE;
+      drained = TRUE;
+    }
 
-  if (sock->send_buffer->len == 0)
+  if (send_queue_length (sock) == 0)
     {
       g_source_destroy (sock->write_source);
       g_source_unref (sock->write_source);
@@ -150,6 +230,13 @@ dispatch_client_write (GIOChannel *channel, GIOCondition cond, gpointer data)
     }
 
   g_mutex_unlock (&sock->sock_mutex);
+
+  /* Notify the protocol outside of the socket mutex, so that it may write to 
+     the socket from the callback. */
+  
+  if (drained && sock->drained_callback != NULL)
+    sock->drained_callback (sock->drained_data);
+  
   return TRUE;
 }
 
@@ -194,6 +281,8 @@ fill_recv_buffer (gzochid_client_socket *sock)
 static gboolean
 dispatch_client_read (gzochid_client_socket *sock)
 {
+  sock->last_read_us = g_get_monotonic_time ();
+
   if (fill_recv_buffer (sock))
     {      
       while (sock->recv_buffer->len > 0 && sock->protocol.can_dispatch
@@ -224,14 +313,15 @@ dispatch_client (GIOChannel *channel, GIOCondition condition, gpointer data)
   if (g_source_is_destroyed (g_main_current_source ()))
     return FALSE;
 
-  switch (condition)
-    {
-    case G_IO_IN:
-    case G_IO_PRI: return dispatch_client_read (sock);
-    case G_IO_ERR:
-    case G_IO_HUP: return dispatch_client_error (sock);
-    default: return FALSE;
-    }
+  /* A socket that has been shut down may be readable and hung up at the same 
+     time; read first, so that the protocol gets to see any remaining data 
+     before the end of the stream is reported. */
+  
+  if (condition & (G_IO_IN | G_IO_PRI))
+    return dispatch_client_read (sock);
+  else if (condition & (G_IO_ERR | G_IO_HUP))
+    return dispatch_client_error (sock);
+  else return FALSE;
 }
 
 gzochid_client_socket *
@@ -255,7 +345,19 @@ gzochid_client_socket_new (GIOChannel *channel,
   g_mutex_init (&sock->sock_mutex);
   sock->recv_buffer = g_byte_array_new ();
   sock->send_buffer = g_byte_array_new ();
-
+  sock->send_offset = 0;
+
+  sock->high_watermark = 0;
+  sock->low_watermark = 0;
+  sock->congested = FALSE;
+  sock->shut_down = FALSE;
+  sock->drained_callback = NULL;
+  sock->drained_data = NULL;
+
+  sock->idle_timeout_ms = 0;
+  sock->last_read_us = g_get_monotonic_time ();
+  sock->idle_source = NULL;
+  
   sock->ref_count = 1;
   
   return sock;
@@ -278,6 +380,71 @@ free_server_socket (gpointer data)
   gzochid_server_socket_free (sock);
 }
 
+/* A `GSourceFunc' that shuts down the specified client socket if nothing has
+   been read from it within its idle timeout. */
+
+static gboolean
+dispatch_idle_check (gpointer data)
+{
+  gzochid_client_socket *sock = data;
+  gboolean idle = FALSE;
+
+  /* As with reads and writes, the check may be dispatched to a source that has
+     already been destroyed. */
+  
+  if (g_source_is_destroyed (g_main_current_source ()))
+    return FALSE;
+
+  g_mutex_lock (&sock->sock_mutex);
+
+  idle = g_get_monotonic_time () - sock->last_read_us
+    >= (gint64) sock->idle_timeout_ms * 1000;
+  
+  if (idle)
+    {
+      g_source_unref (sock->idle_source);
+      sock->idle_source = NULL;
+    }
+
+  g_mutex_unlock (&sock->sock_mutex);
+
+  if (idle)
+    {
+      g_debug ("Socket %s idle; shutting down.",
+	       gzochid_client_socket_get_connection_description (sock));
+      gzochid_client_socket_shutdown (sock);
+      return FALSE;
+    }
+  else return TRUE;
+}
+
+/* (Re-)creates the source that enforces the specified client socket's idle
+   timeout, if it has one. The caller must hold the socket mutex, and the 
+   socket must have been added to a socket server. */
+
+static void
+arm_idle_source (gzochid_client_socket *sock)
+{
+  if (sock->idle_source != NULL)
+    {
+      g_source_destroy (sock->idle_source);
+      g_source_unref (sock->idle_source);
+      sock->idle_source = NULL;
+    }
+
+  if (sock->idle_timeout_ms > 0)
+    {
+      /* Check at least once a second, so that the connection isn't left open
+	 for much longer than the timeout. */
+      
+      sock->idle_source = g_timeout_source_new
+	(MIN (sock->idle_timeout_ms, 1000));
+      g_source_set_callback
+	(sock->idle_source, dispatch_idle_check, sock, NULL);
+      g_source_attach (sock->idle_source, sock->server->main_context);
+    }
+}
+
 /* Add the specified client to the socket server in the form of a watch. */
 
 static void
@@ -297,6 +464,73 @@ add_client (GzochidSocketServer *server, gzochid_client_socket *sock)
   g_source_attach (sock->read_source, server->main_context);
   
   sock->server = server;  
+
+  g_mutex_lock (&sock->sock_mutex);
+  arm_idle_source (sock);
+  g_mutex_unlock (&sock->sock_mutex);
+}
+
+/* Refills the specified server socket's accept tokens according to its accept
+   rate, and returns `TRUE' if another connection may be accepted. */
+
+static gboolean
+has_accept_token (gzochid_server_socket *sock)
+{
+  gint64 now = 0;
+  
+  if (sock->accept_rate == 0)
+    return TRUE;
+
+  now = g_get_monotonic_time ();
+  sock->accept_tokens = MIN
+    (sock->accept_burst, sock->accept_tokens
+     + (now - sock->accept_refill_us) * sock->accept_rate / 1000000.0);
+  sock->accept_refill_us = now;
+
+  return sock->accept_tokens >= 1;
+}
+
+static gboolean dispatch_accept (GIOChannel *, GIOCondition, gpointer);
+
+/* The `GDestroyNotify' for a server socket's accept watch. Frees the server
+   socket, unless the watch was removed to pause accepting. */
+
+static void
+release_server_socket (gpointer data)
+{
+  gzochid_server_socket *sock = data;
+
+  if (!sock->accept_paused)
+    free_server_socket (sock);
+}
+
+/* Creates a watch for incoming connections on the specified server socket and
+   attaches it to the socket's server. */
+
+static void
+attach_accept_source (gzochid_server_socket *sock)
+{
+  GSource *server_source = g_io_create_watch (sock->channel, G_IO_IN);
+
+  g_source_set_callback
+    (server_source, (GSourceFunc) dispatch_accept, sock,
+     release_server_socket);
+  g_source_attach (server_source, sock->server->main_context);
+  g_source_unref (server_source);
+}
+
+/* A `GSourceFunc' that resumes accepting connections on the specified server
+   socket once its accept rate allows it. */
+
+static gboolean
+resume_accept (gpointer data)
+{
+  gzochid_server_socket *sock = data;
+
+  sock->accept_paused = FALSE;
+  attach_accept_source (sock);
+  
+  return FALSE;
 }
 
 static gboolean
@@ -308,8 +542,10 @@ dispatch_accept (GIOChannel *channel, GIOCondition cond, gpointer data)
   socklen_t client_addr_len = sizeof (struct sockaddr_in);
   int one = 1;
 
-  while ((client_fd = accept
-	  (server_fd, (struct sockaddr *) &client_addr, &client_addr_len)) >= 0)
+  while (has_accept_token (server_socket)
+	 && (client_fd = accept
+	     (server_fd, (struct sockaddr *) &client_addr, &client_addr_len))
+	 >= 0)
     {
       GIOChannel *channel = g_io_channel_unix_new (client_fd);
       char *connection_description = g_strdup_printf 
@@ -333,8 +569,29 @@ dispatch_accept (GIOChannel *channel, GIOCondition cond, gpointer data)
 
       add_client (server_socket->server, sock);
       gzochid_client_socket_unref (sock);
+
+      if (server_socket->accept_rate > 0)
+	server_socket->accept_tokens -= 1;
     }
 
+  /* If the accept rate has been exceeded, stop watching the socket until the 
+     next token is due; pending connections wait in the listen backlog. */
+  
+  if (server_socket->accept_rate > 0 && server_socket->accept_tokens < 1)
+    {
+      GSource *resume_source = g_timeout_source_new
+	((guint) ((1 - server_socket->accept_tokens) * 1000
+		  / server_socket->accept_rate) + 1);
+      
+      g_source_set_callback
+	(resume_source, resume_accept, server_socket, NULL);
+      g_source_attach (resume_source, server_socket->server->main_context);
+      g_source_unref (resume_source);
+
+      server_socket->accept_paused = TRUE;
+      return FALSE;
+    }
+  
   return TRUE;
 }
 
@@ -349,12 +606,10 @@ void gzochid_server_socket_listen
 (GzochidSocketServer *server, gzochid_server_socket *sock, gint port)
 {
   gint fd = socket (PF_INET, SOCK_STREAM, 0);
-  GSource *server_source = NULL;
   struct sockaddr_in addr;
   int one = 1;
 
   sock->channel = g_io_channel_unix_new (fd);
-  server_source = g_io_create_watch (sock->channel, G_IO_IN);
   
   assert (sock->server == NULL);
   sock->server = server;
@@ -392,10 +647,17 @@ void gzochid_server_socket_listen
 		      ntohs (bound_addr->sin_port));
     }
 
-  g_source_set_callback
-    (server_source, (GSourceFunc) dispatch_accept, sock, free_server_socket);
-  g_source_attach (server_source, server->main_context);
-  g_source_unref (server_source);
+  attach_accept_source (sock);
+}
+
+void
+gzochid_server_socket_set_accept_rate (gzochid_server_socket *sock,
+				       unsigned int rate, unsigned int burst)
+{
+  sock->accept_rate = rate;
+  sock->accept_burst = MAX (burst, 1);
+  sock->accept_tokens = sock->accept_burst;
+  sock->accept_refill_us = g_get_monotonic_time ();
 }
 
 static gpointer 
@@ -430,6 +692,13 @@ gzochid_client_socket_get_connection_description (gzochid_client_socket *sock)
   return sock->connection_description;
 }
 
+GMainContext *
+gzochid_client_socket_get_main_context (gzochid_client_socket *sock)
+{
+  assert (sock->server != NULL);
+  return sock->server->main_context;
+}
+
 void
 _gzochid_server_socket_getsockname (gzochid_server_socket *sock,
 				    struct sockaddr *addr, size_t *addrlen)
@@ -460,8 +729,21 @@ gzochid_client_socket_write (gzochid_client_socket *sock,
   assert (sock->server != NULL);
   
   g_mutex_lock (&sock->sock_mutex);
+
+  /* Nothing more can be written to a connection that's been shut down. */
+  
+  if (sock->shut_down)
+    {
+      g_mutex_unlock (&sock->sock_mutex);
+      return;
+    }
+  
   g_byte_array_append (sock->send_buffer, data, len);
 
+  if (sock->high_watermark > 0 && send_queue_length (sock) > 
+      sock->high_watermark)
+    sock->congested = TRUE;
+  
   if (sock->write_source == NULL)
     {
       sock->write_source = g_io_create_watch (sock->channel, G_IO_OUT);
@@ -473,6 +755,99 @@ gzochid_client_socket_write (gzochid_client_socket *sock,
   g_mutex_unlock (&sock->sock_mutex);
 }
 
+void
+gzochid_client_socket_set_watermarks
+(gzochid_client_socket *sock, size_t low_watermark, size_t high_watermark,
+ gzochid_client_socket_drained_callback callback, gpointer user_data)
+{
+  assert (high_watermark == 0 || low_watermark <= high_watermark);
+  
+  g_mutex_lock (&sock->sock_mutex);
+
+  sock->low_watermark = low_watermark;
+  sock->high_watermark = high_watermark;
+  sock->drained_callback = callback;
+  sock->drained_data = user_data;
+
+  if (high_watermark == 0)
+    sock->congested = FALSE;
+  
+  g_mutex_unlock (&sock->sock_mutex);
+}
+
+void
+gzochid_client_socket_set_idle_timeout (gzochid_client_socket *sock,
+					guint timeout_ms)
+{
+  g_mutex_lock (&sock->sock_mutex);
+
+  sock->idle_timeout_ms = timeout_ms;
+  sock->last_read_us = g_get_monotonic_time ();
+  
+  if (sock->server != NULL && !sock->shut_down)
+    arm_idle_source (sock);
+  
+  g_mutex_unlock (&sock->sock_mutex);
+}
+
+size_t
+gzochid_client_socket_get_send_queue_length (gzochid_client_socket *sock)
+{
+  size_t len = 0;
+
+  g_mutex_lock (&sock->sock_mutex);
+  len = send_queue_length (sock);
+  g_mutex_unlock (&sock->sock_mutex);
+
+  return len;
+}
+
+gboolean
+gzochid_client_socket_is_congested (gzochid_client_socket *sock)
+{
+  gboolean congested = FALSE;
+
+  g_mutex_lock (&sock->sock_mutex);
+  congested = sock->congested;
+  g_mutex_unlock (&sock->sock_mutex);
+
+  return congested;
+}
+
+void
+gzochid_client_socket_shutdown (gzochid_client_socket *sock)
+{
+  g_mutex_lock (&sock->sock_mutex);
+
+  /* Discard any unsent data; writing it to the shut down socket would fail
+     anyway. */
+  
+  if (sock->write_source != NULL)
+    {
+      g_source_destroy (sock->write_source);
+      g_source_unref (sock->write_source);
+
+      sock->write_source = NULL;
+    }
+
+  if (sock->idle_source != NULL)
+    {
+      g_source_destroy (sock->idle_source);
+      g_source_unref (sock->idle_source);
+
+      sock->idle_source = NULL;
+    }
+  
+  g_byte_array_set_size (sock->send_buffer, 0);
+  sock->send_offset = 0;
+  sock->congested = FALSE;
+  sock->shut_down = TRUE;
+  
+  shutdown (g_io_channel_unix_get_fd (sock->channel), SHUT_RDWR);
+
+  g_mutex_unlock (&sock->sock_mutex);
+}
+
 gzochid_client_socket *
 gzochid_client_socket_ref (gzochid_client_socket *sock)
 {
@@ -500,6 +875,11 @@ gzochid_client_socket_unref (gzochid_client_socket *sock)
 	  g_source_destroy (sock->write_source);
 	  g_source_unref (sock->write_source);
 	}
+      if (sock->idle_source != NULL)
+	{
+	  g_source_destroy (sock->idle_source);
+	  g_source_unref (sock->idle_source);
+	}
       
       g_mutex_unlock (&sock->sock_mutex);
       
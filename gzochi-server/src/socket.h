@@ -117,6 +117,13 @@ void gzochid_client_socket_unref (gzochid_client_socket *);
 const char *gzochid_client_socket_get_connection_description
 (gzochid_client_socket *);
 
+/* Returns the main context of the socket server to which the specified client
+   socket has been added, for use by protocols that need to schedule their own
+   work on the socket's thread. */
+
+GMainContext *gzochid_client_socket_get_main_context
+(gzochid_client_socket *);
+
 /* Copies the specified buffer to the specified client socket's send buffer; it
    will be written to the underlying socket as soon as that socket indicates its
    readiness for data. */
@@ -124,6 +131,51 @@ const char *gzochid_client_socket_get_connection_description
 void gzochid_client_socket_write
 (gzochid_client_socket *, const unsigned char *, size_t);
 
+/* Typedef for the callback invoked when a congested client socket's send queue
+   drains to its low watermark. */
+
+typedef void (*gzochid_client_socket_drained_callback) (gpointer);
+
+/* Sets the low and high watermarks for the specified client socket's send 
+   queue, along with a callback (and its closure data) to be invoked when the 
+   socket's send queue has drained to the low watermark after exceeding the 
+   high watermark. A high watermark of `0' disables congestion tracking.
+
+   The socket does not itself enforce any limit on the size of its send queue;
+   it's up to the client protocol to decide what to do with writes to a 
+   congested socket. The drained callback is invoked from the socket server's 
+   thread, without any socket locks held, so it may safely write to the 
+   socket. */
+
+void gzochid_client_socket_set_watermarks
+(gzochid_client_socket *, size_t, size_t,
+ gzochid_client_socket_drained_callback, gpointer);
+
+/* Returns the number of bytes written to the specified client socket that have
+   not yet been written to the underlying socket. */
+
+size_t gzochid_client_socket_get_send_queue_length (gzochid_client_socket *);
+
+/* Returns `TRUE' if the specified client socket's send queue has exceeded its
+   high watermark and has not yet drained to its low watermark, `FALSE' 
+   otherwise. */
+
+gboolean gzochid_client_socket_is_congested (gzochid_client_socket *);
+
+/* Shuts down both directions of the specified client socket's underlying
+   connection, discarding any data that has not yet been sent. Subsequent 
+   writes to the socket are ignored. The socket's protocol will be notified via
+   its `error' callback when the socket server next polls the socket. */
+
+void gzochid_client_socket_shutdown (gzochid_client_socket *);
+
+/* Sets the number of milliseconds after which the specified client socket will
+   be shut down (as per `gzochid_client_socket_shutdown') if nothing has been
+   read from it. The clock restarts when the timeout is set; a timeout of `0' 
+   disables the check. */
+
+void gzochid_client_socket_set_idle_timeout (gzochid_client_socket *, guint);
+
 /* Private client socket API, visible for testing only. */
 
 /* Returns the client protocol associated with the specified client socket. */
@@ -160,6 +212,16 @@ void gzochid_server_socket_free (gzochid_server_socket *);
 void gzochid_server_socket_listen
 (GzochidSocketServer *, gzochid_server_socket *, int);
 
+/* Limits the rate at which the specified server socket accepts connections to
+   the specified sustained number of connections per second, allowing bursts of
+   up to the specified size. Connections in excess of the rate wait in the 
+   kernel's listen backlog. A rate of `0' removes the limit. 
+
+   This function must be called before the socket begins listening. */
+
+void gzochid_server_socket_set_accept_rate
+(gzochid_server_socket *, unsigned int, unsigned int);
+
 /*
   The "reconnectable socket" API below provides an abstraction for buffering
   outgoing messages on a logical connection (such as the one between the 
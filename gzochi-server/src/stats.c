@@ -47,6 +47,7 @@ update_from_event (gzochid_application_stats *stats,
     {
     case MESSAGE_RECEIVED: stats->num_messages_received++; break;
     case MESSAGE_SENT: stats->num_messages_sent++; break;
+    case MESSAGE_DROPPED: stats->num_messages_dropped++; break;
     case TRANSACTION_START: stats->num_transactions_started++; break;
     default: assert (1 == 0);
     }
@@ -85,6 +86,47 @@ update_from_transaction_event (gzochid_application_stats *stats,
       
       break;
     case TRANSACTION_ROLLBACK: stats->num_transactions_rolled_back++; break;
+    case TRANSACTION_RETRY:
+      stats->num_transactions_retried++;
+      stats->total_retry_delay_us += duration_us;
+
+      if (duration_us > stats->max_retry_delay_us)
+	stats->max_retry_delay_us = duration_us;
+      
+      break;
+    default: assert (1 == 0);
+    }
+}
+
+static void
+update_from_login_event (gzochid_application_stats *stats,
+			 gzochid_login_event_type type, GzochidLoginEvent *event)
+{
+  guint64 duration_us = 0;
+  guint64 duration_ms = 0;
+  
+  g_object_get (event, "duration-us", &duration_us, NULL);
+
+  duration_ms = duration_us / 1000;
+  
+  switch (type)
+    {
+    case LOGIN_SUCCEEDED:
+      stats->num_logins++;
+
+      if (duration_ms > stats->max_login_latency)
+	stats->max_login_latency = duration_ms;
+
+      if (stats->num_logins == 1)
+	stats->average_login_latency = duration_ms;
+      else stats->average_login_latency =
+	     (duration_ms + ((stats->num_logins - 1)
+			     * stats->average_login_latency))
+	     / stats->num_logins;
+      
+      break;
+    case LOGIN_FAILED: stats->num_login_failures++; break;
+    case LOGIN_REJECTED: stats->num_logins_rejected++; break;
     default: assert (1 == 0);
     }
 }
@@ -105,4 +147,6 @@ gzochid_stats_update_from_event (gzochid_application_stats *stats,
   else if (event_type == GZOCHID_TYPE_TRANSACTION_EVENT)
     update_from_transaction_event
       (stats, type, GZOCHID_TRANSACTION_EVENT (event));
+  else if (event_type == GZOCHID_TYPE_LOGIN_EVENT)
+    update_from_login_event (stats, type, GZOCHID_LOGIN_EVENT (event));
 }
@@ -24,15 +24,34 @@ struct _gzochid_application_stats
 {
   unsigned int num_messages_received;
   unsigned int num_messages_sent;
+  unsigned int num_messages_dropped;
   
   unsigned int num_transactions_started;
   unsigned int num_transactions_committed;
   unsigned int num_transactions_rolled_back;
+  unsigned int num_transactions_retried;
 
   unsigned long max_transaction_duration;
   unsigned long min_transaction_duration;
   double average_transaction_duration;
 
+  /* The total and maximum delay (in microseconds) imposed by backoff before 
+     transaction retries. Backoff delays are often shorter than a millisecond,
+     so they're accumulated at full precision. */
+  
+  guint64 total_retry_delay_us;
+  guint64 max_retry_delay_us;
+
+  unsigned int num_logins;
+  unsigned int num_login_failures;
+  unsigned int num_logins_rejected;
+
+  /* The maximum and average time (in milliseconds) between the receipt of a 
+     login request and the completion of authentication. */
+  
+  unsigned long max_login_latency;
+  double average_login_latency;
+
   unsigned long bytes_read;
   unsigned long bytes_written;
 };
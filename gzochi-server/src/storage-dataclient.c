@@ -52,22 +52,46 @@
   store are transmitted to the meta server for durable persistence.
 
   Locks are only held temporarily; once a lock's (or range lock's) timeout 
-  expires - and once all current transactions using it have committed or rolled
-  back - the lock is explicitly released via the data client. 
+  expires, or once the meta server revokes it because another node has 
+  requested a conflicting lock - and once all current transactions using it 
+  have committed or rolled back - the lock is explicitly released via the data
+  client. Requests for locks that conflict with those held by other nodes are 
+  queued by the meta server, which pushes a grant once the lock is available; 
+  transactions waiting on such requests simply continue to wait.
 */
 
 /*
-  The maximum number of keys that can be released before a sweep of the delegate
-  store is triggered.
+  The default estimated size, in bytes, that the values of released keys may
+  occupy in the delegate store before they are purged.
 
   To avoid contention on the store, keys are not removed from the underlying 
   store when they are released. Instead, timestamps are used to make sure that
   clients see the most recent version of a key, even in the case of deletions.
-  Over time, old values may build up in the store, and so they must be 
-  periodically be "purged" to control the size of the store.
+  Over time, old values may build up in the store, and so they are "purged" -
+  least recently released first - by a background thread whenever their 
+  estimated size exceeds this budget.
 */
 
-#define DEFAULT_PURGE_THRESHOLD 1024
+#define DEFAULT_MAX_CACHE_BYTES (64 * 1024 * 1024)
+
+/* The estimated per-key bookkeeping overhead in the delegate store, counted
+   against the cache size budget in addition to the sizes of the key and 
+   value. */
+
+#define PURGEABLE_KEY_OVERHEAD 64
+
+/* The maximum number of keys purged in a single delegate transaction. */
+
+#define PURGE_BATCH_SIZE 64
+
+/* The timeout for a purge transaction; short, so that a purge that contends 
+   with application transactions gives up quickly. */
+
+#define PURGE_TRANSACTION_TIMEOUT_MS 50
+
+/* The delay before retrying a purge transaction that was rolled back. */
+
+#define PURGE_RETRY_INTERVAL_MS 10
 
 /* Combines a key with the store to which it belongs, to disambiguate it in
    contexts in which keys are not otherwise partitioned. */
@@ -87,6 +111,10 @@ struct _dataclient_purgeable_key
 {
   dataclient_qualified_key *qualified_key; /* The purgeable key. */
   gint64 release_timestamp; /* The time at which the key was released. */
+
+  /* The estimated size of the key and its value in the delegate store. */
+  
+  size_t size; 
 };
 
 typedef struct _dataclient_purgeable_key dataclient_purgeable_key;
@@ -275,16 +303,36 @@ struct _dataclient_environment
   GzochidDataClient *client;
 
   GHashTable *databases; /* Map of `char *' to `dataclient_database' structs. */
-  GList *transactions; /* List of `dataclient_transaction' structs. */
-  GPtrArray *purgeable_keys; /* Array of `dataclient_qualified_key' pointers. */
-  unsigned int purge_threshold; /* Maximum size of the purgeable key array. */
+
+  /* Protects the databases table, and prevents stores from being closed during
+     a purge. */
+
+  GMutex databases_mutex; 
+
+  /* Queue of `dataclient_purgeable_key' structs, in release order; the least
+     recently used keys are at the head. */
+  
+  GQueue *purgeable_keys; 
+  size_t purgeable_bytes; /* The estimated size of the purgeable keys. */
+
+  /* The purgeable key size above which keys are purged. */
   
-  /* Flag to indicate whether a key purge is in progress. */
+  size_t max_cache_bytes; 
+
+  GThread *purge_thread; /* The background purge thread. */
+  gboolean purge_thread_running; /* Cleared to stop the purge thread. */
   
-  gboolean purging_keys;
+  GMutex purge_mutex; /* Protects the purgeable key queue and budget. */
 
-  GMutex purge_mutex; /* Mutex to protect the purgeable key sweep. */
-  GCond purge_cond; /* Condition variable to protect the purgeable key sweep. */
+  /* Signaled when the purge thread may have work to do, or should exit. */
+
+  GCond purge_cond; 
+
+  gboolean purging; /* Whether a batch of keys is being purged. */
+
+  /* Signaled when the purge thread finishes purging a batch of keys. */
+
+  GCond purge_done_cond;
   
   GList *evicted_keys; /* List of `dataclient_evicted_key' structs. */
 
@@ -307,6 +355,12 @@ struct _dataclient_environment
   
   GHashTable *write_lock_requests; 
 
+  /* Set of `dataclient_qualified_key' keys for which read lock requests have
+     been sent to the meta server on behalf of a prefetch, but not yet 
+     answered. */
+
+  GHashTable *prefetch_requests;
+
   /* A read-through cache of `dataclient_qualified_key' keys to `GBytes' 
      values. */
 
@@ -403,6 +457,36 @@ gzochid_dataclient_storage_context_set_dataclient
   environment->client = g_object_ref (client);
 }
 
+void
+gzochid_dataclient_storage_context_set_max_cache_bytes
+(gzochid_storage_context *context, size_t max_cache_bytes)
+{
+  dataclient_environment *environment = context->environment;
+
+  g_mutex_lock (&environment->purge_mutex);
+  environment->max_cache_bytes = max_cache_bytes;
+
+  /* The budget may have shrunk below the current size of the cache. */
+  
+  g_cond_signal (&environment->purge_cond);
+  g_mutex_unlock (&environment->purge_mutex);
+}
+
+void
+_gzochid_dataclient_storage_context_wait_for_purge
+(gzochid_storage_context *context)
+{
+  dataclient_environment *environment = context->environment;
+
+  g_mutex_lock (&environment->purge_mutex);
+
+  while (environment->purging
+	 || environment->purgeable_bytes > environment->max_cache_bytes)
+    g_cond_wait (&environment->purge_done_cond, &environment->purge_mutex);
+
+  g_mutex_unlock (&environment->purge_mutex);
+}
+
 /* A hash function for `dataclient_qualified_key' structures. Combines the hash
    codes produced by delegating to `g_str_hash' (for the store name) and
    `g_bytes_hash' (for the key bytes). */
@@ -479,17 +563,18 @@ static gint dataclient_qualified_key_compare (gconstpointer a, gconstpointer b)
 }
 
 /* Create and return a new `dataclient_purgeable_key' structure with the 
-   specifed `dataclient_qualified_key' (which is copied) and the current 
-   monotonic time. The memory used by this structure should be freed via 
-   `dataclient_purgeable_key_free' when no longer in use. */
+   specifed `dataclient_qualified_key' (which is copied), estimated size, and
+   the current monotonic time. The memory used by this structure should be 
+   freed via `dataclient_purgeable_key_free' when no longer in use. */
 
 static dataclient_purgeable_key *
-dataclient_purgeable_key_new (dataclient_qualified_key *k)
+dataclient_purgeable_key_new (dataclient_qualified_key *k, size_t size)
 {
   dataclient_purgeable_key *pk = malloc (sizeof (dataclient_purgeable_key));
 
   pk->qualified_key = dataclient_qualified_key_copy (k);
   pk->release_timestamp = g_get_monotonic_time ();
+  pk->size = size;
   
   return pk;
 }
@@ -1151,13 +1236,15 @@ lock_success_callback (GBytes *data, gpointer user_data)
     {
       /* If the lock already exists, conditionally upgrade it. */
       
-      if (callback_data->for_write)
+      /* Need to bump the lock's ref count, since an additional success 
+	 callback indicates that another release callback will be 
+	 forthcoming. (This may be a queued read request that was granted after
+	 a write lock had already been obtained.) */
 
-	/* Need to bump the lock's ref count, since an additional success 
-	   callback indicates that another release callback will be 
-	   forthcoming. */
-	
-	lock_ref (lock)->for_write = TRUE;
+      lock_ref (lock);
+      
+      if (callback_data->for_write)
+	lock->for_write = TRUE;
     }
 
   /* Otherwise create a new lock. */
@@ -1185,6 +1272,7 @@ lock_success_callback (GBytes *data, gpointer user_data)
       notify_waiters (environment->write_lock_requests, &qualified_key);
       g_hash_table_remove (environment->write_lock_requests, &qualified_key);
     }
+  else g_hash_table_remove (environment->prefetch_requests, &qualified_key);
 
   /* Always notify threads waiting for read locks - they'll be happy with a
      write lock as well. */
@@ -1212,6 +1300,15 @@ lock_failure_callback (struct timeval wait_time, gpointer user_data)
  
   dataclient_lock_request *lock_request = NULL;
 
+  /* A zero wait time indicates that the meta server has queued the request and
+     will grant the lock once it's available, at which point the success 
+     callback will be invoked with the same callback data. Leave the lock 
+     requests in the "requested" state so that waiting threads don't send
+     another request. */
+  
+  if (wait_time.tv_sec == 0 && wait_time.tv_usec == 0)
+    return;
+  
   g_mutex_lock (&environment->lock_table_mutex);
   
   if (callback_data->for_write)
@@ -1232,6 +1329,7 @@ lock_failure_callback (struct timeval wait_time, gpointer user_data)
 	  notify_waiters (environment->write_lock_requests, &qualified_key);
 	}
     }
+  else g_hash_table_remove (environment->prefetch_requests, &qualified_key);
 
   /* There may be no lock request if there are no longer any threads waiting
      for the lock. */
@@ -1272,6 +1370,7 @@ lock_release_callback (gpointer user_data)
     { database->name, callback_data->key };
 
   gboolean purgeable = FALSE;
+  size_t purgeable_size = 0;
   
   /* Grab the environment's mutex before the store's mutex; important to always
      take these in the same order. */
@@ -1310,6 +1409,16 @@ lock_release_callback (gpointer user_data)
       
       else
 	{
+	  GBytes *value = g_hash_table_lookup
+	    (environment->value_cache, &qualified_key);
+
+	  /* The cached value is the best available estimate of the size of the
+	     value in the delegate store. */
+	  
+	  purgeable_size = g_bytes_get_size (callback_data->key)
+	    + (value != NULL ? g_bytes_get_size (value) : 0)
+	    + PURGEABLE_KEY_OVERHEAD;
+	  
 	  g_hash_table_remove (environment->locks, &qualified_key);
 	  g_hash_table_remove (environment->value_cache, &qualified_key);
 	  purgeable = TRUE;
@@ -1327,8 +1436,16 @@ lock_release_callback (gpointer user_data)
   if (purgeable)
     {
       g_mutex_lock (&environment->purge_mutex);
-      g_ptr_array_add (environment->purgeable_keys,
-		       dataclient_purgeable_key_new (&qualified_key));
+      g_queue_push_tail
+	(environment->purgeable_keys,
+	 dataclient_purgeable_key_new (&qualified_key, purgeable_size));
+      environment->purgeable_bytes += purgeable_size;
+
+      /* Wake the purge thread if the cache has outgrown its budget. */
+      
+      if (environment->purgeable_bytes > environment->max_cache_bytes)
+	g_cond_signal (&environment->purge_cond);
+      
       g_mutex_unlock (&environment->purge_mutex);
     }
   
@@ -1572,6 +1689,14 @@ ensure_lock (gzochid_storage_transaction *tx, gzochid_storage_store *store,
 	  lock_request = lock_request_new
 	    (database->name, key_bytes, for_write);
 
+	  /* If a prefetch has already sent a request for a read lock, don't 
+	     send another one; its response will be delivered to the waiters on
+	     this request. */
+
+	  if (!for_write && g_hash_table_contains
+	      (environment->prefetch_requests, &qualified_key))
+	    lock_request->requested = TRUE;
+
 	  g_hash_table_insert
 	    (for_write
 	     ? environment->write_lock_requests
@@ -1579,8 +1704,12 @@ ensure_lock (gzochid_storage_transaction *tx, gzochid_storage_store *store,
 	     dataclient_qualified_key_copy (&qualified_key), lock_request);
 	}
 
-      g_mutex_unlock (&environment->lock_table_mutex);	 
+      /* Seize the request mutex before releasing the lock table mutex, so that
+	 a response to a request that's already been sent can't be signaled
+	 before this thread starts waiting for it. */
+      
       g_mutex_lock (&lock_request->mutex);
+      g_mutex_unlock (&environment->lock_table_mutex);	 
     }
   
   while (TRUE)
@@ -1765,6 +1894,12 @@ range_lock_failure_callback (struct timeval wait_time, gpointer user_data)
   dataclient_database *database = callback_data->store->database;
   dataclient_range_lock_request_search_context search_context;
 
+  /* As above, a zero wait time means that the range lock will be granted 
+     later. */
+  
+  if (wait_time.tv_sec == 0 && wait_time.tv_usec == 0)
+    return;
+  
   search_context.store = database->name;
   search_context.from = callback_data->key;
   search_context.to = NULL;
@@ -2262,6 +2397,293 @@ ensure_range_lock (gzochid_storage_transaction *tx,
     }
 }
 
+/* Returns the timestamp-prefixed value in the value cache (if any) setting the
+   specified size pointer if available. The returned buffer is owned by the 
+   cache and should not be modified or freed. */
+
+static const unsigned char *
+get_prefixed_cache_value (dataclient_environment *environment,
+			  dataclient_qualified_key *qualified_key,
+			  size_t *value_len)
+{
+  GBytes *value = g_hash_table_lookup
+    (environment->value_cache, qualified_key);
+  
+  if (value != NULL)
+    return g_bytes_get_data (value, value_len);
+  else return NULL;
+}
+
+/* If there is a timestamp-prefixed non-zero-length value in the value cache 
+   for the specified key, return a copy of that value with the timestamp prefix
+   removed. Otherwise, return `NULL'. The returned buffer should be freed via
+   `free' when no longer needed. */
+
+static unsigned char *
+get_value_from_cache (dataclient_environment *environment,
+		      dataclient_qualified_key *qualified_key,
+		      size_t *value_len)
+{
+  size_t prefixed_value_len = 0;
+  const unsigned char *prefixed_value = get_prefixed_cache_value
+    (environment, qualified_key, &prefixed_value_len);
+
+  if (prefixed_value == NULL || prefixed_value_len <= 8)
+    return NULL;
+  else
+    {
+      size_t ret_value_len = prefixed_value_len - 8;
+
+      if (value_len != NULL)
+	*value_len = ret_value_len;
+      return g_memdup (prefixed_value + 8, ret_value_len);
+    }
+}
+
+/* If there is a timestamp-prefixed value in the value cache for the specified
+   key, return its timestamp. Otherwise, return zero. */
+
+static gint64
+get_timestamp_from_cache (dataclient_environment *environment,
+			  dataclient_qualified_key *qualified_key)
+{
+  size_t prefixed_value_len = 0;
+  const unsigned char *prefixed_value = get_prefixed_cache_value
+    (environment, qualified_key, &prefixed_value_len);
+
+  if (prefixed_value == NULL)
+    return 0;
+  else
+    {
+      assert (prefixed_value_len >= 8);
+      return gzochi_common_io_read_long (prefixed_value, 0);
+    }
+}
+
+/*
+  Transactionally removes a key from one of the delegate stores managed by the
+  specified environment if its release timestamp is *more recent* than the 
+  timestamp on the value in the store.
+
+  The delete may conflict with an application transaction that holds a lock on
+  the same part of the delegate store, in which case the specified delegate 
+  transaction is marked for rollback. The timestamp check ensures that a value
+  written after the key was released is never purged.
+
+  This function should only be called with the environment's database mutex 
+  held.
+*/
+
+static void
+purge_key (dataclient_environment *environment,
+	   gzochid_storage_transaction *delegate_tx,
+	   dataclient_purgeable_key *purgeable_key)
+{
+  dataclient_database *database = g_hash_table_lookup
+    (environment->databases, purgeable_key->qualified_key->store);
+  
+  size_t key_len = 0;
+  const unsigned char *key = g_bytes_get_data
+    (purgeable_key->qualified_key->key, &key_len);
+  char *value = NULL;
+
+  /* The store may have been closed since the key was released. */
+
+  if (database == NULL)
+    return;
+
+  value = environment->delegate_iface->transaction_get
+    (delegate_tx, database->delegate_store, (char *) key, key_len, NULL);
+
+  /* The value may have naturally been removed from the store; or it may never
+     have been added. */
+  
+  if (value != NULL)
+    {
+      gint64 timestamp = gzochi_common_io_read_long
+	((unsigned char *) value, 0);
+      
+      if (timestamp <= purgeable_key->release_timestamp)
+	{
+	  if (gzochid_log_level_visible (G_LOG_DOMAIN, GZOCHID_LOG_LEVEL_TRACE))
+	    GZOCHID_WITH_FORMATTED_BYTES
+	      (purgeable_key->qualified_key->key, buf, 33,
+	       gzochid_trace ("Purging stored value for released key %s/%s/%s.",
+			      environment->app_name,
+			      purgeable_key->qualified_key->store, buf));
+	  
+	  environment->delegate_iface->transaction_delete
+	    (delegate_tx, database->delegate_store, (char *) key, key_len);
+	}
+
+      free (value);
+    }
+}
+
+/* Removes the value (incl. deletion markers) for a purged key from the value
+   cache of the specified environment if its release timestamp is *more 
+   recent* than the timestamp on the cached value. This function should only be
+   called once the delegate transaction that purged the key has committed, so 
+   that the cache never drops a value that the store still holds. */
+
+static void
+purge_cached_key (dataclient_environment *environment,
+		  dataclient_purgeable_key *purgeable_key)
+{
+  g_mutex_lock (&environment->lock_table_mutex);
+  
+  if (get_timestamp_from_cache (environment, purgeable_key->qualified_key) <=
+      purgeable_key->release_timestamp) 
+    {
+      if (gzochid_log_level_visible (G_LOG_DOMAIN, GZOCHID_LOG_LEVEL_TRACE))
+	GZOCHID_WITH_FORMATTED_BYTES
+	  (purgeable_key->qualified_key->key, buf, 33,
+	   gzochid_trace ("Purging cached value for released key %s/%s/%s.",
+			  environment->app_name,
+			  purgeable_key->qualified_key->store, buf));
+      
+      g_hash_table_remove
+	(environment->value_cache, purgeable_key->qualified_key);
+    }
+
+  g_mutex_unlock (&environment->lock_table_mutex);
+}
+
+/*
+  Initiates a short, timed transaction against the delegate store and uses it
+  to conditionally delete (via `purge_key') all the keys in the specified array
+  of `dataclient_purgeable_key' structs; once the transaction has committed,
+  the keys are removed from the value cache (via `purge_cached_key'). Returns
+  `TRUE' if the transaction committed, `FALSE' if it was rolled back because of
+  contention with application transactions, in which case the keys should be 
+  purged again later.
+*/
+
+static gboolean
+purge_keys (dataclient_environment *env, GPtrArray *purgeable_keys)
+{
+  struct timeval timeout = { 0, PURGE_TRANSACTION_TIMEOUT_MS * 1000 };
+  gzochid_storage_transaction *tx = env->delegate_iface
+    ->transaction_begin_timed (env->delegate_context, timeout);
+  gboolean committed = FALSE;
+  guint i = 0;
+
+  /* Prevent the stores from being closed out from under the purge. */
+  
+  g_mutex_lock (&env->databases_mutex);
+  
+  for (; i < purgeable_keys->len && !tx->rollback; i++)
+    purge_key (env, tx, g_ptr_array_index (purgeable_keys, i));
+
+  if (!tx->rollback)
+    env->delegate_iface->transaction_prepare (tx);
+
+  if (tx->rollback)
+    env->delegate_iface->transaction_rollback (tx);
+  else
+    {
+      env->delegate_iface->transaction_commit (tx);
+      committed = TRUE;
+
+      for (i = 0; i < purgeable_keys->len; i++)
+	purge_cached_key (env, g_ptr_array_index (purgeable_keys, i));
+    }
+
+  g_mutex_unlock (&env->databases_mutex);
+  
+  return committed;
+}
+
+/*
+  The body of the environment's purge thread, which incrementally purges 
+  released keys - oldest release first - in small batches, whenever the 
+  estimated size of the released-but-unpurged keys exceeds the environment's 
+  cache size budget. 
+
+  Each batch is purged in its own short delegate transaction, concurrently with
+  application transactions; the purge mutex is not held while a batch is being
+  purged, so releasing keys and committing transactions never wait for a 
+  purge. Batches that fail because of contention are returned to the head of 
+  the queue and retried after a short delay.
+*/
+
+static gpointer
+purge_thread_func (gpointer data)
+{
+  dataclient_environment *env = data;
+  GPtrArray *batch = g_ptr_array_new ();
+
+  g_mutex_lock (&env->purge_mutex);
+
+  while (env->purge_thread_running)
+    {
+      size_t batch_size = 0;
+      gboolean committed = FALSE;
+      
+      if (env->purgeable_bytes <= env->max_cache_bytes)
+	{
+	  g_cond_wait (&env->purge_cond, &env->purge_mutex);
+	  continue;
+	}
+
+      /* Take the least recently released keys off the head of the queue. */
+      
+      while (batch->len < PURGE_BATCH_SIZE
+	     && !g_queue_is_empty (env->purgeable_keys))
+	{
+	  dataclient_purgeable_key *purgeable_key =
+	    g_queue_pop_head (env->purgeable_keys);
+
+	  batch_size += purgeable_key->size;
+	  g_ptr_array_add (batch, purgeable_key);
+	}
+
+      env->purgeable_bytes -= batch_size;
+      env->purging = TRUE;
+      g_mutex_unlock (&env->purge_mutex);
+
+      committed = purge_keys (env, batch);
+      
+      g_mutex_lock (&env->purge_mutex);
+      env->purging = FALSE;
+
+      if (committed)
+	{
+	  guint i = 0;
+	  
+	  for (; i < batch->len; i++)
+	    dataclient_purgeable_key_free (g_ptr_array_index (batch, i));
+	}
+      else
+	{
+	  gint64 retry_time = g_get_monotonic_time ()
+	    + PURGE_RETRY_INTERVAL_MS * 1000;
+	  guint i = batch->len;
+	  
+	  g_debug ("Purge of released keys for '%s' failed; retrying.",
+		   env->app_name);
+	  
+	  /* Put the keys back in release order, and back off. */
+	  
+	  while (i > 0)
+	    g_queue_push_head
+	      (env->purgeable_keys, g_ptr_array_index (batch, --i));
+
+	  env->purgeable_bytes += batch_size;
+	  
+	  g_cond_wait_until (&env->purge_cond, &env->purge_mutex, retry_time);
+	}
+
+      g_ptr_array_set_size (batch, 0);
+      g_cond_broadcast (&env->purge_done_cond);
+    }
+
+  g_mutex_unlock (&env->purge_mutex);
+  g_ptr_array_unref (batch);
+
+  return NULL;
+}
+
 /* The functions below implement the gzochid storage engine interface (as
    defined in `gzochid-storage.h') in terms of the client lock caching system 
    defined above. */
@@ -2285,6 +2707,7 @@ initialize (char *path)
 
   g_mutex_init (&environment->mutex);
   g_mutex_init (&environment->lock_table_mutex);
+  g_mutex_init (&environment->databases_mutex);
 
   environment->databases = g_hash_table_new (g_str_hash, g_str_equal);  
   
@@ -2302,6 +2725,9 @@ initialize (char *path)
   environment->write_lock_requests = g_hash_table_new_full
     (dataclient_qualified_key_hash, dataclient_qualified_key_equal,
      dataclient_qualified_key_free, NULL);
+  environment->prefetch_requests = g_hash_table_new_full
+    (dataclient_qualified_key_hash, dataclient_qualified_key_equal,
+     dataclient_qualified_key_free, NULL);
 
   environment->value_cache = g_hash_table_new_full
     (dataclient_qualified_key_hash, dataclient_qualified_key_equal,
@@ -2311,10 +2737,13 @@ initialize (char *path)
 
   g_mutex_init (&environment->purge_mutex);
   g_cond_init (&environment->purge_cond);
+  g_cond_init (&environment->purge_done_cond);
   
-  environment->purgeable_keys = g_ptr_array_new_with_free_func
-    (dataclient_purgeable_key_free);
-  environment->purge_threshold = DEFAULT_PURGE_THRESHOLD;
+  environment->purgeable_keys = g_queue_new ();
+  environment->max_cache_bytes = DEFAULT_MAX_CACHE_BYTES;
+  environment->purge_thread_running = TRUE;
+  environment->purge_thread = g_thread_new
+    ("dataclient-purge", purge_thread_func, environment);
   
   context->environment = environment;
   
@@ -2328,6 +2757,16 @@ static void
 close_context (gzochid_storage_context *context)
 {
   dataclient_environment *environment = context->environment;
+
+  /* Stop the purge thread before tearing down the structures it uses. */
+  
+  g_mutex_lock (&environment->purge_mutex);
+  environment->purge_thread_running = FALSE;
+  g_cond_signal (&environment->purge_cond);
+  g_mutex_unlock (&environment->purge_mutex);
+
+  g_thread_join (environment->purge_thread);
+  
   environment->delegate_iface->close_context (environment->delegate_context);
 
   if (environment->client != NULL)
@@ -2340,12 +2779,17 @@ close_context (gzochid_storage_context *context)
   g_hash_table_destroy (environment->locks);
   g_hash_table_destroy (environment->read_lock_requests);
   g_hash_table_destroy (environment->write_lock_requests);
+  g_hash_table_destroy (environment->prefetch_requests);
   
   g_hash_table_destroy (environment->value_cache);
 
   g_mutex_clear (&environment->purge_mutex);
   g_cond_clear (&environment->purge_cond);
-  g_ptr_array_free (environment->purgeable_keys, TRUE);  
+  g_cond_clear (&environment->purge_done_cond);
+  g_queue_free_full
+    (environment->purgeable_keys, dataclient_purgeable_key_free);
+
+  g_mutex_clear (&environment->databases_mutex);
   
   free (context->environment);  
   free (context);
@@ -2395,12 +2839,12 @@ open (gzochid_storage_context *context, char *path, unsigned int flags)
   store->context = context;
   store->database = database;
 
-  /* Hold the purge mutex to ensure serialized acccess ot the databases table
-     during a key page. */
+  /* Hold the databases mutex to ensure serialized acccess to the databases 
+     table during a key purge. */
   
-  g_mutex_lock (&environment->purge_mutex);
+  g_mutex_lock (&environment->databases_mutex);
   g_hash_table_insert (environment->databases, database->name, database);
-  g_mutex_unlock (&environment->purge_mutex);
+  g_mutex_unlock (&environment->databases_mutex);
   
   return store;
 }
@@ -2424,12 +2868,12 @@ close_store (gzochid_storage_store *store)
   dataclient_environment *environment = store->context->environment;
   dataclient_database *database = store->database;
 
-  /* Hold the purge mutex to ensure serialized acccess ot the databases table
-     during a key page. */
+  /* Hold the databases mutex to ensure serialized acccess to the databases 
+     table during a key purge. */
 
-  g_mutex_lock (&environment->purge_mutex);
+  g_mutex_lock (&environment->databases_mutex);
   g_hash_table_remove (environment->databases, database->name);
-  g_mutex_unlock (&environment->purge_mutex);
+  g_mutex_unlock (&environment->databases_mutex);
   
   free (database->name);
 
@@ -2489,7 +2933,6 @@ static gzochid_storage_transaction *
 create_transaction (gzochid_storage_context *context,
 		    gzochid_storage_transaction *delegate_tx, gint64 end_time)
 {
-  dataclient_environment *environment = context->environment;
   gzochid_storage_transaction *tx =
     calloc (1, sizeof (gzochid_storage_transaction));
   dataclient_transaction *txn = calloc (1, sizeof (dataclient_transaction));
@@ -2516,22 +2959,6 @@ create_transaction (gzochid_storage_context *context,
   tx->context = context;
   tx->txn = txn;
 
-  /* Don't allow new transactions to start if a key purge is in progress. */
-  
-  g_mutex_lock (&environment->purge_mutex);
-
-  if (environment->purging_keys)
-    {
-      g_debug
-	("Waiting to start transaction; purge of stale keys is in progress.");
-
-      while (environment->purging_keys)
-	g_cond_wait (&environment->purge_cond, &environment->purge_mutex);
-    }
-  
-  environment->transactions = g_list_prepend (environment->transactions, txn);
-  g_mutex_unlock (&environment->purge_mutex);
-  
   return tx;
 }
 
@@ -2599,172 +3026,6 @@ range_lock_unref_search_func (gpointer from, gpointer to, gpointer data,
   return FALSE;
 }
 
-/* Returns the timestamp-prefixed value in the value cache (if any) setting the
-   specified size pointer if available. The returned buffer is owned by the 
-   cache and should not be modified or freed. */
-
-static const unsigned char *
-get_prefixed_cache_value (dataclient_environment *environment,
-			  dataclient_qualified_key *qualified_key,
-			  size_t *value_len)
-{
-  GBytes *value = g_hash_table_lookup
-    (environment->value_cache, qualified_key);
-  
-  if (value != NULL)
-    return g_bytes_get_data (value, value_len);
-  else return NULL;
-}
-
-/* If there is a timestamp-prefixed non-zero-length value in the value cache 
-   for the specified key, return a copy of that value with the timestamp prefix
-   removed. Otherwise, return `NULL'. The returned buffer should be freed via
-   `free' when no longer needed. */
-
-static unsigned char *
-get_value_from_cache (dataclient_environment *environment,
-		      dataclient_qualified_key *qualified_key,
-		      size_t *value_len)
-{
-  size_t prefixed_value_len = 0;
-  const unsigned char *prefixed_value = get_prefixed_cache_value
-    (environment, qualified_key, &prefixed_value_len);
-
-  if (prefixed_value == NULL || prefixed_value_len <= 8)
-    return NULL;
-  else
-    {
-      size_t ret_value_len = prefixed_value_len - 8;
-
-      if (value_len != NULL)
-	*value_len = ret_value_len;
-      return g_memdup (prefixed_value + 8, ret_value_len);
-    }
-}
-
-/* If there is a timestamp-prefixed value in the value cache for the specified
-   key, return its timestamp. Otherwise, return zero. */
-
-static gint64
-get_timestamp_from_cache (dataclient_environment *environment,
-			  dataclient_qualified_key *qualified_key)
-{
-  size_t prefixed_value_len = 0;
-  const unsigned char *prefixed_value = get_prefixed_cache_value
-    (environment, qualified_key, &prefixed_value_len);
-
-  if (prefixed_value == NULL)
-    return 0;
-  else
-    {
-      assert (prefixed_value_len >= 8);
-      return gzochi_common_io_read_long (prefixed_value, 0);
-    }
-}
-
-/*
-  A `GFunc' to transactionally removes a key from one of the delegate stores 
-  managed by the specified environment, and from the value cache, if its release
-  timestamp is *more recent* than the timestamp on the value in the store / 
-  cache.
-
-  This function should only be called with the purge lock held, and with no 
-  other transactions active - i.e., during a properly-orchestrated purgeable key
-  sweep.
-*/
-
-static void
-purge_key (gpointer data, gpointer user_data)
-{
-  gpointer *args = user_data;
-  dataclient_environment *environment = args[0];
-  gzochid_storage_transaction *delegate_tx = args[1];  
-  
-  dataclient_purgeable_key *purgeable_key = data;
-  dataclient_database *database = g_hash_table_lookup
-    (environment->databases, purgeable_key->qualified_key->store);
-  
-  size_t key_len = 0;
-  const unsigned char *key = g_bytes_get_data
-    (purgeable_key->qualified_key->key, &key_len);
-  char *value = environment->delegate_iface->transaction_get
-    (delegate_tx, database->delegate_store, (char *) key, key_len, NULL);
-
-  /* The value may have naturally been removed from the store; or it may never
-     have been added. */
-  
-  if (value != NULL)
-    {
-      gint64 timestamp = gzochi_common_io_read_long
-	((unsigned char *) value, 0);
-      
-      if (timestamp <= purgeable_key->release_timestamp)
-	{
-	  if (gzochid_log_level_visible (G_LOG_DOMAIN, GZOCHID_LOG_LEVEL_TRACE))
-	    GZOCHID_WITH_FORMATTED_BYTES
-	      (purgeable_key->qualified_key->key, buf, 33,
-	       gzochid_trace ("Purging stored value for released key %s/%s/%s.",
-			      environment->app_name,
-			      purgeable_key->qualified_key->store, buf));
-	  
-	  int ret = environment->delegate_iface->transaction_delete
-	    (delegate_tx, database->delegate_store, (char *) key, key_len);
-	  assert (ret != GZOCHID_STORAGE_ETXFAILURE);	  
-	}
-
-      free (value);
-    }
-
-  /* Also remove the value (incl. deletion markers) from the cache, if
-     appropriate. */
-  
-  if (get_timestamp_from_cache (environment, purgeable_key->qualified_key) <=
-      purgeable_key->release_timestamp) 
-    {
-      if (gzochid_log_level_visible (G_LOG_DOMAIN, GZOCHID_LOG_LEVEL_TRACE))
-	GZOCHID_WITH_FORMATTED_BYTES
-	  (purgeable_key->qualified_key->key, buf, 33,
-	   gzochid_trace ("Purging cached value for released key %s/%s/%s.",
-			  environment->app_name,
-			  purgeable_key->qualified_key->store, buf));
-      
-      g_hash_table_remove
-	(environment->value_cache, purgeable_key->qualified_key);
-    }
-}
-
-/*
-  Initiates a transaction against the delegate store and uses it to 
-  conditionally delete (via `purge_key') all the keys in the purgeable key 
-  array.
-
-  This function should only be called with the purge lock held, and with no 
-  other transactions active - i.e., during a properly-orchestrated purgeable key
-  sweep.
-*/
-
-static void
-purge_keys (dataclient_environment *env)
-{
-  gzochid_storage_transaction *tx = env->delegate_iface->transaction_begin
-    (env->delegate_context);
-  gpointer args[2] = { env, tx };
-
-  g_debug ("Purging released keys for '%s'...", env->app_name);
-  
-  g_ptr_array_foreach (env->purgeable_keys, purge_key, args);
-  
-  env->delegate_iface->transaction_prepare (tx);
-  assert (!tx->rollback);
-  
-  env->delegate_iface->transaction_commit (tx);
-  g_debug ("Released key purge for '%s' complete.", env->app_name);
-  
-  g_ptr_array_free (env->purgeable_keys, TRUE);
-  env->purgeable_keys = g_ptr_array_new_with_free_func
-    (dataclient_purgeable_key_free);
-}
-
 /* Frees the resources allocated for the specified transaction and removes it
    from the enclosing dataclient environment. */
 
@@ -2806,39 +3067,6 @@ cleanup_transaction (gzochid_storage_transaction *tx)
   g_array_free (txn->changeset, TRUE);
   
   g_list_free_full (txn->deleted_keys, (GDestroyNotify) callback_data_free);
-
-  g_mutex_lock (&env->purge_mutex);
-
-  /* First remove the current transaction from the transaction list so it
-     doesn't show up as active. */
-  
-  env->transactions = g_list_remove (env->transactions, txn); 
-
-  /* If the number of released keys has exceeded the purge threshold and there's
-     not already a purge in progress. */
-  
-  if (env->purgeable_keys->len > env->purge_threshold && !env->purging_keys)
-    {      
-      env->purging_keys = TRUE;
-
-      if (env->transactions != NULL)
-	{
-	  g_debug ("Awaiting transaction completion ahead of '%s' key purge.",
-		   env->app_name);
-	  
-	  while (env->transactions != NULL)
-	    g_cond_wait (&env->purge_cond, &env->purge_mutex);
-	}
-      
-      purge_keys (env);      
-      env->purging_keys = FALSE;
-    }
-
-  /* Wake up any transactions waiting to start - or completed transactions 
-     waiting to initiate a key purge. */
-  
-  g_cond_broadcast (&env->purge_cond);
-  g_mutex_unlock (&env->purge_mutex);
   
   free (txn);
   free (tx);
@@ -3282,6 +3510,223 @@ transaction_next_key (gzochid_storage_transaction *tx,
   else return NULL;
 }
 
+/* The engine-specific state of a cursor. */
+
+struct _dataclient_cursor
+{
+  /* The key at which the cursor is positioned, or `NULL' if it is positioned
+     before the first key. */
+
+  char *position;
+  size_t position_len; /* The length of the position key. */
+
+  /* Whether the position key itself should be returned by the next call to 
+     `cursor_next', as it may be following a seek. */
+
+  gboolean inclusive; 
+};
+
+typedef struct _dataclient_cursor dataclient_cursor;
+
+static gzochid_storage_cursor *
+transaction_cursor_open (gzochid_storage_transaction *tx,
+			 gzochid_storage_store *store)
+{
+  gzochid_storage_cursor *cursor = malloc (sizeof (gzochid_storage_cursor));
+
+  cursor->transaction = tx;
+  cursor->store = store;
+  cursor->cursor = calloc (1, sizeof (dataclient_cursor));
+  
+  return cursor;
+}
+
+static void
+cursor_seek (gzochid_storage_cursor *cursor, char *key, size_t key_len)
+{
+  dataclient_cursor *dcursor = cursor->cursor;
+
+  free (dcursor->position);
+  
+  dcursor->position = malloc (sizeof (char) * key_len);
+  dcursor->position_len = key_len;
+  dcursor->inclusive = TRUE;
+
+  memcpy (dcursor->position, key, key_len);
+
+  /* The first key greater than or equal to a key ending in a NUL byte is the
+     first key strictly greater than the key without it, which can be found via
+     a range lock alone - without requesting a point lock on a key that most
+     likely doesn't exist. */
+  
+  if (key_len > 0 && key[key_len - 1] == '\0')
+    {
+      dcursor->position_len--;
+      dcursor->inclusive = FALSE;
+    }
+}
+
+/*
+  Advances the specified cursor to the next key, and retrieves its value.
+
+  The cursor is built on the same range locks that back `transaction_next_key',
+  and the same point locks that back `transaction_get' - which may already be 
+  held by this node, in which case no round trip to the meta server is needed.
+  Following a seek, the value of the seek key itself is requested first, since
+  range locks only cover the keys that strictly follow their lower bounds.
+*/
+
+static char *
+cursor_next (gzochid_storage_cursor *cursor, size_t *key_len, char **value,
+	     size_t *value_len)
+{
+  dataclient_cursor *dcursor = cursor->cursor;
+  gzochid_storage_transaction *tx = cursor->transaction;
+
+  while (!tx->rollback)
+    {
+      char *key = NULL, *key_value = NULL;
+      size_t tmp_key_len = 0, tmp_value_len = 0;
+
+      if (dcursor->position == NULL)
+	key = transaction_first_key (tx, cursor->store, &tmp_key_len);
+      else
+	{
+	  if (dcursor->inclusive)
+	    {
+	      key_value = transaction_get
+		(tx, cursor->store, dcursor->position, dcursor->position_len,
+		 &tmp_value_len);
+	      
+	      if (key_value != NULL)
+		{
+		  tmp_key_len = dcursor->position_len;
+		  key = g_memdup (dcursor->position, tmp_key_len);
+		}
+	      else if (tx->rollback)
+		return NULL;
+	    }
+
+	  if (key == NULL)
+	    key = transaction_next_key
+	      (tx, cursor->store, dcursor->position, dcursor->position_len,
+	       &tmp_key_len);
+	}
+      
+      if (key == NULL)
+	return NULL;
+
+      free (dcursor->position);
+      dcursor->position = g_memdup (key, tmp_key_len);
+      dcursor->position_len = tmp_key_len;
+      dcursor->inclusive = FALSE;
+
+      if (key_value == NULL)
+	key_value = transaction_get
+	  (tx, cursor->store, key, tmp_key_len, &tmp_value_len);
+
+      /* A key without a value has been deleted by this transaction; skip 
+	 it. */
+      
+      if (key_value == NULL)
+	{
+	  free (key);
+	  continue;
+	}
+      
+      if (key_len != NULL)
+	*key_len = tmp_key_len;
+      if (value != NULL)
+	*value = key_value;
+      else free (key_value);
+      if (value_len != NULL)
+	*value_len = tmp_value_len;
+
+      return key;
+    }
+
+  return NULL;
+}
+
+static void
+cursor_close (gzochid_storage_cursor *cursor)
+{
+  dataclient_cursor *dcursor = cursor->cursor;
+
+  free (dcursor->position);
+  free (dcursor);
+  free (cursor);
+}
+
+/*
+  Sends a request to the meta server for a read lock on the specified key, 
+  unless the lock is already held on this node or a request for it is already
+  in progress, and returns without waiting for a response. The value delivered
+  with the lock is held in the value cache, so that a subsequent 
+  `transaction_get' for the key can establish the lock without a round trip to
+  the meta server - or at least without waiting for the whole trip.
+
+  Keys in the eviction list are skipped, since they cannot be re-requested until
+  their release has been acknowledged.
+*/
+
+static void
+transaction_prefetch (gzochid_storage_transaction *tx,
+		      gzochid_storage_store *store, char *key, size_t key_len)
+{
+  dataclient_database *database = store->database;
+  dataclient_environment *environment = store->context->environment;
+  dataclient_transaction *dataclient_tx = tx->txn;  
+  GBytes *key_bytes = g_bytes_new (key, key_len);
+
+  dataclient_qualified_key qualified_key = { database->name, key_bytes };
+  gboolean should_request = FALSE;
+  
+  if (tx->rollback
+      || g_hash_table_contains (dataclient_tx->locks, &qualified_key))
+    {
+      g_bytes_unref (key_bytes);
+      return;
+    }
+  
+  g_mutex_lock (&environment->mutex);
+  g_mutex_lock (&environment->lock_table_mutex);
+
+  if (!g_hash_table_contains (environment->locks, &qualified_key)
+      && !g_hash_table_contains
+      (environment->read_lock_requests, &qualified_key)
+      && !g_hash_table_contains
+      (environment->write_lock_requests, &qualified_key)
+      && !g_hash_table_contains
+      (environment->prefetch_requests, &qualified_key)
+      && find_evicted_key (environment, &qualified_key) == NULL)
+    {
+      g_hash_table_add
+	(environment->prefetch_requests,
+	 dataclient_qualified_key_copy (&qualified_key));
+      should_request = TRUE;
+    }
+
+  g_mutex_unlock (&environment->lock_table_mutex);
+  g_mutex_unlock (&environment->mutex);
+
+  /* The request is sent outside of the lock table mutex, since the response
+     callbacks need to acquire it. */
+  
+  if (should_request)
+    {
+      dataclient_callback_data *callback_data =
+	create_callback_data (store, key_bytes, FALSE);
+      
+      gzochid_dataclient_request_value
+	(environment->client, environment->app_name, database->name, key_bytes,
+	 FALSE, lock_success_callback, callback_data, lock_failure_callback,
+	 callback_data, lock_release_callback, callback_data);
+    }
+  
+  g_bytes_unref (key_bytes);
+}
+
 gzochid_storage_engine_interface gzochid_storage_engine_interface_dataclient = 
   {
     "dataclient",
@@ -3304,5 +3749,10 @@ gzochid_storage_engine_interface gzochid_storage_engine_interface_dataclient =
     transaction_put,
     transaction_delete,
     transaction_first_key,
-    transaction_next_key
+    transaction_next_key,
+    transaction_cursor_open,
+    cursor_seek,
+    cursor_next,
+    cursor_close,
+    transaction_prefetch
   };
@@ -29,4 +29,21 @@ gzochid_storage_engine_interface_dataclient;
 void gzochid_dataclient_storage_context_set_dataclient
 (gzochid_storage_context *, GzochidDataClient *);
 
+/* Sets the approximate number of bytes that the values of released keys may
+   occupy in the local cache of the specified storage context before they are
+   purged, least recently released first, by a background thread. The default
+   is 64 MB. */
+
+void gzochid_dataclient_storage_context_set_max_cache_bytes
+(gzochid_storage_context *, size_t);
+
+/* Private storage context API, visible for testing only. */
+
+/* Blocks until the background purge thread of the specified storage context has
+   purged enough released keys to bring their estimated size within the cache 
+   size budget, and is not in the middle of purging a batch. */
+
+void _gzochid_dataclient_storage_context_wait_for_purge
+(gzochid_storage_context *);
+
 #endif /* GZOCHID_STORAGE_DATACLIENT_H */
@@ -3447,6 +3447,273 @@ transaction_get_for_update (gzochid_storage_transaction *tx,
   return get_internal (tx, store, key, key_len, value_len, TRUE);
 }
 
+/* Returns the leaf node that follows the specified leaf node, from the point of
+   view of the specified transaction, establishing read locks on the nodes 
+   visited along the way. This function returns NULL if there is no next leaf,
+   or if a lock cannot be established (in which case, the error return will be 
+   set). */
+
+static btree_node *
+tx_next_leaf (btree_node *node, btree_transaction *btx, GError **err)
+{
+  GError *tmp_err = NULL;
+  
+  while (TRUE)
+    {
+      btree_node *next = NULL;
+
+      /* Climb until there's a sibling to the right... */
+      
+      while ((next = tx_next_sibling (node, btx, &tmp_err)) == NULL)
+	{
+	  if (tmp_err == NULL)
+	    node = tx_parent (node, btx, &tmp_err);
+
+	  if (tmp_err != NULL)
+	    {
+	      g_propagate_error (err, tmp_err);
+	      return NULL;
+	    }
+	  else if (node == NULL)
+	    return NULL;
+	}
+
+      /* ...then descend along the leftmost path below it. */
+      
+      node = next;
+      while (effective_page (node, FALSE) == NULL
+	     && (next = tx_first_child (node, btx, &tmp_err)) != NULL)
+	node = next;
+
+      if (tmp_err != NULL)
+	{
+	  g_propagate_error (err, tmp_err);
+	  return NULL;
+	}
+      else if (effective_page (node, FALSE) != NULL)
+	return node;
+
+      /* An internal node with no children; keep looking to its right. */
+    }
+}
+
+/* A key-value pair buffered by a cursor. */
+
+struct _mem_cursor_record
+{
+  char *key; /* The key. */
+  size_t key_len; /* The length of the key. */
+  char *value; /* The value. */
+  size_t value_len; /* The length of the value. */
+};
+
+typedef struct _mem_cursor_record mem_cursor_record;
+
+/* The engine-specific state of a cursor. */
+
+struct _mem_cursor
+{
+  GQueue *records; /* The buffered `mem_cursor_record' structures. */
+
+  /* The key from which the next batch of records should be read, or `NULL' if
+     reading should start from the first key. */
+
+  char *position;
+  size_t position_len; /* The length of the position key. */
+  gboolean exhausted; /* Whether the last key has been read. */
+};
+
+typedef struct _mem_cursor mem_cursor;
+
+static void
+free_cursor_record (gpointer data)
+{
+  mem_cursor_record *record = data;
+
+  free (record->key);
+  free (record->value);
+  free (record);
+}
+
+/* Copies into the specified cursor's buffer the records in the specified page
+   starting at the specified offset. Returns the number of records copied. */
+
+static int
+buffer_page_records (mem_cursor *cursor, btree_page *page, size_t offset)
+{
+  int n = 0;
+  
+  while (offset < page->page_size)
+    {
+      mem_cursor_record *record = malloc (sizeof (mem_cursor_record));
+      
+      record->key_len = gzochi_common_io_read_short (page->data, offset);
+      record->key = malloc (sizeof (char) * record->key_len);
+      memcpy (record->key, page->data + offset + 2, record->key_len);
+      offset += record->key_len + 2;
+
+      record->value_len = gzochi_common_io_read_short (page->data, offset);
+      record->value = malloc (sizeof (char) * record->value_len);
+      memcpy (record->value, page->data + offset + 2, record->value_len);
+      offset += record->value_len + 2;
+
+      g_queue_push_tail (cursor->records, record);
+      n++;
+    }
+
+  return n;
+}
+
+/*
+  Refills the specified cursor's buffer with the records from the leaf page 
+  that holds its position, or from the next non-empty leaf page if the records
+  in that page all fall before the position. Records are copied out of the page
+  so that the buffer is unaffected by modifications the transaction makes to 
+  the B+tree while the cursor is open. 
+
+  Returns `FALSE' if the records could not be read, in which case the 
+  transaction is marked for rollback. 
+*/
+
+static gboolean
+fill_cursor (gzochid_storage_cursor *cursor)
+{
+  GError *err = NULL;
+  mem_cursor *mcursor = cursor->cursor;
+  btree_transaction *btx = cursor->transaction->txn;
+  btree_node *node = NULL;
+  btree_page *page = NULL;
+  
+  /* The first key in the store must be immediately >= '\0'. */
+
+  if (mcursor->position == NULL)
+    node = search (btx, cursor->store->database, "", 1);
+  else node = search
+	 (btx, cursor->store->database, mcursor->position,
+	  mcursor->position_len);
+
+  if (node == NULL)
+    {
+      g_warning ("Failed to seek cursor in transaction.");
+      mark_for_rollback (cursor->transaction, TRUE);
+      return FALSE;
+    }
+
+  page = effective_page (node, FALSE);
+
+  if (page != NULL)
+    {
+      size_t offset = mcursor->position == NULL ? 0 : page_key_offset
+	(page, (unsigned char *) mcursor->position, mcursor->position_len);
+
+      if (buffer_page_records (mcursor, page, offset) > 0)
+	return TRUE;
+    }
+  
+  while ((node = tx_next_leaf (node, btx, &err)) != NULL)
+    if (buffer_page_records (mcursor, effective_page (node, FALSE), 0) > 0)
+      return TRUE;
+
+  if (err != NULL)
+    {
+      g_warning ("Failed to advance cursor in transaction: %s", err->message);
+      g_error_free (err);
+      mark_for_rollback (cursor->transaction, TRUE);
+      return FALSE;
+    }
+
+  mcursor->exhausted = TRUE;
+  return TRUE;
+}
+
+static gzochid_storage_cursor *
+transaction_cursor_open (gzochid_storage_transaction *tx,
+			 gzochid_storage_store *store)
+{
+  gzochid_storage_cursor *cursor = malloc (sizeof (gzochid_storage_cursor));
+  mem_cursor *mcursor = calloc (1, sizeof (mem_cursor));
+
+  mcursor->records = g_queue_new ();
+  
+  cursor->transaction = tx;
+  cursor->store = store;
+  cursor->cursor = mcursor;
+  
+  return cursor;
+}
+
+static void
+cursor_seek (gzochid_storage_cursor *cursor, char *key, size_t key_len)
+{
+  mem_cursor *mcursor = cursor->cursor;
+
+  while (!g_queue_is_empty (mcursor->records))
+    free_cursor_record (g_queue_pop_head (mcursor->records));
+
+  free (mcursor->position);
+  
+  mcursor->position = malloc (sizeof (char) * key_len);
+  mcursor->position_len = key_len;
+  mcursor->exhausted = FALSE;
+
+  memcpy (mcursor->position, key, key_len);
+}
+
+static char *
+cursor_next (gzochid_storage_cursor *cursor, size_t *key_len, char **value,
+	     size_t *value_len)
+{
+  mem_cursor *mcursor = cursor->cursor;
+  mem_cursor_record *record = NULL;
+  char *ret = NULL;
+  
+  if (!check_tx (cursor->transaction))
+    return NULL;
+
+  if (g_queue_is_empty (mcursor->records))
+    {
+      if (mcursor->exhausted || !fill_cursor (cursor)
+	  || g_queue_is_empty (mcursor->records))
+	return NULL;
+    }
+
+  record = g_queue_pop_head (mcursor->records);
+
+  /* The next batch of records will start immediately after this one. */
+  
+  if (g_queue_is_empty (mcursor->records))
+    {
+      free (mcursor->position);
+      mcursor->position = (char *) key_after
+	((unsigned char *) record->key, record->key_len);
+      mcursor->position_len = record->key_len + 1;
+    }
+  
+  ret = record->key;
+
+  if (key_len != NULL)
+    *key_len = record->key_len;
+  if (value != NULL)
+    *value = record->value;
+  else free (record->value);
+  if (value_len != NULL)
+    *value_len = record->value_len;
+
+  free (record);
+  return ret;
+}
+
+static void
+cursor_close (gzochid_storage_cursor *cursor)
+{
+  mem_cursor *mcursor = cursor->cursor;
+
+  g_queue_free_full (mcursor->records, free_cursor_record);
+  free (mcursor->position);
+  free (mcursor);
+  free (cursor);
+}
+
 gzochid_storage_engine_interface gzochid_storage_engine_interface_mem = 
   {
     "mem",
@@ -3469,7 +3736,11 @@ gzochid_storage_engine_interface gzochid_storage_engine_interface_mem =
     transaction_put,
     transaction_delete,
     transaction_first_key,
-    transaction_next_key
+    transaction_next_key,
+    transaction_cursor_open,
+    cursor_seek,
+    cursor_next,
+    cursor_close
   };
 
 /* A `GFunc' implementation to support `gzochid_data_print_btree_structure' 
@@ -35,7 +35,8 @@
    engine. If any of these steps fail, this function returns NULL. */
 
 gzochid_storage_engine *
-gzochid_storage_load_engine (const char *dir, const char *name)
+gzochid_storage_load_engine (const char *dir, const char *name,
+			     GHashTable *config)
 {
   if (g_module_supported ())
     {
@@ -89,6 +90,10 @@ gzochid_storage_load_engine (const char *dir, const char *name)
 	  engine->handle = engine_handle;
 	      
 	  g_message ("Loaded storage engine '%s'", engine->interface->name);
+
+	  if (config != NULL && engine->interface->configure != NULL)
+	    engine->interface->configure (config);
+	  
 	  return engine;
 	}
     }
@@ -99,3 +104,38 @@ gzochid_storage_load_engine (const char *dir, const char *name)
       return NULL;
     }
 }
+
+gzochid_storage_transaction *
+gzochid_storage_transaction_begin_read_only
+(gzochid_storage_engine_interface *iface, gzochid_storage_context *context)
+{
+  if (iface->transaction_begin_read_only != NULL)
+    return iface->transaction_begin_read_only (context);
+  else return iface->transaction_begin (context);
+}
+
+gboolean
+gzochid_storage_context_snapshot_reads
+(gzochid_storage_engine_interface *iface, gzochid_storage_context *context)
+{
+  return iface->context_snapshot_reads != NULL
+    && iface->context_snapshot_reads (context);
+}
+
+void
+gzochid_storage_transaction_put_bulk
+(gzochid_storage_engine_interface *iface, gzochid_storage_transaction *tx,
+ gzochid_storage_store *store, gzochid_storage_pair *pairs, size_t num_pairs)
+{
+  if (iface->transaction_put_bulk != NULL)
+    iface->transaction_put_bulk (tx, store, pairs, num_pairs);
+  else
+    {
+      size_t i = 0;
+
+      for (; i < num_pairs && !tx->rollback; i++)
+	iface->transaction_put
+	  (tx, store, pairs[i].key, pairs[i].key_len, pairs[i].value,
+	   pairs[i].value_len);
+    }
+}
@@ -25,11 +25,39 @@
    file, with no extension or path prefix. If a storage engine module is 
    present in the module directory, it will be opened, loaded, and initialized.
 
+   If the engine accepts configuration, it is configured with the specified
+   table of settings, which may be `NULL'.
+
    This function returns a pointer to a newly-allocated 
    `gzochid_storage_engine' structure (which should be freed with `free') on 
    success, or NULL on failure. 
 */
 gzochid_storage_engine *gzochid_storage_load_engine (const char *, 
-						     const char *);
+						     const char *,
+						     GHashTable *);
+
+/* Begins a transaction that will only read from the database, via the 
+   specified storage engine interface's `transaction_begin_read_only' function
+   if it provides one, or via its `transaction_begin' function otherwise. */
+
+gzochid_storage_transaction *gzochid_storage_transaction_begin_read_only
+(gzochid_storage_engine_interface *, gzochid_storage_context *);
+
+/* Returns `TRUE' if the read-only transactions begun via the specified storage
+   engine interface in the specified context read from a snapshot, via the 
+   interface's `context_snapshot_reads' function if it provides one; returns
+   `FALSE' otherwise. */
+
+gboolean gzochid_storage_context_snapshot_reads
+(gzochid_storage_engine_interface *, gzochid_storage_context *);
+
+/* Stores the specified array of key-value pairs in the specified store within
+   the specified transaction, via the specified storage engine interface's 
+   `transaction_put_bulk' function if it provides one, or by calling its
+   `transaction_put' function for each pair otherwise. */
+
+void gzochid_storage_transaction_put_bulk
+(gzochid_storage_engine_interface *, gzochid_storage_transaction *,
+ gzochid_storage_store *, gzochid_storage_pair *, size_t);
 
 #endif /* GZOCHID_STORAGE_INTERNAL_H */
@@ -27,19 +27,181 @@
 
 #include "../gzochid-storage.h"
 
+/* The initial size of the buffer used for bulk cursor reads. Berkeley DB 
+   requires that it be a multiple of 1024 bytes. */
+
+#define CURSOR_BUFFER_SIZE (64 * 1024)
+
+/* The default interval, in seconds, between checkpoints. */
+
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+
+/* Engine settings, read from the server configuration by `configure'. */
+
+struct _bdb_settings
+{
+  guint64 cache_size; /* The cache size in bytes, or 0 for the default. */
+  guint64 log_buffer_size; /* The log buffer size, or 0 for the default. */
+
+  /* The maximum number of concurrent transactions, or 0 for the default. */
+
+  guint64 max_transactions;
+
+  /* The number of seconds between checkpoints, or 0 to disable the checkpoint
+     thread. */
+
+  guint64 checkpoint_interval;
+
+  /* Whether log files no longer needed for recovery are removed after each
+     checkpoint. */
+
+  gboolean remove_logs; 
+
+  /* Whether read-only transactions read from a snapshot, via multi-version 
+     concurrency control, instead of taking read locks. */
+
+  gboolean snapshot_reads; 
+};
+
+typedef struct _bdb_settings bdb_settings;
+
+static bdb_settings settings =
+  { 0, 0, 0, DEFAULT_CHECKPOINT_INTERVAL, TRUE, FALSE };
+
+/* The engine-specific state of a storage context. */
+
+struct _bdb_environment
+{
+  DB_ENV *db_env; /* The Berkeley DB environment. */
+  
+  GThread *checkpoint_thread; /* The checkpoint thread, if any. */
+  GMutex mutex; /* Protects `closing'. */
+  GCond cond; /* Signaled when the environment is closing. */
+  gboolean closing; /* Whether the environment is closing. */
+};
+
+typedef struct _bdb_environment bdb_environment;
+
 static gboolean 
 retryable (int ret)
 {
   return ret == DB_LOCK_DEADLOCK || ret == DB_LOCK_NOTGRANTED;
 }
 
+/* Parses the setting with the specified name from the specified table as a
+   non-negative integer, returning the specified default value if the setting
+   is absent or malformed. */
+
+static guint64
+setting_to_uint64 (GHashTable *config, const char *name, guint64 def)
+{
+  const char *value = g_hash_table_lookup (config, name);
+  gchar *end = NULL;
+  guint64 ret = 0;
+
+  if (value == NULL)
+    return def;
+
+  ret = g_ascii_strtoull (value, &end, 10);
+  if (end == value || *end != '\0')
+    {
+      g_warning ("Invalid value '%s' for %s; ignoring.", value, name);
+      return def;
+    }
+  else return ret;
+}
+
+static gboolean
+setting_to_boolean (GHashTable *config, const char *name, gboolean def)
+{
+  const char *value = g_hash_table_lookup (config, name);
+
+  if (value == NULL)
+    return def;
+  else if (g_ascii_strcasecmp (value, "true") == 0)
+    return TRUE;
+  else if (g_ascii_strcasecmp (value, "false") == 0)
+    return FALSE;
+  else
+    {
+      g_warning ("Invalid value '%s' for %s; ignoring.", value, name);
+      return def;
+    }
+}
+
+static void
+configure (GHashTable *config)
+{
+  settings.cache_size = setting_to_uint64
+    (config, "storage.bdb.cache.mb", 0) * 1024 * 1024;
+  settings.log_buffer_size = setting_to_uint64
+    (config, "storage.bdb.log.buffer.kb", 0) * 1024;
+  settings.max_transactions = setting_to_uint64
+    (config, "storage.bdb.tx.max", 0);
+  settings.checkpoint_interval = setting_to_uint64
+    (config, "storage.bdb.checkpoint.interval.sec",
+     DEFAULT_CHECKPOINT_INTERVAL);
+  settings.remove_logs = setting_to_boolean
+    (config, "storage.bdb.log.remove", TRUE);
+  settings.snapshot_reads = setting_to_boolean
+    (config, "storage.bdb.snapshot.enabled", FALSE);
+}
+
+/* Flushes the cache to disk and writes a checkpoint record to the log, which
+   bounds the amount of log that must be replayed during recovery, and then
+   removes the log files that are no longer needed, if so configured. */
+
+static void
+checkpoint (DB_ENV *db_env)
+{
+  int ret = db_env->txn_checkpoint (db_env, 0, 0, 0);
+
+  if (ret != 0)
+    g_warning ("Failed to checkpoint BDB environment: %s", db_strerror (ret));
+  else if (settings.remove_logs)
+    {
+      ret = db_env->log_archive (db_env, NULL, DB_ARCH_REMOVE);
+      if (ret != 0)
+	g_warning ("Failed to remove BDB log files: %s", db_strerror (ret));
+    }
+}
+
+static gpointer
+checkpoint_thread (gpointer data)
+{
+  bdb_environment *env = data;
+
+  g_mutex_lock (&env->mutex);
+
+  while (!env->closing)
+    {
+      gint64 end_time = g_get_monotonic_time ()
+	+ settings.checkpoint_interval * G_USEC_PER_SEC;
+
+      while (!env->closing)
+	if (!g_cond_wait_until (&env->cond, &env->mutex, end_time))
+	  break;
+
+      if (!env->closing)
+	{
+	  g_mutex_unlock (&env->mutex);
+	  checkpoint (env->db_env);
+	  g_mutex_lock (&env->mutex);
+	}
+    }
+
+  g_mutex_unlock (&env->mutex);
+
+  return NULL;
+}
+
 static gzochid_storage_context *
 initialize (char *path)
 {
   DB_ENV *db_env = NULL;
   u_int32_t env_flags = 0;
-  gzochid_storage_context *context = 
-    calloc (1, sizeof (gzochid_storage_context));
+  gzochid_storage_context *context = NULL;
+  bdb_environment *env = NULL;
   int ret = 0;
 
   if (g_file_test (path, G_FILE_TEST_EXISTS))
@@ -63,6 +225,21 @@ initialize (char *path)
   assert (db_env_create (&db_env, 0) == 0);
   assert (db_env->set_lk_detect (db_env, DB_LOCK_YOUNGEST) == 0);
 
+  if (settings.cache_size > 0)
+    assert (db_env->set_cachesize
+	    (db_env, settings.cache_size / G_GUINT64_CONSTANT (1073741824),
+	     settings.cache_size % G_GUINT64_CONSTANT (1073741824), 1) == 0);
+  if (settings.log_buffer_size > 0)
+    assert (db_env->set_lg_bsize (db_env, settings.log_buffer_size) == 0);
+  if (settings.max_transactions > 0)
+    assert (db_env->set_tx_max (db_env, settings.max_transactions) == 0);
+
+  /* Multi-version concurrency control must be enabled for the environment's
+     databases to support snapshot reads. */
+  
+  if (settings.snapshot_reads)
+    assert (db_env->set_flags (db_env, DB_MULTIVERSION, 1) == 0);
+
   env_flags = DB_CREATE
     | DB_INIT_LOCK
     | DB_INIT_MPOOL
@@ -80,7 +257,17 @@ initialize (char *path)
 
   db_env->set_flags (db_env, DB_TXN_WRITE_NOSYNC, TRUE);
 
-  context->environment = db_env;
+  env = calloc (1, sizeof (bdb_environment));
+  env->db_env = db_env;
+  g_mutex_init (&env->mutex);
+  g_cond_init (&env->cond);
+
+  if (settings.checkpoint_interval > 0)
+    env->checkpoint_thread = g_thread_new
+      ("bdb-checkpoint", checkpoint_thread, env);
+
+  context = calloc (1, sizeof (gzochid_storage_context));
+  context->environment = env;
 
   return context;
 }
@@ -88,10 +275,27 @@ initialize (char *path)
 static void 
 close_context (gzochid_storage_context *context)
 {
-  DB_ENV *env = context->environment;
+  bdb_environment *env = context->environment;
 
-  env->close (env, DB_FORCESYNC);
+  if (env->checkpoint_thread != NULL)
+    {
+      g_mutex_lock (&env->mutex);
+      env->closing = TRUE;
+      g_cond_signal (&env->cond);
+      g_mutex_unlock (&env->mutex);
+
+      g_thread_join (env->checkpoint_thread);
+    }
+
+  /* A final checkpoint shortens recovery when the environment is reopened. */
 
+  checkpoint (env->db_env);
+  env->db_env->close (env->db_env, DB_FORCESYNC);
+
+  g_mutex_clear (&env->mutex);
+  g_cond_clear (&env->cond);
+
+  free (env);
   free (context);
 }
 
@@ -123,7 +327,8 @@ open (gzochid_storage_context *context, char *path, unsigned int flags)
 {
   DB *db = NULL;
   DB_TXN *dbopen_tx = NULL;
-  DB_ENV *db_env = context->environment;
+  bdb_environment *env = context->environment;
+  DB_ENV *db_env = env->db_env;
 
   int pathlen = strlen (path);
   gzochid_storage_store *store = calloc (1, sizeof (gzochid_storage_store));
@@ -176,22 +381,22 @@ close_store (gzochid_storage_store *store)
 static void
 destroy_store (gzochid_storage_context *context, char *path)
 {
-  DB_ENV *env = context->environment;  
+  bdb_environment *env = context->environment;  
   gchar *filename = g_strconcat (path, ".db", NULL);
 
-  env->dbremove (env, NULL, filename, NULL, 0);
+  env->db_env->dbremove (env->db_env, NULL, filename, NULL, 0);
   g_free (filename);
 }
 
 static gzochid_storage_transaction *
-transaction_begin (gzochid_storage_context *context)
+transaction_begin_flags (gzochid_storage_context *context, u_int32_t flags)
 {
-  DB_ENV *db_env = context->environment;
+  bdb_environment *env = context->environment;
   gzochid_storage_transaction *transaction = 
     calloc (1, sizeof (gzochid_storage_transaction));
   DB_TXN *txn;
 
-  db_env->txn_begin (db_env, NULL, &txn, 0);
+  env->db_env->txn_begin (env->db_env, NULL, &txn, flags);
 
   transaction->context = context;
   transaction->txn = txn;
@@ -199,6 +404,28 @@ transaction_begin (gzochid_storage_context *context)
   return transaction;
 }
 
+static gzochid_storage_transaction *
+transaction_begin (gzochid_storage_context *context)
+{
+  return transaction_begin_flags (context, 0);
+}
+
+static gzochid_storage_transaction *
+transaction_begin_read_only (gzochid_storage_context *context)
+{
+  return transaction_begin_flags
+    (context, settings.snapshot_reads ? DB_TXN_SNAPSHOT : 0);
+}
+
+/* Read-only transactions are only serviced from a snapshot if multi-version
+   concurrency control has been enabled; otherwise they take read locks. */
+
+static gboolean
+context_snapshot_reads (gzochid_storage_context *context)
+{
+  return settings.snapshot_reads;
+}
+
 static gzochid_storage_transaction *
 transaction_begin_timed (gzochid_storage_context *context, 
 			 struct timeval timeout)
@@ -322,6 +549,61 @@ transaction_put (gzochid_storage_transaction *tx, gzochid_storage_store *store,
     }
 }
 
+/* Stores the specified pairs via a single bulk `DB->put' call, from a buffer
+   in `DB_MULTIPLE_KEY' format. Note that there is no need to begin bulk load
+   transactions with `DB_TXN_NOSYNC', since the environment is configured with
+   `DB_TXN_WRITE_NOSYNC' and so never flushes the log on commit. */
+
+static void
+transaction_put_bulk (gzochid_storage_transaction *tx,
+		      gzochid_storage_store *store, gzochid_storage_pair *pairs,
+		      size_t num_pairs)
+{
+  DB *db = store->database;
+  DB_TXN *txn = tx->txn;
+  DBT db_key, db_data;
+  size_t i = 0, len = 0;
+  void *ptr = NULL;
+  int ret = 0;
+
+  if (num_pairs == 0)
+    return;
+
+  /* The buffer holds the keys and values, followed by (at the end of the
+     buffer) four 32-bit offsets and lengths per pair, and a terminator. */
+
+  for (; i < num_pairs; i++)
+    len += pairs[i].key_len + pairs[i].value_len;
+  len = (len + sizeof (u_int32_t) - 1) & ~(sizeof (u_int32_t) - 1);
+  len += (4 * num_pairs + 1) * sizeof (u_int32_t);
+
+  memset (&db_key, 0, sizeof (DBT));
+  memset (&db_data, 0, sizeof (DBT));
+
+  db_key.data = malloc (len);
+  db_key.ulen = len;
+  db_key.flags = DB_DBT_USERMEM | DB_DBT_BULK;
+
+  DB_MULTIPLE_WRITE_INIT (ptr, &db_key);
+  for (i = 0; i < num_pairs && ptr != NULL; i++)
+    DB_MULTIPLE_KEY_WRITE_NEXT
+      (ptr, &db_key, pairs[i].key, pairs[i].key_len, pairs[i].value,
+       pairs[i].value_len);
+
+  assert (ptr != NULL);
+  ret = db->put (db, txn, &db_key, &db_data, DB_MULTIPLE_KEY);
+  free (db_key.data);
+
+  if (ret != 0)
+    {
+      g_warning
+	("Failed to store %zu keys in transaction: %s", num_pairs,
+	 db_strerror (ret));
+      tx->rollback = TRUE;
+      tx->should_retry = retryable (ret);
+    }
+}
+
 static int
 transaction_delete (gzochid_storage_transaction *tx, 
 		    gzochid_storage_store *store, char *key, size_t key_len)
@@ -438,6 +720,246 @@ transaction_next_key (gzochid_storage_transaction *tx,
     }
 }
 
+/* The engine-specific state of a cursor. Key-value pairs are read from the 
+   database in bulk, into a buffer, and returned from the buffer one at a 
+   time. */
+
+struct _bdb_cursor
+{
+  DBC *dbc; /* The Berkeley DB cursor. */
+  DBT buffer; /* The bulk read buffer. */
+  void *buffer_ptr; /* The read position in the buffer; `NULL' if empty. */
+
+  char *seek_key; /* The key from which to resume reading, if any. */
+  size_t seek_key_len; /* The length of the seek key. */
+
+  /* Whether the Berkeley DB cursor is positioned at the last key in the 
+     buffer, such that the next bulk read should continue from there. */
+
+  gboolean positioned; 
+  gboolean exhausted; /* Whether the last key has been read. */
+};
+
+typedef struct _bdb_cursor bdb_cursor;
+
+static gzochid_storage_cursor *
+transaction_cursor_open (gzochid_storage_transaction *tx,
+			 gzochid_storage_store *store)
+{
+  DB *db = store->database;
+  gzochid_storage_cursor *cursor = malloc (sizeof (gzochid_storage_cursor));
+  bdb_cursor *bcursor = calloc (1, sizeof (bdb_cursor));
+  int ret = db->cursor (db, tx->txn, &bcursor->dbc, 0);
+
+  if (ret != 0)
+    {
+      g_warning ("Failed to open cursor in transaction: %s", db_strerror (ret));
+      tx->rollback = TRUE;
+      tx->should_retry = retryable (ret);
+
+      bcursor->dbc = NULL;
+      bcursor->exhausted = TRUE;
+    }
+
+  bcursor->buffer.data = malloc (CURSOR_BUFFER_SIZE);
+  bcursor->buffer.ulen = CURSOR_BUFFER_SIZE;
+  bcursor->buffer.flags = DB_DBT_USERMEM;
+  
+  cursor->transaction = tx;
+  cursor->store = store;
+  cursor->cursor = bcursor;
+  
+  return cursor;
+}
+
+static void
+cursor_seek (gzochid_storage_cursor *cursor, char *key, size_t key_len)
+{
+  bdb_cursor *bcursor = cursor->cursor;
+
+  free (bcursor->seek_key);
+  
+  bcursor->seek_key = malloc (sizeof (char) * key_len);
+  bcursor->seek_key_len = key_len;
+  memcpy (bcursor->seek_key, key, key_len);
+  
+  bcursor->buffer_ptr = NULL;
+  bcursor->positioned = FALSE;
+  bcursor->exhausted = bcursor->dbc == NULL;
+}
+
+/* Reads the next block of key-value pairs into the specified cursor's buffer,
+   growing the buffer if it is too small to hold a single pair. Returns `FALSE'
+   if there are no more pairs or the read fails, in which case the transaction 
+   is marked for rollback. */
+
+static gboolean
+fill_cursor (gzochid_storage_cursor *cursor)
+{
+  bdb_cursor *bcursor = cursor->cursor;
+  DBT db_key;
+  u_int32_t flags = DB_MULTIPLE_KEY;
+  int ret = 0;
+
+  memset (&db_key, 0, sizeof (DBT));
+  db_key.flags = DB_DBT_MALLOC;
+
+  if (bcursor->positioned)
+    flags |= DB_NEXT;
+  else if (bcursor->seek_key != NULL)
+    {
+      db_key.data = bcursor->seek_key;
+      db_key.size = bcursor->seek_key_len;
+
+      flags |= DB_SET_RANGE;
+    }
+  else flags |= DB_FIRST;
+
+  while ((ret = bcursor->dbc->get (bcursor->dbc, &db_key, &bcursor->buffer,
+				   flags)) == DB_BUFFER_SMALL)
+    {
+      /* Round the required size up to the next multiple of 1024. */
+      
+      bcursor->buffer.ulen = MAX (bcursor->buffer.ulen * 2,
+				  (bcursor->buffer.size + 1023) & ~1023);
+      bcursor->buffer.data = realloc
+	(bcursor->buffer.data, bcursor->buffer.ulen);
+    }
+
+  if (db_key.data != NULL && db_key.data != bcursor->seek_key)
+    free (db_key.data);
+  
+  if (ret == 0)
+    {
+      DB_MULTIPLE_INIT (bcursor->buffer_ptr, &bcursor->buffer);
+      bcursor->positioned = TRUE;
+
+      return TRUE;
+    }
+  else 
+    {
+      if (ret != DB_NOTFOUND)
+	{
+	  g_warning
+	    ("Failed to advance cursor in transaction: %s", db_strerror (ret));
+	  cursor->transaction->rollback = TRUE;
+	  cursor->transaction->should_retry = retryable (ret);
+	}
+      
+      bcursor->exhausted = TRUE;
+      return FALSE;
+    }
+}
+
+static char *
+cursor_next (gzochid_storage_cursor *cursor, size_t *key_len, char **value,
+	     size_t *value_len)
+{
+  bdb_cursor *bcursor = cursor->cursor;
+
+  while (TRUE)
+    {
+      if (bcursor->buffer_ptr != NULL)
+	{
+	  void *k = NULL, *v = NULL;
+	  u_int32_t k_len = 0, v_len = 0;
+	  
+	  DB_MULTIPLE_KEY_NEXT
+	    (bcursor->buffer_ptr, &bcursor->buffer, k, k_len, v, v_len);
+
+	  if (bcursor->buffer_ptr != NULL)
+	    {
+	      char *ret = malloc (sizeof (char) * k_len);
+	      memcpy (ret, k, k_len);
+	      
+	      if (key_len != NULL)
+		*key_len = k_len;
+	      if (value != NULL)
+		{
+		  *value = malloc (sizeof (char) * v_len);
+		  memcpy (*value, v, v_len);
+		}
+	      if (value_len != NULL)
+		*value_len = v_len;
+
+	      return ret;
+	    }
+	}
+
+      if (bcursor->exhausted || !fill_cursor (cursor))
+	return NULL;
+    }
+}
+
+static void
+cursor_close (gzochid_storage_cursor *cursor)
+{
+  bdb_cursor *bcursor = cursor->cursor;
+
+  if (bcursor->dbc != NULL)
+    bcursor->dbc->close (bcursor->dbc);
+
+  free (bcursor->buffer.data);
+  free (bcursor->seek_key);
+  free (bcursor);
+  free (cursor);
+}
+
+/* Formats the specified statistic and passes it to the specified 
+   `gzochid_storage_stat_func'. */
+
+static void
+report_stat (gzochid_storage_stat_func func, gpointer user_data,
+	     const char *name, guint64 value)
+{
+  gchar *formatted_value = g_strdup_printf ("%" G_GUINT64_FORMAT, value);
+
+  func (name, formatted_value, user_data);
+  g_free (formatted_value);
+}
+
+static void
+context_stats (gzochid_storage_context *context, gzochid_storage_stat_func func,
+	       gpointer user_data)
+{
+  bdb_environment *env = context->environment;
+  DB_MPOOL_STAT *mpool_stat = NULL;
+  DB_LOCK_STAT *lock_stat = NULL;
+
+  if (env->db_env->memp_stat (env->db_env, &mpool_stat, NULL, 0) == 0)
+    {
+      guint64 hits = mpool_stat->st_cache_hit;
+      guint64 misses = mpool_stat->st_cache_miss;
+
+      if (hits + misses > 0)
+	{
+	  gchar *hit_rate = g_strdup_printf
+	    ("%.2f%%", 100.0 * hits / (hits + misses));
+
+	  func ("Cache hit rate", hit_rate, user_data);
+	  g_free (hit_rate);
+	}
+
+      report_stat (func, user_data, "Cache hits", hits);
+      report_stat (func, user_data, "Cache misses", misses);
+
+      free (mpool_stat);
+    }
+
+  if (env->db_env->lock_stat (env->db_env, &lock_stat, 0) == 0)
+    {
+      report_stat (func, user_data, "Lock requests", lock_stat->st_nrequests);
+      report_stat (func, user_data, "Lock waits", lock_stat->st_lock_wait);
+      report_stat (func, user_data, "Deadlocks", lock_stat->st_ndeadlocks);
+      report_stat
+	(func, user_data, "Lock timeouts", lock_stat->st_nlocktimeouts);
+      report_stat
+	(func, user_data, "Transaction timeouts", lock_stat->st_ntxntimeouts);
+
+      free (lock_stat);
+    }
+}
+
 static gzochid_storage_engine_interface interface = 
   {
     "bdb",
@@ -460,7 +982,17 @@ static gzochid_storage_engine_interface interface =
     transaction_put,
     transaction_delete,
     transaction_first_key,
-    transaction_next_key
+    transaction_next_key,
+    transaction_cursor_open,
+    cursor_seek,
+    cursor_next,
+    cursor_close,
+    NULL,
+    transaction_begin_read_only,
+    configure,
+    context_stats,
+    transaction_put_bulk,
+    context_snapshot_reads
   };
   
 GZOCHID_STORAGE_INIT_ENGINE (interface);
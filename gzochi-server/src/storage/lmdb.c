@@ -0,0 +1,1250 @@
+/* lmdb.c: Database storage routines for gzochid (LMDB)
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <lmdb.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../gzochid-storage.h"
+
+/* Each storage context is an LMDB environment, and each store is a named
+   database within that environment. LMDB serves reads directly from a
+   read-only memory map without taking any locks, but permits only a single
+   write transaction at a time. gzochid transactions are long-lived and may be
+   nested (object ids, for example, are allocated in a separate transaction
+   while a task's transaction is open) so holding LMDB's write lock for the
+   lifetime of a gzochid transaction would serialize every task, and could
+   deadlock a thread against itself.
+
+   Instead, a gzochid transaction reads from a read-only LMDB snapshot and
+   buffers its writes in memory. When the transaction is prepared, an LMDB
+   write transaction is started and used to verify that none of the values or
+   key ranges read from the snapshot have changed since the snapshot was taken;
+   the buffered writes are then applied, and the write transaction is
+   committed along with the gzochid transaction. A transaction that fails
+   verification is marked for rollback and retry. Readers never block, and
+   transactions never deadlock. */
+
+/* The size of the memory map, which limits the size of the database. This is
+   reserved address space, not memory; the data file grows as needed. */
+
+#define MAP_SIZE \
+  ((size_t) (sizeof (size_t) > 4 ? (1ULL << 40) : (1ULL << 30)))
+
+/* The maximum number of stores per storage context. */
+
+#define MAX_DBS 32
+
+/* The maximum number of concurrent transactions per storage context. */
+
+#define MAX_READERS 1024
+
+/* The engine-specific state of a store. */
+
+struct _lmdb_store
+{
+  MDB_dbi dbi; /* The LMDB database handle. */
+};
+
+typedef struct _lmdb_store lmdb_store;
+
+/* A read of a range of keys from a transaction's snapshot: the first key
+   following (or equal to, if `inclusive' is `TRUE') a particular key. */
+
+struct _lmdb_range_read
+{
+  GBytes *from; /* The starting key, or `NULL' for the start of the store. */
+  gboolean inclusive; /* Whether `from' itself was a candidate. */
+
+  /* The key that was found, pointing into the memory map; `mv_data' is `NULL'
+     if there was no such key. */
+
+  MDB_val key;
+};
+
+typedef struct _lmdb_range_read lmdb_range_read;
+
+/* The state of a store within a transaction. */
+
+struct _lmdb_transaction_store
+{
+  MDB_dbi dbi; /* The LMDB database handle. */
+
+  /* The values read from the snapshot, as a map of `GBytes' key to `MDB_val'
+     pointing into the memory map. A `mv_data' of `NULL' indicates that the key
+     was not present. */
+
+  GHashTable *reads;
+  GPtrArray *range_reads; /* The key ranges read from the snapshot. */
+
+  /* The buffered writes, as an ordered map of `GBytes' key to `GBytes' value,
+     or to `NULL' for a deletion. */
+
+  GTree *writes;
+
+  /* The pairs stored via `transaction_put_bulk', in the order in which they
+     were stored, as alternating `GBytes' keys and values. */
+
+  GPtrArray *appends;
+};
+
+typedef struct _lmdb_transaction_store lmdb_transaction_store;
+
+/* The engine-specific state of a transaction. */
+
+struct _lmdb_transaction
+{
+  MDB_txn *snapshot; /* The read-only snapshot transaction. */
+  MDB_txn *writer; /* The write transaction, once prepared; else `NULL'. */
+
+  /* The per-store transaction state, keyed on database handle. */
+
+  GHashTable *stores;
+  gint64 deadline; /* The monotonic time limit, or 0 for no limit. */
+  gboolean dirty; /* Whether any writes have been buffered. */
+};
+
+typedef struct _lmdb_transaction lmdb_transaction;
+
+static gint
+compare_bytes (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return g_bytes_compare (a, b);
+}
+
+static void
+unref_nullable_bytes (gpointer data)
+{
+  if (data != NULL)
+    g_bytes_unref (data);
+}
+
+static void
+bytes_to_val (GBytes *bytes, MDB_val *val)
+{
+  gsize size = 0;
+
+  val->mv_data = (void *) g_bytes_get_data (bytes, &size);
+  val->mv_size = size;
+}
+
+/* Compares the specified key to the specified LMDB key, in LMDB's default
+   key order. */
+
+static gint
+compare_key (GBytes *bytes, MDB_val *val)
+{
+  gsize size = 0;
+  gconstpointer data = g_bytes_get_data (bytes, &size);
+  gint ret = memcmp (data, val->mv_data, MIN (size, val->mv_size));
+
+  if (ret != 0)
+    return ret;
+  else return size < val->mv_size ? -1 : size > val->mv_size ? 1 : 0;
+}
+
+static gboolean
+val_equal (MDB_val *a, MDB_val *b)
+{
+  return a->mv_size == b->mv_size
+    && (a->mv_data == b->mv_data
+	|| memcmp (a->mv_data, b->mv_data, a->mv_size) == 0);
+}
+
+/* Returns a copy of the specified data, allocated via `malloc'. */
+
+static char *
+copy_data (const void *data, size_t data_len, size_t *len)
+{
+  char *ret = malloc (sizeof (char) * MAX (data_len, 1));
+
+  memcpy (ret, data, data_len);
+  if (len != NULL)
+    *len = data_len;
+
+  return ret;
+}
+
+static char *
+copy_bytes (GBytes *bytes, size_t *len)
+{
+  gsize size = 0;
+  gconstpointer data = g_bytes_get_data (bytes, &size);
+
+  return copy_data (data, size, len);
+}
+
+static void
+free_range_read (gpointer data)
+{
+  lmdb_range_read *range_read = data;
+
+  if (range_read->from != NULL)
+    g_bytes_unref (range_read->from);
+  free (range_read);
+}
+
+static void
+free_transaction_store (gpointer data)
+{
+  lmdb_transaction_store *tx_store = data;
+
+  g_hash_table_destroy (tx_store->reads);
+  g_ptr_array_free (tx_store->range_reads, TRUE);
+  g_tree_destroy (tx_store->writes);
+  g_ptr_array_free (tx_store->appends, TRUE);
+
+  free (tx_store);
+}
+
+/* Returns the state of the specified store within the specified transaction,
+   creating it if necessary. */
+
+static lmdb_transaction_store *
+transaction_store (lmdb_transaction *txn, gzochid_storage_store *store)
+{
+  lmdb_store *lstore = store->database;
+  lmdb_transaction_store *tx_store = g_hash_table_lookup
+    (txn->stores, GUINT_TO_POINTER (lstore->dbi));
+
+  if (tx_store == NULL)
+    {
+      tx_store = malloc (sizeof (lmdb_transaction_store));
+
+      tx_store->dbi = lstore->dbi;
+      tx_store->reads = g_hash_table_new_full
+	(g_bytes_hash, g_bytes_equal, (GDestroyNotify) g_bytes_unref, free);
+      tx_store->range_reads = g_ptr_array_new_with_free_func (free_range_read);
+      tx_store->writes = g_tree_new_full
+	(compare_bytes, NULL, (GDestroyNotify) g_bytes_unref,
+	 unref_nullable_bytes);
+      tx_store->appends = g_ptr_array_new_with_free_func
+	((GDestroyNotify) g_bytes_unref);
+
+      g_hash_table_insert
+	(txn->stores, GUINT_TO_POINTER (lstore->dbi), tx_store);
+    }
+
+  return tx_store;
+}
+
+/* Returns `TRUE' if the specified transaction has not been marked for rollback
+   nor has exceeded its execution time, `FALSE' otherwise. */
+
+static gboolean
+check_tx (gzochid_storage_transaction *tx)
+{
+  lmdb_transaction *txn = tx->txn;
+
+  if (tx->rollback)
+    return FALSE;
+  else if (txn->deadline > 0 && g_get_monotonic_time () > txn->deadline)
+    {
+      tx->rollback = TRUE;
+      tx->should_retry = TRUE;
+      return FALSE;
+    }
+  else return TRUE;
+}
+
+/* Marks the specified transaction for rollback following an unexpected LMDB
+   error. */
+
+static void
+fail (gzochid_storage_transaction *tx, const char *action, int ret)
+{
+  g_warning ("Failed to %s in transaction: %s", action, mdb_strerror (ret));
+
+  tx->rollback = TRUE;
+  tx->should_retry = FALSE;
+}
+
+static gzochid_storage_context *
+initialize (char *path)
+{
+  MDB_env *env = NULL;
+  gzochid_storage_context *context = NULL;
+  int ret = 0;
+
+  if (g_file_test (path, G_FILE_TEST_EXISTS))
+    {
+      if (!g_file_test (path, G_FILE_TEST_IS_DIR))
+	{
+	  g_warning ("%s is not a directory.", path);
+	  return NULL;
+	}
+    }
+  else
+    {
+      g_message ("LMDB data directory %s does not exist; creating...", path);
+      if (g_mkdir (path, 493) != 0)
+	{
+	  g_warning ("Unable to create LMDB data directory %s.", path);
+	  return NULL;
+	}
+    }
+
+  assert (mdb_env_create (&env) == 0);
+  assert (mdb_env_set_maxdbs (env, MAX_DBS) == 0);
+  assert (mdb_env_set_maxreaders (env, MAX_READERS) == 0);
+  assert (mdb_env_set_mapsize (env, MAP_SIZE) == 0);
+
+  /* Read-only transactions are not bound to threads, since a thread may open a
+     transaction while another is in progress. Like the Berkeley DB engine,
+     commits are written to the operating system but not flushed to disk. */
+
+  ret = mdb_env_open (env, path, MDB_NOTLS | MDB_NOSYNC, 0644);
+  if (ret != 0)
+    {
+      g_warning
+	("Unable to open LMDB environment in %s: %s", path, mdb_strerror (ret));
+      mdb_env_close (env);
+      return NULL;
+    }
+
+  /* Release any reader slots held by processes that exited uncleanly. */
+
+  mdb_reader_check (env, NULL);
+
+  context = calloc (1, sizeof (gzochid_storage_context));
+  context->environment = env;
+
+  return context;
+}
+
+static void
+close_context (gzochid_storage_context *context)
+{
+  MDB_env *env = context->environment;
+
+  mdb_env_sync (env, 1);
+  mdb_env_close (env);
+
+  free (context);
+}
+
+static void
+destroy_context (char *path)
+{
+  gchar *data_filename = g_strconcat (path, "/data.mdb", NULL);
+  gchar *lock_filename = g_strconcat (path, "/lock.mdb", NULL);
+
+  g_remove (data_filename);
+  g_remove (lock_filename);
+
+  g_free (data_filename);
+  g_free (lock_filename);
+
+  assert (g_rmdir (path) == 0);
+}
+
+static gzochid_storage_store *
+open (gzochid_storage_context *context, char *path, unsigned int flags)
+{
+  MDB_env *env = context->environment;
+  MDB_txn *txn = NULL;
+  MDB_dbi dbi = 0;
+  gchar *name = g_path_get_basename (path);
+  gzochid_storage_store *store = NULL;
+  lmdb_store *lstore = NULL;
+  int ret = 0;
+
+  assert (mdb_txn_begin (env, NULL, 0, &txn) == 0);
+
+  if ((flags & GZOCHID_STORAGE_EXCL) && mdb_dbi_open (txn, name, 0, &dbi) == 0)
+    ret = MDB_KEYEXIST;
+  else ret = mdb_dbi_open
+	 (txn, name, flags & GZOCHID_STORAGE_CREATE ? MDB_CREATE : 0, &dbi);
+
+  if (ret == 0)
+    ret = mdb_txn_commit (txn);
+  else mdb_txn_abort (txn);
+
+  if (ret != 0)
+    {
+      g_warning
+	("Unable to open LMDB database %s: %s", name, mdb_strerror (ret));
+      g_free (name);
+      return NULL;
+    }
+
+  store = calloc (1, sizeof (gzochid_storage_store));
+  lstore = malloc (sizeof (lmdb_store));
+
+  lstore->dbi = dbi;
+  store->database = lstore;
+  store->context = context;
+
+  g_free (name);
+
+  return store;
+}
+
+static void
+close_store (gzochid_storage_store *store)
+{
+  /* LMDB database handles are shared by the environment and are released when
+     it is closed. */
+
+  free (store->database);
+  free (store);
+}
+
+static void
+destroy_store (gzochid_storage_context *context, char *path)
+{
+  MDB_env *env = context->environment;
+  MDB_txn *txn = NULL;
+  MDB_dbi dbi = 0;
+  gchar *name = g_path_get_basename (path);
+
+  assert (mdb_txn_begin (env, NULL, 0, &txn) == 0);
+
+  if (mdb_dbi_open (txn, name, 0, &dbi) == 0
+      && mdb_drop (txn, dbi, 1) == 0)
+    mdb_txn_commit (txn);
+  else mdb_txn_abort (txn);
+
+  g_free (name);
+}
+
+static gzochid_storage_transaction *
+transaction_begin (gzochid_storage_context *context)
+{
+  MDB_env *env = context->environment;
+  gzochid_storage_transaction *transaction =
+    calloc (1, sizeof (gzochid_storage_transaction));
+  lmdb_transaction *txn = calloc (1, sizeof (lmdb_transaction));
+  int ret = mdb_txn_begin (env, NULL, MDB_RDONLY, &txn->snapshot);
+
+  txn->stores = g_hash_table_new_full
+    (g_direct_hash, g_direct_equal, NULL, free_transaction_store);
+
+  transaction->context = context;
+  transaction->txn = txn;
+
+  if (ret != 0)
+    {
+      /* Most likely all of the reader slots are in use. */
+
+      txn->snapshot = NULL;
+      fail (transaction, "begin", ret);
+      transaction->should_retry = TRUE;
+    }
+
+  return transaction;
+}
+
+static gzochid_storage_transaction *
+transaction_begin_timed (gzochid_storage_context *context,
+			 struct timeval timeout)
+{
+  gzochid_storage_transaction *transaction = transaction_begin (context);
+  lmdb_transaction *txn = transaction->txn;
+  gint64 t = timeout.tv_usec + timeout.tv_sec * G_USEC_PER_SEC;
+
+  assert (t > 0);
+
+  txn->deadline = g_get_monotonic_time () + t;
+
+  return transaction;
+}
+
+static void
+free_transaction (gzochid_storage_transaction *tx)
+{
+  lmdb_transaction *txn = tx->txn;
+
+  if (txn->writer != NULL)
+    mdb_txn_abort (txn->writer);
+  if (txn->snapshot != NULL)
+    mdb_txn_abort (txn->snapshot);
+
+  g_hash_table_destroy (txn->stores);
+
+  free (txn);
+  free (tx);
+}
+
+/* Returns `TRUE' if none of the values or key ranges in the specified store
+   that were read by a transaction have been modified by the transactions
+   committed since its snapshot was taken, `FALSE' otherwise. */
+
+static gboolean
+validate_store (MDB_txn *writer, lmdb_transaction_store *tx_store)
+{
+  GHashTableIter iter;
+  gpointer key = NULL, value = NULL;
+  MDB_cursor *cursor = NULL;
+  guint i = 0;
+
+  g_hash_table_iter_init (&iter, tx_store->reads);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      MDB_val *read = value;
+      MDB_val k, v;
+      int ret = 0;
+
+      bytes_to_val (key, &k);
+      ret = mdb_get (writer, tx_store->dbi, &k, &v);
+
+      if (ret == MDB_NOTFOUND)
+	{
+	  if (read->mv_data != NULL)
+	    return FALSE;
+	}
+      else if (ret != 0 || read->mv_data == NULL || !val_equal (read, &v))
+	return FALSE;
+    }
+
+  if (tx_store->range_reads->len == 0)
+    return TRUE;
+  if (mdb_cursor_open (writer, tx_store->dbi, &cursor) != 0)
+    return FALSE;
+
+  for (; i < tx_store->range_reads->len; i++)
+    {
+      lmdb_range_read *range_read =
+	g_ptr_array_index (tx_store->range_reads, i);
+      MDB_val k, v;
+      int ret = 0;
+
+      if (range_read->from == NULL || g_bytes_get_size (range_read->from) == 0)
+	ret = mdb_cursor_get (cursor, &k, &v, MDB_FIRST);
+      else
+	{
+	  bytes_to_val (range_read->from, &k);
+	  ret = mdb_cursor_get (cursor, &k, &v, MDB_SET_RANGE);
+
+	  if (ret == 0 && !range_read->inclusive
+	      && compare_key (range_read->from, &k) == 0)
+	    ret = mdb_cursor_get (cursor, &k, &v, MDB_NEXT);
+	}
+
+      if (ret == MDB_NOTFOUND)
+	{
+	  if (range_read->key.mv_data != NULL)
+	    break;
+	}
+      else if (ret != 0 || range_read->key.mv_data == NULL
+	       || !val_equal (&range_read->key, &k))
+	break;
+    }
+
+  mdb_cursor_close (cursor);
+  return i == tx_store->range_reads->len;
+}
+
+struct _write_state
+{
+  MDB_txn *writer;
+  MDB_dbi dbi;
+  int ret;
+};
+
+typedef struct _write_state write_state;
+
+/* A `GTraverseFunc' that applies a buffered write to an LMDB write
+   transaction. */
+
+static gboolean
+apply_write (gpointer key, gpointer value, gpointer user_data)
+{
+  write_state *state = user_data;
+  MDB_val k, v;
+
+  bytes_to_val (key, &k);
+
+  if (value == NULL)
+    {
+      state->ret = mdb_del (state->writer, state->dbi, &k, NULL);
+      if (state->ret == MDB_NOTFOUND)
+	state->ret = 0;
+    }
+  else
+    {
+      bytes_to_val (value, &v);
+      state->ret = mdb_put (state->writer, state->dbi, &k, &v, 0);
+    }
+
+  return state->ret != 0;
+}
+
+/* Applies the pairs stored via `transaction_put_bulk' to an LMDB write
+   transaction. Each pair is appended to the end of the database if its key
+   follows the last key in the database, which is much cheaper than an
+   ordinary insertion, and is inserted normally otherwise. Returns 0 on 
+   success, or an LMDB error code. */
+
+static int
+apply_appends (MDB_txn *writer, lmdb_transaction_store *tx_store)
+{
+  guint i = 0;
+
+  for (; i + 1 < tx_store->appends->len; i += 2)
+    {
+      MDB_val k, v;
+      int ret = 0;
+
+      bytes_to_val (g_ptr_array_index (tx_store->appends, i), &k);
+      bytes_to_val (g_ptr_array_index (tx_store->appends, i + 1), &v);
+
+      ret = mdb_put (writer, tx_store->dbi, &k, &v, MDB_APPEND);
+      if (ret == MDB_KEYEXIST)
+	ret = mdb_put (writer, tx_store->dbi, &k, &v, 0);
+      if (ret != 0)
+	return ret;
+    }
+
+  return 0;
+}
+
+static void
+transaction_prepare (gzochid_storage_transaction *tx)
+{
+  lmdb_transaction *txn = tx->txn;
+  MDB_env *env = tx->context->environment;
+  GHashTableIter iter;
+  gpointer value = NULL;
+  int ret = 0;
+
+  /* A transaction that has not written anything has seen a consistent snapshot
+     of the database, and requires no validation. */
+
+  if (!check_tx (tx) || !txn->dirty || txn->writer != NULL)
+    return;
+
+  ret = mdb_txn_begin (env, NULL, 0, &txn->writer);
+  if (ret != 0)
+    {
+      txn->writer = NULL;
+      fail (tx, "begin write", ret);
+      return;
+    }
+
+  g_hash_table_iter_init (&iter, txn->stores);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    if (!validate_store (txn->writer, value))
+      {
+	tx->rollback = TRUE;
+	tx->should_retry = TRUE;
+	return;
+      }
+
+  /* The snapshot (and the read records that point into it) are no longer
+     needed. */
+
+  mdb_txn_abort (txn->snapshot);
+  txn->snapshot = NULL;
+
+  g_hash_table_iter_init (&iter, txn->stores);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      lmdb_transaction_store *tx_store = value;
+      write_state state = { txn->writer, tx_store->dbi, 0 };
+
+      g_tree_foreach (tx_store->writes, apply_write, &state);
+      if (state.ret == 0)
+	state.ret = apply_appends (txn->writer, tx_store);
+      if (state.ret != 0)
+	{
+	  fail (tx, "apply writes", state.ret);
+	  return;
+	}
+    }
+}
+
+static void
+transaction_commit (gzochid_storage_transaction *tx)
+{
+  lmdb_transaction *txn = tx->txn;
+
+  if (txn->dirty && txn->writer == NULL)
+    transaction_prepare (tx);
+
+  if (txn->writer != NULL && !tx->rollback)
+    {
+      int ret = mdb_txn_commit (txn->writer);
+
+      txn->writer = NULL;
+      if (ret != 0)
+	g_warning ("Failed to commit transaction: %s", mdb_strerror (ret));
+    }
+  else if (txn->dirty)
+    g_warning ("Discarding writes from failed transaction.");
+
+  free_transaction (tx);
+}
+
+static void
+transaction_rollback (gzochid_storage_transaction *tx)
+{
+  free_transaction (tx);
+}
+
+/* Records the result of a read of the specified key from the snapshot of the
+   specified store. */
+
+static void
+record_read (lmdb_transaction_store *tx_store, const void *key, size_t key_len,
+	     MDB_val *value)
+{
+  MDB_val *read = malloc (sizeof (MDB_val));
+
+  *read = *value;
+  g_hash_table_insert (tx_store->reads, g_bytes_new (key, key_len), read);
+}
+
+/* Looks up the specified key in the transaction's snapshot of the specified
+   store and records the read. Returns 0 or `MDB_NOTFOUND' (in which case the
+   `mv_data' field of `value' is set to `NULL') on success, or an LMDB error
+   code. */
+
+static int
+snapshot_get (lmdb_transaction *txn, lmdb_transaction_store *tx_store,
+	      char *key, size_t key_len, MDB_val *value)
+{
+  MDB_val k;
+  int ret = 0;
+
+  k.mv_data = key;
+  k.mv_size = key_len;
+
+  ret = mdb_get (txn->snapshot, tx_store->dbi, &k, value);
+  if (ret == MDB_NOTFOUND)
+    {
+      value->mv_data = NULL;
+      value->mv_size = 0;
+    }
+  if (ret == 0 || ret == MDB_NOTFOUND)
+    record_read (tx_store, key, key_len, value);
+
+  return ret;
+}
+
+/* Finds the first key in the transaction's snapshot of the specified store
+   that follows (or is equal to, if `inclusive' is `TRUE') the specified key,
+   using the specified LMDB cursor (or a temporary cursor, if `NULL'), and
+   records the read. Returns 0 or `MDB_NOTFOUND' (in which case the `mv_data'
+   field of `key' is set to `NULL') on success, or an LMDB error code. */
+
+static int
+snapshot_next (lmdb_transaction *txn, lmdb_transaction_store *tx_store,
+	       MDB_cursor *cursor, GBytes *from, gboolean inclusive,
+	       MDB_val *key, MDB_val *value)
+{
+  MDB_cursor *temp_cursor = NULL;
+  gsize from_len = 0;
+  gconstpointer from_data = NULL;
+  int ret = 0;
+
+  if (cursor == NULL)
+    {
+      ret = mdb_cursor_open (txn->snapshot, tx_store->dbi, &temp_cursor);
+      if (ret != 0)
+	return ret;
+
+      cursor = temp_cursor;
+    }
+
+  if (from != NULL)
+    from_data = g_bytes_get_data (from, &from_len);
+
+  /* LMDB does not permit zero-length keys, so every key follows the empty
+     key. */
+
+  if (from_len == 0)
+    ret = mdb_cursor_get (cursor, key, value, MDB_FIRST);
+  else
+    {
+      key->mv_data = (void *) from_data;
+      key->mv_size = from_len;
+
+      ret = mdb_cursor_get (cursor, key, value, MDB_SET_RANGE);
+      if (ret == 0 && !inclusive && compare_key (from, key) == 0)
+	ret = mdb_cursor_get (cursor, key, value, MDB_NEXT);
+    }
+
+  if (temp_cursor != NULL)
+    mdb_cursor_close (temp_cursor);
+
+  if (ret == MDB_NOTFOUND)
+    {
+      key->mv_data = NULL;
+      key->mv_size = 0;
+    }
+  if (ret == 0 || ret == MDB_NOTFOUND)
+    {
+      lmdb_range_read *range_read = malloc (sizeof (lmdb_range_read));
+
+      range_read->from = from == NULL ? NULL : g_bytes_new
+	(from_data, from_len);
+      range_read->inclusive = inclusive;
+      range_read->key = *key;
+
+      g_ptr_array_add (tx_store->range_reads, range_read);
+    }
+
+  return ret;
+}
+
+/* The state of a search for the first buffered write following a key. */
+
+struct _write_search
+{
+  GBytes *from; /* The key to search from, or `NULL' to find the first key. */
+  gboolean inclusive; /* Whether `from' itself is a candidate. */
+
+  gboolean found; /* Whether a buffered write was found. */
+  GBytes *key; /* The key of the write that was found. */
+  GBytes *value; /* The value of the write; `NULL' for a deletion. */
+};
+
+typedef struct _write_search write_search;
+
+/* A `GTraverseFunc' that stops at the first buffered write that satisfies a
+   `write_search'. */
+
+static gboolean
+find_write (gpointer key, gpointer value, gpointer user_data)
+{
+  write_search *search = user_data;
+  gint c = search->from == NULL ? 1 : g_bytes_compare (key, search->from);
+
+  if (c > 0 || (c == 0 && search->inclusive))
+    {
+      search->found = TRUE;
+      search->key = key;
+      search->value = value;
+
+      return TRUE;
+    }
+  else return FALSE;
+}
+
+/* Finds the first key visible to the specified transaction in the specified
+   store that follows (or is equal to, if `inclusive' is `TRUE') the specified
+   key, merging the snapshot with the transaction's buffered writes. Returns
+   `TRUE' and sets `key' and `value' (if non-`NULL') to `GBytes' that should be
+   released via `g_bytes_unref' if such a key exists; returns `FALSE' if there
+   is no such key, or if the read fails, in which case the transaction is
+   marked for rollback. The returned key and value may point into the memory
+   map, and so must not be used after the snapshot is released. */
+
+static gboolean
+next_visible (gzochid_storage_transaction *tx,
+	      lmdb_transaction_store *tx_store, MDB_cursor *cursor,
+	      GBytes *from, gboolean inclusive, GBytes **key, GBytes **value)
+{
+  lmdb_transaction *txn = tx->txn;
+  GBytes *position = from == NULL ? NULL : g_bytes_ref (from);
+  gboolean ret = FALSE;
+
+  while (TRUE)
+    {
+      MDB_val k, v;
+      write_search search;
+      int mdb_ret = snapshot_next
+	(txn, tx_store, cursor, position, inclusive, &k, &v);
+
+      if (mdb_ret != 0 && mdb_ret != MDB_NOTFOUND)
+	{
+	  fail (tx, "advance cursor", mdb_ret);
+	  break;
+	}
+
+      memset (&search, 0, sizeof (write_search));
+      search.from = position;
+      search.inclusive = inclusive;
+      g_tree_foreach (tx_store->writes, find_write, &search);
+
+      if (search.found
+	  && (k.mv_data == NULL || compare_key (search.key, &k) <= 0))
+	{
+	  if (search.value == NULL)
+	    {
+	      /* The key has been deleted by this transaction; skip past it. */
+
+	      if (position != NULL)
+		g_bytes_unref (position);
+
+	      position = g_bytes_ref (search.key);
+	      inclusive = FALSE;
+	      continue;
+	    }
+
+	  *key = g_bytes_ref (search.key);
+	  if (value != NULL)
+	    *value = g_bytes_ref (search.value);
+
+	  ret = TRUE;
+	}
+      else if (k.mv_data != NULL)
+	{
+	  *key = g_bytes_new_static (k.mv_data, k.mv_size);
+	  if (value != NULL)
+	    {
+	      record_read (tx_store, k.mv_data, k.mv_size, &v);
+	      *value = g_bytes_new_static (v.mv_data, v.mv_size);
+	    }
+
+	  ret = TRUE;
+	}
+
+      break;
+    }
+
+  if (position != NULL)
+    g_bytes_unref (position);
+
+  return ret;
+}
+
+static char *
+transaction_get (gzochid_storage_transaction *tx, gzochid_storage_store *store,
+		 char *key, size_t key_len, size_t *len)
+{
+  lmdb_transaction *txn = tx->txn;
+  lmdb_transaction_store *tx_store = NULL;
+  GBytes *lookup_key = NULL;
+  gpointer written = NULL;
+  gboolean was_written = FALSE;
+  MDB_val value;
+  int ret = 0;
+
+  if (!check_tx (tx))
+    return NULL;
+
+  tx_store = transaction_store (txn, store);
+  lookup_key = g_bytes_new_static (key, key_len);
+  was_written = g_tree_lookup_extended
+    (tx_store->writes, lookup_key, NULL, &written);
+  g_bytes_unref (lookup_key);
+
+  if (was_written)
+    return written == NULL ? NULL : copy_bytes (written, len);
+
+  ret = snapshot_get (txn, tx_store, key, key_len, &value);
+  if (ret == 0)
+    return copy_data (value.mv_data, value.mv_size, len);
+  else
+    {
+      if (ret != MDB_NOTFOUND)
+	fail (tx, "retrieve key", ret);
+      return NULL;
+    }
+}
+
+/* Reads are validated when the transaction is prepared, so there is no need to
+   lock keys that are to be updated. */
+
+static char *
+transaction_get_for_update (gzochid_storage_transaction *tx,
+			    gzochid_storage_store *store, char *key,
+			    size_t key_len, size_t *len)
+{
+  return transaction_get (tx, store, key, key_len, len);
+}
+
+static void
+transaction_put (gzochid_storage_transaction *tx, gzochid_storage_store *store,
+		 char *key, size_t key_len, char *data, size_t data_len)
+{
+  lmdb_transaction *txn = tx->txn;
+  lmdb_transaction_store *tx_store = NULL;
+
+  if (!check_tx (tx))
+    return;
+
+  tx_store = transaction_store (txn, store);
+  g_tree_replace (tx_store->writes, g_bytes_new (key, key_len),
+		  g_bytes_new (data, data_len));
+
+  txn->dirty = TRUE;
+}
+
+/* Buffers the specified pairs for application at commit time, without the
+   per-key bookkeeping of `transaction_put', since bulk-loaded pairs need not
+   be visible to the transaction's subsequent reads. */
+
+static void
+transaction_put_bulk (gzochid_storage_transaction *tx,
+		      gzochid_storage_store *store, gzochid_storage_pair *pairs,
+		      size_t num_pairs)
+{
+  lmdb_transaction *txn = tx->txn;
+  lmdb_transaction_store *tx_store = NULL;
+  size_t i = 0;
+
+  if (!check_tx (tx))
+    return;
+
+  tx_store = transaction_store (txn, store);
+
+  for (; i < num_pairs; i++)
+    {
+      g_ptr_array_add
+	(tx_store->appends, g_bytes_new (pairs[i].key, pairs[i].key_len));
+      g_ptr_array_add
+	(tx_store->appends, g_bytes_new (pairs[i].value, pairs[i].value_len));
+    }
+
+  txn->dirty = TRUE;
+}
+
+static int
+transaction_delete (gzochid_storage_transaction *tx,
+		    gzochid_storage_store *store, char *key, size_t key_len)
+{
+  lmdb_transaction *txn = tx->txn;
+  lmdb_transaction_store *tx_store = NULL;
+  GBytes *lookup_key = NULL;
+  gpointer written = NULL;
+  gboolean exists = FALSE;
+
+  if (!check_tx (tx))
+    return GZOCHID_STORAGE_ETXFAILURE;
+
+  tx_store = transaction_store (txn, store);
+  lookup_key = g_bytes_new_static (key, key_len);
+
+  if (g_tree_lookup_extended (tx_store->writes, lookup_key, NULL, &written))
+    exists = written != NULL;
+  else
+    {
+      MDB_val value;
+      int ret = snapshot_get (txn, tx_store, key, key_len, &value);
+
+      if (ret != 0 && ret != MDB_NOTFOUND)
+	{
+	  g_bytes_unref (lookup_key);
+	  fail (tx, "delete key", ret);
+	  return GZOCHID_STORAGE_ETXFAILURE;
+	}
+
+      exists = ret == 0;
+    }
+
+  g_bytes_unref (lookup_key);
+
+  if (!exists)
+    return GZOCHID_STORAGE_ENOTFOUND;
+
+  g_tree_replace (tx_store->writes, g_bytes_new (key, key_len), NULL);
+  txn->dirty = TRUE;
+
+  return 0;
+}
+
+static char *
+next_key (gzochid_storage_transaction *tx, gzochid_storage_store *store,
+	  GBytes *from, size_t *len)
+{
+  GBytes *key = NULL;
+  char *ret = NULL;
+
+  if (!check_tx (tx))
+    return NULL;
+
+  if (next_visible (tx, transaction_store (tx->txn, store), NULL, from, FALSE,
+		    &key, NULL))
+    {
+      ret = copy_bytes (key, len);
+      g_bytes_unref (key);
+    }
+
+  return ret;
+}
+
+static char *
+transaction_first_key (gzochid_storage_transaction *tx,
+		       gzochid_storage_store *store, size_t *len)
+{
+  return next_key (tx, store, NULL, len);
+}
+
+static char *
+transaction_next_key (gzochid_storage_transaction *tx,
+		      gzochid_storage_store *store, char *key, size_t key_len,
+		      size_t *len)
+{
+  GBytes *from = g_bytes_new_static (key, key_len);
+  char *ret = next_key (tx, store, from, len);
+
+  g_bytes_unref (from);
+  return ret;
+}
+
+/* The engine-specific state of a cursor. */
+
+struct _lmdb_cursor
+{
+  MDB_cursor *cursor; /* The LMDB cursor on the transaction's snapshot. */
+
+  /* The key from which to resume reading, or `NULL' for the first key. */
+
+  GBytes *position;
+  gboolean inclusive; /* Whether the position key itself may be read. */
+  gboolean exhausted; /* Whether the last key has been read. */
+};
+
+typedef struct _lmdb_cursor lmdb_cursor;
+
+static gzochid_storage_cursor *
+transaction_cursor_open (gzochid_storage_transaction *tx,
+			 gzochid_storage_store *store)
+{
+  lmdb_transaction *txn = tx->txn;
+  lmdb_store *lstore = store->database;
+  gzochid_storage_cursor *cursor = malloc (sizeof (gzochid_storage_cursor));
+  lmdb_cursor *lcursor = calloc (1, sizeof (lmdb_cursor));
+
+  if (check_tx (tx))
+    {
+      int ret = mdb_cursor_open (txn->snapshot, lstore->dbi, &lcursor->cursor);
+
+      if (ret != 0)
+	{
+	  fail (tx, "open cursor", ret);
+	  lcursor->cursor = NULL;
+	}
+    }
+
+  lcursor->exhausted = lcursor->cursor == NULL;
+
+  cursor->transaction = tx;
+  cursor->store = store;
+  cursor->cursor = lcursor;
+
+  return cursor;
+}
+
+static void
+cursor_seek (gzochid_storage_cursor *cursor, char *key, size_t key_len)
+{
+  lmdb_cursor *lcursor = cursor->cursor;
+
+  if (lcursor->position != NULL)
+    g_bytes_unref (lcursor->position);
+
+  lcursor->position = g_bytes_new (key, key_len);
+  lcursor->inclusive = TRUE;
+  lcursor->exhausted = lcursor->cursor == NULL;
+}
+
+static char *
+cursor_next (gzochid_storage_cursor *cursor, size_t *key_len, char **value,
+	     size_t *value_len)
+{
+  lmdb_cursor *lcursor = cursor->cursor;
+  gzochid_storage_transaction *tx = cursor->transaction;
+  GBytes *key = NULL, *data = NULL;
+  char *ret = NULL;
+
+  if (lcursor->exhausted || !check_tx (tx))
+    return NULL;
+
+  if (!next_visible (tx, transaction_store (tx->txn, cursor->store),
+		     lcursor->cursor, lcursor->position, lcursor->inclusive,
+		     &key, &data))
+    {
+      lcursor->exhausted = TRUE;
+      return NULL;
+    }
+
+  ret = copy_bytes (key, key_len);
+  if (value != NULL)
+    *value = copy_bytes (data, value_len);
+
+  /* The key may point into the memory map, which remains valid for as long as
+     the cursor is open. */
+
+  if (lcursor->position != NULL)
+    g_bytes_unref (lcursor->position);
+
+  lcursor->position = key;
+  lcursor->inclusive = FALSE;
+
+  g_bytes_unref (data);
+
+  return ret;
+}
+
+static void
+cursor_close (gzochid_storage_cursor *cursor)
+{
+  lmdb_cursor *lcursor = cursor->cursor;
+
+  if (lcursor->cursor != NULL)
+    mdb_cursor_close (lcursor->cursor);
+  if (lcursor->position != NULL)
+    g_bytes_unref (lcursor->position);
+
+  free (lcursor);
+  free (cursor);
+}
+
+/* Every transaction reads from an LMDB snapshot, so a long-running read-only
+   transaction never holds up writers. */
+
+static gboolean
+context_snapshot_reads (gzochid_storage_context *context)
+{
+  return TRUE;
+}
+
+static gzochid_storage_engine_interface interface =
+  {
+    "lmdb",
+
+    initialize,
+    close_context,
+    destroy_context,
+    open,
+    close_store,
+    destroy_store,
+
+    transaction_begin,
+    transaction_begin_timed,
+    transaction_commit,
+    transaction_rollback,
+    transaction_prepare,
+
+    transaction_get,
+    transaction_get_for_update,
+    transaction_put,
+    transaction_delete,
+    transaction_first_key,
+    transaction_next_key,
+    transaction_cursor_open,
+    cursor_seek,
+    cursor_next,
+    cursor_close,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    transaction_put_bulk,
+    context_snapshot_reads
+  };
+
+GZOCHID_STORAGE_INIT_ENGINE (interface);
@@ -144,7 +144,7 @@ gzochid_tool_probe_storage_engine (GHashTable *gzochid_conf, char *name)
 
   /* Attempt to load the engine. */
 
-  engine = gzochid_storage_load_engine (dir, engine_name);
+  engine = gzochid_storage_load_engine (dir, engine_name, gzochid_conf);
 
   if (engine == NULL)
     {
@@ -49,6 +49,10 @@
        (or (hashtable-ref oids->records (gzochi:managed-reference-oid ref) #f)
 	   (raise (gzochi:make-object-removed-condition)))))
 
+    (variable-set!
+     (module-variable gzochi-private-data 'primitive-prefetch)
+     (lambda (oids) (if #f #f)))
+
     (variable-set!
      (module-variable gzochi-private-data 'primitive-mark-for-write!)
      (lambda (record) (if #f #f)))
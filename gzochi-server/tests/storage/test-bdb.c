@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <glib.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -68,6 +69,32 @@ test_storage_fixture_setup
   fixture->context = engine.interface->initialize (fixture->dir);
 }
 
+static void 
+test_storage_fixture_setup_snapshot
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine engine;
+  gint (*initializer) (gzochid_storage_engine *);
+  GHashTable *config = g_hash_table_new (g_str_hash, g_str_equal);
+  
+  GModule *module = g_module_open 
+    (QUOTE (BDB_MODULE_LOCATION), G_MODULE_BIND_LOCAL);
+
+  g_assert (module != NULL);
+  g_assert (g_module_symbol (module, "gzochid_storage_init_engine", 
+			     (gpointer *) &initializer));
+  initializer (&engine);
+
+  g_hash_table_insert (config, "storage.bdb.snapshot.enabled", "true");
+  g_hash_table_insert (config, "storage.bdb.checkpoint.interval.sec", "1");
+  engine.interface->configure (config);
+  g_hash_table_destroy (config);
+  
+  fixture->dir = g_dir_make_tmp (NULL, NULL);
+  fixture->bdb_interface = engine.interface;
+  fixture->context = engine.interface->initialize (fixture->dir);
+}
+
 static void
 test_storage_fixture_teardown
 (struct test_storage_fixture *fixture, gconstpointer user_data)
@@ -115,6 +142,215 @@ test_storage_open_excl
   g_free (db);
 }
 
+static void
+test_storage_snapshot_read
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine_interface *iface = fixture->bdb_interface;
+  gchar *db = g_strconcat (fixture->dir, "/oids", NULL);
+  gzochid_storage_store *store = iface->open 
+    (fixture->context, db, GZOCHID_STORAGE_CREATE);
+  gzochid_storage_transaction *tx1 = iface->transaction_begin
+    (fixture->context);
+  gzochid_storage_transaction *tx2 = NULL;
+
+  iface->transaction_put (tx1, store, "foo", 4, "bar", 4);
+
+  /* The read-only transaction does not wait for the write lock held by the
+     first transaction. */
+  
+  tx2 = iface->transaction_begin_read_only (fixture->context);
+  g_assert (iface->transaction_get (tx2, store, "foo", 4, NULL) == NULL);
+  g_assert (!tx2->rollback);
+  iface->transaction_rollback (tx2);
+
+  iface->transaction_commit (tx1);
+  
+  iface->close_store (store);
+  iface->destroy_store (fixture->context, db);
+  g_free (db);
+}
+
+static void
+test_storage_cursor
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  int i = 0;
+  char key[9], value[256], *large_value = NULL;
+
+  char *k = NULL, *v = NULL;
+  size_t k_len = 0, v_len = 0;
+  gzochid_storage_engine_interface *iface = fixture->bdb_interface;
+  gchar *db = g_strconcat (fixture->dir, "/oids", NULL);
+  gzochid_storage_store *store = iface->open 
+    (fixture->context, db, GZOCHID_STORAGE_CREATE);
+  gzochid_storage_transaction *tx = iface->transaction_begin
+    (fixture->context);
+  gzochid_storage_cursor *cursor = NULL;
+
+  /* Enough data to require several refills of the cursor's 64k bulk read 
+     buffer, plus one value too large to fit in it at all. */
+  
+  memset (value, 'x', 256);
+  for (; i < 999; i++)
+    {
+      sprintf (key, "key-%04d", i);
+      iface->transaction_put (tx, store, key, 9, value, 256);
+    }
+
+  large_value = calloc (128 * 1024, sizeof (char));
+  iface->transaction_put (tx, store, "key-0999", 9, large_value, 128 * 1024);
+  free (large_value);
+  
+  iface->transaction_commit (tx);
+  tx = iface->transaction_begin (fixture->context);
+  cursor = iface->transaction_cursor_open (tx, store);
+
+  for (i = 0; (k = iface->cursor_next (cursor, &k_len, &v, &v_len)) != NULL;
+       i++)
+    {
+      sprintf (key, "key-%04d", i);
+
+      g_assert_cmpstr (k, ==, key);
+      g_assert_cmpint (k_len, ==, 9);
+      g_assert_cmpint (v_len, ==, i < 999 ? 256 : 128 * 1024);
+
+      free (k);
+      free (v);
+    }
+
+  g_assert_cmpint (i, ==, 1000);
+  g_assert (!tx->rollback);
+
+  /* Seeking between keys positions the cursor at the next key. */
+  
+  iface->cursor_seek (cursor, "key-0500", 8);
+  k = iface->cursor_next (cursor, NULL, NULL, NULL);
+
+  g_assert_cmpstr (k, ==, "key-0500");
+  free (k);
+
+  /* Seeking to a key with a NUL byte appended skips past the key. */
+  
+  iface->cursor_seek (cursor, "key-0500\0", 10);
+  k = iface->cursor_next (cursor, NULL, NULL, NULL);
+
+  g_assert_cmpstr (k, ==, "key-0501");
+  free (k);
+
+  /* The cursor keeps reading past the end of the seek's first buffer. */
+  
+  for (i = 502; (k = iface->cursor_next (cursor, NULL, NULL, NULL)) != NULL;
+       i++)
+    {
+      sprintf (key, "key-%04d", i);
+      g_assert_cmpstr (k, ==, key);
+      free (k);
+    }
+
+  g_assert_cmpint (i, ==, 1000);
+
+  iface->cursor_seek (cursor, "zzz", 4);
+  g_assert (iface->cursor_next (cursor, NULL, NULL, NULL) == NULL);
+  g_assert (!tx->rollback);
+  
+  iface->cursor_close (cursor);
+  iface->transaction_rollback (tx);
+
+  iface->close_store (store);
+  iface->destroy_store (fixture->context, db);
+  g_free (db);
+}
+
+static void
+test_storage_transaction_put_bulk
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  int i = 0;
+  char *keys = malloc (sizeof (char) * 9 * 1000), value[256];
+  char *k = NULL, *v = NULL;
+  size_t v_len = 0;
+
+  gzochid_storage_engine_interface *iface = fixture->bdb_interface;
+  gchar *db = g_strconcat (fixture->dir, "/oids", NULL);
+  gzochid_storage_store *store = iface->open 
+    (fixture->context, db, GZOCHID_STORAGE_CREATE);
+  gzochid_storage_transaction *tx = iface->transaction_begin
+    (fixture->context);
+  gzochid_storage_cursor *cursor = NULL;
+  gzochid_storage_pair *pairs = malloc (sizeof (gzochid_storage_pair) * 1000);
+
+  iface->transaction_put (tx, store, "key-0500", 9, "old", 4);
+  iface->transaction_commit (tx);
+
+  /* Enough pairs to fill a bulk buffer much larger than a single page, in 
+     ascending order except for the last, which precedes all the others. One
+     of the pairs overwrites the existing key. */
+  
+  memset (value, 'x', 256);
+  for (; i < 1000; i++)
+    {
+      sprintf (keys + i * 9, "key-%04d", i == 999 ? 0 : i + 1);
+
+      pairs[i].key = keys + i * 9;
+      pairs[i].key_len = 9;
+      pairs[i].value = value;
+      pairs[i].value_len = 256;
+    }
+
+  tx = iface->transaction_begin (fixture->context);
+  iface->transaction_put_bulk (tx, store, pairs, 1000);
+  g_assert (!tx->rollback);
+  iface->transaction_commit (tx);
+
+  free (pairs);
+  free (keys);
+  
+  tx = iface->transaction_begin (fixture->context);
+
+  v = iface->transaction_get (tx, store, "key-0500", 9, &v_len);
+  g_assert_cmpint (v_len, ==, 256);
+  g_assert (memcmp (v, value, 256) == 0);
+  free (v);
+
+  cursor = iface->transaction_cursor_open (tx, store);
+  for (i = 0; (k = iface->cursor_next (cursor, NULL, NULL, NULL)) != NULL;
+       i++)
+    {
+      char key[9];
+
+      sprintf (key, "key-%04d", i);
+      g_assert_cmpstr (k, ==, key);
+      free (k);
+    }
+
+  g_assert_cmpint (i, ==, 1000);
+
+  iface->cursor_close (cursor);
+  iface->transaction_rollback (tx);
+
+  iface->close_store (store);
+  iface->destroy_store (fixture->context, db);
+  g_free (db);
+}
+
+static void
+count_stat (const char *name, const char *value, gpointer user_data)
+{
+  int *count = user_data;
+  (*count)++;
+}
+
+static void
+test_storage_context_stats
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  int count = 0;
+
+  fixture->bdb_interface->context_stats (fixture->context, count_stat, &count);
+  g_assert_cmpint (count, >, 0);
+}
+
 int 
 main (int argc, char *argv[])
 {
@@ -130,6 +366,19 @@ main (int argc, char *argv[])
       g_test_add ("/storage-bdb/open/excl", struct test_storage_fixture, NULL,
 		  test_storage_fixture_setup, test_storage_open_excl,
 		  test_storage_fixture_teardown);
+      g_test_add ("/storage-bdb/snapshot/read", struct test_storage_fixture,
+		  NULL, test_storage_fixture_setup_snapshot,
+		  test_storage_snapshot_read, test_storage_fixture_teardown);
+      g_test_add ("/storage-bdb/cursor", struct test_storage_fixture, NULL,
+		  test_storage_fixture_setup, test_storage_cursor,
+		  test_storage_fixture_teardown);
+      g_test_add ("/storage-bdb/transaction/put-bulk",
+		  struct test_storage_fixture, NULL, test_storage_fixture_setup,
+		  test_storage_transaction_put_bulk,
+		  test_storage_fixture_teardown);
+      g_test_add ("/storage-bdb/context-stats", struct test_storage_fixture,
+		  NULL, test_storage_fixture_setup, test_storage_context_stats,
+		  test_storage_fixture_teardown);
     }
 
   return g_test_run ();
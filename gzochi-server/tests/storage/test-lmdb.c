@@ -0,0 +1,453 @@
+/* test-lmdb.c: Test routines for storage/lmdb.c in gzochid.
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "gzochid-storage.h"
+
+#define Q(x) #x
+#define QUOTE(x) Q(x)
+
+#ifndef LMDB_MODULE_LOCATION
+#error "LMDB_MODULE_LOCATION is required!"
+#endif /* LMDB_MODULE_LOCATION */
+
+struct test_storage_fixture
+{
+  gchar *dir;
+  gzochid_storage_engine_interface *lmdb_interface;
+  gzochid_storage_context *context;
+};
+
+static gboolean
+ignore_warnings (const gchar *log_domain, GLogLevelFlags log_level,
+                 const gchar *message, gpointer user_data)
+{
+  if (log_level & G_LOG_LEVEL_CRITICAL
+      || log_level & G_LOG_LEVEL_WARNING)
+    return FALSE;
+  else return log_level & G_LOG_FLAG_FATAL;
+}
+
+static void 
+test_storage_fixture_setup 
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine engine;
+  gint (*initializer) (gzochid_storage_engine *);
+  
+  GModule *module = g_module_open 
+    (QUOTE (LMDB_MODULE_LOCATION), G_MODULE_BIND_LOCAL);
+
+  g_assert (module != NULL);
+  g_assert (g_module_symbol (module, "gzochid_storage_init_engine", 
+			     (gpointer *) &initializer));
+  initializer (&engine);
+
+  fixture->dir = g_dir_make_tmp (NULL, NULL);
+  fixture->lmdb_interface = engine.interface;
+  fixture->context = engine.interface->initialize (fixture->dir);
+}
+
+static void
+test_storage_fixture_teardown
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  fixture->lmdb_interface->close_context (fixture->context);
+  fixture->lmdb_interface->destroy_context (fixture->dir);
+  g_free (fixture->dir);
+}
+
+static void
+test_storage_open_create 
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gchar *db = g_strconcat (fixture->dir, "/oids", NULL);
+  gzochid_storage_store *store = NULL;
+
+  g_test_log_set_fatal_handler (ignore_warnings, NULL);
+
+  g_assert (fixture->lmdb_interface->open (fixture->context, db, 0) == NULL);
+  store = fixture->lmdb_interface->open
+    (fixture->context, db, GZOCHID_STORAGE_CREATE);
+  g_assert (store != NULL);
+
+  fixture->lmdb_interface->close_store (store);
+  fixture->lmdb_interface->destroy_store (fixture->context, db);
+  g_free (db);
+}
+
+static void
+test_storage_open_excl 
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gchar *db = g_strconcat (fixture->dir, "/oids", NULL);
+  gzochid_storage_store *store = fixture->lmdb_interface->open 
+    (fixture->context, db, GZOCHID_STORAGE_CREATE);
+
+  g_test_log_set_fatal_handler (ignore_warnings, NULL);
+
+  fixture->lmdb_interface->close_store (store);
+  store = fixture->lmdb_interface->open
+    (fixture->context, db, GZOCHID_STORAGE_CREATE | GZOCHID_STORAGE_EXCL);
+  g_assert (store == NULL);
+
+  fixture->lmdb_interface->destroy_store (fixture->context, db);
+  g_free (db);
+}
+
+static gzochid_storage_store *
+open_store (struct test_storage_fixture *fixture)
+{
+  gchar *db = g_strconcat (fixture->dir, "/oids", NULL);
+  gzochid_storage_store *store = fixture->lmdb_interface->open 
+    (fixture->context, db, GZOCHID_STORAGE_CREATE);
+
+  g_free (db);
+  return store;
+}
+
+static void
+put_committed (struct test_storage_fixture *fixture,
+	       gzochid_storage_store *store, char *key, char *value)
+{
+  gzochid_storage_engine_interface *iface = fixture->lmdb_interface;
+  gzochid_storage_transaction *tx = iface->transaction_begin (fixture->context);
+
+  iface->transaction_put
+    (tx, store, key, strlen (key) + 1, value, strlen (value) + 1);
+  iface->transaction_prepare (tx);
+  g_assert (!tx->rollback);
+  iface->transaction_commit (tx);
+}
+
+static void
+test_storage_transaction_isolation
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine_interface *iface = fixture->lmdb_interface;
+  gzochid_storage_store *store = open_store (fixture);
+  gzochid_storage_transaction *tx1 = NULL, *tx2 = NULL;
+  char *value = NULL;
+
+  put_committed (fixture, store, "foo", "bar");
+
+  tx1 = iface->transaction_begin (fixture->context);
+  tx2 = iface->transaction_begin (fixture->context);
+
+  /* Buffered writes are visible to the writing transaction only. */
+
+  iface->transaction_put (tx1, store, "foo", 4, "baz", 4);
+
+  value = iface->transaction_get (tx1, store, "foo", 4, NULL);
+  g_assert_cmpstr (value, ==, "baz");
+  free (value);
+
+  value = iface->transaction_get (tx2, store, "foo", 4, NULL);
+  g_assert_cmpstr (value, ==, "bar");
+  free (value);
+
+  iface->transaction_prepare (tx1);
+  g_assert (!tx1->rollback);
+  iface->transaction_commit (tx1);
+
+  /* The snapshot of the second transaction is unaffected by the commit. */
+
+  value = iface->transaction_get (tx2, store, "foo", 4, NULL);
+  g_assert_cmpstr (value, ==, "bar");
+  free (value);
+
+  iface->transaction_rollback (tx2);
+  iface->close_store (store);
+}
+
+static void
+test_storage_transaction_conflict
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine_interface *iface = fixture->lmdb_interface;
+  gzochid_storage_store *store = open_store (fixture);
+  gzochid_storage_transaction *tx1 = NULL, *tx2 = NULL;
+  char *value = NULL;
+
+  put_committed (fixture, store, "foo", "bar");
+
+  tx1 = iface->transaction_begin (fixture->context);
+  tx2 = iface->transaction_begin (fixture->context);
+
+  free (iface->transaction_get_for_update (tx1, store, "foo", 4, NULL));
+  free (iface->transaction_get_for_update (tx2, store, "foo", 4, NULL));
+
+  iface->transaction_put (tx1, store, "foo", 4, "baz", 4);
+  iface->transaction_put (tx2, store, "foo", 4, "qux", 4);
+
+  iface->transaction_prepare (tx1);
+  g_assert (!tx1->rollback);
+  iface->transaction_commit (tx1);
+
+  /* The second transaction read a value that has since changed. */
+
+  iface->transaction_prepare (tx2);
+  g_assert (tx2->rollback);
+  g_assert (tx2->should_retry);
+  iface->transaction_rollback (tx2);
+
+  tx1 = iface->transaction_begin (fixture->context);
+  value = iface->transaction_get (tx1, store, "foo", 4, NULL);
+  g_assert_cmpstr (value, ==, "baz");
+  free (value);
+
+  iface->transaction_rollback (tx1);
+  iface->close_store (store);
+}
+
+static void
+test_storage_transaction_phantom
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine_interface *iface = fixture->lmdb_interface;
+  gzochid_storage_store *store = open_store (fixture);
+  gzochid_storage_transaction *tx1 = NULL, *tx2 = NULL;
+  char *key = NULL;
+
+  put_committed (fixture, store, "a", "1");
+  put_committed (fixture, store, "c", "3");
+
+  tx1 = iface->transaction_begin (fixture->context);
+  tx2 = iface->transaction_begin (fixture->context);
+
+  key = iface->transaction_next_key (tx1, store, "a", 2, NULL);
+  g_assert_cmpstr (key, ==, "c");
+  free (key);
+  iface->transaction_put (tx1, store, "d", 2, "4", 2);
+
+  /* Inserting a key into the range scanned by the first transaction
+     invalidates it. */
+
+  iface->transaction_put (tx2, store, "b", 2, "2", 2);
+  iface->transaction_prepare (tx2);
+  g_assert (!tx2->rollback);
+  iface->transaction_commit (tx2);
+
+  iface->transaction_prepare (tx1);
+  g_assert (tx1->rollback);
+  iface->transaction_rollback (tx1);
+
+  iface->close_store (store);
+}
+
+static void
+test_storage_cursor_merge
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine_interface *iface = fixture->lmdb_interface;
+  gzochid_storage_store *store = open_store (fixture);
+  gzochid_storage_transaction *tx = NULL;
+  gzochid_storage_cursor *cursor = NULL;
+  char *key = NULL, *value = NULL;
+
+  put_committed (fixture, store, "a", "1");
+  put_committed (fixture, store, "c", "3");
+  put_committed (fixture, store, "e", "5");
+
+  tx = iface->transaction_begin (fixture->context);
+
+  iface->transaction_put (tx, store, "b", 2, "2", 2);
+  iface->transaction_put (tx, store, "c", 2, "33", 3);
+  g_assert_cmpint (iface->transaction_delete (tx, store, "e", 2), ==, 0);
+
+  cursor = iface->transaction_cursor_open (tx, store);
+
+  key = iface->cursor_next (cursor, NULL, &value, NULL);
+  g_assert_cmpstr (key, ==, "a");
+  g_assert_cmpstr (value, ==, "1");
+  free (key);
+  free (value);
+
+  key = iface->cursor_next (cursor, NULL, &value, NULL);
+  g_assert_cmpstr (key, ==, "b");
+  g_assert_cmpstr (value, ==, "2");
+  free (key);
+  free (value);
+
+  key = iface->cursor_next (cursor, NULL, &value, NULL);
+  g_assert_cmpstr (key, ==, "c");
+  g_assert_cmpstr (value, ==, "33");
+  free (key);
+  free (value);
+
+  g_assert (iface->cursor_next (cursor, NULL, NULL, NULL) == NULL);
+  g_assert (!tx->rollback);
+
+  iface->cursor_close (cursor);
+  iface->transaction_rollback (tx);
+  iface->close_store (store);
+}
+
+static void
+test_storage_transaction_put_bulk
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_storage_engine_interface *iface = fixture->lmdb_interface;
+  gzochid_storage_store *store = open_store (fixture);
+  gzochid_storage_transaction *tx = NULL;
+  char *value = NULL;
+
+  /* The last pair precedes the existing key, and cannot be appended. */
+
+  gzochid_storage_pair pairs[] =
+    {
+      { "b", 2, "2", 2 },
+      { "c", 2, "3", 2 },
+      { "a", 2, "1", 2 }
+    };
+
+  put_committed (fixture, store, "b", "0");
+
+  tx = iface->transaction_begin (fixture->context);
+  iface->transaction_put_bulk (tx, store, pairs, 3);
+  iface->transaction_prepare (tx);
+  g_assert (!tx->rollback);
+  iface->transaction_commit (tx);
+
+  tx = iface->transaction_begin (fixture->context);
+
+  value = iface->transaction_get (tx, store, "a", 2, NULL);
+  g_assert_cmpstr (value, ==, "1");
+  free (value);
+  value = iface->transaction_get (tx, store, "b", 2, NULL);
+  g_assert_cmpstr (value, ==, "2");
+  free (value);
+  value = iface->transaction_get (tx, store, "c", 2, NULL);
+  g_assert_cmpstr (value, ==, "3");
+  free (value);
+
+  iface->transaction_rollback (tx);
+  iface->close_store (store);
+}
+
+static void
+test_storage_transaction_put_bulk_append
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  int i = 0;
+  char *keys = malloc (sizeof (char) * 9 * 1000), value[256];
+  char *k = NULL, *v = NULL;
+  size_t v_len = 0;
+
+  gzochid_storage_engine_interface *iface = fixture->lmdb_interface;
+  gzochid_storage_store *store = open_store (fixture);
+  gzochid_storage_transaction *tx = NULL;
+  gzochid_storage_cursor *cursor = NULL;
+  gzochid_storage_pair *pairs = malloc (sizeof (gzochid_storage_pair) * 1000);
+
+  /* Enough ascending pairs to be appended across many pages of an empty 
+     database. */
+  
+  memset (value, 'x', 256);
+  for (; i < 1000; i++)
+    {
+      sprintf (keys + i * 9, "key-%04d", i);
+
+      pairs[i].key = keys + i * 9;
+      pairs[i].key_len = 9;
+      pairs[i].value = value;
+      pairs[i].value_len = 256;
+    }
+
+  tx = iface->transaction_begin (fixture->context);
+  iface->transaction_put_bulk (tx, store, pairs, 1000);
+  iface->transaction_prepare (tx);
+  g_assert (!tx->rollback);
+  iface->transaction_commit (tx);
+
+  free (pairs);
+  free (keys);
+
+  tx = iface->transaction_begin (fixture->context);
+  cursor = iface->transaction_cursor_open (tx, store);
+  
+  for (i = 0; (k = iface->cursor_next (cursor, NULL, &v, &v_len)) != NULL;
+       i++)
+    {
+      char key[9];
+
+      sprintf (key, "key-%04d", i);
+      g_assert_cmpstr (k, ==, key);
+      g_assert_cmpint (v_len, ==, 256);
+      g_assert (memcmp (v, value, 256) == 0);
+      
+      free (k);
+      free (v);
+    }
+
+  g_assert_cmpint (i, ==, 1000);
+
+  iface->cursor_close (cursor);
+  iface->transaction_rollback (tx);
+  iface->close_store (store);
+}
+
+int 
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (g_module_supported ())
+    {
+      g_test_add 
+	("/storage-lmdb/open/create", struct test_storage_fixture, NULL, 
+	 test_storage_fixture_setup, test_storage_open_create, 
+	 test_storage_fixture_teardown);
+      g_test_add ("/storage-lmdb/open/excl", struct test_storage_fixture, NULL,
+		  test_storage_fixture_setup, test_storage_open_excl,
+		  test_storage_fixture_teardown);
+      g_test_add 
+	("/storage-lmdb/transaction/isolation", struct test_storage_fixture,
+	 NULL, test_storage_fixture_setup, test_storage_transaction_isolation,
+	 test_storage_fixture_teardown);
+      g_test_add 
+	("/storage-lmdb/transaction/conflict", struct test_storage_fixture,
+	 NULL, test_storage_fixture_setup, test_storage_transaction_conflict,
+	 test_storage_fixture_teardown);
+      g_test_add 
+	("/storage-lmdb/transaction/phantom", struct test_storage_fixture,
+	 NULL, test_storage_fixture_setup, test_storage_transaction_phantom,
+	 test_storage_fixture_teardown);
+      g_test_add 
+	("/storage-lmdb/cursor/merge", struct test_storage_fixture, NULL,
+	 test_storage_fixture_setup, test_storage_cursor_merge,
+	 test_storage_fixture_teardown);
+      g_test_add 
+	("/storage-lmdb/transaction/put-bulk", struct test_storage_fixture,
+	 NULL, test_storage_fixture_setup, test_storage_transaction_put_bulk,
+	 test_storage_fixture_teardown);
+      g_test_add 
+	("/storage-lmdb/transaction/put-bulk/append",
+	 struct test_storage_fixture, NULL, test_storage_fixture_setup,
+	 test_storage_transaction_put_bulk_append,
+	 test_storage_fixture_teardown);
+    }
+
+  return g_test_run ();
+}
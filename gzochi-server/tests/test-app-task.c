@@ -84,6 +84,19 @@ gzochid_schedule_execute_task (gzochid_task *task)
   task->worker (task->data, NULL);
 }
 
+/* The affinity key of the last task submitted to the front of an execution 
+   lane. */
+
+static guint64 last_lane_key;
+
+void
+gzochid_schedule_submit_task_with_affinity_first
+(gzochid_task_queue *task_queue, guint64 key, gzochid_task *task)
+{
+  last_lane_key = key;
+  task->worker (task->data, NULL);
+}
+
 struct _app_task_fixture
 {
   int task_attempts;
@@ -254,6 +267,90 @@ test_task_execution_resubmit_failure (app_task_fixture *fixture,
   g_assert_cmpint (fixture->cleanup_invocations, ==, 1);
 }
 
+static void
+test_task_execution_resubmit_failure_affinity (app_task_fixture *fixture,
+					       gconstpointer user_data)
+{
+  gzochid_transactional_application_task_execution *execution =
+    gzochid_transactional_application_task_execution_new
+    (fixture->failure_task, fixture->catch_task, fixture->cleanup_task);
+
+  gzochid_transactional_application_task_execution_set_affinity
+    (execution, 123);
+  last_lane_key = 0;
+  
+  gzochid_application_resubmitting_transactional_task_worker
+    (fixture->context, fixture->identity, execution);
+
+  /* The retries and the catch and cleanup tasks all stay in the lane. */
+  
+  g_assert_cmpint (fixture->task_attempts, ==, 3);
+  g_assert_cmpint (fixture->catch_invocations, ==, 1);
+  g_assert_cmpint (fixture->cleanup_invocations, ==, 1);
+  g_assert_cmpint (last_lane_key, ==, 123);
+}
+
+static void
+test_task_execution_retry_policy (app_task_fixture *fixture,
+				  gconstpointer user_data)
+{
+  gzochid_application_retry_policy policy = { 5, 0, 0 };
+  gzochid_transactional_application_task_execution *execution = NULL;
+
+  fixture->context->retry_policy = policy;
+  execution = gzochid_transactional_application_task_execution_new
+    (fixture->failure_task, fixture->catch_task, fixture->cleanup_task);
+  
+  gzochid_application_reexecuting_transactional_task_worker
+    (fixture->context, fixture->identity, execution);
+
+  g_assert_cmpint (fixture->task_attempts, ==, 5);
+  g_assert_cmpint (fixture->catch_invocations, ==, 1);
+  g_assert_cmpint (fixture->cleanup_invocations, ==, 1);
+}
+
+static void
+test_retry_delay (app_task_fixture *fixture, gconstpointer user_data)
+{
+  guint64 delay = 0;
+  gzochid_application_retry_policy policy = { 10, 10, 40 };
+  gzochid_transactional_application_task_execution *execution = NULL;
+
+  fixture->context->retry_policy = policy;
+  execution = gzochid_transactional_application_task_execution_new
+    (fixture->success_task, NULL, NULL);
+
+  execution->attempts = 1;
+  delay = gzochid_application_retry_delay (execution);  
+  g_assert_cmpint (delay, >=, 5000);
+  g_assert_cmpint (delay, <=, 10000);
+
+  execution->attempts = 2;
+  delay = gzochid_application_retry_delay (execution);  
+  g_assert_cmpint (delay, >=, 10000);
+  g_assert_cmpint (delay, <=, 20000);
+
+  execution->attempts = 9;
+  delay = gzochid_application_retry_delay (execution);  
+  g_assert_cmpint (delay, >=, 20000);
+  g_assert_cmpint (delay, <=, 40000);
+
+  gzochid_transactional_application_task_execution_free (execution);
+}
+
+static void
+test_retry_delay_disabled (app_task_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_transactional_application_task_execution *execution =
+    gzochid_transactional_application_task_execution_new
+    (fixture->success_task, NULL, NULL);
+
+  execution->attempts = 2;
+  g_assert_cmpint (gzochid_application_retry_delay (execution), ==, 0);
+
+  gzochid_transactional_application_task_execution_free (execution);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -273,6 +370,19 @@ main (int argc, char *argv[])
   g_test_add ("/task-execution/resubmit/failure", app_task_fixture, NULL,
 	      app_task_fixture_set_up, test_task_execution_resubmit_failure,
 	      app_task_fixture_tear_down);
+  g_test_add ("/task-execution/resubmit/failure/affinity", app_task_fixture,
+	      NULL, app_task_fixture_set_up,
+	      test_task_execution_resubmit_failure_affinity,
+	      app_task_fixture_tear_down);
+  g_test_add ("/task-execution/retry-policy", app_task_fixture, NULL,
+	      app_task_fixture_set_up, test_task_execution_retry_policy,
+	      app_task_fixture_tear_down);
+  g_test_add ("/task-execution/retry-delay", app_task_fixture, NULL,
+	      app_task_fixture_set_up, test_retry_delay,
+	      app_task_fixture_tear_down);
+  g_test_add ("/task-execution/retry-delay/disabled", app_task_fixture, NULL,
+	      app_task_fixture_set_up, test_retry_delay_disabled,
+	      app_task_fixture_tear_down);
   
   return g_test_run ();
 }
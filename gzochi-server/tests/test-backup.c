@@ -0,0 +1,282 @@
+/* test-backup.c: Test routines for backup.c in gzochid.
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "backup.h"
+#include "descriptor.h"
+#include "dumpfile.h"
+#include "gzochid-storage.h"
+#include "storage-mem.h"
+
+#define NUM_OIDS 5000
+
+struct test_backup_fixture
+{
+  gzochid_application_context *app_context;
+  gzochid_storage_engine_interface *iface;
+  char *dir; /* The temporary directory to back up to. */
+};
+
+/* The `mem' storage engine takes read locks in read-only transactions, and so
+   is refused by the backup process; the tests back up via a copy of its 
+   interface that claims to read from a snapshot instead. */
+
+static gzochid_storage_engine_interface snapshot_mem_interface;
+
+static gboolean
+pretend_snapshot_reads (gzochid_storage_context *context)
+{
+  return TRUE;
+}
+
+static void
+test_backup_fixture_setup (struct test_backup_fixture *fixture,
+			   gconstpointer user_data)
+{
+  gzochid_storage_transaction *tx = NULL;
+  int i = 0;
+
+  snapshot_mem_interface = gzochid_storage_engine_interface_mem;
+  snapshot_mem_interface.context_snapshot_reads = pretend_snapshot_reads;
+  
+  fixture->iface = &snapshot_mem_interface;
+  fixture->app_context = gzochid_application_context_new ();
+  fixture->app_context->descriptor = g_object_new
+    (GZOCHID_TYPE_APPLICATION_DESCRIPTOR, NULL);
+  fixture->app_context->descriptor->name = strdup ("test");
+
+  fixture->app_context->storage_engine_interface = fixture->iface;
+  fixture->app_context->storage_context = fixture->iface->initialize ("/tmp");
+  fixture->app_context->meta = fixture->iface->open
+    (fixture->app_context->storage_context, "/tmp/meta",
+     GZOCHID_STORAGE_CREATE);
+  fixture->app_context->oids = fixture->iface->open
+    (fixture->app_context->storage_context, "/tmp/oids",
+     GZOCHID_STORAGE_CREATE);
+  fixture->app_context->names = fixture->iface->open
+    (fixture->app_context->storage_context, "/tmp/names",
+     GZOCHID_STORAGE_CREATE);
+
+  tx = fixture->iface->transaction_begin
+    (fixture->app_context->storage_context);
+
+  fixture->iface->transaction_put
+    (tx, fixture->app_context->meta, "next-oid", 9, "5000", 5);
+  fixture->iface->transaction_put
+    (tx, fixture->app_context->names, "s.foo", 6, "1", 2);
+  fixture->iface->transaction_put
+    (tx, fixture->app_context->names, "s.bar", 6, "2", 2);
+
+  for (; i < NUM_OIDS; i++)
+    {
+      char key[16], value[32];
+
+      snprintf (key, 16, "%08d", i);
+      snprintf (value, 32, "object-%d", i);
+
+      fixture->iface->transaction_put
+	(tx, fixture->app_context->oids, key, strlen (key) + 1, value,
+	 strlen (value) + 1);
+    }
+
+  fixture->iface->transaction_prepare (tx);
+  fixture->iface->transaction_commit (tx);
+
+  fixture->dir = g_dir_make_tmp (NULL, NULL);
+}
+
+static void
+remove_backup_files (const char *dir)
+{
+  char *files[] = { "meta.dump", "oids.dump", "names.dump" };
+  int i = 0;
+
+  for (; i < 3; i++)
+    {
+      char *filename = g_strconcat (dir, "/", files[i], NULL);
+
+      remove (filename);
+      g_free (filename);
+    }
+}
+
+static void
+test_backup_fixture_teardown (struct test_backup_fixture *fixture,
+			      gconstpointer user_data)
+{
+  remove_backup_files (fixture->dir);
+  g_rmdir (fixture->dir);
+  g_free (fixture->dir);
+
+  fixture->iface->close_store (fixture->app_context->meta);
+  fixture->iface->close_store (fixture->app_context->oids);
+  fixture->iface->close_store (fixture->app_context->names);
+  fixture->iface->close_context (fixture->app_context->storage_context);
+
+  g_object_unref (fixture->app_context->descriptor);
+  gzochid_application_context_free (fixture->app_context);
+}
+
+/* Returns the number of records in the specified dump file in the specified
+   directory, asserting that the file is a valid binary dump file. */
+
+static int
+count_records (const char *dir, const char *file)
+{
+  char *filename = g_strconcat (dir, "/", file, NULL);
+  FILE *from = fopen (filename, "r");
+  gzochid_dump_reader *reader = NULL;
+  size_t key_len = 0, value_len = 0;
+  char *key = NULL, *value = NULL;
+  GError *err = NULL;
+  int n = 0;
+
+  g_assert (from != NULL);
+  g_assert (gzochid_dump_file_is_binary (from));
+
+  reader = gzochid_dump_reader_new (from, &err);
+  g_assert_no_error (err);
+
+  while (gzochid_dump_reader_next
+	 (reader, &key, &key_len, &value, &value_len, &err))
+    {
+      free (key);
+      free (value);
+      n++;
+    }
+
+  g_assert_no_error (err);
+
+  gzochid_dump_reader_free (reader);
+  fclose (from);
+  g_free (filename);
+
+  return n;
+}
+
+static void
+test_backup_application (struct test_backup_fixture *fixture,
+			 gconstpointer user_data)
+{
+  gzochid_backup_stats stats;
+  GError *err = NULL;
+
+  g_assert (gzochid_backup_application
+	    (fixture->app_context, fixture->dir, &stats, &err));
+  g_assert_no_error (err);
+
+  g_assert_cmpint (stats.num_meta_records, ==, 1);
+  g_assert_cmpint (stats.num_oids_records, ==, NUM_OIDS);
+  g_assert_cmpint (stats.num_names_records, ==, 2);
+
+  g_assert_cmpint (count_records (fixture->dir, "meta.dump"), ==, 1);
+  g_assert_cmpint (count_records (fixture->dir, "oids.dump"), ==, NUM_OIDS);
+  g_assert_cmpint (count_records (fixture->dir, "names.dump"), ==, 2);
+}
+
+static void
+test_backup_application_releases_locks (struct test_backup_fixture *fixture,
+					gconstpointer user_data)
+{
+  gzochid_storage_transaction *tx = NULL;
+  GError *err = NULL;
+
+  g_assert (gzochid_backup_application
+	    (fixture->app_context, fixture->dir, NULL, &err));
+  g_assert_no_error (err);
+
+  /* The backup transaction has ended, so its locks have been released. */
+
+  tx = fixture->iface->transaction_begin
+    (fixture->app_context->storage_context);
+  fixture->iface->transaction_put
+    (tx, fixture->app_context->names, "s.baz", 6, "3", 2);
+
+  g_assert (!tx->rollback);
+
+  fixture->iface->transaction_prepare (tx);
+  fixture->iface->transaction_commit (tx);
+}
+
+static void
+test_backup_application_io_error (struct test_backup_fixture *fixture,
+				  gconstpointer user_data)
+{
+  char *file = g_strconcat (fixture->dir, "/not-a-dir", NULL);
+  char *dir = g_strconcat (file, "/backup", NULL);
+  GError *err = NULL;
+
+  g_assert (g_file_set_contents (file, "", 0, NULL));
+
+  g_assert (!gzochid_backup_application
+	    (fixture->app_context, dir, NULL, &err));
+  g_assert_error (err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_IO);
+
+  g_error_free (err);
+  remove (file);
+  g_free (dir);
+  g_free (file);
+}
+
+static void
+test_backup_application_no_snapshot (struct test_backup_fixture *fixture,
+				     gconstpointer user_data)
+{
+  GError *err = NULL;
+  char *filename = g_strconcat (fixture->dir, "/oids.dump", NULL);
+
+  fixture->app_context->storage_engine_interface =
+    &gzochid_storage_engine_interface_mem;
+
+  g_assert (!gzochid_backup_application
+	    (fixture->app_context, fixture->dir, NULL, &err));
+  g_assert_error (err, GZOCHID_BACKUP_ERROR, GZOCHID_BACKUP_ERROR_NO_SNAPSHOT);
+  g_assert (!g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  g_error_free (err);
+  g_free (filename);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/backup/application", struct test_backup_fixture, NULL,
+	      test_backup_fixture_setup, test_backup_application,
+	      test_backup_fixture_teardown);
+  g_test_add ("/backup/application/releases-locks",
+	      struct test_backup_fixture, NULL, test_backup_fixture_setup,
+	      test_backup_application_releases_locks,
+	      test_backup_fixture_teardown);
+  g_test_add ("/backup/application/io-error", struct test_backup_fixture,
+	      NULL, test_backup_fixture_setup, test_backup_application_io_error,
+	      test_backup_fixture_teardown);
+  g_test_add ("/backup/application/no-snapshot", struct test_backup_fixture,
+	      NULL, test_backup_fixture_setup,
+	      test_backup_application_no_snapshot,
+	      test_backup_fixture_teardown);
+
+  return g_test_run ();
+}
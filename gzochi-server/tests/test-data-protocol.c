@@ -230,6 +230,94 @@ test_data_response_failure ()
   g_bytes_unref (bytes);
 }
 
+static void
+test_grant ()
+{
+  GBytes *bytes = NULL;
+  GByteArray *arr = g_byte_array_new ();
+  GBytes *key = g_bytes_new_static ("foo", 4);
+  GBytes *data = g_bytes_new_static ("bar", 4);
+  gzochid_data_grant *grant1 = NULL;
+  gzochid_data_grant *grant2 = NULL;
+
+  grant1 = gzochid_data_grant_new ("test", "oids", TRUE, key, data);
+
+  gzochid_data_protocol_grant_write (grant1, arr);
+
+  bytes = g_byte_array_free_to_bytes (arr);
+  grant2 = gzochid_data_protocol_grant_read (bytes);
+
+  g_assert (grant2 != NULL);
+  g_assert_cmpstr (grant2->app, ==, "test");
+  g_assert_cmpstr (grant2->store, ==, "oids");
+  g_assert (grant2->for_write);
+  g_assert (g_bytes_equal (grant2->key, key));
+  g_assert (g_bytes_equal (grant2->data, data));
+  
+  gzochid_data_grant_free (grant1);
+  gzochid_data_grant_free (grant2);
+
+  g_bytes_unref (key);
+  g_bytes_unref (data);
+  g_bytes_unref (bytes);
+}
+
+static void
+test_grant_null_key ()
+{
+  GBytes *bytes = NULL;
+  GByteArray *arr = g_byte_array_new ();
+  gzochid_data_grant *grant1 = NULL;
+  gzochid_data_grant *grant2 = NULL;
+
+  grant1 = gzochid_data_grant_new ("test", "names", FALSE, NULL, NULL);
+
+  gzochid_data_protocol_grant_write (grant1, arr);
+
+  bytes = g_byte_array_free_to_bytes (arr);
+  grant2 = gzochid_data_protocol_grant_read (bytes);
+
+  g_assert (grant2 != NULL);
+  g_assert_cmpstr (grant2->app, ==, "test");
+  g_assert_cmpstr (grant2->store, ==, "names");
+  g_assert (! grant2->for_write);
+  g_assert (grant2->key == NULL);
+  g_assert (grant2->data == NULL);
+  
+  gzochid_data_grant_free (grant1);
+  gzochid_data_grant_free (grant2);
+
+  g_bytes_unref (bytes);
+}
+
+static void
+test_revocation ()
+{
+  GBytes *bytes = NULL;
+  GByteArray *arr = g_byte_array_new ();
+  GBytes *key = g_bytes_new_static ("foo", 4);
+  gzochid_data_revocation *revocation1 = NULL;
+  gzochid_data_revocation *revocation2 = NULL;
+
+  revocation1 = gzochid_data_revocation_new ("test", "oids", key);
+
+  gzochid_data_protocol_revocation_write (revocation1, arr);
+
+  bytes = g_byte_array_free_to_bytes (arr);
+  revocation2 = gzochid_data_protocol_revocation_read (bytes);
+
+  g_assert (revocation2 != NULL);
+  g_assert_cmpstr (revocation2->app, ==, "test");
+  g_assert_cmpstr (revocation2->store, ==, "oids");
+  g_assert (g_bytes_equal (revocation2->key, key));
+  
+  gzochid_data_revocation_free (revocation1);
+  gzochid_data_revocation_free (revocation2);
+
+  g_bytes_unref (key);
+  g_bytes_unref (bytes);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -244,6 +332,9 @@ main (int argc, char *argv[])
 		   test_data_response_not_found);
   g_test_add_func
     ("/data-protocol/data-response/failure", test_data_response_failure);
+  g_test_add_func ("/data-protocol/grant", test_grant);
+  g_test_add_func ("/data-protocol/grant/null-key", test_grant_null_key);
+  g_test_add_func ("/data-protocol/revocation", test_revocation);
   
   return g_test_run ();
 }
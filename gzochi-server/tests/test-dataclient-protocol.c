@@ -123,6 +123,50 @@ gzochid_dataclient_received_next_key (GzochidDataClient *client,
 		      (char *) g_bytes_get_data (response->data, NULL)));
 }
 
+void
+gzochid_dataclient_received_value_grant (GzochidDataClient *client,
+					 gzochid_data_grant *grant)
+{
+  client->activity_log = g_list_append
+    (client->activity_log,
+     g_strdup_printf ("RECEIVED VALUE GRANT %s/%s/%s:%s", grant->app,
+		      grant->store, (char *) g_bytes_get_data (grant->key, NULL),
+		      (char *) g_bytes_get_data (grant->data, NULL)));
+}
+
+void
+gzochid_dataclient_received_next_key_grant (GzochidDataClient *client,
+					    gzochid_data_grant *grant)
+{
+  client->activity_log = g_list_append
+    (client->activity_log,
+     g_strdup_printf ("RECEIVED KEY GRANT %s/%s/%s:%s", grant->app,
+		      grant->store, (char *) g_bytes_get_data (grant->key, NULL),
+		      (char *) g_bytes_get_data (grant->data, NULL)));
+}
+
+void
+gzochid_dataclient_received_key_revocation
+(GzochidDataClient *client, gzochid_data_revocation *revocation)
+{
+  client->activity_log = g_list_append
+    (client->activity_log,
+     g_strdup_printf ("REVOKED KEY %s/%s/%s", revocation->app,
+		      revocation->store,
+		      (char *) g_bytes_get_data (revocation->key, NULL)));
+}
+
+void
+gzochid_dataclient_received_key_range_revocation
+(GzochidDataClient *client, gzochid_data_revocation *revocation)
+{
+  client->activity_log = g_list_append
+    (client->activity_log,
+     g_strdup_printf ("REVOKED KEY RANGE %s/%s/%s", revocation->app,
+		      revocation->store,
+		      (char *) g_bytes_get_data (revocation->key, NULL)));
+}
+
 static void
 test_client_can_dispatch_true ()
 {
@@ -212,6 +256,45 @@ test_client_dispatch_one_next_key_response ()
   g_object_unref (client);
 }
 
+static void
+test_client_dispatch_one_value_grant ()
+{
+  GzochidDataClient *client = g_object_new (GZOCHID_TYPE_DATA_CLIENT, NULL);
+  GByteArray *bytes = g_byte_array_new ();
+
+  g_byte_array_append
+    (bytes, "\x00\x18\x53test\x00names\x00\x01\x00\x04""foo\x00"
+     "\x00\x04""bar\x00", 27);
+
+  g_assert_cmpint
+    (gzochid_dataclient_client_protocol.dispatch (bytes, client), ==, 27);
+  g_assert_cmpint (g_list_length (client->activity_log), ==, 1);
+  g_assert_cmpstr
+    (client->activity_log->data, ==, "RECEIVED VALUE GRANT test/names/foo:bar");
+
+  g_byte_array_unref (bytes);
+  g_object_unref (client);
+}
+
+static void
+test_client_dispatch_one_key_revocation ()
+{
+  GzochidDataClient *client = g_object_new (GZOCHID_TYPE_DATA_CLIENT, NULL);
+  GByteArray *bytes = g_byte_array_new ();
+
+  g_byte_array_append
+    (bytes, "\x00\x11\x55test\x00names\x00\x00\x04""foo\x00", 20);
+
+  g_assert_cmpint
+    (gzochid_dataclient_client_protocol.dispatch (bytes, client), ==, 20);
+  g_assert_cmpint (g_list_length (client->activity_log), ==, 1);
+  g_assert_cmpstr
+    (client->activity_log->data, ==, "REVOKED KEY test/names/foo");
+
+  g_byte_array_unref (bytes);
+  g_object_unref (client);
+}
+
 static void
 test_client_dispatch_multiple ()
 {
@@ -259,6 +342,11 @@ main (int argc, char *argv[])
   g_test_add_func
     ("/client/dispatch/one/next-key-response",
      test_client_dispatch_one_next_key_response);
+  g_test_add_func
+    ("/client/dispatch/one/value-grant", test_client_dispatch_one_value_grant);
+  g_test_add_func
+    ("/client/dispatch/one/key-revocation",
+     test_client_dispatch_one_key_revocation);
 
   g_test_add_func ("/client/dispatch/multiple", test_client_dispatch_multiple);
   
@@ -125,12 +125,17 @@ release_callback (gpointer user_data)
 static void
 dataclient_fixture_setup (dataclient_fixture *fixture, gconstpointer user_data)
 {
+  /* The lock lease interval may be overridden via the user data pointer. */
+  
+  const char *release_msec = user_data != NULL ? user_data : "10";
   GKeyFile *key_file = g_key_file_new ();
   GzochidConfiguration *configuration = g_object_new
     (GZOCHID_TYPE_CONFIGURATION, "key_file", key_file, NULL);
 
-  g_key_file_set_value (key_file, "metaserver", "lock.release.msec", "10");
-  g_key_file_set_value (key_file, "metaserver", "rangelock.release.msec", "10");
+  g_key_file_set_value
+    (key_file, "metaserver", "lock.release.msec", release_msec);
+  g_key_file_set_value
+    (key_file, "metaserver", "rangelock.release.msec", release_msec);
 
   fixture->socket = gzochid_reconnectable_socket_new ();
   fixture->socket->fixture = fixture;
@@ -317,6 +322,90 @@ test_received_value_unexpected (dataclient_fixture *fixture,
   g_bytes_unref (response.data);
 }
 
+static void
+test_received_value_grant (dataclient_fixture *fixture,
+			   gconstpointer user_data)
+{
+  GBytes *key = g_bytes_new_static ("foo", 4);
+  dataclient_data_callback_data callback_data = { 0 };
+  gzochid_data_response response;
+  gzochid_data_grant grant;
+
+  response.app = "test";
+  response.store = "oids";
+  response.success = FALSE;
+  response.timeout.tv_sec = 0;
+  response.timeout.tv_usec = 0;
+
+  grant.app = "test";
+  grant.store = "oids";
+  grant.for_write = TRUE;
+  grant.key = key;
+  grant.data = g_bytes_new_static ("bar", 4);
+  
+  callback_data.fixture = fixture;
+  
+  gzochid_dataclient_request_value
+    (fixture->dataclient, "test", "oids", key, TRUE,
+     success_callback, &callback_data, failure_callback, &callback_data,
+     release_callback, &callback_data);
+
+  gzochid_dataclient_received_value (fixture->dataclient, &response);
+  g_assert (callback_data.value == NULL);
+  
+  gzochid_dataclient_received_value_grant (fixture->dataclient, &grant);
+  set_timeout (fixture->main_loop, fixture->main_context);
+  g_main_loop_run (fixture->main_loop);
+
+  g_assert (g_bytes_equal (grant.data, callback_data.value));
+  g_assert (callback_data.released);
+  
+  g_bytes_unref (grant.data);
+  g_bytes_unref (callback_data.value);  
+  g_bytes_unref (key);
+}
+
+static void
+test_received_key_revocation (dataclient_fixture *fixture,
+			      gconstpointer user_data)
+{
+  GBytes *key = g_bytes_new_static ("foo", 4);
+  dataclient_data_callback_data callback_data = { 0 };
+  gzochid_data_response response;
+  gzochid_data_revocation revocation;
+  
+  response.app = "test";
+  response.store = "oids";
+  response.success = TRUE;
+  response.data = g_bytes_new_static ("bar", 4);
+
+  revocation.app = "test";
+  revocation.store = "oids";
+  revocation.key = key;
+  
+  callback_data.fixture = fixture;
+  
+  gzochid_dataclient_request_value
+    (fixture->dataclient, "test", "oids", key, FALSE,
+     success_callback, &callback_data, failure_callback, &callback_data,
+     release_callback, &callback_data);
+
+  gzochid_dataclient_received_value (fixture->dataclient, &response);
+
+  /* The lease is much longer than the loop timeout, so the lock will only be
+     released in time if the revocation expedites it. */
+  
+  gzochid_dataclient_received_key_revocation (fixture->dataclient, &revocation);
+  set_timeout (fixture->main_loop, fixture->main_context);
+  g_main_loop_run (fixture->main_loop);
+
+  g_assert (callback_data.released);
+  
+  g_bytes_unref (response.data);
+  g_bytes_unref (callback_data.value);  
+  g_bytes_unref (key);
+}
+
 static void
 test_request_next_key_simple (dataclient_fixture *fixture,
 			      gconstpointer user_data)
@@ -562,6 +651,14 @@ main (int argc, char *argv[])
     ("/dataclient/received-value/unexpected", dataclient_fixture, NULL,
      dataclient_fixture_setup, test_received_value_unexpected,
      dataclient_fixture_teardown);
+  g_test_add
+    ("/dataclient/received-value/grant", dataclient_fixture, NULL,
+     dataclient_fixture_setup, test_received_value_grant,
+     dataclient_fixture_teardown);
+  g_test_add
+    ("/dataclient/received-key-revocation", dataclient_fixture, "60000",
+     dataclient_fixture_setup, test_received_key_revocation,
+     dataclient_fixture_teardown);
   
   g_test_add
     ("/dataclient/request-next-key/simple", dataclient_fixture, NULL,
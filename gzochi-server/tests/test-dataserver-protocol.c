@@ -157,6 +157,30 @@ gzochi_metad_dataserver_process_changeset (GzochiMetadDataServer *dataserver,
     }
 }
 
+void
+gzochi_metad_dataserver_server_connected (GzochiMetadDataServer *dataserver,
+					  guint node_id,
+					  gzochid_client_socket *sock)
+{
+}
+
+void
+gzochi_metad_dataserver_server_disconnected (GzochiMetadDataServer *dataserver,
+					     guint node_id)
+{
+}
+
+/* Requests are executed synchronously so that their effects are visible to the
+   tests as soon as the corresponding message has been dispatched. */
+
+void
+gzochi_metad_dataserver_submit_request
+(GzochiMetadDataServer *dataserver, guint64 partition,
+ gzochi_metad_dataserver_request_worker worker, gpointer data)
+{
+  worker (dataserver, data);
+}
+
 struct _metaserver_wrapper_client
 {
   gzochi_metad_dataserver_client *dataserver_client;
@@ -223,6 +223,138 @@ test_request_value_failure (dataserver_fixture *fixture,
   g_bytes_unref (key);
 }
 
+static void
+test_request_value_failure_queued (dataserver_fixture *fixture,
+				   gconstpointer user_data)
+{
+  GBytes *key = g_bytes_new_static ("1", 2);
+  gzochid_data_response *response1 = NULL;
+  gzochid_data_response *response2 = NULL;
+  gzochid_data_response *response3 = NULL;
+  
+  response1 = gzochi_metad_dataserver_request_value
+    (fixture->server, 1, "test", "oids", key, TRUE, NULL);
+  response2 = gzochi_metad_dataserver_request_value
+    (fixture->server, 2, "test", "oids", key, TRUE, NULL);
+
+  /* A zero timeout indicates that the request was queued. */
+  
+  g_assert (! response2->success);
+  g_assert_cmpint (response2->timeout.tv_sec, ==, 0);
+  g_assert_cmpint (response2->timeout.tv_usec, ==, 0);
+
+  /* Releasing the lock grants it to node 2; but node 2 isn't connected, so the
+     grant should be released once the request workers have drained. */
+  
+  gzochi_metad_dataserver_release_key (fixture->server, 1, "test", "oids", key);
+  gzochi_metad_dataserver_stop (fixture->server);
+  
+  response3 = gzochi_metad_dataserver_request_value
+    (fixture->server, 3, "test", "oids", key, TRUE, NULL);
+
+  g_assert (response3->success);
+  
+  gzochid_data_response_free (response1);
+  gzochid_data_response_free (response2);
+  gzochid_data_response_free (response3);
+  g_bytes_unref (key);
+}
+
+static void
+test_request_value_failure_queued_duplicate (dataserver_fixture *fixture,
+					     gconstpointer user_data)
+{
+  GBytes *key = g_bytes_new_static ("1", 2);
+  gzochid_data_response *response1 = NULL;
+  gzochid_data_response *response2 = NULL;
+  gzochid_data_response *response3 = NULL;
+  gzochid_data_response *response4 = NULL;
+  gzochid_data_response *response5 = NULL;
+  
+  response1 = gzochi_metad_dataserver_request_value
+    (fixture->server, 1, "test", "oids", key, TRUE, NULL);
+
+  /* Node 2 repeats its request, upgrading it to a write; both responses 
+     indicate that the request was queued. */
+  
+  response2 = gzochi_metad_dataserver_request_value
+    (fixture->server, 2, "test", "oids", key, FALSE, NULL);
+  response3 = gzochi_metad_dataserver_request_value
+    (fixture->server, 2, "test", "oids", key, TRUE, NULL);
+
+  g_assert (! response2->success);
+  g_assert_cmpint (response2->timeout.tv_sec, ==, 0);
+  g_assert (! response3->success);
+  g_assert_cmpint (response3->timeout.tv_sec, ==, 0);
+
+  /* Node 2's single, upgraded request is queued ahead of node 3's read. */
+  
+  response4 = gzochi_metad_dataserver_request_value
+    (fixture->server, 3, "test", "oids", key, FALSE, NULL);
+  g_assert (! response4->success);
+  
+  /* Releasing the lock grants it to node 2 (and then to node 3) once; the 
+     grants are released once the request workers have drained, since neither
+     node is connected. */
+  
+  gzochi_metad_dataserver_release_key (fixture->server, 1, "test", "oids", key);
+  gzochi_metad_dataserver_stop (fixture->server);
+  
+  response5 = gzochi_metad_dataserver_request_value
+    (fixture->server, 4, "test", "oids", key, TRUE, NULL);
+
+  g_assert (response5->success);
+  
+  gzochid_data_response_free (response1);
+  gzochid_data_response_free (response2);
+  gzochid_data_response_free (response3);
+  gzochid_data_response_free (response4);
+  gzochid_data_response_free (response5);
+  g_bytes_unref (key);
+}
+
+static void
+test_request_value_failure_queued_writer (dataserver_fixture *fixture,
+					  gconstpointer user_data)
+{
+  GBytes *key = g_bytes_new_static ("1", 2);
+  gzochid_data_response *response1 = NULL;
+  gzochid_data_response *response2 = NULL;
+  gzochid_data_response *response3 = NULL;
+  gzochid_data_response *response4 = NULL;
+  
+  response1 = gzochi_metad_dataserver_request_value
+    (fixture->server, 1, "test", "oids", key, FALSE, NULL);
+  response2 = gzochi_metad_dataserver_request_value
+    (fixture->server, 2, "test", "oids", key, TRUE, NULL);
+
+  g_assert (! response2->success);
+
+  /* The read lock would be compatible with node 1's, but node 2 is waiting to
+     write the key, so the request is queued behind it. */
+  
+  response3 = gzochi_metad_dataserver_request_value
+    (fixture->server, 3, "test", "oids", key, FALSE, NULL);
+
+  g_assert (! response3->success);
+  g_assert_cmpint (response3->timeout.tv_sec, ==, 0);
+  g_assert_cmpint (response3->timeout.tv_usec, ==, 0);
+
+  /* Node 1 is unaffected by node 2's request, since it already holds a read
+     lock on the key. */
+
+  response4 = gzochi_metad_dataserver_request_value
+    (fixture->server, 1, "test", "oids", key, FALSE, NULL);
+
+  g_assert (response4->success);
+  
+  gzochid_data_response_free (response1);
+  gzochid_data_response_free (response2);
+  gzochid_data_response_free (response3);
+  gzochid_data_response_free (response4);
+  g_bytes_unref (key);
+}
+
 static void
 test_request_next_key (dataserver_fixture *fixture, gconstpointer user_data)
 {
@@ -333,6 +465,61 @@ test_request_next_key_failure (dataserver_fixture *fixture,
   g_bytes_unref (key2);
 }
 
+static void
+test_request_next_key_failure_queued (dataserver_fixture *fixture,
+				      gconstpointer user_data)
+{
+  GBytes *key1 = g_bytes_new_static ("a", 2);
+  GBytes *key2 = g_bytes_new_static ("b", 2);
+  gzochid_data_response *response1 = NULL;
+  gzochid_data_response *response2 = NULL;
+  gzochid_data_response *response3 = NULL;
+  gzochid_data_response *response4 = NULL;
+
+  test_storage_initialize (NULL);
+  test_storage_open (test_context, "names", GZOCHID_STORAGE_CREATE);
+  
+  put (names, "a", 2, "1", 2);
+  put (names, "b", 2, "2", 2);
+
+  response1 = gzochi_metad_dataserver_request_value
+    (fixture->server, 1, "test", "names", key2, TRUE, NULL);
+
+  /* The range from "a" to "b" conflicts with node 1's lock on "b". Repeating
+     the request doesn't queue it a second time. */
+  
+  response2 = gzochi_metad_dataserver_request_next_key
+    (fixture->server, 2, "test", "names", key1, NULL);
+  response3 = gzochi_metad_dataserver_request_next_key
+    (fixture->server, 2, "test", "names", key1, NULL);
+
+  g_assert (! response2->success);
+  g_assert_cmpint (response2->timeout.tv_sec, ==, 0);
+  g_assert (! response3->success);
+  g_assert_cmpint (response3->timeout.tv_sec, ==, 0);
+
+  /* A key added to the range while the request was waiting narrows the range
+     granted on release, which is read outside of the lock table's mutex. */
+
+  put (names, "a1", 3, "3", 2);
+  gzochi_metad_dataserver_release_key
+    (fixture->server, 1, "test", "names", key2);
+  gzochi_metad_dataserver_stop (fixture->server);
+
+  response4 = gzochi_metad_dataserver_request_value
+    (fixture->server, 3, "test", "names", key2, TRUE, NULL);
+
+  g_assert (response4->success);
+  
+  gzochid_data_response_free (response1);
+  gzochid_data_response_free (response2);
+  gzochid_data_response_free (response3);
+  gzochid_data_response_free (response4);
+
+  g_bytes_unref (key1);
+  g_bytes_unref (key2);
+}
+
 static void
 test_release_key (dataserver_fixture *fixture, gconstpointer user_data)
 {
@@ -582,6 +769,166 @@ test_process_changeset (dataserver_fixture *fixture, gconstpointer user_data)
   g_array_unref (changes);
 }
 
+#define LOAD_NODES 8
+#define LOAD_REQUESTS_PER_NODE 250
+
+/* Shared state for the simulated-load test. */
+
+struct _load_context
+{
+  GMutex mutex; /* Protects `latencies' and `granted'. */
+  GCond cond; /* Signaled when all requests have been executed. */
+
+  GArray *latencies; /* Submit-to-grant latencies, in microseconds. */
+  guint granted; /* The number of requests that were granted. */
+};
+
+typedef struct _load_context load_context;
+
+/* A single lock request made on behalf of a simulated node. */
+
+struct _load_request
+{
+  load_context *context; /* The shared test state. */
+  guint node_id; /* The id of the requesting node. */
+  GBytes *key; /* The key to lock. */
+  gint64 submitted; /* The monotonic time at which the request was submitted. */
+};
+
+typedef struct _load_request load_request;
+
+/* A simulated node. */
+
+struct _load_node
+{
+  GzochiMetadDataServer *server; /* The data server under test. */
+  load_context *context; /* The shared test state. */
+  guint node_id; /* The node id. */
+};
+
+typedef struct _load_node load_node;
+
+/* A `gzochi_metad_dataserver_request_worker' that obtains a write lock on the
+   requested key, records the request latency, and then releases the lock. */
+
+static void
+execute_load_request (GzochiMetadDataServer *server, gpointer data)
+{
+  load_request *request = data;
+  load_context *context = request->context;
+  gzochid_data_response *response = gzochi_metad_dataserver_request_value
+    (server, request->node_id, "test", "oids", request->key, TRUE, NULL);
+  gint64 latency = g_get_monotonic_time () - request->submitted;
+  
+  gzochi_metad_dataserver_release_key
+    (server, request->node_id, "test", "oids", request->key);
+
+  g_mutex_lock (&context->mutex);
+
+  g_array_append_val (context->latencies, latency);
+  if (response->success)
+    context->granted++;
+  if (context->latencies->len == LOAD_NODES * LOAD_REQUESTS_PER_NODE)
+    g_cond_signal (&context->cond);
+
+  g_mutex_unlock (&context->mutex);
+  
+  gzochid_data_response_free (response);
+  g_bytes_unref (request->key);
+  free (request);
+}
+
+/* The thread function for a simulated node. Submits a sequence of lock
+   requests for keys distinct to the node. */
+
+static gpointer
+run_load_node (gpointer data)
+{
+  load_node *node = data;
+  int i = 0;
+
+  for (; i < LOAD_REQUESTS_PER_NODE; i++)
+    {
+      load_request *request = malloc (sizeof (load_request));
+      char *key = g_strdup_printf ("%u-%d", node->node_id, i);
+
+      request->context = node->context;
+      request->node_id = node->node_id;
+      request->key = g_bytes_new_take (key, strlen (key) + 1);
+      request->submitted = g_get_monotonic_time ();
+
+      gzochi_metad_dataserver_submit_request
+	(node->server, node->node_id, execute_load_request, request);
+    }
+  
+  return NULL;
+}
+
+static gint
+compare_latency (gconstpointer a, gconstpointer b)
+{
+  const gint64 *latency_a = a, *latency_b = b;
+  return *latency_a < *latency_b ? -1 : *latency_a > *latency_b ? 1 : 0;
+}
+
+static gint64
+latency_percentile (GArray *latencies, int percentile)
+{
+  return g_array_index
+    (latencies, gint64, (latencies->len - 1) * percentile / 100);
+}
+
+static void
+test_load (dataserver_fixture *fixture, gconstpointer user_data)
+{
+  load_context context;
+  load_node nodes[LOAD_NODES];
+  GThread *threads[LOAD_NODES];
+  int i = 0;
+
+  test_storage_initialize (NULL);
+  test_storage_open (test_context, "oids", GZOCHID_STORAGE_CREATE);
+  
+  g_mutex_init (&context.mutex);
+  g_cond_init (&context.cond);
+  context.latencies = g_array_sized_new
+    (FALSE, FALSE, sizeof (gint64), LOAD_NODES * LOAD_REQUESTS_PER_NODE);
+  context.granted = 0;
+
+  for (; i < LOAD_NODES; i++)
+    {
+      nodes[i].server = fixture->server;
+      nodes[i].context = &context;
+      nodes[i].node_id = i + 1;
+      
+      threads[i] = g_thread_new ("load-node", run_load_node, &nodes[i]);
+    }
+
+  for (i = 0; i < LOAD_NODES; i++)
+    g_thread_join (threads[i]);
+
+  g_mutex_lock (&context.mutex);
+  while (context.latencies->len < LOAD_NODES * LOAD_REQUESTS_PER_NODE)
+    g_cond_wait (&context.cond, &context.mutex);
+  g_mutex_unlock (&context.mutex);
+
+  g_assert_cmpint (context.granted, ==, LOAD_NODES * LOAD_REQUESTS_PER_NODE);
+
+  g_array_sort (context.latencies, compare_latency);
+  g_test_message
+    ("Grant latency (us) for %d nodes x %d requests: p50=%" G_GINT64_FORMAT
+     " p90=%" G_GINT64_FORMAT " p99=%" G_GINT64_FORMAT " max=%"
+     G_GINT64_FORMAT, LOAD_NODES, LOAD_REQUESTS_PER_NODE,
+     latency_percentile (context.latencies, 50),
+     latency_percentile (context.latencies, 90),
+     latency_percentile (context.latencies, 99),
+     latency_percentile (context.latencies, 100));
+  
+  g_array_unref (context.latencies);
+  g_cond_clear (&context.cond);
+  g_mutex_clear (&context.mutex);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -614,6 +961,15 @@ main (int argc, char *argv[])
   g_test_add ("/dataserver/request-value/failure", dataserver_fixture, NULL,
 	      setup_dataserver, test_request_value_failure,
 	      teardown_dataserver);
+  g_test_add ("/dataserver/request-value/failure/queued", dataserver_fixture,
+	      NULL, setup_dataserver, test_request_value_failure_queued,
+	      teardown_dataserver);
+  g_test_add ("/dataserver/request-value/failure/queued-duplicate",
+	      dataserver_fixture, NULL, setup_dataserver,
+	      test_request_value_failure_queued_duplicate, teardown_dataserver);
+  g_test_add ("/dataserver/request-value/failure/queued-writer",
+	      dataserver_fixture, NULL, setup_dataserver,
+	      test_request_value_failure_queued_writer, teardown_dataserver);
   g_test_add ("/dataserver/request-next-key", dataserver_fixture, NULL,
 	      setup_dataserver, test_request_next_key, teardown_dataserver);
   g_test_add ("/dataserver/request-next-key/null", dataserver_fixture, NULL,
@@ -625,6 +981,9 @@ main (int argc, char *argv[])
   g_test_add ("/dataserver/request-next-key/failure", dataserver_fixture,
 	      NULL, setup_dataserver, test_request_next_key_failure,
 	      teardown_dataserver);
+  g_test_add ("/dataserver/request-next-key/failure/queued",
+	      dataserver_fixture, NULL, setup_dataserver,
+	      test_request_next_key_failure_queued, teardown_dataserver);
   g_test_add ("/dataserver/release-key", dataserver_fixture, NULL,
 	      setup_dataserver, test_release_key, teardown_dataserver);
   g_test_add ("/dataserver/release-key-range", dataserver_fixture, NULL,
@@ -633,6 +992,8 @@ main (int argc, char *argv[])
 	      setup_dataserver, test_release_all, teardown_dataserver);
   g_test_add ("/dataserver/process-changeset", dataserver_fixture, NULL,
 	      setup_dataserver, test_process_changeset, teardown_dataserver);
+  g_test_add ("/dataserver/load", dataserver_fixture, NULL, setup_dataserver,
+	      test_load, teardown_dataserver);
   
   return g_test_run ();
 }
@@ -84,6 +84,57 @@ test_descriptor_parse_ready ()
   g_object_unref (descriptor);
 }
 
+static void 
+test_descriptor_parse_message_batching ()
+{
+  char *descriptor_text = "<?xml version=\"1.0\" ?>\n\
+<game name=\"test\">\n\
+  <description>Test</description>\n\
+  <load-paths />\n\
+  <initialized>\n\
+    <callback module=\"test\" procedure=\"initialized\" />\n\
+  </initialized>\n\
+  <logged-in><callback module=\"test\" procedure=\"logged-in\" /></logged-in>\n\
+  <message-batching max-messages=\"8\" />\n\
+</game>";
+
+  FILE *descriptor_file = 
+    fmemopen (descriptor_text, strlen (descriptor_text), "r");
+  GzochidApplicationDescriptor *descriptor =
+    gzochid_config_parse_application_descriptor (descriptor_file);
+
+  g_assert (descriptor != NULL);
+  g_assert_cmpint (descriptor->max_batch_messages, ==, 8);
+  g_assert_cmpint (descriptor->max_batch_bytes, ==, 16384);
+
+  fclose (descriptor_file);
+  g_object_unref (descriptor);
+}
+
+static void 
+test_descriptor_parse_message_batching_error ()
+{
+  char *descriptor_text = "<?xml version=\"1.0\" ?>\n\
+<game name=\"test\">\n\
+  <description>Test</description>\n\
+  <load-paths />\n\
+  <initialized>\n\
+    <callback module=\"test\" procedure=\"initialized\" />\n\
+  </initialized>\n\
+  <logged-in><callback module=\"test\" procedure=\"logged-in\" /></logged-in>\n\
+  <message-batching max-messages=\"-1\" />\n\
+</game>";
+
+  FILE *descriptor_file =
+    fmemopen (descriptor_text, strlen (descriptor_text), "r");
+
+  g_test_log_set_fatal_handler (ignore_warnings, NULL);
+  
+  g_assert
+    (gzochid_config_parse_application_descriptor (descriptor_file) == NULL);
+  fclose (descriptor_file);
+}
+
 static void 
 test_descriptor_parse_error ()
 {
@@ -109,6 +160,10 @@ main (int argc, char *argv[])
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/descriptor/parse/ready", test_descriptor_parse_ready);
+  g_test_add_func ("/descriptor/parse/message-batching",
+		   test_descriptor_parse_message_batching);
+  g_test_add_func ("/descriptor/parse/message-batching/error",
+		   test_descriptor_parse_message_batching_error);
   g_test_add_func ("/descriptor/parse/error", test_descriptor_parse_error);
 
   return g_test_run ();
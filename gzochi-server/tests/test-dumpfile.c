@@ -0,0 +1,193 @@
+/* test-dumpfile.c: Test routines for dumpfile.c in gzochid.
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dumpfile.h"
+
+#define NUM_RECORDS 10000
+
+/* Writes `NUM_RECORDS' records to a new temporary file, which is returned
+   rewound to its beginning. */
+
+static FILE *
+write_records (gboolean compress)
+{
+  FILE *file = tmpfile ();
+  gzochid_dump_writer *writer = gzochid_dump_writer_new (file, compress);
+  GError *err = NULL;
+  int i = 0;
+
+  for (; i < NUM_RECORDS; i++)
+    {
+      char key[16], value[64];
+
+      snprintf (key, 16, "key-%06d", i);
+      snprintf (value, 64, "value-%06d-%040d", i, 0);
+
+      gzochid_dump_writer_put
+	(writer, key, strlen (key) + 1, value, strlen (value) + 1);
+    }
+
+  g_assert (gzochid_dump_writer_close (writer, &err));
+  g_assert_no_error (err);
+
+  rewind (file);
+  return file;
+}
+
+static void
+test_dumpfile_round_trip (gconstpointer user_data)
+{
+  FILE *file = write_records (GPOINTER_TO_INT (user_data));
+  gzochid_dump_reader *reader = NULL;
+  size_t key_len = 0, value_len = 0;
+  char *key = NULL, *value = NULL;
+  GError *err = NULL;
+  int i = 0;
+
+  g_assert (gzochid_dump_file_is_binary (file));
+
+  reader = gzochid_dump_reader_new (file, &err);
+  g_assert_no_error (err);
+
+  while (gzochid_dump_reader_next
+	 (reader, &key, &key_len, &value, &value_len, &err))
+    {
+      char expected_key[16], expected_value[64];
+
+      snprintf (expected_key, 16, "key-%06d", i);
+      snprintf (expected_value, 64, "value-%06d-%040d", i, 0);
+
+      g_assert_cmpstr (key, ==, expected_key);
+      g_assert_cmpint (key_len, ==, strlen (expected_key) + 1);
+      g_assert_cmpstr (value, ==, expected_value);
+      g_assert_cmpint (value_len, ==, strlen (expected_value) + 1);
+
+      free (key);
+      free (value);
+      i++;
+    }
+
+  g_assert_no_error (err);
+  g_assert_cmpint (i, ==, NUM_RECORDS);
+
+  gzochid_dump_reader_free (reader);
+  fclose (file);
+}
+
+static void
+test_dumpfile_checksum ()
+{
+  FILE *file = write_records (FALSE);
+  gzochid_dump_reader *reader = NULL;
+  size_t key_len = 0, value_len = 0;
+  char *key = NULL, *value = NULL;
+  GError *err = NULL;
+
+  /* Corrupt a byte of the first block's record data, which follows the file
+     header and the block header. */
+
+  fseek (file, 12 + 16 + 10, SEEK_SET);
+  fputc ('X', file);
+  rewind (file);
+
+  reader = gzochid_dump_reader_new (file, &err);
+  g_assert_no_error (err);
+
+  g_assert (!gzochid_dump_reader_next
+	    (reader, &key, &key_len, &value, &value_len, &err));
+  g_assert_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_CHECKSUM);
+
+  g_error_free (err);
+  gzochid_dump_reader_free (reader);
+  fclose (file);
+}
+
+static void
+test_dumpfile_truncated ()
+{
+  FILE *file = write_records (TRUE), *truncated = tmpfile ();
+  gzochid_dump_reader *reader = NULL;
+  size_t key_len = 0, value_len = 0;
+  char *key = NULL, *value = NULL;
+  GError *err = NULL;
+  char buf[64];
+  int i = 0;
+
+  /* Copy the header and part of the first block. */
+
+  g_assert_cmpint (fread (buf, 1, 64, file), ==, 64);
+  fwrite (buf, 1, 64, truncated);
+  rewind (truncated);
+
+  reader = gzochid_dump_reader_new (truncated, &err);
+  g_assert_no_error (err);
+
+  while (gzochid_dump_reader_next
+	 (reader, &key, &key_len, &value, &value_len, &err))
+    {
+      free (key);
+      free (value);
+      i++;
+    }
+
+  g_assert_cmpint (i, ==, 0);
+  g_assert_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT);
+
+  g_error_free (err);
+  gzochid_dump_reader_free (reader);
+  fclose (truncated);
+  fclose (file);
+}
+
+static void
+test_dumpfile_text ()
+{
+  FILE *file = tmpfile ();
+  GError *err = NULL;
+
+  fputs ("VERSION=3\n", file);
+  rewind (file);
+
+  g_assert (!gzochid_dump_file_is_binary (file));
+  g_assert (gzochid_dump_reader_new (file, &err) == NULL);
+  g_assert_error (err, GZOCHID_DUMP_ERROR, GZOCHID_DUMP_ERROR_FORMAT);
+
+  g_error_free (err);
+  fclose (file);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_data_func ("/dumpfile/round-trip/uncompressed",
+			GINT_TO_POINTER (FALSE), test_dumpfile_round_trip);
+  g_test_add_data_func ("/dumpfile/round-trip/compressed",
+			GINT_TO_POINTER (TRUE), test_dumpfile_round_trip);
+  g_test_add_func ("/dumpfile/checksum", test_dumpfile_checksum);
+  g_test_add_func ("/dumpfile/truncated", test_dumpfile_truncated);
+  g_test_add_func ("/dumpfile/text", test_dumpfile_text);
+
+  return g_test_run ();
+}
@@ -17,6 +17,7 @@
 
 #include <glib.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "app.h"
 #include "app-task.h"
@@ -28,6 +29,11 @@
 #include "oids-storage.h"
 #include "schedule.h"
 #include "storage-mem.h"
+#include "util.h"
+
+/* Enough periodic tasks to fill more than one chunk of a tick bucket. */
+
+#define NUM_BUCKETED_TASKS 70
 
 static GMutex test_worker_mutex;
 static GCond test_worker_cond;
@@ -185,6 +191,131 @@ static gzochid_application_task_serialization string_task_serialization_c =
     &test_worker_string_serialization
   };
 
+static void
+test_string_worker_periodic (gzochid_application_context *context,
+			     gzochid_auth_identity *identity, gpointer data)
+{
+  GString *str = data;
+
+  g_mutex_lock (&test_worker_mutex);
+  g_string_append (str, "p");
+  g_cond_signal (&test_worker_cond);
+  g_mutex_unlock (&test_worker_mutex);
+}
+
+static gzochid_application_worker
+deserialize_task_worker_periodic (gzochid_application_context *context,
+				  GByteArray *in)
+{
+  return test_string_worker_periodic;
+}
+
+static gzochid_application_worker_serialization
+test_worker_serialization_periodic =
+  { serialize_task_worker_noop, deserialize_task_worker_periodic };
+
+static gzochid_application_task_serialization
+string_task_serialization_periodic =
+  {
+    "string-task-serialization-periodic",
+    &test_worker_serialization_periodic,
+    &test_worker_string_serialization
+  };
+
+/* Per-task execution counts for `test_periodic_task_restart'. Each task's data
+   is a pointer to its count, which is persisted as the count's index. */
+
+static int bucketed_task_counts[NUM_BUCKETED_TASKS];
+
+static void
+serialize_bucketed_task_count (gzochid_application_context *context,
+			       gpointer data, GByteArray *out, GError **error)
+{
+  gzochid_util_serialize_int ((int *) data - bucketed_task_counts, out);
+}
+
+static gpointer
+deserialize_bucketed_task_count (gzochid_application_context *context,
+				 GByteArray *in, GError **error)
+{
+  return &bucketed_task_counts[gzochid_util_deserialize_int (in)];
+}
+
+static gzochid_io_serialization bucketed_task_count_serialization =
+  {
+    serialize_bucketed_task_count,
+    deserialize_bucketed_task_count,
+    finalize_test_worker_string
+  };
+
+static void
+bucketed_task_worker (gzochid_application_context *context,
+		      gzochid_auth_identity *identity, gpointer data)
+{
+  int *count = data;
+
+  g_mutex_lock (&test_worker_mutex);
+  (*count)++;
+  g_cond_signal (&test_worker_cond);
+  g_mutex_unlock (&test_worker_mutex);
+}
+
+static gzochid_application_worker
+deserialize_bucketed_task_worker (gzochid_application_context *context,
+				  GByteArray *in)
+{
+  return bucketed_task_worker;
+}
+
+static gzochid_application_worker_serialization
+bucketed_task_worker_serialization =
+  { serialize_task_worker_noop, deserialize_bucketed_task_worker };
+
+static gzochid_application_task_serialization bucketed_task_serialization =
+  {
+    "bucketed-task-serialization",
+    &bucketed_task_worker_serialization,
+    &bucketed_task_count_serialization
+  };
+
+/* A copy of the mem storage engine interface that counts the writes to a 
+   watched key in the `oids' store, and to the `names' store; see
+   `test_periodic_task_reschedule' below. */
+
+static gzochid_storage_engine_interface counting_interface;
+static gzochid_application_context *counted_context;
+static guint64 counted_encoded_oid;
+static int counted_oid_puts;
+static int counted_oids_puts;
+static int counted_names_puts;
+
+static void
+counting_transaction_put (gzochid_storage_transaction *tx,
+			  gzochid_storage_store *store, char *key,
+			  size_t key_len, char *value, size_t value_len)
+{
+  g_mutex_lock (&test_worker_mutex);
+
+  if (counted_context != NULL)
+    {
+      if (store == counted_context->names)
+	counted_names_puts++;
+      else if (store == counted_context->oids)
+	{
+	  counted_oids_puts++;
+	  
+	  if (key_len == sizeof (guint64)
+	      && memcmp (key, &counted_encoded_oid, sizeof (guint64)) == 0)
+	    counted_oid_puts++;
+	}
+    }
+  
+  g_mutex_unlock (&test_worker_mutex);
+
+  gzochid_storage_engine_interface_mem.transaction_put
+    (tx, store, key, key_len, value, value_len);
+}
+
 static void 
 test_task_chain_inner0 (gpointer data)
 {
@@ -273,6 +404,281 @@ test_task_chain_simple ()
   gzochid_auth_identity_unref (identity);
 }
 
+static void
+test_periodic_task_inner0 (gpointer data)
+{
+  test_context *context = data;
+  gzochid_application_task *task = gzochid_application_task_new
+    (context->app_context, context->identity, test_string_worker_periodic,
+     test_worker_string);
+
+  gzochid_schedule_periodic_durable_task
+    (context->app_context, context->identity, task,
+     &string_task_serialization_periodic, (struct timeval) { 0, 0 },
+     (struct timeval) { 0, 10000 }, NULL);
+
+  gzochid_application_task_unref (task);
+}
+
+static void
+test_periodic_task_simple ()
+{
+  test_context context;
+
+  gzochid_application_context *app_context = 
+    gzochid_application_context_new ();
+  gzochid_auth_identity *identity = gzochid_auth_identity_new ("test");
+  GThreadPool *pool = gzochid_thread_pool_new (NULL, 1, TRUE, NULL);
+
+  application_context_init (app_context);
+  app_context->tx_timeout = (struct timeval) { INT_MAX, INT_MAX };
+  app_context->task_queue = gzochid_schedule_task_queue_new (pool);
+
+  gzochid_schedule_task_queue_start (app_context->task_queue);    
+
+  context.app_context = app_context;
+  context.identity = identity;
+  context.handle_oid = 0;
+
+  test_worker_string = g_string_new ("");
+
+  gzochid_transaction_execute (test_periodic_task_inner0, &context);
+
+  /* Each execution of the task is rescheduled through a tick bucket; wait for
+     a few of them to complete. */
+  
+  g_mutex_lock (&test_worker_mutex);
+  while (test_worker_string->len < 3)
+    g_cond_wait (&test_worker_cond, &test_worker_mutex);
+  g_mutex_unlock (&test_worker_mutex);
+
+  gzochid_schedule_task_queue_stop (app_context->task_queue);
+  g_thread_pool_free (pool, TRUE, TRUE);
+
+  g_assert_cmpint (test_worker_string->len, >=, 3);
+  g_assert_nonnull (strstr (test_worker_string->str, "ppp"));
+  
+  gzochid_schedule_task_queue_free (app_context->task_queue);
+  application_context_clear (app_context);
+  gzochid_application_context_free (app_context);
+  gzochid_auth_identity_unref (identity);
+  g_string_free (test_worker_string, TRUE);
+}
+
+/* Shares the storage of the specified application context with another, as if
+   the latter were the same application after a restart of the container. */
+
+static void
+application_context_share_storage (gzochid_application_context *context,
+				   gzochid_application_context *source)
+{
+  context->storage_engine_interface = source->storage_engine_interface;
+  context->storage_context = source->storage_context;
+  context->meta = source->meta;
+  context->oids = source->oids;
+  context->names = source->names;
+  context->oid_strategy = source->oid_strategy;
+  context->tx_timeout = source->tx_timeout;
+
+  context->identity_cache = gzochid_auth_identity_cache_new ();
+}
+
+static void
+test_periodic_task_restart_inner0 (gpointer data)
+{
+  test_context *context = data;
+  int i = 0;
+
+  for (; i < NUM_BUCKETED_TASKS; i++)
+    {
+      gzochid_application_task *task = gzochid_application_task_new
+	(context->app_context, context->identity, bucketed_task_worker,
+	 &bucketed_task_counts[i]);
+
+      gzochid_schedule_periodic_durable_task
+	(context->app_context, context->identity, task,
+	 &bucketed_task_serialization, (struct timeval) { 0, 0 },
+	 (struct timeval) { 3600, 0 }, NULL);
+
+      gzochid_application_task_unref (task);
+    }
+}
+
+static void
+test_periodic_task_restart_inner1 (gpointer data)
+{
+  gzochid_restart_tasks (data);
+}
+
+/* Reloads the durable tasks of the application whose storage is shared by the
+   specified context, runs them for the specified number of microseconds (or
+   until every bucketed task has run at least once, if the duration is 0) and
+   then shuts the task queue down. */
+
+static void
+restart_periodic_tasks (gzochid_application_context *app_context,
+			gint64 duration_us)
+{
+  int i = 0;
+  GThreadPool *pool = gzochid_thread_pool_new (NULL, 4, TRUE, NULL);
+
+  app_context->task_queue = gzochid_schedule_task_queue_new (pool);
+  gzochid_transaction_execute (test_periodic_task_restart_inner1, app_context);
+  gzochid_schedule_task_queue_start (app_context->task_queue);
+
+  if (duration_us > 0)
+    g_usleep (duration_us);
+  else
+    {
+      g_mutex_lock (&test_worker_mutex);
+      while (i < NUM_BUCKETED_TASKS)
+	if (bucketed_task_counts[i] > 0)
+	  i++;
+	else g_cond_wait (&test_worker_cond, &test_worker_mutex);
+      g_mutex_unlock (&test_worker_mutex);
+    }
+
+  /* Freeing the pool waits for any executions - and their commits - that are
+     still in flight. */
+  
+  gzochid_schedule_task_queue_stop (app_context->task_queue);
+  g_thread_pool_free (pool, FALSE, TRUE);
+  gzochid_schedule_task_queue_free (app_context->task_queue);
+}
+
+static void
+test_periodic_task_restart ()
+{
+  test_context context;
+  int i = 0;
+
+  gzochid_application_context *app_context = 
+    gzochid_application_context_new ();
+  gzochid_application_context *restarted_app_context =
+    gzochid_application_context_new ();
+  gzochid_application_context *rerestarted_app_context =
+    gzochid_application_context_new ();
+  gzochid_auth_identity *identity = gzochid_auth_identity_new ("test");
+
+  application_context_init (app_context);
+  app_context->tx_timeout = (struct timeval) { INT_MAX, INT_MAX };
+
+  /* The task queue is never started, so the tasks' bucket is never dispatched,
+     as if the container had stopped before it was due. */
+  
+  app_context->task_queue = gzochid_schedule_task_queue_new (NULL);
+
+  context.app_context = app_context;
+  context.identity = identity;
+  context.handle_oid = 0;
+
+  memset (bucketed_task_counts, 0, sizeof (bucketed_task_counts));
+  gzochid_transaction_execute (test_periodic_task_restart_inner0, &context);
+  gzochid_schedule_task_queue_free (app_context->task_queue);
+
+  /* After a restart, the reloaded tasks are bucketed together again and each of
+     them runs exactly once. */
+  
+  application_context_share_storage (restarted_app_context, app_context);
+  restart_periodic_tasks (restarted_app_context, 0);
+
+  for (; i < NUM_BUCKETED_TASKS; i++)
+    g_assert_cmpint (bucketed_task_counts[i], ==, 1);
+
+  /* The execution for the first period has been committed, so the next restart
+     doesn't run any of them again before their next period. */
+  
+  application_context_share_storage (rerestarted_app_context, app_context);
+  restart_periodic_tasks (rerestarted_app_context, 100000);
+  
+  for (i = 0; i < NUM_BUCKETED_TASKS; i++)
+    g_assert_cmpint (bucketed_task_counts[i], ==, 1);
+
+  gzochid_auth_identity_cache_destroy
+    (rerestarted_app_context->identity_cache);
+  gzochid_application_context_free (rerestarted_app_context);
+  gzochid_auth_identity_cache_destroy (restarted_app_context->identity_cache);
+  gzochid_application_context_free (restarted_app_context);
+  application_context_clear (app_context);
+  gzochid_application_context_free (app_context);
+  gzochid_auth_identity_unref (identity);
+}
+
+static void
+find_pending_task_oid (gpointer data)
+{
+  GError *err = NULL;
+  test_context *context = data;
+  char *binding = gzochid_data_next_binding_oid
+    (context->app_context, "s.pendingTask.", &context->handle_oid, &err);
+
+  g_assert_no_error (err);
+  g_assert_nonnull (binding);
+  free (binding);
+}
+
+static void
+test_periodic_task_reschedule ()
+{
+  test_context context;
+
+  gzochid_application_context *app_context = 
+    gzochid_application_context_new ();
+  gzochid_auth_identity *identity = gzochid_auth_identity_new ("test");
+  GThreadPool *pool = gzochid_thread_pool_new (NULL, 1, TRUE, NULL);
+
+  application_context_init (app_context);
+  app_context->tx_timeout = (struct timeval) { INT_MAX, INT_MAX };
+  app_context->task_queue = gzochid_schedule_task_queue_new (pool);
+
+  counting_interface = gzochid_storage_engine_interface_mem;
+  counting_interface.transaction_put = counting_transaction_put;
+  app_context->storage_engine_interface = &counting_interface;
+  
+  context.app_context = app_context;
+  context.identity = identity;
+  context.handle_oid = 0;
+
+  test_worker_string = g_string_new ("");
+
+  gzochid_transaction_execute (test_periodic_task_inner0, &context);
+  gzochid_transaction_execute (find_pending_task_oid, &context);
+
+  /* Only the writes made by the task's executions are counted. */
+  
+  g_mutex_lock (&test_worker_mutex);
+  counted_context = app_context;
+  counted_encoded_oid = gzochid_util_encode_oid (context.handle_oid);
+  counted_oid_puts = counted_oids_puts = counted_names_puts = 0;
+  g_mutex_unlock (&test_worker_mutex);
+
+  gzochid_schedule_task_queue_start (app_context->task_queue);    
+  
+  g_mutex_lock (&test_worker_mutex);
+  while (test_worker_string->len < 3)
+    g_cond_wait (&test_worker_cond, &test_worker_mutex);
+  g_mutex_unlock (&test_worker_mutex);
+
+  gzochid_schedule_task_queue_stop (app_context->task_queue);
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  /* Each execution rescheduled the task by writing its schedule record; 
+     neither the task handle nor its pending task binding was rewritten. */
+  
+  g_mutex_lock (&test_worker_mutex);
+  g_assert_cmpint (counted_oids_puts, >=, 3);
+  g_assert_cmpint (counted_oid_puts, ==, 0);
+  g_assert_cmpint (counted_names_puts, ==, 0);
+  counted_context = NULL;
+  g_mutex_unlock (&test_worker_mutex);
+  
+  gzochid_schedule_task_queue_free (app_context->task_queue);
+  application_context_clear (app_context);
+  gzochid_application_context_free (app_context);
+  gzochid_auth_identity_unref (identity);
+  g_string_free (test_worker_string, TRUE);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -283,10 +689,17 @@ main (int argc, char *argv[])
   gzochid_task_register_serialization (&string_task_serialization_a);
   gzochid_task_register_serialization (&string_task_serialization_b);
   gzochid_task_register_serialization (&string_task_serialization_c);
+  gzochid_task_register_serialization (&string_task_serialization_periodic);
+  gzochid_task_register_serialization (&bucketed_task_serialization);
 
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/dutable-task/chain/simple", test_task_chain_simple);
+  g_test_add_func ("/durable-task/periodic/simple", test_periodic_task_simple);
+  g_test_add_func
+    ("/durable-task/periodic/restart", test_periodic_task_restart);
+  g_test_add_func
+    ("/durable-task/periodic/reschedule", test_periodic_task_reschedule);
 
   return g_test_run ();
 }
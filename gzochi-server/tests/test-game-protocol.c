@@ -21,25 +21,66 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
 
+#include "app.h"
+#include "app-task.h"
 #include "config.h"
+#include "descriptor.h"
 #include "game.h"
 #include "game-protocol.h"
+#include "gzochid-auth.h"
 #include "resolver.h"
+#include "schedule.h"
 #include "socket.h"
+#include "threads.h"
+#include "tx.h"
 
 struct _game_protocol_fixture
 {
   GzochidResolutionContext *resolution_context;
   GzochidGameServer *game_server;
   GzochidSocketServer *socket_server;
+  gzochid_game_protocol_closure *closure;
 
+  /* The closure's task queue, which is not started by default. */
+
+  GThreadPool *pool;
+  gzochid_task_queue *task_queue;
+
+  /* The closure's authentication pool, or `NULL' if clients are authenticated
+     on the socket server's thread. */
+
+  GThreadPool *auth_pool; 
+
+  /* The application the client is bound to, if any. */
+
+  gzochid_application_context *app_context; 
+  
   gzochid_client_socket *client_socket;
   gzochid_server_socket *server_socket;
+
+  int socket_fd; /* The client's end of the connection. */
 };
 
 typedef struct _game_protocol_fixture game_protocol_fixture;
 
+/* The log of received messages whose delivery transactions have committed. 
+   Messages delivered in a batch are enclosed in square brackets. */
+
+static GString *delivery_log;
+static GMutex delivery_mutex;
+static GCond delivery_cond;
+
+/* While `auth_blocked' is `TRUE', the test authenticator waits before 
+   returning; `auth_thread' is the thread on which it last ran. */
+
+static gboolean auth_blocked;
+static GThread *auth_thread;
+static GMutex auth_mutex;
+static GCond auth_cond;
+
 static gboolean
 ignore_warnings (const gchar *log_domain, GLogLevelFlags log_level,
 		 const gchar *message, gpointer user_data)
@@ -55,7 +96,7 @@ server_accept_wrapper (GIOChannel *channel, const char *desc, gpointer data)
 {
   game_protocol_fixture *fixture = data;
   gzochid_client_socket *ret = gzochid_game_server_protocol.accept
-    (channel, desc, fixture->game_server);
+    (channel, desc, fixture->closure);
 
   fixture->client_socket = ret;
   return ret;
@@ -64,17 +105,35 @@ server_accept_wrapper (GIOChannel *channel, const char *desc, gpointer data)
 static gzochid_server_protocol game_server_wrapper_protocol =
   { server_accept_wrapper };
 
-static void
-game_protocol_fixture_set_up (game_protocol_fixture *fixture,
-			      gconstpointer user_data)
+/* Opens a new connection to the fixture's server socket, returning the 
+   client's end of it and storing the server's end in the fixture. */
+
+static int
+connect_client (game_protocol_fixture *fixture)
 {
   struct sockaddr addr;
   size_t addrlen = sizeof (struct sockaddr);
   int socket_fd = socket (AF_INET, SOCK_STREAM, 0);
+
+  _gzochid_server_socket_getsockname (fixture->server_socket, &addr, &addrlen);
+  connect (socket_fd, &addr, addrlen);
+
+  g_assert (g_main_context_iteration
+	    (fixture->socket_server->main_context, FALSE));
+
+  return socket_fd;
+}
+
+static void
+set_up (game_protocol_fixture *fixture,
+	gzochid_game_client_flow_control flow_control,
+	gzochid_game_client_login_control login_control, gboolean auth_pool)
+{
   GKeyFile *key_file = g_key_file_new ();
   GzochidConfiguration *configuration = g_object_new
     (GZOCHID_TYPE_CONFIGURATION, "key_file", key_file, NULL);
-  
+  struct timeval tx_timeout = { 0, 100000 };
+
   g_test_log_set_fatal_handler (ignore_warnings, NULL);
   
   fixture->resolution_context = g_object_new
@@ -87,17 +146,21 @@ game_protocol_fixture_set_up (game_protocol_fixture *fixture,
     (fixture->resolution_context, GZOCHID_TYPE_GAME_SERVER, NULL);
   fixture->socket_server = gzochid_resolver_require_full
     (fixture->resolution_context, GZOCHID_TYPE_SOCKET_SERVER, NULL);
+  fixture->pool = gzochid_thread_pool_new (NULL, 1, TRUE, NULL);
+  fixture->task_queue = gzochid_schedule_task_queue_new (fixture->pool);
+  fixture->auth_pool = auth_pool
+    ? gzochid_thread_pool_new (NULL, 2, FALSE, NULL) : NULL;
+  fixture->app_context = NULL;
+  fixture->closure = gzochid_game_protocol_create_closure
+    (fixture->game_server, fixture->task_queue, tx_timeout, flow_control,
+     fixture->auth_pool, login_control);
   
   fixture->server_socket = gzochid_server_socket_new
     ("test", game_server_wrapper_protocol, fixture);
   
   gzochid_server_socket_listen
     (fixture->socket_server, fixture->server_socket, 0);
-  _gzochid_server_socket_getsockname (fixture->server_socket, &addr, &addrlen);
-  connect (socket_fd, &addr, addrlen);
-
-  g_assert (g_main_context_iteration
-	    (fixture->socket_server->main_context, FALSE));
+  fixture->socket_fd = connect_client (fixture);
 
   g_assert (fixture->client_socket != NULL);
 
@@ -105,6 +168,35 @@ game_protocol_fixture_set_up (game_protocol_fixture *fixture,
   g_object_unref (configuration);
 }
 
+static void
+game_protocol_fixture_set_up (game_protocol_fixture *fixture,
+			      gconstpointer user_data)
+{
+  gzochid_game_client_flow_control flow_control = { 0 };
+  gzochid_game_client_login_control login_control = { 0 };
+
+  /* Tests may supply their own flow control settings; by default, flow 
+     control is disabled. */
+  
+  if (user_data != NULL)
+    flow_control = *((const gzochid_game_client_flow_control *) user_data);
+
+  set_up (fixture, flow_control, login_control, FALSE);
+}
+
+/* Sets up a fixture whose clients are authenticated on a thread pool, with 
+   the specified login control settings. */
+
+static void
+game_protocol_login_fixture_set_up (game_protocol_fixture *fixture,
+				    gconstpointer user_data)
+{
+  gzochid_game_client_flow_control flow_control = { 0 };
+
+  set_up (fixture, flow_control,
+	  *((const gzochid_game_client_login_control *) user_data), TRUE);
+}
+
 static void
 game_protocol_fixture_tear_down (game_protocol_fixture *fixture,
 				 gconstpointer user_data)
@@ -115,6 +207,38 @@ game_protocol_fixture_tear_down (game_protocol_fixture *fixture,
   if (client_source != NULL)
     g_source_unref (client_source);
 
+  close (fixture->socket_fd);
+
+  /* Let any running tasks finish before the application goes away. */
+  
+  gzochid_schedule_task_queue_stop (fixture->task_queue);
+  g_thread_pool_free (fixture->pool, FALSE, TRUE);
+  gzochid_schedule_task_queue_free (fixture->task_queue);
+
+  if (fixture->auth_pool != NULL)
+    {
+      /* Let any blocked authentications finish. */
+      
+      g_mutex_lock (&auth_mutex);
+      auth_blocked = FALSE;
+      g_cond_broadcast (&auth_cond);
+      g_mutex_unlock (&auth_mutex);
+      
+      g_thread_pool_free (fixture->auth_pool, FALSE, TRUE);
+    }
+  
+  if (fixture->app_context != NULL)
+    {
+      g_object_unref (fixture->app_context->descriptor);
+      gzochid_application_context_free (fixture->app_context);
+    }
+  if (delivery_log != NULL)
+    {
+      g_string_free (delivery_log, TRUE);
+      delivery_log = NULL;
+    }
+  
+  gzochid_game_protocol_closure_free (fixture->closure);
   g_object_unref (fixture->game_server);
   g_object_unref (fixture->resolution_context);
   g_object_unref (fixture->socket_server);
@@ -224,6 +348,880 @@ test_client_error (game_protocol_fixture *fixture, gconstpointer user_data)
   g_source_unref (source);
 }
 
+/* Reads exactly the specified number of bytes from the client's end of the
+   connection, running the socket server's main context as necessary to flush
+   any pending writes. */
+
+static void
+read_from_socket (game_protocol_fixture *fixture, int socket_fd,
+		  unsigned char *buf, size_t len)
+{
+  size_t offset = 0;
+  int attempts = 0;
+
+  while (offset < len)
+    {
+      ssize_t n = 0;
+      
+      g_assert_cmpint (++attempts, <, 10000);
+      g_main_context_iteration (fixture->socket_server->main_context, FALSE);
+
+      n = recv (socket_fd, buf + offset, len - offset, MSG_DONTWAIT);
+      if (n > 0)
+	offset += n;
+    }
+}
+
+static void
+read_from_server (game_protocol_fixture *fixture, unsigned char *buf,
+		  size_t len)
+{
+  read_from_socket (fixture, fixture->socket_fd, buf, len);
+}
+
+/* Negotiates the specified protocol options on behalf of the client, and 
+   asserts that the server accepted them all. */
+
+static void
+negotiate_options (game_protocol_fixture *fixture, unsigned char options)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char request[4] = { 0x00, 0x01, 0x40, options };
+  unsigned char response[4];
+  GByteArray *byte_array = g_byte_array_new ();
+
+  g_byte_array_append (byte_array, request, 4);
+  g_assert_cmpint
+    (gzochid_game_client_protocol.dispatch (byte_array, client), ==, 4);
+
+  read_from_server (fixture, response, 4);
+
+  g_assert_cmpint (response[0], ==, 0x00);
+  g_assert_cmpint (response[1], ==, 0x01);
+  g_assert_cmpint (response[2], ==, 0x41);
+  g_assert_cmpint (response[3], ==, options);
+  
+  g_byte_array_free (byte_array, TRUE);
+}
+
+static void
+test_client_options (game_protocol_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char response[4];
+  GByteArray *byte_array = g_byte_array_new ();
+
+  /* Unsupported options are left out of the response. */
+  
+  g_byte_array_append (byte_array, "\x00\x01\x40\xff", 4);
+  g_assert_cmpint
+    (gzochid_game_client_protocol.dispatch (byte_array, client), ==, 4);
+
+  read_from_server (fixture, response, 4);
+  g_assert (memcmp (response, "\x00\x01\x41\x03", 4) == 0);
+  
+  g_byte_array_free (byte_array, TRUE);
+}
+
+static void
+test_client_dispatch_batch (game_protocol_fixture *fixture,
+			    gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+
+  unsigned int bytes_dispatched = 0;
+  GByteArray *byte_array = g_byte_array_new ();
+
+  negotiate_options (fixture, 0x01);
+  
+  g_byte_array_append
+    (byte_array, "\x00\x0a\x32\x00\x03\x01\x02\x03\x00\x03\x04\x05\x06", 13);
+  g_byte_array_append (byte_array, "\x00\x03\x31\x07\x08\x09", 6);
+  
+  bytes_dispatched = gzochid_game_client_protocol.dispatch (byte_array, client);
+  
+  g_assert_cmpint (bytes_dispatched, ==, 19);
+
+  g_byte_array_free (byte_array, TRUE);
+}
+
+static void
+test_client_dispatch_compressed (game_protocol_fixture *fixture,
+				 gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+
+  unsigned char payload[1024], frame[1024];
+  uLongf compressed_len = 1018;
+  unsigned int bytes_dispatched = 0;
+  GByteArray *byte_array = g_byte_array_new ();
+
+  negotiate_options (fixture, 0x02);
+
+  memset (payload, 'a', 1024);
+  g_assert_cmpint
+    (compress (frame + 6, &compressed_len, payload, 1024), ==, Z_OK);
+
+  frame[0] = 0x00;
+  frame[1] = compressed_len + 3;
+  frame[2] = 0x33;
+  frame[3] = 0x31;
+  frame[4] = 0x04;
+  frame[5] = 0x00;
+
+  g_byte_array_append (byte_array, frame, compressed_len + 6);
+  
+  bytes_dispatched = gzochid_game_client_protocol.dispatch (byte_array, client);
+  
+  g_assert_cmpint (bytes_dispatched, ==, compressed_len + 6);
+
+  g_byte_array_free (byte_array, TRUE);
+}
+
+static void
+test_client_send_batch (game_protocol_fixture *fixture,
+			gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char response[13];
+
+  negotiate_options (fixture, 0x01);
+
+  gzochid_game_client_send (client, (unsigned char *) "foo", 3);
+  gzochid_game_client_send (client, (unsigned char *) "bar", 3);
+
+  read_from_server (fixture, response, 13);
+  g_assert
+    (memcmp (response, "\x00\x0a\x32\x00\x03" "foo" "\x00\x03" "bar", 13)
+     == 0);
+}
+
+static void
+test_client_send_batch_ordered (game_protocol_fixture *fixture,
+				gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char response[9];
+
+  negotiate_options (fixture, 0x01);
+
+  /* Pending messages are flushed ahead of the disconnect notification. */
+  
+  gzochid_game_client_send (client, (unsigned char *) "foo", 3);
+  gzochid_game_client_disconnect (client);
+
+  read_from_server (fixture, response, 9);
+  g_assert (memcmp (response, "\x00\x03\x31" "foo" "\x00\x00\x30", 9) == 0);
+}
+
+static void
+test_client_send_compressed (game_protocol_fixture *fixture,
+			     gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char payload[1024], uncompressed[1024], header[3], *frame = NULL;
+  uLongf uncompressed_len = 1024;
+  unsigned short frame_len = 0;
+
+  negotiate_options (fixture, 0x02);
+
+  memset (payload, 'a', 1024);
+  gzochid_game_client_send (client, payload, 1024);
+
+  read_from_server (fixture, header, 3);
+  g_assert_cmpint (header[2], ==, 0x33);
+
+  frame_len = (header[0] << 8) | header[1];
+  g_assert_cmpint (frame_len, <, 1024);
+
+  frame = g_malloc (frame_len);
+  read_from_server (fixture, frame, frame_len);
+
+  g_assert_cmpint (frame[0], ==, 0x31);
+  g_assert_cmpint ((frame[1] << 8) | frame[2], ==, 1024);
+  g_assert_cmpint
+    (uncompress (uncompressed, &uncompressed_len, frame + 3, frame_len - 3),
+     ==, Z_OK);
+  g_assert_cmpint (uncompressed_len, ==, 1024);
+  g_assert (memcmp (uncompressed, payload, 1024) == 0);
+
+  g_free (frame);
+}
+
+/* Flow control settings with a tiny high watermark, so that a single message
+   is enough to congest a client. */
+
+static gzochid_game_client_flow_control drop_flow_control =
+  { 8, 0, 0, GZOCHID_GAME_CLIENT_OVERFLOW_DROP };
+static gzochid_game_client_flow_control coalesce_flow_control =
+  { 8, 0, 0, GZOCHID_GAME_CLIENT_OVERFLOW_COALESCE };
+static gzochid_game_client_flow_control disconnect_flow_control =
+  { 8, 0, 0, GZOCHID_GAME_CLIENT_OVERFLOW_DISCONNECT };
+static gzochid_game_client_flow_control max_length_flow_control =
+  { 8, 0, 32, GZOCHID_GAME_CLIENT_OVERFLOW_DROP };
+
+/* Asserts that nothing further has been written to the client. */
+
+static void
+assert_nothing_to_read (game_protocol_fixture *fixture)
+{
+  unsigned char buf[1];
+  
+  while (g_main_context_iteration
+	 (fixture->socket_server->main_context, FALSE));
+
+  g_assert_cmpint (recv (fixture->socket_fd, buf, 1, MSG_DONTWAIT), ==, -1);
+}
+
+/* Runs the socket server's main context until the specified client has been
+   disconnected. The caller should hold a reference to the client's socket, 
+   which would otherwise be freed along with the client once the socket server
+   notices the disconnection. */
+
+static void
+wait_for_disconnect (game_protocol_fixture *fixture,
+		     gzochid_game_client *client)
+{
+  int attempts = 0;
+
+  while (!_gzochid_game_client_disconnected (client))
+    {
+      g_assert_cmpint (++attempts, <, 10000);
+      g_main_context_iteration (fixture->socket_server->main_context, FALSE);
+    }
+}
+
+static void
+test_client_send_overflow_drop (game_protocol_fixture *fixture,
+				gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char response[25];
+
+  gzochid_game_client_send (client, (unsigned char *) "0123456789abcdef", 16);
+  g_assert (gzochid_game_client_is_congested (client));
+  g_assert_cmpint (gzochid_game_client_get_send_queue_length (client), ==, 19);
+
+  /* Droppable messages are dropped; others are still queued. */
+  
+  gzochid_game_client_send_droppable (client, (unsigned char *) "foo", 3);
+  gzochid_game_client_send (client, (unsigned char *) "bar", 3);
+
+  read_from_server (fixture, response, 25);
+  g_assert
+    (memcmp (response, "\x00\x10\x31" "0123456789abcdef" "\x00\x03\x31" "bar",
+	     25) == 0);
+
+  assert_nothing_to_read (fixture);
+  g_assert (!gzochid_game_client_is_congested (client));
+}
+
+static void
+test_client_send_overflow_coalesce (game_protocol_fixture *fixture,
+				    gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char response[25];
+
+  gzochid_game_client_send (client, (unsigned char *) "0123456789abcdef", 16);
+  g_assert (gzochid_game_client_is_congested (client));
+
+  /* Only the most recent droppable message is sent, once the queue has 
+     drained. */
+  
+  gzochid_game_client_send_droppable (client, (unsigned char *) "foo", 3);
+  gzochid_game_client_send_droppable (client, (unsigned char *) "baz", 3);
+
+  read_from_server (fixture, response, 25);
+  g_assert
+    (memcmp (response, "\x00\x10\x31" "0123456789abcdef" "\x00\x03\x31" "baz",
+	     25) == 0);
+
+  assert_nothing_to_read (fixture);
+}
+
+static void
+test_client_send_overflow_disconnect (game_protocol_fixture *fixture,
+				      gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+
+  gzochid_client_socket_ref (fixture->client_socket);
+
+  gzochid_game_client_send (client, (unsigned char *) "0123456789abcdef", 16);
+  gzochid_game_client_send (client, (unsigned char *) "foo", 3);
+
+  wait_for_disconnect (fixture, client);
+  g_assert_cmpint (gzochid_game_client_get_send_queue_length (client), ==, 0);
+
+  gzochid_client_socket_unref (fixture->client_socket);
+}
+
+static void
+test_client_send_overflow_max_length (game_protocol_fixture *fixture,
+				      gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+
+  gzochid_client_socket_ref (fixture->client_socket);
+
+  gzochid_game_client_send (client, (unsigned char *) "0123456789abcdef", 16);
+  gzochid_game_client_send (client, (unsigned char *) "0123456789abcdef", 16);
+  g_assert (!_gzochid_game_client_disconnected (client));
+
+  /* The send queue now exceeds its maximum length. */
+  
+  gzochid_game_client_send (client, (unsigned char *) "foo", 3);
+  wait_for_disconnect (fixture, client);
+
+  gzochid_client_socket_unref (fixture->client_socket);
+}
+
+static void
+test_client_send_overflow_drop_batch (game_protocol_fixture *fixture,
+				      gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char response[26];
+
+  negotiate_options (fixture, 0x01);
+
+  /* The message waits in the outbound batch, not in the socket's send queue,
+     but still counts against the high watermark. */
+  
+  gzochid_game_client_send (client, (unsigned char *) "0123456789abcdef", 16);
+  gzochid_game_client_send_droppable (client, (unsigned char *) "foo", 3);
+  gzochid_game_client_send (client, (unsigned char *) "bar", 3);
+
+  read_from_server (fixture, response, 26);
+  g_assert
+    (memcmp (response, "\x00\x17\x32" "\x00\x10" "0123456789abcdef"
+	     "\x00\x03" "bar", 26) == 0);
+
+  assert_nothing_to_read (fixture);
+}
+
+static void
+test_client_send_overflow_coalesce_batch (game_protocol_fixture *fixture,
+					  gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  unsigned char response[25];
+
+  negotiate_options (fixture, 0x01);
+
+  gzochid_game_client_send (client, (unsigned char *) "0123456789abcdef", 16);
+  gzochid_game_client_send_droppable (client, (unsigned char *) "foo", 3);
+  gzochid_game_client_send_droppable (client, (unsigned char *) "baz", 3);
+
+  read_from_server (fixture, response, 25);
+  g_assert
+    (memcmp (response, "\x00\x10\x31" "0123456789abcdef" "\x00\x03\x31" "baz",
+	     25) == 0);
+
+  assert_nothing_to_read (fixture);
+}
+
+static void
+delivery_commit (gpointer data)
+{
+  GString *tx_log = data;
+
+  g_mutex_lock (&delivery_mutex);
+  g_string_append (delivery_log, tx_log->str);
+  g_cond_signal (&delivery_cond);
+  g_mutex_unlock (&delivery_mutex);
+
+  g_string_free (tx_log, TRUE);
+}
+
+static void
+delivery_rollback (gpointer data)
+{
+  g_string_free (data, TRUE);
+}
+
+static int
+delivery_prepare (gpointer data)
+{
+  return TRUE;
+}
+
+static gzochid_transaction_participant delivery_participant =
+  { "delivery", delivery_prepare, delivery_commit, delivery_rollback };
+
+/* Returns the current transaction's portion of the delivery log. */
+
+static GString *
+transaction_delivery_log (void)
+{
+  if (!gzochid_transaction_active ()
+      || gzochid_transaction_context (&delivery_participant) == NULL)
+    gzochid_transaction_join (&delivery_participant, g_string_new (""));
+
+  return gzochid_transaction_context (&delivery_participant);
+}
+
+/* Appends the specified message to the current transaction's portion of the
+   delivery log. A message whose payload is "bad" raises a non-retryable error,
+   like a `received-message' handler that throws; a message whose payload is
+   "busy" raises a retryable error on every attempt, like a handler that keeps
+   losing a lock conflict. Returns `FALSE' in those cases, `TRUE' otherwise. */
+
+static gboolean
+deliver_test_message (GBytes *message)
+{
+  gsize len = 0;
+  const char *payload = g_bytes_get_data (message, &len);
+  GString *tx_log = transaction_delivery_log ();
+  
+  if (len == 3 && memcmp (payload, "bad", 3) == 0)
+    {
+      gzochid_transaction_mark_for_rollback (&delivery_participant, FALSE);
+      return FALSE;
+    }
+  else if (len == 4 && memcmp (payload, "busy", 4) == 0)
+    {
+      gzochid_transaction_mark_for_rollback (&delivery_participant, TRUE);
+      return FALSE;
+    }
+
+  g_string_append_len (tx_log, payload, len);
+  return TRUE;
+}
+
+static void
+test_message_worker (gzochid_application_context *context,
+		     gzochid_auth_identity *identity, gpointer data)
+{
+  void **args = data;
+
+  if (deliver_test_message (args[1]))
+    g_string_append_c (transaction_delivery_log (), ' ');
+}
+
+/* Follows the contract of 
+   `gzochid_scheme_application_received_messages_worker'. */
+
+static void
+test_message_batch_worker (gzochid_application_context *context,
+			   gzochid_auth_identity *identity, gpointer data)
+{
+  void **args = data;
+  GPtrArray *messages = args[1];
+  gboolean *failed = args[2];
+  guint i = 0;
+
+  *failed = FALSE;
+  g_string_append_c (transaction_delivery_log (), '[');
+  
+  for (; i < messages->len; i++)
+    {
+      if (i > 0)
+	g_string_append_c (transaction_delivery_log (), ' ');
+      if (!deliver_test_message (g_ptr_array_index (messages, i)))
+	{
+	  *failed = TRUE;
+	  return;
+	}
+    }
+
+  g_string_append_c (transaction_delivery_log (), ']');
+}
+
+/* Binds the fixture's client to a session of an application whose descriptor 
+   enables batching with the specified limits, and starts the task queue that
+   will run the delivery transactions. */
+
+static void
+prepare_batching (game_protocol_fixture *fixture,
+		  unsigned int max_batch_messages, unsigned int max_batch_bytes)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  gzochid_application_context *app_context =
+    gzochid_application_context_new ();
+  guint64 session_oid = 1;
+
+  app_context->descriptor = g_object_new
+    (GZOCHID_TYPE_APPLICATION_DESCRIPTOR, NULL);
+  app_context->descriptor->max_batch_messages = max_batch_messages;
+  app_context->descriptor->max_batch_bytes = max_batch_bytes;
+
+  /* Retries and redeliveries are resubmitted to the application's queue. */
+  
+  app_context->task_queue = fixture->task_queue;
+
+  g_hash_table_insert
+    (app_context->clients_to_oids, client,
+     g_memdup (&session_oid, sizeof (guint64)));
+
+  _gzochid_game_client_set_identity
+    (client, app_context, gzochid_auth_identity_new ("[TEST]"));
+  _gzochid_game_protocol_set_message_workers
+    (fixture->closure, test_message_worker, test_message_batch_worker);
+
+  fixture->app_context = app_context;
+  
+  delivery_log = g_string_new ("");
+  gzochid_schedule_task_queue_start (fixture->task_queue);
+}
+
+/* Waits for the delivery log to read as specified. */
+
+static void
+assert_deliveries (const char *expected)
+{
+  gint64 end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&delivery_mutex);
+  while (strcmp (delivery_log->str, expected) != 0)
+    if (!g_cond_wait_until (&delivery_cond, &delivery_mutex, end_time))
+      break;
+
+  g_assert_cmpstr (delivery_log->str, ==, expected);
+  g_mutex_unlock (&delivery_mutex);
+}
+
+static void
+test_client_dispatch_batch_max_messages (game_protocol_fixture *fixture,
+					 gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  GByteArray *byte_array = g_byte_array_new ();
+
+  prepare_batching (fixture, 2, 1024);
+
+  g_byte_array_append (byte_array, "\x00\x03\x31" "foo", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "bar", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "baz", 6);
+
+  g_assert_cmpint
+    (gzochid_game_client_protocol.dispatch (byte_array, client), ==, 18);
+
+  /* The trailing message is flushed on its own, as an ordinary message. */
+  
+  assert_deliveries ("[foo bar]baz ");
+  
+  g_byte_array_free (byte_array, TRUE);
+}
+
+static void
+test_client_dispatch_batch_max_bytes (game_protocol_fixture *fixture,
+				      gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  GByteArray *byte_array = g_byte_array_new ();
+
+  prepare_batching (fixture, 10, 6);
+
+  g_byte_array_append (byte_array, "\x00\x03\x31" "foo", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "bar", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "baz", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "qux", 6);
+
+  g_assert_cmpint
+    (gzochid_game_client_protocol.dispatch (byte_array, client), ==, 24);
+
+  assert_deliveries ("[foo bar][baz qux]");
+  
+  g_byte_array_free (byte_array, TRUE);
+}
+
+static void
+test_client_dispatch_batch_failure (game_protocol_fixture *fixture,
+				    gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  GByteArray *byte_array = g_byte_array_new ();
+
+  prepare_batching (fixture, 3, 1024);
+
+  g_byte_array_append (byte_array, "\x00\x03\x31" "foo", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "bad", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "baz", 6);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "qux", 6);
+
+  g_assert_cmpint
+    (gzochid_game_client_protocol.dispatch (byte_array, client), ==, 24);
+
+  /* The failed batch is redelivered one message per transaction, so that only
+     the bad message is lost - and in order, ahead of the next message. */
+  
+  assert_deliveries ("foo baz qux ");
+  
+  g_byte_array_free (byte_array, TRUE);
+}
+
+static void
+test_client_dispatch_batch_failure_retries
+(game_protocol_fixture *fixture, gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  GByteArray *byte_array = g_byte_array_new ();
+
+  prepare_batching (fixture, 3, 1024);
+
+  g_byte_array_append (byte_array, "\x00\x03\x31" "foo", 6);
+  g_byte_array_append (byte_array, "\x00\x04\x31" "busy", 7);
+  g_byte_array_append (byte_array, "\x00\x03\x31" "baz", 6);
+
+  g_assert_cmpint
+    (gzochid_game_client_protocol.dispatch (byte_array, client), ==, 19);
+
+  /* A batch that is still failing when it runs out of attempts is redelivered
+     one message per transaction, just like a batch with a bad message. */
+  
+  assert_deliveries ("foo baz ");
+  
+  g_byte_array_free (byte_array, TRUE);
+}
+
+/* Login control settings for the tests of asynchronous authentication. */
+
+static gzochid_game_client_login_control async_login_control =
+  { 0, 0, 0, 0, 0 };
+static gzochid_game_client_login_control max_pending_login_control =
+  { 1, 0, 0, 0, 0 };
+static gzochid_game_client_login_control timeout_login_control =
+  { 0, 0, 0, 100, 0 };
+
+/* An authenticator that accepts any credentials, once it's allowed to. */
+
+static gzochid_auth_identity *
+test_authenticator (unsigned char *cred, short cred_len, gpointer auth_data,
+		    GError **err)
+{
+  g_mutex_lock (&auth_mutex);
+  auth_thread = g_thread_self ();
+  while (auth_blocked)
+    g_cond_wait (&auth_cond, &auth_mutex);
+  g_mutex_unlock (&auth_mutex);
+
+  return gzochid_auth_identity_new ("[TEST]");
+}
+
+/* Registers an application named "test" with the fixture's game server, and
+   arranges for its authenticator to block until `unblock_authenticator' is
+   called. */
+
+static void
+prepare_login (game_protocol_fixture *fixture)
+{
+  gzochid_application_context *app_context =
+    gzochid_application_context_new ();
+
+  app_context->descriptor = g_object_new
+    (GZOCHID_TYPE_APPLICATION_DESCRIPTOR, NULL);
+  app_context->descriptor->name = strdup ("test");
+  app_context->authenticator = test_authenticator;
+
+  _gzochid_game_server_register_application
+    (fixture->game_server, app_context);
+  fixture->app_context = app_context;
+
+  auth_blocked = TRUE;
+  auth_thread = NULL;
+}
+
+static void
+unblock_authenticator (void)
+{
+  g_mutex_lock (&auth_mutex);
+  auth_blocked = FALSE;
+  g_cond_broadcast (&auth_cond);
+  g_mutex_unlock (&auth_mutex);
+}
+
+/* Sends a login request for the "test" application from the specified 
+   client. */
+
+static void
+send_login_request (gzochid_game_client *client)
+{
+  GByteArray *byte_array = g_byte_array_new ();
+
+  g_byte_array_append (byte_array, "\x00\x07\x10" "test" "\x00" "ok", 10);
+  g_assert_cmpint
+    (gzochid_game_client_protocol.dispatch (byte_array, client), ==, 10);
+
+  g_byte_array_free (byte_array, TRUE);
+}
+
+/* Waits, without running the socket server's main context, until no login 
+   requests are awaiting authentication. */
+
+static void
+wait_for_authentication (game_protocol_fixture *fixture)
+{
+  int attempts = 0;
+
+  while (_gzochid_game_protocol_pending_logins (fixture->closure) > 0)
+    {
+      g_assert_cmpint (++attempts, <, 5000);
+      g_usleep (1000);
+    }
+}
+
+/* Runs the socket server's main context until the specified client's login
+   request has been completed. */
+
+static void
+wait_for_login_completion (game_protocol_fixture *fixture,
+			   gzochid_game_client *client)
+{
+  int attempts = 0;
+
+  while (_gzochid_game_client_login_pending (client))
+    {
+      g_assert_cmpint (++attempts, <, 5000);
+      g_main_context_iteration (fixture->socket_server->main_context, FALSE);
+      g_usleep (1000);
+    }
+}
+
+static void
+test_client_login_async (game_protocol_fixture *fixture,
+			 gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+
+  prepare_login (fixture);
+  send_login_request (client);
+
+  /* The socket server's thread isn't held up by the authenticator. */
+  
+  g_assert (_gzochid_game_client_login_pending (client));
+  g_assert_cmpint (_gzochid_game_protocol_pending_logins (fixture->closure),
+		   ==, 1);
+
+  unblock_authenticator ();
+  wait_for_authentication (fixture);
+
+  g_mutex_lock (&auth_mutex);
+  g_assert (auth_thread != NULL);
+  g_assert (auth_thread != g_thread_self ());
+  g_mutex_unlock (&auth_mutex);
+
+  /* The outcome is only acted on once it's been handed back to the socket
+     server's thread. */
+  
+  g_assert (gzochid_game_client_get_identity (client) == NULL);
+  wait_for_login_completion (fixture, client);
+  
+  g_assert (gzochid_game_client_get_identity (client) != NULL);
+  g_assert_cmpstr
+    (gzochid_auth_identity_name (gzochid_game_client_get_identity (client)),
+     ==, "[TEST]");
+}
+
+static void
+test_client_login_async_disconnect (game_protocol_fixture *fixture,
+				    gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+
+  gzochid_client_socket_ref (fixture->client_socket);
+
+  prepare_login (fixture);
+  send_login_request (client);
+
+  /* The client goes away while its authentication is pending. */
+
+  close (fixture->socket_fd);
+  fixture->socket_fd = -1;
+  wait_for_disconnect (fixture, client);
+
+  unblock_authenticator ();
+  wait_for_login_completion (fixture, client);
+
+  /* The identity is discarded, rather than bound to the departed client. */
+  
+  g_assert (gzochid_game_client_get_identity (client) == NULL);
+  g_assert_cmpint (_gzochid_game_protocol_pending_logins (fixture->closure),
+		   ==, 0);
+  
+  gzochid_client_socket_unref (fixture->client_socket);
+}
+
+static void
+test_client_login_async_max_pending (game_protocol_fixture *fixture,
+				     gconstpointer user_data)
+{
+  gzochid_game_client *client1 =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  gzochid_game_client *client2 = NULL;
+  int socket_fd2 = 0;
+  unsigned char response[3];
+
+  prepare_login (fixture);
+  send_login_request (client1);
+
+  socket_fd2 = connect_client (fixture);
+  client2 = _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  
+  /* The second login request is refused outright, since the first is still 
+     being authenticated. */
+  
+  send_login_request (client2);
+  
+  g_assert (!_gzochid_game_client_login_pending (client2));
+  g_assert_cmpint (_gzochid_game_protocol_pending_logins (fixture->closure),
+		   ==, 1);
+
+  read_from_socket (fixture, socket_fd2, response, 3);
+  g_assert (memcmp (response, "\x00\x00\x12", 3) == 0);
+
+  unblock_authenticator ();
+  wait_for_login_completion (fixture, client1);
+  g_assert (gzochid_game_client_get_identity (client1) != NULL);
+
+  close (socket_fd2);
+}
+
+static void
+test_client_login_timeout (game_protocol_fixture *fixture,
+			   gconstpointer user_data)
+{
+  gzochid_game_client *client =
+    _gzochid_client_socket_get_protocol_data (fixture->client_socket);
+  int attempts = 0;
+
+  gzochid_client_socket_ref (fixture->client_socket);
+  g_assert (!_gzochid_game_client_disconnected (client));
+
+  /* The client never sends a login request, so the socket server shuts down
+     its connection once the login timeout has passed. Block on the main 
+     context, so that the timeout gets a chance to fire. */
+  
+  while (!_gzochid_game_client_disconnected (client))
+    {
+      g_assert_cmpint (++attempts, <, 1000);
+      g_main_context_iteration (fixture->socket_server->main_context, TRUE);
+    }
+
+  gzochid_client_socket_unref (fixture->client_socket);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -256,6 +1254,77 @@ main (int argc, char *argv[])
   g_test_add ("/client/error", game_protocol_fixture, NULL,
 	      game_protocol_fixture_set_up, test_client_error,
 	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/options", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up, test_client_options,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/dispatch/batch", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up, test_client_dispatch_batch,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/dispatch/compressed", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up, test_client_dispatch_compressed,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/dispatch/batch/max-messages", game_protocol_fixture,
+	      NULL, game_protocol_fixture_set_up,
+	      test_client_dispatch_batch_max_messages,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/dispatch/batch/max-bytes", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up,
+	      test_client_dispatch_batch_max_bytes,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/dispatch/batch/failure", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up, test_client_dispatch_batch_failure,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/dispatch/batch/failure/retries", game_protocol_fixture,
+	      NULL, game_protocol_fixture_set_up,
+	      test_client_dispatch_batch_failure_retries,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/batch", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up, test_client_send_batch,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/batch/ordered", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up, test_client_send_batch_ordered,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/compressed", game_protocol_fixture, NULL,
+	      game_protocol_fixture_set_up, test_client_send_compressed,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/overflow/drop", game_protocol_fixture,
+	      &drop_flow_control, game_protocol_fixture_set_up,
+	      test_client_send_overflow_drop, game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/overflow/coalesce", game_protocol_fixture,
+	      &coalesce_flow_control, game_protocol_fixture_set_up,
+	      test_client_send_overflow_coalesce,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/overflow/drop/batch", game_protocol_fixture,
+	      &drop_flow_control, game_protocol_fixture_set_up,
+	      test_client_send_overflow_drop_batch,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/overflow/coalesce/batch", game_protocol_fixture,
+	      &coalesce_flow_control, game_protocol_fixture_set_up,
+	      test_client_send_overflow_coalesce_batch,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/overflow/disconnect", game_protocol_fixture,
+	      &disconnect_flow_control, game_protocol_fixture_set_up,
+	      test_client_send_overflow_disconnect,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/send/overflow/max-length", game_protocol_fixture,
+	      &max_length_flow_control, game_protocol_fixture_set_up,
+	      test_client_send_overflow_max_length,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/login/async", game_protocol_fixture,
+	      &async_login_control, game_protocol_login_fixture_set_up,
+	      test_client_login_async,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/login/async/disconnect", game_protocol_fixture,
+	      &async_login_control, game_protocol_login_fixture_set_up,
+	      test_client_login_async_disconnect,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/login/async/max-pending", game_protocol_fixture,
+	      &max_pending_login_control, game_protocol_login_fixture_set_up,
+	      test_client_login_async_max_pending,
+	      game_protocol_fixture_tear_down);
+  g_test_add ("/client/login/timeout", game_protocol_fixture,
+	      &timeout_login_control, game_protocol_login_fixture_set_up,
+	      test_client_login_timeout, game_protocol_fixture_tear_down);
   
   return g_test_run ();
 }
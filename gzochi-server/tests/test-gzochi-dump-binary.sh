@@ -0,0 +1,67 @@
+#!/bin/sh
+
+# test-gzochi-dump-binary.sh: Binary dump round-trip test for the gzochi-dump
+# and gzochi-load tools
+# Copyright (C) 2017 Julian Graham
+#
+# gzochi is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+export GZOCHID_STORAGE_ENGINE_DIR=`pwd`
+export TMPDIR=`mktemp -d tmp.XXXXXX`
+
+mkdir $TMPDIR/source $TMPDIR/dump $TMPDIR/target
+
+# The initial contents of the databases.
+
+cat <<EOF >$TMPDIR/source/meta
+next-oid
+42
+EOF
+
+awk 'BEGIN { for (i = 0; i < 10000; i++) printf "%d\nobject-%d\n", i, i }' \
+    >$TMPDIR/source/oids
+
+cat <<EOF >$TMPDIR/source/names
+foo
+bar
+baz
+quux
+EOF
+
+fail () {
+    echo "FAILED: $1" >&2
+    rm -rf $TMPDIR
+    exit 1
+}
+
+# Dump all three databases in the compressed binary format, and load them into
+# an empty data directory.
+
+../meta/gzochi-dump -z -e treefile -o $TMPDIR/dump $TMPDIR/source \
+    || fail "Dump failed."
+../meta/gzochi-load -e treefile -i $TMPDIR/dump $TMPDIR/target \
+    || fail "Load failed."
+
+# The loaded databases hold the same records as the originals, in key order.
+
+for db in meta oids names; do
+    paste - - <$TMPDIR/source/$db | LC_ALL=C sort >$TMPDIR/expected
+    paste - - <$TMPDIR/target/$db >$TMPDIR/actual
+    diff $TMPDIR/expected $TMPDIR/actual >/dev/null \
+	|| fail "Incorrect contents for $db."
+done
+
+echo "SUCCESS" >&2
+rm -rf $TMPDIR
+exit 0
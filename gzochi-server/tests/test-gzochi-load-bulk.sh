@@ -0,0 +1,61 @@
+#!/bin/sh
+
+# test-gzochi-load-bulk.sh: Bulk load test for the gzochi-load tool
+# Copyright (C) 2017 Julian Graham
+#
+# gzochi is free software: you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+export GZOCHID_STORAGE_ENGINE_DIR=`pwd`
+export TMPDIR=`mktemp -d tmp.XXXXXX`
+
+NUM_RECORDS=1000000
+
+# Generate a dump file with keys k0000000 through k0999999, mapped to values
+# v0000000 through v0999999.
+
+awk -v n=$NUM_RECORDS 'BEGIN {
+  print "VERSION=3"; print "format=bytevalue"; print "type=btree";
+  print "HEADER=END";
+  for (i = 0; i < n; i++) {
+    s = sprintf ("%07d", i); h = "";
+    for (j = 1; j <= 7; j++) h = h "3" substr (s, j, 1);
+    print " 6b" h; print " 76" h;
+  }
+  print "DATA=END";
+}' >$TMPDIR/names.dump
+
+fail () {
+    echo "FAILED: $1" >&2
+    rm -rf $TMPDIR
+    exit 1
+}
+
+# Load the dump data into the database, in batches that do not evenly divide
+# the number of records.
+
+../meta/gzochi-load -b 300000 -e treefile $TMPDIR:names <$TMPDIR/names.dump \
+    || fail "Load failed."
+
+# Check the size of the database and the records at either end.
+
+test `wc -l <$TMPDIR/names` -eq `expr $NUM_RECORDS \* 2` \
+    || fail "Incorrect number of records."
+test "`head -n 2 $TMPDIR/names | tr '\n' ' '`" = "k0000000 v0000000 " \
+    || fail "Incorrect first record."
+test "`tail -n 2 $TMPDIR/names | tr '\n' ' '`" = "k0999999 v0999999 " \
+    || fail "Incorrect last record."
+
+echo "SUCCESS" >&2
+rm -rf $TMPDIR
+exit 0
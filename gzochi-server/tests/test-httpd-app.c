@@ -0,0 +1,323 @@
+/* test-httpd-app.c: Test routines for httpd-app.c in gzochid.
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "app.h"
+#include "gzochid-storage.h"
+#include "httpd.h"
+#include "httpd-app.h"
+#include "storage-mem.h"
+#include "util.h"
+
+struct _test_httpd_app_fixture
+{
+  GzochidHttpServer *http_server;
+  gzochid_application_context *app_context;
+  GIOChannel *client_channel;
+  int client_socket_fd;
+};
+
+typedef struct _test_httpd_app_fixture test_httpd_app_fixture;
+
+/* A copy of the mem storage engine interface whose cursors fail partway
+   through a page; see `test_list_oids_failure' below. */
+
+static gzochid_storage_engine_interface failing_interface;
+
+/* The number of keys a cursor from the failing interface reads before its
+   transaction is rolled back. */
+
+static int failing_cursor_keys;
+
+static char *
+failing_cursor_next (gzochid_storage_cursor *cursor, size_t *key_len,
+		     char **value, size_t *value_len)
+{
+  if (failing_cursor_keys-- > 0)
+    return gzochid_storage_engine_interface_mem.cursor_next
+      (cursor, key_len, value, value_len);
+  else
+    {
+      cursor->transaction->rollback = TRUE;
+      return NULL;
+    }
+}
+
+static gpointer
+bind_test_app (const GMatchInfo *match_info, gzochid_http_response_sink *sink,
+	       gpointer request_context, gpointer user_data)
+{
+  return user_data;
+}
+
+static void
+put_oid (gzochid_application_context *app_context, guint64 oid)
+{
+  gzochid_storage_engine_interface *iface =
+    app_context->storage_engine_interface;
+  gzochid_storage_transaction *tx = iface->transaction_begin
+    (app_context->storage_context);
+  guint64 encoded_oid = gzochid_util_encode_oid (oid);
+
+  iface->transaction_put
+    (tx, app_context->oids, (char *) &encoded_oid, sizeof (guint64), "x", 2);
+  iface->transaction_prepare (tx);
+  iface->transaction_commit (tx);
+}
+
+static void
+put_name (gzochid_application_context *app_context, char *name, guint64 oid)
+{
+  gzochid_storage_engine_interface *iface =
+    app_context->storage_engine_interface;
+  gzochid_storage_transaction *tx = iface->transaction_begin
+    (app_context->storage_context);
+  guint64 encoded_oid = gzochid_util_encode_oid (oid);
+
+  iface->transaction_put
+    (tx, app_context->names, name, strlen (name) + 1, (char *) &encoded_oid,
+     sizeof (guint64));
+  iface->transaction_prepare (tx);
+  iface->transaction_commit (tx);
+}
+
+static void
+test_httpd_app_fixture_set_up (test_httpd_app_fixture *fixture,
+			       gconstpointer user_data)
+{
+  struct sockaddr addr;
+  socklen_t addrlen = sizeof (struct sockaddr);
+  gzochid_application_context *app_context =
+    gzochid_application_context_new ();
+  gzochid_httpd_partial *app_root = NULL;
+
+  app_context->storage_engine_interface =
+    &gzochid_storage_engine_interface_mem;
+  app_context->storage_context =
+    gzochid_storage_engine_interface_mem.initialize ("/dev/null");
+  app_context->oids = gzochid_storage_engine_interface_mem.open
+    (app_context->storage_context, "/dev/null", 0);
+  app_context->names = gzochid_storage_engine_interface_mem.open
+    (app_context->storage_context, "/dev/null", 0);
+
+  put_oid (app_context, 1);
+  put_oid (app_context, 2);
+  put_oid (app_context, 3);
+
+  put_name (app_context, "o.bar", 1);
+  put_name (app_context, "o.foo", 2);
+
+  fixture->app_context = app_context;
+  fixture->client_socket_fd = socket (AF_INET, SOCK_STREAM, 0);
+  fixture->http_server = g_object_new (GZOCHID_TYPE_HTTP_SERVER, NULL);
+
+  app_root = gzochid_httpd_add_continuation
+    (fixture->http_server, "/app", bind_test_app, app_context);
+  _gzochid_httpd_app_append_key_listings (app_root);
+
+  gzochid_http_server_start (fixture->http_server, 0, NULL);
+
+  _gzochid_http_server_getsockname (fixture->http_server, &addr, &addrlen);
+  connect (fixture->client_socket_fd, &addr, addrlen);
+
+  fixture->client_channel = g_io_channel_unix_new (fixture->client_socket_fd);
+}
+
+static void
+test_httpd_app_fixture_tear_down (test_httpd_app_fixture *fixture,
+				  gconstpointer user_data)
+{
+  gzochid_application_context *app_context = fixture->app_context;
+
+  g_object_unref (fixture->http_server);
+  g_io_channel_unref (fixture->client_channel);
+
+  gzochid_storage_engine_interface_mem.close_store (app_context->oids);
+  gzochid_storage_engine_interface_mem.close_store (app_context->names);
+  gzochid_storage_engine_interface_mem.close_context
+    (app_context->storage_context);
+
+  gzochid_application_context_free (app_context);
+}
+
+/* Sends an HTTP/1.0 GET request for the specified path - so that the response
+   isn't chunk-encoded - and asserts that the response has the specified status
+   line suffix, e.g. " 200 OK\r\n". */
+
+static void
+request (test_httpd_app_fixture *fixture, const char *path,
+	 const char *status_suffix)
+{
+  char *response_line = NULL;
+  gchar *request_str = g_strdup_printf ("GET %s HTTP/1.0\r\n\r\n", path);
+
+  g_io_channel_write_chars
+    (fixture->client_channel, request_str, strlen (request_str), NULL, NULL);
+  g_io_channel_flush (fixture->client_channel, NULL);
+  g_free (request_str);
+
+  g_io_channel_read_line
+    (fixture->client_channel, &response_line, NULL, NULL, NULL);
+  g_assert (response_line != NULL);
+  g_assert (g_str_has_suffix (response_line, status_suffix));
+  g_free (response_line);
+}
+
+/* Skips the response headers and asserts that the response body is the
+   specified line. */
+
+static void
+assert_body (test_httpd_app_fixture *fixture, char *reference)
+{
+  char *response_line = NULL;
+
+  while (TRUE)
+    {
+      g_io_channel_read_line
+	(fixture->client_channel, &response_line, NULL, NULL, NULL);
+      g_assert (response_line != NULL);
+
+      if (strcmp ("\r\n", response_line) == 0)
+	{
+	  g_free (response_line);
+	  break;
+	}
+      else g_free (response_line);
+    }
+
+  g_io_channel_read_line
+    (fixture->client_channel, &response_line, NULL, NULL, NULL);
+  g_assert_cmpstr (response_line, ==, reference);
+  g_free (response_line);
+}
+
+static void
+test_list_oids_first_page (test_httpd_app_fixture *fixture,
+			   gconstpointer user_data)
+{
+  request (fixture, "/app/oids/?limit=2", " 200 OK\r\n");
+  assert_body (fixture, "{\"oids\":[\"1\",\"2\"],\"next\":\"2\"}\n");
+}
+
+static void
+test_list_oids_last_page (test_httpd_app_fixture *fixture,
+			  gconstpointer user_data)
+{
+  request (fixture, "/app/oids/?after=2&limit=2", " 200 OK\r\n");
+  assert_body (fixture, "{\"oids\":[\"3\"],\"next\":null}\n");
+}
+
+static void
+test_list_oids_exact_page (test_httpd_app_fixture *fixture,
+			   gconstpointer user_data)
+{
+  /* A page that ends with the last key has no next page. */
+
+  request (fixture, "/app/oids/?after=1&limit=2", " 200 OK\r\n");
+  assert_body (fixture, "{\"oids\":[\"2\",\"3\"],\"next\":null}\n");
+}
+
+static void
+test_list_oids_bad_after (test_httpd_app_fixture *fixture,
+			  gconstpointer user_data)
+{
+  request (fixture, "/app/oids/?after=xyz", " 400 Bad Request\r\n");
+}
+
+static void
+test_list_oids_failure (test_httpd_app_fixture *fixture,
+			gconstpointer user_data)
+{
+  failing_interface = gzochid_storage_engine_interface_mem;
+  failing_interface.cursor_next = failing_cursor_next;
+  failing_cursor_keys = 1;
+
+  fixture->app_context->storage_engine_interface = &failing_interface;
+
+  /* The transaction fails after the first key of the page has been read; that
+     must not be reported as a short, final page. */
+
+  request (fixture, "/app/oids/?limit=2", " 503 Service Unavailable\r\n");
+}
+
+static void
+test_list_names (test_httpd_app_fixture *fixture, gconstpointer user_data)
+{
+  request (fixture, "/app/names/?limit=1", " 200 OK\r\n");
+  assert_body
+    (fixture,
+     "{\"names\":[{\"name\":\"o.bar\",\"oid\":\"1\"}],\"next\":\"o.bar\"}\n");
+}
+
+static void
+test_list_names_after (test_httpd_app_fixture *fixture,
+		       gconstpointer user_data)
+{
+  request (fixture, "/app/names/?after=o.bar&limit=1", " 200 OK\r\n");
+  assert_body
+    (fixture,
+     "{\"names\":[{\"name\":\"o.foo\",\"oid\":\"2\"}],\"next\":null}\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+#if GLIB_CHECK_VERSION (2, 36, 0)
+  /* No need for `g_type_init'. */
+#else
+  g_type_init ();
+#endif /* GLIB_CHECK_VERSION */
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add
+    ("/httpd-app/list-oids/first-page", test_httpd_app_fixture, NULL,
+     test_httpd_app_fixture_set_up, test_list_oids_first_page,
+     test_httpd_app_fixture_tear_down);
+  g_test_add
+    ("/httpd-app/list-oids/last-page", test_httpd_app_fixture, NULL,
+     test_httpd_app_fixture_set_up, test_list_oids_last_page,
+     test_httpd_app_fixture_tear_down);
+  g_test_add
+    ("/httpd-app/list-oids/exact-page", test_httpd_app_fixture, NULL,
+     test_httpd_app_fixture_set_up, test_list_oids_exact_page,
+     test_httpd_app_fixture_tear_down);
+  g_test_add
+    ("/httpd-app/list-oids/bad-after", test_httpd_app_fixture, NULL,
+     test_httpd_app_fixture_set_up, test_list_oids_bad_after,
+     test_httpd_app_fixture_tear_down);
+  g_test_add
+    ("/httpd-app/list-oids/failure", test_httpd_app_fixture, NULL,
+     test_httpd_app_fixture_set_up, test_list_oids_failure,
+     test_httpd_app_fixture_tear_down);
+  g_test_add
+    ("/httpd-app/list-names/first-page", test_httpd_app_fixture, NULL,
+     test_httpd_app_fixture_set_up, test_list_names,
+     test_httpd_app_fixture_tear_down);
+  g_test_add
+    ("/httpd-app/list-names/after", test_httpd_app_fixture, NULL,
+     test_httpd_app_fixture_set_up, test_list_names_after,
+     test_httpd_app_fixture_tear_down);
+
+  return g_test_run ();
+}
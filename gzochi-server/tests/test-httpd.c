@@ -57,6 +57,37 @@ test_continuation_handler (const GMatchInfo *match_info,
   return "foo";
 }
 
+/* Streams the specified NUL-terminated string a few bytes at a time. */
+
+static ssize_t
+test_stream_producer (gpointer user_data, char *buf, size_t max)
+{
+  char **str = user_data;
+  size_t n = MIN (MIN (max, 3), strlen (*str));
+
+  if (n == 0)
+    return -1;
+
+  memcpy (buf, *str, n);
+  *str += n;
+  
+  return n;
+}
+
+static void
+test_stream_terminal (const GMatchInfo *match_info,
+		      gzochid_http_response_sink *sink,
+		      gpointer request_context, gpointer user_data)
+{
+  char **str = user_data;
+
+  *str = (char *) gzochid_http_get_argument (sink, "msg");
+  g_assert (*str != NULL);
+  
+  gzochid_http_write_response_stream
+    (sink, 200, "text/plain", test_stream_producer, str, NULL);
+}
+
 static void
 test_httpd_fixture_set_up (test_httpd_fixture *fixture, gconstpointer user_data)
 {
@@ -157,6 +188,32 @@ test_add_continuation_simple (test_httpd_fixture *fixture,
   assert_next_line (fixture->client_channel, "SUCCESS\n");
 }
 
+static void
+test_write_response_stream (test_httpd_fixture *fixture,
+			    gconstpointer user_data)
+{
+  char *str = NULL;
+  char *response_line = NULL;
+  
+  gzochid_httpd_add_terminal
+    (fixture->http_server, "/", test_stream_terminal, &str);
+
+  /* Ask for HTTP/1.0, so that the response isn't chunk-encoded. */
+  
+  g_io_channel_write_chars
+    (fixture->client_channel, "GET /?msg=STREAMED%0A HTTP/1.0\r\n\r\n", 34,
+     NULL, NULL);  
+  g_io_channel_flush (fixture->client_channel, NULL);
+
+  g_io_channel_read_line
+    (fixture->client_channel, &response_line, NULL, NULL, NULL);
+  g_assert (g_str_has_suffix (response_line, " 200 OK\r\n"));
+  g_free (response_line);
+  
+  skip_headers (fixture->client_channel);
+  assert_next_line (fixture->client_channel, "STREAMED\n");
+}
+
 static void
 test_get_base_url (test_httpd_fixture *fixture, gconstpointer user_data)
 {
@@ -195,6 +252,10 @@ main (int argc, char *argv[])
     ("/httpd/add_continuation/simple", test_httpd_fixture, NULL,
      test_httpd_fixture_set_up, test_add_continuation_simple,
      test_httpd_fixture_tear_down);
+  g_test_add
+    ("/httpd/write_response_stream/simple", test_httpd_fixture, NULL,
+     test_httpd_fixture_set_up, test_write_response_stream,
+     test_httpd_fixture_tear_down);
   g_test_add
     ("/httpd/get_base_url/simple", test_httpd_fixture, NULL,
      test_httpd_fixture_set_up, test_get_base_url,
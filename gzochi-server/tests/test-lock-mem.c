@@ -317,6 +317,30 @@ test_range_lock_conflict_with_write (test_lock_table_fixture *fixture,
   g_bytes_unref (to);
 }
 
+static void
+test_range_lock_conflict_with_inner_write (test_lock_table_fixture *fixture,
+					   gconstpointer user_data)
+{
+  GBytes *from = g_bytes_new_static ("foo", 4);
+  GBytes *key = g_bytes_new_static ("foo1", 5);
+  GBytes *to = g_bytes_new_static ("foo2", 5);
+  GBytes *from2 = g_bytes_new_static ("foo3", 5);
+  GBytes *to2 = g_bytes_new_static ("foo4", 5);
+
+  gzochid_lock_check_and_set (fixture->lock_table, 1, key, TRUE, NULL);
+
+  g_assert (! gzochid_lock_range_check_and_set
+	    (fixture->lock_table, 2, from, to, NULL));
+  g_assert (gzochid_lock_range_check_and_set
+	    (fixture->lock_table, 2, from2, to2, NULL));
+
+  g_bytes_unref (from);
+  g_bytes_unref (key);
+  g_bytes_unref (to);
+  g_bytes_unref (from2);
+  g_bytes_unref (to2);
+}
+
 static void
 test_range_lock_rebalance (test_lock_table_fixture *fixture,
 			   gconstpointer user_data)
@@ -416,6 +440,107 @@ test_release_all (test_lock_table_fixture *fixture, gconstpointer user_data)
   g_bytes_unref (to);
 }
 
+static void
+collect_conflict (guint node_id, gboolean range, GBytes *from, GBytes *to,
+		  gpointer user_data)
+{
+  GList **conflicts = user_data;
+  *conflicts = g_list_append
+    (*conflicts, GUINT_TO_POINTER (range ? node_id + 100 : node_id));
+}
+
+static void
+test_conflicts_read (test_lock_table_fixture *fixture, gconstpointer user_data)
+{
+  GList *conflicts = NULL;
+  GBytes *key = g_bytes_new_static ("foo", 4);
+
+  gzochid_lock_check_and_set (fixture->lock_table, 1, key, FALSE, NULL);
+  gzochid_lock_check_and_set (fixture->lock_table, 2, key, FALSE, NULL);
+
+  gzochid_lock_foreach_conflict
+    (fixture->lock_table, 3, key, FALSE, collect_conflict, &conflicts);
+  g_assert_null (conflicts);
+
+  gzochid_lock_foreach_conflict
+    (fixture->lock_table, 3, key, TRUE, collect_conflict, &conflicts);
+  g_assert_cmpint (g_list_length (conflicts), ==, 2);
+  g_assert_nonnull (g_list_find (conflicts, GUINT_TO_POINTER (1)));
+  g_assert_nonnull (g_list_find (conflicts, GUINT_TO_POINTER (2)));
+  g_list_free (conflicts);
+  conflicts = NULL;
+
+  gzochid_lock_foreach_conflict
+    (fixture->lock_table, 1, key, TRUE, collect_conflict, &conflicts);
+  g_assert_cmpint (g_list_length (conflicts), ==, 1);
+  g_assert_nonnull (g_list_find (conflicts, GUINT_TO_POINTER (2)));
+  g_list_free (conflicts);
+
+  g_bytes_unref (key);
+}
+
+static void
+test_conflicts_write (test_lock_table_fixture *fixture,
+		      gconstpointer user_data)
+{
+  GList *conflicts = NULL;
+  GBytes *key = g_bytes_new_static ("foo", 4);
+  GBytes *to = g_bytes_new_static ("foo2", 5);
+
+  gzochid_lock_range_check_and_set (fixture->lock_table, 2, key, to, NULL);
+
+  gzochid_lock_foreach_conflict
+    (fixture->lock_table, 1, key, FALSE, collect_conflict, &conflicts);
+  g_assert_null (conflicts);
+
+  gzochid_lock_foreach_conflict
+    (fixture->lock_table, 1, key, TRUE, collect_conflict, &conflicts);
+  g_assert_cmpint (g_list_length (conflicts), ==, 1);
+  g_assert_nonnull (g_list_find (conflicts, GUINT_TO_POINTER (102)));
+  g_list_free (conflicts);
+  
+  g_bytes_unref (key);
+  g_bytes_unref (to);
+}
+
+static void
+test_conflicts_range (test_lock_table_fixture *fixture,
+		      gconstpointer user_data)
+{
+  GList *conflicts = NULL;
+  GBytes *from = g_bytes_new_static ("foo1", 5);
+  GBytes *key2 = g_bytes_new_static ("foo2", 5);
+  GBytes *key3 = g_bytes_new_static ("foo3", 5);
+  GBytes *to = g_bytes_new_static ("foo4", 5);
+  GBytes *key5 = g_bytes_new_static ("foo5", 5);
+
+  gzochid_lock_check_and_set (fixture->lock_table, 1, key2, TRUE, NULL);
+  gzochid_lock_check_and_set (fixture->lock_table, 2, key3, FALSE, NULL);
+  gzochid_lock_check_and_set (fixture->lock_table, 3, key5, FALSE, NULL);
+  gzochid_lock_range_check_and_set (fixture->lock_table, 4, to, key5, NULL);
+
+  gzochid_lock_range_foreach_conflict
+    (fixture->lock_table, 5, from, to, collect_conflict, &conflicts);
+  
+  g_assert_cmpint (g_list_length (conflicts), ==, 2);
+  g_assert_nonnull (g_list_find (conflicts, GUINT_TO_POINTER (1)));
+  g_assert_nonnull (g_list_find (conflicts, GUINT_TO_POINTER (104)));
+  g_list_free (conflicts);
+  conflicts = NULL;
+
+  gzochid_lock_range_foreach_conflict
+    (fixture->lock_table, 4, NULL, NULL, collect_conflict, &conflicts);
+  g_assert_cmpint (g_list_length (conflicts), ==, 1);
+  g_assert_nonnull (g_list_find (conflicts, GUINT_TO_POINTER (1)));
+  g_list_free (conflicts);
+  
+  g_bytes_unref (from);
+  g_bytes_unref (key2);
+  g_bytes_unref (key3);
+  g_bytes_unref (to);
+  g_bytes_unref (key5);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -484,6 +609,10 @@ main (int argc, char *argv[])
     ("/lock-mem/range-lock/conflict-with-write-lock", test_lock_table_fixture,
      NULL, setup_lock_table, test_range_lock_conflict_with_write,
      teardown_lock_table);
+  g_test_add
+    ("/lock-mem/range-lock/conflict-with-inner-write-lock",
+     test_lock_table_fixture, NULL, setup_lock_table,
+     test_range_lock_conflict_with_inner_write, teardown_lock_table);
   g_test_add
     ("/lock-mem/range-lock/rebalance", test_lock_table_fixture, NULL,
      setup_lock_table, test_range_lock_rebalance, teardown_lock_table);
@@ -499,6 +628,15 @@ main (int argc, char *argv[])
   g_test_add
     ("/lock-mem/release-all", test_lock_table_fixture, NULL, setup_lock_table,
      test_release_all, teardown_lock_table);
+  g_test_add
+    ("/lock-mem/conflicts/read", test_lock_table_fixture, NULL,
+     setup_lock_table, test_conflicts_read, teardown_lock_table);
+  g_test_add
+    ("/lock-mem/conflicts/write", test_lock_table_fixture, NULL,
+     setup_lock_table, test_conflicts_write, teardown_lock_table);
+  g_test_add
+    ("/lock-mem/conflicts/range", test_lock_table_fixture, NULL,
+     setup_lock_table, test_conflicts_range, teardown_lock_table);
   
   return g_test_run ();
 }
@@ -46,12 +46,22 @@ test_value_evict_func (gpointer value)
   free (value);
 }
 
+static guint ref_counter;
+
+static gpointer
+test_ref_func (gpointer value)
+{
+  ref_counter++;
+  return value;
+}
+
 static void
 reset_counters ()
 {
   new_value_counter = 0;
   key_eviction_counter = 0;
   value_eviction_counter = 0;
+  ref_counter = 0;
 }
 
 static void
@@ -121,6 +131,102 @@ test_lrucache_destroy_eviction ()
   g_assert_cmpint (3, ==, value_eviction_counter);
 }
 
+static void
+test_lrucache_lookup_ref ()
+{
+  gzochid_lru_cache *cache = NULL;
+
+  reset_counters ();
+  
+  cache = gzochid_lru_cache_new_with_ref
+    (g_str_hash, g_str_equal, test_new_func, 3, test_key_evict_func,
+     test_ref_func, test_value_evict_func);
+
+  g_assert_cmpstr ("aaa", ==, gzochid_lru_cache_lookup (cache, "aaa"));
+  g_assert_cmpint (1, ==, ref_counter);
+  g_assert_cmpstr ("aaa", ==, gzochid_lru_cache_lookup (cache, "aaa"));
+  g_assert_cmpint (2, ==, ref_counter);
+
+  gzochid_lru_cache_destroy (cache);
+}
+
+static gint slow_new_value_counter;
+
+static gpointer
+test_slow_new_func (gpointer key, gpointer *key_copy)
+{
+  g_atomic_int_inc (&slow_new_value_counter);
+
+  /* Give the other lookup threads a chance to find the key loading. */
+  
+  g_usleep (G_USEC_PER_SEC / 10);
+
+  *key_copy = strdup (key);
+  return strdup (key);
+}
+
+static gpointer
+lookup_thread (gpointer data)
+{
+  return gzochid_lru_cache_lookup (data, "aaa");
+}
+
+static void
+test_lrucache_lookup_concurrent ()
+{
+  int i = 0;
+  GThread *threads[4];
+  gpointer values[4];
+  gzochid_lru_cache *cache = gzochid_lru_cache_new_full
+    (g_str_hash, g_str_equal, test_slow_new_func, 3, free,
+     test_value_evict_func);
+
+  slow_new_value_counter = 0;
+  
+  for (i = 0; i < 4; i++)
+    threads[i] = g_thread_new ("lookup", lookup_thread, cache);
+  for (i = 0; i < 4; i++)
+    values[i] = g_thread_join (threads[i]);
+
+  g_assert_cmpint (g_atomic_int_get (&slow_new_value_counter), ==, 1);
+
+  for (i = 1; i < 4; i++)
+    g_assert (values[i] == values[0]);
+  
+  gzochid_lru_cache_destroy (cache);
+}
+
+static void
+test_lrucache_lookup_sharded ()
+{
+  int i = 0;
+  gzochid_lru_cache *cache = NULL;
+
+  reset_counters ();
+  
+  cache = gzochid_lru_cache_new_full
+    (g_str_hash, g_str_equal, test_new_func, 1024, free,
+     test_value_evict_func);
+
+  for (i = 0; i < 4096; i++)
+    {
+      char *key = g_strdup_printf ("key-%d", i);
+      gpointer value = NULL;
+      
+      value = gzochid_lru_cache_lookup (cache, strdup (key));
+      g_assert_cmpstr (key, ==, value);
+      g_free (key);
+    }
+
+  /* Every shard has been overfilled, so the cache holds exactly its maximum
+     size. */
+  
+  g_assert_cmpint (4096, ==, new_value_counter);
+  g_assert_cmpint (4096 - 1024, ==, value_eviction_counter);
+
+  gzochid_lru_cache_destroy (cache);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -128,6 +234,10 @@ main (int argc, char *argv[])
 
   g_test_add_func ("/lrucache/lookup/simple", test_lrucache_lookup_simple);
   g_test_add_func ("/lrucache/lookup/eviction", test_lrucache_lookup_eviction);
+  g_test_add_func ("/lrucache/lookup/ref", test_lrucache_lookup_ref);
+  g_test_add_func ("/lrucache/lookup/concurrent",
+		   test_lrucache_lookup_concurrent);
+  g_test_add_func ("/lrucache/lookup/sharded", test_lrucache_lookup_sharded);
   g_test_add_func ("/lrucache/destroy/eviction",
 		   test_lrucache_destroy_eviction);
   
@@ -116,6 +116,70 @@ test_queue_pop ()
   gzochid_durable_queue_free (queue);
 }
 
+static void
+test_queue_many ()
+{
+  int i = 0;
+  GError *err = NULL;
+  gzochid_durable_queue *queue = gzochid_durable_queue_new (NULL);
+
+  /* Enough elements to span several segments. */
+  
+  for (; i < 200; i++)
+    {
+      gzochid_durable_queue_offer
+	(queue, &string_serialization, g_strdup_printf ("%d", i), &err);
+      g_assert_no_error (err);
+    }
+
+  for (i = 0; i < 200; i++)
+    {
+      char *expected = g_strdup_printf ("%d", i);
+      char *data = gzochid_durable_queue_pop
+	(queue, &string_serialization, &err);
+
+      g_assert_no_error (err);
+      g_assert_cmpstr (data, ==, expected);
+      g_free (expected);
+    }
+
+  g_assert
+    (gzochid_durable_queue_pop (queue, &string_serialization, &err) == NULL);
+  g_assert_no_error (err);
+  
+  gzochid_durable_queue_free (queue);
+}
+
+static void
+test_queue_serialization ()
+{
+  char *data = NULL;
+  GError *err = NULL;
+  GByteArray *bytes = g_byte_array_new ();
+  gzochid_durable_queue *queue = gzochid_durable_queue_new (NULL);
+  gzochid_durable_queue *queue2 = NULL;
+
+  gzochid_durable_queue_offer
+    (queue, &string_serialization, strdup ("foo"), NULL);
+  gzochid_durable_queue_offer
+    (queue, &string_serialization, strdup ("bar"), NULL);
+
+  gzochid_durable_queue_serialization.serializer (NULL, queue, bytes, &err);
+  g_assert_no_error (err);
+  queue2 = gzochid_durable_queue_serialization.deserializer
+    (NULL, bytes, &err);
+  g_assert_no_error (err);
+  
+  data = gzochid_durable_queue_pop (queue2, &string_serialization, NULL);
+  g_assert_cmpstr (data, ==, "foo");
+  data = gzochid_durable_queue_pop (queue2, &string_serialization, NULL);
+  g_assert_cmpstr (data, ==, "bar");
+
+  g_byte_array_unref (bytes);
+  gzochid_durable_queue_free (queue);
+  gzochid_durable_queue_free (queue2);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -124,6 +188,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/queue/offer", test_queue_offer);
   g_test_add_func ("/queue/peek", test_queue_peek);
   g_test_add_func ("/queue/pop", test_queue_pop);
+  g_test_add_func ("/queue/many", test_queue_many);
+  g_test_add_func ("/queue/serialization", test_queue_serialization);
 
   gzochid_test_mock_data_initialize ();
   
@@ -0,0 +1,280 @@
+/* test-schedule.c: Test routines for schedule.c in gzochid.
+ * Copyright (C) 2017 Julian Graham
+ *
+ * gzochi is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "schedule.h"
+#include "task.h"
+#include "threads.h"
+
+#define NUM_LANES 4
+#define TASKS_PER_LANE 25
+
+struct _schedule_fixture
+{
+  GThreadPool *pool;
+  gzochid_task_queue *task_queue;
+
+  GMutex mutex;
+  GCond cond;
+
+  /* Per-lane record of task sequence numbers, in execution order. */
+
+  GArray *executed[NUM_LANES];
+
+  int in_flight[NUM_LANES]; /* Per-lane count of currently executing tasks. */
+  gboolean overlapped; /* Set if two tasks from one lane ever overlap. */
+  int completed; /* Total number of completed tasks. */
+};
+
+typedef struct _schedule_fixture schedule_fixture;
+
+struct _lane_task_data
+{
+  schedule_fixture *fixture;
+  int lane;
+  int sequence;
+};
+
+typedef struct _lane_task_data lane_task_data;
+
+static void
+schedule_fixture_set_up (schedule_fixture *fixture, gconstpointer user_data)
+{
+  int i = 0;
+
+  fixture->pool = gzochid_thread_pool_new (NULL, NUM_LANES, TRUE, NULL);
+  fixture->task_queue = gzochid_schedule_task_queue_new (fixture->pool);
+
+  g_mutex_init (&fixture->mutex);
+  g_cond_init (&fixture->cond);
+
+  for (; i < NUM_LANES; i++)
+    {
+      fixture->executed[i] = g_array_new (FALSE, FALSE, sizeof (int));
+      fixture->in_flight[i] = 0;
+    }
+
+  fixture->overlapped = FALSE;
+  fixture->completed = 0;
+
+  gzochid_schedule_task_queue_start (fixture->task_queue);
+}
+
+static void
+schedule_fixture_tear_down (schedule_fixture *fixture, gconstpointer user_data)
+{
+  int i = 0;
+
+  gzochid_schedule_task_queue_stop (fixture->task_queue);
+  g_thread_pool_free (fixture->pool, FALSE, TRUE);
+  gzochid_schedule_task_queue_free (fixture->task_queue);
+
+  for (; i < NUM_LANES; i++)
+    g_array_unref (fixture->executed[i]);
+
+  g_mutex_clear (&fixture->mutex);
+  g_cond_clear (&fixture->cond);
+}
+
+static void
+lane_task_worker (gpointer data, gpointer user_data)
+{
+  lane_task_data *task_data = data;
+  schedule_fixture *fixture = task_data->fixture;
+
+  g_mutex_lock (&fixture->mutex);
+  if (++fixture->in_flight[task_data->lane] > 1)
+    fixture->overlapped = TRUE;
+  g_mutex_unlock (&fixture->mutex);
+
+  /* Give tasks in the same lane a chance to overlap, if the lane is broken. */
+
+  g_usleep (100);
+
+  g_mutex_lock (&fixture->mutex);
+
+  fixture->in_flight[task_data->lane]--;
+  g_array_append_val (fixture->executed[task_data->lane], task_data->sequence);
+  fixture->completed++;
+
+  g_cond_signal (&fixture->cond);
+  g_mutex_unlock (&fixture->mutex);
+
+  free (task_data);
+}
+
+static void
+test_submit_task_with_affinity (schedule_fixture *fixture,
+				gconstpointer user_data)
+{
+  int i = 0, j = 0;
+
+  for (; i < TASKS_PER_LANE; i++)
+    for (j = 0; j < NUM_LANES; j++)
+      {
+	lane_task_data *task_data = malloc (sizeof (lane_task_data));
+	gzochid_task *task = gzochid_task_immediate_new
+	  (lane_task_worker, task_data);
+
+	task_data->fixture = fixture;
+	task_data->lane = j;
+	task_data->sequence = i;
+
+	gzochid_schedule_submit_task_with_affinity
+	  (fixture->task_queue, j, task);
+	gzochid_task_free (task);
+      }
+
+  g_mutex_lock (&fixture->mutex);
+  while (fixture->completed < NUM_LANES * TASKS_PER_LANE)
+    g_cond_wait (&fixture->cond, &fixture->mutex);
+  g_mutex_unlock (&fixture->mutex);
+
+  g_assert_false (fixture->overlapped);
+
+  for (i = 0; i < NUM_LANES; i++)
+    {
+      g_assert_cmpint (fixture->executed[i]->len, ==, TASKS_PER_LANE);
+
+      for (j = 0; j < TASKS_PER_LANE; j++)
+	g_assert_cmpint (g_array_index (fixture->executed[i], int, j), ==, j);
+    }
+}
+
+struct _ordered_task_data
+{
+  schedule_fixture *fixture;
+  char name; /* Appended to the execution log when the task runs. */
+};
+
+typedef struct _ordered_task_data ordered_task_data;
+
+/* The execution log for `test_submit_task_with_affinity_first'. */
+
+static GString *execution_log;
+
+static void
+ordered_task_worker (gpointer data, gpointer user_data)
+{
+  ordered_task_data *task_data = data;
+  schedule_fixture *fixture = task_data->fixture;
+
+  g_mutex_lock (&fixture->mutex);
+  g_string_append_c (execution_log, task_data->name);
+  fixture->completed++;
+  g_cond_signal (&fixture->cond);
+  g_mutex_unlock (&fixture->mutex);
+}
+
+static void
+submit_ordered_task (schedule_fixture *fixture, ordered_task_data *task_data,
+		     gboolean first)
+{
+  gzochid_task *task = gzochid_task_immediate_new
+    (ordered_task_worker, task_data);
+
+  if (first)
+    gzochid_schedule_submit_task_with_affinity_first
+      (fixture->task_queue, 1, task);
+  else gzochid_schedule_submit_task_with_affinity
+	 (fixture->task_queue, 1, task);
+
+  gzochid_task_free (task);
+}
+
+/* Runs as the first task in lane 1: Queues task `b' behind it, and then task
+   `c' ahead of `b'. */
+
+static void
+lane_head_worker (gpointer data, gpointer user_data)
+{
+  ordered_task_data *task_data = data;
+
+  submit_ordered_task (task_data->fixture, &task_data[1], FALSE);
+  submit_ordered_task (task_data->fixture, &task_data[2], TRUE);
+  ordered_task_worker (data, user_data);
+}
+
+static void
+test_submit_task_with_affinity_first (schedule_fixture *fixture,
+				      gconstpointer user_data)
+{
+  ordered_task_data task_data[3] =
+    { { fixture, 'a' }, { fixture, 'b' }, { fixture, 'c' } };
+  gzochid_task *task = gzochid_task_immediate_new
+    (lane_head_worker, task_data);
+
+  execution_log = g_string_new ("");
+  
+  gzochid_schedule_submit_task_with_affinity (fixture->task_queue, 1, task);
+  gzochid_task_free (task);
+
+  g_mutex_lock (&fixture->mutex);
+  while (fixture->completed < 3)
+    g_cond_wait (&fixture->cond, &fixture->mutex);
+  g_mutex_unlock (&fixture->mutex);
+
+  g_assert_cmpstr (execution_log->str, ==, "acb");
+  g_string_free (execution_log, TRUE);
+}
+
+static void
+noop_worker (gpointer data, gpointer user_data)
+{
+}
+
+static void
+test_task_queue_free_active_lanes ()
+{
+  int i = 0;
+  gzochid_task_queue *task_queue = gzochid_schedule_task_queue_new (NULL);
+
+  /* The queue is never started, so the lanes are still active - each with a
+     current task and a pending one - when the queue is freed. */
+  
+  for (; i < 2 * NUM_LANES; i++)
+    {
+      gzochid_task *task = gzochid_task_immediate_new (noop_worker, NULL);
+      
+      gzochid_schedule_submit_task_with_affinity
+	(task_queue, i % NUM_LANES, task);
+      gzochid_task_free (task);
+    }
+
+  gzochid_schedule_task_queue_free (task_queue);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/schedule/submit-task-with-affinity", schedule_fixture, NULL,
+	      schedule_fixture_set_up, test_submit_task_with_affinity,
+	      schedule_fixture_tear_down);
+  g_test_add ("/schedule/submit-task-with-affinity/first", schedule_fixture,
+	      NULL, schedule_fixture_set_up,
+	      test_submit_task_with_affinity_first, schedule_fixture_tear_down);
+  g_test_add_func ("/schedule/task-queue-free/active-lanes",
+		   test_task_queue_free_active_lanes);
+
+  return g_test_run ();
+}
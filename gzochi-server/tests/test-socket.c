@@ -23,6 +23,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -167,6 +168,124 @@ test_socket_client_dispatch (test_socket_fixture *fixture,
   g_assert_cmpint (fixture->state->error_called, ==, 0);
 }
 
+static void
+test_drained (gpointer user_data)
+{
+  int *drained_called = user_data;
+
+  (*drained_called)++;
+}
+
+static void
+test_socket_client_write_watermarks (test_socket_fixture *fixture,
+				     gconstpointer user_data)
+{
+  int drained_called = 0, attempts = 0;
+  unsigned char buf[16];
+  
+  gzochid_client_socket_set_watermarks
+    (fixture->client_socket, 4, 8, test_drained, &drained_called);
+
+  gzochid_client_socket_write (fixture->client_socket, "abcd", 4);
+  g_assert (!gzochid_client_socket_is_congested (fixture->client_socket));
+
+  gzochid_client_socket_write (fixture->client_socket, "efghijklmnop", 12);
+  g_assert (gzochid_client_socket_is_congested (fixture->client_socket));
+  g_assert_cmpint
+    (gzochid_client_socket_get_send_queue_length (fixture->client_socket), ==,
+     16);
+
+  while (gzochid_client_socket_get_send_queue_length
+	 (fixture->client_socket) > 0)
+    {
+      g_assert_cmpint (++attempts, <, 1000);
+      g_main_context_iteration (fixture->socket_server->main_context, FALSE);
+    }
+
+  g_assert (!gzochid_client_socket_is_congested (fixture->client_socket));
+  g_assert_cmpint (drained_called, ==, 1);
+
+  g_assert_cmpint (read (fixture->client_socket_fd, buf, 16), ==, 16);
+  g_assert (memcmp (buf, "abcdefghijklmnop", 16) == 0);
+}
+
+static void
+test_socket_client_shutdown (test_socket_fixture *fixture,
+			     gconstpointer user_data)
+{
+  int attempts = 0;
+  
+  gzochid_client_socket_shutdown (fixture->client_socket);
+
+  while (fixture->state->error_called == 0)
+    {
+      g_assert_cmpint (++attempts, <, 1000);
+      g_main_context_iteration (fixture->socket_server->main_context, FALSE);
+    }
+
+  g_assert_cmpint (fixture->state->error_called, ==, 1);
+}
+
+static void
+test_socket_client_idle_timeout (test_socket_fixture *fixture,
+				 gconstpointer user_data)
+{
+  int attempts = 0;
+
+  gzochid_client_socket_set_idle_timeout (fixture->client_socket, 50);
+
+  while (fixture->state->error_called == 0)
+    {
+      g_assert_cmpint (++attempts, <, 1000);
+      g_main_context_iteration (fixture->socket_server->main_context, TRUE);
+    }
+
+  g_assert_cmpint (fixture->state->error_called, ==, 1);
+}
+
+static void
+test_socket_server_accept_rate ()
+{
+  test_socket_fixture fixture;
+  struct sockaddr addr;
+  size_t addrlen = sizeof (struct sockaddr);
+  int socket_fd_1 = socket (AF_INET, SOCK_STREAM, 0);
+  int socket_fd_2 = socket (AF_INET, SOCK_STREAM, 0);
+  int attempts = 0;
+  
+  fixture.state = calloc (1, sizeof (test_client_state));
+  fixture.socket_server = g_object_new (GZOCHID_TYPE_SOCKET_SERVER, NULL);
+  fixture.server_socket = gzochid_server_socket_new
+    ("test", test_server_protocol, &fixture);
+
+  gzochid_server_socket_set_accept_rate (fixture.server_socket, 10, 1);
+  gzochid_server_socket_listen
+    (fixture.socket_server, fixture.server_socket, 0);
+  _gzochid_server_socket_getsockname (fixture.server_socket, &addr, &addrlen);
+
+  connect (socket_fd_1, &addr, addrlen);
+  connect (socket_fd_2, &addr, addrlen);
+
+  /* The first connection uses up the only token; the second has to wait for 
+     the next one. */
+  
+  g_assert
+    (g_main_context_iteration (fixture.socket_server->main_context, FALSE));
+  g_assert_cmpint (fixture.state->accept_called, ==, 1);
+  
+  while (fixture.state->accept_called < 2)
+    {
+      g_assert_cmpint (++attempts, <, 1000);
+      g_main_context_iteration (fixture.socket_server->main_context, TRUE);
+    }
+
+  close (socket_fd_1);
+  close (socket_fd_2);
+  
+  g_object_unref (fixture.socket_server);
+  free (fixture.state);
+}
+
 static void
 test_socket_client_listen ()
 {
@@ -295,11 +414,25 @@ main (int argc, char *argv[])
     ("/socket/server/accept", test_socket_fixture, NULL,
      test_socket_fixture_set_up, test_socket_server_accept,
      test_socket_fixture_tear_down);
+  g_test_add_func
+    ("/socket/server/accept-rate", test_socket_server_accept_rate);
   g_test_add
     ("/socket/client/dispatch", test_socket_fixture, NULL,
      test_socket_fixture_set_up, test_socket_client_dispatch,
      test_socket_fixture_tear_down);
   g_test_add_func ("/socket/client/listen", test_socket_client_listen);
+  g_test_add
+    ("/socket/client/write/watermarks", test_socket_fixture, NULL,
+     test_socket_fixture_set_up, test_socket_client_write_watermarks,
+     test_socket_fixture_tear_down);
+  g_test_add
+    ("/socket/client/shutdown", test_socket_fixture, NULL,
+     test_socket_fixture_set_up, test_socket_client_shutdown,
+     test_socket_fixture_tear_down);
+  g_test_add
+    ("/socket/client/idle-timeout", test_socket_fixture, NULL,
+     test_socket_fixture_set_up, test_socket_client_idle_timeout,
+     test_socket_fixture_tear_down);
 
   g_test_add
     ("/socket/reconnectable/simple", test_socket_fixture, NULL,
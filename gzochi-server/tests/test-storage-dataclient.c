@@ -265,20 +265,32 @@ process_response
       client->processing_thread =
 	g_thread_new ("test-response", process_response_async, closure);
     }
-  else client->deferred_response_closures = g_list_append
-	 (client->deferred_response_closures,
-	  create_response_closure
-	  (client, qualified_key,
-	   create_failure_response ((struct timeval) { 0, 0 }),
-	   success_callback, success_data, failure_callback, failure_data,
-	   release_callback, release_data));
+  else
+    {
+      /* Use a non-zero timeout for deferred failures; a zero timeout indicates
+	 a queued request, for which the callback data is not freed. */
+      
+      client->deferred_response_closures = g_list_append
+	(client->deferred_response_closures,
+	 create_response_closure
+	 (client, qualified_key,
+	  create_failure_response ((struct timeval) { 1, 0 }),
+	  success_callback, success_data, failure_callback, failure_data,
+	  release_callback, release_data));
+    }
 }
 
-static const gchar *
+/* Returns a newly-allocated string containing the text of the specified key,
+   which may or may not include a trailing NUL byte - cursor seeks, for example,
+   strip it. The returned string should be freed via `g_free'. */
+
+static gchar *
 key_text (GBytes *key)
 {
   size_t size = 0;
-  const char *ret = g_bytes_get_data (key, &size);
+  const char *data = g_bytes_get_data (key, &size);
+  gchar *ret = g_strndup (data, size);
+
   assert (index (ret, '/') == NULL);
   return ret;
 }
@@ -288,22 +300,37 @@ create_qualified_key (char *app, char *store, GBytes *key)
 {
   if (key == NULL)
     return g_strdup_printf ("/%s/%s/", app, store);
-  else return g_strdup_printf ("/%s/%s/%s", app, store, key_text (key));
+  else
+    {
+      gchar *text = key_text (key);
+      gchar *ret = g_strdup_printf ("/%s/%s/%s", app, store, text);
+
+      g_free (text);
+      return ret;
+    }
 }
 
 static gchar *
 create_qualified_key_range (char *app, char *store, GBytes *from, GBytes *to)
 {
+  gchar *from_text = from == NULL ? NULL : key_text (from);
+  gchar *to_text = to == NULL ? NULL : key_text (to);
+  gchar *ret = NULL;
+  
   if (from == NULL)
     {
       if (to == NULL)
-	return g_strdup_printf ("/%s/%s//", app, store);
-      else return g_strdup_printf ("/%s/%s//%s", app, store, key_text (to));
+	ret = g_strdup_printf ("/%s/%s//", app, store);
+      else ret = g_strdup_printf ("/%s/%s//%s", app, store, to_text);
     }
   else if (to == NULL)
-    return g_strdup_printf ("/%s/%s/%s//", app, store, key_text (from));
-  else return g_strdup_printf
-	 ("/%s/%s/%s/%s", app, store, key_text (from), key_text (to));
+    ret = g_strdup_printf ("/%s/%s/%s//", app, store, from_text);
+  else ret = g_strdup_printf ("/%s/%s/%s/%s", app, store, from_text, to_text);
+
+  g_free (from_text);
+  g_free (to_text);
+  
+  return ret;
 }
 
 static gint
@@ -607,6 +634,43 @@ test_get_uncached_timeout (dataclient_storage_fixture *fixture,
   g_assert_cmpint (g_list_length (fixture->dataclient->requested_keys), ==, 1);
 }
 
+static void
+test_prefetch (dataclient_storage_fixture *fixture, gconstpointer user_data)
+{
+  size_t value_len = 0;  
+  unsigned char *value = NULL;
+  gzochid_storage_transaction *tx = fixture->iface->transaction_begin_timed
+    (fixture->storage_context, (struct timeval) { 1, 0 });
+
+  GBytes *success_bytes = g_bytes_new_static ("bar", 4);
+  dataclient_storage_response *response =
+    create_success_response (success_bytes);
+  
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response);
+
+  fixture->iface->transaction_prefetch (tx, fixture->store, "foo", 4);
+
+  g_assert_cmpint (g_list_length (fixture->dataclient->requested_keys), ==, 1);
+  
+  value = fixture->iface->transaction_get
+    (tx, fixture->store, "foo", 4, &value_len);
+
+  g_assert (value != NULL);
+  g_assert (memcmp (value, "bar", MIN (4, value_len)) == 0);
+
+  free (value);
+  free_response (response);
+  g_bytes_unref (success_bytes);
+  
+  fixture->iface->transaction_rollback (tx);
+
+  /* The read should have been satisfied by the prefetched lock, without 
+     another request. */
+  
+  g_assert_cmpint (g_list_length (fixture->dataclient->requested_keys), ==, 1);
+}
+
 static void
 test_get_for_update_cached (dataclient_storage_fixture *fixture,
 			    gconstpointer user_data)
@@ -1324,6 +1388,160 @@ test_next_key_uncached_timeout (dataclient_storage_fixture *fixture,
   g_assert_cmpint (g_list_length (fixture->dataclient->requested_keys), ==, 1);
 }
 
+static void
+test_cursor_seek_between_keys (dataclient_storage_fixture *fixture,
+			       gconstpointer user_data)
+{
+  size_t key_len = 0, value_len = 0;
+  char *key = NULL, *value = NULL;
+  gzochid_storage_transaction *tx = fixture->iface->transaction_begin
+    (fixture->storage_context);
+  gzochid_storage_cursor *cursor = NULL;
+
+  GBytes *next_key_bytes = g_bytes_new_static ("foo", 4);
+  GBytes *value_bytes = g_bytes_new_static ("bar", 4);
+  dataclient_storage_response *response1 = create_success_response (NULL);
+  dataclient_storage_response *response2 =
+    create_success_response (next_key_bytes);
+  dataclient_storage_response *response3 =
+    create_success_response (value_bytes);
+  dataclient_storage_response *response4 = create_success_response (NULL);
+
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response1);
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response2);
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response3);
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response4);
+
+  cursor = fixture->iface->transaction_cursor_open (tx, fixture->store);
+
+  /* "baz" without its NUL terminator is an inclusive seek: the seek key itself
+     is requested, and then the range that follows it. */
+  
+  fixture->iface->cursor_seek (cursor, "baz", 3);
+  key = fixture->iface->cursor_next (cursor, &key_len, &value, &value_len);
+
+  g_assert (key != NULL);
+  g_assert_cmpint (key_len, ==, 4);
+  g_assert (memcmp (key, "foo", 4) == 0);
+  g_assert (value != NULL);
+  g_assert (memcmp (value, "bar", MIN (4, value_len)) == 0);
+
+  free (key);
+  free (value);
+  
+  g_assert (fixture->iface->cursor_next (cursor, NULL, NULL, NULL) == NULL);
+  g_assert (!tx->rollback);
+
+  fixture->iface->cursor_close (cursor);
+  fixture->iface->transaction_rollback (tx);
+
+  g_assert_cmpint (g_list_length (fixture->dataclient->requested_keys), ==, 4);
+  g_assert_cmpstr
+    (g_list_nth_data (fixture->dataclient->requested_keys, 0), ==,
+     "/test/test/baz");
+  g_assert_cmpstr
+    (g_list_nth_data (fixture->dataclient->requested_keys, 1), ==,
+     "/test/test/baz//");
+  g_assert_cmpstr
+    (g_list_nth_data (fixture->dataclient->requested_keys, 2), ==,
+     "/test/test/foo");
+  g_assert_cmpstr
+    (g_list_nth_data (fixture->dataclient->requested_keys, 3), ==,
+     "/test/test/foo//");
+
+  free_response (response1);
+  free_response (response2);
+  free_response (response3);
+  free_response (response4);
+  
+  g_bytes_unref (next_key_bytes);
+  g_bytes_unref (value_bytes);
+}
+
+static void
+test_cursor_seek_nul (dataclient_storage_fixture *fixture,
+		      gconstpointer user_data)
+{
+  char *key = NULL;
+  gzochid_storage_transaction *tx = fixture->iface->transaction_begin
+    (fixture->storage_context);
+  gzochid_storage_cursor *cursor = NULL;
+
+  GBytes *next_key_bytes = g_bytes_new_static ("foo", 4);
+  GBytes *value_bytes = g_bytes_new_static ("bar", 4);
+  dataclient_storage_response *response1 =
+    create_success_response (next_key_bytes);
+  dataclient_storage_response *response2 =
+    create_success_response (value_bytes);
+
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response1);
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response2);
+
+  cursor = fixture->iface->transaction_cursor_open (tx, fixture->store);
+
+  /* Seeking to "baz\0" (the key "baz" with a NUL appended) positions the 
+     cursor strictly after "baz", so only a range lock should be requested. */
+  
+  fixture->iface->cursor_seek (cursor, "baz\0", 5);
+  key = fixture->iface->cursor_next (cursor, NULL, NULL, NULL);
+
+  g_assert (key != NULL);
+  g_assert (memcmp (key, "foo", 4) == 0);
+  free (key);
+
+  fixture->iface->cursor_close (cursor);
+  fixture->iface->transaction_rollback (tx);
+
+  g_assert_cmpint (g_list_length (fixture->dataclient->requested_keys), ==, 2);
+  g_assert_cmpstr
+    (g_list_nth_data (fixture->dataclient->requested_keys, 0), ==,
+     "/test/test/baz//");
+  g_assert_cmpstr
+    (g_list_nth_data (fixture->dataclient->requested_keys, 1), ==,
+     "/test/test/foo");
+
+  free_response (response1);
+  free_response (response2);
+  
+  g_bytes_unref (next_key_bytes);
+  g_bytes_unref (value_bytes);
+}
+
+static void
+test_cursor_seek_past_end (dataclient_storage_fixture *fixture,
+			   gconstpointer user_data)
+{
+  gzochid_storage_transaction *tx = fixture->iface->transaction_begin
+    (fixture->storage_context);
+  gzochid_storage_cursor *cursor = NULL;
+  dataclient_storage_response *response = create_success_response (NULL);
+
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response);
+
+  cursor = fixture->iface->transaction_cursor_open (tx, fixture->store);
+  fixture->iface->cursor_seek (cursor, "zzz", 4);
+
+  g_assert (fixture->iface->cursor_next (cursor, NULL, NULL, NULL) == NULL);
+  g_assert (!tx->rollback);
+
+  fixture->iface->cursor_close (cursor);
+  fixture->iface->transaction_rollback (tx);
+
+  g_assert_cmpint (g_list_length (fixture->dataclient->requested_keys), ==, 1);
+  g_assert_cmpstr
+    (g_list_nth_data (fixture->dataclient->requested_keys, 0), ==,
+     "/test/test/zzz//");
+
+  free_response (response);
+}
+
 static void
 test_lock_release_eviction (dataclient_storage_fixture *fixture,
 			    gconstpointer user_data)
@@ -1475,6 +1693,84 @@ test_cache_store_consistency (dataclient_storage_fixture *fixture,
   free (value);
 }
 
+static void
+test_cache_store_consistency_purge (dataclient_storage_fixture *fixture,
+				    gconstpointer user_data)
+{
+  GBytes *key_bytes = g_bytes_new_static ("foo", 4);
+  GBytes *value1_bytes = g_bytes_new_static ("bar", 4);
+  GBytes *value2_bytes = g_bytes_new_static ("baz", 4);
+
+  char *value = NULL;
+  size_t value_len = 0;
+  GBytes *value_bytes = NULL;
+  
+  gzochid_storage_transaction *tx = NULL;
+  dataclient_storage_response *response1 =
+    create_success_response (value1_bytes);
+  dataclient_storage_response *response2 =
+    create_success_response (value2_bytes);
+
+  /* Purge every released key as soon as it's released. */
+  
+  gzochid_dataclient_storage_context_set_max_cache_bytes
+    (fixture->storage_context, 0);
+
+  tx = fixture->iface->transaction_begin (fixture->storage_context);  
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response1);
+
+  g_mutex_lock (&fixture->dataclient->process_response_mutex);
+
+  value = fixture->iface->transaction_get_for_update
+    (tx, fixture->store, "foo", 4, NULL);
+  g_cond_wait (&fixture->dataclient->process_response_cond,
+	       &fixture->dataclient->process_response_mutex);
+  
+  g_mutex_unlock (&fixture->dataclient->process_response_mutex);
+  
+  free (value);
+  fixture->iface->transaction_put (tx, fixture->store, "foo", 4, "qux", 4);
+
+  fixture->iface->transaction_prepare (tx);
+  fixture->iface->transaction_commit (tx);
+
+  release_key (fixture->dataclient, "test", "test", key_bytes);
+
+  /* Wait for the purge thread to remove the stored value. */
+  
+  _gzochid_dataclient_storage_context_wait_for_purge
+    (fixture->storage_context);
+  
+  tx = fixture->iface->transaction_begin (fixture->storage_context);
+  fixture->dataclient->responses = g_list_append
+    (fixture->dataclient->responses, response2);
+
+  g_mutex_lock (&fixture->dataclient->process_response_mutex);
+
+  value = fixture->iface->transaction_get
+    (tx, fixture->store, "foo", 4, &value_len);
+  g_cond_wait (&fixture->dataclient->process_response_cond,
+	       &fixture->dataclient->process_response_mutex);  
+  
+  g_mutex_unlock (&fixture->dataclient->process_response_mutex);
+
+  fixture->iface->transaction_rollback (tx);
+  
+  value_bytes = g_bytes_new_static (value, value_len);
+  g_assert (g_bytes_equal (value2_bytes, value_bytes));
+  
+  free_response (response1);
+  free_response (response2);
+  
+  g_bytes_unref (key_bytes);
+  g_bytes_unref (value1_bytes);
+  g_bytes_unref (value2_bytes);
+  g_bytes_unref (value_bytes);
+  
+  free (value);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -1504,6 +1800,11 @@ main (int argc, char *argv[])
      NULL, dataclient_storage_fixture_setup, test_get_uncached_timeout,
      dataclient_storage_fixture_teardown);
 
+  g_test_add
+    ("/storage-dataclient/prefetch", dataclient_storage_fixture, NULL,
+     dataclient_storage_fixture_setup, test_prefetch,
+     dataclient_storage_fixture_teardown);
+
   g_test_add
     ("/storage-dataclient/get-for-update/cached", dataclient_storage_fixture,
      NULL, dataclient_storage_fixture_setup, test_get_for_update_cached,
@@ -1604,6 +1905,19 @@ main (int argc, char *argv[])
      dataclient_storage_fixture, NULL, dataclient_storage_fixture_setup,
      test_next_key_uncached_timeout, dataclient_storage_fixture_teardown);
 
+  g_test_add
+    ("/storage-dataclient/cursor/seek/between-keys",
+     dataclient_storage_fixture, NULL, dataclient_storage_fixture_setup,
+     test_cursor_seek_between_keys, dataclient_storage_fixture_teardown);
+  g_test_add
+    ("/storage-dataclient/cursor/seek/nul", dataclient_storage_fixture, NULL,
+     dataclient_storage_fixture_setup, test_cursor_seek_nul,
+     dataclient_storage_fixture_teardown);
+  g_test_add
+    ("/storage-dataclient/cursor/seek/past-end", dataclient_storage_fixture,
+     NULL, dataclient_storage_fixture_setup, test_cursor_seek_past_end,
+     dataclient_storage_fixture_teardown);
+
   g_test_add
     ("/storage-dataclient/lock-release/eviction", dataclient_storage_fixture,
      NULL, dataclient_storage_fixture_setup, test_lock_release_eviction,
@@ -1617,6 +1931,10 @@ main (int argc, char *argv[])
     ("/storage-dataclient/consistency/cache-store",
      dataclient_storage_fixture, NULL, dataclient_storage_fixture_setup,
      test_cache_store_consistency, dataclient_storage_fixture_teardown);
+  g_test_add
+    ("/storage-dataclient/consistency/cache-store/purge",
+     dataclient_storage_fixture, NULL, dataclient_storage_fixture_setup,
+     test_cache_store_consistency_purge, dataclient_storage_fixture_teardown);
   
   return g_test_run ();
 }
@@ -17,6 +17,7 @@
 
 #include <assert.h>
 #include <glib.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -527,6 +528,72 @@ test_storage_mem_tx_merge_internal
   gzochid_storage_engine_interface_mem.transaction_rollback (tx);  
 }
 
+static void
+test_storage_mem_cursor
+(struct test_storage_fixture *fixture, gconstpointer user_data)
+{
+  int i = 0;
+  char key[9], value[256];
+
+  char *k = NULL, *v = NULL;
+  size_t k_len = 0, v_len = 0;
+  gzochid_storage_cursor *cursor = NULL;
+  gzochid_storage_transaction *tx = 
+    gzochid_storage_engine_interface_mem.transaction_begin (fixture->context);
+
+  /* Enough data to be spread across many leaves. */
+  
+  memset (value, 'x', 256);
+  for (; i < 1000; i++)
+    {
+      sprintf (key, "key-%04d", i);
+      gzochid_storage_engine_interface_mem.transaction_put 
+	(tx, fixture->store, key, 9, value, 256);
+    }
+
+  gzochid_storage_engine_interface_mem.transaction_commit (tx);
+  tx = gzochid_storage_engine_interface_mem.transaction_begin
+    (fixture->context);
+  cursor = gzochid_storage_engine_interface_mem.transaction_cursor_open
+    (tx, fixture->store);
+
+  for (i = 0; (k = gzochid_storage_engine_interface_mem.cursor_next
+	       (cursor, &k_len, &v, &v_len)) != NULL; i++)
+    {
+      sprintf (key, "key-%04d", i);
+
+      g_assert_cmpstr (k, ==, key);
+      g_assert_cmpint (k_len, ==, 9);
+      g_assert_cmpint (v_len, ==, 256);
+
+      free (k);
+      free (v);
+    }
+
+  g_assert_cmpint (i, ==, 1000);
+
+  gzochid_storage_engine_interface_mem.cursor_seek
+    (cursor, "key-0500", 9);
+  k = gzochid_storage_engine_interface_mem.cursor_next
+    (cursor, NULL, NULL, NULL);
+
+  g_assert_cmpstr (k, ==, "key-0500");
+  free (k);
+
+  /* Seeking to a key with a NUL byte appended skips past the key. */
+  
+  gzochid_storage_engine_interface_mem.cursor_seek
+    (cursor, "key-0500\0", 10);
+  k = gzochid_storage_engine_interface_mem.cursor_next
+    (cursor, NULL, NULL, NULL);
+
+  g_assert_cmpstr (k, ==, "key-0501");
+  free (k);
+
+  gzochid_storage_engine_interface_mem.cursor_close (cursor);
+  gzochid_storage_engine_interface_mem.transaction_rollback (tx);  
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -572,5 +639,10 @@ main (int argc, char *argv[])
      test_storage_fixture_setup, test_storage_mem_tx_merge_internal,
      test_storage_fixture_teardown);
 
+  g_test_add
+    ("/storage-mem/cursor", struct test_storage_fixture, NULL,
+     test_storage_fixture_setup, test_storage_mem_cursor,
+     test_storage_fixture_teardown);
+
   return g_test_run ();
 }
@@ -472,6 +472,113 @@ transaction_get_for_update (gzochid_storage_transaction *tx,
   return get_internal (tx, store, key, key_len, value_len);
 }
 
+/* Used to hold contextual data while traversing the GTree on behalf of a 
+   cursor. */
+
+struct _treefile_cursor_context
+{
+  treefile_datum position; /* The cursor position; `NULL' data for none. */
+  gboolean inclusive; /* Whether the position itself may be matched. */
+  treefile_datum *match_key; /* The matched key, if any. */
+  treefile_datum *match_value; /* The matched value, if any. */
+};
+
+typedef struct _treefile_cursor_context treefile_cursor_context;
+
+static gboolean
+key_at_or_after (gpointer key, gpointer value, gpointer data)
+{
+  treefile_cursor_context *context = data;
+  int c = context->position.data == NULL
+    ? -1 : compare_datum (&context->position, key);
+  
+  if (c < 0 || (c == 0 && context->inclusive))
+    {
+      context->match_key = key;
+      context->match_value = value;
+      return TRUE;
+    }
+  else return FALSE;
+}
+
+static gzochid_storage_cursor *
+transaction_cursor_open (gzochid_storage_transaction *tx,
+			 gzochid_storage_store *store)
+{
+  gzochid_storage_cursor *cursor = malloc (sizeof (gzochid_storage_cursor));
+
+  cursor->transaction = tx;
+  cursor->store = store;
+  cursor->cursor = calloc (1, sizeof (treefile_cursor_context));
+
+  return cursor;
+}
+
+static void
+cursor_seek (gzochid_storage_cursor *cursor, char *key, size_t key_len)
+{
+  treefile_cursor_context *context = cursor->cursor;
+
+  free (context->position.data);
+  context->position.data = malloc (sizeof (unsigned char) * key_len);
+  context->position.data_len = key_len;
+  context->inclusive = TRUE;
+  
+  memcpy (context->position.data, key, key_len);
+}
+
+static char *
+cursor_next (gzochid_storage_cursor *cursor, size_t *key_len, char **value,
+	     size_t *value_len)
+{
+  treefile_cursor_context *context = cursor->cursor;
+  GTree *tree = ensure_store_tx (cursor->transaction, cursor->store);
+  char *ret = NULL;
+  
+  context->match_key = NULL;
+  context->match_value = NULL;
+  
+  g_tree_foreach (tree, key_at_or_after, context);
+
+  if (context->match_key == NULL)
+    return NULL;
+
+  ret = malloc (sizeof (unsigned char) * context->match_key->data_len);
+  memcpy (ret, context->match_key->data, context->match_key->data_len);
+
+  if (key_len != NULL)
+    *key_len = context->match_key->data_len;
+  if (value != NULL)
+    {
+      *value = malloc
+	(sizeof (unsigned char) * context->match_value->data_len);
+      memcpy (*value, context->match_value->data,
+	      context->match_value->data_len);
+    }
+  if (value_len != NULL)
+    *value_len = context->match_value->data_len;
+
+  free (context->position.data);
+  context->position.data = malloc
+    (sizeof (unsigned char) * context->match_key->data_len);
+  context->position.data_len = context->match_key->data_len;
+  context->inclusive = FALSE;
+  
+  memcpy (context->position.data, ret, context->position.data_len);
+  
+  return ret;
+}
+
+static void
+cursor_close (gzochid_storage_cursor *cursor)
+{
+  treefile_cursor_context *context = cursor->cursor;
+
+  free (context->position.data);
+  free (context);
+  free (cursor);
+}
+
 static gzochid_storage_engine_interface interface = 
   {
     "treefile",
@@ -494,7 +601,11 @@ static gzochid_storage_engine_interface interface =
     transaction_put,
     transaction_delete,
     transaction_first_key,
-    transaction_next_key
+    transaction_next_key,
+    transaction_cursor_open,
+    cursor_seek,
+    cursor_next,
+    cursor_close
   };
   
 GZOCHID_STORAGE_INIT_ENGINE (interface);